@@ -0,0 +1,11 @@
+#
+# Component Makefile
+#
+# Caching DNS resolver used by usocket, curl, requests and the MQTT transport
+#
+
+COMPONENT_SRCDIRS := .
+COMPONENT_ADD_INCLUDEDIRS := include
+
+# getaddrinfo and gethostbyname are resolved through the DNS cache (dns_cache.c)
+COMPONENT_ADD_LDFLAGS := -l$(COMPONENT_NAME) -Wl,--wrap=lwip_getaddrinfo -Wl,--wrap=lwip_gethostbyname
@@ -0,0 +1,988 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Apache License Version 2.0
+ *
+ * Caching DNS resolver (IPv4) shared by usocket, curl, requests and the MQTT transport
+ *
+ * lwip's resolver doesn't pass the record TTL to the application and every
+ * getaddrinfo blocks the caller until the answer arrives, so the cache uses
+ * its own small DNS client: the queries are sent to the servers lwip got from
+ * DHCP or PPP (or set by dns_cache_set_server) and the answers are received
+ * by the resolver task, which also retransmits the queries and expires the
+ * lookups without an answer.
+ *
+ * As lwip's DNS_SECURE, every lookup uses its own UDP socket bound to a random
+ * source port and a random query id; the answer is only accepted from the server
+ * the query was sent to, with the same question, and only the A record of the
+ * queried name (or of the name on its CNAME chain) is used.
+ *
+ * The answers are kept for the TTL of the A record (the lowest TTL on the
+ * CNAME chain, at most DNS_CACHE_MAX_TTL), the negative answers (NXDOMAIN,
+ * no A record) for the SOA minimum TTL as in RFC 2308, the server failures
+ * for a few seconds. Concurrent lookups of the same name share one query.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#include "lwip/sockets.h"
+#include "lwip/dns.h"
+#include "lwip/netdb.h"
+
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+
+#include "dns_cache.h"
+
+#ifdef CONFIG_MICROPY_USE_DNS_CACHE
+
+#define DNS_CACHE_TASK_STACK    4096
+#define DNS_CACHE_TASK_PRIO     5
+#define DNS_CACHE_POLL_MS       50      // maximal wait, the queries added meanwhile are received at least this often
+#define DNS_CACHE_QUERIES       3       // lookups sent at the same time (sockets), the others wait
+#define DNS_CACHE_CNAME_MAX     8       // followed CNAME records
+#define DNS_MSG_SIZE            512     // maximal UDP message without EDNS
+#define DNS_NAME_SIZE           256     // decoded names of the records (CNAME targets can be long)
+#define DNS_PORT                53
+#define DNS_LOCAL_PORT_MIN      1024    // lowest random source port
+
+#define DNS_TYPE_A              1
+#define DNS_TYPE_CNAME          5
+#define DNS_TYPE_SOA            6
+#define DNS_CLASS_IN            1
+
+#define DNS_RCODE_NXDOMAIN      3
+
+enum {
+    DNS_ENTRY_FREE = 0,
+    DNS_ENTRY_PENDING,
+    DNS_ENTRY_VALID,
+    DNS_ENTRY_NEGATIVE,
+};
+
+typedef struct {
+    char name[DNS_CACHE_NAME_MAX + 1];
+    uint8_t state;
+    int8_t status;                  // status of the negative entry
+    uint8_t tries;                  // sent queries
+    uint8_t sent;                   // servers the query was sent to (bits)
+    uint16_t id;
+    int sock;                       // socket of the pending entry, -1 while it waits for one
+    struct in_addr addr;
+    int64_t expires;                // ms
+    int64_t started;
+    int64_t next_tx;                // next retransmission or timeout of the pending entry
+    int64_t last_used;
+    dns_cache_waiter_t *waiters;
+} dns_entry_t;
+
+extern int MainTaskCore;
+
+static const char *TAG = "DNS_CACHE";
+
+static portMUX_TYPE dns_mux = portMUX_INITIALIZER_UNLOCKED;
+static SemaphoreHandle_t dns_mutex = NULL;
+static SemaphoreHandle_t dns_wake = NULL;
+static TaskHandle_t dns_task = NULL;
+static dns_entry_t *dns_table = NULL;
+static int dns_nsocks = 0;
+static struct sockaddr_in dns_server[DNS_CACHE_SERVERS];
+static dns_cache_stats_t dns_stats;
+
+static int64_t dns_now(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+static void dns_lock(void)
+{
+    xSemaphoreTake(dns_mutex, portMAX_DELAY);
+}
+
+static void dns_unlock(void)
+{
+    xSemaphoreGive(dns_mutex);
+}
+
+/*
+ * Names handled by the cache
+ * '.local' names are resolved by mDNS, too long or malformed names are left to lwip
+ */
+static bool dns_is_name(const char *host)
+{
+    int len = strlen(host);
+    if ((len > 0) && (host[len-1] == '.')) {
+        len--;
+    }
+    if ((len == 0) || (len > DNS_CACHE_NAME_MAX)) {
+        return false;
+    }
+    if ((len >= 6) && (strncasecmp(host + len - 6, ".local", 6) == 0)) {
+        return false;
+    }
+    int label = 0;
+    for (int i = 0; i < len; i++) {
+        if (host[i] == '.') {
+            if (label == 0) {
+                return false;
+            }
+            label = 0;
+        }
+        else if ((unsigned char)host[i] <= ' ') {
+            return false;
+        }
+        else {
+            label++;
+        }
+    }
+    return (label > 0);
+}
+
+// The effective server: the configured one or the one lwip uses
+static bool dns_get_server(int index, struct sockaddr_in *server)
+{
+    portENTER_CRITICAL(&dns_mux);
+    *server = dns_server[index];
+    portEXIT_CRITICAL(&dns_mux);
+    if (server->sin_addr.s_addr != 0) {
+        return true;
+    }
+    const ip_addr_t *ip = dns_getserver(index);
+    if ((ip == NULL) || !IP_IS_V4(ip) || (ip_2_ip4(ip)->addr == 0)) {
+        return false;
+    }
+    memset(server, 0, sizeof(struct sockaddr_in));
+    server->sin_family = AF_INET;
+    server->sin_port = htons(DNS_PORT);
+    server->sin_addr.s_addr = ip_2_ip4(ip)->addr;
+    return true;
+}
+
+static int dns_get_servers(struct sockaddr_in *servers)
+{
+    int n = 0;
+    for (int i = 0; i < DNS_CACHE_SERVERS; i++) {
+        if (dns_get_server(i, &servers[n])) {
+            n++;
+        }
+    }
+    return n;
+}
+
+// Query name in the DNS label format, returns its length
+static int dns_encode_name(const char *name, uint8_t *buf)
+{
+    uint8_t *len = buf;
+    uint8_t *p = buf + 1;
+    *len = 0;
+    for (; *name; name++) {
+        if (*name == '.') {
+            if (name[1] == '\0') {
+                break;
+            }
+            len = p++;
+            *len = 0;
+        }
+        else {
+            *p++ = *name;
+            (*len)++;
+        }
+    }
+    *p++ = 0;
+    return p - buf;
+}
+
+static int dns_skip_name(const uint8_t *msg, int len, int pos)
+{
+    while (pos < len) {
+        uint8_t l = msg[pos];
+        if (l == 0) {
+            return pos + 1;
+        }
+        if ((l & 0xc0) == 0xc0) {
+            // compression pointer ends the name
+            return (pos + 2 <= len) ? pos + 2 : -1;
+        }
+        if (l & 0xc0) {
+            return -1;
+        }
+        pos += l + 1;
+    }
+    return -1;
+}
+
+// Name at pos in the dotted lower case form, the compression pointers are followed
+static bool dns_read_name(const uint8_t *msg, int len, int pos, char *name, int size)
+{
+    int n = 0;
+    int jumps = 0;
+    while (pos < len) {
+        uint8_t l = msg[pos];
+        if (l == 0) {
+            // without the trailing dot
+            name[(n > 0) ? n - 1 : 0] = '\0';
+            return true;
+        }
+        if ((l & 0xc0) == 0xc0) {
+            if ((pos + 2 > len) || (++jumps > 16)) {
+                return false;
+            }
+            pos = ((l & 0x3f) << 8) | msg[pos + 1];
+            continue;
+        }
+        if ((l & 0xc0) || (pos + 1 + l > len) || (n + l + 1 > size)) {
+            return false;
+        }
+        for (int i = 0; i < l; i++) {
+            name[n++] = tolower(msg[pos + 1 + i]);
+        }
+        name[n++] = '.';
+        pos += l + 1;
+    }
+    return false;
+}
+
+// The name is the zone or in the zone
+static bool dns_in_zone(const char *name, const char *zone)
+{
+    int nlen = strlen(name);
+    int zlen = strlen(zone);
+    if (zlen == 0) {
+        return true;
+    }
+    if ((zlen > nlen) || (strcmp(name + nlen - zlen, zone) != 0)) {
+        return false;
+    }
+    return ((zlen == nlen) || (name[nlen - zlen - 1] == '.'));
+}
+
+static uint16_t dns_get16(const uint8_t *p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static uint32_t dns_get32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// Socket of the pending entry, bound to a random source port
+static bool dns_open(dns_entry_t *e)
+{
+    if (dns_nsocks >= DNS_CACHE_QUERIES) {
+        return false;
+    }
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        return false;
+    }
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    for (int i = 0; i < 8; i++) {
+        local.sin_port = htons(DNS_LOCAL_PORT_MIN + (esp_random() % (65536 - DNS_LOCAL_PORT_MIN)));
+        if (bind(sock, (struct sockaddr *)&local, sizeof(local)) == 0) {
+            e->sock = sock;
+            dns_nsocks++;
+            return true;
+        }
+    }
+    close(sock);
+    return false;
+}
+
+static void dns_close(dns_entry_t *e)
+{
+    if (e->sock >= 0) {
+        close(e->sock);
+        e->sock = -1;
+        dns_nsocks--;
+    }
+}
+
+// Send the query for the pending entry, the servers are used in turn
+static void dns_send(dns_entry_t *e, int64_t now)
+{
+    struct sockaddr_in servers[DNS_CACHE_SERVERS];
+    uint8_t query[12 + DNS_CACHE_NAME_MAX + 2 + 4];
+
+    if ((e->sock < 0) && !dns_open(e)) {
+        // all sockets are used, sent when one is closed
+        e->next_tx = now + DNS_CACHE_POLL_MS;
+        return;
+    }
+    int n = dns_get_servers(servers);
+
+    memset(query, 0, 12);
+    query[0] = e->id >> 8;
+    query[1] = e->id & 0xff;
+    query[2] = 0x01;    // RD
+    query[5] = 1;       // QDCOUNT
+    int len = 12 + dns_encode_name(e->name, query + 12);
+    query[len++] = 0;
+    query[len++] = DNS_TYPE_A;
+    query[len++] = 0;
+    query[len++] = DNS_CLASS_IN;
+
+    if (n > 0) {
+        struct sockaddr_in *server = &servers[e->tries % n];
+        e->sent |= 1 << (e->tries % n);
+        if (sendto(e->sock, query, len, MSG_DONTWAIT, (struct sockaddr *)server, sizeof(struct sockaddr_in)) < 0) {
+            ESP_LOGD(TAG, "Query '%s' not sent (%d)", e->name, errno);
+        }
+        dns_stats.queries++;
+    }
+    // without the server the lookup just times out
+    e->next_tx = now + (DNS_CACHE_QUERY_TIMEOUT << e->tries);
+    e->tries++;
+}
+
+// Set the result of the pending entry and call the waiters
+static void dns_complete(dns_entry_t *e, int status, uint32_t ttl, int64_t now)
+{
+    uint32_t elapsed = now - e->started;
+    dns_stats.total_ms += elapsed;
+    if (elapsed > dns_stats.max_ms) {
+        dns_stats.max_ms = elapsed;
+    }
+    if (status == DNS_CACHE_OK) {
+        dns_stats.resolved++;
+    }
+    else if (status == DNS_CACHE_NOT_FOUND) {
+        dns_stats.not_found++;
+    }
+    else if (status == DNS_CACHE_TIMEOUT) {
+        dns_stats.timeouts++;
+    }
+    else {
+        dns_stats.failures++;
+    }
+
+    dns_close(e);
+    struct in_addr addr = e->addr;
+    dns_cache_waiter_t *w = e->waiters;
+    e->waiters = NULL;
+    if (ttl == 0) {
+        e->state = DNS_ENTRY_FREE;
+    }
+    else {
+        e->state = (status == DNS_CACHE_OK) ? DNS_ENTRY_VALID : DNS_ENTRY_NEGATIVE;
+        e->status = status;
+        e->expires = now + (int64_t)ttl * 1000;
+    }
+    ESP_LOGD(TAG, "'%s': status %d, ttl %u, %u ms", e->name, status, ttl, elapsed);
+
+    while (w) {
+        // the waiter can be reused by the callback
+        dns_cache_waiter_t *next = w->next;
+        w->cb(status, (status == DNS_CACHE_OK) ? &addr : NULL, w->arg);
+        w = next;
+    }
+}
+
+// Process the answer received on the socket of the pending entry
+static void dns_answer(dns_entry_t *e, const uint8_t *msg, int len, const struct sockaddr_in *from)
+{
+    struct sockaddr_in servers[DNS_CACHE_SERVERS];
+    int nservers = dns_get_servers(servers);
+    int i;
+
+    for (i = 0; i < nservers; i++) {
+        if ((e->sent & (1 << i)) && (servers[i].sin_addr.s_addr == from->sin_addr.s_addr) && (servers[i].sin_port == from->sin_port)) {
+            break;
+        }
+    }
+    if ((i == nservers) || (len < 12) || ((msg[2] & 0x80) == 0) || (dns_get16(msg) != e->id) || (dns_get16(msg + 4) != 1)) {
+        return;
+    }
+
+    // the question must be the one sent
+    char name[DNS_NAME_SIZE];
+    char target[DNS_NAME_SIZE];
+    int qend = dns_skip_name(msg, len, 12);
+    if ((qend < 0) || (qend + 4 > len) || (dns_get16(msg + qend) != DNS_TYPE_A) || (dns_get16(msg + qend + 2) != DNS_CLASS_IN)) {
+        return;
+    }
+    for (i = 0; e->name[i]; i++) {
+        target[i] = tolower((unsigned char)e->name[i]);
+    }
+    target[i] = '\0';
+    // servers may randomize the letter case (dns 0x20)
+    if (!dns_read_name(msg, len, 12, name, sizeof(name)) || (strcmp(name, target) != 0)) {
+        return;
+    }
+
+    int64_t now = dns_now();
+    int rcode = msg[3] & 0x0f;
+    if ((rcode != 0) && (rcode != DNS_RCODE_NXDOMAIN)) {
+        // SERVFAIL, REFUSED...; ask the other server if there is one
+        if ((nservers > 1) && (e->tries < DNS_CACHE_TRIES)) {
+            e->next_tx = now;
+        }
+        else {
+            dns_complete(e, DNS_CACHE_FAIL, DNS_CACHE_FAIL_TTL, now);
+        }
+        return;
+    }
+
+    /*
+     * Only the records of the queried name and of the names on its CNAME chain are used,
+     * the others are ignored. The chain is followed in any order of the records.
+     */
+    int ancount = dns_get16(msg + 6);
+    int nscount = dns_get16(msg + 8);
+    int pos = qend + 4;
+    uint32_t ttl = DNS_CACHE_MAX_TTL;
+    bool found = false;
+    for (int hop = 0; (hop <= DNS_CACHE_CNAME_MAX) && !found; hop++) {
+        bool next = false;
+        pos = qend + 4;
+        for (i = 0; i < ancount; i++) {
+            bool owner = dns_read_name(msg, len, pos, name, sizeof(name)) && (strcmp(name, target) == 0);
+            pos = dns_skip_name(msg, len, pos);
+            if ((pos < 0) || (pos + 10 > len)) {
+                break;
+            }
+            uint16_t type = dns_get16(msg + pos);
+            uint16_t class = dns_get16(msg + pos + 2);
+            uint32_t rttl = dns_get32(msg + pos + 4);
+            int rdlen = dns_get16(msg + pos + 8);
+            pos += 10;
+            if (pos + rdlen > len) {
+                break;
+            }
+            if ((owner) && (class == DNS_CLASS_IN)) {
+                if ((type == DNS_TYPE_A) && (rdlen == 4)) {
+                    memcpy(&e->addr, msg + pos, 4);
+                    if (rttl < ttl) {
+                        ttl = rttl;
+                    }
+                    found = true;
+                    break;
+                }
+                if ((type == DNS_TYPE_CNAME) && !next && dns_read_name(msg, len, pos, name, sizeof(name))) {
+                    if (rttl < ttl) {
+                        ttl = rttl;
+                    }
+                    next = true;
+                    // the record of the alias is looked for in the next pass
+                    strcpy(target, name);
+                }
+            }
+            pos += rdlen;
+        }
+        if (!next) {
+            break;
+        }
+    }
+
+    if (found) {
+        dns_complete(e, DNS_CACHE_OK, ttl, now);
+        return;
+    }
+
+    // the SOA record of the zone of the (last) name gives the negative answer TTL
+    pos = qend + 4;
+    for (i = 0; i < ancount + nscount; i++) {
+        bool zone = (i >= ancount) && dns_read_name(msg, len, pos, name, sizeof(name)) && dns_in_zone(target, name);
+        pos = dns_skip_name(msg, len, pos);
+        if ((pos < 0) || (pos + 10 > len)) {
+            break;
+        }
+        uint16_t type = dns_get16(msg + pos);
+        uint32_t rttl = dns_get32(msg + pos + 4);
+        int rdlen = dns_get16(msg + pos + 8);
+        pos += 10;
+        if (pos + rdlen > len) {
+            break;
+        }
+        if ((zone) && (type == DNS_TYPE_SOA) && (rdlen >= 20)) {
+            // negative answer TTL: min(SOA TTL, SOA MINIMUM)
+            uint32_t minimum = dns_get32(msg + pos + rdlen - 4);
+            ttl = (rttl < minimum) ? rttl : minimum;
+            if (ttl > DNS_CACHE_NEG_MAX_TTL) {
+                ttl = DNS_CACHE_NEG_MAX_TTL;
+            }
+            dns_complete(e, DNS_CACHE_NOT_FOUND, ttl, now);
+            return;
+        }
+        pos += rdlen;
+    }
+
+    if ((rcode == DNS_RCODE_NXDOMAIN) || ((msg[2] & 0x02) == 0)) {
+        // no such name, or no A record, without the SOA record
+        dns_complete(e, DNS_CACHE_NOT_FOUND, DNS_CACHE_NEG_TTL, now);
+    }
+    else {
+        // truncated answer without the A record
+        dns_complete(e, DNS_CACHE_FAIL, DNS_CACHE_FAIL_TTL, now);
+    }
+}
+
+/*
+ * Retransmit the queries and time out the lookups, the sockets of the pending lookups are added to rfds
+ * Returns the time to the next deadline in ms, -1 if there are no pending lookups
+ */
+static int dns_process(fd_set *rfds, int *maxfd)
+{
+    int64_t wait = -1;
+    dns_lock();
+    int64_t now = dns_now();
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        dns_entry_t *e = &dns_table[i];
+        if (e->state != DNS_ENTRY_PENDING) {
+            continue;
+        }
+        if (e->next_tx <= now) {
+            if ((e->tries >= DNS_CACHE_TRIES) || ((e->sock < 0) && (now - e->started >= DNS_CACHE_RESOLVE_TIMEOUT))) {
+                dns_complete(e, DNS_CACHE_TIMEOUT, 0, now);
+                continue;
+            }
+            dns_send(e, now);
+        }
+        if (e->sock >= 0) {
+            FD_SET(e->sock, rfds);
+            if (e->sock > *maxfd) {
+                *maxfd = e->sock;
+            }
+        }
+        if ((wait < 0) || (e->next_tx - now < wait)) {
+            wait = e->next_tx - now;
+        }
+    }
+    dns_unlock();
+    return wait;
+}
+
+//----------------------------------------
+static void dns_cache_task(void *pvParameters)
+{
+    uint8_t msg[DNS_MSG_SIZE];
+    struct sockaddr_in from;
+    socklen_t fromlen;
+    fd_set rfds;
+    struct timeval tv;
+
+    while (1) {
+        int maxfd = -1;
+        FD_ZERO(&rfds);
+        int wait = dns_process(&rfds, &maxfd);
+        if (wait < 0) {
+            // nothing to do until the next lookup
+            xSemaphoreTake(dns_wake, portMAX_DELAY);
+            continue;
+        }
+        // the lookups started meanwhile have the sockets not yet in rfds
+        if (wait > DNS_CACHE_POLL_MS) {
+            wait = DNS_CACHE_POLL_MS;
+        }
+        tv.tv_sec = wait / 1000;
+        tv.tv_usec = (wait % 1000) * 1000;
+        if ((maxfd < 0) || (select(maxfd + 1, &rfds, NULL, NULL, &tv) <= 0)) {
+            if (maxfd < 0) {
+                vTaskDelay((wait + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS);
+            }
+            continue;
+        }
+        dns_lock();
+        for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+            dns_entry_t *e = &dns_table[i];
+            // the entry can be completed by the previous answer
+            while ((e->state == DNS_ENTRY_PENDING) && (e->sock >= 0) && FD_ISSET(e->sock, &rfds)) {
+                fromlen = sizeof(from);
+                int len = recvfrom(e->sock, msg, sizeof(msg), MSG_DONTWAIT, (struct sockaddr *)&from, &fromlen);
+                if (len < 0) {
+                    break;
+                }
+                dns_answer(e, msg, len, &from);
+            }
+        }
+        dns_unlock();
+    }
+}
+
+// Create the mutex and the resolver task on the first lookup
+static bool dns_start(void)
+{
+    if (dns_task) {
+        return true;
+    }
+    if (dns_mutex == NULL) {
+        SemaphoreHandle_t mutex = xSemaphoreCreateMutex();
+        if (mutex == NULL) {
+            return false;
+        }
+        portENTER_CRITICAL(&dns_mux);
+        if (dns_mutex == NULL) {
+            dns_mutex = mutex;
+            mutex = NULL;
+        }
+        portEXIT_CRITICAL(&dns_mux);
+        if (mutex) {
+            vSemaphoreDelete(mutex);
+        }
+    }
+
+    dns_lock();
+    if (dns_table == NULL) {
+        dns_table = calloc(DNS_CACHE_SIZE, sizeof(dns_entry_t));
+    }
+    if ((dns_table) && (dns_wake == NULL)) {
+        dns_wake = xSemaphoreCreateBinary();
+    }
+    if ((dns_wake) && (dns_task == NULL)) {
+        #if CONFIG_MICROPY_USE_BOTH_CORES
+        xTaskCreate(dns_cache_task, "dns_cache", DNS_CACHE_TASK_STACK, NULL, DNS_CACHE_TASK_PRIO, &dns_task);
+        #else
+        xTaskCreatePinnedToCore(dns_cache_task, "dns_cache", DNS_CACHE_TASK_STACK, NULL, DNS_CACHE_TASK_PRIO, &dns_task, MainTaskCore);
+        #endif
+        if (dns_task == NULL) {
+            ESP_LOGE(TAG, "Error starting resolver task");
+        }
+    }
+    dns_unlock();
+    return (dns_task != NULL);
+}
+
+// Entry for the new lookup: free, expired or the least recently used one
+static dns_entry_t *dns_alloc(int64_t now)
+{
+    dns_entry_t *lru = NULL;
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        dns_entry_t *e = &dns_table[i];
+        if ((e->state == DNS_ENTRY_FREE) || ((e->state != DNS_ENTRY_PENDING) && (e->expires <= now))) {
+            return e;
+        }
+        if ((e->state != DNS_ENTRY_PENDING) && ((lru == NULL) || (e->last_used < lru->last_used))) {
+            lru = e;
+        }
+    }
+    return lru;
+}
+
+static dns_entry_t *dns_find(const char *host)
+{
+    int len = strlen(host);
+    if (host[len-1] == '.') {
+        len--;
+    }
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        dns_entry_t *e = &dns_table[i];
+        if ((e->state != DNS_ENTRY_FREE) && (strncasecmp(e->name, host, len) == 0) && (e->name[len] == '\0')) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static int dns_lookup(const char *host, struct in_addr *addr, dns_cache_waiter_t *waiter, dns_cache_cb_t cb, void *arg, bool probe)
+{
+    if (inet_aton(host, addr)) {
+        return DNS_CACHE_OK;
+    }
+    if (strcasecmp(host, "localhost") == 0) {
+        addr->s_addr = htonl(INADDR_LOOPBACK);
+        return DNS_CACHE_OK;
+    }
+    if (!dns_is_name(host)) {
+        return DNS_CACHE_ERROR;
+    }
+    if (dns_task == NULL) {
+        // the task is not created before the network has the DNS server
+        struct sockaddr_in servers[DNS_CACHE_SERVERS];
+        if ((dns_get_servers(servers) == 0) || !dns_start()) {
+            return DNS_CACHE_ERROR;
+        }
+    }
+
+    int status = DNS_CACHE_PENDING;
+    dns_lock();
+    int64_t now = dns_now();
+    dns_entry_t *e = dns_find(host);
+    if ((e) && (e->state != DNS_ENTRY_PENDING)) {
+        if (e->expires > now) {
+            e->last_used = now;
+            if (e->state == DNS_ENTRY_VALID) {
+                *addr = e->addr;
+                status = DNS_CACHE_OK;
+                dns_stats.hits++;
+            }
+            else {
+                status = e->status;
+                dns_stats.negative_hits++;
+            }
+            goto exit;
+        }
+        // expired, looked up again in the same entry
+        e->state = DNS_ENTRY_FREE;
+    }
+    if (probe) {
+        // only the cached names
+        goto exit;
+    }
+    if (e == NULL) {
+        struct sockaddr_in servers[DNS_CACHE_SERVERS];
+        if (dns_get_servers(servers) == 0) {
+            status = DNS_CACHE_ERROR;
+            goto exit;
+        }
+        e = dns_alloc(now);
+        if (e == NULL) {
+            // all entries wait for the answer
+            status = DNS_CACHE_ERROR;
+            goto exit;
+        }
+        // the expired or evicted entry is reused
+        e->state = DNS_ENTRY_FREE;
+        strncpy(e->name, host, DNS_CACHE_NAME_MAX);
+        e->name[DNS_CACHE_NAME_MAX] = '\0';
+        int len = strlen(e->name);
+        if (e->name[len-1] == '.') {
+            e->name[len-1] = '\0';
+        }
+    }
+    if (e->state == DNS_ENTRY_FREE) {
+        e->state = DNS_ENTRY_PENDING;
+        e->tries = 0;
+        e->sent = 0;
+        e->sock = -1;
+        e->id = esp_random() & 0xffff;
+        e->started = now;
+        e->last_used = now;
+        e->waiters = NULL;
+        dns_send(e, now);
+    }
+    dns_stats.misses++;
+    if ((waiter) && (cb)) {
+        waiter->cb = cb;
+        waiter->arg = arg;
+        waiter->next = e->waiters;
+        e->waiters = waiter;
+    }
+
+exit:
+    dns_unlock();
+    if ((status == DNS_CACHE_PENDING) && !probe) {
+        xSemaphoreGive(dns_wake);
+    }
+    return status;
+}
+
+//============================================================================================================
+int dns_cache_resolve_async(const char *host, struct in_addr *addr, dns_cache_waiter_t *waiter, dns_cache_cb_t cb, void *arg)
+{
+    return dns_lookup(host, addr, waiter, cb, arg, false);
+}
+
+typedef struct {
+    SemaphoreHandle_t sem;
+    int status;
+    struct in_addr addr;
+} dns_wait_t;
+
+static void dns_wait_cb(int status, const struct in_addr *addr, void *arg)
+{
+    dns_wait_t *w = (dns_wait_t *)arg;
+    w->status = status;
+    if (addr) {
+        w->addr = *addr;
+    }
+    xSemaphoreGive(w->sem);
+}
+
+//=========================================================================
+int dns_cache_resolve(const char *host, struct in_addr *addr, int timeout_ms)
+{
+    // the cached names are returned without creating the semaphore and starting the query
+    int status = dns_lookup(host, addr, NULL, NULL, NULL, true);
+    if (status != DNS_CACHE_PENDING) {
+        return status;
+    }
+
+    dns_cache_waiter_t waiter;
+    dns_wait_t w;
+    w.sem = xSemaphoreCreateBinary();
+    if (w.sem == NULL) {
+        return DNS_CACHE_ERROR;
+    }
+    status = dns_lookup(host, addr, &waiter, dns_wait_cb, &w, false);
+    if (status == DNS_CACHE_PENDING) {
+        TickType_t ticks = (timeout_ms < 0) ? portMAX_DELAY : (timeout_ms + portTICK_PERIOD_MS - 1) / portTICK_PERIOD_MS;
+        if (xSemaphoreTake(w.sem, ticks) != pdTRUE) {
+            dns_cache_cancel(&waiter);
+            // the callback may have been called before the waiter was removed
+            if (xSemaphoreTake(w.sem, 0) != pdTRUE) {
+                w.status = DNS_CACHE_TIMEOUT;
+            }
+        }
+        status = w.status;
+        if (status == DNS_CACHE_OK) {
+            *addr = w.addr;
+        }
+    }
+    vSemaphoreDelete(w.sem);
+    return status;
+}
+
+//==============================================
+void dns_cache_cancel(dns_cache_waiter_t *waiter)
+{
+    if (dns_table == NULL) {
+        return;
+    }
+    dns_lock();
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        dns_cache_waiter_t **w = &dns_table[i].waiters;
+        while (*w) {
+            if (*w == waiter) {
+                *w = waiter->next;
+                // the query is not cancelled, the answer will be cached
+                dns_unlock();
+                return;
+            }
+            w = &(*w)->next;
+        }
+    }
+    dns_unlock();
+}
+
+//=========================
+void dns_cache_flush(void)
+{
+    if (dns_table == NULL) {
+        return;
+    }
+    dns_lock();
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (dns_table[i].state != DNS_ENTRY_PENDING) {
+            dns_table[i].state = DNS_ENTRY_FREE;
+        }
+    }
+    dns_unlock();
+}
+
+//===================================================
+void dns_cache_get_stats(dns_cache_stats_t *stats)
+{
+    if (dns_table == NULL) {
+        memset(stats, 0, sizeof(dns_cache_stats_t));
+        return;
+    }
+    dns_lock();
+    *stats = dns_stats;
+    stats->entries = 0;
+    int64_t now = dns_now();
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if ((dns_table[i].state >= DNS_ENTRY_VALID) && (dns_table[i].expires > now)) {
+            stats->entries++;
+        }
+    }
+    dns_unlock();
+}
+
+/*
+ * Set the DNS server used by the cache instead of the lwip's one
+ * NULL or 0.0.0.0 address reverts to the lwip's server
+ */
+//==================================================================
+void dns_cache_set_server(int index, const struct sockaddr_in *server)
+{
+    if ((index < 0) || (index >= DNS_CACHE_SERVERS)) {
+        return;
+    }
+    // the address is read by the resolver task, changed as a whole
+    portENTER_CRITICAL(&dns_mux);
+    if (server) {
+        dns_server[index] = *server;
+        dns_server[index].sin_family = AF_INET;
+        if (dns_server[index].sin_port == 0) {
+            dns_server[index].sin_port = htons(DNS_PORT);
+        }
+    }
+    else {
+        memset(&dns_server[index], 0, sizeof(struct sockaddr_in));
+    }
+    portEXIT_CRITICAL(&dns_mux);
+}
+
+//===========================================================
+bool dns_cache_get_server(int index, struct sockaddr_in *server)
+{
+    if ((index < 0) || (index >= DNS_CACHE_SERVERS)) {
+        return false;
+    }
+    return dns_get_server(index, server);
+}
+
+#endif // CONFIG_MICROPY_USE_DNS_CACHE
+
+/*
+ * lwip's getaddrinfo and gethostbyname are wrapped (-Wl,--wrap, see component.mk),
+ * so curl, the esp_http_client used by requests and the other libraries resolving
+ * the names themselves also use the cache. The names not handled by the cache
+ * are passed to lwip.
+ */
+int __real_lwip_getaddrinfo(const char *nodename, const char *servname, const struct addrinfo *hints, struct addrinfo **res);
+struct hostent *__real_lwip_gethostbyname(const char *name);
+
+//=====================================================================================================================
+int __wrap_lwip_getaddrinfo(const char *nodename, const char *servname, const struct addrinfo *hints, struct addrinfo **res)
+{
+    #ifdef CONFIG_MICROPY_USE_DNS_CACHE
+    char ip[16];
+    if ((nodename) && ((hints == NULL) || (hints->ai_family == AF_UNSPEC) || (hints->ai_family == AF_INET))) {
+        struct in_addr addr;
+        int status = dns_cache_resolve(nodename, &addr, DNS_CACHE_RESOLVE_TIMEOUT);
+        if (status == DNS_CACHE_OK) {
+            // lwip creates the result from the numeric address
+            inet_ntoa_r(addr, ip, sizeof(ip));
+            nodename = ip;
+        }
+        else if (status != DNS_CACHE_ERROR) {
+            *res = NULL;
+            return (status == DNS_CACHE_NOT_FOUND) ? EAI_NONAME : EAI_FAIL;
+        }
+    }
+    #endif
+    return __real_lwip_getaddrinfo(nodename, servname, hints, res);
+}
+
+//=========================================================
+struct hostent *__wrap_lwip_gethostbyname(const char *name)
+{
+    #ifdef CONFIG_MICROPY_USE_DNS_CACHE
+    // not reentrant, as lwip's gethostbyname
+    static struct hostent host;
+    static struct in_addr host_addr;
+    static char *host_addr_list[2];
+    static char *host_aliases = NULL;
+    static char host_name[DNS_CACHE_NAME_MAX + 1];
+
+    int status = dns_cache_resolve(name, &host_addr, DNS_CACHE_RESOLVE_TIMEOUT);
+    if (status == DNS_CACHE_OK) {
+        strncpy(host_name, name, DNS_CACHE_NAME_MAX);
+        host_name[DNS_CACHE_NAME_MAX] = '\0';
+        host_addr_list[0] = (char *)&host_addr;
+        host_addr_list[1] = NULL;
+        host.h_name = host_name;
+        host.h_aliases = &host_aliases;
+        host.h_addrtype = AF_INET;
+        host.h_length = sizeof(struct in_addr);
+        host.h_addr_list = host_addr_list;
+        return &host;
+    }
+    if (status != DNS_CACHE_ERROR) {
+        return NULL;
+    }
+    #endif
+    return __real_lwip_gethostbyname(name);
+}
@@ -0,0 +1,88 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Apache License Version 2.0
+ *
+ * Caching DNS resolver (IPv4) shared by usocket, curl, requests and the MQTT transport
+ */
+
+#ifndef _DNS_CACHE_H_
+#define _DNS_CACHE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "lwip/sockets.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+#ifdef CONFIG_MICROPY_DNS_CACHE_SIZE
+#define DNS_CACHE_SIZE              CONFIG_MICROPY_DNS_CACHE_SIZE
+#else
+#define DNS_CACHE_SIZE              16
+#endif
+#ifdef CONFIG_MICROPY_DNS_CACHE_MAX_TTL
+#define DNS_CACHE_MAX_TTL           CONFIG_MICROPY_DNS_CACHE_MAX_TTL
+#else
+#define DNS_CACHE_MAX_TTL           600     // seconds, longer TTLs are shortened
+#endif
+#define DNS_CACHE_NAME_MAX          63
+#define DNS_CACHE_SERVERS           2
+#define DNS_CACHE_NEG_TTL           30      // seconds, negative answer without the SOA record
+#define DNS_CACHE_NEG_MAX_TTL       300     // seconds
+#define DNS_CACHE_FAIL_TTL          5       // seconds, server failure
+#define DNS_CACHE_QUERY_TIMEOUT     2000    // ms to the first retransmission, doubled for each next one
+#define DNS_CACHE_TRIES             3
+#define DNS_CACHE_RESOLVE_TIMEOUT   15000   // ms, default timeout of the blocking lookup
+
+// Lookup status
+#define DNS_CACHE_OK                0
+#define DNS_CACHE_PENDING           1       // the callback will be called with the result
+#define DNS_CACHE_NOT_FOUND         (-1)    // the name doesn't exist or has no IPv4 address
+#define DNS_CACHE_TIMEOUT           (-2)    // no answer from the DNS servers
+#define DNS_CACHE_FAIL              (-3)    // server failure or invalid answer
+#define DNS_CACHE_ERROR             (-4)    // not handled by the cache (mDNS or too long name, no DNS server,
+                                            // out of memory), the caller should use lwip's resolver
+
+/*
+ * Called from the resolver task with the result of the lookup, addr is NULL if not found.
+ * The cache is locked while the callback runs, it must be short and must not call
+ * the dns_cache functions.
+ */
+typedef void (*dns_cache_cb_t)(int status, const struct in_addr *addr, void *arg);
+
+// Provided by the caller, must stay valid until the callback is called or the lookup is cancelled
+typedef struct dns_cache_waiter {
+    struct dns_cache_waiter *next;
+    dns_cache_cb_t cb;
+    void *arg;
+} dns_cache_waiter_t;
+
+typedef struct {
+    uint32_t hits;
+    uint32_t negative_hits;
+    uint32_t misses;
+    uint32_t queries;       // sent queries, retransmissions included
+    uint32_t timeouts;
+    uint32_t not_found;
+    uint32_t failures;
+    uint32_t entries;       // valid (positive and negative) entries
+    uint32_t resolved;      // lookups answered by a server
+    uint32_t total_ms;      // time to get the answers from the servers
+    uint32_t max_ms;
+} dns_cache_stats_t;
+
+int dns_cache_resolve(const char *host, struct in_addr *addr, int timeout_ms);
+int dns_cache_resolve_async(const char *host, struct in_addr *addr, dns_cache_waiter_t *waiter, dns_cache_cb_t cb, void *arg);
+void dns_cache_cancel(dns_cache_waiter_t *waiter);
+void dns_cache_flush(void);
+void dns_cache_get_stats(dns_cache_stats_t *stats);
+void dns_cache_set_server(int index, const struct sockaddr_in *server);
+bool dns_cache_get_server(int index, struct sockaddr_in *server);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
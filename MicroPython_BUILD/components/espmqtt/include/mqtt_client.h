@@ -100,6 +100,8 @@ typedef struct {
     int task_prio;
     int task_stack;
     int buffer_size;
+    int batch_size;             /*!< size of the publish queue buffer, 0 for default */
+    int max_inflight;           /*!< max. number of unacknowledged QoS1/QoS2 messages, 0 for default */
     const char *cert_pem;
     esp_mqtt_transport_t transport;
 } esp_mqtt_client_config_t;
@@ -135,6 +137,12 @@ typedef struct {
     int network_timeout_ms;
 } mqtt_config_storage_t;
 
+typedef struct {
+    uint32_t messages;          /*!< PUBLISH messages written */
+    uint32_t writes;            /*!< transport writes of the publish queue */
+    uint32_t bytes;             /*!< bytes written */
+} esp_mqtt_publish_stats_t;
+
 struct esp_mqtt_client {
     transport_list_handle_t transport_list;
     transport_handle_t transport;
@@ -150,6 +158,13 @@ struct esp_mqtt_client {
     bool run;
     outbox_handle_t outbox;
     EventGroupHandle_t status_bits;
+    SemaphoreHandle_t lock;
+    uint8_t *batch_buffer;
+    int batch_size;
+    int batch_len;
+    long long batch_tick;
+    int max_inflight;
+    esp_mqtt_publish_stats_t publish_stats;
     void *mpy_mqtt_obj;
 };
 
@@ -162,6 +177,9 @@ esp_err_t esp_mqtt_client_stop(esp_mqtt_client_handle_t client);
 esp_err_t esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos);
 esp_err_t esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *topic);
 int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain);
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain);
+esp_err_t esp_mqtt_client_flush(esp_mqtt_client_handle_t client);
+int esp_mqtt_client_get_inflight(esp_mqtt_client_handle_t client);
 esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client);
 
 #endif
@@ -63,6 +63,21 @@
 #define MQTT_ENABLE_WS              CONFIG_MQTT_TRANSPORT_WEBSOCKET
 #define MQTT_ENABLE_WSS             CONFIG_MQTT_TRANSPORT_WEBSOCKET_SECURE
 
+#if CONFIG_MQTT_PUBLISH_BATCH_SIZE
+#define MQTT_PUBLISH_BATCH_SIZE     CONFIG_MQTT_PUBLISH_BATCH_SIZE
+#else
+#define MQTT_PUBLISH_BATCH_SIZE     2048
+#endif
+
+#if CONFIG_MQTT_MAX_INFLIGHT
+#define MQTT_MAX_INFLIGHT           CONFIG_MQTT_MAX_INFLIGHT
+#else
+#define MQTT_MAX_INFLIGHT           16
+#endif
+
+// queued PUBLISH messages are written to the transport after this time at the latest
+#define MQTT_PUBLISH_BATCH_DELAY_MS (10)
+
 #define OUTBOX_EXPIRED_TIMEOUT_MS   (30*1000)
 #define OUTBOX_MAX_SIZE             (4*1024)
 #endif
@@ -38,6 +38,7 @@ esp_err_t outbox_delete_expired(outbox_handle_t outbox, int current_tick, int ti
 
 esp_err_t outbox_set_pending(outbox_handle_t outbox, int msg_id);
 int outbox_get_size(outbox_handle_t outbox);
+int outbox_get_count(outbox_handle_t outbox, int msg_type);
 esp_err_t outbox_cleanup(outbox_handle_t outbox, int max_size);
 void outbox_destroy(outbox_handle_t outbox);
 
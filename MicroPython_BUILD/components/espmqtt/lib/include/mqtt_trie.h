@@ -0,0 +1,34 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Apache License Version 2.0
+ *
+ * Topic trie for the MQTT subscription filters with '+' and '#' wildcards
+ */
+
+#ifndef _MQTT_TRIE_H_
+#define _MQTT_TRIE_H_
+
+#include <stdbool.h>
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+typedef struct mqtt_trie *mqtt_trie_handle_t;
+
+// called for every filter matching the topic with the data stored for the filter
+typedef void (*mqtt_trie_match_cb_t)(void *data, void *arg);
+
+mqtt_trie_handle_t mqtt_trie_init();
+void mqtt_trie_destroy(mqtt_trie_handle_t trie);
+bool mqtt_trie_valid_filter(const char *filter);
+int mqtt_trie_insert(mqtt_trie_handle_t trie, const char *filter, void *data, void **old_data);
+void *mqtt_trie_remove(mqtt_trie_handle_t trie, const char *filter);
+int mqtt_trie_match(mqtt_trie_handle_t trie, const char *topic, int topic_len, mqtt_trie_match_cb_t cb, void *arg);
+int mqtt_trie_count(mqtt_trie_handle_t trie);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
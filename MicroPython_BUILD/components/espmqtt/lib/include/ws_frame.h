@@ -0,0 +1,74 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Apache License Version 2.0
+ *
+ * WebSocket (RFC 6455) framing shared by the MQTT WebSocket transport
+ * and the MicroPython websocket module, with permessage-deflate (RFC 7692)
+ */
+
+#ifndef _WS_FRAME_H_
+#define _WS_FRAME_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "zlib.h"
+
+#ifdef  __cplusplus
+extern "C" {
+#endif
+
+// First header byte
+#define WS_FRAME_FIN            0x80
+#define WS_FRAME_RSV1           0x40    // compressed message (permessage-deflate)
+#define WS_FRAME_OPCODE         0x0f
+#define WS_FRAME_CONTROL        0x08    // opcodes >= 8 are control frames
+// Second header byte
+#define WS_FRAME_MASKED         0x80
+#define WS_FRAME_MAX_HEADER     14
+
+// Deflate parameters used for sending, smaller than the zlib defaults to save RAM
+// (deflate needs about (1 << (window_bits + 2)) + (1 << (mem_level + 9)) bytes)
+#define WS_DEFLATE_MAX_TX_WINDOW_BITS   11
+#define WS_DEFLATE_MEM_LEVEL            4
+#define WS_DEFLATE_LEVEL                6
+// Size of the output buffer always large enough for ws_deflate()
+#define WS_DEFLATE_BOUND(len)           ((len) + ((len) >> 7) + 64)
+
+typedef struct {
+    uint64_t remaining;     // payload bytes of the frame not yet received
+    uint8_t flags;          // first header byte of the frame (FIN, RSV1, opcode)
+    uint8_t opcode;         // opcode of the current data message, continuation frames inherit it
+    bool compressed;        // current data message is compressed
+    bool masked;
+    uint8_t mask[4];
+    uint8_t mask_pos;
+} ws_frame_t;
+
+typedef struct {
+    z_stream rx;
+    z_stream tx;
+    bool rx_init;
+    bool tx_init;
+    bool rx_pending;        // inflate output buffer was filled, more output may be available
+    uint8_t rx_tail;        // bytes of the end of message marker already passed to inflate
+} ws_deflate_t;
+
+int ws_frame_header_size(const uint8_t *hdr, size_t len);
+int ws_frame_parse(ws_frame_t *frame, const uint8_t *hdr, size_t len);
+int ws_frame_header(uint8_t *hdr, uint8_t flags, uint64_t len, const uint8_t *mask);
+uint8_t ws_frame_mask(uint8_t *buf, size_t len, const uint8_t *mask, uint8_t pos);
+size_t ws_frame_payload(ws_frame_t *frame, uint8_t *buf, size_t len);
+
+int ws_deflate_init(ws_deflate_t *z, int rx_window_bits, int tx_window_bits);
+void ws_deflate_free(ws_deflate_t *z);
+int ws_inflate(ws_deflate_t *z, const uint8_t *in, size_t in_len, size_t *in_used, uint8_t *out, size_t out_len, bool last);
+bool ws_inflate_done(ws_deflate_t *z);
+int ws_deflate(ws_deflate_t *z, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len);
+
+#ifdef  __cplusplus
+}
+#endif
+#endif
@@ -130,6 +130,18 @@ int outbox_get_size(outbox_handle_t outbox)
     return siz;
 }
 
+int outbox_get_count(outbox_handle_t outbox, int msg_type)
+{
+    int count = 0;
+    outbox_item_handle_t item;
+    STAILQ_FOREACH(item, outbox, next) {
+        if (item->msg_type == msg_type) {
+            count++;
+        }
+    }
+    return count;
+}
+
 esp_err_t outbox_cleanup(outbox_handle_t outbox, int max_size)
 {
     while(outbox_get_size(outbox) > max_size) {
@@ -0,0 +1,341 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Apache License Version 2.0
+ *
+ * Topic trie for the MQTT subscription filters with '+' and '#' wildcards
+ *
+ * Every trie node is one topic level of a filter. The children of all nodes
+ * are kept in one hash table keyed by (parent node, level name), so finding
+ * the child for a topic level doesn't depend on the number of subscriptions
+ * and matching a topic takes O(topic levels) lookups (two per level if there
+ * are '+' filters on the path).
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mqtt_trie.h"
+
+#define TRIE_INITIAL_SIZE   16
+
+typedef struct mqtt_trie_node {
+    struct mqtt_trie_node *parent;
+    struct mqtt_trie_node *bucket_next;     // next node in the hash table bucket
+    struct mqtt_trie_node *plus;            // '+' child
+    struct mqtt_trie_node *hash;            // '#' child
+    void *data;                             // filter data, NULL if no filter ends at this node
+    uint32_t key;
+    uint16_t children;
+    uint16_t len;
+    char level[];                           // level name, not 0 terminated
+} mqtt_trie_node_t;
+
+struct mqtt_trie {
+    mqtt_trie_node_t *root;
+    mqtt_trie_node_t **table;
+    uint32_t size;                          // number of the hash table buckets, power of 2
+    uint32_t nodes;
+    int filters;
+};
+
+static uint32_t trie_key(const mqtt_trie_node_t *parent, const char *level, int len)
+{
+    // FNV-1a of the level name mixed with the parent node address
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < len; i++) {
+        h = (h ^ (uint8_t)level[i]) * 16777619u;
+    }
+    return h ^ (uint32_t)((uintptr_t)parent * 2654435761u);
+}
+
+static mqtt_trie_node_t *trie_child(mqtt_trie_handle_t trie, const mqtt_trie_node_t *parent, const char *level, int len, uint32_t key)
+{
+    mqtt_trie_node_t *node = trie->table[key & (trie->size - 1)];
+    while (node) {
+        if ((node->key == key) && (node->parent == parent) && (node->len == len) && (memcmp(node->level, level, len) == 0)) {
+            return node;
+        }
+        node = node->bucket_next;
+    }
+    return NULL;
+}
+
+static int trie_grow(mqtt_trie_handle_t trie)
+{
+    uint32_t size = trie->size * 2;
+    mqtt_trie_node_t **table = calloc(size, sizeof(mqtt_trie_node_t *));
+    if (table == NULL) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < trie->size; i++) {
+        mqtt_trie_node_t *node = trie->table[i];
+        while (node) {
+            mqtt_trie_node_t *next = node->bucket_next;
+            node->bucket_next = table[node->key & (size - 1)];
+            table[node->key & (size - 1)] = node;
+            node = next;
+        }
+    }
+    free(trie->table);
+    trie->table = table;
+    trie->size = size;
+    return 0;
+}
+
+static mqtt_trie_node_t *trie_add_child(mqtt_trie_handle_t trie, mqtt_trie_node_t *parent, const char *level, int len, uint32_t key)
+{
+    if ((trie->nodes + 1) > (trie->size / 4 * 3)) {
+        // a failed resize only makes the buckets longer
+        trie_grow(trie);
+    }
+    mqtt_trie_node_t *node = calloc(1, sizeof(mqtt_trie_node_t) + len);
+    if (node == NULL) {
+        return NULL;
+    }
+    node->parent = parent;
+    node->key = key;
+    node->len = len;
+    memcpy(node->level, level, len);
+    node->bucket_next = trie->table[key & (trie->size - 1)];
+    trie->table[key & (trie->size - 1)] = node;
+    trie->nodes++;
+    parent->children++;
+    if ((len == 1) && (level[0] == '+')) {
+        parent->plus = node;
+    }
+    else if ((len == 1) && (level[0] == '#')) {
+        parent->hash = node;
+    }
+    return node;
+}
+
+static void trie_delete_node(mqtt_trie_handle_t trie, mqtt_trie_node_t *node)
+{
+    mqtt_trie_node_t **pnode = &trie->table[node->key & (trie->size - 1)];
+    while (*pnode != node) {
+        pnode = &(*pnode)->bucket_next;
+    }
+    *pnode = node->bucket_next;
+    if (node->parent->plus == node) {
+        node->parent->plus = NULL;
+    }
+    if (node->parent->hash == node) {
+        node->parent->hash = NULL;
+    }
+    node->parent->children--;
+    trie->nodes--;
+    free(node);
+}
+
+// Find the node of the filter, create the missing levels if 'create' is set
+static mqtt_trie_node_t *trie_find(mqtt_trie_handle_t trie, const char *filter, bool create)
+{
+    mqtt_trie_node_t *node = trie->root;
+    const char *level = filter;
+    while (1) {
+        const char *sep = strchr(level, '/');
+        int len = (sep) ? (int)(sep - level) : (int)strlen(level);
+        uint32_t key = trie_key(node, level, len);
+        mqtt_trie_node_t *child = trie_child(trie, node, level, len, key);
+        if (child == NULL) {
+            if (!create) {
+                return NULL;
+            }
+            child = trie_add_child(trie, node, level, len, key);
+            if (child == NULL) {
+                return NULL;
+            }
+        }
+        node = child;
+        if (sep == NULL) {
+            return node;
+        }
+        level = sep + 1;
+    }
+}
+
+// Remove the nodes not used by any filter, starting from 'node' up to the root
+static void trie_prune(mqtt_trie_handle_t trie, mqtt_trie_node_t *node)
+{
+    while ((node != trie->root) && (node->data == NULL) && (node->children == 0)) {
+        mqtt_trie_node_t *parent = node->parent;
+        trie_delete_node(trie, node);
+        node = parent;
+    }
+}
+
+mqtt_trie_handle_t mqtt_trie_init()
+{
+    mqtt_trie_handle_t trie = calloc(1, sizeof(struct mqtt_trie));
+    if (trie == NULL) {
+        return NULL;
+    }
+    trie->root = calloc(1, sizeof(mqtt_trie_node_t));
+    trie->size = TRIE_INITIAL_SIZE;
+    trie->table = calloc(trie->size, sizeof(mqtt_trie_node_t *));
+    if ((trie->root == NULL) || (trie->table == NULL)) {
+        mqtt_trie_destroy(trie);
+        return NULL;
+    }
+    return trie;
+}
+
+// The filter data is not freed
+void mqtt_trie_destroy(mqtt_trie_handle_t trie)
+{
+    if (trie->table) {
+        for (uint32_t i = 0; i < trie->size; i++) {
+            mqtt_trie_node_t *node = trie->table[i];
+            while (node) {
+                mqtt_trie_node_t *next = node->bucket_next;
+                free(node);
+                node = next;
+            }
+        }
+        free(trie->table);
+    }
+    free(trie->root);
+    free(trie);
+}
+
+// '+' and '#' must occupy the whole level, '#' only as the last level
+bool mqtt_trie_valid_filter(const char *filter)
+{
+    if ((filter == NULL) || (filter[0] == '\0')) {
+        return false;
+    }
+    for (const char *p = filter; *p; p++) {
+        if ((*p == '+') || (*p == '#')) {
+            if ((p != filter) && (p[-1] != '/')) {
+                return false;
+            }
+            if ((*p == '#') && (p[1] != '\0')) {
+                return false;
+            }
+            if ((*p == '+') && (p[1] != '\0') && (p[1] != '/')) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+/*
+ * Add the filter with its data (must not be NULL).
+ * If the filter already exists its data is replaced and the old data
+ * is returned in 'old_data'.
+ * Returns 0 on success, -1 for invalid filter or if out of memory.
+ */
+int mqtt_trie_insert(mqtt_trie_handle_t trie, const char *filter, void *data, void **old_data)
+{
+    if (old_data) {
+        *old_data = NULL;
+    }
+    if ((data == NULL) || (!mqtt_trie_valid_filter(filter))) {
+        return -1;
+    }
+    mqtt_trie_node_t *node = trie_find(trie, filter, true);
+    if (node == NULL) {
+        // out of memory, remove the levels already added
+        mqtt_trie_remove(trie, filter);
+        return -1;
+    }
+    if (node->data == NULL) {
+        trie->filters++;
+    }
+    else if (old_data) {
+        *old_data = node->data;
+    }
+    node->data = data;
+    return 0;
+}
+
+// Remove the filter, returns its data or NULL if the filter was not found
+void *mqtt_trie_remove(mqtt_trie_handle_t trie, const char *filter)
+{
+    if ((filter == NULL) || (filter[0] == '\0')) {
+        return NULL;
+    }
+    // find the deepest existing node of the filter
+    mqtt_trie_node_t *node = trie->root;
+    const char *level = filter;
+    bool found = false;
+    while (1) {
+        const char *sep = strchr(level, '/');
+        int len = (sep) ? (int)(sep - level) : (int)strlen(level);
+        mqtt_trie_node_t *child = trie_child(trie, node, level, len, trie_key(node, level, len));
+        if (child == NULL) {
+            break;
+        }
+        node = child;
+        if (sep == NULL) {
+            found = true;
+            break;
+        }
+        level = sep + 1;
+    }
+    void *data = NULL;
+    if ((found) && (node->data)) {
+        data = node->data;
+        node->data = NULL;
+        trie->filters--;
+    }
+    trie_prune(trie, node);
+    return data;
+}
+
+static int trie_match(mqtt_trie_handle_t trie, mqtt_trie_node_t *node, const char *topic, int len, bool done,
+                      bool first, mqtt_trie_match_cb_t cb, void *arg)
+{
+    int count = 0;
+    // the wildcards don't match the topics starting with '$' at the first level
+    bool wildcards = !((first) && (len > 0) && (topic[0] == '$'));
+
+    // '#' matches the rest of the topic, including the parent level ("a/#" matches "a")
+    if ((node->hash) && (node->hash->data) && (wildcards)) {
+        count++;
+        if (cb) cb(node->hash->data, arg);
+    }
+    if (done) {
+        if (node->data) {
+            count++;
+            if (cb) cb(node->data, arg);
+        }
+        return count;
+    }
+
+    const char *sep = memchr(topic, '/', len);
+    int level_len = (sep) ? (sep - topic) : len;
+    const char *next = (sep) ? (sep + 1) : (topic + len);
+    int next_len = (sep) ? (len - level_len - 1) : 0;
+
+    mqtt_trie_node_t *child = trie_child(trie, node, topic, level_len, trie_key(node, topic, level_len));
+    if ((child) && (child != node->plus) && (child != node->hash)) {
+        count += trie_match(trie, child, next, next_len, (sep == NULL), false, cb, arg);
+    }
+    if ((node->plus) && (wildcards)) {
+        count += trie_match(trie, node->plus, next, next_len, (sep == NULL), false, cb, arg);
+    }
+    return count;
+}
+
+/*
+ * Call 'cb' for every filter matching the topic.
+ * If 'cb' is NULL only the matching filters are counted.
+ * Returns the number of the matching filters.
+ */
+int mqtt_trie_match(mqtt_trie_handle_t trie, const char *topic, int topic_len, mqtt_trie_match_cb_t cb, void *arg)
+{
+    if ((trie->filters == 0) || (topic == NULL)) {
+        return 0;
+    }
+    return trie_match(trie, trie->root, topic, topic_len, false, true, cb, arg);
+}
+
+// Number of the filters in the trie
+int mqtt_trie_count(mqtt_trie_handle_t trie)
+{
+    return trie->filters;
+}
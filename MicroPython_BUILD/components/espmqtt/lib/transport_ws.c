@@ -6,6 +6,7 @@
 #include "transport.h"
 #include "transport_tcp.h"
 #include "transport_ws.h"
+#include "ws_frame.h"
 #include "mbedtls/base64.h"
 #include "mbedtls/sha1.h"
 
@@ -15,7 +16,11 @@ static const char *TAG = "TRANSPORT_WS";
 
 typedef struct {
     char *path;
-    char *buffer;
+    char *buffer;               // handshake and received data buffer
+    char *tx_buffer;            // masked frame being sent
+    int rx_pos;                 // start of the unprocessed data in 'buffer'
+    int rx_len;                 // end of the received data in 'buffer'
+    ws_frame_t frame;           // received frame
     transport_handle_t parent;
 } transport_ws_t;
 
@@ -86,10 +91,16 @@ static int ws_connect(transport_handle_t t, const char *host, int port, int time
         ESP_LOGE(TAG, "Error write Upgrade header %s", ws->buffer);
         return -1;
     }
-    if ((len = transport_read(ws->parent, ws->buffer, DEFAULT_WS_BUFFER, timeout_ms)) <= 0) {
+    if ((len = transport_read(ws->parent, ws->buffer, DEFAULT_WS_BUFFER - 1, timeout_ms)) <= 0) {
         ESP_LOGE(TAG, "Error read response for Upgrade header %s", ws->buffer);
         return -1;
     }
+    ws->buffer[len] = 0;
+    memset(&ws->frame, 0, sizeof(ws_frame_t));
+    // the frames may follow the response in the same read
+    char *header_end = strstr(ws->buffer, "\r\n\r\n");
+    ws->rx_pos = (header_end) ? (header_end + 4 - ws->buffer) : len;
+    ws->rx_len = len;
     char *server_key = get_http_header(ws->buffer, "Sec-WebSocket-Accept:");
     if (server_key == NULL) {
         ESP_LOGE(TAG, "Sec-WebSocket-Accept not found");
@@ -109,96 +120,151 @@ static int ws_connect(transport_handle_t t, const char *host, int port, int time
     return 0;
 }
 
+// Write the whole buffer to the parent transport
+static int ws_write_all(transport_ws_t *ws, const char *buffer, int len, int timeout_ms)
+{
+    int written = 0;
+    while (written < len) {
+        int wlen = transport_write(ws->parent, buffer + written, len - written, timeout_ms);
+        if (wlen <= 0) {
+            return -1;
+        }
+        written += wlen;
+    }
+    return written;
+}
+
+// Send the masked frame, the header and the masked payload are written
+// from the transmit buffer in as few writes as possible, 'buff' is not modified
+static int ws_write_frame(transport_ws_t *ws, uint8_t flags, const char *buff, int len, int timeout_ms)
+{
+    uint8_t mask[4];
+    for (int i = 0; i < 4; i++) {
+        mask[i] = rand() & 0xFF;
+    }
+    int pos = ws_frame_header((uint8_t *)ws->tx_buffer, flags, len, mask);
+    int sent = 0;
+    uint8_t mask_pos = 0;
+    do {
+        int n = DEFAULT_WS_BUFFER - pos;
+        if (n > len - sent) {
+            n = len - sent;
+        }
+        memcpy(ws->tx_buffer + pos, buff + sent, n);
+        mask_pos = ws_frame_mask((uint8_t *)ws->tx_buffer + pos, n, mask, mask_pos);
+        if (ws_write_all(ws, ws->tx_buffer, pos + n, timeout_ms) < 0) {
+            ESP_LOGE(TAG, "Error write frame");
+            return -1;
+        }
+        sent += n;
+        pos = 0;
+    } while (sent < len);
+    return len;
+}
+
 static int ws_write(transport_handle_t t, const char *buff, int len, int timeout_ms)
 {
     transport_ws_t *ws = transport_get_context_data(t);
-    char ws_header[MAX_WEBSOCKET_HEADER_SIZE];
-    char *mask;
-    int header_len = 0, i;
-    char *buffer = (char *)buff;
     int poll_write;
     if ((poll_write = transport_poll_write(ws->parent, timeout_ms)) <= 0) {
         return poll_write;
     }
+    return ws_write_frame(ws, WS_OPCODE_BINARY | WS_FIN, buff, len, timeout_ms);
+}
 
-    ws_header[header_len++] = WS_OPCODE_BINARY | WS_FIN;
-
-    // NOTE: no support for > 16-bit sized messages
-    if (len > 125) {
-        ws_header[header_len++] = WS_SIZE16 | WS_MASK;
-        ws_header[header_len++] = (uint8_t)(len >> 8);
-        ws_header[header_len++] = (uint8_t)(len & 0xFF);
-    } else {
-        ws_header[header_len++] = (uint8_t)(len | WS_MASK);
-    }
-    mask = &ws_header[header_len];
-    ws_header[header_len++] = rand() & 0xFF;
-    ws_header[header_len++] = rand() & 0xFF;
-    ws_header[header_len++] = rand() & 0xFF;
-    ws_header[header_len++] = rand() & 0xFF;
-
-    for (i = 0; i < len; ++i) {
-        buffer[i] = (buffer[i] ^ mask[i % 4]);
+// Read more data into the receive buffer
+static int ws_fill(transport_ws_t *ws, int timeout_ms)
+{
+    if (ws->rx_pos > 0) {
+        memmove(ws->buffer, ws->buffer + ws->rx_pos, ws->rx_len - ws->rx_pos);
+        ws->rx_len -= ws->rx_pos;
+        ws->rx_pos = 0;
     }
-    if (transport_write(ws->parent, ws_header, header_len, timeout_ms) != header_len) {
-        ESP_LOGE(TAG, "Error write header");
-        return -1;
+    int rlen = transport_read(ws->parent, ws->buffer + ws->rx_len, DEFAULT_WS_BUFFER - ws->rx_len, timeout_ms);
+    if (rlen > 0) {
+        ws->rx_len += rlen;
     }
-    return transport_write(ws->parent, buffer, len, timeout_ms);
+    return rlen;
 }
 
+/*
+ * Read the payload of the received data frames
+ * The data is read in bulk into the receive buffer, so the frame headers
+ * and short payloads are usually received with one read; the rest of long
+ * payloads is read directly into the caller's buffer. The payload is returned
+ * as it arrives, the fragmented messages are not reassembled.
+ */
 static int ws_read(transport_handle_t t, char *buffer, int len, int timeout_ms)
 {
     transport_ws_t *ws = transport_get_context_data(t);
-    int payload_len;
-    char *data_ptr = buffer, opcode, mask, *mask_key = NULL;
     int rlen;
-    int poll_read;
-    if ((poll_read = transport_poll_read(ws->parent, timeout_ms)) <= 0) {
-        return poll_read;
-    }
-    if ((rlen = transport_read(ws->parent, buffer, len, timeout_ms)) <= 0) {
-        ESP_LOGE(TAG, "Error read data");
-        return rlen;
-    }
-
-    opcode = (*data_ptr & 0x0F);
-    data_ptr ++;
-    mask = ((*data_ptr >> 7) & 0x01);
-    payload_len = (*data_ptr & 0x7F);
-    data_ptr++;
-    ESP_LOGD(TAG, "Opcode: %d, mask: %d, len: %d\r\n", opcode, mask, payload_len);
-    if (payload_len == 126) {
-        // headerLen += 2;
-        payload_len = data_ptr[0] << 8 | data_ptr[1];
-        data_ptr += 2;
-    } else if (payload_len == 127) {
-        // headerLen += 8;
-
-        if (data_ptr[0] != 0 || data_ptr[1] != 0 || data_ptr[2] != 0 || data_ptr[3] != 0) {
-            // really too big!
-            payload_len = 0xFFFFFFFF;
-        } else {
-            payload_len = data_ptr[4] << 24 | data_ptr[5] << 16 | data_ptr[6] << 8 | data_ptr[7];
+    while (ws->frame.remaining == 0) {
+        // the header is parsed into a copy, it is used only when the frame can be processed
+        ws_frame_t frame = ws->frame;
+        int header_len = ws_frame_parse(&frame, (uint8_t *)ws->buffer + ws->rx_pos, ws->rx_len - ws->rx_pos);
+        if (header_len < 0) {
+            ESP_LOGE(TAG, "Invalid frame header");
+            return -1;
+        }
+        uint8_t opcode = frame.flags & WS_FRAME_OPCODE;
+        if ((header_len == 0) ||
+            ((opcode & WS_FRAME_CONTROL) && ((ws->rx_len - ws->rx_pos) < (header_len + frame.remaining)))) {
+            // wait for the whole header, and the whole payload of the control frame
+            if ((rlen = ws_fill(ws, timeout_ms)) <= 0) {
+                return rlen;
+            }
+            continue;
+        }
+        ws->frame = frame;
+        ws->rx_pos += header_len;
+        if (opcode & WS_FRAME_CONTROL) {
+            char *payload = ws->buffer + ws->rx_pos;
+            int payload_len = ws_frame_payload(&ws->frame, (uint8_t *)payload, ws->frame.remaining);
+            ws->rx_pos += payload_len;
+            ESP_LOGD(TAG, "Control frame, opcode: %d, len: %d", opcode, payload_len);
+            if (opcode == WS_OPCODE_PING) {
+                if (ws_write_frame(ws, WS_OPCODE_PONG | WS_FIN, payload, payload_len, timeout_ms) < 0) {
+                    return -1;
+                }
+            } else if (opcode == WS_OPCODE_CLOSE) {
+                ESP_LOGW(TAG, "Connection closed by the server");
+                return -1;
+            }
+            continue;
+        }
+        if (ws->frame.compressed) {
+            ESP_LOGE(TAG, "Compressed frame not expected");
+            return -1;
+        }
+        if (ws->frame.remaining == 0) {
+            // empty data frame
+            return 0;
         }
-        data_ptr += 8;
     }
 
-    if (mask) {
-        mask_key = data_ptr;
-        data_ptr += 4;
-        for (int i = 0; i < payload_len; i++) {
-            buffer[i] = (data_ptr[i] ^ mask_key[i % 4]);
+    if (len > ws->frame.remaining) {
+        len = ws->frame.remaining;
+    }
+    if (ws->rx_pos < ws->rx_len) {
+        if (len > (ws->rx_len - ws->rx_pos)) {
+            len = ws->rx_len - ws->rx_pos;
         }
-    } else {
-        memmove(buffer, data_ptr, payload_len);
+        memcpy(buffer, ws->buffer + ws->rx_pos, len);
+        ws->rx_pos += len;
+        rlen = len;
+    } else if ((rlen = transport_read(ws->parent, buffer, len, timeout_ms)) <= 0) {
+        return rlen;
     }
-    return payload_len;
+    return ws_frame_payload(&ws->frame, (uint8_t *)buffer, rlen);
 }
 
 static int ws_poll_read(transport_handle_t t, int timeout_ms)
 {
     transport_ws_t *ws = transport_get_context_data(t);
+    if (ws->rx_pos < ws->rx_len) {
+        // data already received
+        return 1;
+    }
     return transport_poll_read(ws->parent, timeout_ms);
 }
 
@@ -218,6 +284,7 @@ static esp_err_t ws_destroy(transport_handle_t t)
 {
     transport_ws_t *ws = transport_get_context_data(t);
     free(ws->buffer);
+    free(ws->tx_buffer);
     free(ws->path);
     free(ws);
     return 0;
@@ -238,7 +305,10 @@ transport_handle_t transport_ws_init(transport_handle_t parent_handle)
     ws->path = strdup("/");
     ESP_MEM_CHECK(TAG, ws->path, return NULL);
     ws->buffer = malloc(DEFAULT_WS_BUFFER);
-    ESP_MEM_CHECK(TAG, ws->buffer, {
+    ws->tx_buffer = malloc(DEFAULT_WS_BUFFER);
+    ESP_MEM_CHECK(TAG, (ws->buffer) && (ws->tx_buffer), {
+        free(ws->buffer);
+        free(ws->tx_buffer);
         free(ws->path);
         free(ws);
         return NULL;
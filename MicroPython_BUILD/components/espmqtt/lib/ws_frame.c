@@ -0,0 +1,317 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Apache License Version 2.0
+ *
+ * WebSocket (RFC 6455) framing shared by the MQTT WebSocket transport
+ * and the MicroPython websocket module
+ *
+ * The functions only work on buffers, reading and writing is left to the
+ * caller, so the same code serves the transport layer and the MicroPython
+ * streams. The payload is unmasked in place, 32 bits at a time, as it is
+ * received; the messages are never reassembled, every frame is passed on
+ * as it arrives.
+ *
+ * permessage-deflate (RFC 7692): the received messages are inflated as
+ * they arrive using the window size negotiated for the peer, the sent
+ * messages are compressed without context takeover (valid for any
+ * negotiated parameters) and with a reduced window to save RAM.
+ */
+
+#include <string.h>
+
+#include "ws_frame.h"
+
+typedef uint32_t __attribute__((__may_alias__)) ws_word_t;
+
+static const uint8_t ws_deflate_tail[4] = { 0x00, 0x00, 0xff, 0xff };
+
+/*
+ * Size of the frame header from its first two bytes
+ * Returns 0 if less than two bytes are available
+ */
+int ws_frame_header_size(const uint8_t *hdr, size_t len)
+{
+    if (len < 2) {
+        return 0;
+    }
+    int size = 2;
+    if ((hdr[1] & 0x7f) == 126) {
+        size += 2;
+    } else if ((hdr[1] & 0x7f) == 127) {
+        size += 8;
+    }
+    if (hdr[1] & WS_FRAME_MASKED) {
+        size += 4;
+    }
+    return size;
+}
+
+/*
+ * Parse the frame header at the start of 'hdr'
+ * Returns the header size, 0 if the header is not complete yet or -1 for invalid header
+ */
+int ws_frame_parse(ws_frame_t *frame, const uint8_t *hdr, size_t len)
+{
+    int size = ws_frame_header_size(hdr, len);
+    if ((size == 0) || (len < (size_t)size)) {
+        return 0;
+    }
+    uint8_t opcode = hdr[0] & WS_FRAME_OPCODE;
+    uint64_t payload_len = hdr[1] & 0x7f;
+    const uint8_t *p = hdr + 2;
+    if (payload_len == 126) {
+        payload_len = (p[0] << 8) | p[1];
+        p += 2;
+    } else if (payload_len == 127) {
+        if (p[0] & 0x80) {
+            return -1;
+        }
+        payload_len = 0;
+        for (int i = 0; i < 8; i++) {
+            payload_len = (payload_len << 8) | p[i];
+        }
+        p += 8;
+    }
+    if ((opcode & WS_FRAME_CONTROL) && ((payload_len > 125) || ((hdr[0] & WS_FRAME_FIN) == 0))) {
+        // control frames can't be fragmented or longer than 125 bytes
+        return -1;
+    }
+
+    frame->flags = hdr[0];
+    frame->remaining = payload_len;
+    frame->masked = (hdr[1] & WS_FRAME_MASKED) != 0;
+    if (frame->masked) {
+        memcpy(frame->mask, p, 4);
+    } else {
+        memset(frame->mask, 0, 4);
+    }
+    frame->mask_pos = 0;
+    if ((opcode & WS_FRAME_CONTROL) == 0) {
+        // control frames may be injected in a fragmented message, they don't change the message state
+        if (opcode != 0) {
+            frame->opcode = opcode;
+            frame->compressed = (hdr[0] & WS_FRAME_RSV1) != 0;
+        }
+    }
+    return size;
+}
+
+/*
+ * Build the frame header, 'flags' is the first header byte (FIN, RSV1, opcode)
+ * 'mask' is the masking key for the client frames or NULL
+ * Returns the header size
+ */
+int ws_frame_header(uint8_t *hdr, uint8_t flags, uint64_t len, const uint8_t *mask)
+{
+    int size = 2;
+    hdr[0] = flags;
+    if (len < 126) {
+        hdr[1] = len;
+    } else if (len <= 0xffff) {
+        hdr[1] = 126;
+        hdr[2] = len >> 8;
+        hdr[3] = len & 0xff;
+        size = 4;
+    } else {
+        hdr[1] = 127;
+        for (int i = 0; i < 8; i++) {
+            hdr[9 - i] = len & 0xff;
+            len >>= 8;
+        }
+        size = 10;
+    }
+    if (mask) {
+        hdr[1] |= WS_FRAME_MASKED;
+        memcpy(hdr + size, mask, 4);
+        size += 4;
+    }
+    return size;
+}
+
+/*
+ * Mask/unmask the buffer in place, 'pos' is the position in the masking key
+ * of the first byte, the position of the next byte is returned.
+ * The aligned part of the buffer is processed 32 bits at a time.
+ */
+uint8_t ws_frame_mask(uint8_t *buf, size_t len, const uint8_t *mask, uint8_t pos)
+{
+    while ((len > 0) && ((uintptr_t)buf & 3)) {
+        *buf++ ^= mask[pos++ & 3];
+        len--;
+    }
+    if (len >= 4) {
+        // masking key rotated to the current position, in memory byte order
+        ws_word_t key;
+        uint8_t *k = (uint8_t *)&key;
+        for (int i = 0; i < 4; i++) {
+            k[i] = mask[(pos + i) & 3];
+        }
+        ws_word_t *w = (ws_word_t *)buf;
+        size_t n = len >> 2;
+        while (n >= 4) {
+            w[0] ^= key;
+            w[1] ^= key;
+            w[2] ^= key;
+            w[3] ^= key;
+            w += 4;
+            n -= 4;
+        }
+        while (n > 0) {
+            *w++ ^= key;
+            n--;
+        }
+        buf = (uint8_t *)w;
+        len &= 3;
+    }
+    while (len > 0) {
+        *buf++ ^= mask[pos++ & 3];
+        len--;
+    }
+    return pos & 3;
+}
+
+/*
+ * Account the received payload bytes of the frame and unmask them in place
+ * Returns the number of bytes belonging to the frame (at most 'len')
+ */
+size_t ws_frame_payload(ws_frame_t *frame, uint8_t *buf, size_t len)
+{
+    if (len > frame->remaining) {
+        len = frame->remaining;
+    }
+    if (frame->masked) {
+        frame->mask_pos = ws_frame_mask(buf, len, frame->mask, frame->mask_pos);
+    }
+    frame->remaining -= len;
+    return len;
+}
+
+/*
+ * Initialize permessage-deflate
+ * 'rx_window_bits' is the window size used by the peer (8-15), 0 if the received messages are not compressed
+ * 'tx_window_bits' is the maximal window size allowed for sending (9-15), 0 if the sent messages are not compressed
+ * Returns 0 on success, -1 if out of memory
+ */
+int ws_deflate_init(ws_deflate_t *z, int rx_window_bits, int tx_window_bits)
+{
+    memset(z, 0, sizeof(ws_deflate_t));
+    if (rx_window_bits > 0) {
+        if (rx_window_bits < 8) rx_window_bits = 8;
+        if (rx_window_bits > 15) rx_window_bits = 15;
+        if (inflateInit2(&z->rx, -rx_window_bits) != Z_OK) {
+            return -1;
+        }
+        z->rx_init = true;
+    }
+    if (tx_window_bits > 0) {
+        if (tx_window_bits < 9) tx_window_bits = 9;
+        if (tx_window_bits > WS_DEFLATE_MAX_TX_WINDOW_BITS) tx_window_bits = WS_DEFLATE_MAX_TX_WINDOW_BITS;
+        if (deflateInit2(&z->tx, WS_DEFLATE_LEVEL, Z_DEFLATED, -tx_window_bits, WS_DEFLATE_MEM_LEVEL, Z_DEFAULT_STRATEGY) != Z_OK) {
+            ws_deflate_free(z);
+            return -1;
+        }
+        z->tx_init = true;
+    }
+    return 0;
+}
+
+void ws_deflate_free(ws_deflate_t *z)
+{
+    if (z->rx_init) {
+        inflateEnd(&z->rx);
+        z->rx_init = false;
+    }
+    if (z->tx_init) {
+        deflateEnd(&z->tx);
+        z->tx_init = false;
+    }
+}
+
+/*
+ * Inflate the (unmasked) payload of the compressed message
+ * Call with 'last' set and no input after the last payload byte was passed,
+ * until ws_inflate_done() returns true.
+ * Returns the number of bytes written to 'out' or -1 on error
+ */
+int ws_inflate(ws_deflate_t *z, const uint8_t *in, size_t in_len, size_t *in_used, uint8_t *out, size_t out_len, bool last)
+{
+    *in_used = 0;
+    if (!z->rx_init) {
+        return -1;
+    }
+    if (z->rx_tail > 4) {
+        // the final block was already received, ignore the rest of the message
+        *in_used = in_len;
+        return 0;
+    }
+    z->rx.next_out = out;
+    z->rx.avail_out = out_len;
+    int ret = Z_OK;
+    if (in_len > 0) {
+        z->rx.next_in = (uint8_t *)in;
+        z->rx.avail_in = in_len;
+        ret = inflate(&z->rx, Z_SYNC_FLUSH);
+        *in_used = in_len - z->rx.avail_in;
+    } else if ((last) && (z->rx_tail < 4)) {
+        // end of message marker removed by the sender
+        z->rx.next_in = (uint8_t *)ws_deflate_tail + z->rx_tail;
+        z->rx.avail_in = 4 - z->rx_tail;
+        ret = inflate(&z->rx, Z_SYNC_FLUSH);
+        z->rx_tail = 4 - z->rx.avail_in;
+    } else if (z->rx_pending) {
+        z->rx.next_in = NULL;
+        z->rx.avail_in = 0;
+        ret = inflate(&z->rx, Z_SYNC_FLUSH);
+    }
+    if (ret == Z_STREAM_END) {
+        // the sender may end the message with the final block
+        z->rx_tail = 5;
+        *in_used = in_len;
+    } else if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+        return -1;
+    }
+    z->rx_pending = (z->rx.avail_out == 0);
+    return out_len - z->rx.avail_out;
+}
+
+/*
+ * Returns true if the whole message was inflated and prepares for the next message
+ */
+bool ws_inflate_done(ws_deflate_t *z)
+{
+    if ((z->rx_tail < 4) || (z->rx_pending)) {
+        return false;
+    }
+    if (z->rx_tail > 4) {
+        inflateReset(&z->rx);
+    }
+    z->rx_tail = 0;
+    return true;
+}
+
+/*
+ * Compress the whole message into 'out', the end of message marker is removed
+ * Returns the compressed size or -1 if the output buffer is too small
+ * (the message can be sent uncompressed)
+ */
+int ws_deflate(ws_deflate_t *z, const uint8_t *in, size_t in_len, uint8_t *out, size_t out_len)
+{
+    if (!z->tx_init) {
+        return -1;
+    }
+    deflateReset(&z->tx);
+    z->tx.next_in = (uint8_t *)in;
+    z->tx.avail_in = in_len;
+    z->tx.next_out = out;
+    z->tx.avail_out = out_len;
+    int ret = deflate(&z->tx, Z_SYNC_FLUSH);
+    if ((ret != Z_OK) || (z->tx.avail_in != 0) || (z->tx.avail_out == 0)) {
+        return -1;
+    }
+    int len = out_len - z->tx.avail_out;
+    if ((len >= 4) && (memcmp(out + len - 4, ws_deflate_tail, 4) == 0)) {
+        len -= 4;
+    }
+    return len;
+}
@@ -20,6 +20,7 @@
 const char *MQTT_TAG = "MQTT_CLIENT";
 
 const static int STOPPED_BIT = BIT0;
+const static int INFLIGHT_BIT = BIT1;
 
 extern int MainTaskCore;
 
@@ -29,6 +30,7 @@ static esp_err_t esp_mqtt_destroy_config(esp_mqtt_client_handle_t client);
 static esp_err_t esp_mqtt_connect(esp_mqtt_client_handle_t client, int timeout_ms);
 static esp_err_t esp_mqtt_abort_connection(esp_mqtt_client_handle_t client);
 static esp_err_t esp_mqtt_client_ping(esp_mqtt_client_handle_t client);
+static esp_err_t mqtt_flush_batch(esp_mqtt_client_handle_t client);
 static char *create_string(const char *ptr, int len);
 
 static esp_err_t esp_mqtt_set_config(esp_mqtt_client_handle_t client, const esp_mqtt_client_config_t *config)
@@ -200,7 +202,14 @@ static esp_err_t esp_mqtt_connect(esp_mqtt_client_handle_t client, int timeout_m
 
 static esp_err_t esp_mqtt_abort_connection(esp_mqtt_client_handle_t client)
 {
+    xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
     transport_close(client->transport);
+    // the messages are not retransmitted, drop the queued and unacknowledged ones
+    // and release the publishers waiting for the in-flight window
+    client->batch_len = 0;
+    outbox_delete_msgtype(client->outbox, MQTT_MSG_TYPE_PUBLISH);
+    xEventGroupSetBits(client->status_bits, INFLIGHT_BIT);
+    xSemaphoreGiveRecursive(client->lock);
     client->wait_timeout_ms = MQTT_RECONNECT_TIMEOUT_MS;
     client->reconnect_tick = platform_tick_get_ms();
     client->state = MQTT_STATE_WAIT_TIMEOUT;
@@ -294,6 +303,19 @@ esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *co
 
     client->mqtt_state.out_buffer_length = buffer_size;
     client->mqtt_state.connect_info = &client->connect_info;
+
+    client->batch_size = config->batch_size;
+    if (client->batch_size <= 0) {
+        client->batch_size = MQTT_PUBLISH_BATCH_SIZE;
+    }
+    client->batch_buffer = (uint8_t *)malloc(client->batch_size);
+    ESP_MEM_CHECK(MQTT_TAG, client->batch_buffer, goto _mqtt_init_failed);
+    client->max_inflight = config->max_inflight;
+    if (client->max_inflight <= 0) {
+        client->max_inflight = MQTT_MAX_INFLIGHT;
+    }
+    client->lock = xSemaphoreCreateRecursiveMutex();
+    ESP_MEM_CHECK(MQTT_TAG, client->lock, goto _mqtt_init_failed);
     client->outbox = outbox_init();
     ESP_MEM_CHECK(MQTT_TAG, client->outbox, goto _mqtt_init_failed);
     client->status_bits = xEventGroupCreate();
@@ -314,6 +336,10 @@ esp_err_t esp_mqtt_client_destroy(esp_mqtt_client_handle_t client)
     vEventGroupDelete(client->status_bits);
     free(client->mqtt_state.in_buffer);
     free(client->mqtt_state.out_buffer);
+    free(client->batch_buffer);
+    if (client->lock) {
+        vSemaphoreDelete(client->lock);
+    }
     free(client);
     return ESP_OK;
 }
@@ -382,8 +408,39 @@ esp_err_t esp_mqtt_client_set_uri(esp_mqtt_client_handle_t client, const char *u
     return ESP_OK;
 }
 
+static esp_err_t mqtt_write_all(esp_mqtt_client_handle_t client, const uint8_t *data, int len)
+{
+    while (len > 0) {
+        int write_len = transport_write(client->transport, (char *)data, len, client->config->network_timeout_ms);
+        if (write_len <= 0) {
+            ESP_LOGE(MQTT_TAG, "Error write data or timeout, written len = %d", write_len);
+            return ESP_FAIL;
+        }
+        data += write_len;
+        len -= write_len;
+    }
+    return ESP_OK;
+}
+
+// Write the queued PUBLISH messages in one transport write, called with the client lock taken
+static esp_err_t mqtt_flush_batch(esp_mqtt_client_handle_t client)
+{
+    if (client->batch_len == 0) {
+        return ESP_OK;
+    }
+    int len = client->batch_len;
+    client->batch_len = 0;
+    client->publish_stats.writes++;
+    client->publish_stats.bytes += len;
+    return mqtt_write_all(client, client->batch_buffer, len);
+}
+
 static esp_err_t mqtt_write_data(esp_mqtt_client_handle_t client)
 {
+    // keep the order of the messages, the queued ones are sent first
+    if (mqtt_flush_batch(client) != ESP_OK) {
+        return ESP_FAIL;
+    }
     int write_len = transport_write(client->transport,
                                     (char *)client->mqtt_state.outbound_message->data,
                                     client->mqtt_state.outbound_message->length,
@@ -493,7 +550,11 @@ static void mqtt_enqueue(esp_mqtt_client_handle_t client)
     ESP_LOGD(MQTT_TAG, "mqtt_enqueue id: %d, type=%d successful",
         client->mqtt_state.pending_msg_id, client->mqtt_state.pending_msg_type);
     //lock mutex
-    if (client->mqtt_state.pending_msg_count > 0) {
+    // the outbound message must still be the pending one, the buffer is reused for other messages
+    if ((client->mqtt_state.pending_msg_count > 0) &&
+            (client->mqtt_state.outbound_message) && (client->mqtt_state.outbound_message->length > 0) &&
+            (mqtt_get_type(client->mqtt_state.outbound_message->data) == client->mqtt_state.pending_msg_type) &&
+            (mqtt_get_id(client->mqtt_state.outbound_message->data, client->mqtt_state.outbound_message->length) == client->mqtt_state.pending_msg_id)) {
         //Copy to queue buffer
         outbox_enqueue(client->outbox,
                        client->mqtt_state.outbound_message->data,
@@ -505,14 +566,14 @@ static void mqtt_enqueue(esp_mqtt_client_handle_t client)
     //unlock
 }
 
-static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
+static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client, int timeout_ms)
 {
-    int read_len;
+    int read_len, msg_len;
     uint8_t msg_type;
     uint8_t msg_qos;
     uint16_t msg_id;
 
-    read_len = transport_read(client->transport, (char *)client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_length, 1000);
+    read_len = transport_read(client->transport, (char *)client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_length, timeout_ms);
 
     if (read_len < 0) {
         ESP_LOGE(MQTT_TAG, "Read error or end of stream");
@@ -523,90 +584,126 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
         return ESP_OK;
     }
 
-    msg_type = mqtt_get_type(client->mqtt_state.in_buffer);
-    msg_qos = mqtt_get_qos(client->mqtt_state.in_buffer);
-    msg_id = mqtt_get_id(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_length);
-
-    ESP_LOGD(MQTT_TAG, "msg_type=%d, msg_id=%d", msg_type, msg_id);
-    switch (msg_type)
-    {
-        case MQTT_MSG_TYPE_SUBACK:
-            if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_SUBSCRIBE, msg_id)) {
-                ESP_LOGD(MQTT_TAG, "Subscribe successful");
-                client->event.event_id = MQTT_EVENT_SUBSCRIBED;
-                client->event.type = MQTT_MSG_TYPE_SUBSCRIBE;
-                esp_mqtt_dispatch_event(client);
-            }
-            break;
-        case MQTT_MSG_TYPE_UNSUBACK:
-            if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_UNSUBSCRIBE, msg_id)) {
-                ESP_LOGD(MQTT_TAG, "UnSubscribe successful");
-                client->event.event_id = MQTT_EVENT_UNSUBSCRIBED;
-                client->event.type = MQTT_MSG_TYPE_UNSUBSCRIBE;
-                esp_mqtt_dispatch_event(client);
-            }
-            break;
-        case MQTT_MSG_TYPE_PUBLISH:
-            if (msg_qos == 1) {
-                client->mqtt_state.outbound_message = mqtt_msg_puback(&client->mqtt_state.mqtt_connection, msg_id);
-            }
-            else if (msg_qos == 2) {
-                client->mqtt_state.outbound_message = mqtt_msg_pubrec(&client->mqtt_state.mqtt_connection, msg_id);
+    xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
+    // more than one message can be received in one read (e.g. the acknowledges of the pipelined messages),
+    // the processed message is removed from the start of the input buffer
+    while (read_len > 0) {
+        msg_type = mqtt_get_type(client->mqtt_state.in_buffer);
+        msg_qos = mqtt_get_qos(client->mqtt_state.in_buffer);
+        msg_len = mqtt_get_total_length(client->mqtt_state.in_buffer, read_len);
+
+        if ((msg_type != MQTT_MSG_TYPE_PUBLISH) && ((read_len < 2) || (msg_len > read_len)) && (msg_len <= client->mqtt_state.in_buffer_length)) {
+            // the rest of a short message is not received yet
+            int len = transport_read(client->transport, (char *)client->mqtt_state.in_buffer + read_len,
+                                     (read_len < 2) ? 1 : msg_len - read_len, client->config->network_timeout_ms);
+            if (len <= 0) {
+                ESP_LOGE(MQTT_TAG, "Read error or timeout: %d", errno);
+                xSemaphoreGiveRecursive(client->lock);
+                return ESP_FAIL;
             }
+            read_len += len;
+            continue;
+        }
+        if (msg_len > read_len) {
+            msg_len = read_len;
+        }
+        msg_id = mqtt_get_id(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer_length);
+
+        ESP_LOGD(MQTT_TAG, "msg_type=%d, msg_id=%d", msg_type, msg_id);
+        switch (msg_type)
+        {
+            case MQTT_MSG_TYPE_SUBACK:
+                if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_SUBSCRIBE, msg_id)) {
+                    ESP_LOGD(MQTT_TAG, "Subscribe successful");
+                    client->event.event_id = MQTT_EVENT_SUBSCRIBED;
+                    client->event.type = MQTT_MSG_TYPE_SUBSCRIBE;
+                    esp_mqtt_dispatch_event(client);
+                }
+                break;
+            case MQTT_MSG_TYPE_UNSUBACK:
+                if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_UNSUBSCRIBE, msg_id)) {
+                    ESP_LOGD(MQTT_TAG, "UnSubscribe successful");
+                    client->event.event_id = MQTT_EVENT_UNSUBSCRIBED;
+                    client->event.type = MQTT_MSG_TYPE_UNSUBSCRIBE;
+                    esp_mqtt_dispatch_event(client);
+                }
+                break;
+            case MQTT_MSG_TYPE_PUBLISH:
+                if (msg_qos == 1) {
+                    client->mqtt_state.outbound_message = mqtt_msg_puback(&client->mqtt_state.mqtt_connection, msg_id);
+                }
+                else if (msg_qos == 2) {
+                    client->mqtt_state.outbound_message = mqtt_msg_pubrec(&client->mqtt_state.mqtt_connection, msg_id);
+                }
 
-            if (msg_qos == 1 || msg_qos == 2) {
-                ESP_LOGD(MQTT_TAG, "Queue response QoS: %d", msg_qos);
+                if (msg_qos == 1 || msg_qos == 2) {
+                    ESP_LOGD(MQTT_TAG, "Queue response QoS: %d", msg_qos);
 
-                if (mqtt_write_data(client) != ESP_OK) {
-                    ESP_LOGE(MQTT_TAG, "Error write qos msg repsonse, qos = %d", msg_qos);
-                    // TODO: Shoule reconnect?
-                    // return ESP_FAIL;
+                    if (mqtt_write_data(client) != ESP_OK) {
+                        ESP_LOGE(MQTT_TAG, "Error write qos msg repsonse, qos = %d", msg_qos);
+                        // TODO: Shoule reconnect?
+                        // return ESP_FAIL;
+                    }
                 }
-            }
-            client->mqtt_state.message_length_read = read_len;
-            client->mqtt_state.message_length = mqtt_get_total_length(client->mqtt_state.in_buffer, client->mqtt_state.message_length_read);
-            ESP_LOGI(MQTT_TAG, "deliver_publish, message_length_read=%d, message_length=%d", read_len, client->mqtt_state.message_length);
+                client->mqtt_state.message_length_read = msg_len;
+                client->mqtt_state.message_length = mqtt_get_total_length(client->mqtt_state.in_buffer, read_len);
+                ESP_LOGI(MQTT_TAG, "deliver_publish, message_length_read=%d, message_length=%d", msg_len, client->mqtt_state.message_length);
 
-            deliver_publish(client, client->mqtt_state.in_buffer, client->mqtt_state.message_length_read);
-            break;
-        case MQTT_MSG_TYPE_PUBACK:
-            if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_PUBLISH, msg_id)) {
-                ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBACK, finish QoS1 publish");
-            client->event.event_id = MQTT_EVENT_PUBLISHED;
-            client->event.type = MQTT_MSG_TYPE_PUBACK;
-            esp_mqtt_dispatch_event(client);
-            }
+                deliver_publish(client, client->mqtt_state.in_buffer, client->mqtt_state.message_length_read);
+                break;
+            case MQTT_MSG_TYPE_PUBACK:
+                if (outbox_delete(client->outbox, msg_id, MQTT_MSG_TYPE_PUBLISH) == ESP_OK) {
+                    ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBACK, finish QoS1 publish");
+                    xEventGroupSetBits(client->status_bits, INFLIGHT_BIT);
+                    client->event.event_id = MQTT_EVENT_PUBLISHED;
+                    client->event.type = MQTT_MSG_TYPE_PUBACK;
+                    esp_mqtt_dispatch_event(client);
+                }
 
-            break;
-        case MQTT_MSG_TYPE_PUBREC:
-            ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBREC");
-            client->mqtt_state.outbound_message = mqtt_msg_pubrel(&client->mqtt_state.mqtt_connection, msg_id);
-            mqtt_write_data(client);
-            break;
-        case MQTT_MSG_TYPE_PUBREL:
-            ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBREL");
-            client->mqtt_state.outbound_message = mqtt_msg_pubcomp(&client->mqtt_state.mqtt_connection, msg_id);
-            mqtt_write_data(client);
+                break;
+            case MQTT_MSG_TYPE_PUBREC:
+                ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBREC");
+                if (outbox_delete(client->outbox, msg_id, MQTT_MSG_TYPE_PUBLISH) == ESP_OK) {
+                    xEventGroupSetBits(client->status_bits, INFLIGHT_BIT);
+                }
+                client->mqtt_state.outbound_message = mqtt_msg_pubrel(&client->mqtt_state.mqtt_connection, msg_id);
+                mqtt_write_data(client);
+                break;
+            case MQTT_MSG_TYPE_PUBREL:
+                ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBREL");
+                client->mqtt_state.outbound_message = mqtt_msg_pubcomp(&client->mqtt_state.mqtt_connection, msg_id);
+                mqtt_write_data(client);
 
+                break;
+            case MQTT_MSG_TYPE_PUBCOMP:
+                ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBCOMP");
+                if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_PUBREL, msg_id)) {
+                    ESP_LOGD(MQTT_TAG, "Receive MQTT_MSG_TYPE_PUBCOMP, finish QoS2 publish");
+                client->event.event_id = MQTT_EVENT_PUBLISHED;
+                client->event.type = MQTT_MSG_TYPE_PUBCOMP;
+                esp_mqtt_dispatch_event(client);
+                }
+                break;
+            case MQTT_MSG_TYPE_PINGREQ:
+                client->mqtt_state.outbound_message = mqtt_msg_pingresp(&client->mqtt_state.mqtt_connection);
+                mqtt_write_data(client);
+                break;
+            case MQTT_MSG_TYPE_PINGRESP:
+                ESP_LOGD(MQTT_TAG, "MQTT_MSG_TYPE_PINGRESP");
+                // Ignore
+                break;
+        }
+
+        if ((msg_type == MQTT_MSG_TYPE_PUBLISH) && (client->mqtt_state.message_length > msg_len)) {
+            // the input buffer was used to receive the rest of the message
             break;
-        case MQTT_MSG_TYPE_PUBCOMP:
-            ESP_LOGD(MQTT_TAG, "received MQTT_MSG_TYPE_PUBCOMP");
-            if (is_valid_mqtt_msg(client, MQTT_MSG_TYPE_PUBREL, msg_id)) {
-                ESP_LOGD(MQTT_TAG, "Receive MQTT_MSG_TYPE_PUBCOMP, finish QoS2 publish");
-            client->event.event_id = MQTT_EVENT_PUBLISHED;
-            client->event.type = MQTT_MSG_TYPE_PUBCOMP;
-            esp_mqtt_dispatch_event(client);
-            }
-            break;
-        case MQTT_MSG_TYPE_PINGREQ:
-            client->mqtt_state.outbound_message = mqtt_msg_pingresp(&client->mqtt_state.mqtt_connection);
-            mqtt_write_data(client);
-            break;
-        case MQTT_MSG_TYPE_PINGRESP:
-            ESP_LOGD(MQTT_TAG, "MQTT_MSG_TYPE_PINGRESP");
-            // Ignore
-            break;
+        }
+        read_len -= msg_len;
+        if (read_len > 0) {
+            memmove(client->mqtt_state.in_buffer, client->mqtt_state.in_buffer + msg_len, read_len);
+        }
     }
+    xSemaphoreGiveRecursive(client->lock);
 
     return ESP_OK;
 }
@@ -614,6 +711,7 @@ static esp_err_t mqtt_process_receive(esp_mqtt_client_handle_t client)
 static void esp_mqtt_task(void *pv)
 {
     esp_mqtt_client_handle_t client = (esp_mqtt_client_handle_t) pv;
+    int read_timeout, inflight;
     client->run = true;
 
     //get transport by scheme
@@ -660,23 +758,47 @@ static void esp_mqtt_task(void *pv)
                 break;
             case MQTT_STATE_CONNECTED:
                 // receive and process data
-                if (mqtt_process_receive(client) == ESP_FAIL) {
+                // don't wait longer than the queued messages may be delayed
+                read_timeout = 1000;
+                if (client->batch_len > 0) {
+                    read_timeout = MQTT_PUBLISH_BATCH_DELAY_MS - (int)(platform_tick_get_ms() - client->batch_tick);
+                    if (read_timeout < 0) {
+                        read_timeout = 0;
+                    }
+                }
+                if (mqtt_process_receive(client, read_timeout) == ESP_FAIL) {
                     esp_mqtt_abort_connection(client);
                     break;
                 }
 
+                xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
+                if ((client->batch_len > 0) && (platform_tick_get_ms() - client->batch_tick >= MQTT_PUBLISH_BATCH_DELAY_MS)) {
+                    if (mqtt_flush_batch(client) != ESP_OK) {
+                        xSemaphoreGiveRecursive(client->lock);
+                        esp_mqtt_abort_connection(client);
+                        break;
+                    }
+                }
+
                 if (platform_tick_get_ms() - client->keepalive_tick > client->connect_info.keepalive * 1000 / 2) {
                     if (esp_mqtt_client_ping(client) == ESP_FAIL) {
+                        xSemaphoreGiveRecursive(client->lock);
                         esp_mqtt_abort_connection(client);
                         break;
                     }
                     client->keepalive_tick = platform_tick_get_ms();
                 }
 
+                inflight = outbox_get_count(client->outbox, MQTT_MSG_TYPE_PUBLISH);
                 //Delete mesaage after 30 senconds
                 outbox_delete_expired(client->outbox, platform_tick_get_ms(), OUTBOX_EXPIRED_TIMEOUT_MS);
                 //
                 outbox_cleanup(client->outbox, OUTBOX_MAX_SIZE);
+                if (outbox_get_count(client->outbox, MQTT_MSG_TYPE_PUBLISH) < inflight) {
+                    // unacknowledged messages were dropped, the in-flight window has free slots
+                    xEventGroupSetBits(client->status_bits, INFLIGHT_BIT);
+                }
+                xSemaphoreGiveRecursive(client->lock);
                 break;
             case MQTT_STATE_WAIT_TIMEOUT:
 
@@ -745,6 +867,7 @@ int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic
         ESP_LOGE(MQTT_TAG, "Client has not connected");
         return -1;
     }
+    xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
     mqtt_enqueue(client); //move pending msg to outbox (if have)
     client->mqtt_state.outbound_message = mqtt_msg_subscribe(&client->mqtt_state.mqtt_connection,
                                           topic, qos,
@@ -754,9 +877,11 @@ int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic
     client->mqtt_state.pending_msg_count ++;
 
     if (mqtt_write_data(client) != ESP_OK) {
+        xSemaphoreGiveRecursive(client->lock);
         ESP_LOGE(MQTT_TAG, "Error to subscribe topic=%s, qos=%d", topic, qos);
         return -1;
     }
+    xSemaphoreGiveRecursive(client->lock);
 
     ESP_LOGD(MQTT_TAG, "Sent subscribe topic=%s, id: %d, type=%d successful", topic, client->mqtt_state.pending_msg_id, client->mqtt_state.pending_msg_type);
     return client->mqtt_state.pending_msg_id;
@@ -768,6 +893,7 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *top
         ESP_LOGE(MQTT_TAG, "Client has not connected");
         return -1;
     }
+    xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
     mqtt_enqueue(client);
     client->mqtt_state.outbound_message = mqtt_msg_unsubscribe(&client->mqtt_state.mqtt_connection,
                                           topic,
@@ -778,17 +904,68 @@ int esp_mqtt_client_unsubscribe(esp_mqtt_client_handle_t client, const char *top
     client->mqtt_state.pending_msg_count ++;
 
     if (mqtt_write_data(client) != ESP_OK) {
+        xSemaphoreGiveRecursive(client->lock);
         ESP_LOGE(MQTT_TAG, "Error to unsubscribe topic=%s", topic);
         return -1;
     }
+    xSemaphoreGiveRecursive(client->lock);
 
     ESP_LOGD(MQTT_TAG, "Sent Unsubscribe topic=%s, id: %d, successful", topic, client->mqtt_state.pending_msg_id);
     return client->mqtt_state.pending_msg_id;
 }
 
-int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+// Build a PUBLISH message and add it to the publish queue, called with the client lock taken
+static int mqtt_queue_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    uint16_t msg_id = 0;
+    mqtt_message_t *msg = mqtt_msg_publish(&client->mqtt_state.mqtt_connection,
+                                           topic, data, len,
+                                           qos, retain,
+                                           &msg_id);
+    if (msg->length == 0) {
+        ESP_LOGE(MQTT_TAG, "Error creating publish message, topic=%s, len=%d", topic, len);
+        return -1;
+    }
+    client->mqtt_state.outbound_message = msg;
+
+    if (client->batch_len + msg->length > client->batch_size) {
+        if (mqtt_flush_batch(client) != ESP_OK) {
+            return -1;
+        }
+    }
+    if (msg->length > client->batch_size) {
+        // does not fit into the queue, write it directly
+        client->publish_stats.writes++;
+        client->publish_stats.bytes += msg->length;
+        if (mqtt_write_all(client, msg->data, msg->length) != ESP_OK) {
+            return -1;
+        }
+    }
+    else {
+        if (client->batch_len == 0) {
+            client->batch_tick = platform_tick_get_ms();
+        }
+        memcpy(client->batch_buffer + client->batch_len, msg->data, msg->length);
+        client->batch_len += msg->length;
+    }
+    if (qos > 0) {
+        // in flight until acknowledged
+        outbox_enqueue(client->outbox, msg->data, msg->length, msg_id, MQTT_MSG_TYPE_PUBLISH, platform_tick_get_ms());
+    }
+    client->publish_stats.messages++;
+    return msg_id;
+}
+
+/*
+ * Add the message to the publish queue without writing it to the transport.
+ * The queued messages are written in one transport write when the queue is full,
+ * on esp_mqtt_client_flush() or by the mqtt task after MQTT_PUBLISH_BATCH_DELAY_MS.
+ * For QoS > 0 waits (max. network timeout) until the number of unacknowledged messages
+ * drops below the in-flight window, must not be called from the event handler.
+ * Returns the message id (0 for QoS 0) or -1 on error.
+ */
+int esp_mqtt_client_enqueue(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
 {
-    uint16_t pending_msg_id = 0;
     if (client->state != MQTT_STATE_CONNECTED) {
         ESP_LOGE(MQTT_TAG, "Client has not connected");
         return -1;
@@ -796,25 +973,53 @@ int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic,
     if (len <= 0) {
         len = strlen(data);
     }
-    if (qos > 0) {
-        mqtt_enqueue(client);
-    }
 
-    client->mqtt_state.outbound_message = mqtt_msg_publish(&client->mqtt_state.mqtt_connection,
-                                          topic, data, len,
-                                          qos, retain,
-                                          &pending_msg_id);
-    if (qos > 0) {
-        client->mqtt_state.pending_msg_type = mqtt_get_type(client->mqtt_state.outbound_message->data);
-        client->mqtt_state.pending_msg_id = pending_msg_id;
-        client->mqtt_state.pending_msg_count ++;
+    long long start = platform_tick_get_ms();
+    xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
+    while ((qos > 0) && (outbox_get_count(client->outbox, MQTT_MSG_TYPE_PUBLISH) >= client->max_inflight)) {
+        // the queued messages must be sent for the broker to acknowledge them
+        if (mqtt_flush_batch(client) != ESP_OK) {
+            xSemaphoreGiveRecursive(client->lock);
+            return -1;
+        }
+        xEventGroupClearBits(client->status_bits, INFLIGHT_BIT);
+        xSemaphoreGiveRecursive(client->lock);
+        if ((client->state != MQTT_STATE_CONNECTED) || (platform_tick_get_ms() - start > client->config->network_timeout_ms)) {
+            ESP_LOGE(MQTT_TAG, "In-flight window full, topic=%s, qos=%d", topic, qos);
+            return -1;
+        }
+        xEventGroupWaitBits(client->status_bits, INFLIGHT_BIT, true, true, 100 / portTICK_PERIOD_MS);
+        xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
     }
+    int msg_id = mqtt_queue_publish(client, topic, data, len, qos, retain);
+    xSemaphoreGiveRecursive(client->lock);
+    return msg_id;
+}
 
-    if (mqtt_write_data(client) != ESP_OK) {
+esp_err_t esp_mqtt_client_flush(esp_mqtt_client_handle_t client)
+{
+    xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
+    esp_err_t res = mqtt_flush_batch(client);
+    xSemaphoreGiveRecursive(client->lock);
+    return res;
+}
+
+// Number of the QoS1/QoS2 messages waiting for the acknowledge
+int esp_mqtt_client_get_inflight(esp_mqtt_client_handle_t client)
+{
+    xSemaphoreTakeRecursive(client->lock, portMAX_DELAY);
+    int count = outbox_get_count(client->outbox, MQTT_MSG_TYPE_PUBLISH);
+    xSemaphoreGiveRecursive(client->lock);
+    return count;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data, int len, int qos, int retain)
+{
+    int msg_id = esp_mqtt_client_enqueue(client, topic, data, len, qos, retain);
+    if ((msg_id < 0) || (esp_mqtt_client_flush(client) != ESP_OK)) {
         ESP_LOGE(MQTT_TAG, "Error publishing data to topic=%s, qos=%d", topic, qos);
         return -1;
     }
-    return pending_msg_id;
+    return msg_id;
 }
 
-
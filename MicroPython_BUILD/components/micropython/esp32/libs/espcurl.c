@@ -33,6 +33,7 @@
 #include <ctype.h>
 #include "freertos/FreeRTOS.h"
 #include "libs/espcurl.h"
+#include "extmod/vfs_native.h"
 #include "libs/libGSM.h"
 
 #include "lwip/err.h"
@@ -56,6 +57,8 @@
 
 const char *CURL_TAG = "[Curl]";
 
+extern int MainTaskCore;
+
 // Set default values for configuration variables
 uint8_t curl_verbose = 0;			// show detailed info of what curl functions are doing
 uint8_t curl_progress = 0;			// show progress during curl transfers
@@ -209,8 +212,9 @@ static curl_socket_t opensocket_callback(void *clientp, curlsocktype purpose, st
 */
 
 // Set some common curl options
-//----------------------------------------------
-static void _set_default_options(CURL *handle) {
+// If 'reuse' is not set, the connection is closed after the transfer
+//---------------------------------------------------------------
+static void _set_default_options(CURL *handle, uint8_t reuse) {
 	curl_easy_setopt(handle, CURLOPT_VERBOSE, curl_verbose);
 
 	// ** Set SSL Options
@@ -238,7 +242,7 @@ static void _set_default_options(CURL *handle) {
     curl_easy_setopt(handle, CURLOPT_TIMEOUT, (long)curl_timeout);
 
     curl_easy_setopt(handle, CURLOPT_MAXFILESIZE, (long)curl_maxbytes);
-    curl_easy_setopt(handle, CURLOPT_FORBID_REUSE, 1L);
+    curl_easy_setopt(handle, CURLOPT_FORBID_REUSE, (reuse) ? 0L : 1L);
     curl_easy_setopt(handle, CURLOPT_NOPROGRESS, 1L);
 
     if (curl_nodecode) {
@@ -326,7 +330,7 @@ int Curl_GET(char *url, char *fname, char *hdr, char *body, int hdrlen, int body
 
     curl_easy_setopt(curl, CURLOPT_URL, url);
 
-    _set_default_options(curl);
+    _set_default_options(curl, 0);
 
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curlWrite);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &get_header);
@@ -360,7 +364,10 @@ int Curl_GET(char *url, char *fname, char *hdr, char *body, int hdrlen, int body
 
 exit:
 	// Cleanup
-    if (file) fclose(file);
+    if (file) {
+        fclose(file);
+        native_vfs_file_changed();
+    }
     if (curl) curl_easy_cleanup(curl);
 
     return err;
@@ -472,7 +479,7 @@ int Curl_IMAP_GET(const char *opts, char *fname, char *hdr, char *body, int hdrl
     printf("=== URL=[%s]\n", url);
     free(url);
 
-    _set_default_options(curl);
+    _set_default_options(curl, 0);
 
     curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curlWrite);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &get_header);
@@ -519,7 +526,10 @@ int Curl_IMAP_GET(const char *opts, char *fname, char *hdr, char *body, int hdrl
 
 exit:
     // Cleanup
-    if (file) fclose(file);
+    if (file) {
+        fclose(file);
+        native_vfs_file_changed();
+    }
     if (curl) curl_easy_cleanup(curl);
 
     return err;
@@ -576,7 +586,7 @@ int Curl_POST(char *url , char *hdr, char *body, int hdrlen, int bodylen)
 	// set URL that receives this POST
 	curl_easy_setopt(curl, CURLOPT_URL, url);
 
-    _set_default_options(curl);
+    _set_default_options(curl, 0);
 
 	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, curlWrite);
     curl_easy_setopt(curl, CURLOPT_HEADERDATA, &get_header);
@@ -690,7 +700,7 @@ int Curl_FTP(uint8_t upload, char *url, char *user_pass, char *fname, char *hdr,
 
     curl_easy_setopt(curl, CURLOPT_URL, url);
 
-    _set_default_options(curl);
+    _set_default_options(curl, 0);
 
 	/// build a list of commands to pass to libcurl
 	//headerlist = curl_slist_append(headerlist, "QUIT");
@@ -758,7 +768,10 @@ int Curl_FTP(uint8_t upload, char *url, char *user_pass, char *fname, char *hdr,
 
 exit:
 	// Cleanup
-    if (file) fclose(file);
+    if (file) {
+        fclose(file);
+        native_vfs_file_changed();
+    }
     if (curl) curl_easy_cleanup(curl);
 
     return err;
@@ -766,6 +779,361 @@ exit:
 
 #endif
 
+// ==== Multi transfer engine ====
+
+static portMUX_TYPE curl_multi_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Callback: response body to file or buffer
+//----------------------------------------------------------------------------------
+static size_t multiWrite(void *buffer, size_t size, size_t nmemb, void *userdata)
+{
+	curl_xfer_t *x = (curl_xfer_t *)userdata;
+	size_t n = size*nmemb;
+
+	if (x->orphan) return 0; // abort, the application buffer may not exist any more
+	if (x->file) {
+		size_t nwrite = fwrite(buffer, 1, n, x->file);
+		x->len += nwrite;
+		return nwrite;
+	}
+	// abort the transfer if the buffer is full
+	if ((x->len + n) > x->buf_size) return 0;
+	memcpy(x->buf + x->len, buffer, n);
+	x->len += n;
+	return n;
+}
+
+// Callback: response header, truncated to the header buffer size
+//-----------------------------------------------------------------------------------
+static size_t multiHeader(void *buffer, size_t size, size_t nmemb, void *userdata)
+{
+	curl_xfer_t *x = (curl_xfer_t *)userdata;
+	size_t n = size*nmemb;
+
+	if ((x->hdr) && (x->hdr_len < (x->hdr_size-1))) {
+		size_t len = n;
+		if (len > (x->hdr_size - 1 - x->hdr_len)) len = x->hdr_size - 1 - x->hdr_len;
+		memcpy(x->hdr + x->hdr_len, buffer, len);
+		x->hdr_len += len;
+		x->hdr[x->hdr_len] = '\0';
+	}
+	return n;
+}
+
+// Callback: ftp PUT from file
+//-------------------------------------------------------------------------------
+static size_t multiRead(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	curl_xfer_t *x = (curl_xfer_t *)userdata;
+
+	if (x->orphan) return CURL_READFUNC_ABORT;
+	size_t nread = fread(ptr, 1, size*nmemb, x->file);
+	x->len += nread;
+	return nread;
+}
+
+// Remove the finished transfer from the multi handle
+// The connection is returned to the multi handle's cache and used by the next transfer to the same host
+//------------------------------------------------------------------------------
+static void multi_xfer_finish(curl_multi_t *m, curl_xfer_t *x, bool added)
+{
+	long n = 0;
+
+	if (x->curl) {
+		curl_easy_getinfo(x->curl, CURLINFO_RESPONSE_CODE, &x->status);
+		if (curl_easy_getinfo(x->curl, CURLINFO_NUM_CONNECTS, &n) == CURLE_OK) m->n_connects += n;
+		if (added) curl_multi_remove_handle(m->multi, x->curl);
+		curl_easy_cleanup(x->curl);
+		x->curl = NULL;
+	}
+	if (x->file) {
+		fclose(x->file);
+		native_vfs_file_changed();
+	}
+	x->file = NULL;
+	m->n_transfers++;
+
+	// the result is ready when the callback is called, but the transfer is owned
+	// by the multi task until the callback returns, so the application keeps its object
+	portENTER_CRITICAL(&curl_multi_mux);
+	x->ready = true;
+	portEXIT_CRITICAL(&curl_multi_mux);
+	if ((x->done_cb) && (!x->orphan) && (!m->stop)) x->done_cb(x);
+
+	portENTER_CRITICAL(&curl_multi_mux);
+	m->pending--;
+	bool orphan = x->orphan;
+	x->queued = false;
+	portEXIT_CRITICAL(&curl_multi_mux);
+
+	if (orphan) {
+		if (x->own_buf) free(x->buf);
+		if (x->hdr) free(x->hdr);
+		free(x);
+	}
+}
+
+//---------------------------------------
+static void curl_multi_task(void *arg)
+{
+	curl_multi_t *m = (curl_multi_t *)arg;
+	curl_xfer_t *x;
+	curl_xfer_t *prev;
+	CURLMsg *msg;
+	int running = 0;
+	int nmsg;
+
+	while (!m->stop) {
+		// Add the new transfers, if there are no active transfers wait for the new one
+		TickType_t wait = (m->active) ? 0 : (CURL_MULTI_IDLE_MS / portTICK_PERIOD_MS);
+		while (xQueueReceive(m->add_q, &x, wait) == pdTRUE) {
+			wait = 0;
+			if (x == NULL) continue; // wake up
+			if (curl_multi_add_handle(m->multi, x->curl) != CURLM_OK) {
+				x->result = CURLE_FAILED_INIT;
+				multi_xfer_finish(m, x, false);
+				continue;
+			}
+			x->next = m->active;
+			m->active = x;
+		}
+		if ((m->stop) || (m->active == NULL)) continue;
+
+		curl_multi_perform(m->multi, &running);
+
+		while ((msg = curl_multi_info_read(m->multi, &nmsg))) {
+			if (msg->msg != CURLMSG_DONE) continue;
+			x = NULL;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&x);
+			if (x == NULL) continue;
+			x->result = msg->data.result;
+			// remove from the active list
+			if (m->active == x) m->active = x->next;
+			else {
+				for (prev = m->active; prev; prev = prev->next) {
+					if (prev->next == x) {
+						prev->next = x->next;
+						break;
+					}
+				}
+			}
+			multi_xfer_finish(m, x, true);
+		}
+
+		if (m->active) curl_multi_wait(m->multi, NULL, 0, CURL_MULTI_WAIT_MS, NULL);
+	}
+
+	// Abort the unfinished transfers
+	while (m->active) {
+		x = m->active;
+		m->active = x->next;
+		x->result = CURLE_ABORTED_BY_CALLBACK;
+		multi_xfer_finish(m, x, true);
+	}
+	while (xQueueReceive(m->add_q, &x, 0) == pdTRUE) {
+		if (x == NULL) continue;
+		x->result = CURLE_ABORTED_BY_CALLBACK;
+		multi_xfer_finish(m, x, false);
+	}
+	curl_multi_cleanup(m->multi);
+	m->multi = NULL;
+
+	portENTER_CRITICAL(&curl_multi_mux);
+	bool detached = m->detached;
+	portEXIT_CRITICAL(&curl_multi_mux);
+	if (detached) {
+		vQueueDelete(m->add_q);
+		vSemaphoreDelete(m->stopped);
+		free(m);
+	}
+	else xSemaphoreGive(m->stopped);
+	vTaskDelete(NULL);
+}
+
+//===========================================================
+curl_multi_t *Curl_multi_new(int max_total, int max_host)
+{
+	if (!curl_initialized) {
+		if (curl_global_init(CURL_GLOBAL_DEFAULT)) return NULL;
+		curl_initialized = 1;
+	}
+
+	curl_multi_t *m = calloc(1, sizeof(curl_multi_t));
+	if (m == NULL) return NULL;
+
+	m->multi = curl_multi_init();
+	m->add_q = xQueueCreate(CURL_MULTI_QUEUE, sizeof(curl_xfer_t *));
+	m->stopped = xSemaphoreCreateBinary();
+	if ((m->multi == NULL) || (m->add_q == NULL) || (m->stopped == NULL)) goto error;
+
+	// connections are kept open for reuse, up to max_total
+	curl_multi_setopt(m->multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long)max_total);
+	curl_multi_setopt(m->multi, CURLMOPT_MAXCONNECTS, (long)max_total);
+	curl_multi_setopt(m->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)max_host);
+
+	#if CONFIG_MICROPY_USE_BOTH_CORES
+	int tres = xTaskCreate(curl_multi_task, "Curl_multi", CURL_MULTI_STACK, m, CONFIG_MICROPY_TASK_PRIORITY, NULL);
+	#else
+	int tres = xTaskCreatePinnedToCore(curl_multi_task, "Curl_multi", CURL_MULTI_STACK, m, CONFIG_MICROPY_TASK_PRIORITY, NULL, MainTaskCore);
+	#endif
+	if (tres != pdTRUE) goto error;
+	return m;
+
+error:
+	ESP_LOGE(CURL_TAG, "Error creating multi handle");
+	if (m->multi) curl_multi_cleanup(m->multi);
+	if (m->add_q) vQueueDelete(m->add_q);
+	if (m->stopped) vSemaphoreDelete(m->stopped);
+	free(m);
+	return NULL;
+}
+
+//================================================
+void Curl_multi_stop(curl_multi_t *m, bool wait)
+{
+	curl_xfer_t *wake = NULL;
+
+	if (!wait) {
+		// the idle task sees the flag within CURL_MULTI_IDLE_MS, 'm' can be freed as soon as it is set
+		portENTER_CRITICAL(&curl_multi_mux);
+		m->detached = true;
+		m->stop = true;
+		portEXIT_CRITICAL(&curl_multi_mux);
+		return;
+	}
+	m->stop = true;
+	xQueueSend(m->add_q, &wake, 0);
+	xSemaphoreTake(m->stopped, portMAX_DELAY);
+
+	vQueueDelete(m->add_q);
+	vSemaphoreDelete(m->stopped);
+	free(m);
+}
+
+//===================================================================================================================================
+curl_xfer_t *Curl_xfer_new(uint8_t type, char *url, char *user_pass, char *fname, char *buf, int buf_size, int hdr_size, int *err)
+{
+	curl_xfer_t *x = NULL;
+
+	*err = 0;
+	if ((!url) || ((type != CURL_XFER_GET) && (!user_pass))) {
+		*err = -3;
+		return NULL;
+	}
+	x = calloc(1, sizeof(curl_xfer_t));
+	if (x == NULL) {
+		*err = -5;
+		return NULL;
+	}
+	x->type = type;
+
+	if (hdr_size >= MIN_HDR_BUF_LEN) {
+		x->hdr = malloc(hdr_size);
+		if (x->hdr == NULL) goto error;
+		x->hdr[0] = '\0';
+		x->hdr_size = hdr_size;
+	}
+
+	if (fname) {
+		x->file = fopen(fname, (type == CURL_XFER_FTP_PUT) ? "rb" : "wb");
+		if (x->file == NULL) {
+			*err = -6;
+			goto error;
+		}
+	}
+	else if (type == CURL_XFER_FTP_PUT) {
+		*err = -6;
+		goto error;
+	}
+	else if (buf) {
+		x->buf = buf;
+		x->buf_size = buf_size;
+	}
+	else {
+		x->buf = malloc(buf_size);
+		if (x->buf == NULL) goto error;
+		x->buf_size = buf_size;
+		x->own_buf = true;
+	}
+
+	x->curl = curl_easy_init();
+	if (x->curl == NULL) goto error;
+
+	curl_easy_setopt(x->curl, CURLOPT_URL, url);
+	_set_default_options(x->curl, 1);
+	curl_easy_setopt(x->curl, CURLOPT_PRIVATE, (char *)x);
+	curl_easy_setopt(x->curl, CURLOPT_HEADERFUNCTION, multiHeader);
+	curl_easy_setopt(x->curl, CURLOPT_HEADERDATA, x);
+
+	if (type != CURL_XFER_GET) {
+		curl_easy_setopt(x->curl, CURLOPT_USERPWD, user_pass);
+		curl_easy_setopt(x->curl, CURLOPT_FTP_USE_EPSV, 0L);
+		curl_easy_setopt(x->curl, CURLOPT_USE_SSL, CURLUSESSL_TRY);
+	}
+	if (type == CURL_XFER_FTP_PUT) {
+		struct stat sb;
+		curl_easy_setopt(x->curl, CURLOPT_FTP_CREATE_MISSING_DIRS, CURLFTP_CREATE_DIR_RETRY);
+		curl_easy_setopt(x->curl, CURLOPT_READFUNCTION, multiRead);
+		curl_easy_setopt(x->curl, CURLOPT_READDATA, x);
+		curl_easy_setopt(x->curl, CURLOPT_UPLOAD, 1L);
+		if ((stat(fname, &sb) == 0) && (sb.st_size > 0)) curl_easy_setopt(x->curl, CURLOPT_INFILESIZE, (long)sb.st_size);
+	}
+	else {
+		curl_easy_setopt(x->curl, CURLOPT_WRITEFUNCTION, multiWrite);
+		curl_easy_setopt(x->curl, CURLOPT_WRITEDATA, x);
+	}
+	return x;
+
+error:
+	if (*err == 0) *err = -5;
+	if (x->file) {
+		fclose(x->file);
+		native_vfs_file_changed();
+	}
+	if (x->own_buf) free(x->buf);
+	if (x->hdr) free(x->hdr);
+	free(x);
+	return NULL;
+}
+
+//=====================================================
+int Curl_multi_add(curl_multi_t *m, curl_xfer_t *xfer)
+{
+	if ((m->stop) || (xfer->queued) || (xfer->ready)) return -1;
+
+	portENTER_CRITICAL(&curl_multi_mux);
+	xfer->queued = true;
+	m->pending++;
+	portEXIT_CRITICAL(&curl_multi_mux);
+	if (xQueueSend(m->add_q, &xfer, 1000 / portTICK_PERIOD_MS) != pdTRUE) {
+		portENTER_CRITICAL(&curl_multi_mux);
+		xfer->queued = false;
+		m->pending--;
+		portEXIT_CRITICAL(&curl_multi_mux);
+		return -1;
+	}
+	return 0;
+}
+
+//===================================
+void Curl_xfer_free(curl_xfer_t *xfer)
+{
+	portENTER_CRITICAL(&curl_multi_mux);
+	bool queued = xfer->queued;
+	if (queued) xfer->orphan = true;
+	portEXIT_CRITICAL(&curl_multi_mux);
+	if (queued) return; // freed by the multi task
+
+	if (xfer->curl) curl_easy_cleanup(xfer->curl);
+	if (xfer->file) {
+		fclose(xfer->file);
+		native_vfs_file_changed();
+	}
+	if (xfer->own_buf) free(xfer->buf);
+	if (xfer->hdr) free(xfer->hdr);
+	free(xfer);
+}
+
 //-------------------
 void Curl_cleanup() {
 	if (curl_initialized) {
@@ -1202,13 +1570,19 @@ int ssh_SCP(uint8_t type, char *server, char *port, char * scppath, char *user,
     if (rc != 0) {
         sprintf(msg, "* libssh2 initialization failed (%d)", rc);
     	_append_msg(hdr, msg, hdrlen, ESP_LOG_ERROR);
-        if (fdd) fclose(fdd);
+        if (fdd) {
+            fclose(fdd);
+            native_vfs_file_changed();
+        }
         return -1;
     }
 
     int sock = sock_connect(server, port, hdr, hdrlen);
     if (sock < 0) {
-        if (fdd) fclose(fdd);
+        if (fdd) {
+            fclose(fdd);
+            native_vfs_file_changed();
+        }
     	libssh2_exit();
     	return -2;
     }
@@ -1217,7 +1591,10 @@ int ssh_SCP(uint8_t type, char *server, char *port, char * scppath, char *user,
     // ** Create session
     session = getSSHSession(sock, user, pass, privkey, pubkey, auth, hdr, hdrlen);
     if (session == NULL) {
-        if (fdd) fclose(fdd);
+        if (fdd) {
+            fclose(fdd);
+            native_vfs_file_changed();
+        }
     	close(sock);
     	libssh2_exit();
     	return -3;
@@ -1430,7 +1807,10 @@ endchannel:
     }
 
 shutdown:
-	if (fdd) fclose(fdd);
+	if (fdd) {
+		fclose(fdd);
+		native_vfs_file_changed();
+	}
 	libssh2_session_disconnect(session, "Normal Shutdown.");
 	libssh2_session_free(session);
 	close(sock);
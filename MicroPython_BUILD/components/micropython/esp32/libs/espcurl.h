@@ -146,6 +146,102 @@ int Curl_FTP(uint8_t upload, char *url, char *user_pass, char *fname, char *hdr,
 
 #endif
 
+
+// ==== Multi transfer engine ====
+// Transfers are performed by the curl multi interface in the dedicated FreeRTOS task.
+// Open connections and the DNS cache of the multi handle are shared by all its transfers.
+
+#include <stdio.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#define CURL_XFER_GET		0
+#define CURL_XFER_FTP_GET	1
+#define CURL_XFER_FTP_PUT	2
+#define CURL_XFER_FTP_LIST	3
+
+#define CURL_MULTI_STACK	10240	// TLS handshake runs in the multi task
+#define CURL_MULTI_QUEUE	16		// max transfers waiting to be added to the multi handle
+#define CURL_MULTI_WAIT_MS	50		// max latency of adding the new transfer
+#define CURL_MULTI_IDLE_MS	500		// max latency of the stop signaled without waiting
+
+typedef struct _curl_xfer_t {
+	CURL *curl;
+	FILE *file;				// download to or upload from file
+	char *buf;				// received body, the application's or allocated buffer
+	uint32_t buf_size;
+	uint32_t len;			// received or sent bytes
+	char *hdr;				// received response header
+	uint32_t hdr_size;
+	uint32_t hdr_len;
+	bool own_buf;
+	uint8_t type;
+	int result;				// CURLcode
+	long status;			// http or ftp response code
+	volatile bool ready;	// result, status and len are final
+	volatile bool queued;	// owned by the multi task, until after the done callback
+	volatile bool orphan;	// released while queued, freed by the multi task
+	void (*done_cb)(struct _curl_xfer_t *xfer);	// called from the multi task
+	void *arg;
+	struct _curl_xfer_t *next;
+} curl_xfer_t;
+
+typedef struct _curl_multi_t {
+	CURLM *multi;
+	QueueHandle_t add_q;
+	SemaphoreHandle_t stopped;
+	curl_xfer_t *active;	// transfers added to the multi handle
+	volatile bool stop;
+	volatile bool detached;	// stopped without waiting, the task frees the multi handle
+	volatile int pending;	// queued and active transfers
+	uint32_t n_transfers;
+	uint32_t n_connects;	// new connections, n_transfers - n_connects transfers used the open connection
+} curl_multi_t;
+
+/*
+ * Create the multi handle and start its task
+ *   max_total: max number of open connections, more transfers wait for the free connection
+ *    max_host: max number of connections to the same host
+ * Returns NULL on error
+ */
+//===================================================
+curl_multi_t *Curl_multi_new(int max_total, int max_host);
+
+/*
+ * Abort the unfinished transfers, stop the task and free the multi handle
+ *   wait: wait for the task to finish, must be called with the GIL released;
+ *         if false, the task is only signaled to stop and frees the multi handle itself
+ *         (from the finaliser), 'm' must not be used after the call
+ */
+//===============================================
+void Curl_multi_stop(curl_multi_t *m, bool wait);
+
+/*
+ * Create the new transfer
+ *    url, user_pass: as for Curl_GET and Curl_FTP
+ *     fname: download to or upload from the file of that name
+ *       buf: if fname is NULL, the body is received to this buffer, if NULL the buffer of buf_size is allocated
+ *  hdr_size: size of the response header buffer
+ * On error, NULL is returned and 'err' is set to the same code as returned from Curl_GET
+ */
+//====================================================================================================================================
+curl_xfer_t *Curl_xfer_new(uint8_t type, char *url, char *user_pass, char *fname, char *buf, int buf_size, int hdr_size, int *err);
+
+/*
+ * Add the transfer to the multi handle, it is started by the multi task
+ * Returns 0 on success, -1 if the multi handle is stopped or the queue is full
+ */
+//======================================================
+int Curl_multi_add(curl_multi_t *m, curl_xfer_t *xfer);
+
+/*
+ * Free the transfer, if it is not finished it will be freed by the multi task
+ */
+//====================================
+void Curl_xfer_free(curl_xfer_t *xfer);
+
 #endif //CONFIG_MICROPY_USE_CURL
 
 //==================
@@ -82,14 +82,25 @@ const char *FTP_TAG = "[Ftp]";
  ******************************************************************************/
 #define FTP_CMD_PORT                        21
 #define FTP_ACTIVE_DATA_PORT                20
-#define FTP_PASIVE_DATA_PORT                2024
+#define FTP_PASIVE_DATA_PORT                2024	// session 'n' uses FTP_PASIVE_DATA_PORT + n
 #define FTP_CMD_SIZE_MAX                    6
-#define FTP_CMD_CLIENTS_MAX                 1
-#define FTP_DATA_CLIENTS_MAX                1
 #define FTP_MAX_PARAM_SIZE                  (MICROPY_ALLOC_PATH_MAX + 1)
 #define FTP_UNIX_SECONDS_180_DAYS           15552000
 #define FTP_DATA_TIMEOUT_MS                 10000	// 10 seconds
-#define FTP_SOCKETFIFO_ELEMENTS_MAX         4
+#define FTP_REPLY_TIMEOUT_MS                200
+#define FTP_LIST_ITEM_MAX                   (FTP_MAX_PARAM_SIZE + 64)
+#define FTP_BUSY_YIELD_MS                   100
+
+#ifdef CONFIG_MICROPY_FTPSERVER_MAX_SESSIONS
+#define FTP_SESSIONS_MAX                    CONFIG_MICROPY_FTPSERVER_MAX_SESSIONS
+#else
+#define FTP_SESSIONS_MAX                    2
+#endif
+
+// The file is sent in chunks matched to the lwip send buffer:
+// the chunk grows while lwip accepts the whole chunk and shrinks when the send window is full
+#define FTP_TX_CHUNK_MIN                    (MIN(TCP_MSS, ftp_buff_size))
+#define FTP_TX_CHUNK_MAX                    (MIN(TCP_SND_BUF, ftp_buff_size))
 
 /******************************************************************************
  DEFINE PRIVATE TYPES
@@ -117,19 +128,29 @@ typedef enum {
     E_FTP_CLOSE_CMD_AND_DATA,
 } ftp_e_closesocket_t;
 
+// Transmit buffer, data from 'pos' to 'len' is not yet sent
+typedef struct {
+    uint8_t         *buf;
+    uint32_t        len;
+    uint32_t        pos;
+} ftp_txbuf_t;
+
+// One client session (control connection and its data connection)
 typedef struct {
     uint8_t         *dBuffer;
+    uint8_t         *tBuffer;		// second transmit buffer, allocated on first LIST/RETR
+    char            *path;
     uint32_t        ctimeout;
     union {
         DIR         *dp;
         FILE        *fp;
     };
-    int32_t         lc_sd;
     int32_t         ld_sd;
     int32_t         c_sd;
     int32_t         d_sd;
     int32_t         dtimeout;
     uint32_t        ip_addr;
+    uint8_t         index;
     uint8_t         state;
     uint8_t         substate;
     uint8_t         txRetries;
@@ -137,8 +158,15 @@ typedef struct {
     ftp_loggin_t	loggin;
     uint8_t         e_open;
     bool            closechild;
-    bool            enabled;
     bool            listroot;
+    bool            nlist;
+    bool            quit;
+    ftp_txbuf_t     tx[2];			// transmit buffers, one is sent while the other is filled
+    uint8_t         tx_nbuf;
+    uint8_t         tx_head;		// buffer being sent
+    uint8_t         tx_count;		// number of filled buffers
+    bool            tx_eof;			// nothing more to read
+    uint32_t        tx_chunk;		// current read size
     uint32_t		total;
     uint32_t		time;
 } ftp_data_t;
@@ -184,11 +212,14 @@ char ftp_pass[FTP_USER_PASS_LEN_MAX + 1];
 /******************************************************************************
  DECLARE PRIVATE DATA
  ******************************************************************************/
-static ftp_data_t ftp_data = {0};
-static char *ftp_path = NULL;
+static ftp_data_t ftp_sessions[FTP_SESSIONS_MAX] = {0};
+static int32_t ftp_lc_sd = -1;			// control connections listening socket
+static uint8_t ftp_state = E_FTP_STE_DISABLED;
+static bool ftp_enabled = false;
+static TickType_t ftp_busy_since = 0;
+// command and reply buffers are shared, the commands of all sessions are processed in the ftp task
 static char *ftp_scratch_buffer = NULL;;
 static char *ftp_cmd_buffer = NULL;
-static uint8_t ftp_nlist = 0;
 static const ftp_cmd_t ftp_cmd_table[] = { { "FEAT" }, { "SYST" }, { "CDUP" }, { "CWD"  },
                                            { "PWD"  }, { "XPWD" }, { "SIZE" }, { "MDTM" },
                                            { "TYPE" }, { "USER" }, { "PASS" }, { "PASV" },
@@ -208,105 +239,109 @@ static void stoupper (char *str) {
 
 // ==== File functions =========================================
 
-//--------------------------------------------------------------
-static bool ftp_open_file (const char *path, const char *mode) {
-	ftp_data.fp = fopen(path, mode);
-    if (ftp_data.fp == NULL) {
+//-------------------------------------------------------------------------------
+static bool ftp_open_file (ftp_data_t *session, const char *path, const char *mode) {
+	session->fp = fopen(path, mode);
+    if (session->fp == NULL) {
         return false;
     }
-    ftp_data.e_open = E_FTP_FILE_OPEN;
+    // created or truncated
+    if (mode[0] != 'r') native_vfs_file_changed();
+    session->e_open = E_FTP_FILE_OPEN;
     return true;
 }
 
-//--------------------------------------
-static void ftp_close_files_dir (void) {
-    if (ftp_data.e_open == E_FTP_FILE_OPEN) {
-        fclose(ftp_data.fp);
-    	ftp_data.fp = NULL;
+//--------------------------------------------------------
+static void ftp_close_files_dir (ftp_data_t *session) {
+    if (session->e_open == E_FTP_FILE_OPEN) {
+        fclose(session->fp);
+    	session->fp = NULL;
+    	// the buffered data of the uploaded file is written on close
+    	native_vfs_file_changed();
     }
-    else if (ftp_data.e_open == E_FTP_DIR_OPEN) {
-        closedir(ftp_data.dp);
-    	ftp_data.dp = NULL;
+    else if (session->e_open == E_FTP_DIR_OPEN) {
+        closedir(session->dp);
+    	session->dp = NULL;
     }
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
+    session->e_open = E_FTP_NOTHING_OPEN;
 }
 
-//------------------------------------------------
-static void ftp_close_filesystem_on_error (void) {
-    ftp_close_files_dir();
-    if (ftp_data.fp) {
-    	fclose(ftp_data.fp);
-    	ftp_data.fp = NULL;
+//------------------------------------------------------------------
+static void ftp_close_filesystem_on_error (ftp_data_t *session) {
+    ftp_close_files_dir(session);
+    if (session->fp) {
+    	fclose(session->fp);
+    	session->fp = NULL;
     }
-    if (ftp_data.dp) {
-    	closedir(ftp_data.dp);
-    	ftp_data.dp = NULL;
+    if (session->dp) {
+    	closedir(session->dp);
+    	session->dp = NULL;
     }
 }
 
-//---------------------------------------------------------------------------------------------
-static ftp_result_t ftp_read_file (char *filebuf, uint32_t desiredsize, uint32_t *actualsize) {
+//----------------------------------------------------------------------------------------------------------------
+static ftp_result_t ftp_read_file (ftp_data_t *session, char *filebuf, uint32_t desiredsize, uint32_t *actualsize) {
     ftp_result_t result = E_FTP_RESULT_CONTINUE;
-    *actualsize = fread(filebuf, 1, desiredsize, ftp_data.fp);
-    if (*actualsize == 0) {
-        ftp_close_files_dir();
-        result = E_FTP_RESULT_FAILED;
-    } else if (*actualsize < desiredsize) {
-        ftp_close_files_dir();
-        result = E_FTP_RESULT_OK;
+    *actualsize = fread(filebuf, 1, desiredsize, session->fp);
+    if (*actualsize < desiredsize) {
+        // end of file or read error
+        if (ferror(session->fp)) result = E_FTP_RESULT_FAILED;
+        else result = E_FTP_RESULT_OK;
+        ftp_close_files_dir(session);
     }
     return result;
 }
 
-//-----------------------------------------------------------------
-static ftp_result_t ftp_write_file (char *filebuf, uint32_t size) {
+//-----------------------------------------------------------------------------------
+static ftp_result_t ftp_write_file (ftp_data_t *session, char *filebuf, uint32_t size) {
     ftp_result_t result = E_FTP_RESULT_FAILED;
-    uint32_t actualsize = fwrite(filebuf, 1, size, ftp_data.fp);
+    uint32_t actualsize = fwrite(filebuf, 1, size, session->fp);
+    native_vfs_file_changed();
     if (actualsize == size) {
         result = E_FTP_RESULT_OK;
     } else {
-        ftp_close_files_dir();
+        ftp_close_files_dir(session);
     }
     return result;
 }
 
-//---------------------------------------------------------------
-static ftp_result_t ftp_open_dir_for_listing (const char *path) {
-    if (ftp_data.dp) {
-    	closedir(ftp_data.dp);
-    	ftp_data.dp = NULL;
+//---------------------------------------------------------------------------------
+static ftp_result_t ftp_open_dir_for_listing (ftp_data_t *session, const char *path) {
+    if (session->dp) {
+    	closedir(session->dp);
+    	session->dp = NULL;
     }
     if (path[0] == '/' && path[1] == '\0') {
-        ftp_data.listroot = true;
+        session->listroot = true;
     	ESP_LOGD(FTP_TAG, "ftp_open_dir_for_listing: root");
     }
     else {
-        char fullname[128];
+        char fullname[FTP_MAX_PARAM_SIZE + 1];
         strcpy(fullname, path);
     	if ((strcmp(fullname, VFS_NATIVE_MOUNT_POINT) == 0) || (strcmp(fullname, VFS_NATIVE_SDCARD_MOUNT_POINT) == 0)) {
     		strcat(fullname, "/");
     	}
     	ESP_LOGD(FTP_TAG, "ftp_open_dir_for_listing: %s", fullname);
-		ftp_data.dp = opendir(fullname);  // Open the directory
-		if (ftp_data.dp == NULL) {
+		session->dp = opendir(fullname);  // Open the directory
+		if (session->dp == NULL) {
 			return E_FTP_RESULT_FAILED;
 		}
-		ftp_data.e_open = E_FTP_DIR_OPEN;
-        ftp_data.listroot = false;
+		session->e_open = E_FTP_DIR_OPEN;
+        session->listroot = false;
     }
     return E_FTP_RESULT_CONTINUE;
 }
 
-//---------------------------------------------------------------------------------
-static int ftp_get_eplf_item (char *dest, uint32_t destsize, struct dirent *de) {
+// The list buffer always has space for FTP_LIST_ITEM_MAX bytes, longer items are truncated
+//-------------------------------------------------------------------------------------------------
+static int ftp_get_eplf_item (ftp_data_t *session, char *dest, uint32_t destsize, struct dirent *de) {
 
     char *type = (de->d_type & DT_DIR) ? "d" : "-";
 
     // Get full file path needed for stat function
-    char fullname[128];
-    strcpy(fullname, ftp_path);
-    if (fullname[strlen(fullname)-1] != '/') strcat(fullname, "/");
-    strcat(fullname, de->d_name);
+    char fullname[FTP_LIST_ITEM_MAX];
+    int plen = strlen(session->path);
+    snprintf(fullname, sizeof(fullname), "%s%s%s", session->path, ((plen > 0) && (session->path[plen-1] == '/')) ? "" : "/", de->d_name);
 
     struct stat buf;
 	int res = stat(fullname, &buf);
@@ -322,28 +357,18 @@ static int ftp_get_eplf_item (char *dest, uint32_t destsize, struct dirent *de)
     tm_info = localtime(&buf.st_mtime);		// get broken-down file time
 
     // if file is older than 180 days show dat,month,year else show month, day and time
-    if ((buf.st_mtime + FTP_UNIX_SECONDS_180_DAYS) < now) strftime(str_time, 127, "%b %d %Y", tm_info);
+    if ((buf.st_mtime + FTP_UNIX_SECONDS_180_DAYS) < now) strftime(str_time, 63, "%b %d %Y", tm_info);
     else strftime(str_time, 63, "%b %d %H:%M", tm_info);
 
-    int addsize = destsize + 64;
-
-    while (addsize >= destsize) {
-        if (ftp_nlist) addsize = snprintf(dest, destsize, "%s\r\n", de->d_name);
-        else addsize = snprintf(dest, destsize, "%srw-rw-rw-   1 root  root %9u %s %s\r\n", type, (uint32_t)buf.st_size, str_time, de->d_name);
-        if (addsize >= destsize) {
-			ESP_LOGW(FTP_TAG, "Buffer too small, reallocating [%d > %d]", ftp_buff_size, ftp_buff_size + (addsize - destsize) + 64);
-			char *new_dest = realloc(dest, ftp_buff_size + (addsize - destsize) + 65);
-			if (new_dest) {
-				ftp_buff_size += (addsize - destsize) + 64;
-				destsize += (addsize - destsize) + 64;
-				dest = new_dest;
-				addsize = destsize + 64;
-			}
-			else {
-				ESP_LOGE(FTP_TAG, "Buffer reallocation ERROR");
-				addsize = 0;
-			}
-        }
+    int addsize;
+    if (session->nlist) addsize = snprintf(dest, destsize, "%s\r\n", de->d_name);
+    else addsize = snprintf(dest, destsize, "%srw-rw-rw-   1 root  root %9u %s %s\r\n", type, (uint32_t)buf.st_size, str_time, de->d_name);
+    if (addsize >= destsize) {
+        // truncated, terminate the line
+        ESP_LOGW(FTP_TAG, "List item truncated [%d > %d]", addsize, destsize);
+        addsize = destsize - 1;
+        dest[addsize-2] = '\r';
+        dest[addsize-1] = '\n';
     }
     return addsize;
 }
@@ -361,14 +386,13 @@ static int ftp_get_eplf_drive (char *dest, uint32_t destsize, char *name) {
     return snprintf(dest, destsize, "%srw-rw-rw-   1 root  root %9u %s %s\r\n", type, 0, str_time, name);
 }
 
-//--------------------------------------------------------------------------------------
-static ftp_result_t ftp_list_dir(char *list, uint32_t maxlistsize, uint32_t *listsize) {
+//------------------------------------------------------------------------------------------------------------
+static ftp_result_t ftp_list_dir(ftp_data_t *session, char *list, uint32_t maxlistsize, uint32_t *listsize) {
     uint next = 0;
-    uint listcount = 0;
     ftp_result_t result = E_FTP_RESULT_CONTINUE;
 	struct dirent *de;
 
-    if (ftp_data.listroot) {
+    if (session->listroot) {
     	if (native_vfs_mounted[0]) {
             next += ftp_get_eplf_drive((list + next), (maxlistsize - next), "flash");
     	}
@@ -379,9 +403,9 @@ static ftp_result_t ftp_list_dir(char *list, uint32_t maxlistsize, uint32_t *lis
         return E_FTP_RESULT_OK;
     }
 
-    // read up to 8 directory items
-    while (((maxlistsize - next) > 64) && (listcount < 8)) {
-		de = readdir(ftp_data.dp);                  										// Read a directory item
+    // fill the buffer with directory items
+    while ((maxlistsize - next) > FTP_LIST_ITEM_MAX) {
+		de = readdir(session->dp);                  										// Read a directory item
 		if (de == NULL) {
 			result = E_FTP_RESULT_OK;
 			break;                                                                          // Break on error or end of dp
@@ -391,11 +415,10 @@ static ftp_result_t ftp_list_dir(char *list, uint32_t maxlistsize, uint32_t *lis
 
 		// add the entry to the list
     	ESP_LOGD(FTP_TAG, "Add to dir list: %s", de->d_name);
-		next += ftp_get_eplf_item((list + next), (maxlistsize - next), de);
-        listcount++;
+		next += ftp_get_eplf_item(session, (list + next), (maxlistsize - next), de);
     }
     if (result == E_FTP_RESULT_OK) {
-        ftp_close_files_dir();
+        ftp_close_files_dir(session);
     }
     *listsize = next;
     return result;
@@ -403,28 +426,45 @@ static ftp_result_t ftp_list_dir(char *list, uint32_t maxlistsize, uint32_t *lis
 
 // ==== Socket functions ==============================================================
 
-//------------------------------------
-static void ftp_close_cmd_data(void) {
-    closesocket(ftp_data.c_sd);
-    closesocket(ftp_data.d_sd);
-    ftp_data.c_sd  = -1;
-    ftp_data.d_sd  = -1;
-    ftp_close_filesystem_on_error ();
+//--------------------------------------------------
+static void ftp_close_data (ftp_data_t *session) {
+    if (session->d_sd >= 0) closesocket(session->d_sd);
+    session->d_sd = -1;
+    ftp_close_filesystem_on_error(session);
+}
+
+// Close all session sockets and free the session buffers
+//------------------------------------------------------
+static void ftp_close_session (ftp_data_t *session) {
+    if (session->c_sd >= 0) closesocket(session->c_sd);
+    if (session->ld_sd >= 0) closesocket(session->ld_sd);
+    session->c_sd  = -1;
+    session->ld_sd = -1;
+    ftp_close_data(session);
+
+    if (session->dBuffer) free(session->dBuffer);
+    if (session->tBuffer) free(session->tBuffer);
+    if (session->path) free(session->path);
+    session->dBuffer = NULL;
+    session->tBuffer = NULL;
+    session->path = NULL;
+
+    session->quit = false;
+    session->e_open = E_FTP_NOTHING_OPEN;
+    session->state = E_FTP_STE_READY;
+    session->substate = E_FTP_STE_SUB_DISCONNECTED;
 }
 
 //----------------------------
 static void _ftp_reset(void) {
     // close all connections and start all over again
 	ESP_LOGW(FTP_TAG, "FTP RESET");
-    closesocket(ftp_data.lc_sd);
-    closesocket(ftp_data.ld_sd);
-    ftp_data.lc_sd = -1;
-    ftp_data.ld_sd = -1;
-    ftp_close_cmd_data();
-
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
-    ftp_data.state = E_FTP_STE_START;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+    if (ftp_lc_sd >= 0) closesocket(ftp_lc_sd);
+    ftp_lc_sd = -1;
+    for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+        ftp_close_session(&ftp_sessions[i]);
+    }
+    ftp_state = E_FTP_STE_START;
 }
 
 //-------------------------------------------------------------------------------------
@@ -463,23 +503,24 @@ static bool ftp_create_listening_socket (int32_t *sd, uint32_t port, uint8_t bac
         }
         closesocket(*sd);
     }
+    *sd = -1;
     return false;
 }
 
 //--------------------------------------------------------------------------------------------
 static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32_t *ip_addr) {
     struct sockaddr_in  sClientAddress;
-    socklen_t  in_addrSize;
+    socklen_t  in_addrSize = sizeof(struct sockaddr_in);
 
     // accepts a connection from a TCP client, if there is any, otherwise returns EAGAIN
     *n_sd = accept(l_sd, (struct sockaddr *)&sClientAddress, (socklen_t *)&in_addrSize);
     int32_t _sd = *n_sd;
     if (_sd < 0) {
+        *n_sd = -1;
         if (errno == EAGAIN) {
             return E_FTP_RESULT_CONTINUE;
         }
         // error
-        _ftp_reset();
         return E_FTP_RESULT_FAILED;
     }
 
@@ -512,17 +553,29 @@ static ftp_result_t ftp_wait_for_connection (int32_t l_sd, int32_t *n_sd, uint32
         }
     }
 
-    // enable non-blocking mode if not data channel connection
+    // enable non-blocking mode, control and data connections are serviced from the ftp task loop
     uint32_t option = fcntl(_sd, F_GETFL, 0);
-    if (l_sd != ftp_data.ld_sd) option |= O_NONBLOCK;
+    option |= O_NONBLOCK;
     fcntl(_sd, F_SETFL, option);
 
     // client connected, so go on
     return E_FTP_RESULT_OK;
 }
 
-//-----------------------------------------------------------
-static void ftp_send_reply (uint32_t status, char *message) {
+// Wait until the socket is writable or the timeout expires
+//------------------------------------------------------------
+static bool ftp_wait_writable (int32_t sd, uint32_t timeout_ms) {
+    fd_set wfds;
+    struct timeval tv;
+    FD_ZERO(&wfds);
+    FD_SET(sd, &wfds);
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    return (select(sd + 1, NULL, &wfds, NULL, &tv) > 0);
+}
+
+//-----------------------------------------------------------------------------------
+static void ftp_send_reply (ftp_data_t *session, uint32_t status, char *message) {
     if (!message) {
         message = "";
     }
@@ -531,115 +584,155 @@ static void ftp_send_reply (uint32_t status, char *message) {
     strcat ((char *)ftp_cmd_buffer, message);
     strcat ((char *)ftp_cmd_buffer, "\r\n");
 
-    int32_t timeout = 200;
-    ftp_result_t result;
     uint32_t size = strlen((char *)ftp_cmd_buffer);
+    uint32_t sent = 0;
+    int32_t result;
 
-    ESP_LOGD(FTP_TAG, "Send reply: [%s]", ftp_cmd_buffer);
-    vTaskDelay(1);
-
-    while (1) {
-        result = send(ftp_data.c_sd, ftp_cmd_buffer, size, 0);
-		if (result == size) {
-			if (status == 221) {
-				closesocket(ftp_data.d_sd);
-				ftp_data.d_sd = -1;
-				closesocket(ftp_data.ld_sd);
-				ftp_data.ld_sd = -1;
-				closesocket(ftp_data.c_sd);
-				ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-				ftp_close_filesystem_on_error();
-			}
-			else if (status == 426 || status == 451 || status == 550) {
-				closesocket(ftp_data.d_sd);
-				ftp_data.d_sd = -1;
-				ftp_close_filesystem_on_error();
-			}
-			vTaskDelay(1);
-			ESP_LOGD(FTP_TAG, "Send reply: OK (%u)", size);
-			break;
-		}
-		else {
-		    vTaskDelay(1);
-			if ((timeout <= 0) || (errno != EAGAIN)) {
-				// error
-				_ftp_reset();
-	            ESP_LOGW(FTP_TAG, "Error sending command reply.");
-				break;
-			}
-		}
-		timeout -= portTICK_PERIOD_MS;
+    ESP_LOGD(FTP_TAG, "[%d] Send reply: [%s]", session->index, ftp_cmd_buffer);
+
+    while (sent < size) {
+        result = send(session->c_sd, ftp_cmd_buffer + sent, size - sent, 0);
+        if (result > 0) {
+            sent += result;
+            continue;
+        }
+        if ((result < 0) && (errno == EAGAIN) && ftp_wait_writable(session->c_sd, FTP_REPLY_TIMEOUT_MS)) continue;
+        // error, the session is closed at the end of the ftp_run pass
+        session->quit = true;
+        ESP_LOGW(FTP_TAG, "[%d] Error sending command reply.", session->index);
+        return;
+    }
+
+    if (status == 221) {
+        session->quit = true;
     }
+    else if (status == 426 || status == 451 || status == 550) {
+        ftp_close_data(session);
+    }
+    ESP_LOGD(FTP_TAG, "[%d] Send reply: OK (%u)", session->index, size);
 }
 
-//------------------------------------------
-static void ftp_send_list(uint32_t datasize)
+//------------------------------------------------------------------------------------------------
+static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxlen, int32_t *rxLen)
 {
-    int32_t timeout = 200;
-    ftp_result_t result;
+	if (sd < 0) return E_FTP_RESULT_FAILED;
 
-    ESP_LOGD(FTP_TAG, "Send list data: (%u)", datasize);
-    vTaskDelay(1);
+	*rxLen = recv(sd, buff, Maxlen, 0);
+    if (*rxLen > 0) return E_FTP_RESULT_OK;
+    else if ((*rxLen < 0) && (errno == EAGAIN)) return E_FTP_RESULT_CONTINUE;
 
-    while (1) {
-        result = send(ftp_data.d_sd, ftp_data.dBuffer, datasize, 0);
-		if (result == datasize) {
-			vTaskDelay(1);
-			ESP_LOGD(FTP_TAG, "Send OK");
-			break;
-		}
-		else {
-		    vTaskDelay(1);
-			if ((timeout <= 0) || (errno != EAGAIN)) {
-				// error
-				_ftp_reset();
-				ESP_LOGW(FTP_TAG, "Error sending list data.");
-				break;
-			}
-		}
-		timeout -= portTICK_PERIOD_MS;
-    }
+    return E_FTP_RESULT_FAILED;
 }
 
-//-----------------------------------------------
-static void ftp_send_file_data(uint32_t datasize)
-{
+// ==== Data transmit functions =======================================================
+/*
+ * LIST/NLST and RETR data is sent from two buffers.
+ * The data socket is non-blocking, send() only copies the data to the lwip send buffer
+ * and lwip transmits it from the tcpip task. While the first buffer is being transmitted
+ * the ftp task reads the next chunk from the file system into the second buffer.
+ * Nothing waits here, ftp_wait_io() blocks in select() until the send window opens.
+ */
+
+//------------------------------------------------------
+static void ftp_tx_start (ftp_data_t *session) {
+    if (session->tBuffer == NULL) session->tBuffer = malloc(ftp_buff_size+1);
+    session->tx[0].buf = session->dBuffer;
+    session->tx[1].buf = session->tBuffer;
+    // without the second buffer the data is read and sent from one buffer
+    session->tx_nbuf = (session->tBuffer) ? 2 : 1;
+    session->tx[0].len = session->tx[0].pos = 0;
+    session->tx[1].len = session->tx[1].pos = 0;
+    session->tx_head = 0;
+    session->tx_count = 0;
+    session->tx_eof = false;
+    session->tx_chunk = MIN(MAX(session->tx_chunk, FTP_TX_CHUNK_MIN), FTP_TX_CHUNK_MAX);
+    session->total = 0;
+    session->time = 0;
+}
+
+// Read the next chunk into a free buffer
+//------------------------------------------------------------
+static ftp_result_t ftp_tx_fill (ftp_data_t *session) {
+    ftp_txbuf_t *tx = &session->tx[(session->tx_head + session->tx_count) % session->tx_nbuf];
     ftp_result_t result;
-    uint32_t timeout = 200;
+    uint32_t size = 0;
 
-    ESP_LOGD(FTP_TAG, "Send file data: (%u)", datasize);
-    vTaskDelay(1);
+    if (session->state == E_FTP_STE_CONTINUE_LISTING) {
+        result = ftp_list_dir(session, (char *)tx->buf, ftp_buff_size, &size);
+    }
+    else {
+        result = ftp_read_file(session, (char *)tx->buf, session->tx_chunk, &size);
+    }
+    if (result == E_FTP_RESULT_FAILED) return result;
 
-    while (1) {
-        result = send(ftp_data.d_sd, ftp_data.dBuffer, datasize, 0);
-		if (result == datasize) {
-			vTaskDelay(1);
-			ESP_LOGD(FTP_TAG, "Send OK");
-			break;
-		}
-		else {
-		    vTaskDelay(1);
-			if ((timeout <= 0) || (errno != EAGAIN)) {
-				// error
-				_ftp_reset();
-				ESP_LOGW(FTP_TAG, "Error sending file data.");
-				break;
-			}
-		}
-		timeout -= portTICK_PERIOD_MS;
+    if (result == E_FTP_RESULT_OK) session->tx_eof = true;
+    if (size > 0) {
+        tx->len = size;
+        tx->pos = 0;
+        session->tx_count++;
     }
+    return result;
 }
 
-//------------------------------------------------------------------------------------------------
-static ftp_result_t ftp_recv_non_blocking (int32_t sd, void *buff, int32_t Maxlen, int32_t *rxLen)
-{
-	if (sd < 0) return E_FTP_RESULT_FAILED;
+// Push the filled buffers to lwip, then read the next chunk
+//-------------------------------------------------
+static void ftp_tx_run (ftp_data_t *session) {
+    while (session->tx_count > 0) {
+        ftp_txbuf_t *tx = &session->tx[session->tx_head];
+        uint32_t size = tx->len - tx->pos;
+        int32_t sent = send(session->d_sd, tx->buf + tx->pos, size, 0);
+        if (sent < 0) {
+            if (errno == EAGAIN) {
+                // send window full, use smaller chunks
+                session->tx_chunk = MAX(session->tx_chunk / 2, FTP_TX_CHUNK_MIN);
+                break;
+            }
+            ftp_send_reply(session, 426, NULL);
+            session->state = E_FTP_STE_END_TRANSFER;
+            ESP_LOGW(FTP_TAG, "[%d] Error sending data.", session->index);
+            return;
+        }
+        session->dtimeout = 0;
+        session->total += sent;
+        tx->pos += sent;
+        if (tx->pos < tx->len) {
+            // partially accepted, the window is smaller than the chunk
+            session->tx_chunk = MAX(MIN(session->tx_chunk, (uint32_t)sent), FTP_TX_CHUNK_MIN);
+            break;
+        }
+        if (sent == tx->len) {
+            // the whole chunk was accepted at once, try larger chunks
+            session->tx_chunk = MIN(session->tx_chunk * 2, FTP_TX_CHUNK_MAX);
+        }
+        tx->len = tx->pos = 0;
+        session->tx_head = (session->tx_head + 1) % session->tx_nbuf;
+        session->tx_count--;
+    }
 
-	*rxLen = recv(sd, buff, Maxlen, 0);
-    if (*rxLen > 0) return E_FTP_RESULT_OK;
-    else if (errno != EAGAIN) return E_FTP_RESULT_FAILED;
+    // read the next chunk while lwip transmits the previous one
+    if ((!session->tx_eof) && (session->tx_count < session->tx_nbuf)) {
+        if (ftp_tx_fill(session) == E_FTP_RESULT_FAILED) {
+            ftp_send_reply(session, 451, NULL);
+            session->state = E_FTP_STE_END_TRANSFER;
+            ESP_LOGW(FTP_TAG, "[%d] Error reading data.", session->index);
+            return;
+        }
+        session->ctimeout = 0;
+    }
 
-    return E_FTP_RESULT_CONTINUE;
+    if ((session->tx_eof) && (session->tx_count == 0)) {
+        ftp_send_reply(session, 226, NULL);
+        if (session->state == E_FTP_STE_CONTINUE_FILE_TX) {
+            ESP_LOGI(FTP_TAG, "[%d] File sent (%u bytes in %u msek).", session->index, session->total, session->time);
+        }
+        session->state = E_FTP_STE_END_TRANSFER;
+    }
+}
+
+// Returns true if the transmit has data ready to be read or sent without waiting for the socket
+//------------------------------------------------------
+static bool ftp_tx_ready (ftp_data_t *session) {
+    return ((!session->tx_eof) && (session->tx_count < session->tx_nbuf));
 }
 
 // ==== Directory functions =======================
@@ -782,18 +875,18 @@ static ftp_cmd_index_t ftp_pop_command(char **str) {
     return E_FTP_CMD_NOT_SUPPORTED;
 }
 
-// Get file name from parameter and append to ftp_path
-//-------------------------------------------------------
-static void ftp_get_param_and_open_child(char **bufptr) {
+// Get file name from parameter and append to session path
+//---------------------------------------------------------------------------
+static void ftp_get_param_and_open_child(ftp_data_t *session, char **bufptr) {
     ftp_pop_param(bufptr, ftp_scratch_buffer, false, false);
-    ftp_open_child(ftp_path, ftp_scratch_buffer);
-    ftp_data.closechild = true;
+    ftp_open_child(session->path, ftp_scratch_buffer);
+    session->closechild = true;
 }
 
 // ==== Ftp command processing =====
 
-//----------------------------------
-static void ftp_process_cmd (void) {
+//------------------------------------------------------
+static void ftp_process_cmd (ftp_data_t *session) {
     int32_t len;
     char *bufptr = (char *)ftp_cmd_buffer;
     ftp_result_t result;
@@ -801,70 +894,71 @@ static void ftp_process_cmd (void) {
 	int res;
 
 	memset(bufptr, 0, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
-    ftp_data.closechild = false;
+    session->closechild = false;
 
     // use the reply buffer to receive new commands
-    result = ftp_recv_non_blocking(ftp_data.c_sd, ftp_cmd_buffer, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX, &len);
+    result = ftp_recv_non_blocking(session->c_sd, ftp_cmd_buffer, FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX - 1, &len);
     if (result == E_FTP_RESULT_OK) {
     	ftp_cmd_buffer[len] = '\0';
+        session->ctimeout = 0;
         // bufptr is moved as commands are being popped
         ftp_cmd_index_t cmd = ftp_pop_command(&bufptr);
-        if (!ftp_data.loggin.passvalid &&
+        if (!session->loggin.passvalid &&
         		((cmd != E_FTP_CMD_USER) && (cmd != E_FTP_CMD_PASS) && (cmd != E_FTP_CMD_QUIT) && (cmd != E_FTP_CMD_FEAT) && (cmd != E_FTP_CMD_AUTH))) {
-            ftp_send_reply(332, NULL);
+            ftp_send_reply(session, 332, NULL);
             return;
         }
         if ((cmd >= 0) && (cmd < E_FTP_NUM_FTP_CMDS)) {
-        	ESP_LOGD(FTP_TAG, "CMD: %s", ftp_cmd_table[cmd].cmd);
+        	ESP_LOGD(FTP_TAG, "[%d] CMD: %s", session->index, ftp_cmd_table[cmd].cmd);
         }
         else {
-        	ESP_LOGD(FTP_TAG, "CMD: %d", cmd);
+        	ESP_LOGD(FTP_TAG, "[%d] CMD: %d", session->index, cmd);
         }
         switch (cmd) {
         case E_FTP_CMD_FEAT:
-            ftp_send_reply(502, "no-features");
+            ftp_send_reply(session, 502, "no-features");
             break;
         case E_FTP_CMD_AUTH:
-            ftp_send_reply(504, "not-supported");
+            ftp_send_reply(session, 504, "not-supported");
             break;
         case E_FTP_CMD_SYST:
-            ftp_send_reply(215, "UNIX Type: L8");
+            ftp_send_reply(session, 215, "UNIX Type: L8");
             break;
         case E_FTP_CMD_CDUP:
-            ftp_close_child(ftp_path);
-            ftp_send_reply(250, NULL);
+            ftp_close_child(session->path);
+            ftp_send_reply(session, 250, NULL);
             break;
         case E_FTP_CMD_CWD:
 			ftp_pop_param (&bufptr, ftp_scratch_buffer, false, false);
 
 			if (strlen(ftp_scratch_buffer) > 0) {
 				if ((ftp_scratch_buffer[0] == '.') && (ftp_scratch_buffer[1] == '\0')) {
-					ftp_data.dp = NULL;
-					ftp_send_reply(250, NULL);
+					session->dp = NULL;
+					ftp_send_reply(session, 250, NULL);
 					break;
 				}
 				if ((ftp_scratch_buffer[0] == '.') && (ftp_scratch_buffer[1] == '.') && (ftp_scratch_buffer[2] == '\0')) {
-					ftp_close_child (ftp_path);
-		            ftp_send_reply(250, NULL);
+					ftp_close_child (session->path);
+		            ftp_send_reply(session, 250, NULL);
 		            break;
 				}
-				else ftp_open_child (ftp_path, ftp_scratch_buffer);
+				else ftp_open_child (session->path, ftp_scratch_buffer);
 			}
 
-			if ((ftp_path[0] == '/') && (ftp_path[1] == '\0')) {
-				ftp_data.dp = NULL;
-				ftp_send_reply(250, NULL);
+			if ((session->path[0] == '/') && (session->path[1] == '\0')) {
+				session->dp = NULL;
+				ftp_send_reply(session, 250, NULL);
 			}
 			else {
-				ftp_data.dp = opendir(ftp_path);
-				if (ftp_data.dp != NULL) {
-					closedir(ftp_data.dp);
-					ftp_data.dp = NULL;
-					ftp_send_reply(250, NULL);
+				session->dp = opendir(session->path);
+				if (session->dp != NULL) {
+					closedir(session->dp);
+					session->dp = NULL;
+					ftp_send_reply(session, 250, NULL);
 				}
 				else {
-					ftp_close_child (ftp_path);
-					ftp_send_reply(550, NULL);
+					ftp_close_child (session->path);
+					ftp_send_reply(session, 550, NULL);
 				}
 			}
             break;
@@ -872,423 +966,323 @@ static void ftp_process_cmd (void) {
         case E_FTP_CMD_XPWD:
         	{
         		char lpath[128];
-        		if (strstr(ftp_path, VFS_NATIVE_MOUNT_POINT) == ftp_path) {
-        			sprintf(lpath, "%s%s", VFS_NATIVE_INTERNAL_MP, ftp_path+strlen(VFS_NATIVE_MOUNT_POINT));
+        		if (strstr(session->path, VFS_NATIVE_MOUNT_POINT) == session->path) {
+        			sprintf(lpath, "%s%s", VFS_NATIVE_INTERNAL_MP, session->path+strlen(VFS_NATIVE_MOUNT_POINT));
         		}
-        		else if (strstr(ftp_path, VFS_NATIVE_SDCARD_MOUNT_POINT) == ftp_path) {
-        			sprintf(lpath, "%s%s", VFS_NATIVE_EXTERNAL_MP, ftp_path+strlen(VFS_NATIVE_SDCARD_MOUNT_POINT));
+        		else if (strstr(session->path, VFS_NATIVE_SDCARD_MOUNT_POINT) == session->path) {
+        			sprintf(lpath, "%s%s", VFS_NATIVE_EXTERNAL_MP, session->path+strlen(VFS_NATIVE_SDCARD_MOUNT_POINT));
         		}
-        		else strcpy(lpath,ftp_path);
+        		else strcpy(lpath,session->path);
 
-        		ftp_send_reply(257, lpath);
+        		ftp_send_reply(session, 257, lpath);
         	}
             break;
         case E_FTP_CMD_SIZE:
             {
-                ftp_get_param_and_open_child (&bufptr);
-            	int res = stat(ftp_path, &buf);
+                ftp_get_param_and_open_child (session, &bufptr);
+            	int res = stat(session->path, &buf);
             	if (res == 0) {
                     // send the file size
-                    snprintf((char *)ftp_data.dBuffer, ftp_buff_size, "%u", (uint32_t)buf.st_size);
-                    ftp_send_reply(213, (char *)ftp_data.dBuffer);
+                    snprintf((char *)session->dBuffer, ftp_buff_size, "%u", (uint32_t)buf.st_size);
+                    ftp_send_reply(session, 213, (char *)session->dBuffer);
                 } else {
-                    ftp_send_reply(550, NULL);
+                    ftp_send_reply(session, 550, NULL);
                 }
             }
             break;
         case E_FTP_CMD_MDTM:
-            ftp_get_param_and_open_child (&bufptr);
-        	res = stat(ftp_path, &buf);
+            ftp_get_param_and_open_child (session, &bufptr);
+        	res = stat(session->path, &buf);
         	if (res < 0) {
                 // send the file modification time
-                snprintf((char *)ftp_data.dBuffer, ftp_buff_size, "%u", (uint32_t)buf.st_mtime);
-                ftp_send_reply(213, (char *)ftp_data.dBuffer);
+                snprintf((char *)session->dBuffer, ftp_buff_size, "%u", (uint32_t)buf.st_mtime);
+                ftp_send_reply(session, 213, (char *)session->dBuffer);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(session, 550, NULL);
             }
             break;
         case E_FTP_CMD_TYPE:
-            ftp_send_reply(200, NULL);
+            ftp_send_reply(session, 200, NULL);
             break;
         case E_FTP_CMD_USER:
             ftp_pop_param (&bufptr, ftp_scratch_buffer, true, true);
             if (!memcmp(ftp_scratch_buffer, ftp_user, MAX(strlen(ftp_scratch_buffer), strlen(ftp_user)))) {
-                ftp_data.loggin.uservalid = true && (strlen(ftp_user) == strlen(ftp_scratch_buffer));
+                session->loggin.uservalid = true && (strlen(ftp_user) == strlen(ftp_scratch_buffer));
             }
-            ftp_send_reply(331, NULL);
+            ftp_send_reply(session, 331, NULL);
             break;
         case E_FTP_CMD_PASS:
             ftp_pop_param (&bufptr, ftp_scratch_buffer, true, true);
             if (!memcmp(ftp_scratch_buffer, ftp_pass, MAX(strlen(ftp_scratch_buffer), strlen(ftp_pass))) &&
-                    ftp_data.loggin.uservalid) {
-                ftp_data.loggin.passvalid = true && (strlen(ftp_pass) == strlen(ftp_scratch_buffer));
-                if (ftp_data.loggin.passvalid) {
-                    ftp_send_reply(230, NULL);
+                    session->loggin.uservalid) {
+                session->loggin.passvalid = true && (strlen(ftp_pass) == strlen(ftp_scratch_buffer));
+                if (session->loggin.passvalid) {
+                    ftp_send_reply(session, 230, NULL);
                     break;
                 }
             }
-            ftp_send_reply(530, NULL);
+            ftp_send_reply(session, 530, NULL);
             break;
         case E_FTP_CMD_PASV:
             {
                 // some servers (e.g. google chrome) send PASV several times very quickly
-                closesocket(ftp_data.d_sd);
-                ftp_data.d_sd = -1;
-                ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+                if (session->d_sd >= 0) closesocket(session->d_sd);
+                session->d_sd = -1;
+                session->substate = E_FTP_STE_SUB_DISCONNECTED;
+                // every session has its own passive data port
+                uint32_t port = FTP_PASIVE_DATA_PORT + session->index;
                 bool socketcreated = true;
-                if (ftp_data.ld_sd < 0) {
-                    socketcreated = ftp_create_listening_socket(&ftp_data.ld_sd, FTP_PASIVE_DATA_PORT, FTP_DATA_CLIENTS_MAX - 1);
+                if (session->ld_sd < 0) {
+                    socketcreated = ftp_create_listening_socket(&session->ld_sd, port, 1);
                 }
                 if (socketcreated) {
-                    uint8_t *pip = (uint8_t *)&ftp_data.ip_addr;
-                    ftp_data.dtimeout = 0;
-                    snprintf((char *)ftp_data.dBuffer, ftp_buff_size, "(%u,%u,%u,%u,%u,%u)",
-                             pip[0], pip[1], pip[2], pip[3], (FTP_PASIVE_DATA_PORT >> 8), (FTP_PASIVE_DATA_PORT & 0xFF));
-                    ftp_data.substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
-                	ESP_LOGD(FTP_TAG, "Data socket created");
-                    ftp_send_reply(227, (char *)ftp_data.dBuffer);
+                    uint8_t *pip = (uint8_t *)&session->ip_addr;
+                    session->dtimeout = 0;
+                    snprintf((char *)session->dBuffer, ftp_buff_size, "(%u,%u,%u,%u,%u,%u)",
+                             pip[0], pip[1], pip[2], pip[3], (port >> 8), (port & 0xFF));
+                    session->substate = E_FTP_STE_SUB_LISTEN_FOR_DATA;
+                	ESP_LOGD(FTP_TAG, "[%d] Data socket created", session->index);
+                    ftp_send_reply(session, 227, (char *)session->dBuffer);
                 }
                 else {
-                	ESP_LOGW(FTP_TAG, "Error creating data socket");
-                    ftp_send_reply(425, NULL);
+                	ESP_LOGW(FTP_TAG, "[%d] Error creating data socket", session->index);
+                    ftp_send_reply(session, 425, NULL);
                 }
             }
             break;
         case E_FTP_CMD_LIST:
        	case E_FTP_CMD_NLST:
-            ftp_get_param_and_open_child(&bufptr);
-            if (cmd == E_FTP_CMD_LIST) ftp_nlist = 0;
-        	else ftp_nlist = 1;
-            if (ftp_open_dir_for_listing(ftp_path) == E_FTP_RESULT_CONTINUE) {
-                ftp_data.state = E_FTP_STE_CONTINUE_LISTING;
-                ftp_send_reply(150, NULL);
+            ftp_get_param_and_open_child(session, &bufptr);
+            session->nlist = (cmd == E_FTP_CMD_NLST);
+            if (ftp_open_dir_for_listing(session, session->path) == E_FTP_RESULT_CONTINUE) {
+                ftp_tx_start(session);
+                session->state = E_FTP_STE_CONTINUE_LISTING;
+                ftp_send_reply(session, 150, NULL);
             }
-            else ftp_send_reply(550, NULL);
+            else ftp_send_reply(session, 550, NULL);
             break;
         case E_FTP_CMD_RETR:
-        	ftp_data.total = 0;
-        	ftp_data.time = 0;
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (ftp_open_file(ftp_path, "rb")) {
-					ftp_data.state = E_FTP_STE_CONTINUE_FILE_TX;
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(150, NULL);
+            ftp_get_param_and_open_child(session, &bufptr);
+            if ((strlen(session->path) > 0) && (session->path[strlen(session->path)-1] != '/')) {
+				if (ftp_open_file(session, session->path, "rb")) {
+					ftp_tx_start(session);
+					session->state = E_FTP_STE_CONTINUE_FILE_TX;
+					ftp_send_reply(session, 150, NULL);
 				}
 				else {
-					ftp_data.state = E_FTP_STE_END_TRANSFER;
-					ftp_send_reply(550, NULL);
+					session->state = E_FTP_STE_END_TRANSFER;
+					ftp_send_reply(session, 550, NULL);
 				}
             }
             else {
-				ftp_data.state = E_FTP_STE_END_TRANSFER;
-				ftp_send_reply(550, NULL);
+				session->state = E_FTP_STE_END_TRANSFER;
+				ftp_send_reply(session, 550, NULL);
             }
             break;
         case E_FTP_CMD_APPE:
-        	ftp_data.total = 0;
-        	ftp_data.time = 0;
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (ftp_open_file(ftp_path, "ab")) {
-					ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(150, NULL);
-				}
-				else {
-					ftp_data.state = E_FTP_STE_END_TRANSFER;
-					ftp_send_reply(550, NULL);
-				}
-            }
-            else {
-				ftp_data.state = E_FTP_STE_END_TRANSFER;
-				ftp_send_reply(550, NULL);
-            }
-            break;
         case E_FTP_CMD_STOR:
-        	ftp_data.total = 0;
-        	ftp_data.time = 0;
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (ftp_open_file(ftp_path, "wb")) {
-					ftp_data.state = E_FTP_STE_CONTINUE_FILE_RX;
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(150, NULL);
+        	session->total = 0;
+        	session->time = 0;
+            ftp_get_param_and_open_child(session, &bufptr);
+            if ((strlen(session->path) > 0) && (session->path[strlen(session->path)-1] != '/')) {
+				if (ftp_open_file(session, session->path, (cmd == E_FTP_CMD_APPE) ? "ab" : "wb")) {
+					session->state = E_FTP_STE_CONTINUE_FILE_RX;
+					ftp_send_reply(session, 150, NULL);
 				}
 				else {
-					ftp_data.state = E_FTP_STE_END_TRANSFER;
-					ftp_send_reply(550, NULL);
+					session->state = E_FTP_STE_END_TRANSFER;
+					ftp_send_reply(session, 550, NULL);
 				}
             }
             else {
-				ftp_data.state = E_FTP_STE_END_TRANSFER;
-				ftp_send_reply(550, NULL);
+				session->state = E_FTP_STE_END_TRANSFER;
+				ftp_send_reply(session, 550, NULL);
             }
             break;
         case E_FTP_CMD_DELE:
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (unlink(ftp_path) == 0) {
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(250, NULL);
+            ftp_get_param_and_open_child(session, &bufptr);
+            if ((strlen(session->path) > 0) && (session->path[strlen(session->path)-1] != '/')) {
+				if (unlink(session->path) == 0) {
+					native_vfs_file_changed();
+					ftp_send_reply(session, 250, NULL);
 				}
-				else ftp_send_reply(550, NULL);
+				else ftp_send_reply(session, 550, NULL);
             }
-            else ftp_send_reply(250, NULL);
+            else ftp_send_reply(session, 250, NULL);
             break;
         case E_FTP_CMD_RMD:
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (rmdir(ftp_path) == 0) {
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(250, NULL);
-				}
-				else ftp_send_reply(550, NULL);
+            ftp_get_param_and_open_child(session, &bufptr);
+            if ((strlen(session->path) > 0) && (session->path[strlen(session->path)-1] != '/')) {
+				if (rmdir(session->path) == 0) ftp_send_reply(session, 250, NULL);
+				else ftp_send_reply(session, 550, NULL);
             }
-            else ftp_send_reply(250, NULL);
+            else ftp_send_reply(session, 250, NULL);
             break;
         case E_FTP_CMD_MKD:
-            ftp_get_param_and_open_child(&bufptr);
-            if ((strlen(ftp_path) > 0) && (ftp_path[strlen(ftp_path)-1] != '/')) {
-				if (mkdir(ftp_path, 0755) == 0) {
-					vTaskDelay(20 / portTICK_PERIOD_MS);
-					ftp_send_reply(250, NULL);
-				}
-				else ftp_send_reply(550, NULL);
+            ftp_get_param_and_open_child(session, &bufptr);
+            if ((strlen(session->path) > 0) && (session->path[strlen(session->path)-1] != '/')) {
+				if (mkdir(session->path, 0755) == 0) ftp_send_reply(session, 250, NULL);
+				else ftp_send_reply(session, 550, NULL);
             }
-            else ftp_send_reply(250, NULL);
+            else ftp_send_reply(session, 250, NULL);
             break;
         case E_FTP_CMD_RNFR:
-            ftp_get_param_and_open_child(&bufptr);
-        	res = stat(ftp_path, &buf);
+            ftp_get_param_and_open_child(session, &bufptr);
+        	res = stat(session->path, &buf);
         	if (res == 0) {
-                ftp_send_reply(350, NULL);
+                ftp_send_reply(session, 350, NULL);
                 // save the path of the file to rename
-                strcpy((char *)ftp_data.dBuffer, ftp_path);
+                strcpy((char *)session->dBuffer, session->path);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(session, 550, NULL);
             }
             break;
         case E_FTP_CMD_RNTO:
-            ftp_get_param_and_open_child(&bufptr);
+            ftp_get_param_and_open_child(session, &bufptr);
             // the path of the file to rename was saved in the data buffer
-            if (rename((char *)ftp_data.dBuffer, ftp_path) == 0) {
-                ftp_send_reply(250, NULL);
+            if (rename((char *)session->dBuffer, session->path) == 0) {
+                native_vfs_file_changed();
+                ftp_send_reply(session, 250, NULL);
             } else {
-                ftp_send_reply(550, NULL);
+                ftp_send_reply(session, 550, NULL);
             }
             break;
         case E_FTP_CMD_NOOP:
-            ftp_send_reply(200, NULL);
+            ftp_send_reply(session, 200, NULL);
             break;
         case E_FTP_CMD_QUIT:
-            ftp_send_reply(221, NULL);
+            ftp_send_reply(session, 221, NULL);
             break;
         default:
             // command not implemented
-            ftp_send_reply(502, NULL);
+            ftp_send_reply(session, 502, NULL);
             break;
         }
 
-        if (ftp_data.closechild) {
-            remove_fname_from_path(ftp_path, ftp_scratch_buffer);
+        if (session->closechild) {
+            remove_fname_from_path(session->path, ftp_scratch_buffer);
         }
     }
     else if (result == E_FTP_RESULT_CONTINUE) {
-        if (ftp_data.ctimeout > ftp_timeout) {
-            ftp_send_reply(221, NULL);
-        	ESP_LOGI(FTP_TAG, "Connection timeout");
+        if (session->ctimeout > ftp_timeout) {
+            ftp_send_reply(session, 221, NULL);
+        	ESP_LOGI(FTP_TAG, "[%d] Connection timeout", session->index);
         }
     }
     else {
-        ftp_close_cmd_data();
-    }
-}
-
-//---------------------------------------
-static void ftp_wait_for_enabled (void) {
-    // Check if the telnet service has been enabled
-    if (ftp_data.enabled) {
-        ftp_data.state = E_FTP_STE_START;
+        // client closed the connection
+        session->quit = true;
     }
 }
 
-// ==== PUBLIC FUNCTIONS ===================================================================
-
-//---------------------
-void ftp_deinit(void) {
-	if (ftp_path) free(ftp_path);
-	if (ftp_cmd_buffer) free(ftp_cmd_buffer);
-	if (ftp_data.dBuffer) free(ftp_data.dBuffer);
-	if (ftp_scratch_buffer) free(ftp_scratch_buffer);
-	ftp_path = NULL;
-	ftp_cmd_buffer = NULL;
-	ftp_data.dBuffer = NULL;
-	ftp_scratch_buffer = NULL;
-}
+// Accept the new control connection into a free session
+//----------------------------------------
+static void ftp_accept_session (void) {
+    int32_t sd;
+    uint32_t ip_addr = 0;
 
-//-------------------
-bool ftp_init(void) {
-	ftp_stop = 0;
-    // Allocate memory for the data buffer, and the file system structures (from the RTOS heap)
-	ftp_deinit();
+    ftp_result_t result = ftp_wait_for_connection(ftp_lc_sd, &sd, &ip_addr);
+    if (result == E_FTP_RESULT_CONTINUE) return;
+    if (result == E_FTP_RESULT_FAILED) {
+        _ftp_reset();
+        return;
+    }
 
-	memset(&ftp_data, 0, sizeof(ftp_data_t));
-	ftp_data.dBuffer = malloc(ftp_buff_size+1);
-	if (ftp_data.dBuffer == NULL) return false;
-	ftp_path = malloc(FTP_MAX_PARAM_SIZE);
-	if (ftp_path == NULL) {
-	    free(ftp_data.dBuffer);
-	    return false;
-	}
-	ftp_scratch_buffer = malloc(FTP_MAX_PARAM_SIZE);
-    if (ftp_scratch_buffer == NULL) {
-        free(ftp_path);
-        free(ftp_data.dBuffer);
-        return false;
+    ftp_data_t *session = NULL;
+    for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+        if (ftp_sessions[i].c_sd < 0) {
+            session = &ftp_sessions[i];
+            break;
+        }
     }
-	ftp_cmd_buffer = malloc(FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
-    if (ftp_cmd_buffer == NULL) {
-        free(ftp_scratch_buffer);
-        free(ftp_path);
-        free(ftp_data.dBuffer);
-        return false;
+    if (session) {
+        session->dBuffer = malloc(ftp_buff_size+1);
+        session->path = malloc(FTP_MAX_PARAM_SIZE);
+    }
+    if ((session == NULL) || (session->dBuffer == NULL) || (session->path == NULL)) {
+        static const char busy[] = "421 Too many users\r\n";
+        send(sd, busy, sizeof(busy)-1, 0);
+        closesocket(sd);
+        if (session) ftp_close_session(session);
+        ESP_LOGW(FTP_TAG, "Connection refused, no free session");
+        return;
     }
 
-    //SOCKETFIFO_Init((void *)ftp_fifoelements, FTP_SOCKETFIFO_ELEMENTS_MAX);
-
-    ftp_data.c_sd  = -1;
-    ftp_data.d_sd  = -1;
-    ftp_data.lc_sd = -1;
-    ftp_data.ld_sd = -1;
-    ftp_data.e_open = E_FTP_NOTHING_OPEN;
-    ftp_data.state = E_FTP_STE_DISABLED;
-    ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-
-    if (ftp_mutex == NULL) ftp_mutex = xSemaphoreCreateMutex();
-    return true;
+    session->c_sd = sd;
+    session->ip_addr = ip_addr;
+    session->state = E_FTP_STE_READY;
+    session->substate = E_FTP_STE_SUB_DISCONNECTED;
+    session->txRetries = 0;
+    session->logginRetries = 0;
+    session->ctimeout = 0;
+    session->loggin.uservalid = false;
+    session->loggin.passvalid = false;
+    session->quit = false;
+    session->tx_chunk = 0;
+    strcpy (session->path, "/");
+    ESP_LOGI(FTP_TAG, "[%d] Connected.", session->index);
+    ftp_send_reply (session, 220, "Micropython FTP Server");
 }
 
-//============================
-int ftp_run (uint32_t elapsed)
-{
-    if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return -1;
-    if (ftp_stop) return -2;
+//--------------------------------------------------------------------
+static void ftp_run_session (ftp_data_t *session, uint32_t elapsed) {
+    session->dtimeout += elapsed;
+	session->ctimeout += elapsed;
+	session->time += elapsed;
 
-    ftp_data.dtimeout += elapsed;
-	ftp_data.ctimeout += elapsed;
-	ftp_data.time += elapsed;
-
-    switch (ftp_data.state) {
-        case E_FTP_STE_DISABLED:
-            ftp_wait_for_enabled();
-            break;
-        case E_FTP_STE_START:
-            if (ftp_create_listening_socket(&ftp_data.lc_sd, FTP_CMD_PORT, FTP_CMD_CLIENTS_MAX - 1)) {
-                ftp_data.state = E_FTP_STE_READY;
-            }
-            break;
+    switch (session->state) {
         case E_FTP_STE_READY:
-            if (ftp_data.c_sd < 0 && ftp_data.substate == E_FTP_STE_SUB_DISCONNECTED) {
-                if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.lc_sd, &ftp_data.c_sd, &ftp_data.ip_addr)) {
-                    ftp_data.txRetries = 0;
-                    ftp_data.logginRetries = 0;
-                    ftp_data.ctimeout = 0;
-                    ftp_data.loggin.uservalid = false;
-                    ftp_data.loggin.passvalid = false;
-                    strcpy (ftp_path, "/");
-                    ESP_LOGI(FTP_TAG, "Connected.");
-                    ftp_send_reply (220, "Micropython FTP Server");
-                    break;
-                }
-            }
-			if (ftp_data.c_sd > 0 && ftp_data.substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
-				ftp_process_cmd();
-				if (ftp_data.state != E_FTP_STE_READY) {
-					break;
-				}
+			if (session->substate != E_FTP_STE_SUB_LISTEN_FOR_DATA) {
+				ftp_process_cmd(session);
 			}
             break;
         case E_FTP_STE_END_TRANSFER:
-        	if (ftp_data.d_sd >= 0) {
-				closesocket(ftp_data.d_sd);
-				ftp_data.d_sd = -1;
+        	if (session->d_sd >= 0) {
+				closesocket(session->d_sd);
+				session->d_sd = -1;
         	}
             break;
         case E_FTP_STE_CONTINUE_LISTING:
-            // go on with listing
-        	{
-                uint32_t listsize = 0;
-                ftp_result_t list_res = ftp_list_dir((char *)ftp_data.dBuffer, ftp_buff_size, &listsize);
-            	if (listsize > 0) ftp_send_list(listsize);
-                if (list_res == E_FTP_RESULT_OK) {
-                    ftp_send_reply(226, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                }
-                ftp_data.ctimeout = 0;
-            }
-            break;
         case E_FTP_STE_CONTINUE_FILE_TX:
-            // read and send the next block from the file
-        	{
-                uint32_t readsize;
-                ftp_result_t result;
-                ftp_data.ctimeout = 0;
-                result = ftp_read_file ((char *)ftp_data.dBuffer, ftp_buff_size, &readsize);
-                if (result == E_FTP_RESULT_FAILED) {
-                    ftp_send_reply(451, NULL);
-                    ftp_data.state = E_FTP_STE_END_TRANSFER;
-                }
-                else {
-                    if (readsize > 0) {
-                        ftp_send_file_data(readsize);
-                        ftp_data.total += readsize;
-						ESP_LOGD(FTP_TAG, "Sent %u, total: %u", readsize, ftp_data.total);
-                    }
-                    if (result == E_FTP_RESULT_OK) {
-                        ftp_send_reply(226, NULL);
-                        ftp_data.state = E_FTP_STE_END_TRANSFER;
-    					ESP_LOGI(FTP_TAG, "File sent (%u bytes in %u msek).", ftp_data.total, ftp_data.time);
-                    }
-                }
-            }
+            // send the pending data and read the next block
+            ftp_tx_run(session);
             break;
         case E_FTP_STE_CONTINUE_FILE_RX:
         	{
                 int32_t len;
                 ftp_result_t result = E_FTP_RESULT_OK;
 
-                result = ftp_recv_non_blocking(ftp_data.d_sd, ftp_data.dBuffer, ftp_buff_size, &len);
+                result = ftp_recv_non_blocking(session->d_sd, session->dBuffer, ftp_buff_size, &len);
 				if (result == E_FTP_RESULT_OK) {
 					// block of data received
-					ftp_data.dtimeout = 0;
-					ftp_data.ctimeout = 0;
+					session->dtimeout = 0;
+					session->ctimeout = 0;
 					// save received data to file
-					if (E_FTP_RESULT_OK != ftp_write_file ((char *)ftp_data.dBuffer, len)) {
-						ftp_send_reply(451, NULL);
-						ftp_data.state = E_FTP_STE_END_TRANSFER;
-						ESP_LOGW(FTP_TAG, "Error writing to file");
+					if (E_FTP_RESULT_OK != ftp_write_file (session, (char *)session->dBuffer, len)) {
+						ftp_send_reply(session, 451, NULL);
+						session->state = E_FTP_STE_END_TRANSFER;
+						ESP_LOGW(FTP_TAG, "[%d] Error writing to file", session->index);
 					}
 					else {
-						ftp_data.total += len;
-						ESP_LOGD(FTP_TAG, "Received %u, total: %u", len, ftp_data.total);
+						session->total += len;
+						ESP_LOGD(FTP_TAG, "[%d] Received %u, total: %u", session->index, len, session->total);
 					}
 				}
 				else if (result == E_FTP_RESULT_CONTINUE) {
 					// nothing received
-					if (ftp_data.dtimeout > FTP_DATA_TIMEOUT_MS) {
-						ftp_close_files_dir();
-						ftp_send_reply(426, NULL);
-						ftp_data.state = E_FTP_STE_END_TRANSFER;
-						ESP_LOGW(FTP_TAG, "Receiving to file timeout");
+					if (session->dtimeout > FTP_DATA_TIMEOUT_MS) {
+						ftp_close_files_dir(session);
+						ftp_send_reply(session, 426, NULL);
+						session->state = E_FTP_STE_END_TRANSFER;
+						ESP_LOGW(FTP_TAG, "[%d] Receiving to file timeout", session->index);
 					}
 				}
 				else {
 					// File received (E_FTP_RESULT_FAILED)
-					ftp_close_files_dir();
-					ftp_send_reply(226, NULL);
-					ftp_data.state = E_FTP_STE_END_TRANSFER;
-					ESP_LOGI(FTP_TAG, "File received (%u bytes in %u msek).", ftp_data.total, ftp_data.time);
+					ftp_close_files_dir(session);
+					ftp_send_reply(session, 226, NULL);
+					session->state = E_FTP_STE_END_TRANSFER;
+					ESP_LOGI(FTP_TAG, "[%d] File received (%u bytes in %u msek).", session->index, session->total, session->time);
 					break;
 				}
         	}
@@ -1297,34 +1291,35 @@ int ftp_run (uint32_t elapsed)
             break;
     }
 
-    switch (ftp_data.substate) {
+    switch (session->substate) {
     case E_FTP_STE_SUB_DISCONNECTED:
         break;
     case E_FTP_STE_SUB_LISTEN_FOR_DATA:
-        if (E_FTP_RESULT_OK == ftp_wait_for_connection(ftp_data.ld_sd, &ftp_data.d_sd, NULL)) {
-            ftp_data.dtimeout = 0;
-            ftp_data.substate = E_FTP_STE_SUB_DATA_CONNECTED;
-			ESP_LOGD(FTP_TAG, "Data socket connected");
-        }
-        else if (ftp_data.dtimeout > FTP_DATA_TIMEOUT_MS) {
-            ESP_LOGW(FTP_TAG, "Waiting for data connection timeout (%d)", ftp_data.dtimeout);
-            ftp_data.dtimeout = 0;
-            // close the listening socket
-            closesocket(ftp_data.ld_sd);
-            ftp_data.ld_sd = -1;
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
+        {
+            ftp_result_t result = ftp_wait_for_connection(session->ld_sd, &session->d_sd, NULL);
+            if (result == E_FTP_RESULT_OK) {
+                session->dtimeout = 0;
+                session->substate = E_FTP_STE_SUB_DATA_CONNECTED;
+                ESP_LOGD(FTP_TAG, "[%d] Data socket connected", session->index);
+            }
+            else if ((result == E_FTP_RESULT_FAILED) || (session->dtimeout > FTP_DATA_TIMEOUT_MS)) {
+                ESP_LOGW(FTP_TAG, "[%d] Waiting for data connection timeout (%d)", session->index, session->dtimeout);
+                session->dtimeout = 0;
+                // close the listening socket
+                closesocket(session->ld_sd);
+                session->ld_sd = -1;
+                session->substate = E_FTP_STE_SUB_DISCONNECTED;
+            }
         }
         break;
     case E_FTP_STE_SUB_DATA_CONNECTED:
-        if (ftp_data.state == E_FTP_STE_READY && (ftp_data.dtimeout > FTP_DATA_TIMEOUT_MS)) {
+        if (session->state == E_FTP_STE_READY && (session->dtimeout > FTP_DATA_TIMEOUT_MS)) {
             // close the listening and the data socket
-            closesocket(ftp_data.ld_sd);
-            closesocket(ftp_data.d_sd);
-            ftp_data.ld_sd = -1;
-            ftp_data.d_sd = -1;
-            ftp_close_filesystem_on_error ();
-            ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-            ESP_LOGW(FTP_TAG, "Data connection timeout");
+            closesocket(session->ld_sd);
+            session->ld_sd = -1;
+            ftp_close_data(session);
+            session->substate = E_FTP_STE_SUB_DISCONNECTED;
+            ESP_LOGW(FTP_TAG, "[%d] Data connection timeout", session->index);
         }
         break;
     default:
@@ -1332,24 +1327,193 @@ int ftp_run (uint32_t elapsed)
     }
 
     // check the state of the data sockets
-    if (ftp_data.d_sd < 0 && (ftp_data.state > E_FTP_STE_READY)) {
-        ftp_data.substate = E_FTP_STE_SUB_DISCONNECTED;
-        ftp_data.state = E_FTP_STE_READY;
-		ESP_LOGD(FTP_TAG, "Data socket disconnected");
+    if (session->d_sd < 0 && (session->state > E_FTP_STE_READY)) {
+        ftp_close_filesystem_on_error(session);
+        session->substate = E_FTP_STE_SUB_DISCONNECTED;
+        session->state = E_FTP_STE_READY;
+		ESP_LOGD(FTP_TAG, "[%d] Data socket disconnected", session->index);
+    }
+
+    if (session->quit) {
+        ftp_close_session(session);
+		ESP_LOGI(FTP_TAG, "[%d] Disconnected.", session->index);
+    }
+}
+
+// Returns true if any session is transferring data
+//----------------------------
+static bool ftp_busy (void) {
+    for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+        if (ftp_sessions[i].state > E_FTP_STE_READY) return true;
+    }
+    return false;
+}
+
+// ==== PUBLIC FUNCTIONS ===================================================================
+
+//---------------------
+void ftp_deinit(void) {
+    for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+        ftp_close_session(&ftp_sessions[i]);
+    }
+	if (ftp_cmd_buffer) free(ftp_cmd_buffer);
+	if (ftp_scratch_buffer) free(ftp_scratch_buffer);
+	ftp_cmd_buffer = NULL;
+	ftp_scratch_buffer = NULL;
+}
+
+//-------------------
+bool ftp_init(void) {
+	ftp_stop = 0;
+    // Allocate memory for the command buffers (from the RTOS heap)
+    // session buffers are allocated when the client connects
+	for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+	    ftp_sessions[i].c_sd  = -1;
+	    ftp_sessions[i].d_sd  = -1;
+	    ftp_sessions[i].ld_sd = -1;
+	}
+	ftp_deinit();
+
+	memset(ftp_sessions, 0, sizeof(ftp_sessions));
+	ftp_scratch_buffer = malloc(FTP_MAX_PARAM_SIZE);
+    if (ftp_scratch_buffer == NULL) return false;
+	ftp_cmd_buffer = malloc(FTP_MAX_PARAM_SIZE + FTP_CMD_SIZE_MAX);
+    if (ftp_cmd_buffer == NULL) {
+        free(ftp_scratch_buffer);
+        ftp_scratch_buffer = NULL;
+        return false;
+    }
+
+	for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+	    ftp_data_t *session = &ftp_sessions[i];
+	    session->index = i;
+        session->c_sd  = -1;
+        session->d_sd  = -1;
+        session->ld_sd = -1;
+        session->e_open = E_FTP_NOTHING_OPEN;
+        session->state = E_FTP_STE_READY;
+        session->substate = E_FTP_STE_SUB_DISCONNECTED;
+	}
+    ftp_lc_sd = -1;
+    ftp_enabled = false;
+    ftp_state = E_FTP_STE_DISABLED;
+
+    if (ftp_mutex == NULL) ftp_mutex = xSemaphoreCreateMutex();
+    return true;
+}
+
+//============================
+int ftp_run (uint32_t elapsed)
+{
+    if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return -1;
+    if (ftp_stop) {
+        xSemaphoreGive(ftp_mutex);
+        return -2;
+    }
+
+    switch (ftp_state) {
+        case E_FTP_STE_DISABLED:
+            // Check if the ftp service has been enabled
+            if (ftp_enabled) ftp_state = E_FTP_STE_START;
+            break;
+        case E_FTP_STE_START:
+            if (ftp_create_listening_socket(&ftp_lc_sd, FTP_CMD_PORT, FTP_SESSIONS_MAX)) {
+                ftp_state = E_FTP_STE_READY;
+            }
+            break;
+        case E_FTP_STE_READY:
+            ftp_accept_session();
+            for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+                if ((ftp_state == E_FTP_STE_READY) && (ftp_sessions[i].c_sd >= 0)) ftp_run_session(&ftp_sessions[i], elapsed);
+            }
+            break;
+        default:
+            break;
     }
 
     xSemaphoreGive(ftp_mutex);
     return 0;
 }
 
+/*
+ * Wait for activity on the ftp sockets, max. 'timeout_ms'
+ * Returns immediately if a session has data to read from the file system.
+ * If it never has to wait, the ftp task is delayed one tick every FTP_BUSY_YIELD_MS
+ * so that the lower priority tasks can run.
+ */
+//=====================================
+void ftp_wait_io (uint32_t timeout_ms)
+{
+    fd_set rfds, wfds;
+    int32_t maxfd = -1;
+    bool ready = false;
+
+    if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return;
+
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    if ((ftp_state == E_FTP_STE_READY) && (ftp_lc_sd >= 0)) {
+        FD_SET(ftp_lc_sd, &rfds);
+        maxfd = ftp_lc_sd;
+    }
+    for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+        ftp_data_t *session = &ftp_sessions[i];
+        int32_t sd = -1;
+        if (session->c_sd < 0) continue;
+
+        if (session->substate == E_FTP_STE_SUB_LISTEN_FOR_DATA) {
+            sd = session->ld_sd;
+            if (sd >= 0) FD_SET(sd, &rfds);
+        }
+        else if (session->state == E_FTP_STE_READY) {
+            sd = session->c_sd;
+            FD_SET(sd, &rfds);
+        }
+        if ((session->state == E_FTP_STE_CONTINUE_FILE_RX) && (session->d_sd >= 0)) {
+            sd = MAX(sd, session->d_sd);
+            FD_SET(session->d_sd, &rfds);
+        }
+        else if ((session->state == E_FTP_STE_CONTINUE_FILE_TX) || (session->state == E_FTP_STE_CONTINUE_LISTING)) {
+            if (ftp_tx_ready(session)) ready = true;
+            else if (session->d_sd >= 0) {
+                sd = MAX(sd, session->d_sd);
+                FD_SET(session->d_sd, &wfds);
+            }
+        }
+        else if (session->state == E_FTP_STE_END_TRANSFER) ready = true;
+        if (sd > maxfd) maxfd = sd;
+    }
+    xSemaphoreGive(ftp_mutex);
+
+    if (ready) {
+        TickType_t now = xTaskGetTickCount();
+        if (ftp_busy_since == 0) ftp_busy_since = now;
+        else if ((now - ftp_busy_since) > (FTP_BUSY_YIELD_MS / portTICK_PERIOD_MS)) {
+            ftp_busy_since = now;
+            vTaskDelay(1);
+        }
+        return;
+    }
+    ftp_busy_since = 0;
+
+    if (maxfd < 0) {
+        vTaskDelay(timeout_ms / portTICK_PERIOD_MS);
+        return;
+    }
+    struct timeval tv;
+    tv.tv_sec = timeout_ms / 1000;
+    tv.tv_usec = (timeout_ms % 1000) * 1000;
+    select(maxfd + 1, &rfds, &wfds, NULL, &tv);
+}
+
 //----------------------
 bool ftp_enable (void) {
 	if ((FtpTaskHandle == NULL) || (ftp_mutex == NULL)) return false;
 	if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return false;
 
 	bool res = false;
-    if (ftp_data.state == E_FTP_STE_DISABLED) {
-    	ftp_data.enabled = true;
+    if (ftp_state == E_FTP_STE_DISABLED) {
+    	ftp_enabled = true;
 		res = true;
     }
 	xSemaphoreGive(ftp_mutex);
@@ -1361,7 +1525,7 @@ bool ftp_isenabled (void) {
 	if ((FtpTaskHandle == NULL) || (ftp_mutex == NULL)) return false;
 	if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return false;
 
-	bool res = (ftp_data.enabled == true);
+	bool res = (ftp_enabled == true);
 	xSemaphoreGive(ftp_mutex);
 	return res;
 }
@@ -1372,10 +1536,10 @@ bool ftp_disable (void) {
 	if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return false;
 
 	bool res = false;
-    if (ftp_data.state == E_FTP_STE_READY) {
+    if ((ftp_state == E_FTP_STE_READY) && (!ftp_busy())) {
 		_ftp_reset();
-		ftp_data.enabled = false;
-		ftp_data.state = E_FTP_STE_DISABLED;
+		ftp_enabled = false;
+		ftp_state = E_FTP_STE_DISABLED;
 		res = true;
     }
 	xSemaphoreGive(ftp_mutex);
@@ -1393,13 +1557,24 @@ bool ftp_reset (void) {
 }
 
 // Return current ftp server state
+// the state of the first session transferring data, 'Connected' if any client is connected
 //------------------
 int ftp_getstate() {
 	if ((FtpTaskHandle == NULL) || (ftp_mutex == NULL)) return -1;
 	if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return -2;
 
-	int fstate = ftp_data.state | (ftp_data.substate << 8);
-	if ((ftp_data.state == E_FTP_STE_READY) && (ftp_data.c_sd > 0)) fstate = E_FTP_STE_CONNECTED;
+	int fstate = ftp_state;
+	if (ftp_state == E_FTP_STE_READY) {
+	    for (int i=0; i<FTP_SESSIONS_MAX; i++) {
+	        ftp_data_t *session = &ftp_sessions[i];
+	        if (session->c_sd < 0) continue;
+	        if (session->state > E_FTP_STE_READY) {
+	            fstate = session->state | (session->substate << 8);
+	            break;
+	        }
+	        fstate = E_FTP_STE_CONNECTED;
+	    }
+	}
 	xSemaphoreGive(ftp_mutex);
 	return fstate;
 }
@@ -1410,7 +1585,7 @@ bool ftp_terminate (void) {
 	if (xSemaphoreTake(ftp_mutex, FTP_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return false;
 
 	bool res = false;
-    if (ftp_data.state == E_FTP_STE_READY) {
+    if ((ftp_state == E_FTP_STE_READY) && (!ftp_busy())) {
 		ftp_stop = 1;
 		_ftp_reset();
 		res = true;
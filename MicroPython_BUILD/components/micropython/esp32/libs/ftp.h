@@ -61,6 +61,7 @@ typedef enum {
 #define FTP_DEF_PASS            "python"
 #define FTP_MUTEX_TIMEOUT_MS    1000
 #define FTP_CMD_TIMEOUT_MS      (CONFIG_MICROPY_FTPSERVER_TIMEOUT*1000)
+#define FTP_IO_WAIT_MS          20
 
 extern const char *FTP_TAG;
 extern char ftp_user[FTP_USER_PASS_LEN_MAX + 1];
@@ -73,6 +74,7 @@ extern int ftp_timeout;
 bool ftp_init (void);
 void ftp_deinit (void);
 int ftp_run (uint32_t elapsed);
+void ftp_wait_io (uint32_t timeout_ms);
 bool ftp_enable (void);
 bool ftp_isenabled (void);
 bool ftp_disable (void);
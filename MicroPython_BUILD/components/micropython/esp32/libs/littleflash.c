@@ -180,8 +180,78 @@ typedef struct
     struct dirent dirent;
     lfs_dir_t lfs_dir;
     long off;
+    lfs_size_t size;        // size of the last read entry
+    lfs_time_t time;        // time of the last read entry
+    lfs_off_t *pos;         // lfs positions of the entries already read, used by seekdir
+    long npos;              // number of known positions
+    long pos_size;          // allocated size of 'pos'
 } vfs_lfs_dir_t;
 
+// ============================================================================
+// Stat cache
+// ============================================================================
+// Recently resolved paths and their info, repeated stat() calls on the same
+// path (exists, getsize, isdir, ...) do not walk the directory tree again.
+// Accessed with the lock taken, any change to the file system clears the cache.
+
+#define STAT_CACHE_SIZE     8
+#define STAT_CACHE_PATH_LEN 64
+
+typedef struct
+{
+    uint32_t used;          // LRU stamp, 0 if the entry is empty
+    uint8_t type;
+    lfs_size_t size;
+    lfs_time_t time;
+    char path[STAT_CACHE_PATH_LEN];
+} stat_cache_t;
+
+static stat_cache_t stat_cache[STAT_CACHE_SIZE];
+static uint32_t stat_cache_stamp = 0;
+
+//------------------------------
+static void stat_cache_clear()
+{
+    if (stat_cache_stamp == 0) return;
+    memset(stat_cache, 0, sizeof(stat_cache));
+    stat_cache_stamp = 0;
+}
+
+//-------------------------------------------------------------------
+static bool stat_cache_get(const char *path, struct lfs_info *info)
+{
+    for (int i = 0; i < STAT_CACHE_SIZE; i++)
+    {
+        if ((stat_cache[i].used) && (strcmp(stat_cache[i].path, path) == 0))
+        {
+            stat_cache[i].used = ++stat_cache_stamp;
+            info->type = stat_cache[i].type;
+            info->size = stat_cache[i].size;
+            info->time = stat_cache[i].time;
+            return true;
+        }
+    }
+    return false;
+}
+
+//-------------------------------------------------------------------------
+static void stat_cache_put(const char *path, const struct lfs_info *info)
+{
+    if (strlen(path) >= STAT_CACHE_PATH_LEN) return;
+
+    // replace the least recently used entry
+    int idx = 0;
+    for (int i = 1; i < STAT_CACHE_SIZE; i++)
+    {
+        if (stat_cache[i].used < stat_cache[idx].used) idx = i;
+    }
+    stat_cache[idx].used = ++stat_cache_stamp;
+    stat_cache[idx].type = info->type;
+    stat_cache[idx].size = info->size;
+    stat_cache[idx].time = info->time;
+    strcpy(stat_cache[idx].path, path);
+}
+
 //-------------------------------
 static int map_lfs_error(int err)
 {
@@ -255,6 +325,7 @@ static ssize_t write_p(void *ctx, int fd, const void *data, size_t size)
     }
 
     lfs_ssize_t written = lfs_file_write(&self->lfs, self->fds[fd].file, data, size);
+    stat_cache_clear();
 
     _lock_release(&self->lock);
 
@@ -419,6 +490,7 @@ static int open_p(void *ctx, const char *path, int flags, int mode)
 
     self->fds[fd].file = file;
     self->fds[fd].name = name;
+    if ((flags & O_ACCMODE) != O_RDONLY) stat_cache_clear();
 
     _lock_release(&self->lock);
 
@@ -440,6 +512,7 @@ static int close_p(void *ctx, int fd)
     }
 
     int err = lfs_file_close(&self->lfs, self->fds[fd].file);
+    stat_cache_clear();
 
     free(self->fds[fd].name);
     free(self->fds[fd].file);
@@ -498,7 +571,12 @@ static int stat_p(void *ctx, const char *path, struct stat *st)
     _lock_acquire(&self->lock);
 
     struct lfs_info lfs_info;
-    int err = lfs_stat(&self->lfs, path, &lfs_info);
+    int err = LFS_ERR_OK;
+    if (!stat_cache_get(path, &lfs_info))
+    {
+        err = lfs_stat(&self->lfs, path, &lfs_info);
+        if (err == LFS_ERR_OK) stat_cache_put(path, &lfs_info);
+    }
 
     _lock_release(&self->lock);
 
@@ -531,6 +609,7 @@ static int unlink_p(void *ctx, const char *path)
     _lock_acquire(&self->lock);
 
     int err = lfs_remove(&self->lfs, path);
+    stat_cache_clear();
 
     _lock_release(&self->lock);
 
@@ -545,12 +624,32 @@ static int rename_p(void *ctx, const char *src, const char *dst)
     _lock_acquire(&self->lock);
 
     int err = lfs_rename(&self->lfs, src, dst);
+    stat_cache_clear();
 
     _lock_release(&self->lock);
 
     return map_lfs_error(err);
 }
 
+// Remember the lfs position of the directory entry 'idx'
+// so that seekdir can go directly to it
+//--------------------------------------------------------------------
+static void dir_pos_add(vfs_lfs_dir_t *vfs_dir, long idx, lfs_off_t pos)
+{
+    if (idx != vfs_dir->npos) return; // already known or not consecutive
+
+    if (vfs_dir->npos >= vfs_dir->pos_size)
+    {
+        long new_size = (vfs_dir->pos_size) ? (vfs_dir->pos_size * 2) : 32;
+        lfs_off_t *new_pos = realloc(vfs_dir->pos, new_size * sizeof(lfs_off_t));
+        // on failure seekdir reads the remaining entries
+        if (new_pos == NULL) return;
+        vfs_dir->pos = new_pos;
+        vfs_dir->pos_size = new_size;
+    }
+    vfs_dir->pos[vfs_dir->npos++] = pos;
+}
+
 //------------------------------------------------
 static DIR *opendir_p(void *ctx, const char *name)
 {
@@ -562,7 +661,7 @@ static DIR *opendir_p(void *ctx, const char *name)
         errno = ENOMEM;
         return NULL;
     }
-    //*vfs_dir = {};
+    memset(vfs_dir, 0, sizeof(vfs_lfs_dir_t));
 
     _lock_acquire(&self->lock);
 
@@ -595,7 +694,9 @@ static int readdir_r_p(void *ctx, DIR *pdir, struct dirent *entry, struct dirent
     _lock_acquire(&self->lock);
 
     struct lfs_info lfs_info;
+    lfs_soff_t pos = lfs_dir_tell(&self->lfs, &vfs_dir->lfs_dir);
     int err = lfs_dir_read(&self->lfs, &vfs_dir->lfs_dir, &lfs_info);
+    if (err > 0) dir_pos_add(vfs_dir, vfs_dir->off, pos);
 
     _lock_release(&self->lock);
 
@@ -625,6 +726,8 @@ static int readdir_r_p(void *ctx, DIR *pdir, struct dirent *entry, struct dirent
         entry->d_type = DT_UNKNOWN;
     }
     size_t len = strlcpy(entry->d_name, lfs_info.name, sizeof(entry->d_name));
+    vfs_dir->size = lfs_info.size;
+    vfs_dir->time = lfs_info.time;
 
     // This "shouldn't" happen, but the LFS name length can be customized and may
     // be longer than what's provided in "struct dirent"
@@ -691,17 +794,34 @@ static void seekdir_p(void *ctx, DIR *pdir, long offset)
 
     // ESP32 VFS expects simple 0 to n counted directory offsets but lfs
     // doesn't so we need to "translate"...
-    int err = lfs_dir_rewind(&self->lfs, &vfs_dir->lfs_dir);
+    // The positions of the entries already read are known, seek directly to
+    // the nearest one and read only the entries not seen yet
+    long start = 0;
+    if (vfs_dir->npos > 0)
+    {
+        start = (offset < vfs_dir->npos) ? offset : vfs_dir->npos - 1;
+    }
+    int err;
+    if (start > 0)
+    {
+        err = lfs_dir_seek(&self->lfs, &vfs_dir->lfs_dir, vfs_dir->pos[start]);
+    }
+    else
+    {
+        err = lfs_dir_rewind(&self->lfs, &vfs_dir->lfs_dir);
+    }
     if (err >= 0)
     {
-        for (vfs_dir->off = 0; vfs_dir->off < offset; ++vfs_dir->off)
+        for (vfs_dir->off = start; vfs_dir->off < offset; ++vfs_dir->off)
         {
             struct lfs_info lfs_info;
+            lfs_soff_t pos = lfs_dir_tell(&self->lfs, &vfs_dir->lfs_dir);
             err = lfs_dir_read(&self->lfs, &vfs_dir->lfs_dir, &lfs_info);
-            if (err < 0)
+            if (err <= 0)
             {
                 break;
             }
+            dir_pos_add(vfs_dir, vfs_dir->off, pos);
         }
     }
 
@@ -734,6 +854,7 @@ static int closedir_p(void *ctx, DIR *pdir)
 
     _lock_release(&self->lock);
 
+    free(vfs_dir->pos);
     free(vfs_dir);
 
     return map_lfs_error(err);
@@ -747,6 +868,7 @@ static int mkdir_p(void *ctx, const char *name, mode_t mode)
     _lock_acquire(&self->lock);
 
     int err = lfs_mkdir(&self->lfs, name);
+    stat_cache_clear();
 
     _lock_release(&self->lock);
 
@@ -761,6 +883,7 @@ static int rmdir_p(void *ctx, const char *name)
     _lock_acquire(&self->lock);
 
     int err = lfs_remove(&self->lfs, name);
+    stat_cache_clear();
 
     _lock_release(&self->lock);
 
@@ -782,6 +905,7 @@ static int fsync_p(void *ctx, int fd)
     }
 
     int err = lfs_file_sync(&self->lfs, self->fds[fd].file);
+    stat_cache_clear();
 
     _lock_release(&self->lock);
 
@@ -977,6 +1101,7 @@ void littleFlash_term(const char* partition_label)
     {
         lfs_unmount(&littleFlash.lfs);
         littleFlash.mounted = false;
+        stat_cache_clear();
     }
 
     if (block_buffer) free(block_buffer);
@@ -988,6 +1113,24 @@ void littleFlash_term(const char* partition_label)
     _lock_close(&littleFlash.lock);
 }
 
+// Return the size and time of the last entry returned by readdir()
+// 'pdir' must be opened on the littlefs file system
+// The information is read together with the entry, no separate stat() is needed
+//=============================================================================
+int littleFlash_getDirentInfo(DIR *pdir, uint32_t *size, uint32_t *mtime)
+{
+    vfs_lfs_dir_t *vfs_dir = (vfs_lfs_dir_t *) pdir;
+    if (vfs_dir == NULL)
+    {
+        errno = EBADF;
+        return -1;
+    }
+
+    *size = vfs_dir->size;
+    *mtime = vfs_dir->time;
+    return 0;
+}
+
 //--------------------------------------------
 static int lfs_count(void *p, lfs_block_t b) {
     *(lfs_size_t *)p += 1;
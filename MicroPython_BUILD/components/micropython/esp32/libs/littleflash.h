@@ -74,6 +74,8 @@ uint32_t littleFlash_getUsedBlocks();
 
 uint32_t littleFlash_trim(int max_blocks, int noerase);
 
+int littleFlash_getDirentInfo(DIR *pdir, uint32_t *size, uint32_t *mtime);
+
 #endif
 
 #endif
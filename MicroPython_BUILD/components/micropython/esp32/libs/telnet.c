@@ -42,6 +42,8 @@
 #include "py/mpconfig.h"
 #include "py/obj.h"
 #include "py/mphal.h"
+#include "py/mpstate.h"
+#include "py/mpthread.h"
 #include "mpversion.h"
 #include "telnet.h"
 
@@ -68,6 +70,14 @@
 #define TELNET_TX_RETRIES_MAX               50
 #define TELNET_WAIT_TIME_MS                 10
 #define TELNET_LOGIN_RETRIES_MAX            3
+// REPL output is collected in the TX ring buffer and sent by the telnet task
+// in full TCP_MSS segments, or after TELNET_TX_DEADLINE_MS if less data is buffered
+// the buffer size is a multiple of TCP_MSS so that the wrap around doesn't split a segment
+#define TELNET_TX_BUFFER_SIZE               (3 * TCP_MSS)
+#define TELNET_TX_DEADLINE_MS               10
+// When the client doesn't read, the output waits max TELNET_TX_STALL_MS for free space
+// then it is dropped until the buffer is half empty again
+#define TELNET_TX_STALL_MS                  2000
 
 #define SE 240
 #define AYT 246
@@ -134,11 +144,22 @@ typedef struct {
     bool                enabled;
     bool                credentialsValid;
     bool                binary_mode;
+
+    // TX ring buffer
+    uint8_t             *txBuffer;
+    uint32_t            txHead;         // write index
+    uint32_t            txTail;         // read index
+    uint32_t            txLen;          // buffered bytes
+    uint64_t            txFirst;        // time of the last send or when the buffer became non empty
+    bool                txStalled;      // client is not reading, drop the output
+    uint8_t             txLast;         // last character written (for '\n' -> '\r\n')
+    telnet_tx_stats_t   txStats;
 } telnet_data_t;
 
 
 
 QueueHandle_t telnet_mutex = NULL;
+static QueueHandle_t telnet_tx_sem = NULL;     // given by the telnet task when TX buffer space is freed
 
 static uint8_t telnet_stop = 0;
 char telnet_user[TELNET_USER_PASS_LEN_MAX + 1];
@@ -166,6 +187,10 @@ static const uint8_t telnet_options_repl[]  = { IAC, WILL, ECHO, IAC, WILL, SUPP
 //--------------------------------
 static void _telnet_reset (void) {
     // close the connection and start all over again
+    telnet_data.txHead = 0;
+    telnet_data.txTail = 0;
+    telnet_data.txLen = 0;
+    telnet_data.txStalled = false;
     closesocket(telnet_data.n_sd);
     telnet_data.n_sd = -1;
     closesocket(telnet_data.sd);
@@ -255,6 +280,10 @@ static void telnet_wait_for_connection (void) {
         option |= O_NONBLOCK;
         fcntl(telnet_data.n_sd, F_SETFL, option);
 
+        // disable Nagle, the output is coalesced into full segments in the TX buffer
+        option = 1;
+        setsockopt(telnet_data.n_sd, IPPROTO_TCP, TCP_NODELAY, &option, sizeof(option));
+
         // client connected, so go on
         telnet_data.rxWindex = 0;
         telnet_data.rxRindex = 0;
@@ -267,6 +296,12 @@ static void telnet_wait_for_connection (void) {
         telnet_data.loginRetries = 0;
         telnet_data.timeout = mp_hal_ticks_ms();
         telnet_data.binary_mode = false;
+        telnet_data.txHead = 0;
+        telnet_data.txTail = 0;
+        telnet_data.txLen = 0;
+        telnet_data.txStalled = false;
+        telnet_data.txLast = 0;
+        memset(&telnet_data.txStats, 0, sizeof(telnet_tx_stats_t));
     }
 }
 
@@ -468,6 +503,133 @@ static void telnet_reset_buffer (void) {
     telnet_data.rxBuffer[telnet_data.rxWindex++] = '\r';
 }
 
+// ==== TX buffer ====
+
+// Copy 'len' bytes to the TX buffer, the caller checks the free space
+//--------------------------------------------------------------
+static void telnet_tx_copy (const uint8_t *data, uint32_t len) {
+    if (len == 0) return;
+    if (telnet_data.txLen == 0) telnet_data.txFirst = mp_hal_ticks_ms();
+    uint32_t n = MIN(len, TELNET_TX_BUFFER_SIZE - telnet_data.txHead);
+    memcpy(telnet_data.txBuffer + telnet_data.txHead, data, n);
+    if (n < len) memcpy(telnet_data.txBuffer, data + n, len - n);
+    telnet_data.txHead = (telnet_data.txHead + len) % TELNET_TX_BUFFER_SIZE;
+    telnet_data.txLen += len;
+    telnet_data.txLast = data[len-1];
+}
+
+/*
+ * Put as much as fits of 'str' into the TX buffer
+ * Runs of plain characters are copied at once, IAC (0xFF) is escaped as IAC IAC,
+ * if 'cooked' is true '\n' is converted to '\r\n'
+ * Returns the number of input characters consumed
+ */
+//-----------------------------------------------------------------------------
+static uint32_t telnet_tx_put (const uint8_t *str, uint32_t len, bool cooked) {
+    uint32_t done = 0;
+    while (done < len) {
+        uint32_t space = TELNET_TX_BUFFER_SIZE - telnet_data.txLen;
+        const uint8_t *p = str + done;
+        uint32_t run = 0;
+        uint32_t max = len - done;
+        while ((run < max) && (p[run] != IAC) && ((!cooked) || (p[run] != '\n'))) run++;
+        if (run > 0) {
+            uint32_t n = MIN(run, space);
+            telnet_tx_copy(p, n);
+            done += n;
+            if (n < run) break;
+            continue;
+        }
+        // special character, two bytes are needed
+        if (space < 2) break;
+        if (*p == IAC) {
+            static const uint8_t iac_esc[2] = { IAC, IAC };
+            telnet_tx_copy(iac_esc, 2);
+        }
+        else if (telnet_data.txLast == '\r') telnet_tx_copy(p, 1);
+        else telnet_tx_copy((const uint8_t *)"\r\n", 2);
+        done++;
+    }
+    return done;
+}
+
+// Send the buffered output, called from telnet_run with the mutex taken
+//------------------------------------
+static void telnet_tx_flush (void) {
+    bool freed = false;
+    while (telnet_data.txLen > 0) {
+        bool deadline = ((mp_hal_ticks_ms() - telnet_data.txFirst) >= TELNET_TX_DEADLINE_MS);
+        if ((telnet_data.txLen < TCP_MSS) && (!deadline)) break;  // wait for more output
+
+        uint32_t n = MIN(telnet_data.txLen, TELNET_TX_BUFFER_SIZE - telnet_data.txTail);
+        // before the deadline only the full segments are sent
+        if ((!deadline) && (n >= TCP_MSS)) n -= n % TCP_MSS;
+        int32_t sent = send(telnet_data.n_sd, telnet_data.txBuffer + telnet_data.txTail, n, 0);
+        if (sent < 0) {
+            if (errno == EAGAIN) break;     // send window full, try again on the next run
+            printf("[Telnet] Send Error\n");
+            _telnet_reset();
+            return;
+        }
+        telnet_data.txTail = (telnet_data.txTail + sent) % TELNET_TX_BUFFER_SIZE;
+        telnet_data.txLen -= sent;
+        telnet_data.txStats.bytes += sent;
+        telnet_data.txStats.sends++;
+        telnet_data.txStats.segments += (sent + TCP_MSS - 1) / TCP_MSS;
+        telnet_data.timeout = mp_hal_ticks_ms();
+        freed = true;
+        if (sent < n) break;
+        // the deadline for the rest starts now
+        telnet_data.txFirst = mp_hal_ticks_ms();
+    }
+    if (freed) {
+        if (telnet_data.txLen < (TELNET_TX_BUFFER_SIZE / 2)) telnet_data.txStalled = false;
+        // wake up the writer waiting for space
+        xSemaphoreGive(telnet_tx_sem);
+    }
+}
+
+// Write to the TX buffer, wait for free space if the buffer is full
+//---------------------------------------------------------------
+static void telnet_tx_write (const char *str, int len, bool cooked) {
+	if ((TelnetTaskHandle == NULL) || (telnet_mutex == NULL) || (telnet_data.n_sd <= 0)) return;
+
+	uint64_t start = mp_hal_ticks_ms();     // time of the last progress
+	while (len > 0) {
+	    if (xSemaphoreTake(telnet_mutex, TELNET_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return;
+	    if ((telnet_data.state != E_TELNET_STE_LOGGED_IN) || (telnet_data.txBuffer == NULL)) {
+	        xSemaphoreGive(telnet_mutex);
+	        return;
+	    }
+	    if (telnet_data.txStalled) {
+	        // back-pressure policy: the client has not read for TELNET_TX_STALL_MS, drop
+	        telnet_data.txStats.dropped += len;
+	        xSemaphoreGive(telnet_mutex);
+	        return;
+	    }
+	    uint32_t n = telnet_tx_put((const uint8_t *)str, len, cooked);
+	    str += n;
+	    len -= n;
+	    if (n > 0) start = mp_hal_ticks_ms();
+	    bool full_segment = (telnet_data.txLen >= TCP_MSS);
+	    if ((len > 0) && ((mp_hal_ticks_ms() - start) > TELNET_TX_STALL_MS)) {
+	        telnet_data.txStalled = true;
+	        telnet_data.txStats.dropped += len;
+	        len = 0;
+	    }
+	    xSemaphoreGive(telnet_mutex);
+
+	    // don't wait for the deadline if there is a full segment to send
+	    if (full_segment) xTaskNotifyGive(TelnetTaskHandle);
+	    if (len > 0) {
+	        // buffer full, wait until the telnet task sends some data
+	        MP_THREAD_GIL_EXIT();
+	        xSemaphoreTake(telnet_tx_sem, TELNET_WAIT_TIME_MS / portTICK_PERIOD_MS);
+	        MP_THREAD_GIL_ENTER();
+	    }
+	}
+}
+
 
 // =======================================================
 // = The following functions are called from other tasks =
@@ -568,6 +730,7 @@ int telnet_run (void) {
             break;
         case E_TELNET_STE_LOGGED_IN:
             telnet_process();
+            if (telnet_data.state == E_TELNET_STE_LOGGED_IN) telnet_tx_flush();
             break;
         default:
             break;
@@ -586,17 +749,21 @@ int telnet_run (void) {
 //-----------------------
 void telnet_init (void) {
 	telnet_stop = 0;
-    // Allocate memory for the receive buffer (from the RTOS heap)
+    // Allocate memory for the receive and transmit buffers (from the RTOS heap)
 	if (telnet_data.rxBuffer) free(telnet_data.rxBuffer);
+	if (telnet_data.txBuffer) free(telnet_data.txBuffer);
 	memset(&telnet_data, 0, sizeof(telnet_data_t));
     telnet_data.rxBuffer = malloc(TELNET_RX_BUFFER_SIZE);
+    telnet_data.txBuffer = malloc(TELNET_TX_BUFFER_SIZE);
     telnet_data.state = E_TELNET_STE_DISABLED;
 	if (telnet_mutex == NULL) telnet_mutex = xSemaphoreCreateMutex();
+	if (telnet_tx_sem == NULL) telnet_tx_sem = xSemaphoreCreateBinary();
 }
 
 //-------------------------
 void telnet_deinit (void) {
 	if (telnet_data.rxBuffer) free(telnet_data.rxBuffer);
+	if (telnet_data.txBuffer) free(telnet_data.txBuffer);
 	memset(&telnet_data, 0, sizeof(telnet_data_t));
 }
 
@@ -604,24 +771,25 @@ void telnet_deinit (void) {
 // Send string to telnet client
 //----------------------------------------------
 void telnet_tx_strn (const char *str, int len) {
-	if ((TelnetTaskHandle == NULL) || (telnet_mutex == NULL) || (telnet_data.n_sd <= 0)) return;
-    if (xSemaphoreTake(telnet_mutex, TELNET_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return;
-
-    if ((telnet_data.state == E_TELNET_STE_LOGGED_IN) && (len > 0)) {
-        int32_t retries = 0;
-        uint32_t delay = TELNET_WAIT_TIME_MS;
-
-    	do {
-    		if (send(telnet_data.n_sd, str, len, 0) > 0) {
-    			telnet_data.timeout = mp_hal_ticks_ms();
-    			break;
-    		}
-    		else if (EAGAIN != errno) break;
-    		// start with the default delay and increment it on each retry
-    		vTaskDelay(delay++ / portTICK_PERIOD_MS);
-    	} while (++retries <= TELNET_TX_RETRIES_MAX);
-    }
+    telnet_tx_write(str, len, false);
+}
+
+// Send string to telnet client, convert '\n' to '\r\n'
+//-----------------------------------------------------
+void telnet_tx_strn_cooked (const char *str, int len) {
+    telnet_tx_write(str, len, true);
+}
+
+// Get the TX statistics of the current connection
+//-----------------------------------------------------
+bool telnet_get_tx_stats (telnet_tx_stats_t *stats) {
+	if ((TelnetTaskHandle == NULL) || (telnet_mutex == NULL)) return false;
+	if (xSemaphoreTake(telnet_mutex, TELNET_MUTEX_TIMEOUT_MS / portTICK_PERIOD_MS) !=pdTRUE) return false;
+
+	*stats = telnet_data.txStats;
+	stats->buffered = telnet_data.txLen;
 	xSemaphoreGive(telnet_mutex);
+	return true;
 }
 
 // Return true if any character is available in RX buffer
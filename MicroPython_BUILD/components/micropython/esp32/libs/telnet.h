@@ -56,6 +56,14 @@ typedef enum {
     E_TELNET_STE_LOGGED_IN
 } telnet_state_t;
 
+typedef struct {
+    uint32_t bytes;         // bytes sent
+    uint32_t sends;         // send() calls
+    uint32_t segments;      // TCP segments (TCP_MSS sized)
+    uint32_t dropped;       // bytes dropped because the client was not reading
+    uint32_t buffered;      // bytes waiting in the TX buffer
+} telnet_tx_stats_t;
+
 
 extern char telnet_user[TELNET_USER_PASS_LEN_MAX + 1];
 extern char telnet_pass[TELNET_USER_PASS_LEN_MAX + 1];
@@ -72,6 +80,8 @@ void telnet_init (void);
 void telnet_deinit (void);
 int telnet_run (void);
 void telnet_tx_strn (const char *str, int len);
+void telnet_tx_strn_cooked (const char *str, int len);
+bool telnet_get_tx_stats (telnet_tx_stats_t *stats);
 bool telnet_rx_any (void);
 bool telnet_loggedin (void);
 int  telnet_rx_char (void);
@@ -48,6 +48,7 @@
 #include <math.h>
 #include "rom/tjpgd.h"
 #include "esp_heap_caps.h"
+#include "esp_timer.h"
 #include "tftspi.h"
 #include "driver/ledc.h"
 
@@ -115,6 +116,7 @@ uint8_t	text_wrap = 0;			// character wrapping to new line
 color_t	_fg = {  0, 255,   0};
 color_t _bg = {  0,   0,   0};
 uint8_t image_debug = 0;
+uint8_t tft_antialias = 0;
 uint8_t font_now = 0;
 uint16_t image_width = 0;
 uint16_t image_hight = 0;
@@ -376,7 +378,7 @@ static esp_err_t TFT_EPD_disp_select()
         return ESP_OK;
     }
     #endif
-    return disp_select();
+    return tft_panel->select();
 }
 
 //--------------------------------------
@@ -389,7 +391,7 @@ static esp_err_t TFT_EPD_disp_deselect()
         return ESP_OK;
     }
     #endif
-    return disp_deselect();
+    return tft_panel->deselect();
 }
 
 //-----------------------------------------------------------------------------------------------------
@@ -399,9 +401,9 @@ static void TFT_EPD_send_data(int x1, int y1, int x2, int y2, uint32_t len, colo
     if (tft_active_mode == TFT_MODE_EVE) {
         EVE_send_data(x1, y1, x2, y2, len, buf);
     }
-    else send_data(x1, y1, x2, y2, len, buf, wait);
+    else tft_panel->send_data(x1, y1, x2, y2, len, buf, wait);
     #else
-    send_data(x1, y1, x2, y2, len, buf, wait);
+    tft_panel->send_data(x1, y1, x2, y2, len, buf, wait);
     #endif
 }
 
@@ -415,7 +417,7 @@ static void TFT_EPD_drawPixe(int16_t x, int16_t y, color_t color, uint8_t sel)
     #if CONFIG_MICROPY_USE_EVE
     else if (tft_active_mode == TFT_MODE_EVE) EVE_drawPixel(x, y, color);
     #endif
-    else if (tft_active_mode == TFT_MODE_TFT) drawPixel(x, y, color, sel);
+    else if (tft_active_mode == TFT_MODE_TFT) tft_panel->drawPixel(x, y, color, sel);
 }
 
 //-------------------------------------------------------------------------------------------
@@ -427,7 +429,7 @@ static void TFT_EPD_pushColorRep(int x1, int y1, int x2, int y2, color_t color,
     #if CONFIG_MICROPY_USE_EVE
     else if (tft_active_mode == TFT_MODE_EVE) EVE_pushColorRep(x1, y1, x2, y2, color);
     #endif
-    else if (tft_active_mode == TFT_MODE_TFT) TFT_pushColorRep(x1, y1, x2, y2, color, len);
+    else if (tft_active_mode == TFT_MODE_TFT) tft_panel->pushColorRep(x1, y1, x2, y2, color, len);
 }
 
 //===========================================================================================
@@ -1010,149 +1012,233 @@ void TFT_drawEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t
 	}
 }
 
-//-----------------------------------------------------------------------------------------------------------------------
-static void _draw_filled_ellipse_section(uint16_t x, uint16_t y, uint16_t x0, uint16_t y0, color_t color, uint8_t option)
+// ==== SCANLINE SPANS ================================================================
+// Filled arcs, ellipses and polygons are rasterized as one horizontal span per row.
+// Span limits are 16.16 fixed point values, pixel 'x' is centered at x << SPAN_FX_SHIFT
+
+#define SPAN_FX_SHIFT	16
+#define SPAN_FX_ONE		(1 << SPAN_FX_SHIFT)
+#define SPAN_FX_HALF	(1 << (SPAN_FX_SHIFT-1))
+
+//--------------------------------------
+static uint32_t _isqrt64(uint64_t val)
 {
-    // upper right
-    if ( option & TFT_ELLIPSE_UPPER_RIGHT ) _drawFastVLine(x0+x, y0-y, y+1, color);
-    // upper left
-    if ( option & TFT_ELLIPSE_UPPER_LEFT ) _drawFastVLine(x0-x, y0-y, y+1, color);
-    // lower right
-    if ( option & TFT_ELLIPSE_LOWER_RIGHT ) _drawFastVLine(x0+x, y0, y+1, color);
-    // lower left
-    if ( option & TFT_ELLIPSE_LOWER_LEFT ) _drawFastVLine(x0-x, y0, y+1, color);
+	uint64_t res = 0;
+	uint64_t bit = (uint64_t)1 << 62;
+
+	while (bit > val) bit >>= 2;
+	while (bit) {
+		if (val >= (res + bit)) {
+			val -= res + bit;
+			res = (res >> 1) + bit;
+		}
+		else res >>= 1;
+		bit >>= 2;
+	}
+	return (uint32_t)res;
 }
 
-//=====================================================================================================
-void TFT_fillEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t color, uint8_t option)
+// Draw the pixel blended over the background color, 'alpha' = 0 ~ 256
+//-------------------------------------------------------------------------
+static void _drawBlendedPixel(int16_t x, int16_t y, color_t color, int alpha)
 {
-	x0 += dispWin.x1;
-	y0 += dispWin.y1;
-
-	uint16_t x, y;
-	int32_t xchg, ychg;
-	int32_t err;
-	int32_t rxrx2;
-	int32_t ryry2;
-	int32_t stopx, stopy;
-
-	rxrx2 = rx;
-	rxrx2 *= rx;
-	rxrx2 *= 2;
-
-	ryry2 = ry;
-	ryry2 *= ry;
-	ryry2 *= 2;
-
-	x = rx;
-	y = 0;
-
-	xchg = 1;
-	xchg -= rx;
-	xchg -= rx;
-	xchg *= ry;
-	xchg *= ry;
-
-	ychg = rx;
-	ychg *= rx;
-
-	err = 0;
-
-	stopx = ryry2;
-	stopx *= rx;
-	stopy = 0;
+	if (alpha <= 0) return;
+	if (alpha < 256) {
+		color.r = _bg.r + ((((int)color.r - (int)_bg.r) * alpha) >> 8);
+		color.g = _bg.g + ((((int)color.g - (int)_bg.g) * alpha) >> 8);
+		color.b = _bg.b + ((((int)color.b - (int)_bg.b) * alpha) >> 8);
+	}
+	TFT_EPD_drawPixe(x, y, color, 1);
+}
 
-	while( stopx >= stopy ) {
-		_draw_filled_ellipse_section(x, y, x0, y0, color, option);
-		y++;
-		stopy += rxrx2;
-		err += ychg;
-		ychg += rxrx2;
-		if ( 2*err+xchg > 0 ) {
-			x--;
-			stopx -= ryry2;
-			err += xchg;
-			xchg += ryry2;
+// Fill the pixels of the row 'y' covered by the fixed point interval [xa, xb]
+// With 'tft_antialias' set, partially covered end pixels are blended with the background color
+//---------------------------------------------------------------
+static void _fillSpan(int y, int32_t xa, int32_t xb, color_t color)
+{
+	if ((xb < xa) || (y < dispWin.y1) || (y > dispWin.y2)) return;
+
+	int x1, x2;
+	if (tft_antialias) {
+		// pixels containing the interval ends
+		x1 = (xa + SPAN_FX_HALF) >> SPAN_FX_SHIFT;
+		x2 = (xb + SPAN_FX_HALF) >> SPAN_FX_SHIFT;
+		if (x1 == x2) {
+			_drawBlendedPixel(x1, y, color, (xb - xa) >> (SPAN_FX_SHIFT-8));
+			return;
 		}
+		_drawBlendedPixel(x1, y, color, ((x1 * SPAN_FX_ONE) + SPAN_FX_HALF - xa) >> (SPAN_FX_SHIFT-8));
+		_drawBlendedPixel(x2, y, color, (xb - (x2 * SPAN_FX_ONE) + SPAN_FX_HALF) >> (SPAN_FX_SHIFT-8));
+		x1++;
+		x2--;
+	}
+	else {
+		// pixels with the center inside the interval
+		x1 = (xa + SPAN_FX_ONE - 1) >> SPAN_FX_SHIFT;
+		x2 = xb >> SPAN_FX_SHIFT;
 	}
+	if (x1 < dispWin.x1) x1 = dispWin.x1;
+	if (x2 > dispWin.x2) x2 = dispWin.x2;
+	if (x2 < x1) return;
 
-	x = 0;
-	y = ry;
+	_drawFastHLine(x1, y, x2-x1+1, color);
+}
 
-	xchg = ry;
-	xchg *= ry;
+// Fill the closed polygon given by 'n' absolute vertex coordinates
+// Convex and concave polygons are filled using the even-odd rule
+//------------------------------------------------------------------------
+static void _fillPolygon(const int *xp, const int *yp, int n, color_t color)
+{
+	if (n < 3) return;
+
+	int ea[n], eb[n];			// edge top & bottom row
+	int32_t ex[n], edx[n];		// edge x at the top row and x step per row
+	int32_t xs[n];				// edge crossings on the current row
+	int ne = 0;
+	int ymin = yp[0];
+	int ymax = yp[0];
+
+	for (int i = 0, j = n-1; i < n; j = i++) {
+		if (yp[i] < ymin) ymin = yp[i];
+		if (yp[i] > ymax) ymax = yp[i];
+		if (yp[i] == yp[j]) continue;	// horizontal edges are covered by the adjacent edges
+		int k = (yp[i] < yp[j]) ? i : j;
+		int l = (k == i) ? j : i;
+		ea[ne] = yp[k];
+		eb[ne] = yp[l];
+		ex[ne] = xp[k] * SPAN_FX_ONE;
+		edx[ne] = ((xp[l] - xp[k]) * SPAN_FX_ONE) / (yp[l] - yp[k]);
+		ne++;
+	}
+
+	int y1 = (ymin < dispWin.y1) ? dispWin.y1 : ymin;
+	int y2 = (ymax > dispWin.y2) ? dispWin.y2 : ymax;
+	for (int y = y1; y <= y2; y++) {
+		int ns = 0;
+		for (int i = 0; i < ne; i++) {
+			// edges are half open, except on the bottom row, so the shared vertices are counted once
+			if ((y < ea[i]) || (y > eb[i]) || ((y == eb[i]) && (y != ymax))) continue;
+			int32_t x = ex[i] + (edx[i] * (y - ea[i]));
+			int k = ns++;
+			while ((k > 0) && (xs[k-1] > x)) {
+				xs[k] = xs[k-1];
+				k--;
+			}
+			xs[k] = x;
+		}
+		for (int k = 0; (k+1) < ns; k += 2) _fillSpan(y, xs[k], xs[k+1], color);
+	}
+}
 
-	ychg = 1;
-	ychg -= ry;
-	ychg -= ry;
-	ychg *= rx;
-	ychg *= rx;
+//=====================================================================================================
+void TFT_fillEllipse(uint16_t x0, uint16_t y0, uint16_t rx, uint16_t ry, color_t color, uint8_t option)
+{
+	x0 += dispWin.x1;
+	y0 += dispWin.y1;
 
-	err = 0;
+	int32_t xc = x0 * SPAN_FX_ONE;
+	int32_t ry2 = (int32_t)ry * ry;
 
-	stopx = 0;
+	for (int y = 0; y <= ry; y++) {
+		// ellipse half width on this row
+		int32_t w = rx * SPAN_FX_ONE;
+		if (ry) w = (int32_t)(((uint64_t)_isqrt64((uint64_t)(ry2 - (y * y)) << (2*SPAN_FX_SHIFT)) * rx) / ry);
 
-	stopy = rxrx2;
-	stopy *= ry;
+		uint8_t upper = option & (TFT_ELLIPSE_UPPER_LEFT | TFT_ELLIPSE_UPPER_RIGHT);
+		uint8_t lower = option & (TFT_ELLIPSE_LOWER_LEFT | TFT_ELLIPSE_LOWER_RIGHT);
+		if (y == 0) upper = lower = upper | lower;
 
-	while( stopx <= stopy ) {
-		_draw_filled_ellipse_section(x, y, x0, y0, color, option);
-		x++;
-		stopx += ryry2;
-		err += xchg;
-		xchg += ryry2;
-		if ( 2*err+ychg > 0 ) {
-			y--;
-			stopy -= rxrx2;
-			err += ychg;
-			ychg += rxrx2;
+		if (upper) {
+			_fillSpan(y0 - y, (upper & TFT_ELLIPSE_UPPER_LEFT) ? xc - w : xc,
+					(upper & TFT_ELLIPSE_UPPER_RIGHT) ? xc + w : xc, color);
+		}
+		if ((lower) && (y > 0)) {
+			_fillSpan(y0 + y, (lower & TFT_ELLIPSE_LOWER_LEFT) ? xc - w : xc,
+					(lower & TFT_ELLIPSE_LOWER_RIGHT) ? xc + w : xc, color);
 		}
 	}
 }
 
-
 // ==== ARC DRAWING ===================================================================
 
-//---------------------------------------------------------------------------------------------------------------------------------
-static void _fillArcOffsetted(uint16_t cx, uint16_t cy, uint16_t radius, uint16_t thickness, float start, float end, color_t color)
+// Convert the angle limit slope (x/y) to fixed point, clamped to the valid range
+//-------------------------------------------
+static int32_t _arcSlope(float slope)
 {
-	//float sslope = (float)cos_lookup(start) / (float)sin_lookup(start);
-	//float eslope = (float)cos_lookup(end) / (float)sin_lookup(end);
-	float sslope = (cos(start/_arcAngleMax * 2 * PI) * _arcAngleMax) / (sin(start/_arcAngleMax * 2 * PI) * _arcAngleMax) ;
-	float eslope = (cos(end/_arcAngleMax * 2 * PI) * _arcAngleMax) / (sin(end/_arcAngleMax * 2 * PI) * _arcAngleMax);
+	if (slope > 32767.0) return 32767 * SPAN_FX_ONE;
+	if (slope < -32767.0) return -32767 * SPAN_FX_ONE;
+	return (int32_t)(slope * SPAN_FX_ONE);
+}
 
-	if (end == 360) eslope = -1000000;
+// x limit on the row 'y' for the given angle slope, clamped to +/- 'lim'
+//---------------------------------------------------------------
+static int32_t _arcLimit(int y, int32_t slope, int32_t lim)
+{
+	int64_t x = (int64_t)y * slope;
+	if (x > lim) return lim;
+	if (x < -lim) return -lim;
+	return (int32_t)x;
+}
 
-	int ir2 = (radius - thickness) * (radius - thickness);
-	int or2 = radius * radius;
+// Fill the parts of the ring row 'y' inside the angle limits [amin, amax]
+//-------------------------------------------------------------------------------------------------------------------
+static void _fillArcRow(int32_t xc, int y, int32_t xo, int32_t xi, int32_t amin, int32_t amax, color_t color)
+{
+	if (xi < 0) {
+		_fillSpan(y, xc + ((-xo > amin) ? -xo : amin), xc + ((xo < amax) ? xo : amax), color);
+	}
+	else {
+		_fillSpan(y, xc + ((-xo > amin) ? -xo : amin), xc + ((-xi < amax) ? -xi : amax), color);
+		_fillSpan(y, xc + ((xi > amin) ? xi : amin), xc + ((xo < amax) ? xo : amax), color);
+	}
+}
 
-	TFT_EPD_disp_select();
-	for (int x = -radius; x <= radius; x++) {
-		for (int y = -radius; y <= radius; y++) {
-			int x2 = x * x;
-			int y2 = y * y;
-
-			if (
-				(x2 + y2 < or2 && x2 + y2 >= ir2) &&
-				(
-				(y > 0 && start < 180 && x <= y * sslope) ||
-				(y < 0 && start > 180 && x >= y * sslope) ||
-				(y < 0 && start <= 180) ||
-				(y == 0 && start <= 180 && x < 0) ||
-				(y == 0 && start == 0 && x > 0)
-				) &&
-				(
-				(y > 0 && end < 180 && x >= y * eslope) ||
-				(y < 0 && end > 180 && x <= y * eslope) ||
-				(y > 0 && end >= 180) ||
-				(y == 0 && end >= 180 && x < 0) ||
-				(y == 0 && start == 0 && x > 0)
-				)
-				)
-				TFT_EPD_drawPixe(cx+x, cy+y, color, 0);
+// Fill the ring (radius-thickness) <= d < radius between the 'start' and 'end' angles, one span per ring part and row
+//---------------------------------------------------------------------------------------------------------------------------------
+static void _fillArcOffsetted(uint16_t cx, uint16_t cy, uint16_t radius, uint16_t thickness, float start, float end, color_t color)
+{
+	int32_t sslope = _arcSlope(cos(start/_arcAngleMax * 2 * PI) / sin(start/_arcAngleMax * 2 * PI));
+	int32_t eslope = _arcSlope(cos(end/_arcAngleMax * 2 * PI) / sin(end/_arcAngleMax * 2 * PI));
+
+	if (end == 360) eslope = -32767 * SPAN_FX_ONE;
+
+	int32_t xc = cx * SPAN_FX_ONE;
+	int32_t lim = (radius + 1) * SPAN_FX_ONE;
+	int32_t ir2 = (radius - thickness) * (radius - thickness);
+	int32_t or2 = radius * radius;
+	// exact integer ring limits, or the true circles when antialiasing
+	int32_t bias = (tft_antialias) ? 0 : 1;
+
+	for (int y = -radius; y <= radius; y++) {
+		int32_t y2 = y * y;
+		if ((y2 + bias) > or2) continue;
+
+		// ring half width on this row and the half width of the hole inside it (-1 if no hole)
+		int32_t xo = _isqrt64((uint64_t)(or2 - bias - y2) << (2*SPAN_FX_SHIFT));
+		int32_t xi = -1;
+		if ((y2 + bias) <= ir2) xi = _isqrt64((uint64_t)(ir2 - bias - y2) << (2*SPAN_FX_SHIFT)) + bias;
+
+		// x limits set by the start & end angles
+		int32_t amin = -lim;
+		int32_t amax = lim;
+		if (y > 0) {
+			if (start >= 180) continue;
+			if (start > 0) amax = _arcLimit(y, sslope, lim);
+			if (end < 180) amin = _arcLimit(y, eslope, lim);
+		}
+		else if (y < 0) {
+			if (end <= 180) continue;
+			if (start > 180) amin = _arcLimit(y, sslope, lim);
+			amax = _arcLimit(y, eslope, lim);
+		}
+		else {
+			// center row, only the horizontal directions
+			if ((start <= 180) && (end >= 180)) _fillArcRow(xc, cy, xo, xi, -lim, -1, color);
+			if (start == 0) _fillArcRow(xc, cy, xo, xi, 1, lim, color);
+			continue;
 		}
+		_fillArcRow(xc, cy + y, xo, xi, amin, amax, color);
 	}
-	TFT_EPD_disp_deselect();
 }
 
 
@@ -1224,12 +1310,7 @@ void TFT_drawPolygon(int cx, int cy, int sides, int diameter, color_t color, col
 	}
 
 	// Draw the polygon on the screen.
-	if (f) {
-		for(int idx = 0; idx < sides; idx++) {
-			if((idx+1) < sides) _fillTriangle(cx,cy,Xpoints[idx],Ypoints[idx],Xpoints[idx+1],Ypoints[idx+1], fill);
-			else _fillTriangle(cx,cy,Xpoints[idx],Ypoints[idx],Xpoints[0],Ypoints[0], fill);
-		}
-	}
+	if (f) _fillPolygon(Xpoints, Ypoints, sides, fill);
 
 	if (th) {
 		for (int n=0; n<th; n++) {
@@ -1249,54 +1330,37 @@ void TFT_drawPolygon(int cx, int cy, int sides, int diameter, color_t color, col
 	}
 }
 
-/*
 // Similar to the Polygon function.
-//=====================================================================================
-void TFT_drawStar(int cx, int cy, int diameter, color_t color, bool fill, float factor)
+//=====================================================================================================
+void TFT_drawStar(int cx, int cy, int diameter, color_t color, color_t fill, int rot, float factor)
 {
 	cx += dispWin.x1;
 	cy += dispWin.y1;
 
+	int deg = rot - _angleOffset;
+	int f = TFT_compare_colors(fill, color);
+
 	factor = constrain(factor, 1.0, 4.0);
-	uint8_t sides = 5;
-	uint8_t rads = 360 / sides;
-
-	int Xpoints_O[sides], Ypoints_O[sides], Xpoints_I[sides], Ypoints_I[sides];//Xpoints_T[5], Ypoints_T[5];
-
-	for(int idx = 0; idx < sides; idx++) {
-		// makes the outer points
-		Xpoints_O[idx] = cx + sin((float)(idx*rads + 72) * deg_to_rad) * diameter;
-		Ypoints_O[idx] = cy + cos((float)(idx*rads + 72) * deg_to_rad) * diameter;
-		// makes the inner points
-		Xpoints_I[idx] = cx + sin((float)(idx*rads + 36) * deg_to_rad) * ((float)(diameter)/factor);
-		// 36 is half of 72, and this will allow the inner and outer points to line up like a triangle.
-		Ypoints_I[idx] = cy + cos((float)(idx*rads + 36) * deg_to_rad) * ((float)(diameter)/factor);
-	}
-
-	for(int idx = 0; idx < sides; idx++) {
-		if((idx+1) < sides) {
-			if(fill) {// this part below should be self explanatory. It fills in the star.
-				_fillTriangle(cx,cy,Xpoints_I[idx],Ypoints_I[idx],Xpoints_O[idx],Ypoints_O[idx], color);
-				_fillTriangle(cx,cy,Xpoints_O[idx],Ypoints_O[idx],Xpoints_I[idx+1],Ypoints_I[idx+1], color);
-			}
-			else {
-				_drawLine(Xpoints_O[idx],Ypoints_O[idx],Xpoints_I[idx+1],Ypoints_I[idx+1], color);
-				_drawLine(Xpoints_I[idx],Ypoints_I[idx],Xpoints_O[idx],Ypoints_O[idx], color);
-			}
-		}
-		else {
-			if(fill) {
-				_fillTriangle(cx,cy,Xpoints_I[0],Ypoints_I[0],Xpoints_O[idx],Ypoints_O[idx], color);
-				_fillTriangle(cx,cy,Xpoints_O[idx],Ypoints_O[idx],Xpoints_I[idx],Ypoints_I[idx], color);
-			}
-			else {
-				_drawLine(Xpoints_O[idx],Ypoints_O[idx],Xpoints_I[idx],Ypoints_I[idx], color);
-				_drawLine(Xpoints_I[0],Ypoints_I[0],Xpoints_O[idx],Ypoints_O[idx], color);
-			}
-		}
+	int sides = 5;
+	int rads = 360 / sides;
+
+	// outer and inner points alternate, the inner points are at the half angle between the outer ones
+	int Xpoints[sides*2], Ypoints[sides*2];
+
+	for (int idx = 0; idx < sides; idx++) {
+		Xpoints[idx*2] = cx + sin((float)(idx*rads + deg) * deg_to_rad) * diameter;
+		Ypoints[idx*2] = cy + cos((float)(idx*rads + deg) * deg_to_rad) * diameter;
+		Xpoints[idx*2+1] = cx + sin((float)(idx*rads + (rads/2) + deg) * deg_to_rad) * ((float)(diameter)/factor);
+		Ypoints[idx*2+1] = cy + cos((float)(idx*rads + (rads/2) + deg) * deg_to_rad) * ((float)(diameter)/factor);
+	}
+
+	if (f) _fillPolygon(Xpoints, Ypoints, sides*2, fill);
+
+	for (int idx = 0; idx < sides*2; idx++) {
+		if ((idx+1) < sides*2) _drawLine(Xpoints[idx],Ypoints[idx],Xpoints[idx+1],Ypoints[idx+1], color);
+		else _drawLine(Xpoints[idx],Ypoints[idx],Xpoints[0],Ypoints[0], color);
 	}
 }
-*/
 
 // ================ Font and string functions ==================================
 
@@ -1879,7 +1943,7 @@ static int printProportionalChar(int x, int y) {
 				}
 			}
 			// send to display in one transaction
-			if (tft_active_mode != TFT_MODE_EVE) wait_trans_finish(1);
+			if (tft_active_mode != TFT_MODE_EVE) tft_panel->wait_trans_finish(1);
 			TFT_EPD_disp_select();
 			TFT_EPD_send_data(x, y, x+char_width, y+cfont.y_size-1, len, color_line, 1);
 			TFT_EPD_disp_deselect();
@@ -1951,7 +2015,7 @@ static void printChar(uint8_t c, int x, int y) {
 				temp += (fz);
 			}
 			// send to display in one transaction
-			if (tft_active_mode != TFT_MODE_EVE) wait_trans_finish(1);
+			if (tft_active_mode != TFT_MODE_EVE) tft_panel->wait_trans_finish(1);
 			TFT_EPD_disp_select();
 			TFT_EPD_send_data(x, y, x+cfont.x_size-1, y+cfont.y_size-1, len, color_line, 1);
 			TFT_EPD_disp_deselect();
@@ -2545,12 +2609,22 @@ typedef struct {
     uint8_t		*membuff;		// memory buffer containing the image
     uint32_t	bufsize;		// size of the memory buffer
     uint32_t	bufptr;			// memory buffer current position
+    uint8_t		*inbuf;			// file read-ahead buffer
+    uint32_t	inbuf_len;		// number of bytes in the read-ahead buffer
+    uint32_t	inbuf_pos;		// read-ahead buffer current position
     color_t		*linbuf[2];		// memory buffer used for display output
     uint8_t		linbuf_idx;
+    uint32_t	linbuf_size;	// size of the output buffers in pixels
+    int			strip_x1;		// visible image columns, all MCUs of one MCU row are sent as one strip
+    int			strip_x2;
+    int			strip_top;		// display rows held in the current strip, -1 if empty
+    int			strip_bottom;
+    int64_t		t_send;			// time spent sending data to the display
 } JPGIODEV;
 
 
 // User defined call-back function to input JPEG data from file
+// The file is read in JPG_IMAGE_INPUT_BUF_SIZE chunks ahead of the decoder
 //---------------------
 static UINT tjd_input (
 	JDEC* jd,		// Decompression object
@@ -2558,18 +2632,42 @@ static UINT tjd_input (
 	UINT nd			// Number of bytes to read/skip from input stream
 )
 {
-	int rb = 0;
 	// Device identifier for the session (5th argument of jd_prepare function)
 	JPGIODEV *dev = (JPGIODEV*)jd->device;
 
-	if (buff) {	// Read nd bytes from the input strem
-		rb = fread(buff, 1, nd, dev->fhndl);
-		return rb;	// Returns actual number of bytes read
+	if (dev->inbuf == NULL) {
+		if (buff) {	// Read nd bytes from the input strem
+			return fread(buff, 1, nd, dev->fhndl);	// Returns actual number of bytes read
+		}
+		else {	// Remove nd bytes from the input stream
+			if (fseek(dev->fhndl, nd, SEEK_CUR) >= 0) return nd;
+			else return 0;
+		}
 	}
-	else {	// Remove nd bytes from the input stream
-		if (fseek(dev->fhndl, nd, SEEK_CUR) >= 0) return nd;
-		else return 0;
+
+	UINT done = 0;
+	while (done < nd) {
+		if (dev->inbuf_pos >= dev->inbuf_len) {
+			if ((buff == NULL) && ((nd - done) >= JPG_IMAGE_INPUT_BUF_SIZE)) {
+				// Skip whole chunks without reading them
+				uint32_t skip = ((nd - done) / JPG_IMAGE_INPUT_BUF_SIZE) * JPG_IMAGE_INPUT_BUF_SIZE;
+				if (fseek(dev->fhndl, skip, SEEK_CUR) < 0) break;
+				done += skip;
+				continue;
+			}
+			dev->inbuf_len = fread(dev->inbuf, 1, JPG_IMAGE_INPUT_BUF_SIZE, dev->fhndl);
+			dev->inbuf_pos = 0;
+			if (dev->inbuf_len == 0) break;	// end of file
+		}
+		uint32_t n = dev->inbuf_len - dev->inbuf_pos;
+		if (n > (nd - done)) n = nd - done;
+		if (buff) {
+			memcpy(buff + done, dev->inbuf + dev->inbuf_pos, n);
+		}
+		dev->inbuf_pos += n;
+		done += n;
 	}
+	return done;
 }
 
 // User defined call-back function to input JPEG data from memory buffer
@@ -2598,6 +2696,36 @@ static UINT tjd_buf_input (
 	}
 }
 
+// Send the display window (x1,y1),(x2,y2) from the current output buffer, switch to the other buffer
+//-------------------------------------------------------------------------
+static void tjd_send(JPGIODEV *dev, int x1, int y1, int x2, int y2, uint32_t len)
+{
+	int64_t t = esp_timer_get_time();
+    if (image_trans) {
+        tft_panel->wait_trans_finish(1);
+        tft_panel->send_data(x1, y1, x2, y2, len, dev->linbuf[dev->linbuf_idx], 0);
+    }
+    else {
+        tft_panel->select();
+        tft_panel->send_data(x1, y1, x2, y2, len, dev->linbuf[dev->linbuf_idx], 0);
+        tft_panel->wait_trans_finish(1);
+        tft_panel->deselect();
+    }
+    dev->linbuf_idx = ((dev->linbuf_idx + 1) & 1);
+    dev->t_send += esp_timer_get_time() - t;
+}
+
+// Send the collected MCU row strip to the display
+//------------------------------------------
+static void tjd_flush_strip(JPGIODEV *dev)
+{
+	if (dev->strip_top < 0) return;
+
+	uint32_t len = (dev->strip_x2 - dev->strip_x1 + 1) * (dev->strip_bottom - dev->strip_top + 1);
+	tjd_send(dev, dev->strip_x1, dev->strip_top, dev->strip_x2, dev->strip_bottom, len);
+	dev->strip_top = -1;
+}
+
 // User defined call-back function to output RGB bitmap to display device
 //----------------------
 static UINT tjd_output (
@@ -2658,6 +2786,32 @@ static UINT tjd_output (
                 }
 	        }
 	    }
+	    else if (dev->strip_x2 >= dev->strip_x1) {
+	        // Copy the MCU into the strip of the current MCU row
+            if (dtop != dev->strip_top) {
+                tjd_flush_strip(dev);
+                dev->strip_top = dtop;
+                dev->strip_bottom = dbottom;
+            }
+            int strip_w = dev->strip_x2 - dev->strip_x1 + 1;
+            for (y = top; y <= bottom; y++) {
+                if ((y < dtop) || (y > dbottom)) {
+                    src += (right - left + 1) * 3;
+                    continue;
+                }
+                uint8_t *dest = (uint8_t *)(dev->linbuf[dev->linbuf_idx] + ((y - dtop) * strip_w) + (dleft - dev->strip_x1));
+                for (x = left; x <= right; x++) {
+                    if ((x >= dleft) && (x <= dright)) {
+                        *dest++ = (*src++) & 0xFC;
+                        *dest++ = (*src++) & 0xFC;
+                        *dest++ = (*src++) & 0xFC;
+                    }
+                    else src += 3; // skip
+                }
+            }
+            // Last visible MCU of the row, send the whole strip
+            if (dright >= dev->strip_x2) tjd_flush_strip(dev);
+	    }
 	    else {
             uint8_t *dest = (uint8_t *)(dev->linbuf[dev->linbuf_idx]);
 
@@ -2672,21 +2826,11 @@ static UINT tjd_output (
                     else src += 3; // skip
                 }
             }
-            if (image_trans) {
-                wait_trans_finish(1);
-                send_data(dleft, dtop, dright, dbottom, len, dev->linbuf[dev->linbuf_idx], 0);
-            }
-            else {
-                disp_select();
-                send_data(dleft, dtop, dright, dbottom, len, dev->linbuf[dev->linbuf_idx], 0);
-                wait_trans_finish(1);
-                disp_deselect();
-            }
-            dev->linbuf_idx = ((dev->linbuf_idx + 1) & 1);
+            tjd_send(dev, dleft, dtop, dright, dbottom, len);
 	    }
 	}
 	else {
-		if (image_trans) wait_trans_finish(1);
+		if (image_trans) tft_panel->wait_trans_finish(1);
 		mp_printf(&mp_plat_print, "Data size error: %d jpg: (%d,%d,%d,%d) disp: (%d,%d,%d,%d)\r\n", len, left,top,right,bottom, dleft,dtop,dright,dbottom);
 		return 0;  // stop decompression
 	}
@@ -2705,10 +2849,20 @@ void TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int s
 	UINT sz_work = 3800;	// Size of the working buffer (must be power of 2)
 	JDEC jd;				// Decompression object (70 bytes)
 	JRESULT rc;
+	int64_t t_start = esp_timer_get_time();
 
 	dev.linbuf[0] = NULL;
 	dev.linbuf[1] = NULL;
     dev.linbuf_idx = 0;
+    dev.linbuf_size = 0;
+    dev.inbuf = NULL;
+    dev.inbuf_len = 0;
+    dev.inbuf_pos = 0;
+    dev.strip_x1 = 0;
+    dev.strip_x2 = -1;
+    dev.strip_top = -1;
+    dev.strip_bottom = -1;
+    dev.t_send = 0;
 
    	dev.fhndl = NULL;
     if (fname == NULL) {
@@ -2733,6 +2887,8 @@ void TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int s
         	if (image_debug) mp_printf(&mp_plat_print, "Error opening file: %s\r\n", strerror(errno));
             goto exit;
         }
+        // read-ahead buffer, the file is read directly if not available
+        dev.inbuf = malloc(JPG_IMAGE_INPUT_BUF_SIZE);
     }
 
     // Check if the image file is on sdcard
@@ -2760,30 +2916,62 @@ void TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int s
 			dev.y = y;
 
 			if (tft_active_mode != TFT_MODE_EPD) {
-                dev.linbuf[0] = malloc(JPG_IMAGE_LINE_BUF_SIZE*3);
-                if (dev.linbuf[0] == NULL) {
-                    if (image_debug) mp_printf(&mp_plat_print, "Error allocating line buffer #0\r\n");
-                    goto exit;
-                }
-                dev.linbuf[1] = malloc(JPG_IMAGE_LINE_BUF_SIZE*3);
-                if (dev.linbuf[1] == NULL) {
-                    if (image_debug) mp_printf(&mp_plat_print, "Error allocating line buffer #1\r\n");
-                    goto exit;
-                }
+				// Try to get the buffers for whole MCU row strips of the visible image part,
+				// fall back to sending each MCU separately
+				int strip_x1 = (x < dispWin.x1) ? dispWin.x1 : x;
+				int strip_x2 = x + (int)(jd.width >> scale) - 1;
+				if (strip_x2 > dispWin.x2) strip_x2 = dispWin.x2;
+				int mcu_h = (jd.msy * 8) >> scale;
+				if (mcu_h < 1) mcu_h = 1;
+				uint32_t strip_size = (strip_x2 >= strip_x1) ? (strip_x2 - strip_x1 + 1) * mcu_h : 0;
+				if (strip_size > JPG_IMAGE_LINE_BUF_SIZE) {
+					dev.linbuf[0] = malloc(strip_size*3);
+					dev.linbuf[1] = malloc(strip_size*3);
+					if ((dev.linbuf[0]) && (dev.linbuf[1])) {
+						dev.linbuf_size = strip_size;
+						dev.strip_x1 = strip_x1;
+						dev.strip_x2 = strip_x2;
+					}
+					else {
+						if (dev.linbuf[0]) free(dev.linbuf[0]);
+						if (dev.linbuf[1]) free(dev.linbuf[1]);
+						dev.linbuf[0] = NULL;
+						dev.linbuf[1] = NULL;
+					}
+				}
+				if (dev.linbuf_size == 0) {
+					dev.linbuf[0] = malloc(JPG_IMAGE_LINE_BUF_SIZE*3);
+					if (dev.linbuf[0] == NULL) {
+						if (image_debug) mp_printf(&mp_plat_print, "Error allocating line buffer #0\r\n");
+						goto exit;
+					}
+					dev.linbuf[1] = malloc(JPG_IMAGE_LINE_BUF_SIZE*3);
+					if (dev.linbuf[1] == NULL) {
+						if (image_debug) mp_printf(&mp_plat_print, "Error allocating line buffer #1\r\n");
+						goto exit;
+					}
+					dev.linbuf_size = JPG_IMAGE_LINE_BUF_SIZE;
+				}
 			}
 
 			// Start to decode the JPEG file
 			if (image_trans) TFT_EPD_disp_select();
 			rc = jd_decomp(&jd, tjd_output, scale);
+			if (rc == JDR_OK) tjd_flush_strip(&dev);
 			if (image_trans) {
-				wait_trans_finish(1);
-				disp_deselect();
+				tft_panel->wait_trans_finish(1);
+				tft_panel->deselect();
 			}
 
 			if (rc != JDR_OK) {
 				if (image_debug) mp_printf(&mp_plat_print, "jpg decompression error %d\r\n", rc);
 			}
-			if (image_debug) mp_printf(&mp_plat_print, "Jpg size: %dx%d, position; %d,%d, scale: %d, bytes used: %d\r\n", jd.width, jd.height, x, y, scale, jd.sz_pool);
+			if (image_debug) {
+				int t_total = (int)((esp_timer_get_time() - t_start) / 1000);
+				int t_send = (int)(dev.t_send / 1000);
+				mp_printf(&mp_plat_print, "Jpg size: %dx%d, position; %d,%d, scale: %d, bytes used: %d\r\n", jd.width, jd.height, x, y, scale, jd.sz_pool);
+				mp_printf(&mp_plat_print, "Jpg time: decode %d ms, transfer %d ms (%s)\r\n", t_total - t_send, t_send, (dev.strip_x2 >= dev.strip_x1) ? "MCU row strips" : "MCU blocks");
+			}
 			image_width = jd.width;
 			image_hight = jd.height;
 		}
@@ -2799,10 +2987,71 @@ exit:
 	if (work) free(work);  // free work buffer
 	if (dev.linbuf[0]) free(dev.linbuf[0]);
 	if (dev.linbuf[1]) free(dev.linbuf[1]);
+	if (dev.inbuf) free(dev.inbuf);
     if (dev.fhndl) fclose(dev.fhndl);  // close input file
 }
 
+// ================ BMP SUPPORT ================================================
+
+// Convert 'n' pixels of the BMP image row 'src', starting at pixel 'sx', to display RGB-888
+//----------------------------------------------------------------------------------------------------------------
+static void bmp_convert_row(const uint8_t *src, int bpp, const color_t *pal, uint8_t rgb565, int sx, int n, uint8_t *dst)
+{
+	int i;
+
+	if (bpp == 24) {
+		src += sx * 3;
+		for (i = 0; i < n; i++, src += 3, dst += 3) {
+			dst[0] = src[2] & 0xFC;
+			dst[1] = src[1] & 0xFC;
+			dst[2] = src[0] & 0xFC;
+		}
+	}
+	else if (bpp == 32) {
+		src += sx * 4;
+		for (i = 0; i < n; i++, src += 4, dst += 3) {
+			dst[0] = src[2] & 0xFC;
+			dst[1] = src[1] & 0xFC;
+			dst[2] = src[0] & 0xFC;
+		}
+	}
+	else if (bpp == 16) {
+		uint16_t v;
+		src += sx * 2;
+		if (rgb565) {
+			for (i = 0; i < n; i++, src += 2, dst += 3) {
+				v = src[0] | (src[1] << 8);
+				dst[0] = (v >> 8) & 0xF8;
+				dst[1] = (v >> 3) & 0xFC;
+				dst[2] = (v << 3) & 0xF8;
+			}
+		}
+		else {
+			for (i = 0; i < n; i++, src += 2, dst += 3) {
+				v = src[0] | (src[1] << 8);
+				dst[0] = (v >> 7) & 0xF8;
+				dst[1] = (v >> 2) & 0xF8;
+				dst[2] = (v << 3) & 0xF8;
+			}
+		}
+	}
+	else if (bpp == 8) {
+		src += sx;
+		for (i = 0; i < n; i++, dst += 3) *(color_t *)dst = pal[*src++];
+	}
+	else {
+		// 4 or 1 bit palette index, first pixel in the most significant bits
+		int ppb = 8 / bpp;
+		uint8_t mask = (1 << bpp) - 1;
+		for (i = 0; i < n; i++, sx++, dst += 3) {
+			*(color_t *)dst = pal[(src[sx / ppb] >> ((ppb - 1 - (sx % ppb)) * bpp)) & mask];
+		}
+	}
+}
 
+// Displays uncompressed 1, 4, 8 (palette), 16, 24 and 32 bit BMP images, bottom-up or top-down.
+// Only the visible image rows are read, BMP_IMAGE_READ_BUF_SIZE bytes with one fread,
+// the visible part of each row is converted directly into the display line buffer.
 //====================================================================================
 int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int size)
 {
@@ -2810,19 +3059,24 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	struct stat sb;
 	int i, err=0;
 	int img_xsize, img_ysize, img_xstart, img_xlen, img_ystart, img_ylen;
-	int img_pos, img_pix_pos, scan_lines, rd_len;
-	uint8_t tmpc;
-	uint16_t wtemp;
-	uint32_t temp;
+	int img_pos, row_size, rd_rows, nrows, disp_row, disp_step;
+	int top_down = 0;
+	uint16_t wtemp, bpp;
+	uint32_t temp, hdr_size, compression, ncolors;
 	int disp_xstart, disp_xend, disp_ystart, disp_yend;
-	uint8_t buf[56];
+	uint8_t buf[66];
 	char err_buf[64];
 	uint8_t *line_buf[2] = {NULL,NULL};
 	uint8_t lb_idx = 0;
-	uint8_t *scale_buf = NULL;
+	uint8_t *rd_buf = NULL;			// image rows read from file
+	uint8_t *conv_buf = NULL;		// converted image row, used when scaling
+	uint16_t *acc_buf = NULL;		// color sums, used when scaling
+	color_t *pal = NULL;			// color palette, 1~8 bits per pixel images
+	const uint8_t *row = NULL;
+	int rows_in_buf = 0;
+	uint8_t rgb565 = 0;
 	uint8_t scale_pix;
-	uint16_t co[3] = {0,0,0};			// RGB sum
-	uint8_t npix;
+	int64_t t_start = esp_timer_get_time();
 
 	if (scale > 7) scale = 7;
 	scale_pix = scale+1;	// scale factor ( 1~8 )
@@ -2842,13 +3096,13 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 			goto exit;
 		}
 
-		i = fread(buf, 1, 54, fhndl);  // read header
+		i = fread(buf, 1, sizeof(buf), fhndl);  // read header and bit masks
     }
     else {
     	// * Reading image from buffer
     	if ((imgbuf) && (size > 54)) {
-    		memcpy(buf, imgbuf, 54);
-    		i = 54;
+    		i = (size < (int)sizeof(buf)) ? size : (int)sizeof(buf);
+    		memcpy(buf, imgbuf, i);
     	}
     	else i = 0;
     }
@@ -2857,7 +3111,7 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
     image_trans = file_noton_spi_sdcard(fname);
 
     sprintf(err_buf, "reading header");
-	if (i != 54) {err = -3;	goto exit;}
+	if (i < 54) {err = -3;	goto exit;}
 
 	// ** Check image header and get image properties
 	if ((buf[0] != 'B') || (buf[1] != 'M')) {err=-4; goto exit;} // accept only images with 'BM' id
@@ -2867,21 +3121,72 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 
 	memcpy(&img_pos, buf+10, 4);			// start of pixel data
 
-	memcpy(&temp, buf+14, 4);				// BMP header size
-	if (temp != 40) {err=-6; goto exit;}
+	memcpy(&hdr_size, buf+14, 4);			// BMP header size, 40 or larger (V4, V5)
+	if (hdr_size < 40) {err=-6; goto exit;}
 
 	memcpy(&wtemp, buf+26, 2);				// the number of color planes
 	if (wtemp != 1) {err=-7; goto exit;}
 
-	memcpy(&wtemp, buf+28, 2);				// the number of bits per pixel
-	if (wtemp != 24) {err=-8; goto exit;}
-
-	memcpy(&temp, buf+30, 4);				// the compression method being used
-	if (temp != 0) {err=-9; goto exit;}
+	memcpy(&bpp, buf+28, 2);				// the number of bits per pixel
+	if ((bpp != 1) && (bpp != 4) && (bpp != 8) && (bpp != 16) && (bpp != 24) && (bpp != 32)) {err=-8; goto exit;}
+
+	memcpy(&compression, buf+30, 4);		// the compression method being used
+	if (compression == 3) {
+		// BI_BITFIELDS, only the standard 16 and 32-bit color masks are accepted
+		uint32_t rmask = 0, gmask = 0, bmask = 0;
+		if (i >= 66) {
+			memcpy(&rmask, buf+54, 4);
+			memcpy(&gmask, buf+58, 4);
+			memcpy(&bmask, buf+62, 4);
+		}
+		if ((bpp == 16) && (rmask == 0xF800) && (gmask == 0x07E0) && (bmask == 0x001F)) rgb565 = 1;
+		else if ((bpp == 16) && (rmask == 0x7C00) && (gmask == 0x03E0) && (bmask == 0x001F)) rgb565 = 0;
+		else if ((bpp != 32) || (rmask != 0x00FF0000) || (gmask != 0x0000FF00) || (bmask != 0x000000FF)) {err=-9; goto exit;}
+	}
+	else if (compression != 0) {err=-9; goto exit;}
 
 	memcpy(&img_xsize, buf+18, 4);			// the bitmap width in pixels
-	memcpy(&img_ysize, buf+22, 4);			// the bitmap height in pixels
-
+	memcpy(&img_ysize, buf+22, 4);			// the bitmap height in pixels, negative for top-down image
+	if (img_ysize < 0) {
+		img_ysize = -img_ysize;
+		top_down = 1;
+	}
+	row_size = (((img_xsize * bpp) + 31) / 32) * 4;	// image rows are padded to 4 bytes
+
+	if (bpp <= 8) {
+		// ** Read the color palette, it follows the header
+		memcpy(&ncolors, buf+46, 4);
+		if ((ncolors == 0) || (ncolors > (1 << bpp))) ncolors = 1 << bpp;
+		pal = calloc(256, sizeof(color_t));
+		uint8_t *pal_buf = malloc(ncolors * 4);
+		if ((pal == NULL) || (pal_buf == NULL)) {
+			if (pal_buf) free(pal_buf);
+			sprintf(err_buf, "allocating palette");
+			err = -12;
+			goto exit;
+		}
+		i = 0;
+		if (fhndl) {
+			if (fseek(fhndl, 14 + hdr_size, SEEK_SET) == 0) i = fread(pal_buf, 1, ncolors * 4, fhndl);
+		}
+		else if ((14 + hdr_size + (ncolors * 4)) <= size) {
+			memcpy(pal_buf, imgbuf + 14 + hdr_size, ncolors * 4);
+			i = ncolors * 4;
+		}
+		if (i == (ncolors * 4)) {
+			for (temp = 0; temp < ncolors; temp++) {
+				pal[temp].r = pal_buf[(temp*4)+2] & 0xFC;
+				pal[temp].g = pal_buf[(temp*4)+1] & 0xFC;
+				pal[temp].b = pal_buf[temp*4] & 0xFC;
+			}
+		}
+		free(pal_buf);
+		if (i != (ncolors * 4)) {
+			sprintf(err_buf, "reading palette");
+			err = -3;
+			goto exit;
+		}
+	}
 
 	// * scale image dimensions
 
@@ -2903,8 +3208,8 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	// ** set display and image areas
 	if (x < dispWin.x1) {
 		disp_xstart = dispWin.x1;
-		img_xstart = -x;	// image pixel line X offset
-		img_xlen += x;
+		img_xstart = dispWin.x1 - x;	// first displayed column (scaled)
+		img_xlen -= img_xstart;
 	}
 	else {
 		disp_xstart = x;
@@ -2912,8 +3217,8 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	}
 	if (y < dispWin.y1) {
 		disp_ystart = dispWin.y1;
-		img_ystart = -y;	// image pixel line Y offset
-		img_ylen += y;
+		img_ystart = dispWin.y1 - y;	// first displayed row from the image top (scaled)
+		img_ylen -= img_ystart;
 	}
 	else {
 		disp_ystart = y;
@@ -2930,21 +3235,40 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 		img_ylen = disp_yend - disp_ystart + 1;
 	}
 
-	if ((img_xlen < 8) || (img_ylen < 8) || (img_xstart >= (img_xsize-2)) || ((img_ysize - img_ystart) < 2)) {
+	if ((img_xlen < 8) || (img_ylen < 8)) {
 		sprintf(err_buf, "image too small");
 		err = -11;
 		goto exit;
 	}
 
-	// ** Allocate memory for 2 lines of image pixels
-	line_buf[0] = malloc(img_xsize*3);
+	// ** Only the displayed image rows are read, in file order.
+	// ** Bottom-up images are stored from LAST to FIRST row and are drawn from the bottom display line up.
+	nrows = img_ylen * scale_pix;
+	if (top_down) {
+		img_pos += (img_ystart * scale_pix) * row_size;
+		disp_row = disp_ystart;
+		disp_step = 1;
+	}
+	else {
+		img_pos += (img_ysize - ((img_ystart + img_ylen) * scale_pix)) * row_size;
+		disp_row = disp_yend;
+		disp_step = -1;
+	}
+	if ((img_pos + (nrows * row_size)) > size) {
+		sprintf(err_buf, "EOF reached: %d > %d", img_pos + (nrows * row_size), size);
+		err = -16;
+		goto exit;
+	}
+
+	// ** Allocate memory for 2 display lines
+	line_buf[0] = malloc(img_xlen*3);
 	if (line_buf[0] == NULL) {
 	    sprintf(err_buf, "allocating line buffer #1");
 		err=-12;
 		goto exit;
 	}
 
-	line_buf[1] = malloc(img_xsize*3);
+	line_buf[1] = malloc(img_xlen*3);
 	if (line_buf[1] == NULL) {
 	    sprintf(err_buf, "allocating line buffer #2");
 		err=-13;
@@ -2952,36 +3276,32 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 	}
 
 	if (scale) {
-		// Allocate memory for scale buffer
-		rd_len = img_xlen * 3 * scale_pix;
-		scale_buf = malloc(rd_len*scale_pix);
-		if (scale_buf == NULL) {
+		// Allocate memory for the converted image row and the color sums
+		conv_buf = malloc(img_xlen * scale_pix * 3);
+		acc_buf = malloc(img_xlen * 3 * sizeof(uint16_t));
+		if ((conv_buf == NULL) || (acc_buf == NULL)) {
 			sprintf(err_buf, "allocating scale buffer");
 			err=-14;
 			goto exit;
 		}
 	}
-	else rd_len = img_xlen * 3;
-
-	// ** ***************************************************** **
-	// ** BMP images are stored in file from LAST to FIRST line **
-	// ** ***************************************************** **
 
-	/* Used variables:
-		img_xsize		horizontal image size in pixels
-		img_ysize		number of image lines
-		img_xlen 		image display horizontal scaled size in pixels
-		img_ylen		image display vertical scaled size in pixels
-		img_xstart		first pixel in line to be displayed
-		img_ystart		first image line to be displayed
-		img_xlen		number of pixels in image line to be displayed, starting with 'img_xstart'
-		img_ylen		number of lines in image to be displayed, starting with 'img_ystart'
-		rd_len			length of color data which are read from image line in bytes
-	 */
-
-	// Set position in image to the first color data (beginning of the LAST line)
-	img_pos += (img_ystart * (img_xsize*3));
+	rd_rows = 0;
 	if (fhndl) {
+		// Read buffer for as many rows as fit into BMP_IMAGE_READ_BUF_SIZE, at least one
+		rd_rows = BMP_IMAGE_READ_BUF_SIZE / row_size;
+		if (rd_rows > nrows) rd_rows = nrows;
+		if (rd_rows < 1) rd_rows = 1;
+		rd_buf = malloc(rd_rows * row_size);
+		if ((rd_buf == NULL) && (rd_rows > 1)) {
+			rd_rows = 1;
+			rd_buf = malloc(row_size);
+		}
+		if (rd_buf == NULL) {
+			sprintf(err_buf, "allocating read buffer");
+			err=-14;
+			goto exit;
+		}
 		if (fseek(fhndl, img_pos, SEEK_SET) != 0) {
 			sprintf(err_buf, "file seek at %d", img_pos);
 			err = -15;
@@ -2989,104 +3309,77 @@ int TFT_bmp_image(int x, int y, uint8_t scale, char *fname, uint8_t *imgbuf, int
 		}
 	}
 
-	if (image_debug) mp_printf(&mp_plat_print, "BMP: image size: (%d,%d) scale: %d disp size: (%d,%d) img xofs: %d img yofs: %d at: %d,%d; line buf: 2* %d scale buf: %d\r\n",
-			img_xsize, img_ysize, scale_pix, img_xlen, img_ylen, img_xstart, img_ystart, disp_xstart, disp_ystart, img_xsize*3, ((scale) ? (rd_len*scale_pix) : 0));
+	if (image_debug) mp_printf(&mp_plat_print, "BMP: image size: (%d,%d) %d bpp%s scale: %d disp size: (%d,%d) img xofs: %d img yofs: %d at: %d,%d; read buf: %d rows\r\n",
+			img_xsize, img_ysize, bpp, (top_down) ? " top-down" : "", scale_pix, img_xlen, img_ylen, img_xstart, img_ystart, disp_xstart, disp_ystart, rd_rows);
 	image_width = img_xlen;
 	image_hight = img_ylen;
 	// * Select the display
-	if (image_trans) disp_select();
-
-	while ((disp_yend >= disp_ystart) && ((img_pos + (img_xsize*3)) <= size)) {
-		if (img_pos > size) {
-			sprintf(err_buf, "EOF reached: %d > %d", img_pos, size);
-			err = -16;
-			goto exit1;
-		}
-		if (scale == 0) {
-			// Read the line of color data into color buffer
-			if (fhndl) {
-				i = fread(line_buf[lb_idx], 1, img_xsize*3, fhndl);  // read line from file
-				if (i != (img_xsize*3)) {
-					sprintf(err_buf, "file read at %d (%d<>%d)", img_pos, i, img_xsize*3);
+	if (image_trans) tft_panel->select();
+
+	for (int n = 0; n < nrows; n++) {
+		// * Get the next image row
+		if (fhndl) {
+			if (rows_in_buf == 0) {
+				int rd = ((nrows - n) < rd_rows) ? (nrows - n) : rd_rows;
+				i = fread(rd_buf, 1, rd * row_size, fhndl);
+				if (i != (rd * row_size)) {
+					sprintf(err_buf, "file read at %d (%d<>%d)", img_pos + (n * row_size), i, rd * row_size);
 					err = -16;
 					goto exit1;
 				}
+				rows_in_buf = rd;
+				row = rd_buf;
 			}
-			else memcpy(line_buf[lb_idx], imgbuf+img_pos, img_xsize*3);
-
-			if (img_xstart > 0)	memmove(line_buf[lb_idx], line_buf[lb_idx]+(img_xstart*3), rd_len);
-			// Convert colors BGR-888 (BMP) -> RGB-888 (DISPLAY) ===
-			for (i=0; i < rd_len; i += 3) {
-				tmpc = line_buf[lb_idx][i+2] & 0xfc;				// save R
-				line_buf[lb_idx][i+2] = line_buf[lb_idx][i] & 0xfc;	// B -> R
-				line_buf[lb_idx][i] = tmpc;							// R -> B
-				line_buf[lb_idx][i+1] &= 0xfc;						// G
-			}
-			img_pos += (img_xsize*3);
+			else row += row_size;
+			rows_in_buf--;
+		}
+		else row = imgbuf + img_pos + (n * row_size);
+
+		if (scale == 0) {
+			bmp_convert_row(row, bpp, pal, rgb565, img_xstart, img_xlen, line_buf[lb_idx]);
 		}
 		else {
-			// scale image, read 'scale_pix' lines and find the average color
-			for (scan_lines=0; scan_lines<scale_pix; scan_lines++) {
-				if (img_pos > size) break;
-				if (fhndl) {
-					i = fread(line_buf[lb_idx], 1, img_xsize*3, fhndl);  // read line from file
-					if (i != (img_xsize*3)) {
-						sprintf(err_buf, "file read at %d (%d<>%d)", img_pos, i, img_xsize*3);
-						err = -17;
-						goto exit1;
-					}
+			// sum the colors of 'scale_pix' x 'scale_pix' rectangles, send the average
+			bmp_convert_row(row, bpp, pal, rgb565, img_xstart * scale_pix, img_xlen * scale_pix, conv_buf);
+			if ((n % scale_pix) == 0) memset(acc_buf, 0, img_xlen * 3 * sizeof(uint16_t));
+			uint8_t *src = conv_buf;
+			for (int c = 0; c < (img_xlen*3); c += 3) {
+				for (int p = 0; p < scale_pix; p++, src += 3) {
+					acc_buf[c] += src[0];
+					acc_buf[c+1] += src[1];
+					acc_buf[c+2] += src[2];
 				}
-				else memcpy(line_buf[lb_idx], imgbuf+img_pos, img_xsize*3);
-				img_pos += (img_xsize*3);
-
-				// copy only data which are displayed to scale buffer
-				memcpy(scale_buf + (rd_len * scan_lines), line_buf[lb_idx]+img_xstart, rd_len);
 			}
+			if ((n % scale_pix) != (scale_pix - 1)) continue;
 
-			// Populate display line buffer
-			for (int n=0;n<(img_xlen*3);n += 3) {
-				memset(co, 0, sizeof(co));	// initialize color sum
-				npix = 0;					// initialize number of pixels in scale rectangle
-
-				// sum all pixels in scale rectangle
-				for (int sc_line=0; sc_line<scan_lines; sc_line++) {
-					// Get colors position in scale buffer
-					img_pix_pos = (rd_len * sc_line) + (n * scale_pix);
-
-					for (int sc_col=0; sc_col<scale_pix; sc_col++) {
-						co[0] += scale_buf[img_pix_pos];
-						co[1] += scale_buf[img_pix_pos + 1];
-						co[2] += scale_buf[img_pix_pos + 2];
-						npix++;
-					}
-				}
-				// Place the average in display buffer, convert BGR-888 (BMP) -> RGB-888 (DISPLAY)
-				line_buf[lb_idx][n+2] = (uint8_t)(co[0] / npix);	// B
-				line_buf[lb_idx][n+1] = (uint8_t)(co[1] / npix);	// G
-				line_buf[lb_idx][n] = (uint8_t)(co[2] / npix);		// R
-			}
+			int npix = scale_pix * scale_pix;
+			for (int c = 0; c < (img_xlen*3); c++) line_buf[lb_idx][c] = (uint8_t)(acc_buf[c] / npix) & 0xFC;
 		}
 
 		if (image_trans) {
-			wait_trans_finish(1);
-			send_data(disp_xstart, disp_yend, disp_xend, disp_yend, img_xlen, (color_t *)line_buf[lb_idx], 0);
+			tft_panel->wait_trans_finish(1);
+			tft_panel->send_data(disp_xstart, disp_row, disp_xend, disp_row, img_xlen, (color_t *)line_buf[lb_idx], 0);
 		}
 		else {
-			disp_select();
-			send_data(disp_xstart, disp_yend, disp_xend, disp_yend, img_xlen, (color_t *)line_buf[lb_idx], 0);
-			wait_trans_finish(1);
-			disp_deselect();
+			tft_panel->select();
+			tft_panel->send_data(disp_xstart, disp_row, disp_xend, disp_row, img_xlen, (color_t *)line_buf[lb_idx], 0);
+			tft_panel->wait_trans_finish(1);
+			tft_panel->deselect();
 		}
 		lb_idx = (lb_idx + 1) & 1;  // change buffer
 
-		disp_yend--;
+		disp_row += disp_step;
 	}
-	wait_trans_finish(1);
+	tft_panel->wait_trans_finish(1);
 	err = 0;
+	if (image_debug) mp_printf(&mp_plat_print, "BMP: time %d ms\r\n", (int)((esp_timer_get_time() - t_start) / 1000));
 exit1:
-	if (image_trans) disp_deselect();
+	if (image_trans) tft_panel->deselect();
 exit:
-	if (scale_buf) free(scale_buf);
+	if (rd_buf) free(rd_buf);
+	if (conv_buf) free(conv_buf);
+	if (acc_buf) free(acc_buf);
+	if (pal) free(pal);
 	if (line_buf[0]) free(line_buf[0]);
 	if (line_buf[1]) free(line_buf[1]);
 	if (fhndl) fclose(fhndl);
@@ -3095,7 +3388,6 @@ exit:
 	return err;
 }
 
-
 // ============= Touch panel functions =========================================
 
 //-------------------------------------------------------
@@ -95,6 +95,7 @@ extern uint8_t   font_now;
 extern dispWin_t dispWin;			// display clip window
 extern float	  _angleOffset;		// angle offset for arc, polygon and line by angle functions
 extern uint8_t	  image_debug;		// print debug messages during image decode if set to 1
+extern uint8_t	  tft_antialias;	// if not 0 blend the edges of filled arcs, ellipses and polygons with '_bg'
 
 extern Font cfont;					// Current font structure
 
@@ -120,6 +121,12 @@ extern tft_eve_obj_t *eve_tft_obj;
 // The size must be multiple of 256 bytes !!
 #define JPG_IMAGE_LINE_BUF_SIZE 512
 
+// Size of the read-ahead buffer used when decoding jpeg images from file
+#define JPG_IMAGE_INPUT_BUF_SIZE 4096
+
+// Size of the buffer used to read multiple bmp image rows from file
+#define BMP_IMAGE_READ_BUF_SIZE 8192
+
 // --- Constants for ellipse function ---
 #define TFT_ELLIPSE_UPPER_RIGHT 0x01
 #define TFT_ELLIPSE_UPPER_LEFT  0x02
@@ -497,8 +504,20 @@ void TFT_drawArc(uint16_t cx, uint16_t cy, uint16_t r, uint16_t th, float start,
 void TFT_drawPolygon(int cx, int cy, int sides, int diameter, color_t color, color_t fill, int deg, uint8_t th);
 
 
-//--------------------------------------------------------------------------------------
-//void TFT_drawStar(int cx, int cy, int diameter, color_t color, bool fill, float factor);
+/*
+ * Draw five pointed star on screen
+ *
+ * Params:
+ *        cx: star center X position
+ *        cy: star center Y position
+ *  diameter: diameter of the circle on which the outer points are placed
+ *     color: star outline color
+ *      fill: star fill color; if same as color, star is not filled
+ *       deg: star rotation angle; 0 ~ 360
+ *    factor: ratio of the outer and inner points diameter; 1.0 ~ 4.0
+*/
+//-------------------------------------------------------------------------------------------------------
+void TFT_drawStar(int cx, int cy, int diameter, color_t color, color_t fill, int deg, float factor);
 
 
 /*
@@ -705,7 +724,7 @@ void TFT_jpg_image(int x, int y, uint8_t scale, char *fname, uint8_t *buf, int s
 
 /*
  * Decodes and displays BMP image
- * Only uncompressed RGB 24-bit with no color space information BMP images can be displayed
+ * Only uncompressed 1, 4, 8 (palette), 16, 24 and 32-bit BMP images can be displayed
  *
  * Params:
  *       x: image left position; constants CENTER & RIGHT can be used; negative value is accepted
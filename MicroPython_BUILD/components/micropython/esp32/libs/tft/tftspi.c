@@ -68,6 +68,19 @@ exspi_device_handle_t *disp_spi = NULL;
 exspi_device_handle_t *ts_spi = NULL;
 
 uint8_t bits_per_color = 16;
+
+// Default panel backend, display on 'disp_spi'
+const tft_panel_t tft_spi_panel = {
+	.select = disp_select,
+	.deselect = disp_deselect,
+	.wait_trans_finish = wait_trans_finish,
+	.drawPixel = drawPixel,
+	.send_data = send_data,
+	.pushColorRep = TFT_pushColorRep,
+	.read_data = read_data,
+};
+const tft_panel_t *tft_panel = &tft_spi_panel;
+
 uint8_t TFT_RGB_BGR = 0;
 uint8_t gamma_curve = 0;
 uint32_t spi_speed = 10000000;
@@ -571,7 +584,7 @@ color_t readPixel(int16_t x, int16_t y)
 {
     uint8_t color_buf[sizeof(color_t)+1] = {0};
 
-    read_data(x, y, x+1, y+1, 1, color_buf, 1);
+    tft_panel->read_data(x, y, x+1, y+1, 1, color_buf, 1);
 
     color_t color;
 	color.r = color_buf[1];
@@ -1287,5 +1300,70 @@ esp_err_t TFT_display_init(display_config_t *dconfig)
     return ESP_OK;
 }
 
-#endif // CONFIG_MICROPY_USE_TFT
+//============================================
+void TFT_setPanel(const tft_panel_t *panel)
+{
+	tft_panel = (panel) ? panel : &tft_spi_panel;
+}
+
+// ==== Counting panel backend ====
+
+tft_panel_stats_t tft_panel_stats = {0};
+
+//========================================================================================================
+void TFT_countTransfer(tft_panel_stats_t *stats, int x1, int y1, int x2, int y2, uint32_t pixels, uint8_t bpc)
+{
+	stats->transactions++;
+	stats->pixels += pixels;
+	// CASET + 4 bytes, PASET + 4 bytes, RAMWR/RAMRD command
+	stats->bytes += 11 + ((pixels * bpc) / 8);
+	if ((stats->windows == 0) || (x1 != stats->win[0]) || (y1 != stats->win[1]) || (x2 != stats->win[2]) || (y2 != stats->win[3])) {
+		stats->windows++;
+		stats->win[0] = x1;
+		stats->win[1] = y1;
+		stats->win[2] = x2;
+		stats->win[3] = y2;
+	}
+}
+
+//----------------------------------------------------------------------------
+static void stats_drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel)
+{
+	TFT_countTransfer(&tft_panel_stats, x, y, x+1, y+1, 1, bits_per_color);
+	drawPixel(x, y, color, sel);
+}
 
+//-----------------------------------------------------------------------------------------------
+static void stats_send_data(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf, uint8_t wait)
+{
+	TFT_countTransfer(&tft_panel_stats, x1, y1, x2, y2, len, bits_per_color);
+	send_data(x1, y1, x2, y2, len, buf, wait);
+}
+
+//---------------------------------------------------------------------------------------
+static void stats_pushColorRep(int x1, int y1, int x2, int y2, color_t color, uint32_t len)
+{
+	TFT_countTransfer(&tft_panel_stats, x1, y1, x2, y2, len, bits_per_color);
+	TFT_pushColorRep(x1, y1, x2, y2, color, len);
+}
+
+//----------------------------------------------------------------------------------------------
+static int stats_read_data(int x1, int y1, int x2, int y2, int len, uint8_t *buf, uint8_t set_sp)
+{
+	// the pixels are always read as 24-bit colors
+	TFT_countTransfer(&tft_panel_stats, x1, y1, x2, y2, len, 24);
+	return read_data(x1, y1, x2, y2, len, buf, set_sp);
+}
+
+// 'tft_spi_panel' counting the pixel data transfers in 'tft_panel_stats'
+const tft_panel_t tft_spi_stats_panel = {
+	.select = disp_select,
+	.deselect = disp_deselect,
+	.wait_trans_finish = wait_trans_finish,
+	.drawPixel = stats_drawPixel,
+	.send_data = stats_send_data,
+	.pushColorRep = stats_pushColorRep,
+	.read_data = stats_read_data,
+};
+
+#endif // CONFIG_MICROPY_USE_TFT
@@ -594,6 +594,44 @@ esp_err_t disp_deselect();
 //======================
 esp_err_t disp_select();
 
+// ==== Panel backend ====
+// Pixel data path used by the drawing functions in tft.c.
+// The default backend, 'tft_spi_panel', drives the display on 'disp_spi' using
+// the low level functions above. An alternative backend (e.g. in-memory frame buffer)
+// can be installed with TFT_setPanel(); display commands are always sent over SPI.
+typedef struct {
+	esp_err_t (*select)();
+	esp_err_t (*deselect)();
+	esp_err_t (*wait_trans_finish)(uint8_t free_line);
+	void (*drawPixel)(int16_t x, int16_t y, color_t color, uint8_t sel);
+	void (*send_data)(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf, uint8_t wait);
+	void (*pushColorRep)(int x1, int y1, int x2, int y2, color_t color, uint32_t len);
+	int (*read_data)(int x1, int y1, int x2, int y2, int len, uint8_t *buf, uint8_t set_sp);
+} tft_panel_t;
+
+extern const tft_panel_t tft_spi_panel;
+extern const tft_panel_t *tft_panel;	// currently used panel backend
+
+// Install the panel backend, NULL restores the default SPI backend
+//============================================
+void TFT_setPanel(const tft_panel_t *panel);
+
+// Pixel data transfer counters
+typedef struct {
+	uint32_t transactions;	// drawPixel, send_data, pushColorRep and read_data calls
+	uint32_t windows;		// address window changes
+	uint32_t pixels;		// pixels written or read
+	uint32_t bytes;			// bytes transferred, address window commands included
+	int		 win[4];		// last address window
+} tft_panel_stats_t;
+
+extern tft_panel_stats_t tft_panel_stats;
+extern const tft_panel_t tft_spi_stats_panel;	// 'tft_spi_panel' counting the transfers in 'tft_panel_stats'
+
+// Count one transfer of 'pixels' pixels, 'bpc' bits each, to/from the window (x1,y1),(x2,y2)
+//========================================================================================================
+void TFT_countTransfer(tft_panel_stats_t *stats, int x1, int y1, int x2, int y2, uint32_t pixels, uint8_t bpc);
+
 
 // Find maximum spi clock for successful read from display RAM
 // ** Must be used AFTER the display is initialized **
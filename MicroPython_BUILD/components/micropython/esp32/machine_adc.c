@@ -214,6 +214,7 @@ static void adc_task(void *pvParameters)
         // reading to file, close file and free the buffer
         fclose(self->fhndl);
         self->fhndl = NULL;
+        native_vfs_file_changed();
         if (buff8) free(buff8);
         if (buff16) free(buff16);
     }
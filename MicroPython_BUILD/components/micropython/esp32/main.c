@@ -161,6 +161,9 @@ void mp_task(void *pvParameter)
     mp_obj_list_init(mp_sys_argv, 0);
 
     readline_init0();
+    #ifdef CONFIG_MICROPY_USE_DNS_CACHE
+    MP_STATE_PORT(dns_async_head) = NULL;
+    #endif
 
 	// Initialize peripherals
     machine_pins_init();
@@ -41,6 +41,8 @@
 
 #include "py/obj.h"
 #include "py/runtime.h"
+#include "py/objlist.h"
+#include "py/mphal.h"
 #include "modmachine.h"
 #include "modnetwork.h"
 #include "libs/espcurl.h"
@@ -632,6 +634,402 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(curl_FTP_LIST_obj, 3, curl_FTP_LIST);
 #endif
 
 
+// ==== Multi transfer engine ====
+// Transfers run concurrently in the curl multi task, the open connections are reused.
+// The finished transfer's callback is scheduled with the Transfer object as argument.
+
+typedef struct _curl_Multi_obj_t {
+	mp_obj_base_t base;
+	curl_multi_t *engine;
+	mp_obj_t xfers;			// list of unfinished transfers, keeps them and their buffers alive
+} curl_Multi_obj_t;
+
+typedef struct _curl_Transfer_obj_t {
+	mp_obj_base_t base;
+	curl_xfer_t *xfer;
+	mp_obj_t buf;			// application's buffer
+	mp_obj_t callback;
+} curl_Transfer_obj_t;
+
+static const mp_obj_type_t curl_Multi_type;
+static const mp_obj_type_t curl_Transfer_type;
+
+// Called from the multi task
+//-------------------------------------------------
+static void transfer_done_cb(curl_xfer_t *xfer)
+{
+	curl_Transfer_obj_t *self = (curl_Transfer_obj_t *)xfer->arg;
+	if (self->callback != mp_const_none) mp_sched_schedule(self->callback, MP_OBJ_FROM_PTR(self), NULL);
+}
+
+// Remove the transfers no longer owned by the multi task from the multi's list
+//---------------------------------------------------
+static void multi_prune(curl_Multi_obj_t *self)
+{
+	mp_obj_list_t *list = MP_OBJ_TO_PTR(self->xfers);
+	size_t n = 0;
+	for (size_t i=0; i<list->len; i++) {
+		curl_Transfer_obj_t *t = MP_OBJ_TO_PTR(list->items[i]);
+		if (t->xfer->queued) list->items[n++] = list->items[i];
+	}
+	for (size_t i=n; i<list->len; i++) list->items[i] = MP_OBJ_NULL;
+	list->len = n;
+}
+
+//-----------------------------------------------------------------------------------------------------------------------------
+static mp_obj_t multi_add(curl_Multi_obj_t *self, uint8_t type, const char *url, char *user_pass, mp_obj_t file, mp_obj_t buf, mp_obj_t callback)
+{
+	char fullname[128] = {'\0'};
+	char *fname = NULL;
+	char *bufptr = NULL;
+	int buf_size = body_maxlen;
+	int err = 0;
+
+	if (self->engine == NULL) {
+		nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Multi is closed"));
+	}
+	if ((callback != mp_const_none) && (!mp_obj_is_callable(callback))) {
+		mp_raise_ValueError("callback must be a function");
+	}
+	if (MP_OBJ_IS_STR(file)) {
+		int res = physicalPath(mp_obj_str_get_str(file), fullname);
+		if ((res != 0) || (strlen(fullname) == 0)) {
+			nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error resolving file name"));
+		}
+		fname = fullname;
+	}
+	else if (type == CURL_XFER_FTP_PUT) {
+		nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Expected file name for PUT command"));
+	}
+	else if (buf != mp_const_none) {
+		// receive directly to the application's buffer
+		mp_buffer_info_t bufinfo;
+		mp_get_buffer_raise(buf, &bufinfo, MP_BUFFER_WRITE);
+		bufptr = bufinfo.buf;
+		buf_size = bufinfo.len;
+	}
+
+	curl_Transfer_obj_t *t = m_new_obj_with_finaliser(curl_Transfer_obj_t);
+	t->base.type = &curl_Transfer_type;
+	t->xfer = NULL;
+	t->buf = buf;
+	t->callback = callback;
+
+	curl_xfer_t *xfer = Curl_xfer_new(type, (char *)url, user_pass, fname, bufptr, buf_size, hdr_maxlen, &err);
+	if (xfer == NULL) {
+		nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "Error creating transfer (%d)", err));
+	}
+	t->xfer = xfer;
+	xfer->done_cb = transfer_done_cb;
+	xfer->arg = t;
+
+	if (Curl_multi_add(self->engine, xfer) != 0) {
+		Curl_xfer_free(xfer);
+		t->xfer = NULL;
+		nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error adding transfer"));
+	}
+	// only the transfers owned by the multi task are kept in the list
+	multi_prune(self);
+	mp_obj_list_append(self->xfers, MP_OBJ_FROM_PTR(t));
+	return MP_OBJ_FROM_PTR(t);
+}
+
+// Wait until the transfer is finished, scheduled callbacks are executed while waiting
+//------------------------------------------------------------------
+static bool transfer_wait(curl_xfer_t *xfer, volatile int *pending, int timeout)
+{
+	uint64_t start = mp_hal_ticks_ms();
+	while (1) {
+		if (((xfer) && (xfer->ready) && (!xfer->queued)) || ((pending) && (*pending == 0))) {
+			// run the callbacks scheduled by the finished transfers
+			mp_handle_pending();
+			return true;
+		}
+		if ((timeout >= 0) && ((mp_hal_ticks_ms() - start) >= timeout)) return false;
+		MICROPY_EVENT_POLL_HOOK
+	}
+}
+
+//------------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t curl_Multi_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    enum { ARG_maxconn, ARG_maxhost };
+	const mp_arg_t allowed_args[] = {
+		{ MP_QSTR_maxconn, MP_ARG_INT, { .u_int = 4 } },
+		{ MP_QSTR_maxhost, MP_ARG_INT, { .u_int = 2 } },
+	};
+	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+	mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	if ((args[ARG_maxconn].u_int < 1) || (args[ARG_maxconn].u_int > 16) || (args[ARG_maxhost].u_int < 1)) {
+		mp_raise_ValueError("maxconn must be 1~16, maxhost >= 1");
+	}
+
+	curl_Multi_obj_t *self = m_new_obj_with_finaliser(curl_Multi_obj_t);
+	self->base.type = &curl_Multi_type;
+	self->xfers = mp_obj_new_list(0, NULL);
+	self->engine = Curl_multi_new(args[ARG_maxconn].u_int, args[ARG_maxhost].u_int);
+	if (self->engine == NULL) {
+		nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error creating curl multi handle"));
+	}
+	return MP_OBJ_FROM_PTR(self);
+}
+
+//----------------------------------------------------------------------------------------------
+STATIC void curl_Multi_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+	curl_Multi_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (self->engine == NULL) mp_printf(print, "Multi(closed)");
+	else mp_printf(print, "Multi(active=%d, transfers=%u, connects=%u)", self->engine->pending, self->engine->n_transfers, self->engine->n_connects);
+}
+
+//-------------------------------------------------------------------------------------------
+STATIC mp_obj_t curl_Multi_get(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+	network_checkConnection();
+    enum { ARG_url, ARG_file, ARG_buf, ARG_callback };
+	const mp_arg_t allowed_args[] = {
+        { MP_QSTR_url,      MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_file,                       MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_buf,      MP_ARG_KW_ONLY  | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_callback, MP_ARG_KW_ONLY  | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+	const char *url = mp_obj_str_get_str(args[ARG_url].u_obj);
+	return multi_add(MP_OBJ_TO_PTR(pos_args[0]), CURL_XFER_GET, url, NULL, args[ARG_file].u_obj, args[ARG_buf].u_obj, args[ARG_callback].u_obj);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(curl_Multi_get_obj, 2, curl_Multi_get);
+
+#ifdef CONFIG_MICROPY_USE_CURLFTP
+
+//---------------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t curl_Multi_ftp_helper(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args, uint8_t type)
+{
+	network_checkConnection();
+    enum { ARG_url, ARG_user, ARG_pass, ARG_file, ARG_buf, ARG_callback };
+	const mp_arg_t allowed_args[] = {
+        { MP_QSTR_url,  	MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_user, 	MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_password,	MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_file,                       MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_buf,      MP_ARG_KW_ONLY  | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_callback, MP_ARG_KW_ONLY  | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    const char *url = mp_obj_str_get_str(args[ARG_url].u_obj);
+    const char *user = mp_obj_str_get_str(args[ARG_user].u_obj);
+    const char *pass = mp_obj_str_get_str(args[ARG_pass].u_obj);
+    char userpass[64];
+
+	if (strstr(url, "ftp://") != url) {
+		nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "URL must start with 'ftp://'"));
+	}
+	snprintf(userpass, sizeof(userpass), "%s:%s", user, pass);
+
+	return multi_add(MP_OBJ_TO_PTR(pos_args[0]), type, url, userpass, args[ARG_file].u_obj, args[ARG_buf].u_obj, args[ARG_callback].u_obj);
+}
+
+//-----------------------------------------------------------------------------------------------
+STATIC mp_obj_t curl_Multi_ftp_get(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+	return curl_Multi_ftp_helper(n_args, pos_args, kw_args, CURL_XFER_FTP_GET);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(curl_Multi_ftp_get_obj, 4, curl_Multi_ftp_get);
+
+//-----------------------------------------------------------------------------------------------
+STATIC mp_obj_t curl_Multi_ftp_put(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+	return curl_Multi_ftp_helper(n_args, pos_args, kw_args, CURL_XFER_FTP_PUT);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(curl_Multi_ftp_put_obj, 4, curl_Multi_ftp_put);
+
+//------------------------------------------------------------------------------------------------
+STATIC mp_obj_t curl_Multi_ftp_list(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+	return curl_Multi_ftp_helper(n_args, pos_args, kw_args, CURL_XFER_FTP_LIST);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(curl_Multi_ftp_list_obj, 4, curl_Multi_ftp_list);
+
+#endif
+
+// Wait for all transfers to finish, returns False on timeout
+//-----------------------------------------------------------------
+STATIC mp_obj_t curl_Multi_wait(size_t n_args, const mp_obj_t *args)
+{
+	curl_Multi_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+	int timeout = (n_args > 1) ? mp_obj_get_int(args[1]) : -1;
+
+	if (self->engine == NULL) return mp_const_true;
+	bool res = transfer_wait(NULL, &self->engine->pending, timeout);
+	multi_prune(self);
+	return mp_obj_new_bool(res);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(curl_Multi_wait_obj, 1, 2, curl_Multi_wait);
+
+// Returns (transfers, new connections, active transfers)
+//------------------------------------------------
+STATIC mp_obj_t curl_Multi_stats(mp_obj_t self_in)
+{
+	curl_Multi_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	mp_obj_t tuple[3];
+
+	if (self->engine == NULL) {
+		nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Multi is closed"));
+	}
+	tuple[0] = mp_obj_new_int_from_uint(self->engine->n_transfers);
+	tuple[1] = mp_obj_new_int_from_uint(self->engine->n_connects);
+	tuple[2] = mp_obj_new_int(self->engine->pending);
+	return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(curl_Multi_stats_obj, curl_Multi_stats);
+
+// Abort the unfinished transfers and close all connections
+//------------------------------------------------
+STATIC mp_obj_t curl_Multi_close(mp_obj_t self_in)
+{
+	curl_Multi_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+	if (self->engine) {
+		MP_THREAD_GIL_EXIT();
+		Curl_multi_stop(self->engine, true);
+		MP_THREAD_GIL_ENTER();
+		self->engine = NULL;
+		multi_prune(self);
+	}
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(curl_Multi_close_obj, curl_Multi_close);
+
+// Finaliser, runs from the GC: the multi task is only signaled to stop, it is not waited for
+//----------------------------------------------
+STATIC mp_obj_t curl_Multi_del(mp_obj_t self_in)
+{
+	curl_Multi_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+	if (self->engine) Curl_multi_stop(self->engine, false);
+	self->engine = NULL;
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(curl_Multi_del_obj, curl_Multi_del);
+
+//-------------------------------------------------------------------
+STATIC mp_obj_t curl_Multi_exit(size_t n_args, const mp_obj_t *args)
+{
+	return curl_Multi_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(curl_Multi_exit_obj, 4, 4, curl_Multi_exit);
+
+//===========================================================
+STATIC const mp_rom_map_elem_t curl_Multi_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_get),			MP_ROM_PTR(&curl_Multi_get_obj) },
+	#ifdef CONFIG_MICROPY_USE_CURLFTP
+    { MP_ROM_QSTR(MP_QSTR_ftp_get),		MP_ROM_PTR(&curl_Multi_ftp_get_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ftp_put),		MP_ROM_PTR(&curl_Multi_ftp_put_obj) },
+    { MP_ROM_QSTR(MP_QSTR_ftp_list),	MP_ROM_PTR(&curl_Multi_ftp_list_obj) },
+	#endif
+    { MP_ROM_QSTR(MP_QSTR_wait),		MP_ROM_PTR(&curl_Multi_wait_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats),		MP_ROM_PTR(&curl_Multi_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close),		MP_ROM_PTR(&curl_Multi_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__),		MP_ROM_PTR(&curl_Multi_del_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__),	MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__),	MP_ROM_PTR(&curl_Multi_exit_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(curl_Multi_locals_dict, curl_Multi_locals_dict_table);
+
+//=============================================
+static const mp_obj_type_t curl_Multi_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Multi,
+    .print = curl_Multi_print,
+    .make_new = curl_Multi_make_new,
+    .locals_dict = (mp_obj_dict_t*)&curl_Multi_locals_dict,
+};
+
+//-------------------------------------------------------------------------------------------------
+STATIC void curl_Transfer_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+	curl_Transfer_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	curl_xfer_t *xfer = self->xfer;
+	if (xfer->ready) mp_printf(print, "Transfer(done, result=%d, status=%d, length=%u)", xfer->result, (int)xfer->status, xfer->len);
+	else mp_printf(print, "Transfer(running, length=%u)", xfer->len);
+}
+
+//------------------------------------------------------
+STATIC mp_obj_t curl_Transfer_done(mp_obj_t self_in)
+{
+	curl_Transfer_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	return mp_obj_new_bool(self->xfer->ready);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(curl_Transfer_done_obj, curl_Transfer_done);
+
+// Wait for the transfer to finish, returns False on timeout
+//--------------------------------------------------------------------
+STATIC mp_obj_t curl_Transfer_wait(size_t n_args, const mp_obj_t *args)
+{
+	curl_Transfer_obj_t *self = MP_OBJ_TO_PTR(args[0]);
+	int timeout = (n_args > 1) ? mp_obj_get_int(args[1]) : -1;
+	return mp_obj_new_bool(transfer_wait(self->xfer, NULL, timeout));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(curl_Transfer_wait_obj, 1, 2, curl_Transfer_wait);
+
+// Returns None if not finished, or (res, status, header, body)
+//   res: 0 on success, curl error code on error, the error message is returned as body
+//  body: received data; if received to the file or the application's buffer, number of bytes
+//--------------------------------------------------------
+STATIC mp_obj_t curl_Transfer_result(mp_obj_t self_in)
+{
+	curl_Transfer_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	curl_xfer_t *xfer = self->xfer;
+	mp_obj_t tuple[4];
+
+	if (!xfer->ready) return mp_const_none;
+
+	tuple[0] = mp_obj_new_int(xfer->result);
+	tuple[1] = mp_obj_new_int(xfer->status);
+	tuple[2] = (xfer->hdr) ? mp_obj_new_str(xfer->hdr, xfer->hdr_len) : MP_OBJ_NEW_QSTR(MP_QSTR_);
+	if (xfer->result != CURLE_OK) {
+		const char *msg = curl_easy_strerror(xfer->result);
+		tuple[3] = mp_obj_new_str(msg, strlen(msg));
+	}
+	else if (xfer->own_buf) tuple[3] = mp_obj_new_bytes((const byte *)xfer->buf, xfer->len);
+	else tuple[3] = mp_obj_new_int_from_uint(xfer->len);
+
+	return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(curl_Transfer_result_obj, curl_Transfer_result);
+
+//-----------------------------------------------------
+STATIC mp_obj_t curl_Transfer_del(mp_obj_t self_in)
+{
+	curl_Transfer_obj_t *self = MP_OBJ_TO_PTR(self_in);
+	if (self->xfer) Curl_xfer_free(self->xfer);
+	self->xfer = NULL;
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(curl_Transfer_del_obj, curl_Transfer_del);
+
+//==============================================================
+STATIC const mp_rom_map_elem_t curl_Transfer_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_done),		MP_ROM_PTR(&curl_Transfer_done_obj) },
+    { MP_ROM_QSTR(MP_QSTR_wait),		MP_ROM_PTR(&curl_Transfer_wait_obj) },
+    { MP_ROM_QSTR(MP_QSTR_result),		MP_ROM_PTR(&curl_Transfer_result_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__),		MP_ROM_PTR(&curl_Transfer_del_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(curl_Transfer_locals_dict, curl_Transfer_locals_dict_table);
+
+//================================================
+static const mp_obj_type_t curl_Transfer_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Transfer,
+    .print = curl_Transfer_print,
+    .locals_dict = (mp_obj_dict_t*)&curl_Transfer_locals_dict,
+};
+
+
 //============================================================
 STATIC const mp_rom_map_elem_t curl_module_globals_table[] = {
 	{ MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_curl) },
@@ -642,6 +1040,7 @@ STATIC const mp_rom_map_elem_t curl_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_post),		MP_ROM_PTR(&curl_POST_obj) },
     { MP_ROM_QSTR(MP_QSTR_sendmail),	MP_ROM_PTR(&curl_sendmail_obj) },
     { MP_ROM_QSTR(MP_QSTR_getmail),     MP_ROM_PTR(&curl_GET_MAIL_obj) },
+    { MP_ROM_QSTR(MP_QSTR_Multi),		MP_ROM_PTR(&curl_Multi_type) },
 
 	#ifdef CONFIG_MICROPY_USE_CURLFTP
     { MP_ROM_QSTR(MP_QSTR_ftp_get),		MP_ROM_PTR(&curl_FTP_GET_obj) },
@@ -713,6 +713,40 @@ STATIC mp_obj_t display_tft_drawPoly(size_t n_args, const mp_obj_t *pos_args, mp
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(display_tft_drawPoly_obj, 5, display_tft_drawPoly);
 
+//------------------------------------------------------------------------------------------------
+STATIC mp_obj_t display_tft_drawStar(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_x,      MP_ARG_REQUIRED | MP_ARG_INT, { .u_int = 0 } },
+        { MP_QSTR_y,      MP_ARG_REQUIRED | MP_ARG_INT, { .u_int = 0 } },
+        { MP_QSTR_r,      MP_ARG_REQUIRED | MP_ARG_INT, { .u_int = 0 } },
+        { MP_QSTR_color,                    MP_ARG_INT, { .u_int = -1 } },
+        { MP_QSTR_fillcolor,                MP_ARG_INT, { .u_int = -1 } },
+        { MP_QSTR_rotate,                   MP_ARG_INT, { .u_int = 0 } },
+        { MP_QSTR_factor,                   MP_ARG_OBJ, { .u_obj = mp_const_none } },
+    };
+    display_tft_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
+    if (setupDevice(self)) return mp_const_none;
+
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    color_t color = _fg;
+    color_t fill_color = _fg;
+    float factor = 2.0;
+    if (args[3].u_int >= 0) {
+    	color = intToColor(args[3].u_int);
+    }
+    if (args[4].u_int >= 0) {
+    	fill_color = intToColor(args[4].u_int);
+    }
+    if (args[6].u_obj != mp_const_none) factor = mp_obj_get_float(args[6].u_obj);
+    TFT_drawStar(args[0].u_int, args[1].u_int, args[2].u_int, color, fill_color, args[5].u_int, factor);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(display_tft_drawStar_obj, 4, display_tft_drawStar);
+
 //------------------------------------------------------------------------------------------------
 STATIC mp_obj_t display_tft_drawRect(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
@@ -808,7 +842,7 @@ STATIC mp_obj_t display_tft_readScreen(size_t n_args, const mp_obj_t *pos_args,
     }
     memset(buf, 0, buf_len);
 
-    esp_err_t ret = read_data(x, y, x+w+1, y+h+1, (uint32_t)clr_len, buf, 1);
+    esp_err_t ret = tft_panel->read_data(x, y, x+w+1, y+h+1, (uint32_t)clr_len, buf, 1);
 
     if (ret == ESP_OK) {
         if (args[4].u_obj == mp_const_none) return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
@@ -1889,6 +1923,36 @@ STATIC mp_obj_t display_tft_set_fg(mp_obj_t self_in, mp_obj_t color_in)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(display_tft_set_fg_obj, display_tft_set_fg);
 
+//-----------------------------------------------------------------------------
+STATIC mp_obj_t display_tft_antialias(size_t n_args, const mp_obj_t *args)
+{
+    if (n_args > 1) tft_antialias = (uint8_t)mp_obj_is_true(args[1]);
+    return mp_obj_new_bool(tft_antialias);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(display_tft_antialias_obj, 1, 2, display_tft_antialias);
+
+// Count the pixel data transfers to the display
+// panelstats(True) resets the counters and starts counting, panelstats(False) stops it
+// Returns the tuple (transactions, address_windows, pixels, bytes)
+//-----------------------------------------------------------------------------
+STATIC mp_obj_t display_tft_panelstats(size_t n_args, const mp_obj_t *args)
+{
+    if (n_args > 1) {
+        if (mp_obj_is_true(args[1])) {
+            memset(&tft_panel_stats, 0, sizeof(tft_panel_stats_t));
+            TFT_setPanel(&tft_spi_stats_panel);
+        }
+        else TFT_setPanel(NULL);
+    }
+    mp_obj_t tuple[4];
+    tuple[0] = mp_obj_new_int_from_uint(tft_panel_stats.transactions);
+    tuple[1] = mp_obj_new_int_from_uint(tft_panel_stats.windows);
+    tuple[2] = mp_obj_new_int_from_uint(tft_panel_stats.pixels);
+    tuple[3] = mp_obj_new_int_from_uint(tft_panel_stats.bytes);
+    return mp_obj_new_tuple(4, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(display_tft_panelstats_obj, 1, 2, display_tft_panelstats);
+
 //-------------------------------------------------
 STATIC mp_obj_t display_tft_get_X(mp_obj_t self_in)
 {
@@ -1920,6 +1984,7 @@ STATIC const mp_rom_map_elem_t display_tft_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_ellipse),				MP_ROM_PTR(&display_tft_drawEllipse_obj) },
     { MP_ROM_QSTR(MP_QSTR_arc),					MP_ROM_PTR(&display_tft_drawArc_obj) },
     { MP_ROM_QSTR(MP_QSTR_polygon),				MP_ROM_PTR(&display_tft_drawPoly_obj) },
+    { MP_ROM_QSTR(MP_QSTR_star),				MP_ROM_PTR(&display_tft_drawStar_obj) },
     { MP_ROM_QSTR(MP_QSTR_rect),				MP_ROM_PTR(&display_tft_drawRect_obj) },
     { MP_ROM_QSTR(MP_QSTR_readScreen),			MP_ROM_PTR(&display_tft_readScreen_obj) },
     { MP_ROM_QSTR(MP_QSTR_roundrect),			MP_ROM_PTR(&display_tft_drawRoundRect_obj) },
@@ -1948,6 +2013,8 @@ STATIC const mp_rom_map_elem_t display_tft_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_get_bg),				MP_ROM_PTR(&display_tft_get_bg_obj) },
     { MP_ROM_QSTR(MP_QSTR_set_fg),				MP_ROM_PTR(&display_tft_set_fg_obj) },
     { MP_ROM_QSTR(MP_QSTR_set_bg),				MP_ROM_PTR(&display_tft_set_bg_obj) },
+    { MP_ROM_QSTR(MP_QSTR_antialias),			MP_ROM_PTR(&display_tft_antialias_obj) },
+    { MP_ROM_QSTR(MP_QSTR_panelstats),			MP_ROM_PTR(&display_tft_panelstats_obj) },
     { MP_ROM_QSTR(MP_QSTR_text_x),				MP_ROM_PTR(&display_tft_get_X_obj) },
     { MP_ROM_QSTR(MP_QSTR_text_y),				MP_ROM_PTR(&display_tft_get_Y_obj) },
     { MP_ROM_QSTR(MP_QSTR_setColor),            MP_ROM_PTR(&display_tft_setColor_obj) },
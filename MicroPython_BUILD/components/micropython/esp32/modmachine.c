@@ -293,6 +293,11 @@ static void RTC_IRAM_ATTR wake_stub()
 //---------------------------------------------
 void prepareSleepReset(uint8_t hrst, char *msg)
 {
+    #ifdef CONFIG_MICROPY_USE_DNS_CACHE
+    // Cancel the pending getaddrinfo_async lookups
+    socket_dns_deinit();
+    #endif
+
     // Umount external & internal fs
     externalUmount();
     internalUmount();
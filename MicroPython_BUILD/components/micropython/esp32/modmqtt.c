@@ -40,6 +40,7 @@
 #include <string.h>
 
 #include "mqtt_client.h"
+#include "mqtt_trie.h"
 #include "http_parser.h"
 
 #include "py/nlr.h"
@@ -61,6 +62,9 @@ typedef struct _mqtt_obj_t {
     void *mpy_unsubscribed_cb;
     void *mpy_published_cb;
     void *mpy_data_cb;
+    mqtt_trie_handle_t trie;            // subscription filters with their callbacks
+    SemaphoreHandle_t trie_mutex;
+    mp_obj_t subs;                      // dict filter: callback, keeps the callbacks referenced for gc
     uint8_t *msgbuf;
     uint8_t *topicbuf;
     char *certbuf;
@@ -156,11 +160,64 @@ STATIC void published_cb(mqtt_obj_t *self, const char *topic, int type)
     }
 }
 
+//---------------------------------------------------------------------------------------------------------------------------
+STATIC void schedule_data_cb(mqtt_obj_t *self, void *cb, const char *topic, int topic_len, const uint8_t *data, int data_len)
+{
+	mp_sched_carg_t *carg = make_cargs(MP_SCHED_CTYPE_TUPLE);
+	if (!carg) return;
+	if (!make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_STR, strlen(self->name), (const uint8_t *)self->name, NULL)) return;
+	if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, topic_len, (const uint8_t *)topic, NULL)) return;
+	if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_STR, data_len, data, NULL)) return;
+	mp_sched_schedule(cb, mp_const_none, carg);
+}
+
+typedef struct _mqtt_match_t {
+    mqtt_obj_t *self;
+    const char *topic;
+    int topic_len;
+    const uint8_t *data;
+    int data_len;
+} mqtt_match_t;
+
+// Called from mqtt_trie_match for every subscription filter matching the topic
+//--------------------------------------------
+STATIC void trie_match_cb(void *cb, void *arg)
+{
+    mqtt_match_t *match = (mqtt_match_t *)arg;
+    schedule_data_cb(match->self, cb, match->topic, match->topic_len, match->data, match->data_len);
+}
+
+// Returns true if the message on the topic will be delivered to some callback
+//-------------------------------------------------------------------------
+STATIC bool has_data_cb(mqtt_obj_t *self, const char *topic, int topic_len)
+{
+    int n = 0;
+    if (self->trie) {
+        xSemaphoreTake(self->trie_mutex, portMAX_DELAY);
+        n = mqtt_trie_match(self->trie, topic, topic_len, NULL, NULL);
+        xSemaphoreGive(self->trie_mutex);
+    }
+    return ((n > 0) || (self->mpy_data_cb != NULL));
+}
+
+// Schedule the callbacks of all subscriptions matching the topic,
+// the general data callback is used if no subscription callback matches
+//-------------------------------------------------------------------------------------------------------------
+STATIC void deliver_data(mqtt_obj_t *self, const char *topic, int topic_len, const uint8_t *data, int data_len)
+{
+    int n = 0;
+    if (self->trie) {
+        mqtt_match_t match = { self, topic, topic_len, data, data_len };
+        xSemaphoreTake(self->trie_mutex, portMAX_DELAY);
+        n = mqtt_trie_match(self->trie, topic, topic_len, trie_match_cb, &match);
+        xSemaphoreGive(self->trie_mutex);
+    }
+    if ((n == 0) && (self->mpy_data_cb)) schedule_data_cb(self, self->mpy_data_cb, topic, topic_len, data, data_len);
+}
+
 //-------------------------------------------------
 STATIC void data_cb(mqtt_obj_t *self, void *params)
 {
-    if (!self->mpy_data_cb) return;
-
     esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)params;
 
 	if (event->current_data_offset == 0) {
@@ -169,6 +226,9 @@ STATIC void data_cb(mqtt_obj_t *self, void *params)
 		if (self->topicbuf != NULL) free(self->topicbuf);
 		self->msgbuf = NULL;
 		self->topicbuf = NULL;
+		// drop the message if there is no callback for it, before anything is allocated
+		if (!has_data_cb(self, event->topic, event->topic_len)) return;
+
 		if (event->data_len < event->total_data_len) {
 			// === more data will follow, allocate the data buffer and copy the first part ===
 			self->topicbuf = malloc(event->topic_len + 1);
@@ -191,12 +251,7 @@ STATIC void data_cb(mqtt_obj_t *self, void *params)
 		}
 		else {
 			// === all data received, we can schedule the callback function now ===
-			mp_sched_carg_t *carg = make_cargs(MP_SCHED_CTYPE_TUPLE);
-			if (!carg) return;
-			if (!make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_STR, strlen(self->name), (const uint8_t *)self->name, NULL)) return;
-			if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, event->topic_len, (const uint8_t *)event->topic, NULL)) return;
-			if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_STR, event->data_len, (const uint8_t *)event->data, NULL)) return;
-			mp_sched_schedule(self->mpy_data_cb, mp_const_none, carg);
+			deliver_data(self, event->topic, event->topic_len, (const uint8_t *)event->data, event->data_len);
 		}
 	}
 	else {
@@ -207,13 +262,7 @@ STATIC void data_cb(mqtt_obj_t *self, void *params)
 			self->msgbuf[new_len] = 0;
 			if (new_len >= event->total_data_len) {
 				// === all data received, we can schedule the callback function now ===
-				mp_sched_carg_t *carg = make_cargs(MP_SCHED_CTYPE_TUPLE);
-				if (!carg) goto freebufs;
-				if (!make_carg_entry(carg, 0, MP_SCHED_ENTRY_TYPE_STR, strlen(self->name), (const uint8_t *)self->name, NULL)) goto freebufs;
-				if (!make_carg_entry(carg, 1, MP_SCHED_ENTRY_TYPE_STR, strlen((const char *)self->topicbuf), self->topicbuf, NULL)) goto freebufs;
-				if (!make_carg_entry(carg, 2, MP_SCHED_ENTRY_TYPE_STR, event->total_data_len, self->msgbuf, NULL)) goto freebufs;
-				mp_sched_schedule(self->mpy_data_cb, mp_const_none, carg);
-freebufs:
+				deliver_data(self, (const char *)self->topicbuf, strlen((const char *)self->topicbuf), self->msgbuf, event->total_data_len);
 				// Free the buffers
 				free(self->msgbuf);
 				free(self->topicbuf);
@@ -282,7 +331,7 @@ static esp_err_t mqtt_event_handler(esp_mqtt_event_handle_t event)
         	mpy_client->publish_flag = 1;
             break;
         case MQTT_EVENT_DATA:
-        	if (mpy_client->mpy_data_cb == NULL) {
+        	if ((mpy_client->mpy_data_cb == NULL) && ((mpy_client->trie == NULL) || (mqtt_trie_count(mpy_client->trie) == 0))) {
         		ESP_LOGI(MQTT_TAG, "TOPIC: %.*s\r\n", event->topic_len, event->topic);
         		ESP_LOGI(MQTT_TAG, " DATA: %.*s\r\n", event->data_len, event->data);
         	}
@@ -344,7 +393,7 @@ STATIC void mqtt_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_
 STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
 {
 	enum { ARG_name, ARG_server, ARG_user, ARG_pass, ARG_port, ARG_reconnect, ARG_clientid, ARG_cleansess, ARG_keepalive, ARG_cert,
-		ARG_lwt_topic, ARG_lwt_msg, ARG_lwt_qos, ARG_lwt_retain, ARG_datacb, ARG_connected, ARG_disconnected, ARG_subscribed, ARG_unsubscribed, ARG_published };
+		ARG_lwt_topic, ARG_lwt_msg, ARG_lwt_qos, ARG_lwt_retain, ARG_datacb, ARG_connected, ARG_disconnected, ARG_subscribed, ARG_unsubscribed, ARG_published, ARG_inflight };
 
     const mp_arg_t mqtt_init_allowed_args[] = {
 			{ MP_QSTR_name,   	    	MP_ARG_REQUIRED | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
@@ -367,6 +416,7 @@ STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
 			{ MP_QSTR_subscribed_cb,  	MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
 			{ MP_QSTR_unsubscribed_cb, 	MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
 			{ MP_QSTR_published_cb,		MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_inflight,			MP_ARG_KW_ONLY  | MP_ARG_INT,  {.u_int = 0} },
 	};
 	mp_arg_val_t args[MP_ARRAY_SIZE(mqtt_init_allowed_args)];
 	mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(mqtt_init_allowed_args), mqtt_init_allowed_args, args);
@@ -435,6 +485,8 @@ STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
     mqtt_cfg.disable_auto_reconnect = args[ARG_reconnect].u_int ? false : true;
     mqtt_cfg.keepalive = args[ARG_keepalive].u_int;
     mqtt_cfg.disable_clean_session = args[ARG_cleansess].u_int ? false : true;
+    // max. number of unacknowledged QoS1/QoS2 messages, 0 for default
+    mqtt_cfg.max_inflight = args[ARG_inflight].u_int;
 
     // LWT options
     if (MP_OBJ_IS_STR(args[ARG_lwt_topic].u_obj)) {
@@ -523,8 +575,24 @@ STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
 
     self->base.type = &mqtt_type;
 
+    // Subscriptions with own callbacks
+    self->subs = mp_obj_new_dict(0);
+    self->trie = mqtt_trie_init();
+    self->trie_mutex = xSemaphoreCreateMutex();
+    if ((self->trie == NULL) || (self->trie_mutex == NULL)) {
+    	if (self->trie) mqtt_trie_destroy(self->trie);
+    	if (self->trie_mutex) vSemaphoreDelete(self->trie_mutex);
+    	self->trie = NULL;
+    	self->trie_mutex = NULL;
+		mp_raise_msg(&mp_type_MemoryError, "Error allocating subscriptions");
+    }
+
     self->client = esp_mqtt_client_init(&mqtt_cfg);
     if (self->client == NULL) {
+    	mqtt_trie_destroy(self->trie);
+    	vSemaphoreDelete(self->trie_mutex);
+    	self->trie = NULL;
+    	self->trie_mutex = NULL;
 		mp_raise_ValueError("Error initializing mqtt client");
     }
 
@@ -538,7 +606,7 @@ STATIC mp_obj_t mqtt_make_new(const mp_obj_type_t *type, size_t n_args, size_t n
 STATIC mp_obj_t mqtt_op_config(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
 	enum { ARG_server, ARG_user, ARG_pass, ARG_port, ARG_reconnect, ARG_clientid, ARG_cleansess, ARG_keepalive, ARG_lwt_topic, ARG_lwt_msg,
-		   ARG_lwt_qos, ARG_lwt_retain, ARG_datacb, ARG_connected, ARG_disconnected, ARG_subscribed, ARG_unsubscribed, ARG_published };
+		   ARG_lwt_qos, ARG_lwt_retain, ARG_datacb, ARG_connected, ARG_disconnected, ARG_subscribed, ARG_unsubscribed, ARG_published, ARG_inflight };
 
     const mp_arg_t mqtt_config_allowed_args[] = {
 			{ MP_QSTR_server,       	MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
@@ -559,6 +627,7 @@ STATIC mp_obj_t mqtt_op_config(mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
 			{ MP_QSTR_subscribed_cb,  	MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
 			{ MP_QSTR_unsubscribed_cb, 	MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
 			{ MP_QSTR_published_cb,		MP_ARG_KW_ONLY | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_inflight,			MP_ARG_KW_ONLY | MP_ARG_INT,  {.u_int = 0} },
 	};
 
     mqtt_obj_t *self = pos_args[0];
@@ -679,10 +748,27 @@ STATIC mp_obj_t mqtt_op_config(mp_uint_t n_args, const mp_obj_t *pos_args, mp_ma
 	}
     else if (args[ARG_published].u_obj == mp_const_false) self->mpy_published_cb = NULL;
 
+    // In-flight window can be changed at any time
+    if (args[ARG_inflight].u_int > 0) self->client->max_inflight = args[ARG_inflight].u_int;
+
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mqtt_config_obj, 1, mqtt_op_config);
 
+// Remove the subscription callback of the topic filter
+//----------------------------------------------------------
+STATIC void subs_remove(mqtt_obj_t *self, mp_obj_t topic_in)
+{
+    const char *topic = mp_obj_str_get_str(topic_in);
+    xSemaphoreTake(self->trie_mutex, portMAX_DELAY);
+    mqtt_trie_remove(self->trie, topic);
+    xSemaphoreGive(self->trie_mutex);
+    mp_map_lookup(mp_obj_dict_get_map(self->subs), topic_in, MP_MAP_LOOKUP_REMOVE_IF_FOUND);
+}
+
+// subscribe(topic [, qos, cb])
+// If the callback is given, the messages on the topics matching the filter
+// are delivered only to it (instead of the general data callback)
 //-----------------------------------------------------------------------
 STATIC mp_obj_t mqtt_op_subscribe(mp_uint_t n_args, const mp_obj_t *args)
 {
@@ -692,12 +778,34 @@ STATIC mp_obj_t mqtt_op_subscribe(mp_uint_t n_args, const mp_obj_t *args)
     const char *topic = mp_obj_str_get_str(args[1]);
     int wait = 2000;
     int qos = 0;
-    if (n_args == 3) {
+    if (n_args > 2) {
     	qos = mp_obj_get_int(args[2]);
     	if ((qos < 0) || (qos > 2)) {
     		mp_raise_ValueError("Wrong QoS value");
     	}
     }
+    mp_obj_t cb = mp_const_none;
+    if (n_args > 3) {
+    	cb = args[3];
+        if ((cb != mp_const_none) && (!MP_OBJ_IS_FUN(cb)) && (!MP_OBJ_IS_METH(cb))) {
+    		mp_raise_ValueError("Callback function expected");
+        }
+    }
+    if (!mqtt_trie_valid_filter(topic)) {
+		mp_raise_ValueError("Invalid topic filter");
+    }
+
+    if (cb != mp_const_none) {
+    	// register the callback before subscribing, the messages may arrive before the acknowledge
+    	mp_obj_dict_store(self->subs, args[1], cb);
+        xSemaphoreTake(self->trie_mutex, portMAX_DELAY);
+        int res = mqtt_trie_insert(self->trie, topic, cb, NULL);
+        xSemaphoreGive(self->trie_mutex);
+        if (res < 0) {
+        	mp_map_lookup(mp_obj_dict_get_map(self->subs), args[1], MP_MAP_LOOKUP_REMOVE_IF_FOUND);
+    		mp_raise_msg(&mp_type_MemoryError, "Error adding subscription");
+        }
+    }
 
     self->subs_flag = 0;
     self->client->config->user_context = (void *)topic;
@@ -705,6 +813,7 @@ STATIC mp_obj_t mqtt_op_subscribe(mp_uint_t n_args, const mp_obj_t *args)
     int res = esp_mqtt_client_subscribe(self->client, topic, qos);
     if (res < 0) {
     	self->client->config->user_context = NULL;
+    	if (cb != mp_const_none) subs_remove(self, args[1]);
     	return mp_const_false;
     }
 	while ((wait > 0) && (self->subs_flag == 0)) {
@@ -715,13 +824,17 @@ STATIC mp_obj_t mqtt_op_subscribe(mp_uint_t n_args, const mp_obj_t *args)
 	if (wait) return mp_const_true;
 	else return mp_const_false;
 }
-MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mqtt_subscribe_obj, 2, 3, mqtt_op_subscribe);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mqtt_subscribe_obj, 2, 4, mqtt_op_subscribe);
 
 //----------------------------------------------------------------------
 STATIC mp_obj_t mqtt_op_unsubscribe(mp_obj_t self_in, mp_obj_t topic_in)
 {
     mqtt_obj_t *self = self_in;
-    if (checkClient(self) != MQTT_STATE_CONNECTED) return mp_const_false;
+    int state = checkClient(self);
+
+    // no more messages are delivered to the subscription callback
+    subs_remove(self, topic_in);
+    if (state != MQTT_STATE_CONNECTED) return mp_const_false;
 
     const char *topic = mp_obj_str_get_str(topic_in);
     int wait = 2000;
@@ -784,6 +897,82 @@ STATIC mp_obj_t mqtt_op_publish(mp_uint_t n_args, const mp_obj_t *args)
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mqtt_publish_obj, 3, 5, mqtt_op_publish);
 
+// Publish the list of (topic, msg [, qos, retain]) tuples
+// The messages are coalesced into as few transport writes as possible,
+// for QoS > 0 up to 'inflight' messages are sent without waiting for the acknowledge
+//--------------------------------------------------------------------------
+STATIC mp_obj_t mqtt_op_publish_many(mp_uint_t n_args, const mp_obj_t *args)
+{
+    mqtt_obj_t *self = args[0];
+    if (checkClient(self) != MQTT_STATE_CONNECTED) return mp_obj_new_int(0);
+
+    int qos = 0;
+    if (n_args > 2) {
+    	qos = mp_obj_get_int(args[2]);
+    	if ((qos < 0) || (qos > 2)) {
+    		mp_raise_ValueError("Wrong QoS value");
+    	}
+    }
+    int retain = 0;
+    if (n_args > 3) retain = mp_obj_is_true(args[3]);
+
+    size_t n_msgs;
+    mp_obj_t *msgs;
+    mp_obj_get_array(args[1], &n_msgs, &msgs);
+
+    int count = 0;
+    for (int i=0; i<n_msgs; i++) {
+        size_t n_items;
+        mp_obj_t *items;
+        mp_obj_get_array(msgs[i], &n_items, &items);
+        if ((n_items < 2) || (n_items > 4)) {
+    		mp_raise_ValueError("Expected (topic, msg [, qos, retain]) tuple");
+        }
+        size_t len;
+        const char *topic = mp_obj_str_get_str(items[0]);
+        const char *msg = mp_obj_str_get_data(items[1], &len);
+        int msg_qos = qos;
+        int msg_retain = retain;
+        if (n_items > 2) {
+        	msg_qos = mp_obj_get_int(items[2]);
+        	if ((msg_qos < 0) || (msg_qos > 2)) {
+        		mp_raise_ValueError("Wrong QoS value");
+        	}
+        }
+        if (n_items > 3) msg_retain = mp_obj_is_true(items[3]);
+
+        // may wait for a free slot in the in-flight window (QoS > 0) or
+        // write the full batch to the transport (any QoS)
+        MP_THREAD_GIL_EXIT();
+        int res = esp_mqtt_client_enqueue(self->client, topic, msg, len, msg_qos, msg_retain);
+        MP_THREAD_GIL_ENTER();
+        if (res < 0) break;
+        count++;
+    }
+    MP_THREAD_GIL_EXIT();
+    esp_mqtt_client_flush(self->client);
+    MP_THREAD_GIL_ENTER();
+
+    return mp_obj_new_int(count);
+}
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mqtt_publish_many_obj, 2, 4, mqtt_op_publish_many);
+
+//---------------------------------------------
+STATIC mp_obj_t mqtt_op_stats(mp_obj_t self_in)
+{
+    mqtt_obj_t *self = self_in;
+    checkClient(self);
+
+	mp_obj_t tuple[4];
+	tuple[0] = mp_obj_new_int_from_uint(self->client->publish_stats.messages);
+	tuple[1] = mp_obj_new_int_from_uint(self->client->publish_stats.writes);
+	tuple[2] = mp_obj_new_int_from_uint(self->client->publish_stats.bytes);
+	tuple[3] = mp_obj_new_int(esp_mqtt_client_get_inflight(self->client));
+
+	return mp_obj_new_tuple(4, tuple);
+}
+MP_DEFINE_CONST_FUN_OBJ_1(mqtt_stats_obj, mqtt_op_stats);
+
 //----------------------------------------------
 STATIC mp_obj_t mqtt_op_status(mp_obj_t self_in)
 {
@@ -857,6 +1046,17 @@ STATIC mp_obj_t mqtt_op_free(mp_obj_t self_in)
 		esp_mqtt_client_destroy(self->client);
     	self->client = NULL;
 
+    	// the mqtt task is stopped, the subscriptions are not used any more
+    	if (self->trie) {
+    		mqtt_trie_destroy(self->trie);
+    		self->trie = NULL;
+    	}
+    	if (self->trie_mutex) {
+    		vSemaphoreDelete(self->trie_mutex);
+    		self->trie_mutex = NULL;
+    	}
+    	self->subs = mp_const_none;
+
     	if (self->msgbuf) {
     		free(self->msgbuf);
     		self->msgbuf = NULL;
@@ -883,6 +1083,8 @@ STATIC const mp_rom_map_elem_t mqtt_locals_dict_table[] = {
 	    { MP_ROM_QSTR(MP_QSTR_subscribe),	(mp_obj_t)&mqtt_subscribe_obj },
 	    { MP_ROM_QSTR(MP_QSTR_unsubscribe),	(mp_obj_t)&mqtt_unsubscribe_obj },
 	    { MP_ROM_QSTR(MP_QSTR_publish),		(mp_obj_t)&mqtt_publish_obj },
+	    { MP_ROM_QSTR(MP_QSTR_publish_many),	(mp_obj_t)&mqtt_publish_many_obj },
+	    { MP_ROM_QSTR(MP_QSTR_stats),		(mp_obj_t)&mqtt_stats_obj },
 	    { MP_ROM_QSTR(MP_QSTR_status),		(mp_obj_t)&mqtt_status_obj },
 	    { MP_ROM_QSTR(MP_QSTR_stop),		(mp_obj_t)&mqtt_stop_obj },
 	    { MP_ROM_QSTR(MP_QSTR_start),		(mp_obj_t)&mqtt_start_obj },
@@ -1444,6 +1444,23 @@ STATIC mp_obj_t mod_network_stateTelnet()
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_stateTelnet_obj, mod_network_stateTelnet);
 
+// Return the output statistics of the current telnet connection
+//--------------------------------------
+STATIC mp_obj_t mod_network_statsTelnet()
+{
+	telnet_tx_stats_t stats;
+	if (!telnet_get_tx_stats(&stats)) return mp_const_none;
+
+	mp_obj_t tuple[5];
+	tuple[0] = mp_obj_new_int_from_uint(stats.bytes);
+	tuple[1] = mp_obj_new_int_from_uint(stats.sends);
+	tuple[2] = mp_obj_new_int_from_uint(stats.segments);
+	tuple[3] = mp_obj_new_int_from_uint(stats.dropped);
+	tuple[4] = mp_obj_new_int_from_uint(stats.buffered);
+	return mp_obj_new_tuple(5, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_statsTelnet_obj, mod_network_statsTelnet);
+
 //===============================================================
 STATIC const mp_map_elem_t network_telnet_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_start),	(mp_obj_t)&mod_network_startTelnet_obj },
@@ -1451,6 +1468,7 @@ STATIC const mp_map_elem_t network_telnet_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_resume),	(mp_obj_t)&mod_network_resumeTelnet_obj },
     { MP_ROM_QSTR(MP_QSTR_stop),	(mp_obj_t)&mod_network_stopTelnet_obj },
     { MP_ROM_QSTR(MP_QSTR_status),	(mp_obj_t)&mod_network_stateTelnet_obj },
+    { MP_ROM_QSTR(MP_QSTR_stats),	(mp_obj_t)&mod_network_statsTelnet_obj },
     { MP_ROM_QSTR(MP_QSTR_stack),	(mp_obj_t)&mod_network_TelnetMaxStack_obj }
 };
 STATIC MP_DEFINE_CONST_DICT(network_telnet_locals_dict, network_telnet_locals_dict_table);
@@ -1617,6 +1635,84 @@ const mp_obj_type_t network_ftp_type = {
 extern const mp_obj_type_t mdns_type;
 #endif
 
+#ifdef CONFIG_MICROPY_USE_DNS_CACHE
+#include "dns_cache.h"
+
+// Returns (entries, hits, negative_hits, misses, queries, resolved, not_found, timeouts, failures, avg_ms, max_ms)
+//---------------------------------------
+STATIC mp_obj_t mod_network_dns_stats()
+{
+	dns_cache_stats_t stats;
+	dns_cache_get_stats(&stats);
+
+	uint32_t answered = stats.resolved + stats.not_found + stats.timeouts + stats.failures;
+	mp_obj_t tuple[11];
+	tuple[0] = mp_obj_new_int(stats.entries);
+	tuple[1] = mp_obj_new_int(stats.hits);
+	tuple[2] = mp_obj_new_int(stats.negative_hits);
+	tuple[3] = mp_obj_new_int(stats.misses);
+	tuple[4] = mp_obj_new_int(stats.queries);
+	tuple[5] = mp_obj_new_int(stats.resolved);
+	tuple[6] = mp_obj_new_int(stats.not_found);
+	tuple[7] = mp_obj_new_int(stats.timeouts);
+	tuple[8] = mp_obj_new_int(stats.failures);
+	tuple[9] = mp_obj_new_int((answered) ? stats.total_ms / answered : 0);
+	tuple[10] = mp_obj_new_int(stats.max_ms);
+
+	return mp_obj_new_tuple(11, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_dns_stats_obj, mod_network_dns_stats);
+
+//---------------------------------------
+STATIC mp_obj_t mod_network_dns_flush()
+{
+	dns_cache_flush();
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_network_dns_flush_obj, mod_network_dns_flush);
+
+// Get the DNS servers used by the cache or set the server
+// The server can be given as 'ip' or ('ip', port), None reverts to the network's DNS server
+//-------------------------------------------------------------------------
+STATIC mp_obj_t mod_network_dns_server(size_t n_args, const mp_obj_t *args)
+{
+	if (n_args == 0) {
+		mp_obj_t tuple[DNS_CACHE_SERVERS];
+		struct sockaddr_in server;
+		for (int i=0; i<DNS_CACHE_SERVERS; i++) {
+			if (dns_cache_get_server(i, &server)) {
+				tuple[i] = netutils_format_inet_addr((uint8_t *)&server.sin_addr, lwip_ntohs(server.sin_port), NETUTILS_BIG);
+			}
+			else tuple[i] = mp_const_none;
+		}
+		return mp_obj_new_tuple(DNS_CACHE_SERVERS, tuple);
+	}
+
+	int index = (n_args > 1) ? mp_obj_get_int(args[1]) : 0;
+	if ((index < 0) || (index >= DNS_CACHE_SERVERS)) {
+		mp_raise_ValueError("Invalid DNS server index");
+	}
+	if (args[0] == mp_const_none) {
+		dns_cache_set_server(index, NULL);
+	}
+	else {
+		struct sockaddr_in server;
+		memset(&server, 0, sizeof(struct sockaddr_in));
+		if (MP_OBJ_IS_TYPE(args[0], &mp_type_tuple)) {
+			server.sin_port = lwip_htons(netutils_parse_inet_addr(args[0], (uint8_t *)&server.sin_addr, NETUTILS_BIG));
+		}
+		else {
+			netutils_parse_ipv4_addr(args[0], (uint8_t *)&server.sin_addr, NETUTILS_BIG);
+		}
+		dns_cache_set_server(index, &server);
+	}
+	// the cached answers may come from the previous server
+	dns_cache_flush();
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_network_dns_server_obj, 0, 2, mod_network_dns_server);
+#endif
+
 //--------------------------------------------------------------------
 STATIC mp_obj_t esp_wlan_callback(size_t n_args, const mp_obj_t *args)
 {
@@ -1659,6 +1755,11 @@ STATIC const mp_map_elem_t mp_module_network_globals_table[] = {
 	#ifdef CONFIG_MICROPY_USE_MDNS
 	{ MP_ROM_QSTR(MP_QSTR_mDNS),					(mp_obj_type_t *)&mdns_type },
 	#endif
+	#ifdef CONFIG_MICROPY_USE_DNS_CACHE
+	{ MP_ROM_QSTR(MP_QSTR_dns_stats),				(mp_obj_t)&mod_network_dns_stats_obj },
+	{ MP_ROM_QSTR(MP_QSTR_dns_flush),				(mp_obj_t)&mod_network_dns_flush_obj },
+	{ MP_ROM_QSTR(MP_QSTR_dns_server),				(mp_obj_t)&mod_network_dns_server_obj },
+	#endif
 
 #if MODNETWORK_INCLUDE_CONSTANTS
     { MP_OBJ_NEW_QSTR(MP_QSTR_STA_IF),				MP_OBJ_NEW_SMALL_INT(WIFI_IF_STA)},
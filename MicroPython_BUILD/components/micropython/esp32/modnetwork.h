@@ -69,6 +69,10 @@ uint32_t network_hasip();
 uint32_t network_has_staip();
 void network_checkConnection();
 
+#ifdef CONFIG_MICROPY_USE_DNS_CACHE
+void socket_dns_deinit(void);
+#endif
+
 
 #ifdef CONFIG_MICROPY_USE_ETHERNET
 MP_DECLARE_CONST_FUN_OBJ_KW(get_lan_obj);
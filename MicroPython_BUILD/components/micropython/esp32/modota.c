@@ -34,6 +34,8 @@
 
 #include <freertos/FreeRTOS.h>
 #include <freertos/task.h>
+#include <freertos/queue.h>
+#include <freertos/semphr.h>
 #include <sys/socket.h>
 #include <netdb.h>
 
@@ -41,6 +43,7 @@
 #include "esp_partition.h"
 #include "esp_spi_flash.h"
 #include "mbedtls/md5.h"
+#include "mbedtls/sha256.h"
 #include "esp_ota_ops.h"
 #include "rom/queue.h"
 #include "rom/crc.h"
@@ -52,13 +55,23 @@
 #include "modmachine.h"
 #include "mphalport.h"
 #include "extmod/vfs_native.h"
+#if MICROPY_PY_UZLIB
+#include "uzlib/tinf.h"
+#endif
 
 
 #define BUFFSIZE 4096
+#define OTA_RING_BUFFERS    4                           // download buffers between the reader and the writer
+#define OTA_ERASE_AHEAD     (16 * SPI_FLASH_SEC_SIZE)   // flash is erased ahead of the write position in 64KB steps
+#define OTA_RESUME_STEP     (16 * SPI_FLASH_SEC_SIZE)   // resume point is saved to NVS every 64KB
+#define OTA_WRITER_STACK    4096
+#define OTA_GZIP_DICT_SIZE  32768
 
 static const char *TAG = "OTA_UPDATE";
 static char *cert_pem = NULL;
 
+extern int MainTaskCore;
+
 extern void get_certificate(mp_obj_t cert, char *cert_pem_buf);
 
 //----------------------------------------------------------------
@@ -90,8 +103,235 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
     return ESP_OK;
 }
 
-//-----------------------------------------------------------------------------------
-static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_fact)
+// ==== OTA download/flash pipeline ====================================================
+// The network reader (MicroPython task) fills a ring of download buffers,
+// the writer task erases the flash ahead of the write position, writes the data
+// and updates the checksums, so that download and flash erase/write overlap.
+
+typedef struct _ota_chunk_t {
+    char *buf;
+    int len;                        // 0: end of stream, <0: download aborted
+} ota_chunk_t;
+
+typedef struct _ota_pipe_t {
+    const esp_partition_t *partition;
+    QueueHandle_t free_q;           // empty buffers, taken by the reader
+    QueueHandle_t full_q;           // filled chunks, taken by the writer
+    SemaphoreHandle_t done;         // given by the writer task on exit
+    uint32_t offset;                // partition write position
+    uint32_t erased;                // partition is erased up to this offset
+    uint32_t resume_crc;            // crc of the update url, 0 if resume is not used
+    uint32_t total_len;             // total image length, 0 if unknown
+    bool compressed;                // gzip input
+    bool src_eof;
+    volatile esp_err_t err;
+    mbedtls_md5_context md5_ctx;
+    mbedtls_sha256_context sha_ctx;
+    #if MICROPY_PY_UZLIB
+    ota_chunk_t chunk;              // chunk currently consumed by the decompressor
+    int chunk_pos;
+    char *out_buf;
+    uint8_t *dict;
+    TINF_DATA decomp;
+    #endif
+} ota_pipe_t;
+
+//--------------------------------------------------------------------------------------
+static void ota_resume_save(uint32_t url_crc, uint32_t part_addr, uint32_t offset, uint32_t total_len)
+{
+    if (mpy_nvs_handle == 0) return;
+    nvs_set_u32(mpy_nvs_handle, "OTA_ResURL", url_crc);
+    nvs_set_u32(mpy_nvs_handle, "OTA_ResPart", part_addr);
+    nvs_set_u32(mpy_nvs_handle, "OTA_ResOfs", offset);
+    nvs_set_u32(mpy_nvs_handle, "OTA_ResLen", total_len);
+    nvs_commit(mpy_nvs_handle);
+}
+
+// The record is only valid for the image being written to the partition,
+// it is cleared when the partition is written from the start or the update fails
+//------------------------------
+static void ota_resume_clear()
+{
+    uint32_t val = 0;
+    if (mpy_nvs_handle == 0) return;
+    if ((nvs_get_u32(mpy_nvs_handle, "OTA_ResURL", &val) != ESP_OK) || (val == 0)) return;
+    ota_resume_save(0, 0, 0, 0);
+}
+
+// Returns the sector aligned offset from which the interrupted update can be continued
+//--------------------------------------------------------------------------------------------------
+static uint32_t ota_resume_get(uint32_t url_crc, const esp_partition_t *partition, uint32_t *total_len)
+{
+    uint32_t val = 0, offset = 0;
+    if (mpy_nvs_handle == 0) return 0;
+    if ((nvs_get_u32(mpy_nvs_handle, "OTA_ResURL", &val) != ESP_OK) || (val != url_crc)) return 0;
+    if ((nvs_get_u32(mpy_nvs_handle, "OTA_ResPart", &val) != ESP_OK) || (val != partition->address)) return 0;
+    if (nvs_get_u32(mpy_nvs_handle, "OTA_ResOfs", &offset) != ESP_OK) return 0;
+    if (nvs_get_u32(mpy_nvs_handle, "OTA_ResLen", total_len) != ESP_OK) return 0;
+    if ((offset >= partition->size) || ((*total_len > 0) && (offset >= *total_len))) return 0;
+    uint8_t magic = 0;
+    if ((esp_partition_read(partition, 0, &magic, 1) != ESP_OK) || (magic != 0xE9)) return 0;
+    return offset & ~(SPI_FLASH_SEC_SIZE-1);
+}
+
+//----------------------------------------------------------------------------
+static esp_err_t ota_pipe_write(ota_pipe_t *pipe, char *data, int len)
+{
+    if ((pipe->offset + len) > pipe->partition->size) {
+        ESP_LOGE(TAG, "Received more bytes than the partition size: %u > %u", pipe->offset+len, pipe->partition->size);
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((pipe->offset == 0) && ((uint8_t)data[0] != 0xE9)) {
+        ESP_LOGE(TAG, "Error: OTA image has invalid magic byte (%02X <> E9)", (uint8_t)data[0]);
+        return ESP_ERR_INVALID_ARG;
+    }
+    esp_err_t err;
+    // Keep the flash erased ahead of the write position
+    if ((pipe->offset + len) > pipe->erased) {
+        uint32_t erase_end = (pipe->offset + len + OTA_ERASE_AHEAD + SPI_FLASH_SEC_SIZE - 1) & ~(SPI_FLASH_SEC_SIZE-1);
+        if (erase_end > pipe->partition->size) erase_end = pipe->partition->size;
+        err = esp_partition_erase_range(pipe->partition, pipe->erased, erase_end - pipe->erased);
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "Error: flash erase failed! err=0x%x", err);
+            return err;
+        }
+        pipe->erased = erase_end;
+    }
+
+    mbedtls_md5_update(&pipe->md5_ctx, (const unsigned char *)data, len);
+    mbedtls_sha256_update(&pipe->sha_ctx, (const unsigned char *)data, len);
+
+    // Encrypted partitions can only be written in 16-byte blocks,
+    // only the last chunk can be unaligned, all buffers have 16 spare bytes
+    int wr_len = len;
+    if ((pipe->partition->encrypted) && (wr_len & 15)) {
+        memset(data+len, 0xFF, 16 - (len & 15));
+        wr_len = (len + 15) & ~15;
+    }
+    err = esp_partition_write(pipe->partition, pipe->offset, data, wr_len);
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG, "Error: flash write failed! err=0x%x", err);
+        return err;
+    }
+    uint32_t prev_offset = pipe->offset;
+    pipe->offset += len;
+
+    if ((pipe->resume_crc) && ((prev_offset / OTA_RESUME_STEP) != (pipe->offset / OTA_RESUME_STEP))) {
+        ota_resume_save(pipe->resume_crc, pipe->partition->address, pipe->offset & ~(SPI_FLASH_SEC_SIZE-1), pipe->total_len);
+    }
+    return ESP_OK;
+}
+
+#if MICROPY_PY_UZLIB
+// Feed the decompressor from the download buffers
+//------------------------------------------------
+static unsigned char ota_read_src(TINF_DATA *data)
+{
+    ota_pipe_t *pipe = (ota_pipe_t *)((char *)data - offsetof(ota_pipe_t, decomp));
+
+    while (pipe->chunk_pos >= pipe->chunk.len) {
+        if (pipe->src_eof) return 0;
+        if (pipe->chunk.buf) xQueueSend(pipe->free_q, &pipe->chunk.buf, portMAX_DELAY);
+        xQueueReceive(pipe->full_q, &pipe->chunk, portMAX_DELAY);
+        pipe->chunk_pos = 0;
+        if (pipe->chunk.len <= 0) {
+            pipe->chunk.buf = NULL;
+            pipe->chunk.len = 0;
+            pipe->src_eof = true;
+            return 0;
+        }
+    }
+    return (unsigned char)pipe->chunk.buf[pipe->chunk_pos++];
+}
+
+//----------------------------------------
+static void ota_pipe_inflate(ota_pipe_t *pipe)
+{
+    pipe->decomp.source = NULL;
+    pipe->decomp.readSource = ota_read_src;
+    if (uzlib_gzip_parse_header(&pipe->decomp) != TINF_OK) {
+        ESP_LOGE(TAG, "Error: invalid gzip header");
+        pipe->err = ESP_ERR_INVALID_ARG;
+        return;
+    }
+    uzlib_uncompress_init(&pipe->decomp, pipe->dict, OTA_GZIP_DICT_SIZE);
+
+    while (pipe->err == ESP_OK) {
+        pipe->decomp.dest = (unsigned char *)pipe->out_buf;
+        pipe->decomp.destSize = BUFFSIZE;
+        int st = uzlib_uncompress_chksum(&pipe->decomp);
+        if ((st < 0) || (pipe->src_eof)) {
+            ESP_LOGE(TAG, "Error: decompression failed (%d)", (pipe->src_eof) ? TINF_DATA_ERROR : st);
+            pipe->err = ESP_ERR_INVALID_RESPONSE;
+            break;
+        }
+        int len = (char *)pipe->decomp.dest - pipe->out_buf;
+        if (len > 0) pipe->err = ota_pipe_write(pipe, pipe->out_buf, len);
+        if (st == TINF_DONE) break;
+    }
+}
+#endif
+
+//--------------------------------------
+static void ota_writer_task(void *arg)
+{
+    ota_pipe_t *pipe = (ota_pipe_t *)arg;
+    ota_chunk_t chunk;
+
+    #if MICROPY_PY_UZLIB
+    if (pipe->compressed) {
+        ota_pipe_inflate(pipe);
+        if (pipe->chunk.buf) xQueueSend(pipe->free_q, &pipe->chunk.buf, portMAX_DELAY);
+        pipe->chunk.buf = NULL;
+    }
+    if (!pipe->src_eof)
+    #endif
+    {
+        // Write the received data, after an error only return the buffers to the reader
+        while (xQueueReceive(pipe->full_q, &chunk, portMAX_DELAY) == pdTRUE) {
+            if (chunk.len <= 0) break;
+            if (pipe->err == ESP_OK) {
+                #if MICROPY_PY_UZLIB
+                if (pipe->compressed) {
+                    ESP_LOGE(TAG, "Error: data received after the end of compressed stream");
+                    pipe->err = ESP_ERR_INVALID_SIZE;
+                }
+                else
+                #endif
+                pipe->err = ota_pipe_write(pipe, chunk.buf, chunk.len);
+            }
+            xQueueSend(pipe->free_q, &chunk.buf, portMAX_DELAY);
+        }
+    }
+
+    xSemaphoreGive(pipe->done);
+    vTaskDelete(NULL);
+}
+
+// Read from the http client until the buffer is full or the end of data
+//----------------------------------------------------------------------------------
+static int ota_http_read(esp_http_client_handle_t client, char *buf, int size)
+{
+    int len = 0;
+    while (len < size) {
+        int n = esp_http_client_read(client, buf+len, size-len);
+        if (n < 0) return n;
+        if (n == 0) break;
+        len += n;
+    }
+    return len;
+}
+
+//------------------------------------------------------------------------
+static void ota_hex_digest(const unsigned char *digest, int len, char *hex)
+{
+    for (int i = 0; i<len; i++){
+        sprintf(hex+(i*2),"%02x", digest[i]);
+    }
+}
+
+//-----------------------------------------------------------------------------------------------------------------------------------
+static esp_err_t mpy_ota_update(const char *upd_url, bool md5_fetch, const char *md5_str, const char *sha256_str, bool resume, uint8_t force_fact)
 {
     if ((CONFIG_LOG_DEFAULT_LEVEL > ESP_LOG_WARN) && (CONFIG_MICRO_PY_LOG_LEVEL > ESP_LOG_WARN)){
         esp_log_level_set("HTTP_CLIENT", ESP_LOG_WARN);
@@ -105,11 +345,19 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
 	memset(&http_client_config, 0, sizeof(esp_http_client_config_t));
 	char remote_md5[33] = {0};
 	char local_md5[33] = {0};
-	char *ota_write_data = NULL; // ota data write buffer
+	char local_sha256[65] = {0};
+	char *ring_mem = NULL; // download buffers
+	ota_pipe_t *pipe = NULL;
 	esp_err_t err = ESP_FAIL, errexit = ESP_FAIL;
+    esp_http_client_handle_t client = NULL;
+    uint32_t url_crc = crc32_le(0, (const uint8_t *)upd_url, strlen(upd_url)) | 1;
+    uint32_t resume_ofs = 0;
+    bool writer_started = false;
+    bool interrupted = false;       // download interrupted, the update can be resumed
+    ota_chunk_t chunk;
+
+    if (md5_str) strncpy(remote_md5, md5_str, 32);
 
-	// update handle : set by esp_ota_begin(), must be freed via esp_ota_end() !
-    esp_ota_handle_t update_handle = 0 ;
     const esp_partition_t *update_partition = NULL;
 
     const esp_partition_t *running_partition = esp_ota_get_running_partition();
@@ -131,28 +379,23 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
         goto exit;
     }
 
-    ota_write_data = malloc(BUFFSIZE+1);
-    if (ota_write_data == NULL) {
+    pipe = calloc(1, sizeof(ota_pipe_t));
+    ring_mem = malloc(OTA_RING_BUFFERS * (BUFFSIZE+16));
+    if ((pipe == NULL) || (ring_mem == NULL)) {
         ESP_LOGE(TAG, "Error allocating buffer !");
         goto exit;
     }
+    pipe->partition = update_partition;
+    pipe->err = ESP_OK;
+    mbedtls_md5_init(&pipe->md5_ctx);
+    mbedtls_md5_starts(&pipe->md5_ctx);
+    mbedtls_sha256_init(&pipe->sha_ctx);
+    mbedtls_sha256_starts(&pipe->sha_ctx, 0);
 
    	ESP_LOGI(TAG, "Starting OTA update from '%s' to '%s' partition", running_partition->label, update_partition->label);
 
 	mp_hal_reset_wdt();
-    // Begin update
-    err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "esp_ota_begin failed, error=%d", err);
-        goto exit;
-    }
-
-	mp_hal_reset_wdt();
-    int expect_len = 0;
-    int data_read = 0;
-    esp_http_client_handle_t client = NULL;
-
-    if (md5) {
+    if (md5_fetch) {
    	   	// === Get the image MD5 file from server ===
         char http_request[strlen(upd_url)+8];
         strcpy(http_request, upd_url);
@@ -160,7 +403,6 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
         http_client_config.url = http_request;
         http_client_config.cert_pem = cert_pem;
         http_client_config.event_handler = _http_event_handler;
-        //http_client_config.buffer_size = BUFFSIZE;
 
         client = esp_http_client_init(&http_client_config);
         if (client == NULL) {
@@ -169,7 +411,6 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
         }
         err = esp_http_client_open(client, 0);
         if (err != ESP_OK) {
-            esp_http_client_cleanup(client);
             ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
             goto exit_client;
         }
@@ -179,8 +420,8 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
             goto exit_client;
         }
 
-        data_read = esp_http_client_read(client, ota_write_data, BUFFSIZE);
-        if (data_read >= 32) strncpy(remote_md5, ota_write_data, 32);
+        int data_read = esp_http_client_read(client, ring_mem, BUFFSIZE);
+        if (data_read >= 32) strncpy(remote_md5, ring_mem, 32);
         else {
             ESP_LOGE(TAG, "Remote MD5 requested but not received");
             goto exit_client;
@@ -190,21 +431,29 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
         client = NULL;
    	}
 
+    if (resume) {
+        resume_ofs = ota_resume_get(url_crc, update_partition, &pipe->total_len);
+        pipe->resume_crc = url_crc;
+    }
+
    	// === Connect to http server to get the image file ===
     http_client_config.url = upd_url;
     http_client_config.cert_pem = cert_pem;
     http_client_config.event_handler = _http_event_handler;
-    //http_client_config.buffer_size = BUFFSIZE;
 
-    if (client == NULL) client = esp_http_client_init(&http_client_config);
+    client = esp_http_client_init(&http_client_config);
     if (client == NULL) {
         ESP_LOGE(TAG, "Failed to initialise HTTP connection");
         goto exit;
     }
+    if (resume_ofs > 0) {
+        char range[32];
+        sprintf(range, "bytes=%u-", resume_ofs);
+        esp_http_client_set_header(client, "Range", range);
+    }
 
     err = esp_http_client_open(client, 0);
     if (err != ESP_OK) {
-        esp_http_client_cleanup(client);
         ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
         goto exit_client;
     }
@@ -216,7 +465,38 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
 
 	mp_hal_reset_wdt();
 
-    expect_len = esp_http_client_get_content_length(client);
+    int expect_len = esp_http_client_get_content_length(client);
+    if (resume_ofs > 0) {
+        if ((esp_http_client_get_status_code(client) != 206) || ((pipe->total_len > 0) && (expect_len > 0) && ((resume_ofs + expect_len) != pipe->total_len))) {
+            ESP_LOGW(TAG, "Cannot resume the update, starting from the beginning");
+            esp_http_client_close(client);
+            esp_http_client_delete_header(client, "Range");
+            resume_ofs = 0;
+            err = esp_http_client_open(client, 0);
+            if ((err != ESP_OK) || (esp_http_client_fetch_headers(client) == ESP_FAIL)) {
+                ESP_LOGE(TAG, "Failed to open HTTP connection: %s", esp_err_to_name(err));
+                goto exit_client;
+            }
+            expect_len = esp_http_client_get_content_length(client);
+        }
+        else {
+            // Checksums must cover the part of the image already in flash
+            ESP_LOGI(TAG, "Resuming update at offset %u", resume_ofs);
+            for (uint32_t pos = 0; pos < resume_ofs; pos += BUFFSIZE) {
+                err = esp_partition_read(update_partition, pos, ring_mem, BUFFSIZE);
+                if (err != ESP_OK) {
+                    ESP_LOGE(TAG, "Error reading partition! err=0x%x", err);
+                    goto exit_client;
+                }
+                mbedtls_md5_update(&pipe->md5_ctx, (const unsigned char *)ring_mem, BUFFSIZE);
+                mbedtls_sha256_update(&pipe->sha_ctx, (const unsigned char *)ring_mem, BUFFSIZE);
+            }
+        }
+    }
+    pipe->offset = resume_ofs;
+    pipe->erased = resume_ofs;
+    pipe->total_len = (expect_len > 0) ? resume_ofs + expect_len : 0;
+
     if (expect_len > 0) {
         ESP_LOGI(TAG, "Update image size: %d bytes", expect_len);
     }
@@ -224,86 +504,137 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
         ESP_LOGW(TAG, "Cannot determine image size");
     }
 
-    data_read = esp_http_client_read(client, ota_write_data, BUFFSIZE);
+    pipe->free_q = xQueueCreate(OTA_RING_BUFFERS, sizeof(char *));
+    pipe->full_q = xQueueCreate(OTA_RING_BUFFERS+1, sizeof(ota_chunk_t));
+    pipe->done = xSemaphoreCreateBinary();
+    if ((pipe->free_q == NULL) || (pipe->full_q == NULL) || (pipe->done == NULL)) {
+        ESP_LOGE(TAG, "Error creating OTA queues");
+        goto exit_client;
+    }
+    for (int i=0; i<OTA_RING_BUFFERS; i++) {
+        char *buf = ring_mem + (i * (BUFFSIZE+16));
+        xQueueSend(pipe->free_q, &buf, 0);
+    }
+
+    // Read the first chunk and check the image type
+    char *buf = NULL;
+    xQueueReceive(pipe->free_q, &buf, portMAX_DELAY);
+    int data_read = ota_http_read(client, buf, BUFFSIZE);
     if (data_read <= 0) {
         vTaskDelay(5);
-        data_read = esp_http_client_read(client, ota_write_data, BUFFSIZE);
+        data_read = ota_http_read(client, buf, BUFFSIZE);
     }
     if (data_read <= 0) {
         ESP_LOGE(TAG, "Error reading from server (%d)", data_read);
         goto exit_client;
     }
-
-    // We have some data received, check for image magic byte
-    if (ota_write_data[0] != 0xE9) {
-        ESP_LOGE(TAG, "Error: OTA image has invalid magic byte (%02X <> E9)", ota_write_data[0]);
+    // Start of the image, the previous resume point is not valid anymore
+    if (resume_ofs == 0) ota_resume_clear();
+    if ((resume_ofs == 0) && ((uint8_t)buf[0] == 0x1F) && ((uint8_t)buf[1] == 0x8B)) {
+        #if MICROPY_PY_UZLIB
+        pipe->out_buf = malloc(BUFFSIZE+16);
+        pipe->dict = malloc(OTA_GZIP_DICT_SIZE);
+        if ((pipe->out_buf == NULL) || (pipe->dict == NULL)) {
+            ESP_LOGE(TAG, "Error allocating decompression buffers !");
+            goto exit_client;
+        }
+        // the position in the compressed stream can't be restored, no resume point is saved
+        pipe->compressed = true;
+        pipe->resume_crc = 0;
+       	ESP_LOGI(TAG, "Compressed (gzip) image");
+        #else
+        ESP_LOGE(TAG, "Compressed image not supported");
         goto exit_client;
+        #endif
     }
 
     // Start writing data
    	ESP_LOGI(TAG, "Writing to '%s' partition at offset 0x%x", update_partition->label, update_partition->address);
+    #if CONFIG_MICROPY_USE_BOTH_CORES
+    int tres = xTaskCreate(ota_writer_task, "OTA_writer", OTA_WRITER_STACK, pipe, CONFIG_MICROPY_TASK_PRIORITY, NULL);
+    #else
+    int tres = xTaskCreatePinnedToCore(ota_writer_task, "OTA_writer", OTA_WRITER_STACK, pipe, CONFIG_MICROPY_TASK_PRIORITY, NULL, MainTaskCore);
+    #endif
+    if (tres != pdTRUE) {
+        ESP_LOGE(TAG, "Error creating OTA writer task");
+        goto exit_client;
+    }
+    writer_started = true;
 
-    unsigned char md5_byte_array[16] = {0};
-    mbedtls_md5_context ctx;
-    mbedtls_md5_init( &ctx );
-    mbedtls_md5_starts( &ctx );
-	int binary_file_length = 0;  // image total length
-
+	int received = 0;  // received data length
 	while (data_read > 0) {
 		mp_hal_reset_wdt();
-        err = esp_ota_write( update_handle, (const void *)ota_write_data, data_read);
-        mbedtls_md5_update( &ctx, (const unsigned char *)ota_write_data, data_read);
-        if (err != ESP_OK) {
-        	mp_hal_stdout_tx_newline();
-            ESP_LOGE(TAG, "Error: esp_ota_write failed! err=0x%x", err);
-            goto exit_client;
-        }
-        binary_file_length += data_read;
-        mp_printf(&mp_plat_print, "%s Received %d bytes\r", TAG, binary_file_length);
-
-        data_read = esp_http_client_read(client, ota_write_data, BUFFSIZE);
-        if ((expect_len > 0) && ((binary_file_length + data_read) > expect_len)) {
-    		ESP_LOGE(TAG, "More than expected bytes received %u > %u\n", binary_file_length+data_read, expect_len);
-    		goto exit_client;
+        received += data_read;
+        if ((expect_len > 0) && (received > expect_len)) {
+    		ESP_LOGE(TAG, "More than expected bytes received %u > %u\n", received, expect_len);
+    		break;
         }
-        if ((binary_file_length + data_read) > update_partition->size) {
-    		ESP_LOGE(TAG, "Received more bytes than the partition size: %u > %u\n", binary_file_length+data_read, update_partition->size);
-    		goto exit_client;
-		}
+        chunk.buf = buf;
+        chunk.len = data_read;
+        xQueueSend(pipe->full_q, &chunk, portMAX_DELAY);
+        buf = NULL;
+        mp_printf(&mp_plat_print, "%s Received %d bytes\r", TAG, resume_ofs + received);
+        if (pipe->err != ESP_OK) break;
+
+        // Next buffer is available when the writer is at most OTA_RING_BUFFERS-1 chunks behind
+        xQueueReceive(pipe->free_q, &buf, portMAX_DELAY);
+        data_read = ota_http_read(client, buf, BUFFSIZE);
     }
+    if (buf) xQueueSend(pipe->free_q, &buf, portMAX_DELAY);
+
+    // Signal the end of data and wait for the writer to finish
+    chunk.buf = NULL;
+    chunk.len = ((data_read < 0) || ((expect_len > 0) && (received != expect_len))) ? -1 : 0;
+    xQueueSend(pipe->full_q, &chunk, portMAX_DELAY);
+    xSemaphoreTake(pipe->done, portMAX_DELAY);
+    writer_started = false;
+    mp_printf(&mp_plat_print,"                                                         \n");
 
-	mbedtls_md5_finish( &ctx, md5_byte_array );
-    mbedtls_md5_free( &ctx );
-    for (int i = 0; i<16; i++){
-        sprintf(local_md5+(i*2),"%02x", md5_byte_array[i]);
+    if (pipe->err != ESP_OK) goto exit_client;
+    if (data_read < 0) {
+        ESP_LOGE(TAG, "Error reading from server (%d)", data_read);
+        interrupted = true;
+        goto exit_client;
     }
 
-    mp_printf(&mp_plat_print,"                                                         \n");
     ESP_LOGI(TAG, "Connection closed, all packets received");
-	ESP_LOGI(TAG, "Image written, total length = %d bytes\n", binary_file_length);
-	if ((expect_len > 0) && (expect_len != binary_file_length)) {
-		ESP_LOGE(TAG, "Expected image length not equal to received length: %u <> %u\n", expect_len, binary_file_length);
+	ESP_LOGI(TAG, "Image written, total length = %u bytes\n", pipe->offset);
+	if ((expect_len > 0) && (expect_len != received)) {
+		ESP_LOGE(TAG, "Expected image length not equal to received length: %u <> %u\n", expect_len, received);
+		interrupted = (received < expect_len);
 		goto exit_client;
 	}
-   	if (md5) {
-		if (strlen(remote_md5) == 32) {
-			if (strncmp(remote_md5, local_md5, 32) == 0) {
-				ESP_LOGI(TAG, "MD5 Checksum check PASSED.");
-			}
-			else {
-				ESP_LOGE(TAG, "MD5 Checksum check FAILED!");
-				goto exit_client;
-			}
-		}
+
+    unsigned char digest[32];
+	mbedtls_md5_finish(&pipe->md5_ctx, digest);
+	ota_hex_digest(digest, 16, local_md5);
+	mbedtls_sha256_finish(&pipe->sha_ctx, digest);
+	ota_hex_digest(digest, 32, local_sha256);
+
+    // The image is complete, it is either verified and booted or must be downloaded again
+    ota_resume_clear();
+
+   	if (strlen(remote_md5) == 32) {
+        if (strncasecmp(remote_md5, local_md5, 32) == 0) {
+            ESP_LOGI(TAG, "MD5 Checksum check PASSED.");
+        }
+        else {
+            ESP_LOGE(TAG, "MD5 Checksum check FAILED!");
+            goto exit_client;
+        }
+   	}
+   	if (sha256_str) {
+        if ((strlen(sha256_str) == 64) && (strncasecmp(sha256_str, local_sha256, 64) == 0)) {
+            ESP_LOGI(TAG, "SHA256 Checksum check PASSED.");
+        }
+        else {
+            ESP_LOGE(TAG, "SHA256 Checksum check FAILED!");
+            goto exit_client;
+        }
    	}
 
-    err = esp_ota_end(update_handle);
-    if (err != ESP_OK) {
-        ESP_LOGE(TAG, "OTA end failed! err=0x%x", err);
-        goto exit_client;
-    }
 	mp_hal_reset_wdt();
-    // === Set boot partition ===
+    // === Set boot partition, the image is verified before it is set as boot partition ===
     err = esp_ota_set_boot_partition(update_partition);
     if (err != ESP_OK) {
         ESP_LOGE(TAG, "OTA set_boot_partition failed! err=0x%x", err);
@@ -311,14 +642,34 @@ static esp_err_t mpy_ota_update(const char *upd_url, uint8_t md5, uint8_t force_
     }
     ESP_LOGW(TAG, "On next reboot the system will be started from '%s' partition", update_partition->label);
     errexit = ESP_OK;
-    goto exit;
 
 exit_client:
+    if (writer_started) {
+        chunk.buf = NULL;
+        chunk.len = -1;
+        xQueueSend(pipe->full_q, &chunk, portMAX_DELAY);
+        xSemaphoreTake(pipe->done, portMAX_DELAY);
+    }
+    // After an interrupted download the update is continued from the saved resume point,
+    // on any other failure the partition content can't be used
+    if ((errexit != ESP_OK) && (pipe->offset > resume_ofs) && (!interrupted)) ota_resume_clear();
     esp_http_client_close(client);
     esp_http_client_cleanup(client);
 
 exit:
-	if (ota_write_data) free(ota_write_data);
+	if (pipe) {
+	    mbedtls_md5_free(&pipe->md5_ctx);
+	    mbedtls_sha256_free(&pipe->sha_ctx);
+        if (pipe->free_q) vQueueDelete(pipe->free_q);
+        if (pipe->full_q) vQueueDelete(pipe->full_q);
+        if (pipe->done) vSemaphoreDelete(pipe->done);
+        #if MICROPY_PY_UZLIB
+        if (pipe->out_buf) free(pipe->out_buf);
+        if (pipe->dict) free(pipe->dict);
+        #endif
+        free(pipe);
+	}
+	if (ring_mem) free(ring_mem);
 
 	return errexit;
 }
@@ -371,6 +722,8 @@ static esp_err_t mpy_ota_fileupdate(const char *fname, uint8_t force_fact)
    	ESP_LOGI(TAG, "Starting OTA update from '%s' to '%s' partition", running_partition->label, update_partition->label);
 
 	mp_hal_reset_wdt();
+    // The partition is overwritten, an interrupted download to it can't be resumed
+    ota_resume_clear();
     // Begin update
     err = esp_ota_begin(update_partition, OTA_SIZE_UNKNOWN, &update_handle);
     if (err != ESP_OK) {
@@ -513,25 +866,46 @@ exit:
 //------------------------------------------------------------------------------------------
 STATIC mp_obj_t mod_ota_start(mp_uint_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
-	enum { ARG_url,  ARG_restart, ARG_md5, ARG_forceFact, ARG_cert };
+	enum { ARG_url,  ARG_restart, ARG_md5, ARG_forceFact, ARG_cert, ARG_sha256, ARG_resume };
     const mp_arg_t allowed_args[] = {
 			{ MP_QSTR_url,          MP_ARG_REQUIRED | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
 			{ MP_QSTR_restart,      MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
-			{ MP_QSTR_md5,          MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
+			{ MP_QSTR_md5,          MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_false} },
 			{ MP_QSTR_forceFactory, MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
             { MP_QSTR_certificate,  MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_sha256,       MP_ARG_KW_ONLY  | MP_ARG_OBJ,  {.u_obj = mp_const_none} },
+			{ MP_QSTR_resume,       MP_ARG_KW_ONLY  | MP_ARG_BOOL, {.u_bool = false} },
 	};
 	mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
     mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
 
     const char *url = mp_obj_str_get_str(args[ARG_url].u_obj);
 
+    // md5 can be the expected MD5 hex digest or True to get it from '<url>.md5' file
+    const char *md5_str = NULL;
+    bool md5_fetch = false;
+    if (MP_OBJ_IS_STR(args[ARG_md5].u_obj)) {
+        md5_str = mp_obj_str_get_str(args[ARG_md5].u_obj);
+        if (strlen(md5_str) != 32) {
+            mp_raise_ValueError("md5 must be 32 hex characters");
+        }
+    }
+    else md5_fetch = mp_obj_is_true(args[ARG_md5].u_obj);
+
+    const char *sha256_str = NULL;
+    if (args[ARG_sha256].u_obj != mp_const_none) {
+        sha256_str = mp_obj_str_get_str(args[ARG_sha256].u_obj);
+        if (strlen(sha256_str) != 64) {
+            mp_raise_ValueError("sha256 must be 64 hex characters");
+        }
+    }
+
     if (cert_pem) free(cert_pem);
     cert_pem = NULL;
 
     get_certificate(args[ARG_cert].u_obj, cert_pem);
 
-    esp_err_t res = mpy_ota_update(url, args[ARG_md5].u_bool, args[ARG_forceFact].u_bool);
+    esp_err_t res = mpy_ota_update(url, md5_fetch, md5_str, sha256_str, args[ARG_resume].u_bool, args[ARG_forceFact].u_bool);
 
     if (cert_pem) free(cert_pem);
     cert_pem = NULL;
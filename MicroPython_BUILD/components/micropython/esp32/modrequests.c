@@ -30,6 +30,7 @@
 #ifdef CONFIG_MICROPY_USE_REQUESTS
 
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -45,21 +46,54 @@
 
 #include "py/obj.h"
 #include "py/runtime.h"
+#include "py/mphal.h"
+#include "py/stream.h"
 #include "modmachine.h"
 #include "extmod/vfs_native.h"
 #include "modnetwork.h"
 
 #define MAX_HTTP_RECV_BUFFER 512
+#define RQ_CLIENT_BUFFER_SIZE 1024
+#define RQ_DEFAULT_TIMEOUT 5000
+#define RQ_MAX_POOL 4
+#define RQ_MAX_CONN_KEY 80
 static const char *TAG = "[REQUESTS]";
 
-static char *rqheader = NULL;
-static char *rqbody = NULL;
-static FILE* rqbody_file = NULL;
-static int rqheader_len = 0;
-static int rqheader_ptr = 0;
-static int rqbody_len = 0;
-static int rqbody_ptr = 0;
-static bool rqbody_ok = true;
+// Response state of one request
+// Module functions use a local instance for each request,
+// each Session connection has its own
+typedef struct _rq_response_t {
+    char *header;
+    int header_len;
+    int header_ptr;
+    char *body;
+    int body_len;
+    int body_ptr;
+    bool body_ok;
+    bool stream;                // body is read by the Response object, not collected
+    FILE *body_file;
+} rq_response_t;
+
+// Open connection kept in the session pool
+typedef struct _rq_conn_t {
+    esp_http_client_handle_t client;
+    rq_response_t resp;
+    char key[RQ_MAX_CONN_KEY];  // scheme://host:port
+    uint32_t last_used;         // ms
+    bool busy;                  // used by the open streamed Response
+} rq_conn_t;
+
+typedef struct _requests_session_obj_t {
+    mp_obj_base_t base;
+    rq_conn_t pool[RQ_MAX_POOL];
+    int pool_size;
+    int timeout;                // ms
+    uint32_t idle_timeout;      // ms, idle connections are closed before reuse
+    uint32_t n_requests;
+    uint32_t n_connects;
+    uint32_t n_reused;
+} requests_session_obj_t;
+
 static bool rq_debug = false;
 static bool rq_base64 = false;
 static char *cert_pem = NULL;
@@ -77,6 +111,8 @@ static char *cert_pem = NULL;
 //----------------------------------------------------------------
 static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
 {
+    rq_response_t *resp = (rq_response_t *)evt->user_data;
+
     switch(evt->event_id) {
         case HTTP_EVENT_ERROR:
             if (rq_debug) ESP_LOGD(TAG, "HTTP_EVENT_ERROR");
@@ -93,69 +129,83 @@ static esp_err_t _http_event_handler(esp_http_client_event_t *evt)
             break;
         case HTTP_EVENT_ON_HEADER:
             if (rq_debug) ESP_LOGD(TAG, "HTTP_EVENT_ON_HEADER, key=%s, value=%s", evt->header_key, evt->header_value);
-            if (rqheader == NULL) {
-                rqheader = malloc(256);
-                if (rqheader) {
-                    rqheader_len = 256;
-                    rqheader_ptr = 0;
-                    rqheader[0] = '\0';
+            if (resp->header == NULL) {
+                resp->header = malloc(256);
+                if (resp->header) {
+                    resp->header_len = 256;
+                    resp->header_ptr = 0;
+                    resp->header[0] = '\0';
                 }
             }
-            if (rqheader) {
-                bool f = true;
-                int len = strlen(evt->header_key) + strlen(evt->header_value) + rqheader_ptr + 5;
-                if (len > rqheader_len) {
-                    char *tmphdr = realloc(rqheader, len + 128);
+            if (resp->header) {
+                int klen = strlen(evt->header_key);
+                int vlen = strlen(evt->header_value);
+                int len = klen + vlen + resp->header_ptr + 5;
+                if (len > resp->header_len) {
+                    // grow to double size, the headers are appended in place
+                    int new_len = (len > (resp->header_len * 2)) ? len : (resp->header_len * 2);
+                    char *tmphdr = realloc(resp->header, new_len);
                     if (tmphdr) {
-                        rqheader = tmphdr;
-                        rqheader_len = len + 128;
+                        resp->header = tmphdr;
+                        resp->header_len = new_len;
                     }
-                    else f = false;
-                }
-                if (f) {
-                    strcat(rqheader, evt->header_key);
-                    strcat(rqheader, ": ");
-                    strcat(rqheader, evt->header_value);
-                    strcat(rqheader, "\r\n");
-                    rqheader_ptr = strlen(rqheader);
+                    else break;
                 }
+                char *hdr = resp->header + resp->header_ptr;
+                memcpy(hdr, evt->header_key, klen);
+                hdr += klen;
+                *hdr++ = ':';
+                *hdr++ = ' ';
+                memcpy(hdr, evt->header_value, vlen);
+                hdr += vlen;
+                *hdr++ = '\r';
+                *hdr++ = '\n';
+                *hdr = '\0';
+                resp->header_ptr = hdr - resp->header;
             }
             break;
         case HTTP_EVENT_ON_DATA:
-            if (rq_debug) ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d, rqptr=%d [%d]", evt->data_len, rqbody_ptr, rqbody_len);
-            if (rqbody_ok) {
-                if (rqbody_file) {
-                    int nwrite = fwrite(evt->data, 1, evt->data_len, rqbody_file);
+            if (rq_debug) ESP_LOGD(TAG, "HTTP_EVENT_ON_DATA, len=%d, rqptr=%d [%d]", evt->data_len, resp->body_ptr, resp->body_len);
+            if (resp->stream) break; // read by the Response object
+            if (resp->body_ok) {
+                if (resp->body_file) {
+                    int nwrite = fwrite(evt->data, 1, evt->data_len, resp->body_file);
                     if (nwrite <= 0) {
-                        rqbody_ok = false;
+                        resp->body_ok = false;
                         ESP_LOGE(TAG, "Download: Error writing to file %d", nwrite);
                     }
                 }
                 else {
-                    if (rqbody == NULL) {
-                        rqbody = malloc(4096);
-                        if (rqbody) {
-                            rqbody_len = 4096;
-                            rqbody_ptr = 0;
+                    if (resp->body == NULL) {
+                        // allocate the whole body at once if the length is known
+                        int blen = esp_http_client_get_content_length(evt->client);
+                        if ((blen <= 0) || (blen > (1024*1024))) blen = 4096;
+                        if (blen < evt->data_len) blen = evt->data_len;
+                        resp->body = malloc(blen);
+                        if (resp->body) {
+                            resp->body_len = blen;
+                            resp->body_ptr = 0;
                         }
                     }
-                    if (rqbody) {
-                        int len = evt->data_len + rqbody_ptr;
-                        if (len > rqbody_len) {
-                            char *tmpbody = realloc(rqbody, len + 512);
+                    if (resp->body) {
+                        int len = evt->data_len + resp->body_ptr;
+                        if (len > resp->body_len) {
+                            // grow to double size, not chunk by chunk
+                            int new_len = (len > (resp->body_len * 2)) ? len : (resp->body_len * 2);
+                            char *tmpbody = realloc(resp->body, new_len);
                             if (tmpbody) {
-                                rqbody = tmpbody;
-                                rqbody_len = len + 512;
+                                resp->body = tmpbody;
+                                resp->body_len = new_len;
                             }
                             else {
-                                rqbody_ok = false;
+                                resp->body_ok = false;
                                 ESP_LOGE(TAG, "Error reallocating body buffer");
                             }
                         }
 
-                        if (rqbody_ok) {
-                            memcpy(rqbody + rqbody_ptr, evt->data, evt->data_len);
-                            rqbody_ptr += evt->data_len;
+                        if (resp->body_ok) {
+                            memcpy(resp->body + resp->body_ptr, evt->data, evt->data_len);
+                            resp->body_ptr += evt->data_len;
                         }
                     }
                 }
@@ -627,73 +677,119 @@ static int multipart_post_fields(mp_obj_dict_t *dict, char *bndry, esp_http_clie
     return data_len;
 }
 
-//--------------------------------------------------------------------------------------------------
-static mp_obj_t request(int method, bool multipart, mp_obj_t post_data_in, char * url, char *tofile)
+//--------------------------------------------------
+static void response_free_data(rq_response_t *resp)
 {
-    int status;
-    char fullname[128] = {'\0'};
-    char err_msg[128] = {'\0'};
-    esp_err_t err;
-    bool perform_handled = false;
-    bool free_post_data = false;
+    if (resp->header) free(resp->header);
+    if (resp->body) free(resp->body);
+    resp->header = NULL;
+    resp->header_len = 0;
+    resp->header_ptr = 0;
+    resp->body = NULL;
+    resp->body_len = 0;
+    resp->body_ptr = 0;
+    resp->body_ok = true;
+    resp->stream = false;
+}
 
-    // Disable logging
-    if (!rq_debug) {
-        esp_log_level_set("HTTP_CLIENT", ESP_LOG_WARN);
-        esp_log_level_set("TRANSPORT", ESP_LOG_WARN);
-        esp_log_level_set("TRANS_SSL", ESP_LOG_WARN);
+//----------------------------------------------
+static void response_free(rq_response_t *resp)
+{
+    response_free_data(resp);
+    if (resp->body_file) {
+        fclose(resp->body_file);
+        native_vfs_file_changed();
     }
+    resp->body_file = NULL;
+}
 
-    // Check if the response is redirected to file
-    rqbody_file = NULL;
+// Prepare the response for the new request
+// If 'tofile' is given, the response body is redirected to file
+//----------------------------------------------------------------
+static void response_init(rq_response_t *resp, char *tofile)
+{
+    response_free(resp);
     if (tofile) {
         // GET to file
+        char fullname[128] = {'\0'};
         int res = physicalPath(tofile, fullname);
         if ((res != 0) || (strlen(fullname) == 0)) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error resolving file name"));
         }
-        rqbody_file = fopen(fullname, "wb");
-        if (rqbody_file == NULL) {
+        resp->body_file = fopen(fullname, "wb");
+        if (resp->body_file == NULL) {
             nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error opening file"));
         }
     }
+}
+
+// Return the request result tuple (status, header, body) and free the response data
+// Raise the exception if the request failed
+//------------------------------------------------------------------------------------------------------------
+static mp_obj_t response_result(rq_response_t *resp, esp_err_t err, char *err_msg, int status, char *tofile)
+{
+    if (err != ESP_OK) {
+        response_free(resp);
+        if (err == ESP_ERR_INVALID_ARG) {
+            nlr_raise(mp_obj_new_exception_msg_varg(&mp_type_OSError, "%s", err_msg));
+        }
+        ESP_LOGE(TAG, "HTTP Request failed: %s [%s]", esp_err_to_name(err), err_msg);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "HTTP Request failed"));
+    }
+
+    mp_obj_t tuple[3];
+
+    tuple[0] = mp_obj_new_int(status);
+    if ((resp->header) && (resp->header_ptr)) tuple[1] = mp_obj_new_str(resp->header, resp->header_ptr);
+    else tuple[1] = mp_const_none;
+
+    if (resp->body_file) tuple[2] = mp_obj_new_str(tofile, strlen(tofile));
+    else if ((resp->body) && (resp->body_ptr)) tuple[2] = mp_obj_new_str(resp->body, resp->body_ptr);
+    else tuple[2] = mp_const_none;
+
+    response_free(resp);
+
+    return mp_obj_new_tuple(3, tuple);
+}
+
+//----------------------------
+static void set_log_level()
+{
+    // Disable logging
+    if (!rq_debug) {
+        esp_log_level_set("HTTP_CLIENT", ESP_LOG_WARN);
+        esp_log_level_set("TRANSPORT", ESP_LOG_WARN);
+        esp_log_level_set("TRANS_SSL", ESP_LOG_WARN);
+    }
+}
 
+// Perform the request on the initialized client
+// The client is not cleaned up, the connection can be reused for the next request to the same host
+// On argument error ESP_ERR_INVALID_ARG is returned and 'err_msg' is set
+//-----------------------------------------------------------------------------------------------------------------------------------------
+static esp_err_t request_perform(esp_http_client_handle_t client, int method, bool multipart, mp_obj_t post_data_in, char *err_msg)
+{
+    esp_err_t err = ESP_OK;
+    bool perform_handled = false;
     char* post_data = NULL;
+    bool free_post_data = false;
     char bndry[32];
 
-    esp_http_client_config_t config = {0};
-    config.url = url;
-    config.event_handler = _http_event_handler;
-    config.buffer_size = 1024;
+    set_log_level();
 
-    // Initialize the http_client and set the method
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    if (client == NULL) {
-        if (rqbody_file) fclose(rqbody_file);
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error initializing http client"));
-    }
     esp_http_client_set_method(client, method);
 
-    if (rqheader) free(rqheader);
-    if (rqbody) free(rqbody);
-    rqheader = NULL;
-    rqheader_len = 0;
-    rqbody = NULL;
-    rqbody_len = 0;
-    rqbody_ptr = 0;
-    rqbody_ok = true;
-
     if (method == HTTP_METHOD_POST) {
         mp_obj_dict_t *dict;
         if (!multipart) {
             if (MP_OBJ_IS_TYPE(post_data_in, &mp_type_dict)) {
                 dict = MP_OBJ_TO_PTR(post_data_in);
                 post_data = url_post_fields(dict);
-                err = esp_http_client_set_post_field(client, post_data, strlen(post_data));
+                err = esp_http_client_set_post_field(client, (post_data) ? post_data : "", (post_data) ? strlen(post_data) : 0);
                 if (err != ESP_OK) {
-                    if (rqbody_file) fclose(rqbody_file);
-                    free(post_data);
-                    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error setting post fields"));
+                    if (post_data) free(post_data);
+                    sprintf(err_msg, "Error setting post fields");
+                    return ESP_ERR_INVALID_ARG;
                 }
                 free_post_data = true;
             }
@@ -701,13 +797,13 @@ static mp_obj_t request(int method, bool multipart, mp_obj_t post_data_in, char
                 post_data = (char *)mp_obj_str_get_str(post_data_in);
                 err = esp_http_client_set_post_field(client, post_data, strlen(post_data));
                 if (err != ESP_OK) {
-                    if (rqbody_file) fclose(rqbody_file);
-                    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error setting post fields"));
+                    sprintf(err_msg, "Error setting post fields");
+                    return ESP_ERR_INVALID_ARG;
                 }
             }
             else {
-                if (rqbody_file) fclose(rqbody_file);
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Expected Dict or String type argument"));
+                sprintf(err_msg, "Expected Dict or String type argument");
+                return ESP_ERR_INVALID_ARG;
             }
         }
         else {
@@ -716,8 +812,8 @@ static mp_obj_t request(int method, bool multipart, mp_obj_t post_data_in, char
                 dict = MP_OBJ_TO_PTR(post_data_in);
             }
             else {
-                if (rqbody_file) fclose(rqbody_file);
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Expected Dict type argument"));
+                sprintf(err_msg, "Expected Dict type argument");
+                return ESP_ERR_INVALID_ARG;
             }
 
             // Prepare multipart boundary
@@ -727,7 +823,8 @@ static mp_obj_t request(int method, bool multipart, mp_obj_t post_data_in, char
             // Get body length
             int cont_len = multipart_post_fields(dict, bndry, client, false);
             if (cont_len <= 0) {
-                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Nothing to send"));
+                sprintf(err_msg, "Nothing to send");
+                return ESP_ERR_INVALID_ARG;
             }
             char temp_buf[128];
             sprintf(temp_buf, "multipart/form-data; boundary=%s", bndry);
@@ -746,12 +843,11 @@ static mp_obj_t request(int method, bool multipart, mp_obj_t post_data_in, char
                 cont_len = multipart_post_fields(dict, bndry, client, true);
 
                 // Check response
-                if ((esp_http_client_perform_response(client)) != ESP_OK) {
+                if ((err = esp_http_client_perform_response(client)) != ESP_OK) {
                     sprintf(err_msg, "Http client error: response");
                     break;
                 }
             } while (esp_http_client_process_again(client));
-            esp_http_client_cleanup(client);
             MP_THREAD_GIL_ENTER();
             perform_handled = true;
         }
@@ -775,70 +871,518 @@ static mp_obj_t request(int method, bool multipart, mp_obj_t post_data_in, char
                     cont_len = handle_file(client, NULL, NULL, post_data, true);
 
                     // Check response
-                    if ((esp_http_client_perform_response(client)) != ESP_OK) {
+                    if ((err = esp_http_client_perform_response(client)) != ESP_OK) {
                         sprintf(err_msg, "Http client error: response");
                         break;
                     }
                 } while (esp_http_client_process_again(client));
-                esp_http_client_cleanup(client);
                 MP_THREAD_GIL_ENTER();
                 perform_handled = true;
             }
             else {
                 err = esp_http_client_set_post_field(client, post_data, strlen(post_data));
                 if (err != ESP_OK) {
-                    if (rqbody_file) fclose(rqbody_file);
-                    nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error setting post fields"));
+                    sprintf(err_msg, "Error setting post fields");
+                    return ESP_ERR_INVALID_ARG;
                 }
             }
         }
         else {
-            if (rqbody_file) fclose(rqbody_file);
-            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Expected String type argument"));
+            sprintf(err_msg, "Expected String type argument");
+            return ESP_ERR_INVALID_ARG;
         }
     }
 
     if (!perform_handled) {
         MP_THREAD_GIL_EXIT();
         err = esp_http_client_perform(client);
-        esp_http_client_cleanup(client);
-        if ((free_post_data) && (post_data)) free(post_data);
         MP_THREAD_GIL_ENTER();
     }
+    if ((free_post_data) && (post_data)) free(post_data);
 
-    if (err != ESP_OK) {
-        if (rqbody_file) fclose(rqbody_file);
-        if (rqheader) free(rqheader);
-        if (rqbody) free(rqbody);
-        rqbody_file = NULL;
-        rqheader = NULL;
-        rqbody = NULL;
-        ESP_LOGE(TAG, "HTTP Request failed: %s [%s]", esp_err_to_name(err), err_msg);
-        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "HTTP Request failed"));
+    return err;
+}
+
+//--------------------------------------------------------------------------------------------------
+static mp_obj_t request(int method, bool multipart, mp_obj_t post_data_in, char * url, char *tofile)
+{
+    int status = 0;
+    char err_msg[128] = {'\0'};
+    rq_response_t resp = {0};
+
+    // Check if the response is redirected to file
+    response_init(&resp, tofile);
+
+    esp_http_client_config_t config = {0};
+    config.url = url;
+    config.event_handler = _http_event_handler;
+    config.user_data = &resp;
+    config.buffer_size = RQ_CLIENT_BUFFER_SIZE;
+
+    // Initialize the http_client
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    if (client == NULL) {
+        response_free(&resp);
+        nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error initializing http client"));
     }
 
-    status = esp_http_client_get_status_code(client);
+    esp_err_t err = request_perform(client, method, multipart, post_data_in, err_msg);
+    if (err == ESP_OK) status = esp_http_client_get_status_code(client);
+    esp_http_client_cleanup(client);
 
-    mp_obj_t tuple[3];
+    return response_result(&resp, err, err_msg, status, tofile);
+}
 
-    tuple[0] = mp_obj_new_int(status);
-    if ((rqheader) && (rqheader_ptr)) tuple[1] = mp_obj_new_str(rqheader, rqheader_ptr);
-    else tuple[1] = mp_const_none;
 
-    if (rqbody_file) tuple[2] = mp_obj_new_str(tofile, strlen(tofile));
-    else if ((rqbody) && (rqbody_ptr)) tuple[2] = mp_obj_new_str(rqbody, rqbody_ptr);
-    else tuple[2] = mp_const_none;
+// ==== Session, keeps the connections open for the next requests ====
 
-    if (rqbody_file) fclose(rqbody_file);
-    if (rqheader) free(rqheader);
-    if (rqbody) free(rqbody);
-    rqbody_file = NULL;
-    rqheader = NULL;
-    rqbody = NULL;
+// Get the connection pool key (scheme://host:port) from url
+//-----------------------------------------------------
+static bool session_conn_key(const char *url, char *key)
+{
+    const char *host = strstr(url, "://");
+    if (host == NULL) return false;
+    host += 3;
+    int len = strcspn(host, "/?#") + (host - url);
+    if (len >= RQ_MAX_CONN_KEY) return false;
+    memcpy(key, url, len);
+    key[len] = '\0';
+    // explicit default ports use the same connection
+    if ((strncasecmp(key, "http:", 5) == 0) && (len > 3) && (strcmp(key+len-3, ":80") == 0)) key[len-3] = '\0';
+    else if ((strncasecmp(key, "https:", 6) == 0) && (len > 4) && (strcmp(key+len-4, ":443") == 0)) key[len-4] = '\0';
+    return true;
+}
 
-    return mp_obj_new_tuple(3, tuple);
+//------------------------------------------------------------------------
+static void session_close_conn(requests_session_obj_t *self, rq_conn_t *conn)
+{
+    // also called from the finaliser, the GIL is not released
+    if (conn->client) esp_http_client_cleanup(conn->client);
+    conn->client = NULL;
+    conn->key[0] = '\0';
+    conn->busy = false;
+    response_free(&conn->resp);
 }
 
+// Return the pooled connection for the url's host or create the new one
+// If the pool is full, the least recently used connection is closed
+// Connections used by the open streamed responses are not used
+//------------------------------------------------------------------------------------------------------
+static rq_conn_t *session_get_conn(requests_session_obj_t *self, const char *url, bool *reused)
+{
+    char key[RQ_MAX_CONN_KEY];
+    rq_conn_t *conn = NULL;
+    uint32_t now = mp_hal_ticks_ms();
+
+    *reused = false;
+    if (!session_conn_key(url, key)) return NULL;
+
+    for (int i=0; i<self->pool_size; i++) {
+        if ((self->pool[i].client) && (!self->pool[i].busy) && (strcasecmp(self->pool[i].key, key) == 0)) {
+            conn = &self->pool[i];
+            break;
+        }
+    }
+    if ((conn) && (self->idle_timeout) && ((now - conn->last_used) > self->idle_timeout)) {
+        // most servers close the idle connection, don't try to use it
+        session_close_conn(self, conn);
+    }
+
+    if ((conn) && (conn->client)) {
+        // Reuse the open connection
+        esp_http_client_set_url(conn->client, url);
+        // clear the settings of the previous request
+        esp_http_client_set_post_field(conn->client, NULL, 0);
+        esp_http_client_delete_header(conn->client, "Content-Type");
+        *reused = true;
+        self->n_reused++;
+        return conn;
+    }
+
+    if (conn == NULL) {
+        // Use the free or the least recently used pool entry
+        for (int i=0; i<self->pool_size; i++) {
+            if (self->pool[i].busy) continue;
+            if (self->pool[i].client == NULL) {
+                conn = &self->pool[i];
+                break;
+            }
+            if ((conn == NULL) || ((now - self->pool[i].last_used) > (now - conn->last_used))) conn = &self->pool[i];
+        }
+        if (conn == NULL) return NULL; // all connections are used by streamed responses
+        session_close_conn(self, conn);
+    }
+
+    esp_http_client_config_t config = {0};
+    config.url = url;
+    config.event_handler = _http_event_handler;
+    config.user_data = &conn->resp;
+    config.buffer_size = RQ_CLIENT_BUFFER_SIZE;
+    config.timeout_ms = self->timeout;
+
+    conn->client = esp_http_client_init(&config);
+    if (conn->client == NULL) return NULL;
+    strcpy(conn->key, key);
+    conn->last_used = now;
+    self->n_connects++;
+    return conn;
+}
+
+//-------------------------------------------------------------------------------------------------------------------------------------------
+static mp_obj_t session_request(requests_session_obj_t *self, int method, bool multipart, mp_obj_t post_data_in, char * url, char *tofile)
+{
+    int status = 0;
+    char err_msg[128] = {'\0'};
+    esp_err_t err = ESP_FAIL;
+    rq_conn_t *conn = NULL;
+
+    self->n_requests++;
+    for (int attempt=0; attempt<2; attempt++) {
+        bool reused;
+        conn = session_get_conn(self, url, &reused);
+        if (conn == NULL) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error initializing http client"));
+        }
+        // Check if the response is redirected to file
+        response_init(&conn->resp, tofile);
+
+        err = request_perform(conn->client, method, multipart, post_data_in, err_msg);
+        if (err == ESP_OK) {
+            status = esp_http_client_get_status_code(conn->client);
+            conn->last_used = mp_hal_ticks_ms();
+            break;
+        }
+        // Don't leave the failed connection in the pool
+        session_close_conn(self, conn);
+        // The server may have closed the kept-alive connection, retry once on the new one
+        if ((!reused) || (err == ESP_ERR_INVALID_ARG)) break;
+        if (rq_debug) ESP_LOGD(TAG, "Reused connection failed, reconnecting");
+        err_msg[0] = '\0';
+    }
+
+    return response_result(&conn->resp, err, err_msg, status, tofile);
+}
+
+// ==== Streamed response ====
+// get(url, stream=True) returns the Response object instead of the tuple,
+// the body is not collected but read from the connection by the application,
+// in chunks of its choice (readinto(), read(n), iter_content(chunk)).
+// The used RAM does not depend on the body size.
+
+typedef struct _requests_response_obj_t {
+    mp_obj_base_t base;
+    esp_http_client_handle_t client;
+    rq_response_t own_resp;             // response state if the client is owned by the response
+    requests_session_obj_t *session;    // NULL if the client is owned by the response
+    rq_conn_t *conn;                    // session connection
+    mp_obj_t headers;                   // dict
+    int status;
+    int content_length;                 // -1 if not known (chunked)
+    int nread;
+    bool eof;
+} requests_response_obj_t;
+
+typedef struct _requests_response_iter_t {
+    mp_obj_base_t base;
+    mp_fun_1_t iternext;
+    mp_obj_t response;
+    size_t chunk;
+} requests_response_iter_t;
+
+static const mp_obj_type_t requests_response_type;
+
+// Parse the collected header lines into the dictionary
+//-----------------------------------------------------
+static mp_obj_t response_headers(rq_response_t *resp)
+{
+    mp_obj_t dict = mp_obj_new_dict(0);
+    if (resp->header == NULL) return dict;
+
+    char *line = resp->header;
+    char *end = resp->header + resp->header_ptr;
+    while (line < end) {
+        char *eol = strstr(line, "\r\n");
+        if (eol == NULL) eol = end;
+        char *sep = memchr(line, ':', eol - line);
+        if (sep) {
+            char *value = sep + 1;
+            while ((value < eol) && (*value == ' ')) value++;
+            mp_obj_dict_store(dict, mp_obj_new_str(line, sep - line), mp_obj_new_str(value, eol - value));
+        }
+        line = eol + 2;
+    }
+    return dict;
+}
+
+// Send the request and read the response headers, the body is left unread
+//----------------------------------------------------------------------------------
+static esp_err_t stream_open(esp_http_client_handle_t client, int method, int *content_length)
+{
+    esp_err_t err;
+
+    esp_http_client_set_method(client, method);
+    MP_THREAD_GIL_EXIT();
+    err = esp_http_client_open(client, 0);
+    if (err == ESP_OK) {
+        if (esp_http_client_fetch_headers(client) == ESP_FAIL) err = ESP_FAIL;
+    }
+    MP_THREAD_GIL_ENTER();
+
+    *content_length = esp_http_client_get_content_length(client);
+    if ((*content_length < 0) || (esp_http_client_is_chunked_response(client))) *content_length = -1;
+    return err;
+}
+
+//------------------------------------------------------------------------------------------------------
+static mp_obj_t stream_request(requests_session_obj_t *session, int method, char *url)
+{
+    esp_err_t err = ESP_FAIL;
+    int content_length = -1;
+    rq_response_t *resp;
+
+    set_log_level();
+
+    requests_response_obj_t *self = m_new_obj_with_finaliser(requests_response_obj_t);
+    memset(self, 0, sizeof(requests_response_obj_t));
+    self->base.type = &requests_response_type;
+
+    if (session) {
+        rq_conn_t *conn = NULL;
+        if (session->pool_size == 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Session is closed"));
+        }
+        session->n_requests++;
+        for (int attempt=0; attempt<2; attempt++) {
+            bool reused;
+            conn = session_get_conn(session, url, &reused);
+            if (conn == NULL) {
+                nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error initializing http client"));
+            }
+            response_init(&conn->resp, NULL);
+            conn->resp.stream = true;
+            err = stream_open(conn->client, method, &content_length);
+            if (err == ESP_OK) break;
+            session_close_conn(session, conn);
+            // The server may have closed the kept-alive connection, retry once on the new one
+            if (!reused) break;
+        }
+        if (err != ESP_OK) {
+            ESP_LOGE(TAG, "HTTP Request failed: %s", esp_err_to_name(err));
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "HTTP Request failed"));
+        }
+        // The connection is not used by other requests until the response is closed
+        conn->busy = true;
+        self->session = session;
+        self->conn = conn;
+        self->client = conn->client;
+        resp = &conn->resp;
+    }
+    else {
+        resp = &self->own_resp;
+        resp->body_ok = true;
+        resp->stream = true;
+
+        esp_http_client_config_t config = {0};
+        config.url = url;
+        config.event_handler = _http_event_handler;
+        config.user_data = resp;
+        config.buffer_size = RQ_CLIENT_BUFFER_SIZE;
+
+        esp_http_client_handle_t client = esp_http_client_init(&config);
+        if (client == NULL) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Error initializing http client"));
+        }
+        err = stream_open(client, method, &content_length);
+        if (err != ESP_OK) {
+            esp_http_client_cleanup(client);
+            response_free(resp);
+            ESP_LOGE(TAG, "HTTP Request failed: %s", esp_err_to_name(err));
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "HTTP Request failed"));
+        }
+        self->client = client;
+    }
+
+    self->status = esp_http_client_get_status_code(self->client);
+    self->content_length = content_length;
+    self->eof = ((method == HTTP_METHOD_HEAD) || (content_length == 0));
+    // parse the headers only once, the header buffer is not needed any more
+    self->headers = response_headers(resp);
+    response_free_data(resp);
+    resp->stream = true;
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+// Close the response, the kept-alive connection is returned to the session pool
+//---------------------------------------------------------
+static void response_close(requests_response_obj_t *self)
+{
+    if (self->client == NULL) return;
+
+    if (self->session) {
+        rq_conn_t *conn = self->conn;
+        conn->busy = false;
+        conn->resp.stream = false;
+        if ((self->session->pool_size == 0) || (!self->eof)) {
+            // session closed or the rest of the body is not read, the connection can't be reused
+            session_close_conn(self->session, conn);
+        }
+        else conn->last_used = mp_hal_ticks_ms();
+    }
+    else {
+        esp_http_client_cleanup(self->client);
+        response_free(&self->own_resp);
+    }
+    self->client = NULL;
+}
+
+//-------------------------------------------------------------------------------------------
+STATIC mp_uint_t requests_response_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode)
+{
+    requests_response_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    if (self->client == NULL) {
+        *errcode = MP_EBADF;
+        return MP_STREAM_ERROR;
+    }
+    if ((self->eof) || (size == 0)) return 0;
+    if ((self->content_length >= 0) && (size > (self->content_length - self->nread))) size = self->content_length - self->nread;
+
+    // read directly into the caller's buffer
+    MP_THREAD_GIL_EXIT();
+    int n = esp_http_client_read(self->client, buf, size);
+    MP_THREAD_GIL_ENTER();
+
+    if (n < 0) {
+        *errcode = MP_EIO;
+        return MP_STREAM_ERROR;
+    }
+    self->nread += n;
+    if ((n == 0) || ((self->content_length >= 0) && (self->nread >= self->content_length))) self->eof = true;
+    return n;
+}
+
+//-------------------------------------------------------------------------------------------------
+STATIC mp_uint_t requests_response_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode)
+{
+    requests_response_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    if (request == MP_STREAM_CLOSE) {
+        response_close(self);
+        return 0;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
+//------------------------------------------------------------------------
+STATIC mp_obj_t requests_response_iternext(mp_obj_t self_in)
+{
+    requests_response_iter_t *self = MP_OBJ_TO_PTR(self_in);
+
+    vstr_t vstr;
+    vstr_init_len(&vstr, self->chunk);
+    int errcode;
+    mp_uint_t n = requests_response_read(self->response, vstr.buf, self->chunk, &errcode);
+    if (n == MP_STREAM_ERROR) {
+        vstr_clear(&vstr);
+        mp_raise_OSError(errcode);
+    }
+    if (n == 0) {
+        vstr_clear(&vstr);
+        return MP_OBJ_STOP_ITERATION;
+    }
+    vstr.len = n;
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+
+// Return the iterator over the body, yields bytes objects of max 'chunk' size
+//---------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_response_iter_content(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_chunk };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_chunk, MP_ARG_INT, { .u_int = 1024 } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all(n_args - 1, pos_args + 1, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if (args[ARG_chunk].u_int <= 0) {
+        mp_raise_ValueError("chunk must be > 0");
+    }
+
+    requests_response_iter_t *iter = m_new_obj(requests_response_iter_t);
+    iter->base.type = &mp_type_polymorph_iter;
+    iter->iternext = requests_response_iternext;
+    iter->response = pos_args[0];
+    iter->chunk = args[ARG_chunk].u_int;
+    return MP_OBJ_FROM_PTR(iter);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_response_iter_content_obj, 1, requests_response_iter_content);
+
+//-------------------------------------------------------------------
+STATIC mp_obj_t requests_response_exit(size_t n_args, const mp_obj_t *args)
+{
+    response_close(MP_OBJ_TO_PTR(args[0]));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(requests_response_exit_obj, 4, 4, requests_response_exit);
+
+//------------------------------------------------------------------------------------------
+STATIC void requests_response_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    requests_response_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    mp_printf(print, "<Response [%d], length=%d, read=%d%s>", self->status, self->content_length, self->nread, (self->client) ? "" : ", closed");
+}
+
+//================================================================
+STATIC const mp_rom_map_elem_t requests_response_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_read),         MP_ROM_PTR(&mp_stream_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readinto),     MP_ROM_PTR(&mp_stream_readinto_obj) },
+    { MP_ROM_QSTR(MP_QSTR_readline),     MP_ROM_PTR(&mp_stream_unbuffered_readline_obj) },
+    { MP_ROM_QSTR(MP_QSTR_iter_content), MP_ROM_PTR(&requests_response_iter_content_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close),        MP_ROM_PTR(&mp_stream_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__),      MP_ROM_PTR(&mp_stream_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__),    MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__),     MP_ROM_PTR(&requests_response_exit_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(requests_response_locals_dict, requests_response_locals_dict_table);
+
+// Attributes status_code, headers, content_length and raw (the response itself, as stream)
+//---------------------------------------------------------------------------------
+STATIC void requests_response_attr(mp_obj_t self_in, qstr attr, mp_obj_t *dest)
+{
+    if (dest[0] != MP_OBJ_NULL) return; // read only
+
+    requests_response_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (attr == MP_QSTR_status_code) dest[0] = MP_OBJ_NEW_SMALL_INT(self->status);
+    else if (attr == MP_QSTR_headers) dest[0] = self->headers;
+    else if (attr == MP_QSTR_content_length) dest[0] = mp_obj_new_int(self->content_length);
+    else if (attr == MP_QSTR_raw) dest[0] = self_in;
+    else {
+        // methods
+        mp_map_elem_t *elem = mp_map_lookup((mp_map_t*)&requests_response_locals_dict.map, MP_OBJ_NEW_QSTR(attr), MP_MAP_LOOKUP);
+        if (elem != NULL) mp_convert_member_lookup(self_in, &requests_response_type, elem->value, dest);
+    }
+}
+
+STATIC const mp_stream_p_t requests_response_stream_p = {
+    .read = requests_response_read,
+    .ioctl = requests_response_ioctl,
+};
+
+//============================================================
+static const mp_obj_type_t requests_response_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Response,
+    .print = requests_response_print,
+    .getiter = mp_identity_getiter,
+    .iternext = mp_stream_unbuffered_iter,
+    .attr = requests_response_attr,
+    .protocol = &requests_response_stream_p,
+    .locals_dict = (mp_obj_dict_t*)&requests_response_locals_dict,
+};
+
 //-----------------------------------------------------
 void get_certificate(mp_obj_t cert, char *cert_pem_buf)
 {
@@ -878,14 +1422,27 @@ void get_certificate(mp_obj_t cert, char *cert_pem_buf)
     }
 }
 
-//--------------------------------------------------------------------------------------
-STATIC mp_obj_t requests_GET(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+//--------------------------------------------------------------------------------------------------------------------------------------------
+static mp_obj_t do_request(requests_session_obj_t *session, int method, bool multipart, mp_obj_t post_data_in, char * url, char *tofile)
+{
+    if (session) {
+        if (session->pool_size == 0) {
+            nlr_raise(mp_obj_new_exception_msg(&mp_type_OSError, "Session is closed"));
+        }
+        return session_request(session, method, multipart, post_data_in, url, tofile);
+    }
+    return request(method, multipart, post_data_in, url, tofile);
+}
+
+//----------------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_GET_s(requests_session_obj_t *session, size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
     network_checkConnection();
-    enum { ARG_url, ARG_file };
+    enum { ARG_url, ARG_file, ARG_stream };
     const mp_arg_t allowed_args[] = {
-        { MP_QSTR_url,   MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
-        { MP_QSTR_file,                    MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_url,    MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_file,                     MP_ARG_OBJ, { .u_obj = mp_const_none } },
+        { MP_QSTR_stream, MP_ARG_KW_ONLY  | MP_ARG_BOOL, { .u_bool = false } },
     };
 
     mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
@@ -896,19 +1453,23 @@ STATIC mp_obj_t requests_GET(size_t n_args, const mp_obj_t *pos_args, mp_map_t *
 
     url = (char *)mp_obj_str_get_str(args[ARG_url].u_obj);
 
+    if (args[ARG_stream].u_bool) {
+        // The body is read by the application from the returned Response object
+        return stream_request(session, HTTP_METHOD_GET, url);
+    }
+
     if (MP_OBJ_IS_STR(args[ARG_file].u_obj)) {
         // GET to file
         fname = (char *)mp_obj_str_get_str(args[ARG_file].u_obj);
     }
 
-    mp_obj_t res = request(HTTP_METHOD_GET, false, NULL, url, fname);
+    mp_obj_t res = do_request(session, HTTP_METHOD_GET, false, NULL, url, fname);
 
     return res;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_GET_obj, 1, requests_GET);
 
-//--------------------------------------------------------------------------------------
-STATIC mp_obj_t requests_HEAD(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+//-----------------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_HEAD_s(requests_session_obj_t *session, size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
     network_checkConnection();
     enum { ARG_url };
@@ -923,14 +1484,13 @@ STATIC mp_obj_t requests_HEAD(size_t n_args, const mp_obj_t *pos_args, mp_map_t
 
     url = (char *)mp_obj_str_get_str(args[ARG_url].u_obj);
 
-    mp_obj_t res = request(HTTP_METHOD_HEAD, false, NULL, url, NULL);
+    mp_obj_t res = do_request(session, HTTP_METHOD_HEAD, false, NULL, url, NULL);
 
     return res;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_HEAD_obj, 1, requests_HEAD);
 
-//---------------------------------------------------------------------------------------
-STATIC mp_obj_t requests_POST(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+//-----------------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_POST_s(requests_session_obj_t *session, size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
     network_checkConnection();
     enum { ARG_url, ARG_params, ARG_file, ARG_multipart };
@@ -954,14 +1514,13 @@ STATIC mp_obj_t requests_POST(size_t n_args, const mp_obj_t *pos_args, mp_map_t
         fname = (char *)mp_obj_str_get_str(args[ARG_file].u_obj);
     }
 
-    mp_obj_t res = request(HTTP_METHOD_POST, args[ARG_multipart].u_bool, args[ARG_params].u_obj, url, fname);
+    mp_obj_t res = do_request(session, HTTP_METHOD_POST, args[ARG_multipart].u_bool, args[ARG_params].u_obj, url, fname);
 
     return res;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_POST_obj, 1, requests_POST);
 
-//--------------------------------------------------------------------------------------
-STATIC mp_obj_t requests_PUT(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+//-----------------------------------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_PUT_PATCH_s(requests_session_obj_t *session, int method, size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
     network_checkConnection();
     enum { ARG_url, ARG_data };
@@ -977,32 +1536,43 @@ STATIC mp_obj_t requests_PUT(size_t n_args, const mp_obj_t *pos_args, mp_map_t *
 
     url = (char *)mp_obj_str_get_str(args[ARG_url].u_obj);
 
-    mp_obj_t res = request(HTTP_METHOD_PUT, false, args[ARG_data].u_obj, url, NULL);
+    mp_obj_t res = do_request(session, method, false, args[ARG_data].u_obj, url, NULL);
 
     return res;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_PUT_obj, 1, requests_PUT);
 
-//----------------------------------------------------------------------------------------
-STATIC mp_obj_t requests_PATCH(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+//--------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_GET(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
 {
-    network_checkConnection();
-    enum { ARG_url, ARG_data };
-    const mp_arg_t allowed_args[] = {
-        { MP_QSTR_url,  MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
-        { MP_QSTR_data, MP_ARG_REQUIRED | MP_ARG_OBJ, { .u_obj = mp_const_none } },
-    };
-
-    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
-    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    return requests_GET_s(NULL, n_args, pos_args, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_GET_obj, 1, requests_GET);
 
-    char *url = NULL;
+//--------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_HEAD(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_HEAD_s(NULL, n_args, pos_args, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_HEAD_obj, 1, requests_HEAD);
 
-    url = (char *)mp_obj_str_get_str(args[ARG_url].u_obj);
+//---------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_POST(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_POST_s(NULL, n_args, pos_args, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_POST_obj, 1, requests_POST);
 
-    mp_obj_t res = request(HTTP_METHOD_PATCH, false, args[ARG_data].u_obj, url, NULL);
+//--------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_PUT(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_PUT_PATCH_s(NULL, HTTP_METHOD_PUT, n_args, pos_args, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_PUT_obj, 1, requests_PUT);
 
-    return res;
+//----------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_PATCH(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_PUT_PATCH_s(NULL, HTTP_METHOD_PATCH, n_args, pos_args, kw_args);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_PATCH_obj, 1, requests_PATCH);
 
@@ -1025,6 +1595,153 @@ STATIC mp_obj_t requests_certificate(mp_obj_t cert_in)
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(requests_certificate_obj, requests_certificate);
 
 
+// ==== Session object ====
+// Keeps up to 'pool' connections (one per host) open between the requests,
+// the HTTP/1.1 keep-alive connection is reused and the TCP connect and
+// TLS handshake are done only once.
+// Each session has its own response state; a session must not be
+// used from more than one thread at the same time.
+
+static const mp_obj_type_t requests_session_type;
+
+//-------------------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_session_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *all_args)
+{
+    enum { ARG_pool, ARG_timeout, ARG_idle };
+    const mp_arg_t allowed_args[] = {
+        { MP_QSTR_pool,    MP_ARG_INT, { .u_int = 2 } },
+        { MP_QSTR_timeout, MP_ARG_INT, { .u_int = RQ_DEFAULT_TIMEOUT } },
+        { MP_QSTR_idle,    MP_ARG_INT, { .u_int = 30 } },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_arg_parse_all_kw_array(n_args, n_kw, all_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+
+    if ((args[ARG_pool].u_int < 1) || (args[ARG_pool].u_int > RQ_MAX_POOL)) {
+        mp_raise_ValueError("pool size must be 1 ~ 4");
+    }
+
+    requests_session_obj_t *self = m_new_obj_with_finaliser(requests_session_obj_t);
+    memset(self, 0, sizeof(requests_session_obj_t));
+    self->base.type = &requests_session_type;
+    self->pool_size = args[ARG_pool].u_int;
+    self->timeout = (args[ARG_timeout].u_int > 0) ? args[ARG_timeout].u_int : RQ_DEFAULT_TIMEOUT;
+    self->idle_timeout = (args[ARG_idle].u_int > 0) ? args[ARG_idle].u_int * 1000 : 0;
+
+    return MP_OBJ_FROM_PTR(self);
+}
+
+//------------------------------------------------------------------------------------------
+STATIC void requests_session_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    requests_session_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    int nopen = 0;
+    for (int i=0; i<self->pool_size; i++) {
+        if (self->pool[i].client) nopen++;
+    }
+    mp_printf(print, "Session(pool=%d, open=%d, timeout=%d, idle=%u)", self->pool_size, nopen, self->timeout, self->idle_timeout / 1000);
+    for (int i=0; i<self->pool_size; i++) {
+        if (self->pool[i].client) mp_printf(print, "\n  %s", self->pool[i].key);
+    }
+}
+
+//---------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_session_get(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_GET_s(MP_OBJ_TO_PTR(pos_args[0]), n_args-1, pos_args+1, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_session_get_obj, 2, requests_session_get);
+
+//----------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_session_head(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_HEAD_s(MP_OBJ_TO_PTR(pos_args[0]), n_args-1, pos_args+1, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_session_head_obj, 2, requests_session_head);
+
+//----------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_session_post(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_POST_s(MP_OBJ_TO_PTR(pos_args[0]), n_args-1, pos_args+1, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_session_post_obj, 2, requests_session_post);
+
+//---------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_session_put(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_PUT_PATCH_s(MP_OBJ_TO_PTR(pos_args[0]), HTTP_METHOD_PUT, n_args-1, pos_args+1, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_session_put_obj, 2, requests_session_put);
+
+//-----------------------------------------------------------------------------------------------
+STATIC mp_obj_t requests_session_patch(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    return requests_PUT_PATCH_s(MP_OBJ_TO_PTR(pos_args[0]), HTTP_METHOD_PATCH, n_args-1, pos_args+1, kw_args);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(requests_session_patch_obj, 2, requests_session_patch);
+
+// Close all pooled connections
+//----------------------------------------------------
+STATIC mp_obj_t requests_session_close(mp_obj_t self_in)
+{
+    requests_session_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    for (int i=0; i<self->pool_size; i++) {
+        // the connection used by the open streamed Response is closed by the Response
+        if (!self->pool[i].busy) session_close_conn(self, &self->pool[i]);
+    }
+    self->pool_size = 0;
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(requests_session_close_obj, requests_session_close);
+
+//----------------------------------------------------------------
+STATIC mp_obj_t requests_session_exit(size_t n_args, const mp_obj_t *args)
+{
+    return requests_session_close(args[0]);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(requests_session_exit_obj, 4, 4, requests_session_exit);
+
+// Return (requests, connects, reused connections)
+//----------------------------------------------------
+STATIC mp_obj_t requests_session_stats(mp_obj_t self_in)
+{
+    requests_session_obj_t *self = MP_OBJ_TO_PTR(self_in);
+
+    mp_obj_t tuple[3];
+    tuple[0] = mp_obj_new_int_from_uint(self->n_requests);
+    tuple[1] = mp_obj_new_int_from_uint(self->n_connects);
+    tuple[2] = mp_obj_new_int_from_uint(self->n_reused);
+
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(requests_session_stats_obj, requests_session_stats);
+
+//================================================================
+STATIC const mp_rom_map_elem_t requests_session_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_get),         MP_ROM_PTR(&requests_session_get_obj) },
+    { MP_ROM_QSTR(MP_QSTR_head),        MP_ROM_PTR(&requests_session_head_obj) },
+    { MP_ROM_QSTR(MP_QSTR_post),        MP_ROM_PTR(&requests_session_post_obj) },
+    { MP_ROM_QSTR(MP_QSTR_put),         MP_ROM_PTR(&requests_session_put_obj) },
+    { MP_ROM_QSTR(MP_QSTR_patch),       MP_ROM_PTR(&requests_session_patch_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats),       MP_ROM_PTR(&requests_session_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_close),       MP_ROM_PTR(&requests_session_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__),     MP_ROM_PTR(&requests_session_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___enter__),   MP_ROM_PTR(&mp_identity_obj) },
+    { MP_ROM_QSTR(MP_QSTR___exit__),    MP_ROM_PTR(&requests_session_exit_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(requests_session_locals_dict, requests_session_locals_dict_table);
+
+//============================================================
+static const mp_obj_type_t requests_session_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Session,
+    .print = requests_session_print,
+    .make_new = requests_session_make_new,
+    .locals_dict = (mp_obj_dict_t*)&requests_session_locals_dict,
+};
+
+
 //================================================================
 STATIC const mp_rom_map_elem_t requests_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),    MP_ROM_QSTR(MP_QSTR_requests) },
@@ -1036,6 +1753,7 @@ STATIC const mp_rom_map_elem_t requests_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_patch),       MP_ROM_PTR(&requests_PATCH_obj) },
     { MP_ROM_QSTR(MP_QSTR_debug),       MP_ROM_PTR(&requests_debug_obj) },
     { MP_ROM_QSTR(MP_QSTR_certificate), MP_ROM_PTR(&requests_certificate_obj) },
+    { MP_ROM_QSTR(MP_QSTR_Session),     MP_ROM_PTR(&requests_session_type) },
 };
 STATIC MP_DEFINE_CONST_DICT(requests_module_globals, requests_module_globals_table);
 
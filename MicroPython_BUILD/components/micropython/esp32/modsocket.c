@@ -55,8 +55,14 @@
 #include "lwip/ip4.h"
 #include "lwip/igmp.h"
 #include "esp_log.h"
+#ifdef CONFIG_MICROPY_USE_DNS_CACHE
+#include "freertos/FreeRTOS.h"
+#include "dns_cache.h"
+#endif
 
 #define SOCKET_POLL_US (100000)
+// Maximal number of datagrams received by one recv_many() call
+#define SOCKET_RECV_MANY_MAX (16)
 
 typedef struct _socket_obj_t {
     mp_obj_base_t base;
@@ -65,6 +71,7 @@ typedef struct _socket_obj_t {
     uint8_t type;
     uint8_t proto;
     bool peer_closed;
+    bool nonblocking;
     unsigned int retries;
     #if MICROPY_PY_USOCKET_EVENTS
     mp_obj_t events_callback;
@@ -172,10 +179,16 @@ static int _socket_getaddrinfo2(const mp_obj_t host, const mp_obj_t portx, struc
         host_str = "0.0.0.0";
     }
 
+    // the names are resolved through the DNS cache (the lwip_getaddrinfo wrapper in dns_cache.c)
+    *resp = NULL;
     MP_THREAD_GIL_EXIT();
     int res = lwip_getaddrinfo(host_str, port_str, &hints, resp);
     MP_THREAD_GIL_ENTER();
 
+    if ((res != 0) || (*resp == NULL)) {
+        // getaddrinfo errors are negative (-EAI_NONAME, -EAI_FAIL)
+        mp_raise_OSError(-(res ? res : EAI_FAIL));
+    }
     return res;
 }
 
@@ -377,6 +390,7 @@ void _socket_settimeout(socket_obj_t *sock, uint64_t timeout_ms) {
     // with SOCKET_POLL_MS == 100ms, sock->retries allows for timeouts up to 13 years.
     // if timeout_ms == UINT64_MAX, wait forever.
     sock->retries = (timeout_ms == UINT64_MAX) ? UINT_MAX : timeout_ms * 1000 / SOCKET_POLL_US;
+    sock->nonblocking = (timeout_ms == 0);
 
     struct timeval timeout = {
         .tv_sec = 0,
@@ -387,6 +401,15 @@ void _socket_settimeout(socket_obj_t *sock, uint64_t timeout_ms) {
     lwip_fcntl_r(sock->fd, F_SETFL, timeout_ms ? 0 : O_NONBLOCK);
 }
 
+// Number of the blocking calls (waiting up to SOCKET_POLL_US each) after the first MSG_DONTWAIT one,
+// at least one for the socket with a timeout shorter than SOCKET_POLL_US, none for the non-blocking socket
+static unsigned int _socket_waits(socket_obj_t *sock) {
+    if (sock->nonblocking) {
+        return 0;
+    }
+    return (sock->retries == UINT_MAX) ? UINT_MAX : sock->retries + 1;
+}
+
 STATIC mp_obj_t socket_settimeout(const mp_obj_t arg0, const mp_obj_t arg1) {
     socket_obj_t *self = MP_OBJ_TO_PTR(arg0);
     if (arg1 == mp_const_none) _socket_settimeout(self, UINT64_MAX);
@@ -419,29 +442,39 @@ STATIC mp_uint_t _socket_read_data(mp_obj_t self_in, void *buf, size_t size,
     }
 
     mp_hal_set_wdt_tmo();
+    // Data already queued by lwIP is taken without releasing the GIL,
+    // it is only released for the reads which have to wait for data
+    int r = lwip_recvfrom_r(sock->fd, buf, size, MSG_DONTWAIT, from, from_len);
     // XXX Would be nicer to use RTC to handle timeouts
-    for (int i = 0; i <= sock->retries; ++i) {
-        MP_THREAD_GIL_EXIT();
-        int r = lwip_recvfrom_r(sock->fd, buf, size, 0, from, from_len);
-        MP_THREAD_GIL_ENTER();
-        if (r == 0) {
-            sock->peer_closed = true;
-        }
-        if (r >= 0) {
-            return r;
-        }
-        if (errno != EWOULDBLOCK) {
-            *errcode = errno;
-            return MP_STREAM_ERROR;
-        }
+    unsigned int waits = _socket_waits(sock);
+    for (unsigned int i = 0; (r < 0) && (errno == EWOULDBLOCK) && (i < waits); ++i) {
         check_for_exceptions();
         mp_hal_reset_wdt();
+        MP_THREAD_GIL_EXIT();
+        r = lwip_recvfrom_r(sock->fd, buf, size, 0, from, from_len);
+        MP_THREAD_GIL_ENTER();
+    }
+    if (r == 0) {
+        sock->peer_closed = true;
+    }
+    if (r >= 0) {
+        return r;
+    }
+    if (errno != EWOULDBLOCK) {
+        *errcode = errno;
+        return MP_STREAM_ERROR;
     }
 
-    *errcode = sock->retries == 0 ? MP_EWOULDBLOCK : MP_ETIMEDOUT;
+    *errcode = sock->nonblocking ? MP_EWOULDBLOCK : MP_ETIMEDOUT;
     return MP_STREAM_ERROR;
 }
 
+STATIC mp_obj_t _socket_format_addr(struct sockaddr *addr) {
+    uint8_t *ip = (uint8_t*)&((struct sockaddr_in*)addr)->sin_addr;
+    mp_uint_t port = lwip_ntohs(((struct sockaddr_in*)addr)->sin_port);
+    return netutils_format_inet_addr(ip, port, NETUTILS_BIG);
+}
+
 mp_obj_t _socket_recvfrom(mp_obj_t self_in, mp_obj_t len_in,
         struct sockaddr *from, socklen_t *from_len) {
     size_t len = mp_obj_get_int(len_in);
@@ -469,15 +502,135 @@ STATIC mp_obj_t socket_recvfrom(mp_obj_t self_in, mp_obj_t len_in) {
 
     mp_obj_t tuple[2];
     tuple[0] = _socket_recvfrom(self_in, len_in, &from, &fromlen);
-
-    uint8_t *ip = (uint8_t*)&((struct sockaddr_in*)&from)->sin_addr;
-    mp_uint_t port = lwip_ntohs(((struct sockaddr_in*)&from)->sin_port);
-    tuple[1] = netutils_format_inet_addr(ip, port, NETUTILS_BIG);
+    tuple[1] = _socket_format_addr(&from);
 
     return mp_obj_new_tuple(2, tuple);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_recvfrom_obj, socket_recvfrom);
 
+// Receive into the caller's buffer, no bytes object is allocated
+STATIC mp_uint_t _socket_recv_into(size_t n_args, const mp_obj_t *args,
+        struct sockaddr *from, socklen_t *from_len) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_WRITE);
+    size_t len = bufinfo.len;
+    if (n_args > 2) {
+        mp_int_t nbytes = mp_obj_get_int(args[2]);
+        if ((nbytes < 0) || ((size_t)nbytes > len)) {
+            mp_raise_ValueError("nbytes out of range");
+        }
+        if (nbytes > 0) {
+            len = nbytes;
+        }
+    }
+
+    int errcode;
+    mp_uint_t ret = _socket_read_data(args[0], bufinfo.buf, len, from, from_len, &errcode);
+    if (ret == MP_STREAM_ERROR) {
+        exception_from_errno(errcode);
+    }
+    return ret;
+}
+
+STATIC mp_obj_t socket_recv_into(size_t n_args, const mp_obj_t *args) {
+    return mp_obj_new_int_from_uint(_socket_recv_into(n_args, args, NULL, NULL));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recv_into_obj, 2, 3, socket_recv_into);
+
+STATIC mp_obj_t socket_recvfrom_into(size_t n_args, const mp_obj_t *args) {
+    struct sockaddr from;
+    socklen_t fromlen = sizeof(from);
+
+    mp_obj_t tuple[2];
+    tuple[0] = mp_obj_new_int_from_uint(_socket_recv_into(n_args, args, &from, &fromlen));
+    tuple[1] = _socket_format_addr(&from);
+
+    return mp_obj_new_tuple(2, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recvfrom_into_obj, 2, 3, socket_recvfrom_into);
+
+// Receive up to 'slots' datagrams into the consecutive slots of 'buf'.
+// Only the first receive may wait (depending on 'flags'), the rest only drains
+// the datagrams already queued by lwIP.
+// Called without the GIL, must not touch any MicroPython object.
+STATIC int _socket_recv_batch(int fd, uint8_t *buf, size_t slot_size, int slots,
+        int *lens, struct sockaddr_in *from, int flags, int *err) {
+    int n = 0;
+    *err = 0;
+    while (n < slots) {
+        socklen_t from_len = sizeof(struct sockaddr_in);
+        int r = lwip_recvfrom_r(fd, buf + n * slot_size, slot_size, flags, (struct sockaddr *)&from[n], &from_len);
+        if (r < 0) {
+            *err = errno;
+            break;
+        }
+        lens[n++] = r;
+        flags = MSG_DONTWAIT;
+    }
+    return n;
+}
+
+// recv_many(buf, size, lens[, addrs])
+// Receive multiple datagrams with one call, 'buf' is divided into slots of 'size' bytes,
+// one datagram per slot. The datagram lengths are stored into 'lens' (list or array)
+// and the sender addresses into 'addrs' (list), if given.
+// Waits (according to the socket timeout) only for the first datagram.
+// Returns the number of received datagrams.
+STATIC mp_obj_t socket_recv_many(size_t n_args, const mp_obj_t *args) {
+    socket_obj_t *sock = MP_OBJ_TO_PTR(args[0]);
+    if (sock->type != SOCK_DGRAM) {
+        mp_raise_OSError(MP_EOPNOTSUPP);
+    }
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(args[1], &bufinfo, MP_BUFFER_WRITE);
+    mp_int_t slot_size = mp_obj_get_int(args[2]);
+    if (slot_size <= 0) {
+        mp_raise_ValueError("invalid size");
+    }
+    mp_obj_t addrs = ((n_args > 4) && (args[4] != mp_const_none)) ? args[4] : MP_OBJ_NULL;
+
+    mp_int_t slots = MIN(bufinfo.len / slot_size, SOCKET_RECV_MANY_MAX);
+    slots = MIN(slots, mp_obj_get_int(mp_obj_len(args[3])));
+    if (addrs != MP_OBJ_NULL) {
+        slots = MIN(slots, mp_obj_get_int(mp_obj_len(addrs)));
+    }
+    if (slots <= 0) {
+        mp_raise_ValueError("no room for a datagram");
+    }
+
+    int lens[SOCKET_RECV_MANY_MAX];
+    struct sockaddr_in from[SOCKET_RECV_MANY_MAX];
+    int err;
+
+    mp_hal_set_wdt_tmo();
+    // Already queued datagrams are taken without releasing the GIL,
+    // when waiting is needed all datagrams arriving meanwhile are drained with one GIL release
+    int n = _socket_recv_batch(sock->fd, bufinfo.buf, slot_size, slots, lens, from, MSG_DONTWAIT, &err);
+    unsigned int waits = _socket_waits(sock);
+    for (unsigned int i = 0; (n == 0) && (err == EWOULDBLOCK) && (i < waits); ++i) {
+        check_for_exceptions();
+        mp_hal_reset_wdt();
+        MP_THREAD_GIL_EXIT();
+        n = _socket_recv_batch(sock->fd, bufinfo.buf, slot_size, slots, lens, from, 0, &err);
+        MP_THREAD_GIL_ENTER();
+    }
+    if (n == 0) {
+        if (err != EWOULDBLOCK) {
+            exception_from_errno(err);
+        }
+        mp_raise_OSError(sock->nonblocking ? MP_EWOULDBLOCK : MP_ETIMEDOUT);
+    }
+
+    for (int i = 0; i < n; i++) {
+        mp_obj_subscr(args[3], MP_OBJ_NEW_SMALL_INT(i), MP_OBJ_NEW_SMALL_INT(lens[i]));
+        if (addrs != MP_OBJ_NULL) {
+            mp_obj_subscr(addrs, MP_OBJ_NEW_SMALL_INT(i), _socket_format_addr((struct sockaddr *)&from[i]));
+        }
+    }
+    return MP_OBJ_NEW_SMALL_INT(n);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(socket_recv_many_obj, 4, 5, socket_recv_many);
+
 int _socket_send(socket_obj_t *sock, const char *data, size_t datalen) {
     int sentlen = 0;
     mp_hal_set_wdt_tmo();
@@ -496,21 +649,45 @@ int _socket_send(socket_obj_t *sock, const char *data, size_t datalen) {
 
 STATIC mp_obj_t socket_send(const mp_obj_t arg0, const mp_obj_t arg1) {
     socket_obj_t *sock = MP_OBJ_TO_PTR(arg0);
-    mp_uint_t datalen;
-    const char *data = mp_obj_str_get_data(arg1, &datalen);
-    int r = _socket_send(sock, data, datalen);
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(arg1, &bufinfo, MP_BUFFER_READ);
+    int r = _socket_send(sock, bufinfo.buf, bufinfo.len);
     return mp_obj_new_int(r);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_send_obj, socket_send);
 
 STATIC mp_obj_t socket_sendall(const mp_obj_t arg0, const mp_obj_t arg1) {
-    // XXX behaviour when nonblocking (see extmod/modlwip.c)
-    // XXX also timeout behaviour.
     socket_obj_t *sock = MP_OBJ_TO_PTR(arg0);
     mp_buffer_info_t bufinfo;
     mp_get_buffer_raise(arg1, &bufinfo, MP_BUFFER_READ);
-    int r = _socket_send(sock, bufinfo.buf, bufinfo.len);
-    if (r < bufinfo.len) mp_raise_OSError(MP_ETIMEDOUT);
+    const uint8_t *data = bufinfo.buf;
+    size_t sentlen = 0;
+    // The socket timeout applies to the time without any progress
+    unsigned int retries = 0;
+    unsigned int waits = _socket_waits(sock);
+
+    mp_hal_set_wdt_tmo();
+    while (sentlen < bufinfo.len) {
+        // As much as fits into the lwIP send buffer is queued without releasing the GIL
+        int r = lwip_send_r(sock->fd, data + sentlen, bufinfo.len - sentlen, MSG_DONTWAIT);
+        if ((r < 0) && (errno == EWOULDBLOCK)) {
+            if (retries++ >= waits) {
+                mp_raise_OSError(sock->nonblocking ? MP_EWOULDBLOCK : MP_ETIMEDOUT);
+            }
+            check_for_exceptions();
+            mp_hal_reset_wdt();
+            MP_THREAD_GIL_EXIT();
+            r = lwip_send_r(sock->fd, data + sentlen, bufinfo.len - sentlen, 0);
+            MP_THREAD_GIL_ENTER();
+        }
+        if ((r < 0) && (errno != EWOULDBLOCK)) {
+            exception_from_errno(errno);
+        }
+        if (r > 0) {
+            sentlen += r;
+            retries = 0;
+        }
+    }
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(socket_sendall_obj, socket_sendall);
@@ -636,6 +813,9 @@ STATIC const mp_rom_map_elem_t socket_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_sendto), MP_ROM_PTR(&socket_sendto_obj) },
     { MP_ROM_QSTR(MP_QSTR_recv), MP_ROM_PTR(&socket_recv_obj) },
     { MP_ROM_QSTR(MP_QSTR_recvfrom), MP_ROM_PTR(&socket_recvfrom_obj) },
+    { MP_ROM_QSTR(MP_QSTR_recv_into), MP_ROM_PTR(&socket_recv_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_recvfrom_into), MP_ROM_PTR(&socket_recvfrom_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_recv_many), MP_ROM_PTR(&socket_recv_many_obj) },
     { MP_ROM_QSTR(MP_QSTR_setsockopt), MP_ROM_PTR(&socket_setsockopt_obj) },
     { MP_ROM_QSTR(MP_QSTR_settimeout), MP_ROM_PTR(&socket_settimeout_obj) },
     { MP_ROM_QSTR(MP_QSTR_setblocking), MP_ROM_PTR(&socket_setblocking_obj) },
@@ -725,6 +905,245 @@ STATIC mp_obj_t esp_socket_getaddrinfo(size_t n_args, const mp_obj_t *args) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(esp_socket_getaddrinfo_obj, 2, 6, esp_socket_getaddrinfo);
 
+#ifdef CONFIG_MICROPY_USE_DNS_CACHE
+// Asynchronous getaddrinfo
+// The lookup object is pollable, it becomes readable when the result is available.
+// The lookups not yet processed are kept in the list rooted in MP_STATE_PORT(dns_async_head),
+// the resolver task only sets their status and schedules socket_dns_process()
+// which removes them from the list and calls their callbacks.
+
+#define SOCKET_DNS_CANCELLED (-10)
+
+typedef struct _socket_dns_obj_t {
+    mp_obj_base_t base;
+    struct _socket_dns_obj_t *next;
+    dns_cache_waiter_t waiter;
+    mp_obj_t host;
+    mp_obj_t callback;
+    struct in_addr addr;
+    uint16_t port;
+    volatile int8_t status;
+    bool linked;
+} socket_dns_obj_t;
+
+STATIC portMUX_TYPE socket_dns_mux = portMUX_INITIALIZER_UNLOCKED;
+STATIC bool socket_dns_scheduled = false;
+
+STATIC void socket_dns_unlink(socket_dns_obj_t *self) {
+    for (socket_dns_obj_t **d = (socket_dns_obj_t **)&MP_STATE_PORT(dns_async_head); *d; d = &(*d)->next) {
+        if (*d == self) {
+            *d = self->next;
+            break;
+        }
+    }
+    self->linked = false;
+}
+
+// Scheduled after the lookups finish, runs in the MicroPython task
+STATIC mp_obj_t socket_dns_process(mp_obj_t arg) {
+    portENTER_CRITICAL(&socket_dns_mux);
+    socket_dns_scheduled = false;
+    portEXIT_CRITICAL(&socket_dns_mux);
+
+    while (1) {
+        socket_dns_obj_t *self = MP_STATE_PORT(dns_async_head);
+        while ((self) && (self->status == DNS_CACHE_PENDING)) {
+            self = self->next;
+        }
+        if (self == NULL) {
+            break;
+        }
+        // the callback can start or cancel the lookups, the list is searched again after it
+        socket_dns_unlink(self);
+        if (self->callback != mp_const_none) {
+            mp_call_function_1_protected(self->callback, MP_OBJ_FROM_PTR(self));
+        }
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(socket_dns_process_obj, socket_dns_process);
+
+STATIC void socket_dns_finished(socket_dns_obj_t *self, int status) {
+    portENTER_CRITICAL(&socket_dns_mux);
+    self->status = status;
+    bool schedule = !socket_dns_scheduled;
+    socket_dns_scheduled = true;
+    portEXIT_CRITICAL(&socket_dns_mux);
+    if ((schedule) && (!mp_sched_schedule(MP_OBJ_FROM_PTR(&socket_dns_process_obj), mp_const_none, NULL))) {
+        // the scheduler queue is full, processed after the next lookup
+        socket_dns_scheduled = false;
+    }
+}
+
+// Called from the resolver task
+STATIC void socket_dns_callback(int status, const struct in_addr *addr, void *arg) {
+    socket_dns_obj_t *self = arg;
+    if (addr) {
+        self->addr = *addr;
+    }
+    socket_dns_finished(self, status);
+}
+
+STATIC mp_obj_t socket_dns_done(mp_obj_t self_in) {
+    socket_dns_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    return mp_obj_new_bool(self->status != DNS_CACHE_PENDING);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(socket_dns_done_obj, socket_dns_done);
+
+// Returns the same list as getaddrinfo
+STATIC mp_obj_t socket_dns_result(mp_obj_t self_in) {
+    socket_dns_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    int status = self->status;
+    if (status == DNS_CACHE_PENDING) {
+        mp_raise_OSError(MP_EINPROGRESS);
+    }
+    if (status == SOCKET_DNS_CANCELLED) {
+        mp_raise_OSError(MP_EINTR);
+    }
+    if (status != DNS_CACHE_OK) {
+        mp_raise_OSError((status == DNS_CACHE_NOT_FOUND) ? -EAI_NONAME : -EAI_FAIL);
+    }
+
+    char buf[16];
+    inet_ntoa_r(self->addr, buf, sizeof(buf));
+    mp_obj_t inaddr_objs[2] = {
+        mp_obj_new_str(buf, strlen(buf)),
+        mp_obj_new_int(self->port)
+    };
+    mp_obj_t addrinfo_objs[5] = {
+        mp_obj_new_int(AF_INET),
+        mp_obj_new_int(SOCK_STREAM),
+        mp_obj_new_int(0),
+        self->host,
+        mp_obj_new_tuple(2, inaddr_objs)
+    };
+    mp_obj_t tuple = mp_obj_new_tuple(5, addrinfo_objs);
+    return mp_obj_new_list(1, &tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(socket_dns_result_obj, socket_dns_result);
+
+STATIC mp_obj_t socket_dns_cancel(mp_obj_t self_in) {
+    socket_dns_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (self->status == DNS_CACHE_PENDING) {
+        // after dns_cache_cancel() the resolver task doesn't use the waiter
+        dns_cache_cancel(&self->waiter);
+        portENTER_CRITICAL(&socket_dns_mux);
+        if (self->status == DNS_CACHE_PENDING) {
+            self->status = SOCKET_DNS_CANCELLED;
+        }
+        portEXIT_CRITICAL(&socket_dns_mux);
+    }
+    if (self->linked) {
+        // the callback is not called for the cancelled lookup
+        socket_dns_unlink(self);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(socket_dns_cancel_obj, socket_dns_cancel);
+
+STATIC mp_uint_t socket_dns_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t arg, int *errcode) {
+    socket_dns_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    if (request == MP_STREAM_POLL) {
+        return (self->status != DNS_CACHE_PENDING) ? (arg & MP_STREAM_POLL_RD) : 0;
+    }
+    if (request == MP_STREAM_CLOSE) {
+        socket_dns_cancel(self_in);
+        return 0;
+    }
+    *errcode = MP_EINVAL;
+    return MP_STREAM_ERROR;
+}
+
+STATIC const mp_rom_map_elem_t socket_dns_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_done), MP_ROM_PTR(&socket_dns_done_obj) },
+    { MP_ROM_QSTR(MP_QSTR_result), MP_ROM_PTR(&socket_dns_result_obj) },
+    { MP_ROM_QSTR(MP_QSTR_cancel), MP_ROM_PTR(&socket_dns_cancel_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(socket_dns_locals_dict, socket_dns_locals_dict_table);
+
+STATIC const mp_stream_p_t socket_dns_stream_p = {
+    .ioctl = socket_dns_ioctl,
+};
+
+STATIC const mp_obj_type_t socket_dns_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_getaddrinfo_async,
+    .protocol = &socket_dns_stream_p,
+    .locals_dict = (mp_obj_t)&socket_dns_locals_dict,
+};
+
+STATIC mp_obj_t esp_socket_getaddrinfo_async(size_t n_args, const mp_obj_t *args) {
+    const char *host_str = mp_obj_str_get_str(args[0]);
+    mp_int_t port;
+    if (MP_OBJ_IS_SMALL_INT(args[1])) {
+        port = MP_OBJ_SMALL_INT_VALUE(args[1]);
+    }
+    else {
+        port = strtol(mp_obj_str_get_str(args[1]), NULL, 10);
+    }
+    if (host_str[0] == '\0') {
+        host_str = "0.0.0.0";
+    }
+    if (!socket_dns_scheduled) {
+        // finished lookups left in the list when the scheduler queue was full
+        socket_dns_process(mp_const_none);
+    }
+
+    socket_dns_obj_t *self = m_new_obj(socket_dns_obj_t);
+    self->base.type = &socket_dns_type;
+    self->host = args[0];
+    self->callback = (n_args > 2) ? args[2] : mp_const_none;
+    self->addr.s_addr = 0;
+    self->port = port;
+    self->status = DNS_CACHE_PENDING;
+    // the object is rooted until the result is processed
+    self->next = MP_STATE_PORT(dns_async_head);
+    MP_STATE_PORT(dns_async_head) = self;
+    self->linked = true;
+
+    int status = dns_cache_resolve_async(host_str, &self->addr, &self->waiter, socket_dns_callback, self);
+    if (status == DNS_CACHE_ERROR) {
+        // not handled by the cache (mDNS name, no DNS server), resolved by lwip
+        const struct addrinfo hints = {
+            .ai_family = AF_INET,
+            .ai_socktype = SOCK_STREAM,
+        };
+        struct addrinfo *res = NULL;
+        MP_THREAD_GIL_EXIT();
+        int r = lwip_getaddrinfo(host_str, NULL, &hints, &res);
+        MP_THREAD_GIL_ENTER();
+        if ((r == 0) && (res)) {
+            self->addr = ((struct sockaddr_in *)res->ai_addr)->sin_addr;
+            status = DNS_CACHE_OK;
+        }
+        else {
+            status = (r == EAI_NONAME) ? DNS_CACHE_NOT_FOUND : DNS_CACHE_FAIL;
+        }
+        if (res) lwip_freeaddrinfo(res);
+    }
+    if (status != DNS_CACHE_PENDING) {
+        // the callback is also called from the scheduler for the cached names
+        socket_dns_finished(self, status);
+    }
+    return MP_OBJ_FROM_PTR(self);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(esp_socket_getaddrinfo_async_obj, 2, 3, esp_socket_getaddrinfo_async);
+
+// Called before the reset, the resolver task must not use the lookup objects after the heap is released
+void socket_dns_deinit(void) {
+    socket_dns_obj_t *self = MP_STATE_PORT(dns_async_head);
+    while (self) {
+        if (self->status == DNS_CACHE_PENDING) {
+            dns_cache_cancel(&self->waiter);
+            self->status = SOCKET_DNS_CANCELLED;
+        }
+        self->linked = false;
+        self = self->next;
+    }
+    MP_STATE_PORT(dns_async_head) = NULL;
+}
+#endif
+
 STATIC mp_obj_t esp_socket_initialize() {
     static int initialized = 0;
     if (!initialized) {
@@ -741,6 +1160,9 @@ STATIC const mp_rom_map_elem_t mp_module_socket_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___init__), MP_ROM_PTR(&esp_socket_initialize_obj) },
     { MP_ROM_QSTR(MP_QSTR_socket), MP_ROM_PTR(&get_socket_obj) },
     { MP_ROM_QSTR(MP_QSTR_getaddrinfo), MP_ROM_PTR(&esp_socket_getaddrinfo_obj) },
+    #ifdef CONFIG_MICROPY_USE_DNS_CACHE
+    { MP_ROM_QSTR(MP_QSTR_getaddrinfo_async), MP_ROM_PTR(&esp_socket_getaddrinfo_async_obj) },
+    #endif
 
     { MP_ROM_QSTR(MP_QSTR_AF_INET), MP_ROM_INT(AF_INET) },
     { MP_ROM_QSTR(MP_QSTR_AF_INET6), MP_ROM_INT(AF_INET6) },
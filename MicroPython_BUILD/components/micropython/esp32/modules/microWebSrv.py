@@ -335,11 +335,11 @@ class MicroWebSrv :
         if urlPath == '/' :
             for idxPage in self._indexPages :
             	physPath = self._webPath + '/' + idxPage
-            	if MicroWebSrv._fileExists(physPath) :
+            	if MicroWebSrv._fileExists(physPath) or MicroWebSrv._fileExists(physPath + '.gz') :
             		return physPath
         else :
             physPath = self._webPath + urlPath
-            if MicroWebSrv._fileExists(physPath) :
+            if MicroWebSrv._fileExists(physPath) or MicroWebSrv._fileExists(physPath + '.gz') :
                 return physPath
         return None
 
@@ -676,9 +676,18 @@ class MicroWebSrv :
 
         def WriteResponseFile(self, filepath, contentType=None, headers=None) :
             try :
-                size = stat(filepath)[6]
-                if size > 0 :
-                    with open(filepath, 'rb') as file :
+                if not MicroWebSrv._fileExists(filepath) and \
+                   'gzip' in self._client._headers.get('Accept-Encoding', '') :
+                    # Precompressed file is sent as-is, otherwise it is
+                    # decompressed by the file system when read
+                    filepath += '.gz'
+                    if not isinstance(headers, dict) :
+                        headers = { }
+                    headers["Content-Encoding"] = "gzip"
+                with open(filepath, 'rb') as file :
+                    size = file.seek(0, 2)
+                    file.seek(0)
+                    if size > 0 :
                         self._writeBeforeContent(200, headers, contentType, None, size)
                         buf = MicroWebSrv._tryAllocByteArray(1024)
                         if buf :
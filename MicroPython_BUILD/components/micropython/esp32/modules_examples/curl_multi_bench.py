@@ -0,0 +1,56 @@
+import curl, time
+
+# curl.Multi benchmark
+# Compares sequential curl.get (new connection for every request, the caller waits)
+# with concurrent curl.Multi transfers (reused connections, shared DNS cache)
+# Run the stand-in servers on the PC (MicroPython_BUILD/components/micropython/tools):
+#   python3 http_bench_server.py
+#   python3 ftp_bench_server.py --root <dir with some test files>
+# and on the ESP32:
+#   import curl_multi_bench
+#   curl_multi_bench.run('http://192.168.0.10:8080/api')
+#   curl_multi_bench.ftp('ftp://192.168.0.10:2121/', 'test.bin')
+
+#-------------------------
+def run(url, count=20):
+    print("curl benchmark, {} requests to '{}'".format(count, url))
+    t = time.ticks_ms()
+    err = 0
+    for i in range(count):
+        if curl.get(url)[0] != 0:
+            err += 1
+    t = time.ticks_diff(time.ticks_ms(), t)
+    print("  curl.get:   {:6d} ms, {} errors".format(t, err))
+
+    done = []
+    def cb(xfer):
+        done.append(xfer)
+
+    with curl.Multi(maxconn=4, maxhost=4) as m:
+        t = time.ticks_ms()
+        xfers = [m.get(url, callback=cb) for i in range(count)]
+        m.wait()
+        t = time.ticks_diff(time.ticks_ms(), t)
+        err = sum(1 for x in xfers if x.result()[0] != 0)
+        st = m.stats()
+        print("  curl.Multi: {:6d} ms, {} errors, {} callbacks, {} transfers on {} connections".format(t, err, len(done), st[0], st[1]))
+
+#----------------------------------------------------------------------
+def ftp(url, fname, user='user', password='pass', dest='/flash/_ftp.bin'):
+    print("curl.Multi ftp, '{}{}'".format(url, fname))
+    # the transfer to the buffer fails if the file is larger than the buffer
+    buf = bytearray(65536)
+    with curl.Multi() as m:
+        t = time.ticks_ms()
+        lst = m.ftp_list(url, user, password)
+        get = m.ftp_get(url + fname, user, password, dest)
+        tobuf = m.ftp_get(url + fname, user, password, buf=buf)
+        m.wait()
+        t = time.ticks_diff(time.ticks_ms(), t)
+        print("  list: {}".format(lst.result()[3]))
+        print("  get to file: {}".format(get))
+        print("  get to buffer: {}".format(tobuf))
+        put = m.ftp_put(url + '_up_' + fname, user, password, dest)
+        put.wait()
+        print("  put: {}".format(put))
+        print("  {} ms, stats {}".format(t, m.stats()))
@@ -0,0 +1,56 @@
+import os, time
+
+# Directory scan benchmark
+# Compares listing a large directory and stat-ing each entry
+# with the one pass os.ilistdir(dir, True) which returns size and mtime
+# Run on the internal file system (littlefs, spiffs or fatfs) and on sd card:
+#   import dir_bench
+#   dir_bench.run('/flash', 200)
+#   dir_bench.run('/sd', 2000)
+
+#------------------------------
+def create(path, count):
+    try:
+        os.mkdir(path)
+    except:
+        pass
+    t = time.ticks_ms()
+    for i in range(count):
+        with open('{}/f{:05d}.txt'.format(path, i), 'w') as f:
+            f.write('x' * (i % 100))
+    t = time.ticks_diff(time.ticks_ms(), t)
+    print("  create {} files: {} ms".format(count, t))
+
+#------------------------------
+def listdir_stat(path):
+    t = time.ticks_ms()
+    total = 0
+    for name in os.listdir(path):
+        st = os.stat(path + '/' + name)
+        total += st[6]
+    t = time.ticks_diff(time.ticks_ms(), t)
+    print("  listdir + stat:      {:6d} ms, total size {}".format(t, total))
+
+#------------------------------
+def ilistdir_info(path):
+    t = time.ticks_ms()
+    total = 0
+    for entry in os.ilistdir(path, True):
+        total += entry[3]
+    t = time.ticks_diff(time.ticks_ms(), t)
+    print("  ilistdir(dir, True): {:6d} ms, total size {}".format(t, total))
+
+#------------------------------
+def remove(path):
+    for name in os.listdir(path):
+        os.remove(path + '/' + name)
+    os.rmdir(path)
+
+#-----------------------------------
+def run(dir='/flash', count=200):
+    path = dir + '/_dirbench'
+    print("Directory scan benchmark on '{}', {} files".format(dir, count))
+    create(path, count)
+    listdir_stat(path)
+    ilistdir_info(path)
+    remove(path)
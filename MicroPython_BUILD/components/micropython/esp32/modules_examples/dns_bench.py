@@ -0,0 +1,68 @@
+import usocket, uselect, network, time
+
+# DNS resolver cache test and benchmark
+# Measures the first (DNS server) and the cached lookups of the blocking getaddrinfo,
+# resolves several names concurrently with getaddrinfo_async and uselect, and checks
+# the negative caching. Shows the resolver cache statistics.
+# Can be used with the local DNS stand-in on the PC (MicroPython_BUILD/components/micropython/tools):
+#   python3 dns_standin.py --port 5353 --record a.test=10.0.0.1:5 --record b.test=10.0.0.2 --record c.test=10.0.0.3 --delay 200
+# and on the ESP32 (connected to the network):
+#   import dns_bench
+#   dns_bench.run(('192.168.0.10', 5353), names=('a.test', 'b.test', 'c.test'), missing='nx.test')
+# or with the network's DNS server:
+#   dns_bench.run()
+
+#-----------------------
+def _lookup(name, port=80):
+    t = time.ticks_us()
+    try:
+        addr = usocket.getaddrinfo(name, port)[0][-1]
+    except OSError as e:
+        addr = 'error {}'.format(e.args[0])
+    return time.ticks_diff(time.ticks_us(), t) / 1000, addr
+
+#---------------------
+def _async(names):
+    poller = uselect.poll()
+    pending = {}
+    t = time.ticks_us()
+    for name in names:
+        q = usocket.getaddrinfo_async(name, 80)
+        poller.register(q, uselect.POLLIN)
+        pending[q] = name
+    while pending:
+        for q, ev in poller.poll(5000):
+            try:
+                res = q.result()[0][-1]
+            except OSError as e:
+                res = 'error {}'.format(e.args[0])
+            print("  {:24s} {} after {:.1f} ms".format(pending.pop(q), res, time.ticks_diff(time.ticks_us(), t) / 1000))
+            poller.unregister(q)
+
+#-----------------------------------------------------------------------------------------------------------
+def run(server=None, names=('micropython.org', 'github.com', 'pool.ntp.org'), missing='no-such-host.invalid'):
+    if server:
+        network.dns_server(server)
+    network.dns_flush()
+    print("DNS servers: {}".format(network.dns_server()))
+
+    print("Blocking getaddrinfo, first and cached lookup:")
+    for name in names:
+        t1, addr = _lookup(name)
+        t2, _ = _lookup(name)
+        print("  {:24s} {}  {:8.1f} ms  {:6.2f} ms".format(name, addr, t1, t2))
+
+    print("Missing name, first and cached (negative) lookup:")
+    t1, err = _lookup(missing)
+    t2, _ = _lookup(missing)
+    print("  {:24s} {}  {:8.1f} ms  {:6.2f} ms".format(missing, err, t1, t2))
+
+    network.dns_flush()
+    print("getaddrinfo_async, {} names concurrently:".format(len(names)))
+    _async(names)
+
+    st = network.dns_stats()
+    print("Cache: {} entries, {} hits, {} negative hits, {} misses, {} queries".format(*st[:5]))
+    print("       {} resolved, {} not found, {} timeouts, {} failures, avg {} ms, max {} ms".format(*st[5:]))
+    if server:
+        network.dns_server(None)
@@ -0,0 +1,45 @@
+import os, time, urandom
+
+# File system benchmark
+# Compares unbuffered and buffered small appends and random reads
+# Run on the internal file system (littlefs, spiffs or fatfs) and on sd card:
+#   import file_bench
+#   file_bench.run('/flash')
+#   file_bench.run('/sd')
+
+#--------------------------------------------------------
+def appends(path, buffering, count=500, size=32):
+    line = b'x' * (size-1) + b'\n'
+    try:
+        os.remove(path)
+    except:
+        pass
+    t = time.ticks_us()
+    f = open(path, 'ab', buffering)
+    for i in range(count):
+        f.write(line)
+    f.close()
+    t = time.ticks_diff(time.ticks_us(), t)
+    print("  {} x {}-byte appends, buffering={:5d}: {:8.1f} ms, {:6.1f} KB/s".format(count, size, buffering, t/1000, (count*size*1000)/(t*1.024)))
+
+#-------------------------------------------------------------
+def random_reads(path, buffering, count=500, size=32):
+    fsize = os.stat(path)[6]
+    f = open(path, 'rb', buffering)
+    t = time.ticks_us()
+    for i in range(count):
+        f.seek(urandom.getrandbits(16) % (fsize-size))
+        f.read(size)
+    t = time.ticks_diff(time.ticks_us(), t)
+    f.close()
+    print("  {} x {}-byte random reads, buffering={:5d}: {:8.1f} ms".format(count, size, buffering, t/1000))
+
+#---------------------
+def run(dir='/flash'):
+    path = dir + '/_bench.bin'
+    print("Benchmark on '{}'".format(dir))
+    for buffering in (0, 512, 4096):
+        appends(path, buffering)
+    for buffering in (0, -1):
+        random_reads(path, buffering)
+    os.remove(path)
@@ -0,0 +1,54 @@
+import network, time
+
+# Mqtt publish benchmark
+# Compares Mqtt.publish (one network write per message, QoS1 waits for the acknowledge)
+# with Mqtt.publish_many (messages coalesced into one write, QoS1 messages pipelined
+# up to the 'inflight' window)
+# Run the broker stand-in on the PC (MicroPython_BUILD/components/micropython/tools):
+#   python3 mqtt_bench_broker.py --ack-delay 20
+# and on the ESP32:
+#   import mqtt_bench
+#   mqtt_bench.run('192.168.0.10')
+
+#----------------------------------------------------
+def _messages(count):
+    return [('sensor/{}'.format(i % 20), '{}.{:03d}'.format(i, i)) for i in range(count)]
+
+#----------------------------------------------------
+def _result(name, count, t, st0, st):
+    writes = st[1] - st0[1]
+    print("  {:24s} {:6d} ms, {:6.0f} msg/s, {} writes ({:.1f} msg/write)".format(
+        name, t, count * 1000 / max(t, 1), writes, (st[0] - st0[0]) / max(writes, 1)))
+
+#-----------------------------------------------------------
+def run(server, port=1883, count=200, inflight=16, qos=(0, 1)):
+    client = network.mqtt('bench', server, port=port, inflight=inflight)
+    client.start()
+    tmo = 0
+    while client.status()[0] != 2:
+        time.sleep_ms(100)
+        tmo += 1
+        if tmo > 100:
+            print("Not connected")
+            client.free()
+            return
+    msgs = _messages(count)
+    print("Mqtt benchmark, {} messages to {}:{}, in-flight window {}".format(count, server, port, inflight))
+
+    for q in qos:
+        st0 = client.stats()
+        t = time.ticks_ms()
+        for topic, msg in msgs:
+            client.publish(topic, msg, q)
+        _result("publish qos{}".format(q), count, time.ticks_diff(time.ticks_ms(), t), st0, client.stats())
+
+        st0 = client.stats()
+        t = time.ticks_ms()
+        n = client.publish_many(msgs, q)
+        # wait for the acknowledges of the last window
+        while client.stats()[3] > 0:
+            time.sleep_ms(1)
+        _result("publish_many qos{}".format(q), n, time.ticks_diff(time.ticks_ms(), t), st0, client.stats())
+
+    client.stop()
+    client.free()
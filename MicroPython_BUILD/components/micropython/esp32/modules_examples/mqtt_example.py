@@ -35,6 +35,16 @@ mqtt.start()
 mqtt.subscribe('test')
 mqtt.publish('test', 'Hi from Micropython')
 
+# Subscription with its own callback, '+' matches one topic level, '#' all remaining levels
+# Only the matching callback is called, data_cb gets the messages not matching any of them
+
+def tempcb(msg):
+    print("[{}] Temperature {}: {}".format(msg[0], msg[1].split('/')[1], msg[2]))
+
+mqtt.subscribe('sensor/+/temp', 0, tempcb)
+mqtt.publish('sensor/kitchen/temp', '21.5')
+mqtt.unsubscribe('sensor/+/temp')
+
 mqtt.stop()
 
 '''
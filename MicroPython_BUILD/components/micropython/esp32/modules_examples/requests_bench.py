@@ -0,0 +1,57 @@
+import requests, time, gc
+
+# requests benchmark
+# Compares the module functions (new connection for every request)
+# with requests.Session (kept-alive connection, connect and TLS handshake only once)
+# Run the stand-in server on the PC (MicroPython_BUILD/components/micropython/tools):
+#   python3 http_bench_server.py
+#   python3 http_bench_server.py --port 8443 --tls
+# and on the ESP32:
+#   import requests_bench
+#   requests_bench.run('http://192.168.0.10:8080/api')
+#   requests_bench.run('https://192.168.0.10:8443/api')
+#   requests_bench.download('http://192.168.0.10:8080/big?n=1000000')
+
+#--------------------------------
+def bench(name, get, url, seconds):
+    n = 0
+    err = 0
+    t = time.ticks_ms()
+    while time.ticks_diff(time.ticks_ms(), t) < (seconds * 1000):
+        try:
+            res = get(url)
+            if res[0] != 200:
+                err += 1
+        except Exception:
+            err += 1
+        n += 1
+    t = time.ticks_diff(time.ticks_ms(), t)
+    print("  {:10s}: {:5d} requests in {:6d} ms, {:6.1f} requests/minute, {} errors".format(name, n, t, n * 60000 / t, err))
+
+#------------------------------------
+def run(url, seconds=20):
+    print("Requests benchmark, '{}'".format(url))
+    bench('requests', requests.get, url, seconds)
+    with requests.Session() as s:
+        bench('Session', s.get, url, seconds)
+        st = s.stats()
+        print("  Session: {} requests, {} connects, {} reused connections".format(st[0], st[1], st[2]))
+
+#----------------------------------------
+def download(url, chunk=2048):
+    print("Streamed download, '{}'".format(url))
+    buf = bytearray(chunk)
+    gc.collect()
+    mem = gc.mem_free()
+    t = time.ticks_ms()
+    total = 0
+    with requests.get(url, stream=True) as r:
+        print("  {}, content length {}".format(r, r.content_length))
+        while True:
+            n = r.raw.readinto(buf)
+            if not n:
+                break
+            total += n
+        used = mem - gc.mem_free()
+    t = time.ticks_diff(time.ticks_ms(), t)
+    print("  readinto({}): {} bytes in {} ms, {:.1f} KB/s, {} bytes of heap used".format(chunk, total, t, total / t / 1.024, used))
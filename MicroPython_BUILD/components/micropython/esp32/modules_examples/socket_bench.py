@@ -0,0 +1,95 @@
+import socket, time, gc, array
+
+# Socket receive benchmark
+# Compares socket.recv (new bytes object for every datagram) with socket.recv_into
+# (preallocated buffer) and socket.recv_many (several datagrams per call) for UDP,
+# and recv/readinto/recv_into for a TCP stream.
+# Shows the received datagrams per second and the bytes allocated on the heap.
+# Run the peer on the PC (MicroPython_BUILD/components/micropython/tools):
+#   python3 socket_bench_server.py --rate 3000
+# and on the ESP32:
+#   import socket_bench
+#   socket_bench.run('192.168.0.10')
+
+_SIZE = 64
+
+#---------------------------
+def _recv(s, buf, lens):
+    s.recv(_SIZE)
+    return 1
+
+#--------------------------------
+def _recv_into(s, buf, lens):
+    s.recv_into(buf, _SIZE)
+    return 1
+
+#--------------------------------
+def _recv_many(s, buf, lens):
+    return s.recv_many(buf, _SIZE, lens)
+
+#----------------------------------------------
+def _udp(server, port, name, func, count):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.settimeout(1)
+    buf = bytearray(_SIZE * 16)
+    lens = array.array('H', [0] * 16)
+    s.sendto('send {} {}'.format(count, _SIZE), (server, port))
+    gc.collect()
+    gc.disable()
+    alloc = gc.mem_alloc()
+    got = 0
+    calls = 0
+    t = 0
+    try:
+        while got < count:
+            got += func(s, buf, lens)
+            calls += 1
+            if t == 0:
+                t = time.ticks_us()
+    except OSError:
+        # timeout, some datagrams were dropped
+        pass
+    t = time.ticks_diff(time.ticks_us(), t)
+    alloc = gc.mem_alloc() - alloc
+    gc.enable()
+    s.close()
+    print("  {:10s} {:5d}/{} datagrams, {:6.0f} datagrams/s, {:5d} calls, {:7d} bytes allocated".format(
+        name, got, count, got * 1000000 / max(t, 1), calls, alloc))
+
+#----------------------------------------------
+def _tcp(server, port, name, size, chunk):
+    s = socket.socket()
+    s.connect((server, port))
+    s.sendall('{}\n'.format(size))
+    buf = bytearray(chunk)
+    mv = memoryview(buf)
+    gc.collect()
+    gc.disable()
+    alloc = gc.mem_alloc()
+    got = 0
+    t = time.ticks_us()
+    while got < size:
+        if name == 'recv':
+            n = len(s.recv(chunk))
+        elif name == 'readinto':
+            n = s.readinto(mv)
+        else:
+            n = s.recv_into(buf)
+        if n == 0:
+            break
+        got += n
+    t = time.ticks_diff(time.ticks_us(), t)
+    alloc = gc.mem_alloc() - alloc
+    gc.enable()
+    s.close()
+    print("  {:10s} {:7d} bytes, {:7.1f} KB/s, {:7d} bytes allocated".format(name, got, got * 1000000 / 1024 / max(t, 1), alloc))
+
+#----------------------------------------------------------------------
+def run(server, port=5005, count=2000, tcp_size=500000, chunk=1460):
+    print("UDP, {} datagrams of {} bytes from {}:{}".format(count, _SIZE, server, port))
+    _udp(server, port, 'recv', _recv, count)
+    _udp(server, port, 'recv_into', _recv_into, count)
+    _udp(server, port, 'recv_many', _recv_many, count)
+    print("TCP, {} bytes in {}-byte reads".format(tcp_size, chunk))
+    for name in ('recv', 'readinto', 'recv_into'):
+        _tcp(server, port, name, tcp_size, chunk)
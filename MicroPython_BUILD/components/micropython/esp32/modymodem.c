@@ -50,6 +50,12 @@
 #include "py/ringbuf.h"
 #include "mphalport.h"
 #include "rom/uart.h"
+#include "driver/uart.h"
+#include "soc/uart_struct.h"
+#include "soc/uart_reg.h"
+#ifdef CONFIG_MICROPY_USE_TASK_WDT
+#include "esp_task_wdt.h"
+#endif
 
 #include <fcntl.h>
 #include "extmod/vfs_native.h"
@@ -58,40 +64,83 @@
 #include "telnet.h"
 #endif
 
+// CRC16-CCITT (XMODEM) lookup table, one table step per byte
+//----------------------------------
+static const uint16_t crc16_tab[256] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+  0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+  0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+  0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+  0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+  0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+  0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+  0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+  0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+  0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+  0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+  0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+  0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+  0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+  0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+  0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+  0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+  0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+  0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+  0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+  0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+  0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0,
+};
+
 //------------------------------------------------------------------------
 static unsigned short crc16(const unsigned char *buf, unsigned long count)
 {
   unsigned short crc = 0;
-  int i;
 
   while(count--) {
-    crc = crc ^ *buf++ << 8;
-
-    for (i=0; i<8; i++) {
-      if (crc & 0x8000) crc = crc << 1 ^ 0x1021;
-      else crc = crc << 1;
-    }
+    crc = (crc << 8) ^ crc16_tab[((crc >> 8) ^ *buf++) & 0xff];
   }
   return crc;
 }
 
-/*
+// Receive 'size' bytes, copy directly from the stdin ring buffer in contiguous blocks
 //---------------------------------------------------------------------------
-static int32_t receive_Bytes (unsigned char *buf, int size, uint32_t timeout)
+static int32_t Receive_Bytes (unsigned char *buf, int size, uint32_t timeout)
 {
-	unsigned char ch;
-    int cb = -1;
+	uint64_t wait_end = mp_hal_ticks_ms() + timeout;
     int recv = 0;
 
     while (recv < size) {
-    	cb = mp_hal_stdin_rx_chr(timeout);
-    	if (cb < 0) break;
-    	buf[recv++] = (uint8_t)cb;
+    	uint16_t iput = stdin_ringbuf.iput;
+    	while ((recv < size) && (stdin_ringbuf.iget != iput)) {
+    		int len = (iput > stdin_ringbuf.iget) ? (iput - stdin_ringbuf.iget) : (stdin_ringbuf.size - stdin_ringbuf.iget);
+    		if (len > (size - recv)) len = size - recv;
+    		memcpy(buf + recv, stdin_ringbuf.buf + stdin_ringbuf.iget, len);
+    		recv += len;
+    		stdin_ringbuf.iget = (stdin_ringbuf.iget + len) % stdin_ringbuf.size;
+    	}
+    	if (recv >= size) break;
+
+		if (mp_hal_ticks_ms() > wait_end) return -1;
+		#ifdef CONFIG_MICROPY_USE_TASK_WDT
+		esp_task_wdt_reset();
+		#endif
+		// wait max 10 ms for more data
+		MP_THREAD_GIL_EXIT();
+		xSemaphoreTake(uart0_semaphore, 10 / portTICK_PERIOD_MS);
+		MP_THREAD_GIL_ENTER();
     }
-	if (recv == 0) return -1;
-	return 0;
+    return 0;
 }
-*/
 
 //--------------------------------------------------------------
 static int32_t Receive_Byte (unsigned char *c, uint32_t timeout)
@@ -118,11 +167,26 @@ static void uart_consume()
 	xSemaphoreGive(uart0_mutex);
 }
 
+// Write directly to the UART TX FIFO, filling all free FIFO space at once;
+// the UART transmits the last FIFO content while the next packet is prepared.
+// While the FIFO is (almost) full the other tasks run for one tick; at the default
+// 1000 Hz tick rate that is less than the time to transmit the FIFO at 921600 baud.
 //----------------------------------------
 static void send_Bytes(char *buf, int len)
 {
-    while (len--) {
-        uart_tx_one_char(*buf++);
+    while (len > 0) {
+    	int room = UART_FIFO_LEN - UART0.status.txfifo_cnt;
+    	if ((room <= 0) || ((room < len) && (room < (UART_FIFO_LEN / 4)))) {
+    		MP_THREAD_GIL_EXIT();
+    		vTaskDelay(1);
+    		MP_THREAD_GIL_ENTER();
+    		continue;
+    	}
+    	if (room > len) room = len;
+    	len -= room;
+    	while (room--) {
+    		WRITE_PERI_REG(UART_FIFO_AHB_REG(UART_NUM_0), *buf++);
+    	}
     }
 }
 //--------------------------------
@@ -159,6 +223,11 @@ static void send_CRC16 ( void ) {
   Send_Byte(CRC16);
 }
 
+//-------------------------------
+static void send_CRC16G ( void ) {
+  Send_Byte(CRC16G);
+}
+
 
 /**
   * @brief  Receive a packet from sender
@@ -176,7 +245,7 @@ static void send_CRC16 ( void ) {
 //--------------------------------------------------------------------------
 static int32_t Receive_Packet (uint8_t *data, int *length, uint32_t timeout)
 {
-  int count, packet_size, i;
+  int count, packet_size;
   unsigned char ch;
   *length = 0;
   
@@ -217,11 +286,8 @@ static int32_t Receive_Packet (uint8_t *data, int *length, uint32_t timeout)
   uint8_t *dptr = data+1;
   count = packet_size + PACKET_OVERHEAD-1;
 
-  for (i=0; i<count; i++) {
-	  if (Receive_Byte(&ch, timeout) < 0) {
-		  return -1;
-	  }
-	  *dptr++ = (uint8_t)ch;;
+  if (Receive_Bytes(dptr, count, timeout) < 0) {
+	  return -1;
   }
 
   if (data[PACKET_SEQNO_INDEX] != ((data[PACKET_SEQNO_COMP_INDEX] ^ 0xff) & 0xff)) {
@@ -238,8 +304,9 @@ static int32_t Receive_Packet (uint8_t *data, int *length, uint32_t timeout)
 }
 
 // Receive a file using the ymodem protocol.
-//-------------------------------------------------------------------------------
-int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg)
+// In YMODEM-G mode ('ymodem_g'=1) the packets are not acknowledged, any error aborts the transfer.
+//---------------------------------------------------------------------------------------------
+int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg, int ymodem_g)
 {
   uint8_t packet_data[PACKET_1K_SIZE + PACKET_OVERHEAD];
   uint8_t *file_ptr;
@@ -263,10 +330,10 @@ int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg
             case -2:
                 // error
                 errors ++;
-                if (errors > 5) {
+                if ((errors > 5) || (ymodem_g)) {
                   send_CA();
                   size = -2;
-                  sprintf(errmsg, "Error limit exceeded");
+                  sprintf(errmsg, (ymodem_g) ? "Packet error in YMODEM-G mode" : "Error limit exceeded");
                   goto exit;
                 }
                 send_NAK();
@@ -274,7 +341,13 @@ int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg
             case 0:
                 // End of transmission
             	eof_cnt++;
-            	if (eof_cnt == 1) {
+            	if (ymodem_g) {
+            		// EOT is acknowledged once, the next file is requested with 'G'
+            		eof_cnt = 2;
+            		send_ACK();
+            		send_CRC16G();
+            	}
+            	else if (eof_cnt == 1) {
             		send_NAK();
             	}
             	else {
@@ -284,11 +357,11 @@ int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg
             default:
               // ** Normal packet **
               if (eof_cnt > 1) {
-          		send_ACK();
+          		if (!ymodem_g) send_ACK();
               }
               else if ((packet_data[PACKET_SEQNO_INDEX] & 0xff) != (packets_received & 0x000000ff)) {
                 errors ++;
-                if (errors > 5) {
+                if ((errors > 5) || (ymodem_g)) {
                   send_CA();
                   size = -3;
                   sprintf(errmsg, "Wrong packet type received");
@@ -330,7 +403,8 @@ int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg
                     }
 
                     file_len = 0;
-                    send_ACKCRC16();
+                    if (ymodem_g) send_CRC16G();
+                    else send_ACKCRC16();
                   }
                   // Filename packet is empty, end session
                   else {
@@ -346,6 +420,8 @@ int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg
                 }
                 else {
                   // ** Data packet **
+                  // Acknowledge first, so that the next packet is received while the data is written
+                  if (!ymodem_g) send_ACK();
                   // Write received data to file
                   if (file_len < size) {
                     file_len += packet_length;  // total bytes received
@@ -366,7 +442,6 @@ int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg
                   }
                   //success
                   errors = 0;
-                  send_ACK();
                 }
                 packets_received++;
               }
@@ -389,7 +464,8 @@ int Ymodem_Receive (FILE *ffd, unsigned int maxsize, char* getname, char *errmsg
                 sprintf(errmsg, "Max errors");
 				goto exit;
 			  }
-			  send_CRC16();
+			  if (ymodem_g) send_CRC16G();
+			  else send_CRC16();
           }
       }
       if (file_done != 0) {
@@ -501,14 +577,30 @@ static uint8_t Ymodem_WaitResponse(uint8_t ackchr, uint8_t tmo)
 }
 
 
+// Check for the abort from receiver without waiting (YMODEM-G streaming)
+//--------------------------------
+static int Ymodem_CheckAbort(void)
+{
+  int c;
+  while ((c = ringbuf_get(&stdin_ringbuf)) >= 0) {
+    if (c == CA) return 1;
+  }
+  return 0;
+}
+
+// Transmit a file using the ymodem protocol.
+// YMODEM-G streaming is used if the receiver requests the transfer with 'G'.
 //---------------------------------------------------------------------------------------
 int Ymodem_Transmit (char* sendFileName, unsigned int sizeFile, FILE *ffd, char *err_msg)
 {
-  uint8_t packet_data[PACKET_1K_SIZE + PACKET_OVERHEAD];
+  // Two packet buffers, the next packet is read from file while the current one is sent
+  uint8_t packet_data[2][PACKET_1K_SIZE + PACKET_OVERHEAD];
+  uint8_t *packet = packet_data[0];
+  uint8_t *next_packet = packet_data[1];
   uint16_t blkNumber;
   unsigned char receivedC;
-  int err;
-  uint32_t size = 0;
+  int err, ymodem_g;
+  uint32_t size = 0, next_size;
 
   // Wait for response from receiver
   err = 0;
@@ -516,74 +608,106 @@ int Ymodem_Transmit (char* sendFileName, unsigned int sizeFile, FILE *ffd, char
     Send_Byte(CRC16);
   } while (Receive_Byte(&receivedC, NAK_TIMEOUT) < 0 && err++ < 45);
 
-  if (err >= 45 || receivedC != CRC16) {
+  if (err >= 45 || ((receivedC != CRC16) && (receivedC != CRC16G))) {
     send_CA();
     sprintf(err_msg, "No response from host");
     return -1;
   }
+  ymodem_g = (receivedC == CRC16G);
   
   // === Prepare first block and send it =======================================
   /* When the receiving program receives this block and successfully
    * opened the output file, it shall acknowledge this block with an ACK
    * character and then proceed with a normal YMODEM file transfer
    * beginning with a "C" or NAK tranmsitted by the receiver.
+   * In YMODEM-G mode the block is not acknowledged, the receiver sends "G".
    */
-  Ymodem_PrepareIntialPacket(packet_data, sendFileName, sizeFile);
-  do 
-  {
-    // Send Packet
-	  send_Bytes((char *)packet_data, PACKET_SIZE + PACKET_OVERHEAD);
-
-	// Wait for Ack
-    err = Ymodem_WaitResponse(ACK, 10);
-    if (err == 0 || err == 4) {
+  Ymodem_PrepareIntialPacket(packet, sendFileName, sizeFile);
+  if (ymodem_g) {
+    send_Bytes((char *)packet, PACKET_SIZE + PACKET_OVERHEAD);
+    do {
+      err = Ymodem_WaitResponse(CRC16G, 10);
+    } while (err == 4);  // skip optional ACK
+    if (err != 1) {
       send_CA();
-      sprintf(err_msg, "No ACK from host");
-      return -2;                  // timeout or wrong response
+      sprintf(err_msg, "No G after header");
+      return -3;
     }
-    else if (err == 2) {
+  }
+  else {
+    do
+    {
+      // Send Packet
+      send_Bytes((char *)packet, PACKET_SIZE + PACKET_OVERHEAD);
+
+      // Wait for Ack
+      err = Ymodem_WaitResponse(ACK, 10);
+      if (err == 0 || err == 4) {
+        send_CA();
+        sprintf(err_msg, "No ACK from host");
+        return -2;                  // timeout or wrong response
+      }
+      else if (err == 2) {
         sprintf(err_msg, "Host abort");
-    	return 98; // abort
-    }
-  }while (err != 1);
+        return 98; // abort
+      }
+    }while (err != 1);
 
-  // After initial block the receiver sends 'C' after ACK
-  if (Ymodem_WaitResponse(CRC16, 10) != 1) {
-    send_CA();
-    sprintf(err_msg, "No CRC after ACK");
-    return -3;
+    // After initial block the receiver sends 'C' after ACK
+    if (Ymodem_WaitResponse(CRC16, 10) != 1) {
+      send_CA();
+      sprintf(err_msg, "No CRC after ACK");
+      return -3;
+    }
   }
   
   // === Send file blocks ======================================================
   size = sizeFile;
   blkNumber = 0x01;
+  if (size) Ymodem_PreparePacket(packet, blkNumber, size, ffd);
   
   // Resend packet if NAK  for a count of 10 else end of communication
   while (size)
   {
-    // Prepare and send next packet
-    Ymodem_PreparePacket(packet_data, blkNumber, size, ffd);
-    do
-    {
-    	send_Bytes((char *)packet_data, PACKET_1K_SIZE + PACKET_OVERHEAD);
+    next_size = (size > PACKET_1K_SIZE) ? (size - PACKET_1K_SIZE) : 0;
+    send_Bytes((char *)packet, PACKET_1K_SIZE + PACKET_OVERHEAD);
 
-      // Wait for Ack
-      err = Ymodem_WaitResponse(ACK, 10);
-      if (err == 1) {
-        blkNumber++;
-        if (size > PACKET_1K_SIZE) size -= PACKET_1K_SIZE; // Next packet
-        else size = 0; // Last packet sent
-      }
-      else if (err == 0 || err == 4) {
-        send_CA();
-        sprintf(err_msg, "Timeout or wrong response");
-        return -4;                  // timeout or wrong response
+    // Prepare the next packet while the current one is transmitted and acknowledged
+    if (next_size) Ymodem_PreparePacket(next_packet, blkNumber+1, next_size, ffd);
+
+    if (ymodem_g) {
+      if (Ymodem_CheckAbort()) {
+        sprintf(err_msg, "Host abort");
+        return -5;
       }
-      else if (err == 2) {
+    }
+    else {
+      do
+      {
+        // Wait for Ack
+        err = Ymodem_WaitResponse(ACK, 10);
+        if (err == 3) {
+          // NAK, resend the current packet
+          send_Bytes((char *)packet, PACKET_1K_SIZE + PACKET_OVERHEAD);
+        }
+        else if (err == 0 || err == 4) {
+          send_CA();
+          sprintf(err_msg, "Timeout or wrong response");
+          return -4;                  // timeout or wrong response
+        }
+        else if (err == 2) {
           sprintf(err_msg, "Host abort");
-    	  return -5; // abort
-      }
-    }while(err != 1);
+          return -5; // abort
+        }
+      }while(err != 1);
+    }
+
+    // Next packet
+    uint8_t *tmp = packet;
+    packet = next_packet;
+    next_packet = tmp;
+    blkNumber++;
+    size = next_size;
   }
   
   // === Send EOT ==============================================================
@@ -608,17 +732,21 @@ int Ymodem_Transmit (char* sendFileName, unsigned int sizeFile, FILE *ffd, char
   }while (err != 1);
   
   // === Receiver requests next file, prepare and send last packet =============
-  if (Ymodem_WaitResponse(CRC16, 10) != 1) {
+  if (Ymodem_WaitResponse((ymodem_g) ? CRC16G : CRC16, 10) != 1) {
 	sprintf(err_msg, "No CRC after EOF");
     send_CA();
     return -8;
   }
 
-  Ymodem_PrepareLastPacket(packet_data);
+  Ymodem_PrepareLastPacket(packet);
+  if (ymodem_g) {
+    send_Bytes((char *)packet, PACKET_SIZE + PACKET_OVERHEAD);
+    return 0;
+  }
   do 
   {
 	// Send Packet
-	  send_Bytes((char *)packet_data, PACKET_SIZE + PACKET_OVERHEAD);
+	  send_Bytes((char *)packet, PACKET_SIZE + PACKET_OVERHEAD);
 
 	// Wait for Ack
     err = Ymodem_WaitResponse(ACK, 10);
@@ -640,8 +768,8 @@ int Ymodem_Transmit (char* sendFileName, unsigned int sizeFile, FILE *ffd, char
 
 // ===== Module methods ===============================================================================
 
-//--------------------------------------------
-STATIC mp_obj_t ymodem_recv(mp_obj_t fname_in)
+//---------------------------------------------------------------
+STATIC mp_obj_t ymodem_recv(size_t n_args, const mp_obj_t *args)
 {
 #ifdef CONFIG_MICROPY_USE_TELNET
 	if (telnet_loggedin()) {
@@ -656,7 +784,8 @@ STATIC mp_obj_t ymodem_recv(mp_obj_t fname_in)
 		return mp_const_none;
 	}
 
-	const char *fname = mp_obj_str_get_str(fname_in);
+	const char *fname = mp_obj_str_get_str(args[0]);
+	int ymodem_g = ((n_args > 1) && mp_obj_is_true(args[1])) ? 1 : 0;
     char fullname[128] = {'\0'};
     int err = 1;
     char err_msg[128] = {'\0'};
@@ -677,13 +806,14 @@ STATIC mp_obj_t ymodem_recv(mp_obj_t fname_in)
 		uart0_raw_input = 1;
 		xSemaphoreGive(uart0_mutex);
 
-		int rec_res = Ymodem_Receive(ffd, 1000000, orig_name, err_msg);
+		int rec_res = Ymodem_Receive(ffd, 1000000, orig_name, err_msg, ymodem_g);
 
 		xSemaphoreTake(uart0_mutex, UART_SEMAPHORE_WAIT);
 		uart0_raw_input = 0;
 		xSemaphoreGive(uart0_mutex);
 
 		fclose(ffd);
+		native_vfs_file_changed();
 		mp_printf(&mp_plat_print, "\r\n");
 
 		if (rec_res > 0) {
@@ -704,7 +834,7 @@ exit:
 	return mp_const_none;
 #endif
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(ymodem_recv_obj, ymodem_recv);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(ymodem_recv_obj, 1, 2, ymodem_recv);
 
 //--------------------------------------------
 STATIC mp_obj_t ymodem_send(mp_obj_t fname_in)
@@ -43,6 +43,7 @@
 #include "py/obj.h"
 #include "py/mpstate.h"
 #include "py/mphal.h"
+#include "py/runtime.h"
 #include "extmod/misc.h"
 #include "lib/utils/pyexec.h"
 #include "uart.h"
@@ -190,25 +191,6 @@ int mp_hal_stdin_rx_chr(uint32_t timeout)
     return -1;
 }
 
-#ifdef CONFIG_MICROPY_USE_TELNET
-// Convert '\n' to '\r\n'
-//-------------------------------------------------------------
-static void telnet_stdout_tx_str(const char *str, uint32_t len)
-{
-	char *tstr = malloc(len*2+1);
-	char prev = '\0';
-	uint32_t idx = 0;
-	while (len--) {
-		if ((*str == '\n') && (prev != '\r')) tstr[idx++] = '\r';
-		tstr[idx++] = *str;
-		prev = *str++;
-	}
-	tstr[idx++] = '\0';
-	telnet_tx_strn(tstr, strlen(tstr));
-	free(tstr);
-}
-#endif
-
 // send newline character to printf channel
 //-------------------------------
 void mp_hal_stdout_tx_newline() {
@@ -271,7 +253,7 @@ void mp_hal_stdout_tx_strn(const char *str, uint32_t len) {
 void mp_hal_stdout_tx_strn_cooked(const char *str, uint32_t len) {
 	if (str == NULL) return;
 	#ifdef CONFIG_MICROPY_USE_TELNET
-   	if (telnet_loggedin()) telnet_stdout_tx_str(str, len);
+   	if (telnet_loggedin()) telnet_tx_strn_cooked(str, len);
    	else {
    	   	MP_THREAD_GIL_EXIT();
    	    while (len--) {
@@ -413,3 +395,47 @@ void mp_hal_delay_us(uint32_t us) {
 void mp_hal_delay_us_fast(uint32_t us) {
     ets_delay_us(us);
 }
+
+#if MICROPY_PY_MICROPYTHON_PROFILE
+
+#include "esp_timer.h"
+
+static esp_timer_handle_t prof_timer = NULL;
+
+//---------------------------------------
+static void prof_timer_cb(void *arg)
+{
+    mp_prof_tick();
+}
+
+//--------------------------------------------------
+void mp_hal_prof_timer_start(uint32_t period_us)
+{
+    if (prof_timer == NULL) {
+        const esp_timer_create_args_t args = {
+            .callback = prof_timer_cb,
+            .arg = NULL,
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "mp_prof"
+        };
+        if (esp_timer_create(&args, &prof_timer) != ESP_OK) {
+            prof_timer = NULL;
+            mp_raise_msg(&mp_type_OSError, "Error creating profiler timer");
+        }
+    }
+    esp_timer_start_periodic(prof_timer, period_us);
+}
+
+//--------------------------------
+void mp_hal_prof_timer_stop(void)
+{
+    if (prof_timer) esp_timer_stop(prof_timer);
+}
+
+//--------------------------------------
+const char *mp_hal_prof_thread_name(void)
+{
+    return pcTaskGetTaskName(NULL);
+}
+
+#endif
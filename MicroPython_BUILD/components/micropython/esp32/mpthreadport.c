@@ -553,6 +553,21 @@ int mp_thread_num_threads() {
     return res;
 }
 
+#if MICROPY_PY_MICROPYTHON_PROFILE
+// Call 'cb' with the state of every running MicroPython thread, used by the profiler.
+// The caller holds the GIL, the states of the other threads don't change meanwhile.
+//------------------------------------------------------------------------------------------------------------
+void mp_thread_prof_foreach(void (*cb)(struct _mp_state_thread_t *state, const char *name, void *arg), void *arg) {
+    mp_thread_mutex_lock(&thread_mutex, 1);
+    for (thread_t *th = thread; th != NULL; th = th->next) {
+        if ((!th->ready) || (th->type == THREAD_TYPE_SERVICE)) continue;
+        mp_state_thread_t *state = pvTaskGetThreadLocalStoragePointer(th->id, 1);
+        if (state) cb(state, th->name, arg);
+    }
+    mp_thread_mutex_unlock(&thread_mutex);
+}
+#endif
+
 //---------------------------------------------
 uint32_t mp_thread_getnotify(bool check_only) {
 	uint32_t value = 0;
@@ -875,7 +890,8 @@ void telnet_task (void *pvParameters)
             break;
         }
 
-        vTaskDelay(1);
+        // wait one tick, or less if a full TX segment is buffered
+        ulTaskNotifyTake(pdTRUE, 1);
 
         // ---- Check if network is still available ----
         if (!_check_network()) {
@@ -950,7 +966,8 @@ void ftp_task (void *pvParameters)
             break;
         }
 
-        vTaskDelay(1);
+        // Wait for the client's activity on the ftp sockets
+        ftp_wait_io(FTP_IO_WAIT_MS);
 
         // ---- Check if network is still available ----
         if (!_check_network()) {
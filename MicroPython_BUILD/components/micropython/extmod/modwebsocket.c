@@ -27,6 +27,7 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdlib.h>
 
 #include "py/runtime.h"
 #include "py/stream.h"
@@ -34,201 +35,288 @@
 
 #if MICROPY_PY_WEBSOCKET
 
-enum { FRAME_HEADER, FRAME_OPT, PAYLOAD, CONTROL };
+// Framing and permessage-deflate shared with the MQTT WebSocket transport
+#include "ws_frame.h"
+
+enum { FRAME_HEADER, PAYLOAD, CONTROL };
 
 enum { BLOCKING_WRITE = 0x80 };
 
+// Receive buffer, holds at least the largest header with the control frame payload
+#define WS_RX_BUF_SIZE (256)
+// Payloads up to this size are sent in the same write as the frame header
+#define WS_TX_COALESCE_SIZE (128)
+
 typedef struct _mp_obj_websocket_t {
     mp_obj_base_t base;
     mp_obj_t sock;
-    uint32_t msg_sz;
-    byte mask[4];
+    // Received frame
+    ws_frame_t frame;
+    // permessage-deflate state, NULL if not used
+    ws_deflate_t *deflate;
+    // Received data not processed yet is rx[rx_pos:rx_len],
+    // compressed payload not inflated yet is rx[z_pos:rx_pos]
+    uint16_t rx_pos;
+    uint16_t rx_len;
+    uint16_t z_pos;
     byte state;
-    byte to_recv;
-    byte mask_pos;
-    byte buf_pos;
-    byte buf[6];
     byte opts;
     // Copy of last data frame flags
     byte ws_flags;
     // Copy of current frame flags
     byte last_flags;
+    byte rx[WS_RX_BUF_SIZE];
 } mp_obj_websocket_t;
 
-STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode);
+STATIC mp_uint_t websocket_send_frame(mp_obj_websocket_t *self, byte flags, const void *buf, mp_uint_t size, int *errcode);
 
+// websocket(sock, blocking=False, deflate=0)
+// 'deflate' is the window size (8-15 bits, True for 15) if permessage-deflate was
+// negotiated in the handshake; the received messages are inflated, the sent
+// messages are compressed without context takeover
 STATIC mp_obj_t websocket_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
-    mp_arg_check_num(n_args, n_kw, 1, 2, false);
-    mp_obj_websocket_t *o = m_new_obj(mp_obj_websocket_t);
+    mp_arg_check_num(n_args, n_kw, 1, 3, false);
+    mp_obj_websocket_t *o = m_new_obj_with_finaliser(mp_obj_websocket_t);
+    memset(o, 0, sizeof(mp_obj_websocket_t));
     o->base.type = type;
     o->sock = args[0];
     o->state = FRAME_HEADER;
-    o->to_recv = 2;
-    o->mask_pos = 0;
-    o->buf_pos = 0;
     o->opts = FRAME_TXT;
     if (n_args > 1 && args[1] == mp_const_true) {
         o->opts |= BLOCKING_WRITE;
     }
+    if (n_args > 2 && mp_obj_is_true(args[2])) {
+        int window_bits = (args[2] == mp_const_true) ? 15 : mp_obj_get_int(args[2]);
+        if (window_bits < 8 || window_bits > 15) {
+            mp_raise_ValueError("deflate window bits must be 8..15");
+        }
+        o->deflate = malloc(sizeof(ws_deflate_t));
+        if (o->deflate == NULL || ws_deflate_init(o->deflate, window_bits, window_bits) != 0) {
+            free(o->deflate);
+            o->deflate = NULL;
+            mp_raise_msg(&mp_type_MemoryError, "deflate init failed");
+        }
+    }
     return  MP_OBJ_FROM_PTR(o);
 }
 
-STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
-    mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
-    const mp_stream_p_t *stream_p = mp_get_stream_raise(self->sock, MP_STREAM_OP_READ);
+STATIC void websocket_free_deflate(mp_obj_websocket_t *self) {
+    if (self->deflate) {
+        ws_deflate_free(self->deflate);
+        free(self->deflate);
+        self->deflate = NULL;
+    }
+}
+
+// Read more data from the socket into the receive buffer
+STATIC mp_uint_t websocket_fill(mp_obj_websocket_t *self, const mp_stream_p_t *stream_p, int *errcode) {
+    // keep the compressed payload not inflated yet
+    uint16_t keep = (self->state == PAYLOAD && self->frame.compressed) ? self->z_pos : self->rx_pos;
+    if (keep > 0) {
+        memmove(self->rx, self->rx + keep, self->rx_len - keep);
+        self->rx_len -= keep;
+        self->rx_pos -= keep;
+        self->z_pos -= (self->z_pos >= keep) ? keep : self->z_pos;
+    }
+    mp_uint_t out_sz = stream_p->read(self->sock, self->rx + self->rx_len, WS_RX_BUF_SIZE - self->rx_len, errcode);
+    if (out_sz != 0 && out_sz != MP_STREAM_ERROR) {
+        self->rx_len += out_sz;
+    }
+    return out_sz;
+}
+
+// Payload of the compressed message, inflated into 'buf' as it arrives
+// Returns 0 with the state set to FRAME_HEADER at the end of the frame
+STATIC mp_uint_t websocket_read_compressed(mp_obj_websocket_t *self, const mp_stream_p_t *stream_p, void *buf, mp_uint_t size, int *errcode) {
     while (1) {
-        if (self->to_recv != 0) {
-            mp_uint_t out_sz = stream_p->read(self->sock, self->buf + self->buf_pos, self->to_recv, errcode);
-            if (out_sz == 0 || out_sz == MP_STREAM_ERROR) {
+        if (self->z_pos < self->rx_pos || self->deflate->rx_pending) {
+            size_t used;
+            int out_sz = ws_inflate(self->deflate, self->rx + self->z_pos, self->rx_pos - self->z_pos, &used, buf, size, false);
+            if (out_sz < 0 || (out_sz == 0 && used == 0 && self->z_pos < self->rx_pos)) {
+                *errcode = MP_EIO;
+                return MP_STREAM_ERROR;
+            }
+            self->z_pos += used;
+            if (out_sz > 0) {
                 return out_sz;
             }
-            self->buf_pos += out_sz;
-            self->to_recv -= out_sz;
-            if (self->to_recv != 0) {
-                *errcode = MP_EAGAIN;
-                return MP_STREAM_ERROR;
+            continue;
+        }
+        if (self->frame.remaining > 0) {
+            // unmask the next part of the payload in the receive buffer
+            if (self->rx_pos == self->rx_len) {
+                mp_uint_t out_sz = websocket_fill(self, stream_p, errcode);
+                if (out_sz == 0 || out_sz == MP_STREAM_ERROR) {
+                    return out_sz;
+                }
             }
+            self->rx_pos += ws_frame_payload(&self->frame, self->rx + self->rx_pos, self->rx_len - self->rx_pos);
+            continue;
+        }
+        if ((self->frame.flags & WS_FRAME_FIN) == 0) {
+            // the message continues in the next frame
+            self->state = FRAME_HEADER;
+            return 0;
+        }
+        // end of the message
+        size_t used;
+        int out_sz = ws_inflate(self->deflate, NULL, 0, &used, buf, size, true);
+        if (out_sz < 0) {
+            *errcode = MP_EIO;
+            return MP_STREAM_ERROR;
         }
+        if (ws_inflate_done(self->deflate)) {
+            self->state = FRAME_HEADER;
+        }
+        if (out_sz > 0 || self->state == FRAME_HEADER) {
+            return out_sz;
+        }
+    }
+}
 
+STATIC mp_uint_t websocket_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
+    mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
+    const mp_stream_p_t *stream_p = mp_get_stream_raise(self->sock, MP_STREAM_OP_READ);
+    if (size == 0) {
+        return 0;
+    }
+    while (1) {
         switch (self->state) {
             case FRAME_HEADER: {
-                // TODO: Split frame handling below is untested so far, so conservatively disable it
-                assert(self->buf[0] & 0x80);
+                // The header is parsed from the receive buffer, usually it arrives
+                // together with (a part of) the payload in one read
+                int hdr_sz = ws_frame_parse(&self->frame, self->rx + self->rx_pos, self->rx_len - self->rx_pos);
+                if (hdr_sz < 0) {
+                    *errcode = MP_EIO;
+                    return MP_STREAM_ERROR;
+                }
+                if (hdr_sz == 0) {
+                    mp_uint_t out_sz = websocket_fill(self, stream_p, errcode);
+                    if (out_sz == 0 || out_sz == MP_STREAM_ERROR) {
+                        return out_sz;
+                    }
+                    continue;
+                }
+                self->rx_pos += hdr_sz;
+                self->z_pos = self->rx_pos;
 
                 // "Control frames MAY be injected in the middle of a fragmented message."
                 // So, they must be processed before data frames (and not alter
                 // self->ws_flags)
-                byte frame_type = self->buf[0];
+                byte frame_type = self->frame.flags;
                 self->last_flags = frame_type;
                 frame_type &= FRAME_OPCODE_MASK;
 
-                if ((self->buf[0] & FRAME_OPCODE_MASK) == FRAME_CONT) {
+                if (frame_type >= FRAME_CLOSE) {
+                    self->state = CONTROL;
+                    continue;
+                }
+                if (frame_type == FRAME_CONT) {
                     // Preserve previous frame type
-                    self->ws_flags = (self->ws_flags & FRAME_OPCODE_MASK) | (self->buf[0] & ~FRAME_OPCODE_MASK);
+                    self->ws_flags = (self->ws_flags & FRAME_OPCODE_MASK) | (self->frame.flags & ~FRAME_OPCODE_MASK);
                 } else {
-                    self->ws_flags = self->buf[0];
-                }
-
-                // Reset mask in case someone will use "simplified" protocol
-                // without masks.
-                memset(self->mask, 0, sizeof(self->mask));
-
-                int to_recv = 0;
-                size_t sz = self->buf[1] & 0x7f;
-                if (sz == 126) {
-                    // Msg size is next 2 bytes
-                    to_recv += 2;
-                } else if (sz == 127) {
-                    // Msg size is next 8 bytes
-                    assert(0);
-                }
-                if (self->buf[1] & 0x80) {
-                    // Next 4 bytes is mask
-                    to_recv += 4;
+                    self->ws_flags = self->frame.flags;
                 }
-
-                self->buf_pos = 0;
-                self->to_recv = to_recv;
-                self->msg_sz = sz; // May be overridden by FRAME_OPT
-                if (to_recv != 0) {
-                    self->state = FRAME_OPT;
-                } else {
-                    if (frame_type >= FRAME_CLOSE) {
-                        self->state = CONTROL;
-                    } else {
-                        self->state = PAYLOAD;
-                    }
+                if (self->frame.compressed && self->deflate == NULL) {
+                    // permessage-deflate not enabled
+                    *errcode = MP_EIO;
+                    return MP_STREAM_ERROR;
                 }
+                self->state = PAYLOAD;
                 continue;
             }
 
-            case FRAME_OPT: {
-                if ((self->buf_pos & 3) == 2) {
-                    // First two bytes are message length
-                    self->msg_sz = (self->buf[0] << 8) | self->buf[1];
+            case CONTROL: {
+                // Whole control frame payload (max. 125 bytes) is received into the buffer
+                if (self->rx_len - self->rx_pos < self->frame.remaining) {
+                    mp_uint_t out_sz = websocket_fill(self, stream_p, errcode);
+                    if (out_sz == 0 || out_sz == MP_STREAM_ERROR) {
+                        return out_sz;
+                    }
+                    continue;
                 }
-                if (self->buf_pos >= 4) {
-                    // Last 4 bytes is mask
-                    memcpy(self->mask, self->buf + self->buf_pos - 4, 4);
+                byte *payload = self->rx + self->rx_pos;
+                size_t payload_sz = ws_frame_payload(&self->frame, payload, self->frame.remaining);
+                self->rx_pos += payload_sz;
+                self->state = FRAME_HEADER;
+
+                byte frame_type = self->last_flags & FRAME_OPCODE_MASK;
+                if (frame_type == FRAME_CLOSE) {
+                    int err;
+                    websocket_send_frame(self, WS_FRAME_FIN | FRAME_CLOSE, "", 0, &err);
+                    return 0;
                 }
-                self->buf_pos = 0;
-                if ((self->last_flags & FRAME_OPCODE_MASK) >= FRAME_CLOSE) {
-                    self->state = CONTROL;
-                } else {
-                    self->state = PAYLOAD;
+                if (frame_type == FRAME_PING) {
+                    int err;
+                    websocket_send_frame(self, WS_FRAME_FIN | FRAME_PONG, payload, payload_sz, &err);
                 }
+                //DEBUG_printf("Finished receiving ctrl message %x, ignoring\n", self->last_flags);
                 continue;
             }
 
-            case PAYLOAD:
-            case CONTROL: {
-                mp_uint_t out_sz = 0;
-                if (self->msg_sz == 0) {
-                    // In case message had zero payload
-                    goto no_payload;
-                }
-
-                size_t sz = MIN(size, self->msg_sz);
-                out_sz = stream_p->read(self->sock, buf, sz, errcode);
-                if (out_sz == 0 || out_sz == MP_STREAM_ERROR) {
-                    return out_sz;
+            case PAYLOAD: {
+                if (self->frame.compressed) {
+                    mp_uint_t out_sz = websocket_read_compressed(self, stream_p, buf, size, errcode);
+                    if (out_sz != 0 || self->state == PAYLOAD) {
+                        return out_sz;
+                    }
+                    // End of the frame, not EOF
+                    continue;
                 }
-
-                sz = out_sz;
-                for (byte *p = buf; sz--; p++) {
-                    *p ^= self->mask[self->mask_pos++ & 3];
+                if (self->frame.remaining == 0) {
+                    // In case message had zero payload, it is not EOF
+                    self->state = FRAME_HEADER;
+                    continue;
                 }
 
-                self->msg_sz -= out_sz;
-                if (self->msg_sz == 0) {
-                    byte last_state;
-no_payload:
-                    last_state = self->state;
-                    self->state = FRAME_HEADER;
-                    self->to_recv = 2;
-                    self->mask_pos = 0;
-                    self->buf_pos = 0;
-
-                    // Handle control frame
-                    if (last_state == CONTROL) {
-                        byte frame_type = self->last_flags & FRAME_OPCODE_MASK;
-                        if (frame_type == FRAME_CLOSE) {
-                            static char close_resp[2] = {0x88, 0};
-                            int err;
-                            websocket_write(self_in, close_resp, sizeof(close_resp), &err);
-                            return 0;
-                        }
-
-                        //DEBUG_printf("Finished receiving ctrl message %x, ignoring\n", self->last_flags);
-                        continue;
+                mp_uint_t out_sz = MIN(size, self->frame.remaining);
+                if (self->rx_pos < self->rx_len) {
+                    // payload received together with the header
+                    out_sz = MIN(out_sz, (mp_uint_t)(self->rx_len - self->rx_pos));
+                    memcpy(buf, self->rx + self->rx_pos, out_sz);
+                    self->rx_pos += out_sz;
+                } else {
+                    // the rest of the payload is read directly into the caller's buffer
+                    out_sz = stream_p->read(self->sock, buf, out_sz, errcode);
+                    if (out_sz == 0 || out_sz == MP_STREAM_ERROR) {
+                        return out_sz;
                     }
                 }
-
-                if (out_sz != 0) {
-                    return out_sz;
+                self->z_pos = self->rx_pos;
+                // unmasked in place, 32 bits at a time
+                ws_frame_payload(&self->frame, buf, out_sz);
+                if (self->frame.remaining == 0) {
+                    self->state = FRAME_HEADER;
                 }
-                // Empty (data) frame received is not EOF
-                continue;
+                return out_sz;
             }
+        }
+    }
+}
 
+// Send one frame, short frames are sent with a single write
+STATIC mp_uint_t websocket_send_frame(mp_obj_websocket_t *self, byte flags, const void *buf, mp_uint_t size, int *errcode) {
+    byte frame[WS_FRAME_MAX_HEADER + WS_TX_COALESCE_SIZE];
+    int hdr_sz = ws_frame_header(frame, flags, size, NULL);
+    *errcode = 0;
+    if (size <= WS_TX_COALESCE_SIZE) {
+        memcpy(frame + hdr_sz, buf, size);
+        mp_stream_write_exactly(self->sock, frame, hdr_sz + size, errcode);
+    } else {
+        mp_stream_write_exactly(self->sock, frame, hdr_sz, errcode);
+        if (*errcode == 0) {
+            mp_stream_write_exactly(self->sock, buf, size, errcode);
         }
     }
+    if (*errcode != 0) {
+        return MP_STREAM_ERROR;
+    }
+    return size;
 }
 
 STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
     mp_obj_websocket_t *self =  MP_OBJ_TO_PTR(self_in);
-    assert(size < 0x10000);
-    byte header[4] = {0x80 | (self->opts & FRAME_OPCODE_MASK)};
-    int hdr_sz;
-    if (size < 126) {
-        header[1] = size;
-        hdr_sz = 2;
-    } else {
-        header[1] = 126;
-        header[2] = size >> 8;
-        header[3] = size & 0xff;
-        hdr_sz = 4;
-    }
+    byte flags = WS_FRAME_FIN | (self->opts & FRAME_OPCODE_MASK);
 
     mp_obj_t dest[3];
     if (self->opts & BLOCKING_WRITE) {
@@ -237,9 +325,26 @@ STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t si
         mp_call_method_n_kw(1, 0, dest);
     }
 
-    mp_uint_t out_sz = mp_stream_write_exactly(self->sock, header, hdr_sz, errcode);
-    if (*errcode == 0) {
-        out_sz = mp_stream_write_exactly(self->sock, buf, size, errcode);
+    mp_uint_t out_sz = MP_STREAM_ERROR;
+    bool sent = false;
+    if (self->deflate && size > 0 && (flags & FRAME_OPCODE_MASK) < FRAME_CLOSE) {
+        // compressed data message, sent uncompressed if it doesn't get smaller
+        size_t zbuf_sz = WS_DEFLATE_BOUND(size);
+        byte *zbuf = m_new_maybe(byte, zbuf_sz);
+        if (zbuf) {
+            int zlen = ws_deflate(self->deflate, buf, size, zbuf, zbuf_sz);
+            if (zlen >= 0 && (mp_uint_t)zlen < size) {
+                out_sz = websocket_send_frame(self, flags | WS_FRAME_RSV1, zbuf, zlen, errcode);
+                if (out_sz != MP_STREAM_ERROR) {
+                    out_sz = size;
+                }
+                sent = true;
+            }
+            m_del(byte, zbuf, zbuf_sz);
+        }
+    }
+    if (!sent) {
+        out_sz = websocket_send_frame(self, flags, buf, size, errcode);
     }
 
     if (self->opts & BLOCKING_WRITE) {
@@ -247,9 +352,6 @@ STATIC mp_uint_t websocket_write(mp_obj_t self_in, const void *buf, mp_uint_t si
         mp_call_method_n_kw(1, 0, dest);
     }
 
-    if (*errcode != 0) {
-        return MP_STREAM_ERROR;
-    }
     return out_sz;
 }
 
@@ -259,6 +361,7 @@ STATIC mp_uint_t websocket_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t
         case MP_STREAM_CLOSE:
             // TODO: Send close signaling to the other side, otherwise it's
             // abrupt close (connection abort).
+            websocket_free_deflate(self);
             mp_stream_close(self->sock);
             return 0;
         case MP_STREAM_GET_DATA_OPTS:
@@ -274,6 +377,13 @@ STATIC mp_uint_t websocket_ioctl(mp_obj_t self_in, mp_uint_t request, uintptr_t
     }
 }
 
+// Release the deflate state when the object is collected, the socket is not closed
+STATIC mp_obj_t websocket_del(mp_obj_t self_in) {
+    websocket_free_deflate(MP_OBJ_TO_PTR(self_in));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(websocket_del_obj, websocket_del);
+
 STATIC const mp_rom_map_elem_t websocket_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_read), MP_ROM_PTR(&mp_stream_read_obj) },
     { MP_ROM_QSTR(MP_QSTR_readinto), MP_ROM_PTR(&mp_stream_readinto_obj) },
@@ -281,6 +391,7 @@ STATIC const mp_rom_map_elem_t websocket_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_write), MP_ROM_PTR(&mp_stream_write_obj) },
     { MP_ROM_QSTR(MP_QSTR_ioctl), MP_ROM_PTR(&mp_stream_ioctl_obj) },
     { MP_ROM_QSTR(MP_QSTR_close), MP_ROM_PTR(&mp_stream_close_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&websocket_del_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(websocket_locals_dict, websocket_locals_dict_table);
 
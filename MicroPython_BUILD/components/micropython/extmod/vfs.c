@@ -247,9 +247,9 @@ mp_obj_t mp_vfs_umount(mp_obj_t mnt_in) {
 }
 MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_umount_obj, mp_vfs_umount);
 
-// Note: buffering and encoding args are currently ignored
+// Note: the encoding arg is currently ignored, buffering is passed to the VFS open if given
 mp_obj_t mp_vfs_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    enum { ARG_file, ARG_mode, ARG_encoding };
+    enum { ARG_file, ARG_mode, ARG_buffering, ARG_encoding };
     static const mp_arg_t allowed_args[] = {
         { MP_QSTR_file, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
         { MP_QSTR_mode, MP_ARG_OBJ, {.u_rom_obj = MP_ROM_QSTR(MP_QSTR_r)} },
@@ -262,6 +262,11 @@ mp_obj_t mp_vfs_open(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
     mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
 
     mp_vfs_mount_t *vfs = lookup_path((mp_obj_t)args[ARG_file].u_rom_obj, &args[ARG_file].u_obj);
+    if (args[ARG_buffering].u_int != -1) {
+        // buffering is only passed if given, VFS classes written in Python may not accept it
+        args[ARG_buffering].u_obj = MP_OBJ_NEW_SMALL_INT(args[ARG_buffering].u_int);
+        return mp_vfs_proxy_call(vfs, MP_QSTR_open, 3, (mp_obj_t*)&args);
+    }
     return mp_vfs_proxy_call(vfs, MP_QSTR_open, 2, (mp_obj_t*)&args);
 }
 MP_DEFINE_CONST_FUN_OBJ_KW(mp_vfs_open_obj, 0, mp_vfs_open);
@@ -317,6 +322,7 @@ typedef struct _mp_vfs_ilistdir_it_t {
     } cur;
     bool is_str;
     bool is_iter;
+    bool info;
 } mp_vfs_ilistdir_it_t;
 
 STATIC mp_obj_t mp_vfs_ilistdir_it_iternext(mp_obj_t self_in) {
@@ -333,26 +339,33 @@ STATIC mp_obj_t mp_vfs_ilistdir_it_iternext(mp_obj_t self_in) {
         self->cur.vfs = vfs->next;
         if (vfs->len == 1) {
             // vfs is mounted at root dir, delegate to it
-            mp_obj_t root = MP_OBJ_NEW_QSTR(MP_QSTR__slash_);
+            mp_obj_t args[2] = {MP_OBJ_NEW_QSTR(MP_QSTR__slash_), mp_const_true};
             self->is_iter = true;
-            self->cur.iter = mp_vfs_proxy_call(vfs, MP_QSTR_ilistdir, 1, &root);
+            self->cur.iter = mp_vfs_proxy_call(vfs, MP_QSTR_ilistdir, self->info ? 2 : 1, args);
             return mp_iternext(self->cur.iter);
         } else {
             // a mounted directory
-            mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(3, NULL));
+            mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(self->info ? 5 : 3, NULL));
             t->items[0] = mp_obj_new_str_of_type(
                 self->is_str ? &mp_type_str : &mp_type_bytes,
                 (const byte*)vfs->str + 1, vfs->len - 1);
             t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFDIR);
             t->items[2] = MP_OBJ_NEW_SMALL_INT(0); // no inode number
+            if (self->info) {
+                t->items[3] = MP_OBJ_NEW_SMALL_INT(0); // size
+                t->items[4] = MP_OBJ_NEW_SMALL_INT(0); // mtime
+            }
             return MP_OBJ_FROM_PTR(t);
         }
     }
 }
 
+// ilistdir([path[, info]])
+// if 'info' is True the entries are 5-tuples (name, type, inode, size, mtime)
 mp_obj_t mp_vfs_ilistdir(size_t n_args, const mp_obj_t *args) {
     mp_obj_t path_in;
-    if (n_args == 1) {
+    bool info = (n_args == 2) && mp_obj_is_true(args[1]);
+    if (n_args >= 1) {
         path_in = args[0];
     } else {
         path_in = MP_OBJ_NEW_QSTR(MP_QSTR_);
@@ -369,12 +382,17 @@ mp_obj_t mp_vfs_ilistdir(size_t n_args, const mp_obj_t *args) {
         iter->cur.vfs = MP_STATE_VM(vfs_mount_table);
         iter->is_str = mp_obj_get_type(path_in) == &mp_type_str;
         iter->is_iter = false;
+        iter->info = info;
         return MP_OBJ_FROM_PTR(iter);
     }
 
+    if (info) {
+        mp_obj_t proxy_args[2] = {path_out, mp_const_true};
+        return mp_vfs_proxy_call(vfs, MP_QSTR_ilistdir, 2, proxy_args);
+    }
     return mp_vfs_proxy_call(vfs, MP_QSTR_ilistdir, 1, &path_out);
 }
-MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_ilistdir_obj, 0, 1, mp_vfs_ilistdir);
+MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_vfs_ilistdir_obj, 0, 2, mp_vfs_ilistdir);
 
 mp_obj_t mp_vfs_listdir(size_t n_args, const mp_obj_t *args) {
     mp_obj_t iter = mp_vfs_ilistdir(n_args, args);
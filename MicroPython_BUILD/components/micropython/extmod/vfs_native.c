@@ -324,19 +324,21 @@ STATIC mp_obj_t native_vfs_mkfs(mp_obj_t bdev_in) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(native_vfs_mkfs_fun_obj, native_vfs_mkfs);
 STATIC MP_DEFINE_CONST_STATICMETHOD_OBJ(native_vfs_mkfs_obj, MP_ROM_PTR(&native_vfs_mkfs_fun_obj));
 
-STATIC MP_DEFINE_CONST_FUN_OBJ_3(native_vfs_open_obj, nativefs_builtin_open_self);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(native_vfs_open_obj, 3, 4, nativefs_builtin_open_self);
 
 //-----------------------------------------------------------------------------
 STATIC mp_obj_t native_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args) {
 	mp_obj_native_vfs_t *self = MP_OBJ_TO_PTR(args[0]);
 
 	bool is_str_type = true;
+	bool info = false;
 	const char *path;
-	if (n_args == 2) {
+	if (n_args >= 2) {
 		if (mp_obj_get_type(args[1]) == &mp_type_bytes) {
 			is_str_type = false;
 		}
 		path = mp_obj_str_get_str(args[1]);
+		if (n_args == 3) info = mp_obj_is_true(args[2]);
 	} else {
 		path = "";
 	}
@@ -348,9 +350,9 @@ STATIC mp_obj_t native_vfs_ilistdir_func(size_t n_args, const mp_obj_t *args) {
 		return mp_const_none;
 	}
 
-	return native_vfs_ilistdir2(self, path, is_str_type);
+	return native_vfs_ilistdir2(self, path, is_str_type, info);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(native_vfs_ilistdir_obj, 1, 2, native_vfs_ilistdir_func);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(native_vfs_ilistdir_obj, 1, 3, native_vfs_ilistdir_func);
 
 //--------------------------------------------------------------------
 STATIC mp_obj_t native_vfs_remove(mp_obj_t vfs_in, mp_obj_t path_in) {
@@ -369,6 +371,7 @@ STATIC mp_obj_t native_vfs_remove(mp_obj_t vfs_in, mp_obj_t path_in) {
 		mp_raise_OSError(errno);
 		return mp_const_none;
 	}
+	native_vfs_file_changed();
 
 	return mp_const_none;
 }
@@ -417,6 +420,7 @@ STATIC mp_obj_t native_vfs_rename(mp_obj_t vfs_in, mp_obj_t path_in, mp_obj_t pa
 	}
 
 	int res = rename(old_path, new_path);
+	if (res == 0) native_vfs_file_changed();
 	/*
 	// FIXME: have to check if we can replace files with this
 	if (res < 0 && errno == EEXISTS) {
@@ -520,6 +524,73 @@ STATIC mp_obj_t native_vfs_getdrive() {
 }
 MP_DEFINE_CONST_FUN_OBJ_0(native_vfs_getdrive_obj, native_vfs_getdrive);
 
+// Returns the device type of the mounted FAT file system the physical path is on,
+// negative error code if the path is not on FAT file system
+//=============================================================================
+int native_vfs_fat_device(const char *ph_path)
+{
+	int device;
+	if (strstr(ph_path, VFS_NATIVE_SDCARD_MOUNT_POINT) == ph_path) device = VFS_NATIVE_TYPE_SDCARD;
+	else if (strstr(ph_path, VFS_NATIVE_MOUNT_POINT) == ph_path) device = VFS_NATIVE_TYPE_SPIFLASH;
+	else return -MP_ENOENT;
+
+	if (!native_vfs_mounted[device]) return -MP_ENODEV;
+	#if CONFIG_MICROPY_FILESYSTEM_TYPE != 1
+	// internal file system is not FAT
+	if (device == VFS_NATIVE_TYPE_SPIFLASH) return -MP_EOPNOTSUPP;
+	#endif
+	return device;
+}
+
+/// Create the file and allocate the clusters for 'size' bytes on FAT file system
+/// Data written later does not have to allocate the clusters and update the FAT.
+/// The file is extended through the VFS, so the FatFs calls are serialized with
+/// the other users of the volume (open files, FTP server).
+/// An existing file is overwritten, the file size is set to 'size'.
+//-----------------------------------------------------------------------
+STATIC mp_obj_t native_vfs_preallocate(mp_obj_t path_in, mp_obj_t size_in) {
+	const char *path = mp_obj_str_get_str(path_in);
+	mp_int_t size = mp_obj_get_int(size_in);
+	if (size <= 0) {
+		mp_raise_ValueError("size must be > 0");
+	}
+
+	char ph_path[MICROPY_ALLOC_PATH_MAX + 1];
+	if ((strlen(cwd) + strlen(path) + strlen(VFS_NATIVE_SDCARD_MOUNT_POINT) + 1) >= sizeof(ph_path)) {
+		mp_raise_OSError(ENAMETOOLONG);
+	}
+	if (physicalPath(path, ph_path) < 0) {
+		mp_raise_OSError(MP_ENOENT);
+	}
+
+	// only on FAT file system
+	int res_dev = native_vfs_fat_device(ph_path);
+	if (res_dev < 0) {
+		mp_raise_OSError(-res_dev);
+	}
+
+	int fd = open(ph_path, O_WRONLY | O_CREAT | O_TRUNC);
+	if (fd < 0) {
+		mp_raise_OSError(errno);
+	}
+	// moving the file pointer of a file opened for writing past the end of file allocates the clusters,
+	// the file size is less than requested if there is not enough free space
+	int err = 0;
+	struct stat st;
+	if (lseek(fd, size, SEEK_SET) < 0) err = errno;
+	else if (fstat(fd, &st) != 0) err = errno;
+	else if (st.st_size != size) err = MP_ENOSPC;
+	if ((close(fd) != 0) && (err == 0)) err = errno;
+	native_vfs_file_changed();
+	if (err) {
+		ESP_LOGD(TAG, "preallocate('%s', %d) Error %d", ph_path, size, err);
+		if (err == MP_ENOSPC) unlink(ph_path);
+		mp_raise_OSError(err);
+	}
+	return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_2(native_vfs_preallocate_obj, native_vfs_preallocate);
+
 /// \function stat(path)
 /// Get the status of a file or directory.
 //------------------------------------------------------------------
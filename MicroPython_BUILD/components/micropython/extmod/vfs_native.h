@@ -81,10 +81,11 @@ int physicalPath(const char *path, char *ph_path);
 char *getcwd(char *buf, size_t size);
 const char * mkabspath(fs_user_mount_t *vfs, const char *path, char *absbuf, int buflen);
 mp_import_stat_t native_vfs_import_stat(struct _fs_user_mount_t *vfs, const char *path);
-mp_obj_t nativefs_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode);
+mp_obj_t nativefs_builtin_open_self(size_t n_args, const mp_obj_t *args);
 int mount_vfs(int type, char *chdir_to);
 MP_DECLARE_CONST_FUN_OBJ_KW(mp_builtin_open_obj);
 MP_DECLARE_CONST_FUN_OBJ_0(native_vfs_getdrive_obj);
+MP_DECLARE_CONST_FUN_OBJ_2(native_vfs_preallocate_obj);
 //MP_DECLARE_CONST_FUN_OBJ_2(native_vfs_chdir_obj);
 
 int internalUmount();
@@ -92,4 +93,7 @@ void externalUmount();
 
 bool file_noton_spi_sdcard(char *fname);
 
-mp_obj_t native_vfs_ilistdir2(struct _fs_user_mount_t *vfs, const char *path, bool is_str_type);
+mp_obj_t native_vfs_ilistdir2(struct _fs_user_mount_t *vfs, const char *path, bool is_str_type, bool info);
+int native_vfs_fat_device(const char *ph_path);
+// Must be called after a file is written, truncated, removed or renamed, from any task
+void native_vfs_file_changed();
@@ -38,13 +38,17 @@
 #if MICROPY_VFS
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #include "esp_vfs.h"
 #include "esp_system.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
 
 #include "py/nlr.h"
 #include "py/runtime.h"
@@ -52,6 +56,10 @@
 #include "py/mperrno.h"
 #include "extmod/vfs_native.h"
 
+#if MICROPY_VFS_NATIVE_GZIP
+#include "extmod/vfs_native_gz.h"
+#endif
+
 static const char *TAG = "vfs_native_file";
 
 extern const mp_obj_type_t mp_type_fileio;
@@ -60,6 +68,18 @@ extern const mp_obj_type_t mp_type_textio;
 typedef struct _pyb_file_obj_t {
 	mp_obj_base_t base;
 	int fd;
+	uint8_t *wbuf;			// write buffer, NULL if unbuffered
+	uint32_t wbuf_size;
+	uint32_t wbuf_len;		// number of bytes waiting in the write buffer
+	bool line_buf;			// flush the write buffer on new line
+#if MICROPY_VFS_NATIVE_RCACHE_PAGES > 0
+	bool rcache;			// read through the shared read cache
+	uint32_t rcache_file;	// the file's key of the cached pages
+	off_t pos;				// file position if reading through the cache
+#endif
+#if MICROPY_VFS_NATIVE_GZIP
+	gz_file_t *gz;
+#endif
 } pyb_file_obj_t;
 
 //-------------------------------------------------------------------------------------------
@@ -70,11 +90,224 @@ STATIC void file_obj_print(const mp_print_t *print, mp_obj_t self_in, mp_print_k
 	mp_printf(print, "<io.%s %d>", mp_obj_get_type_str(self_in), self->fd);
 }
 
+#if MICROPY_VFS_NATIVE_RCACHE_PAGES > 0
+
+// ==== Shared read cache ====
+// Pages of the files opened read-only are kept in a small cache shared by all opened files.
+// Small reads (readline, short records, random access) are served from the cache,
+// page aligned bulk reads go directly to the file system.
+// The file position of the read-only file is kept in 'pos', the fd position is only
+// set before the actual read.
+// The pages are keyed by the file (path, size and modification time at open), not by fd,
+// so all read-only opens of the same file share them.
+// Every change of any file advances the cache generation (native_vfs_file_changed()),
+// the pages read before it are not used any more. It is called on write, truncate,
+// remove and rename here and in uos, and by the FTP server and the C modules writing files.
+
+#define RCACHE_PAGE_SIZE	512
+
+typedef struct _rcache_page_t {
+	uint32_t file;		// file key, 0 if the page is not used
+	uint32_t gen;		// cache generation when the page was read
+	off_t offset;
+	uint32_t len;
+	uint32_t used;		// LRU tick
+} rcache_page_t;
+
+static rcache_page_t *rcache_pages = NULL;
+static uint8_t *rcache_data = NULL;
+static uint32_t rcache_tick = 0;
+static volatile uint32_t rcache_gen = 0;
+static portMUX_TYPE rcache_mux = portMUX_INITIALIZER_UNLOCKED;
+
+//-----------------------------
+static bool rcache_init()
+{
+	if (rcache_pages) return true;
+	rcache_data = malloc(MICROPY_VFS_NATIVE_RCACHE_PAGES * RCACHE_PAGE_SIZE);
+	if (rcache_data == NULL) return false;
+	rcache_pages = malloc(MICROPY_VFS_NATIVE_RCACHE_PAGES * sizeof(rcache_page_t));
+	if (rcache_pages == NULL) {
+		free(rcache_data);
+		rcache_data = NULL;
+		return false;
+	}
+	for (int i=0; i<MICROPY_VFS_NATIVE_RCACHE_PAGES; i++) {
+		rcache_pages[i].file = 0;
+	}
+	return true;
+}
+
+// Key of the file's cached pages, 0 if the file can't be cached
+//---------------------------------------------------------
+static uint32_t rcache_file_key(int fd, const char *fname)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0) return 0;
+	uint32_t h = 2166136261u;
+	while (*fname) h = (h ^ (uint8_t)*fname++) * 16777619u;
+	h = (h ^ (uint32_t)st.st_size) * 16777619u;
+	h = (h ^ (uint32_t)st.st_mtime) * 16777619u;
+	return (h) ? h : 1;
+}
+
+// Return the index of the cached page, read the page if not cached
+//----------------------------------------------------------------------
+static int rcache_get_page(int fd, uint32_t file, off_t offset)
+{
+	int idx = 0;
+	uint32_t gen = rcache_gen;
+	rcache_tick++;
+	for (int i=0; i<MICROPY_VFS_NATIVE_RCACHE_PAGES; i++) {
+		// pages read before the last file change are free
+		if (rcache_pages[i].gen != gen) rcache_pages[i].file = 0;
+		if ((rcache_pages[i].file == file) && (rcache_pages[i].offset == offset)) {
+			rcache_pages[i].used = rcache_tick;
+			return i;
+		}
+		// free page or the least recently used one is replaced
+		if (rcache_pages[idx].file != 0) {
+			if ((rcache_pages[i].file == 0) || ((rcache_tick - rcache_pages[i].used) > (rcache_tick - rcache_pages[idx].used))) idx = i;
+		}
+	}
+	rcache_pages[idx].file = 0;
+	if (lseek(fd, offset, SEEK_SET) == (off_t)-1) return -1;
+	int res = read(fd, rcache_data + (idx * RCACHE_PAGE_SIZE), RCACHE_PAGE_SIZE);
+	if (res < 0) return -1;
+	// the generation from before the read, a change during the read invalidates the page
+	rcache_pages[idx].file = file;
+	rcache_pages[idx].gen = gen;
+	rcache_pages[idx].offset = offset;
+	rcache_pages[idx].len = res;
+	rcache_pages[idx].used = rcache_tick;
+	return idx;
+}
+
+//------------------------------------------------------------------
+static int rcache_read(pyb_file_obj_t *self, uint8_t *buf, uint32_t size)
+{
+	uint32_t done = 0;
+	while (done < size) {
+		off_t page_offset = self->pos & ~(RCACHE_PAGE_SIZE-1);
+		uint32_t in_page = self->pos - page_offset;
+		uint32_t n = size - done;
+		if ((in_page == 0) && (n >= RCACHE_PAGE_SIZE)) {
+			// read whole pages directly
+			n &= ~(RCACHE_PAGE_SIZE-1);
+			if (lseek(self->fd, self->pos, SEEK_SET) == (off_t)-1) return -1;
+			int res = read(self->fd, buf + done, n);
+			if (res < 0) return -1;
+			self->pos += res;
+			done += res;
+			if ((uint32_t)res < n) break;
+			continue;
+		}
+		int idx = rcache_get_page(self->fd, self->rcache_file, page_offset);
+		if (idx < 0) return -1;
+		rcache_page_t *page = &rcache_pages[idx];
+		if (in_page >= page->len) break; // end of file
+		if (n > (page->len - in_page)) n = page->len - in_page;
+		memcpy(buf + done, rcache_data + (idx * RCACHE_PAGE_SIZE) + in_page, n);
+		self->pos += n;
+		done += n;
+	}
+	return done;
+}
+
+#endif
+
+//============================
+void native_vfs_file_changed()
+{
+#if MICROPY_VFS_NATIVE_RCACHE_PAGES > 0
+	portENTER_CRITICAL(&rcache_mux);
+	rcache_gen++;
+	portEXIT_CRITICAL(&rcache_mux);
+#endif
+}
+
+// Write all data to the file, returns the number of bytes written or -1 on error
+//------------------------------------------------------------------------------
+static int file_write_all(pyb_file_obj_t *self, const uint8_t *buf, uint32_t size)
+{
+	uint32_t sz_out_sum = 0;
+	while (sz_out_sum < size) {
+		int sz_out = write(self->fd, buf + sz_out_sum, size - sz_out_sum);
+		if (sz_out < 0) {
+			ESP_LOGD(TAG, "write(%d, buf, %d): error %d", self->fd, size - sz_out_sum, errno);
+			native_vfs_file_changed();
+			return -1;
+		}
+		if (sz_out == 0) break;
+		sz_out_sum += sz_out;
+	}
+	native_vfs_file_changed();
+	return sz_out_sum;
+}
+
+// Write the buffered data to the file
+//----------------------------------------------------
+static int file_wbuf_flush(pyb_file_obj_t *self)
+{
+	if (self->wbuf_len == 0) return 0;
+	int res = file_write_all(self, self->wbuf, self->wbuf_len);
+	if ((res >= 0) && (res < self->wbuf_len)) {
+		errno = ENOSPC;
+		res = -1;
+	}
+	self->wbuf_len = 0;
+	return (res < 0) ? -1 : 0;
+}
+
+// Flush the write buffer, free the buffers and close the file
+// Returns 0 on success or the error code
+//----------------------------------------------
+static int file_close_fd(pyb_file_obj_t *self)
+{
+	// if fd==-1 then the file is closed and in that case this is a no-op
+	if (self->fd == -1) return 0;
+
+	int err = 0;
+	if (self->wbuf) {
+		if (file_wbuf_flush(self) < 0) err = errno;
+		free(self->wbuf);
+		self->wbuf = NULL;
+	}
+#if MICROPY_VFS_NATIVE_GZIP
+	if (self->gz) {
+		native_vfs_gz_close(self->gz);
+		self->gz = NULL;
+	}
+#endif
+	int res = close(self->fd);
+	if ((res < 0) && (err == 0)) err = errno;
+	if (err) {
+		ESP_LOGD(TAG, "close(%d): error %d", self->fd, err);
+	}
+	self->fd = -1;
+	return err;
+}
+
 //-----------------------------------------------------------------------------------------
 STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int *errcode) {
 	pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-	int sz_out = read(self->fd, buf, size);
+	// in read/write mode the buffered data must be written before reading
+	if ((self->wbuf_len) && (file_wbuf_flush(self) < 0)) {
+		*errcode = errno;
+		return MP_STREAM_ERROR;
+	}
+	int sz_out;
+#if MICROPY_VFS_NATIVE_GZIP
+	if (self->gz) sz_out = native_vfs_gz_read(self->gz, self->fd, buf, size);
+	else
+#endif
+#if MICROPY_VFS_NATIVE_RCACHE_PAGES > 0
+	if (self->rcache) sz_out = rcache_read(self, buf, size);
+	else
+#endif
+	sz_out = read(self->fd, buf, size);
+
 	if (sz_out < 0) {
 		ESP_LOGD(TAG, "read(%d, buf, %d): error %d", self->fd, size, errno);
 		*errcode = errno;
@@ -87,39 +320,48 @@ STATIC mp_uint_t file_obj_read(mp_obj_t self_in, void *buf, mp_uint_t size, int
 STATIC mp_uint_t file_obj_write(mp_obj_t self_in, const void *buf, mp_uint_t size, int *errcode) {
 	pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-	int sz_out = write(self->fd, buf, size);
-	if (sz_out < 0) {
-		ESP_LOGD(TAG, "write(%d, buf, %d): error %d", self->fd, size, errno);
-		*errcode = errno;
-		return MP_STREAM_ERROR;
-	}
-	mp_uint_t sz_out_sum = sz_out;
-	while (sz_out > 0) {
-		buf = &((const uint8_t *) buf)[sz_out];
-		size -= sz_out;
-		sz_out = write(self->fd, buf, size);
+	if (self->wbuf == NULL) {
+		// unbuffered
+		int sz_out = file_write_all(self, buf, size);
 		if (sz_out < 0) {
-			ESP_LOGD(TAG, "write(%d, buf, %d): error %d", self->fd, size, errno);
 			*errcode = errno;
 			return MP_STREAM_ERROR;
 		}
-		sz_out_sum += sz_out;
+		return sz_out;
 	}
 
-	return sz_out_sum;
+	if ((self->wbuf_len + size) > self->wbuf_size) {
+		if (file_wbuf_flush(self) < 0) {
+			*errcode = errno;
+			return MP_STREAM_ERROR;
+		}
+	}
+	if (size >= self->wbuf_size) {
+		// large writes bypass the buffer
+		int sz_out = file_write_all(self, buf, size);
+		if (sz_out < 0) {
+			*errcode = errno;
+			return MP_STREAM_ERROR;
+		}
+		return sz_out;
+	}
+	memcpy(self->wbuf + self->wbuf_len, buf, size);
+	self->wbuf_len += size;
+	if ((self->line_buf) && (memchr(buf, '\n', size) != NULL)) {
+		if (file_wbuf_flush(self) < 0) {
+			*errcode = errno;
+			return MP_STREAM_ERROR;
+		}
+	}
+	return size;
 }
 
 //------------------------------------------------
 STATIC mp_obj_t file_obj_close(mp_obj_t self_in) {
 	pyb_file_obj_t *self = MP_OBJ_TO_PTR(self_in);
-	// if fs==NULL then the file is closed and in that case this method is a no-op
-	if (self->fd != -1) {
-		int res = close(self->fd);
-		self->fd = -1;
-		if (res < 0) {
-			ESP_LOGD(TAG, "close(%d): error %d", self->fd, errno);
-			mp_raise_OSError(errno);
-		}
+	int err = file_close_fd(self);
+	if (err) {
+		mp_raise_OSError(err);
 	}
 	return mp_const_none;
 }
@@ -139,32 +381,72 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 	if (request == MP_STREAM_SEEK) {
 		struct mp_stream_seek_t *s = (struct mp_stream_seek_t*)(uintptr_t)arg;
 
+		if ((self->wbuf_len) && (file_wbuf_flush(self) < 0)) {
+			*errcode = errno;
+			return MP_STREAM_ERROR;
+		}
+#if MICROPY_VFS_NATIVE_GZIP
+		if (self->gz) {
+			mp_off_t target = s->offset;
+			if (s->whence == 1) target += self->gz->pos;
+			else if (s->whence == 2) target += self->gz->size;
+			if ((target < 0) || (native_vfs_gz_seek(self->gz, self->fd, target) < 0)) {
+				*errcode = (target < 0) ? MP_EINVAL : errno;
+				return MP_STREAM_ERROR;
+			}
+			s->offset = self->gz->pos;
+			return 0;
+		}
+#endif
+#if MICROPY_VFS_NATIVE_RCACHE_PAGES > 0
+		if ((self->rcache) && (s->whence != 2)) {
+			// only the logical position is changed
+			mp_off_t target = s->offset;
+			if (s->whence == 1) target += self->pos;
+			if (target < 0) {
+				*errcode = MP_EINVAL;
+				return MP_STREAM_ERROR;
+			}
+			self->pos = target;
+			s->offset = target;
+			return 0;
+		}
+#endif
 		off_t off = lseek(self->fd, s->offset, s->whence);
 		if (off == (off_t)-1) {
 			ESP_LOGD(TAG, "ioctl(%d, %d, ..): error %d", self->fd, request, errno);
 			*errcode = errno;
 			return MP_STREAM_ERROR;
 		}
+#if MICROPY_VFS_NATIVE_RCACHE_PAGES > 0
+		self->pos = off;
+#endif
 		s->offset = off;
 		return 0;
 
 	} else if (request == MP_STREAM_FLUSH) {
-		// fsync() not implemented.
+		// write the buffered data and commit it to the file system
+		if (self->fd == -1) return 0;
+		if ((self->wbuf_len) && (file_wbuf_flush(self) < 0)) {
+			*errcode = errno;
+			return MP_STREAM_ERROR;
+		}
+		if ((fsync(self->fd) < 0) && (errno != ENOSYS)) {
+			ESP_LOGD(TAG, "fsync(%d): error %d", self->fd, errno);
+			*errcode = errno;
+			return MP_STREAM_ERROR;
+		}
+		return 0;
+
+	} else if (request == MP_STREAM_CLOSE) {
+		int err = file_close_fd(self);
+		if (err) {
+			*errcode = err;
+			return MP_STREAM_ERROR;
+		}
 		return 0;
 
-    } else if (request == MP_STREAM_CLOSE) {
-        // if fs==NULL then the file is closed and in that case this method is a no-op
-        if (self->fd != -1) {
-    		int res = close(self->fd);
-    		self->fd = -1;
-    		if (res < 0) {
-                *errcode = errno;
-                return MP_STREAM_ERROR;
-    		}
-        }
-        return 0;
-
-    } else {
+	} else {
 		ESP_LOGD(TAG, "ioctl(%d, %d, ..): error %d", self->fd, request, MP_EINVAL);
 		*errcode = MP_EINVAL;
 		return MP_STREAM_ERROR;
@@ -177,6 +459,7 @@ STATIC mp_uint_t file_obj_ioctl(mp_obj_t o_in, mp_uint_t request, uintptr_t arg,
 STATIC const mp_arg_t file_open_args[] = {
 	{ MP_QSTR_file, MP_ARG_OBJ | MP_ARG_REQUIRED, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
 	{ MP_QSTR_mode, MP_ARG_OBJ, {.u_obj = MP_OBJ_NEW_QSTR(MP_QSTR_r)} },
+	{ MP_QSTR_buffering, MP_ARG_INT, {.u_int = -1} },
 	{ MP_QSTR_encoding, MP_ARG_OBJ | MP_ARG_KW_ONLY, {.u_rom_obj = MP_ROM_PTR(&mp_const_none_obj)} },
 };
 #define FILE_OPEN_NUM_ARGS MP_ARRAY_SIZE(file_open_args)
@@ -184,6 +467,19 @@ STATIC const mp_arg_t file_open_args[] = {
 //----------------------------------------------------------------------------------------------
 STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_arg_val_t *args) {
 	pyb_file_obj_t *o = m_new_obj_with_finaliser(pyb_file_obj_t);
+	o->fd = -1;
+	o->wbuf = NULL;
+	o->wbuf_size = 0;
+	o->wbuf_len = 0;
+	o->line_buf = false;
+#if MICROPY_VFS_NATIVE_RCACHE_PAGES > 0
+	o->rcache = false;
+	o->rcache_file = 0;
+	o->pos = 0;
+#endif
+#if MICROPY_VFS_NATIVE_GZIP
+	o->gz = NULL;
+#endif
 
 	const char *fname = mp_obj_str_get_str(args[0].u_obj);
 	const char *mode_s = mp_obj_str_get_str(args[1].u_obj);
@@ -228,8 +524,31 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
 	}
 	o->base.type = type;
 
+	// buffering: -1 default, 0 unbuffered (binary mode only), 1 line buffering (text mode), >1 buffer size
+	mp_int_t buffering = args[2].u_int;
+	if ((buffering == 0) && (type == &mp_type_textio)) {
+		mp_raise_ValueError("can't have unbuffered text I/O");
+	}
+
 	assert(vfs != NULL);
 	int fd = open(fname, mode_x | mode_rw, 0644);
+#if MICROPY_VFS_NATIVE_GZIP
+	if ((fd == -1) && (errno == ENOENT) && (mode_rw == O_RDONLY) && (mode_x == 0)) {
+		// try the gzip compressed file
+		char gzname[MICROPY_ALLOC_PATH_MAX + 4];
+		snprintf(gzname, sizeof(gzname), "%s.gz", fname);
+		fd = open(gzname, O_RDONLY, 0644);
+		if (fd != -1) {
+			o->gz = native_vfs_gz_open(fd);
+			if (o->gz == NULL) {
+				close(fd);
+				fd = -1;
+				errno = ENOENT;
+			}
+		}
+		else errno = ENOENT;
+	}
+#endif
 	if (fd == -1) {
 		ESP_LOGD(TAG, "open('%s', '%s'): error %d", fname, mode_s_orig, errno);
 		m_del_obj(pyb_file_obj_t, o);
@@ -239,6 +558,30 @@ STATIC mp_obj_t file_open(fs_user_mount_t *vfs, const mp_obj_type_t *type, mp_ar
     if (mode_x & O_APPEND) {
         lseek(fd, 0, 2);
     }
+	// created or truncated
+	if (mode_x & O_CREAT) native_vfs_file_changed();
+
+	if ((mode_rw != O_RDONLY) && (buffering != 0)) {
+		// write buffer, if it can't be allocated the file is unbuffered
+		o->line_buf = (buffering == 1) && (type == &mp_type_textio);
+		o->wbuf_size = (buffering > 1) ? buffering : MICROPY_VFS_NATIVE_WBUF_SIZE;
+		if ((o->wbuf_size == 0) && (o->line_buf)) o->wbuf_size = 128;
+		if (o->wbuf_size) {
+			o->wbuf = malloc(o->wbuf_size);
+			if (o->wbuf == NULL) o->wbuf_size = 0;
+		}
+	}
+#if MICROPY_VFS_NATIVE_RCACHE_PAGES > 0
+	if ((mode_rw == O_RDONLY) && (buffering != 0)) {
+		#if MICROPY_VFS_NATIVE_GZIP
+		if (o->gz == NULL)
+		#endif
+		if (rcache_init()) {
+			o->rcache_file = rcache_file_key(fd, fname);
+			o->rcache = (o->rcache_file != 0);
+		}
+	}
+#endif
 	return MP_OBJ_FROM_PTR(o);
 }
 
@@ -312,14 +655,15 @@ const mp_obj_type_t mp_type_textio = {
 };
 
 // Factory function for I/O stream classes
-//-----------------------------------------------------------------------------------
-mp_obj_t nativefs_builtin_open_self(mp_obj_t self_in, mp_obj_t path, mp_obj_t mode) {
-	// TODO: analyze buffering args and instantiate appropriate type
-	fs_user_mount_t *self = MP_OBJ_TO_PTR(self_in);
+// args: self, path, mode [, buffering]
+//--------------------------------------------------------------------
+mp_obj_t nativefs_builtin_open_self(size_t n_args, const mp_obj_t *args) {
+	fs_user_mount_t *self = MP_OBJ_TO_PTR(args[0]);
 	mp_arg_val_t arg_vals[FILE_OPEN_NUM_ARGS];
-	arg_vals[0].u_obj = path;
-	arg_vals[1].u_obj = mode;
-	arg_vals[2].u_obj = mp_const_none;
+	arg_vals[0].u_obj = args[1];
+	arg_vals[1].u_obj = args[2];
+	arg_vals[2].u_int = (n_args > 3) ? mp_obj_get_int(args[3]) : -1;
+	arg_vals[3].u_obj = mp_const_none;
 	return file_open(self, &mp_type_textio, arg_vals);
 }
 
@@ -0,0 +1,202 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "py/mpconfig.h"
+#if MICROPY_VFS && MICROPY_VFS_NATIVE_GZIP
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include "esp_log.h"
+#include "extmod/vfs_native_gz.h"
+
+static const char *TAG = "vfs_native_gz";
+
+//-------------------------------------------
+static uint32_t gz_get32(const uint8_t *buf)
+{
+	return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+//------------------------------------------------
+static bool gz_skip_string(int fd, uint32_t *pos)
+{
+	uint8_t c;
+	do {
+		if (read(fd, &c, 1) != 1) return false;
+		(*pos)++;
+	} while (c != 0);
+	return true;
+}
+
+//---------------------------------------------------------
+static void gz_parse_extra(gz_file_t *gz, const uint8_t *x, int xlen, int *wbits)
+{
+	int off = 0;
+	while ((off + 4) <= xlen) {
+		int len = x[off+2] | (x[off+3] << 8);
+		if ((off + 4 + len) > xlen) break;
+		if ((x[off] == 'R') && (x[off+1] == 'P') && (len >= 8)) {
+			const uint8_t *rp = x + off + 4;
+			*wbits = rp[0];
+			gz->rp_chunk = gz_get32(rp+4);
+			gz->rp_count = (len - 8) / 4;
+			gz->rp_offs = malloc(gz->rp_count * sizeof(uint32_t));
+			if ((gz->rp_offs == NULL) || (gz->rp_chunk == 0) || (*wbits < 8) || (*wbits > 15)) {
+				// unusable index, read sequentially
+				free(gz->rp_offs);
+				gz->rp_offs = NULL;
+				gz->rp_chunk = 0;
+				gz->rp_count = 0;
+				*wbits = 15;
+			}
+			else {
+				for (uint32_t i = 0; i < gz->rp_count; i++) gz->rp_offs[i] = gz_get32(rp + 8 + (i*4));
+			}
+		}
+		off += 4 + len;
+	}
+}
+
+//=======================================
+gz_file_t *native_vfs_gz_open(int fd)
+{
+	uint8_t hdr[10];
+	if ((read(fd, hdr, 10) != 10) || (hdr[0] != 0x1f) || (hdr[1] != 0x8b) || (hdr[2] != 8)) return NULL;
+
+	gz_file_t *gz = calloc(1, sizeof(gz_file_t));
+	if (gz == NULL) return NULL;
+
+	int wbits = 15;
+	uint32_t pos = 10;
+	if (hdr[3] & 0x04) {
+		// FEXTRA
+		if (read(fd, hdr, 2) != 2) goto error;
+		int xlen = hdr[0] | (hdr[1] << 8);
+		uint8_t *xbuf = malloc(xlen);
+		if (xbuf == NULL) goto error;
+		if (read(fd, xbuf, xlen) != xlen) {
+			free(xbuf);
+			goto error;
+		}
+		gz_parse_extra(gz, xbuf, xlen, &wbits);
+		free(xbuf);
+		pos += 2 + xlen;
+	}
+	if ((hdr[3] & 0x08) && (!gz_skip_string(fd, &pos))) goto error; // FNAME
+	if ((hdr[3] & 0x10) && (!gz_skip_string(fd, &pos))) goto error; // FCOMMENT
+	if (hdr[3] & 0x02) pos += 2; // FHCRC
+	gz->data_start = pos;
+
+	// uncompressed size from the trailer
+	off_t end = lseek(fd, -4, SEEK_END);
+	if ((end < (off_t)(pos + 4)) || (read(fd, hdr, 4) != 4)) goto error;
+	gz->size = gz_get32(hdr);
+	gz->data_end = end - 4;
+
+	if (inflateInit2(&gz->strm, -wbits) != Z_OK) goto error;
+	if (lseek(fd, gz->data_start, SEEK_SET) < 0) {
+		inflateEnd(&gz->strm);
+		goto error;
+	}
+	gz->in_pos = gz->data_start;
+	return gz;
+
+error:
+	free(gz->rp_offs);
+	free(gz);
+	return NULL;
+}
+
+//=========================================
+void native_vfs_gz_close(gz_file_t *gz)
+{
+	inflateEnd(&gz->strm);
+	free(gz->rp_offs);
+	free(gz);
+}
+
+//==========================================================================
+int native_vfs_gz_read(gz_file_t *gz, int fd, uint8_t *buf, uint32_t size)
+{
+	gz->strm.next_out = buf;
+	gz->strm.avail_out = size;
+
+	while ((gz->strm.avail_out > 0) && (!gz->eof)) {
+		if ((gz->strm.avail_in == 0) && (gz->in_pos < gz->data_end)) {
+			uint32_t n = gz->data_end - gz->in_pos;
+			if (n > GZ_INBUF_SIZE) n = GZ_INBUF_SIZE;
+			int res = read(fd, gz->inbuf, n);
+			if (res <= 0) return -1;
+			gz->in_pos += res;
+			gz->strm.next_in = gz->inbuf;
+			gz->strm.avail_in = res;
+		}
+		// with all input consumed inflate may still have buffered output
+		int res = inflate(&gz->strm, Z_NO_FLUSH);
+		if (res == Z_STREAM_END) gz->eof = true;
+		else if ((res == Z_BUF_ERROR) && (gz->strm.avail_in == 0)) gz->eof = true; // truncated stream
+		else if (res != Z_OK) {
+			ESP_LOGD(TAG, "inflate error %d", res);
+			errno = EIO;
+			return -1;
+		}
+	}
+	uint32_t n = size - gz->strm.avail_out;
+	gz->pos += n;
+	return n;
+}
+
+//==============================================================
+int native_vfs_gz_seek(gz_file_t *gz, int fd, uint32_t target)
+{
+	if (target > gz->size) target = gz->size;
+
+	// Restart from the nearest restart point if going backwards or past the next one
+	if ((target < gz->pos) || ((gz->rp_chunk) && ((target / gz->rp_chunk) > (gz->pos / gz->rp_chunk)))) {
+		uint32_t idx = (gz->rp_chunk) ? (target / gz->rp_chunk) : 0;
+		if ((gz->rp_count) && (idx >= gz->rp_count)) idx = gz->rp_count - 1;
+		gz->in_pos = gz->data_start + ((gz->rp_count) ? gz->rp_offs[idx] : 0);
+		if (lseek(fd, gz->in_pos, SEEK_SET) < 0) return -1;
+		inflateReset(&gz->strm);
+		gz->strm.avail_in = 0;
+		gz->pos = idx * gz->rp_chunk;
+		gz->eof = false;
+	}
+	// Decompress and discard up to the target position
+	uint8_t scratch[256];
+	while (gz->pos < target) {
+		uint32_t n = target - gz->pos;
+		if (n > sizeof(scratch)) n = sizeof(scratch);
+		int res = native_vfs_gz_read(gz, fd, scratch, n);
+		if (res < 0) return -1;
+		if (res == 0) break;
+	}
+	return 0;
+}
+
+#endif // MICROPY_VFS_NATIVE_GZIP
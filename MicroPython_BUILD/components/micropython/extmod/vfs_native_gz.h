@@ -0,0 +1,71 @@
+/*
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * The MIT License (MIT)
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+// ==== Transparent read of gzip compressed files ====
+// If the file opened for reading does not exist, but '<name>.gz' does,
+// the compressed file is opened and decompressed on read.
+// The image builders (mkspiffs/mklfs/mkfatfs -z) fully flush the deflate stream
+// every 'chunk' uncompressed bytes and store the compressed offsets of those
+// restart points in the gzip header extra field (subfield 'R','P'):
+//   wbits (1 byte), reserved (3 bytes), chunk (4 bytes), offsets (4 bytes each)
+// so seek only has to decompress from the nearest restart point.
+// Files without the index (created by gzip) can be read, but seek backwards
+// restarts from the beginning of the file.
+// The reader only uses read()/lseek() on the file descriptor.
+
+#ifndef MICROPY_INCLUDED_EXTMOD_VFS_NATIVE_GZ_H
+#define MICROPY_INCLUDED_EXTMOD_VFS_NATIVE_GZ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "zlib.h"
+
+#define GZ_INBUF_SIZE	1024
+
+typedef struct _gz_file_t {
+	z_stream strm;
+	uint8_t inbuf[GZ_INBUF_SIZE];
+	uint32_t data_start;	// file offset of the deflate data
+	uint32_t data_end;		// file offset of the gzip trailer
+	uint32_t in_pos;		// file offset of the next compressed byte
+	uint32_t size;			// uncompressed size
+	uint32_t pos;			// current uncompressed position
+	uint32_t rp_chunk;		// uncompressed bytes between restart points (0: no index)
+	uint32_t rp_count;
+	uint32_t *rp_offs;		// compressed offsets of the restart points
+	bool eof;
+} gz_file_t;
+
+// Parse the gzip header and trailer of the opened file, prepare inflate
+// Returns NULL if the file is not a valid gzip file
+gz_file_t *native_vfs_gz_open(int fd);
+void native_vfs_gz_close(gz_file_t *gz);
+// Returns the number of bytes read, 0 at the end of file, -1 on error (errno set)
+int native_vfs_gz_read(gz_file_t *gz, int fd, uint8_t *buf, uint32_t size);
+// Set the uncompressed position, returns 0 on success, -1 on error
+int native_vfs_gz_seek(gz_file_t *gz, int fd, uint32_t target);
+
+#endif // MICROPY_INCLUDED_EXTMOD_VFS_NATIVE_GZ_H
@@ -38,31 +38,105 @@
 
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
 #include <dirent.h>
 #include <errno.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <time.h>
 #include <esp_log.h>
+#include "ff.h"
 
 #include "py/nlr.h"
 #include "py/runtime.h"
 #include "extmod/vfs_native.h"
 #include "py/lexer.h"
+#include "sdkconfig.h"
+
+#if CONFIG_MICROPY_FILESYSTEM_TYPE == 2
+#include "libs/littleflash.h"
+#endif
 
 //static const char *TAG = "vfs_native_misc";
 
+// Directory object of the esp-idf FAT VFS (components/fatfs/src/vfs_fat.c),
+// after readdir() 'filinfo' holds the FatFs entry of the returned name.
+// The structure is private to vfs_fat.c, this is its layout in ESP-IDF v3.1,
+// which comes with FatFs R0.12b; with other versions the entries are stat'ed
+#if defined(_FATFS) && (_FATFS == 68020)
+#define NATIVE_VFS_FAT_DIRENT_INFO	(1)
+typedef struct {
+	DIR dir;
+	long offset;
+	FF_DIR ffdir;
+	FILINFO filinfo;
+	struct dirent cur_dirent;
+} native_vfs_fat_dir_t;
+
+// v3.1 esp_vfs DIR is {uint16_t dd_vfs_idx; uint16_t dd_rsv;}
+_Static_assert((sizeof(DIR) == 4) && (offsetof(native_vfs_fat_dir_t, ffdir) == 8),
+		"native_vfs_fat_dir_t does not match the ESP-IDF v3.1 vfs_fat_dir_t");
+#else
+#define NATIVE_VFS_FAT_DIRENT_INFO	(0)
+#endif
+
 typedef struct _mp_vfs_native_ilistdir_it_t {
 	mp_obj_base_t base;
-	mp_fun_1_t iternext;
 	bool is_str;
+	bool info;			// return 5-tuples with size and mtime
+	bool is_fat;		// directory is on FAT, size and mtime are read with the entry
+	bool is_lfs;		// directory is on littlefs, size and mtime are read with the entry
 	DIR *dir;
+	char *path;			// directory path, used to stat the entries on spiffs
 } mp_vfs_native_ilistdir_it_t;
 
+//---------------------------------------------------------------------------------------------------------
+STATIC mp_obj_t make_dir_entry(mp_vfs_native_ilistdir_it_t *self, const char *fn, bool is_dir, mp_int_t size, mp_int_t mtime) {
+	mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple((self->info) ? 5 : 3, NULL));
+	if (self->is_str) {
+		t->items[0] = mp_obj_new_str(fn, strlen(fn));
+	} else {
+		t->items[0] = mp_obj_new_bytes((const byte*)fn, strlen(fn));
+	}
+	t->items[1] = MP_OBJ_NEW_SMALL_INT((is_dir) ? MP_S_IFDIR : MP_S_IFREG);
+	t->items[2] = MP_OBJ_NEW_SMALL_INT(0); // no inode number
+	if (self->info) {
+		t->items[3] = mp_obj_new_int(size);
+		t->items[4] = mp_obj_new_int(mtime);
+	}
+	return MP_OBJ_FROM_PTR(t);
+}
+
+#if NATIVE_VFS_FAT_DIRENT_INFO
+// FILINFO of the entry just read by readdir() contains the size and time,
+// no separate stat is needed
+//-------------------------------------------------------------------------------------------
+STATIC bool fat_dirent_info(DIR *dir, const char *fn, uint32_t *size, uint32_t *mtime) {
+	FILINFO *fno = &((native_vfs_fat_dir_t *)dir)->filinfo;
+	// the entry name is copied from FILINFO, check it is the same entry
+	if (strcmp(fno->fname, fn) != 0) return false;
+
+	// same conversion as used by esp-idf stat()
+	struct tm tm = { 0 };
+	tm.tm_mday = fno->fdate & 0x1f;
+	tm.tm_mon = ((fno->fdate >> 5) & 0xf) - 1;
+	tm.tm_year = (fno->fdate >> 9) + 80;
+	tm.tm_sec = (fno->ftime & 0x1f) * 2;
+	tm.tm_min = (fno->ftime >> 5) & 0x3f;
+	tm.tm_hour = (fno->ftime >> 11) & 0x1f;
+	*size = fno->fsize;
+	*mtime = mktime(&tm);
+	return true;
+}
+#endif
+
 //--------------------------------------------------------------------
 STATIC mp_obj_t mp_vfs_native_ilistdir_it_iternext(mp_obj_t self_in) {
 	mp_vfs_native_ilistdir_it_t *self = MP_OBJ_TO_PTR(self_in);
 
+	if (self->dir == NULL) return MP_OBJ_STOP_ITERATION;
+
 	for (;;) {
 		struct dirent *de;
 		de = readdir(self->dir);
@@ -77,37 +151,89 @@ STATIC mp_obj_t mp_vfs_native_ilistdir_it_iternext(mp_obj_t self_in) {
 		if (fn[0] == '.' && ((fn[1] == '.' && fn[2] == 0) || fn[1] == 0))
 			continue;
 
-		// make 3-tuple with info about this entry
-		mp_obj_tuple_t *t = MP_OBJ_TO_PTR(mp_obj_new_tuple(3, NULL));
-		if (self->is_str) {
-			t->items[0] = mp_obj_new_str(fn, strlen(fn));
-		} else {
-			t->items[0] = mp_obj_new_bytes((const byte*)fn, strlen(fn));
+		uint32_t size = 0, mtime = 0;
+		if (self->info) {
+			bool have_info = false;
+			#if NATIVE_VFS_FAT_DIRENT_INFO
+			if (self->is_fat) have_info = fat_dirent_info(self->dir, fn, &size, &mtime);
+			#endif
+			#if CONFIG_MICROPY_FILESYSTEM_TYPE == 2
+			if ((!have_info) && (self->is_lfs)) {
+				// read together with the entry
+				have_info = (littleFlash_getDirentInfo(self->dir, &size, &mtime) == 0);
+			}
+			#endif
+			if (!have_info) {
+				// no size and time in directory entry, stat the file
+				char fpath[strlen(self->path) + strlen(fn) + 2];
+				struct stat buf;
+				sprintf(fpath, "%s/%s", self->path, fn);
+				if (stat(fpath, &buf) == 0) {
+					size = buf.st_size;
+					mtime = buf.st_mtime;
+				}
+			}
 		}
-		if (de->d_type & DT_DIR) {
-			// dir
-			t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFDIR);
-		} else {
-			// file
-			t->items[1] = MP_OBJ_NEW_SMALL_INT(MP_S_IFREG);
-		}
-		t->items[2] = MP_OBJ_NEW_SMALL_INT(0); // no inode number
 
-		return MP_OBJ_FROM_PTR(t);
+		// make 3-tuple (5-tuple) with info about this entry
+		return make_dir_entry(self, fn, (de->d_type & DT_DIR), size, mtime);
 	}
 
-	// ignore error because we may be closing a second time
 	closedir(self->dir);
+	self->dir = NULL;
 
 	return MP_OBJ_STOP_ITERATION;
 }
 
-//---------------------------------------------------------------------------------------
-mp_obj_t native_vfs_ilistdir2(fs_user_mount_t *vfs, const char *path, bool is_str_type) {
-	mp_vfs_native_ilistdir_it_t *iter = m_new_obj(mp_vfs_native_ilistdir_it_t);
-	iter->base.type = &mp_type_polymorph_iter;
-	iter->iternext = mp_vfs_native_ilistdir_it_iternext;
+// Closes the directory if the iteration was not finished
+//---------------------------------------------------------------
+STATIC mp_obj_t mp_vfs_native_ilistdir_it_del(mp_obj_t self_in) {
+	mp_vfs_native_ilistdir_it_t *self = MP_OBJ_TO_PTR(self_in);
+
+	if (self->dir) {
+		closedir(self->dir);
+		self->dir = NULL;
+	}
+	return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mp_vfs_native_ilistdir_it_del_obj, mp_vfs_native_ilistdir_it_del);
+
+STATIC const mp_rom_map_elem_t mp_vfs_native_ilistdir_it_locals_dict_table[] = {
+	{ MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mp_vfs_native_ilistdir_it_del_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(mp_vfs_native_ilistdir_it_locals_dict, mp_vfs_native_ilistdir_it_locals_dict_table);
+
+STATIC const mp_obj_type_t mp_type_vfs_native_ilistdir_it = {
+	{ &mp_type_type },
+	.name = MP_QSTR_iterator,
+	.getiter = mp_identity_getiter,
+	.iternext = mp_vfs_native_ilistdir_it_iternext,
+	.locals_dict = (mp_obj_dict_t*)&mp_vfs_native_ilistdir_it_locals_dict,
+};
+
+// If 'info' is true, the entry size and modification time are also returned
+//--------------------------------------------------------------------------------------------------
+mp_obj_t native_vfs_ilistdir2(fs_user_mount_t *vfs, const char *path, bool is_str_type, bool info) {
+	mp_vfs_native_ilistdir_it_t *iter = m_new_obj_with_finaliser(mp_vfs_native_ilistdir_it_t);
+	iter->base.type = &mp_type_vfs_native_ilistdir_it;
 	iter->is_str = is_str_type;
+	iter->info = info;
+	iter->is_fat = false;
+	iter->is_lfs = false;
+	iter->dir = NULL;
+	iter->path = NULL;
+
+	if (info) {
+		iter->is_fat = (native_vfs_fat_device(path) >= 0);
+		#if CONFIG_MICROPY_FILESYSTEM_TYPE == 2
+		iter->is_lfs = (vfs->device == VFS_NATIVE_TYPE_SPIFLASH);
+		#endif
+		// used if the entry info can't be read with the entry
+		iter->path = m_new(char, strlen(path) + 1);
+		strcpy(iter->path, path);
+		// remove trailing '/'
+		if ((strlen(iter->path) > 1) && (iter->path[strlen(iter->path)-1] == '/')) iter->path[strlen(iter->path)-1] = 0;
+	}
 
 	DIR *d = opendir(path);
 	if (d == NULL) {
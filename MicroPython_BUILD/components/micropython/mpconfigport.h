@@ -156,6 +156,7 @@
 #define MICROPY_PY_BUILTINS_HELP_MODULES    (1)
 #define MICROPY_PY___FILE__                 (1)
 #define MICROPY_PY_MICROPYTHON_MEM_INFO     (1)
+#define MICROPY_PY_MICROPYTHON_PROFILE      (1)
 #define MICROPY_PY_ARRAY                    (1)
 #define MICROPY_PY_ARRAY_SLICE_ASSIGN       (1)
 #define MICROPY_PY_ATTRTUPLE                (1)
@@ -257,6 +258,25 @@
 #define MICROPY_INTERNALFS_ENCRIPTED        (0) // do not use encription on filesystem
 #endif
 
+// transparent read of gzip compressed files ('<name>.gz' is opened if '<name>' does not exist)
+#ifdef CONFIG_MICROPY_USE_COMPRESSED_FILES
+#define MICROPY_VFS_NATIVE_GZIP             (1)
+#else
+#define MICROPY_VFS_NATIVE_GZIP             (0)
+#endif
+
+// native VFS file buffering
+#ifdef CONFIG_MICROPY_FILE_WRITE_BUFFER
+#define MICROPY_VFS_NATIVE_WBUF_SIZE        (CONFIG_MICROPY_FILE_WRITE_BUFFER)      // default write buffer size, 0: unbuffered
+#else
+#define MICROPY_VFS_NATIVE_WBUF_SIZE        (0)
+#endif
+#ifdef CONFIG_MICROPY_FILE_READ_CACHE_PAGES
+#define MICROPY_VFS_NATIVE_RCACHE_PAGES     (CONFIG_MICROPY_FILE_READ_CACHE_PAGES)  // number of 512-byte shared read cache pages
+#else
+#define MICROPY_VFS_NATIVE_RCACHE_PAGES     (0)
+#endif
+
 // === sdcard using ESP32 sdmmc driver configuration ===
 #ifdef CONFIG_MICROPY_SDMMC_SHOW_INFO
 #define MICROPY_SDMMC_SHOW_INFO             (1) // show sdcard info after initialization
@@ -383,6 +403,7 @@ extern const struct _mp_obj_module_t mp_module_nvs;
 
 #define MICROPY_PORT_ROOT_POINTERS \
     const char *readline_hist[20]; \
+    void *dns_async_head; \
 
 // type definitions for the specific machine
 #define BYTES_PER_WORD (4)
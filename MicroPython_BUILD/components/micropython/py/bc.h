@@ -83,6 +83,10 @@ typedef struct _mp_code_state_t {
     #if MICROPY_STACKLESS
     struct _mp_code_state_t *prev;
     #endif
+    #if MICROPY_PY_MICROPYTHON_PROFILE
+    // code state of the calling bytecode function, for the profiler
+    struct _mp_code_state_t *prof_prev;
+    #endif
     // Variable-length
     mp_obj_t state[0];
     // Variable-length, never accessed by name, only as (void*)(state + n_state)
@@ -96,6 +100,17 @@ const byte *mp_decode_uint_skip(const byte *ptr);
 mp_vm_return_kind_t mp_execute_bytecode(mp_code_state_t *code_state, volatile mp_obj_t inject_exc);
 mp_code_state_t *mp_obj_fun_bc_prepare_codestate(mp_obj_t func, size_t n_args, size_t n_kw, const mp_obj_t *args);
 void mp_setup_code_state(mp_code_state_t *code_state, size_t n_args, size_t n_kw, const mp_obj_t *args);
+
+#if MICROPY_PY_MICROPYTHON_PROFILE
+// Link the code state into the thread's chain of executing bytecode functions
+// while mp_execute_bytecode() runs it; the profiler walks the chain to get the stack
+#define MP_PROF_CODE_STATE_ENTER(code_state) do { \
+        (code_state)->prof_prev = MP_STATE_THREAD(prof_code_state); \
+        MP_STATE_THREAD(prof_code_state) = (code_state); \
+    } while (0)
+#define MP_PROF_CODE_STATE_EXIT(code_state) (MP_STATE_THREAD(prof_code_state) = (code_state)->prof_prev)
+#endif
+size_t mp_bytecode_get_source_line(const mp_code_state_t *code_state, qstr *block_name, qstr *source_file);
 void mp_bytecode_print(const void *descr, const byte *code, mp_uint_t len, const mp_uint_t *const_table);
 void mp_bytecode_print2(const byte *code, size_t len, const mp_uint_t *const_table);
 const byte *mp_bytecode_print_str(const byte *ip);
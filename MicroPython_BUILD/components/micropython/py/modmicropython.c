@@ -26,12 +26,14 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "py/builtin.h"
 #include "py/stackctrl.h"
 #include "py/runtime.h"
 #include "py/gc.h"
 #include "py/mphal.h"
+#include "py/bc.h"
 
 // Various builtins specific to MicroPython runtime,
 // living in micropython module
@@ -158,6 +160,161 @@ STATIC mp_obj_t mp_micropython_schedule(mp_obj_t function, mp_obj_t arg) {
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mp_micropython_schedule_obj, mp_micropython_schedule);
 #endif
 
+#if MICROPY_PY_MICROPYTHON_PROFILE
+
+#define PROF_THREAD_NAME_LEN (12)
+
+typedef struct _mp_prof_frame_t {
+    uint16_t block_name;
+    uint16_t source_file;
+    uint16_t line;
+} mp_prof_frame_t;
+
+typedef struct _mp_prof_entry_t {
+    uint32_t hash;
+    uint32_t count;
+    uint16_t depth;
+    char thread[PROF_THREAD_NAME_LEN];
+    mp_prof_frame_t frame[MICROPY_PY_MICROPYTHON_PROFILE_DEPTH]; // innermost first
+} mp_prof_entry_t;
+
+typedef struct _mp_prof_table_t {
+    uint32_t n_samples;
+    uint32_t n_dropped;
+    uint16_t n_used;
+    bool running;
+    mp_prof_entry_t entry[MICROPY_PY_MICROPYTHON_PROFILE_ENTRIES];
+} mp_prof_table_t;
+
+// Called by the port's sampling timer, from an ISR or a high priority task.
+// It only requests a sample: the running thread takes it at its next
+// pending-exception check, so the VM costs nothing extra when not profiling.
+void mp_prof_tick(void) {
+    mp_uint_t atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    MP_STATE_VM(prof_pending) = 1;
+    if (MP_STATE_VM(sched_state) == MP_SCHED_IDLE) {
+        MP_STATE_VM(sched_state) = MP_SCHED_PENDING;
+    }
+    MICROPY_END_ATOMIC_SECTION(atomic_state);
+}
+
+// Count the stack of one thread, 'code_state' is its innermost bytecode function
+STATIC void mp_prof_count_stack(mp_prof_table_t *t, const mp_code_state_t *code_state, const char *name) {
+    mp_prof_entry_t e;
+    memset(&e, 0, sizeof(e));
+    if (name != NULL) {
+        strncpy(e.thread, name, PROF_THREAD_NAME_LEN - 1);
+    }
+    uint32_t hash = 5381;
+    for (const char *c = e.thread; *c; c++) {
+        hash = hash * 33 + *c;
+    }
+    for (const mp_code_state_t *cs = code_state;
+        cs != NULL && e.depth < MICROPY_PY_MICROPYTHON_PROFILE_DEPTH; cs = cs->prof_prev) {
+        qstr block_name, source_file;
+        size_t line = mp_bytecode_get_source_line(cs, &block_name, &source_file);
+        mp_prof_frame_t *f = &e.frame[e.depth++];
+        f->block_name = block_name;
+        f->source_file = source_file;
+        f->line = line > 0xffff ? 0xffff : line;
+        hash = (hash * 33 + block_name) * 33 + f->line;
+    }
+    e.hash = hash;
+
+    for (size_t i = 0; i < t->n_used; i++) {
+        mp_prof_entry_t *p = &t->entry[i];
+        if (p->hash == e.hash && p->depth == e.depth
+            && memcmp(p->frame, e.frame, e.depth * sizeof(mp_prof_frame_t)) == 0
+            && strcmp(p->thread, e.thread) == 0) {
+            p->count++;
+            return;
+        }
+    }
+    if (t->n_used < MICROPY_PY_MICROPYTHON_PROFILE_ENTRIES) {
+        e.count = 1;
+        t->entry[t->n_used++] = e;
+    } else {
+        t->n_dropped++;
+    }
+}
+
+#if MICROPY_PY_THREAD && MICROPY_PY_THREAD_GIL
+STATIC void mp_prof_count_thread(struct _mp_state_thread_t *state, const char *name, void *arg) {
+    mp_prof_count_stack(arg, state->prof_code_state, name);
+}
+#endif
+
+// Count the current stacks, called by the thread taking the requested sample
+void mp_prof_sample(void) {
+    mp_prof_table_t *t = MP_STATE_VM(prof_table);
+    if (t == NULL || !t->running) {
+        return;
+    }
+    t->n_samples++;
+    #if MICROPY_PY_THREAD && MICROPY_PY_THREAD_GIL
+    // The stacks of all threads: the caller holds the GIL, so the other threads
+    // wait for it or run native code, their code state chains can't change
+    mp_thread_prof_foreach(mp_prof_count_thread, t);
+    #else
+    // Without the GIL the other threads' frames may be popped, only the caller's stack
+    mp_prof_count_stack(t, MP_STATE_THREAD(prof_code_state), mp_hal_prof_thread_name());
+    #endif
+}
+
+// Print the counted stacks in the "collapsed" format used by flamegraph.pl:
+// one line per stack, outermost frame first, separated by ';', then the count
+STATIC void mp_prof_print(const mp_print_t *print, const mp_prof_table_t *t) {
+    for (size_t i = 0; i < t->n_used; i++) {
+        const mp_prof_entry_t *p = &t->entry[i];
+        mp_print_str(print, p->thread[0] ? p->thread : "thread");
+        if (p->depth == 0) {
+            mp_print_str(print, ";<native>");
+        }
+        for (int j = p->depth - 1; j >= 0; j--) {
+            const mp_prof_frame_t *f = &p->frame[j];
+            mp_printf(print, ";%q (%q:%u)", f->block_name, f->source_file, f->line);
+        }
+        mp_printf(print, " %u\n", (unsigned)p->count);
+    }
+    if (t->n_dropped) {
+        mp_printf(print, "<dropped> %u\n", (unsigned)t->n_dropped);
+    }
+}
+
+STATIC mp_obj_t mp_micropython_profile(size_t n_args, const mp_obj_t *args) {
+    mp_prof_table_t *t = MP_STATE_VM(prof_table);
+    if (n_args == 0) {
+        // dump the collected samples
+        if (t != NULL) {
+            mp_prof_print(&mp_plat_print, t);
+            return MP_OBJ_NEW_SMALL_INT(t->n_samples);
+        }
+        return MP_OBJ_NEW_SMALL_INT(0);
+    }
+    if (t != NULL && t->running) {
+        mp_hal_prof_timer_stop();
+        t->running = false;
+    }
+    if (mp_obj_is_true(args[0])) {
+        mp_int_t hz = n_args > 1 ? mp_obj_get_int(args[1]) : 100;
+        if (hz < 1 || hz > 10000) {
+            mp_raise_ValueError("invalid sampling rate");
+        }
+        if (t == NULL) {
+            t = m_new_obj(mp_prof_table_t);
+            MP_STATE_VM(prof_table) = t;
+        }
+        memset(t, 0, sizeof(*t));
+        t->running = true;
+        MP_STATE_VM(prof_pending) = 0;
+        mp_hal_prof_timer_start(1000000 / hz);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mp_micropython_profile_obj, 0, 2, mp_micropython_profile);
+
+#endif
+
 STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_micropython) },
     { MP_ROM_QSTR(MP_QSTR_const), MP_ROM_PTR(&mp_identity_obj) },
@@ -192,6 +349,9 @@ STATIC const mp_rom_map_elem_t mp_module_micropython_globals_table[] = {
     #if MICROPY_ENABLE_SCHEDULER
     { MP_ROM_QSTR(MP_QSTR_schedule), MP_ROM_PTR(&mp_micropython_schedule_obj) },
     #endif
+    #if MICROPY_PY_MICROPYTHON_PROFILE
+    { MP_ROM_QSTR(MP_QSTR_profile), MP_ROM_PTR(&mp_micropython_profile_obj) },
+    #endif
 };
 
 STATIC MP_DEFINE_CONST_DICT(mp_module_micropython_globals, mp_module_micropython_globals_table);
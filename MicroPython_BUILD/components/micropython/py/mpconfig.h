@@ -912,6 +912,20 @@ typedef double mp_float_t;
 #define MICROPY_PY_MICROPYTHON_STACK_USE (MICROPY_PY_MICROPYTHON_MEM_INFO)
 #endif
 
+// Whether to provide the "micropython.profile" sampling profiler.  Needs the
+// scheduler, and the port must provide the mp_hal_prof_* functions.
+#ifndef MICROPY_PY_MICROPYTHON_PROFILE
+#define MICROPY_PY_MICROPYTHON_PROFILE (0)
+#endif
+
+// Number of distinct stacks the profiler can count, and frames kept per stack
+#ifndef MICROPY_PY_MICROPYTHON_PROFILE_ENTRIES
+#define MICROPY_PY_MICROPYTHON_PROFILE_ENTRIES (64)
+#endif
+#ifndef MICROPY_PY_MICROPYTHON_PROFILE_DEPTH
+#define MICROPY_PY_MICROPYTHON_PROFILE_DEPTH (8)
+#endif
+
 // Whether to provide "array" module. Note that large chunk of the
 // underlying code is shared with "bytearray" builtin type, so to
 // get real savings, it should be disabled too.
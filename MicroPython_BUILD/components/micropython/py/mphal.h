@@ -71,6 +71,13 @@ uint64_t mp_hal_ticks_us(void);
 uint32_t mp_hal_ticks_cpu(void);
 #endif
 
+#if MICROPY_PY_MICROPYTHON_PROFILE
+// periodic timer calling mp_prof_tick(), and name of the current thread
+void mp_hal_prof_timer_start(uint32_t period_us);
+void mp_hal_prof_timer_stop(void);
+const char *mp_hal_prof_thread_name(void);
+#endif
+
 // If port HAL didn't define its own pin API, use generic
 // "virtual pin" API from the core.
 #ifndef mp_hal_pin_obj_t
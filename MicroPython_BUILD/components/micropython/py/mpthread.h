@@ -47,6 +47,9 @@ void mp_thread_finish(void);
 void mp_thread_mutex_init(mp_thread_mutex_t *mutex);
 int mp_thread_mutex_lock(mp_thread_mutex_t *mutex, int wait);
 void mp_thread_mutex_unlock(mp_thread_mutex_t *mutex);
+#if MICROPY_PY_MICROPYTHON_PROFILE
+void mp_thread_prof_foreach(void (*cb)(struct _mp_state_thread_t *state, const char *name, void *arg), void *arg);
+#endif
 
 #endif // MICROPY_PY_THREAD
 
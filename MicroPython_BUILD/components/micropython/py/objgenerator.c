@@ -119,7 +119,13 @@ mp_vm_return_kind_t mp_obj_gen_resume(mp_obj_t self_in, mp_obj_t send_value, mp_
     }
     mp_obj_dict_t *old_globals = mp_globals_get();
     mp_globals_set(self->globals);
+    #if MICROPY_PY_MICROPYTHON_PROFILE
+    MP_PROF_CODE_STATE_ENTER(&self->code_state);
+    #endif
     mp_vm_return_kind_t ret_kind = mp_execute_bytecode(&self->code_state, throw_value);
+    #if MICROPY_PY_MICROPYTHON_PROFILE
+    MP_PROF_CODE_STATE_EXIT(&self->code_state);
+    #endif
     mp_globals_set(old_globals);
 
     switch (ret_kind) {
@@ -197,6 +197,7 @@ PY_O_BASENAME = \
 	../lib/embed/abort_.o \
 	../extmod/vfs_native.o \
 	../extmod/vfs_native_file.o \
+	../extmod/vfs_native_gz.o \
 	../extmod/vfs_native_misc.o
 
 # prepend the build destination prefix to the py object files
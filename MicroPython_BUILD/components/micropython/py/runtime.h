@@ -117,6 +117,11 @@ mp_sched_carg_t *make_carg_entry_carg(mp_sched_carg_t *carg, int idx, mp_sched_c
 
 #endif
 
+#if MICROPY_PY_MICROPYTHON_PROFILE
+void mp_prof_tick(void);
+void mp_prof_sample(void);
+#endif
+
 // extra printing method specifically for mp_obj_t's which are integral type
 int mp_print_mp_int(const mp_print_t *print, mp_obj_t x, int base, int base_char, int flags, char fill, int width, int prec);
 
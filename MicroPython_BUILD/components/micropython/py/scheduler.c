@@ -282,6 +282,14 @@ static mp_obj_t make_arg_from_carg(mp_sched_carg_t *carg, int level, int *n_cbit
 //---------------------------------------------------
 void mp_handle_pending_tail(mp_uint_t atomic_state) {
     MP_STATE_VM(sched_state) = MP_SCHED_LOCKED;
+    #if MICROPY_PY_MICROPYTHON_PROFILE
+    if (MP_STATE_VM(prof_pending)) {
+        MP_STATE_VM(prof_pending) = 0;
+        MICROPY_END_ATOMIC_SECTION(atomic_state);
+        mp_prof_sample();
+        atomic_state = MICROPY_BEGIN_ATOMIC_SECTION();
+    }
+    #endif
     if (MP_STATE_VM(sched_sp) > 0) {
     	int n_cbitems = 0;
         // get the first scheduled item from stack
@@ -0,0 +1,313 @@
+/*
+ * Host test of the curl multi transfer engine (esp32/libs/espcurl.c, used by curl.Multi)
+ *
+ * espcurl.c is built unchanged against the host libcurl, the multi task runs as a
+ * thread (host/host_stubs.c). The transfers go to the HTTP and FTP stand-ins
+ * (http_bench_server.py, ftp_bench_server.py) on the loopback.
+ * Tested are:
+ *   the done callback sees the final result while the transfer is still owned by
+ *   the multi task (curl.Multi keeps the Transfer object until it is released),
+ *   the connection reuse of concurrent GETs to the same host,
+ *   the body received to the caller's buffer, to a file, and a too small buffer,
+ *   FTP get, list and put,
+ *   a finished transfer can't be added again,
+ *   stop with transfers in flight, one of them released while queued,
+ *   stop without waiting, the multi task frees the handle.
+ *
+ *   gcc -O2 -DNO_QSTR -DCONFIG_MICROPY_USE_CURL=1 -DCONFIG_MICROPY_USE_CURLFTP=1 -DCONFIG_MICROPY_TASK_PRIORITY=5 \
+ *       -DCONFIG_MICROPY_USE_BOTH_CORES=1 -Ihost -I.. -I../esp32 -I../../curl/include \
+ *       -o curl_multi_test curl_multi_test.c host/host_stubs.c -l:libcurl.so.4 -lpthread
+ *   ./curl_multi_test [-v]
+ * (run in this directory, the stand-ins use the TCP ports 8090 and 2121)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "libs/espcurl.c"
+
+#define HTTP_PORT   8090
+#define FTP_PORT    2121
+#define FTP_DIR     "/tmp/curl_multi_test"
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL line %d: %s\n", __LINE__, #cond); errors++; } } while (0)
+
+static int errors = 0;
+static int verbose = 0;
+static pid_t standins[2];
+static volatile int n_callbacks = 0;
+static volatile int n_bad_callbacks = 0;
+
+// ==== Firmware functions used by espcurl.c ====
+
+void native_vfs_file_changed() { }
+void mp_hal_set_wdt_tmo() { }
+void mp_hal_reset_wdt() { }
+
+uint64_t mp_hal_ticks_ms(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (t.tv_sec * 1000) + (t.tv_nsec / 1000000);
+}
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// ==== Stand-ins ====
+
+static pid_t start_standin(const char *script, int port, const char *root)
+{
+    char port_s[16];
+    snprintf(port_s, sizeof(port_s), "%d", port);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!verbose) {
+            freopen("/dev/null", "w", stdout);
+            freopen("/dev/null", "w", stderr);
+        }
+        if (root) execlp("python3", "python3", script, "--port", port_s, "--root", root, NULL);
+        else execlp("python3", "python3", script, "--port", port_s, NULL);
+        perror("python3");
+        _exit(1);
+    }
+    return pid;
+}
+
+static void stop_standins(void)
+{
+    for (int i = 0; i < 2; i++) {
+        if (standins[i] > 0) {
+            kill(standins[i], SIGTERM);
+            waitpid(standins[i], NULL, 0);
+            standins[i] = 0;
+        }
+    }
+}
+
+static void wait_standin(int port)
+{
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    for (int i = 0; i < 100; i++) {
+        int s = socket(AF_INET, SOCK_STREAM, 0);
+        int res = connect(s, (struct sockaddr *)&addr, sizeof(addr));
+        close(s);
+        if (res == 0) return;
+        usleep(50000);
+    }
+    printf("stand-in on port %d not started\n", port);
+    stop_standins();
+    exit(1);
+}
+
+// ==== Tests ====
+
+// Called from the multi task: the result must be final, the transfer still owned by the task
+static void done_cb(curl_xfer_t *x)
+{
+    if ((!x->ready) || (!x->queued)) __sync_fetch_and_add(&n_bad_callbacks, 1);
+    __sync_fetch_and_add(&n_callbacks, 1);
+}
+
+static void wait_all(curl_multi_t *m)
+{
+    double t = now();
+    while ((m->pending) && ((now() - t) < 20)) usleep(1000);
+    CHECK(m->pending == 0);
+}
+
+static curl_xfer_t *xfer_new(uint8_t type, const char *url, const char *user_pass, const char *fname, char *buf, int buf_size, int hdr_size)
+{
+    int err = 0;
+    curl_xfer_t *x = Curl_xfer_new(type, (char *)url, (char *)user_pass, (char *)fname, buf, buf_size, hdr_size, &err);
+    if (x == NULL) {
+        printf("  Curl_xfer_new error %d (%s)\n", err, url);
+        stop_standins();
+        exit(1);
+    }
+    x->done_cb = done_cb;
+    return x;
+}
+
+static void test_get(curl_multi_t *m)
+{
+    char url[64];
+    curl_xfer_t *x[20];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/api", HTTP_PORT);
+
+    printf("20 GETs, 4 connections\n");
+    n_callbacks = 0;
+    uint32_t transfers = m->n_transfers, connects = m->n_connects;
+    double t = now();
+    for (int i = 0; i < 20; i++) {
+        x[i] = xfer_new(CURL_XFER_GET, url, NULL, NULL, NULL, 1024, 512);
+        CHECK(Curl_multi_add(m, x[i]) == 0);
+    }
+    wait_all(m);
+    t = now() - t;
+    int ok = 0;
+    for (int i = 0; i < 20; i++) {
+        if ((x[i]->ready) && (!x[i]->queued) && (x[i]->result == CURLE_OK) && (x[i]->status == 200) && (x[i]->len > 10)) ok++;
+    }
+    CHECK(ok == 20);
+    CHECK(n_callbacks == 20);
+    CHECK(n_bad_callbacks == 0);
+    CHECK(strncmp(x[0]->hdr, "HTTP/1.1 200", 12) == 0);
+    // a finished transfer can't be added again
+    CHECK(Curl_multi_add(m, x[0]) != 0);
+    transfers = m->n_transfers - transfers;
+    connects = m->n_connects - connects;
+    CHECK(transfers == 20);
+    CHECK(connects <= 4);
+    printf("  %.1f ms, %u transfers on %u connections\n", t * 1000, transfers, connects);
+    for (int i = 0; i < 20; i++) Curl_xfer_free(x[i]);
+}
+
+static void test_body(curl_multi_t *m)
+{
+    char url[64], fname[64];
+    printf("body to buffer, to file, too small buffer\n");
+    char *big = malloc(1000000);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/big?n=250000", HTTP_PORT);
+    curl_xfer_t *a = xfer_new(CURL_XFER_GET, url, NULL, NULL, big, 1000000, 512);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/big?n=300000", HTTP_PORT);
+    snprintf(fname, sizeof(fname), "%s/big.bin", FTP_DIR);
+    curl_xfer_t *b = xfer_new(CURL_XFER_GET, url, NULL, fname, NULL, 0, 512);
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/big?n=3000", HTTP_PORT);
+    curl_xfer_t *c = xfer_new(CURL_XFER_GET, url, NULL, NULL, NULL, 1000, 0);
+    CHECK(Curl_multi_add(m, a) == 0);
+    CHECK(Curl_multi_add(m, b) == 0);
+    CHECK(Curl_multi_add(m, c) == 0);
+    wait_all(m);
+
+    int good = 1;
+    for (int i = 0; i < 250000; i++) {
+        if ((unsigned char)big[i] != (i & 0xff)) {
+            good = 0;
+            break;
+        }
+    }
+    struct stat st;
+    CHECK((a->result == CURLE_OK) && (a->len == 250000) && (good));
+    CHECK((b->result == CURLE_OK) && (b->len == 300000));
+    CHECK((stat(fname, &st) == 0) && (st.st_size == 300000));
+    CHECK(c->result == CURLE_WRITE_ERROR);
+    Curl_xfer_free(a);
+    Curl_xfer_free(b);
+    Curl_xfer_free(c);
+    free(big);
+}
+
+static void test_ftp(curl_multi_t *m)
+{
+    char url[64], fname[64], src[64];
+    printf("FTP get, list, put\n");
+    snprintf(src, sizeof(src), "%s/big.bin", FTP_DIR);
+    snprintf(url, sizeof(url), "ftp://127.0.0.1:%d/big.bin", FTP_PORT);
+    snprintf(fname, sizeof(fname), "%s/ftp_get.bin", FTP_DIR);
+    curl_xfer_t *f1 = xfer_new(CURL_XFER_FTP_GET, url, "user:pass", fname, NULL, 0, 512);
+    curl_xfer_t *f4 = xfer_new(CURL_XFER_FTP_GET, url, "user:pass", NULL, NULL, 400000, 0);
+    snprintf(url, sizeof(url), "ftp://127.0.0.1:%d/", FTP_PORT);
+    curl_xfer_t *f2 = xfer_new(CURL_XFER_FTP_LIST, url, "user:pass", NULL, NULL, 4096, 512);
+    snprintf(url, sizeof(url), "ftp://127.0.0.1:%d/sub/put.bin", FTP_PORT);
+    curl_xfer_t *f3 = xfer_new(CURL_XFER_FTP_PUT, url, "user:pass", src, NULL, 0, 512);
+    CHECK(Curl_multi_add(m, f1) == 0);
+    CHECK(Curl_multi_add(m, f2) == 0);
+    CHECK(Curl_multi_add(m, f3) == 0);
+    CHECK(Curl_multi_add(m, f4) == 0);
+    wait_all(m);
+
+    struct stat st;
+    CHECK((f1->result == CURLE_OK) && (f1->len == 300000));
+    CHECK((stat(fname, &st) == 0) && (st.st_size == 300000));
+    CHECK((f2->result == CURLE_OK) && (f2->len > 0) && (memmem(f2->buf, f2->len, "big.bin", 7) != NULL));
+    CHECK((f3->result == CURLE_OK) && (f3->len == 300000));
+    snprintf(fname, sizeof(fname), "%s/sub/put.bin", FTP_DIR);
+    CHECK((stat(fname, &st) == 0) && (st.st_size == 300000));
+    CHECK((f4->result == CURLE_OK) && (f4->len == 300000));
+    Curl_xfer_free(f1);
+    Curl_xfer_free(f2);
+    Curl_xfer_free(f3);
+    Curl_xfer_free(f4);
+}
+
+static void test_stop(curl_multi_t *m)
+{
+    char url[64];
+    printf("stop with transfers in flight\n");
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/big?n=2500000", HTTP_PORT);
+    curl_xfer_t *s1 = xfer_new(CURL_XFER_GET, url, NULL, NULL, NULL, 3000000, 0);
+    curl_xfer_t *s2 = xfer_new(CURL_XFER_GET, url, NULL, NULL, NULL, 3000000, 0);
+    CHECK(Curl_multi_add(m, s1) == 0);
+    CHECK(Curl_multi_add(m, s2) == 0);
+    usleep(20000);
+    // released while queued, freed by the multi task
+    Curl_xfer_free(s2);
+    Curl_multi_stop(m, true);
+    CHECK((s1->ready) && (!s1->queued));
+    Curl_xfer_free(s1);
+}
+
+static void test_detached(void)
+{
+    char url[64];
+    printf("stop without waiting\n");
+    curl_multi_t *m = Curl_multi_new(2, 2);
+    CHECK(m != NULL);
+    if (m == NULL) return;
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/big?n=2500000", HTTP_PORT);
+    curl_xfer_t *s = xfer_new(CURL_XFER_GET, url, NULL, NULL, NULL, 3000000, 0);
+    CHECK(Curl_multi_add(m, s) == 0);
+    usleep(20000);
+    Curl_xfer_free(s);
+    Curl_multi_stop(m, false);
+    // the task exits within CURL_MULTI_IDLE_MS and frees the handle and the transfer
+    usleep((CURL_MULTI_IDLE_MS + 200) * 1000);
+}
+
+int main(int argc, char *argv[])
+{
+    if ((argc > 1) && (strcmp(argv[1], "-v") == 0)) verbose = 1;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    if (!verbose) freopen("/dev/null", "w", stderr);
+
+    mkdir(FTP_DIR, 0755);
+    char path[64];
+    snprintf(path, sizeof(path), "%s/sub", FTP_DIR);
+    mkdir(path, 0755);
+
+    standins[0] = start_standin("http_bench_server.py", HTTP_PORT, NULL);
+    standins[1] = start_standin("ftp_bench_server.py", FTP_PORT, FTP_DIR);
+    wait_standin(HTTP_PORT);
+    wait_standin(FTP_PORT);
+
+    curl_multi_t *m = Curl_multi_new(4, 4);
+    CHECK(m != NULL);
+    if (m) {
+        test_get(m);
+        test_body(m);
+        test_ftp(m);
+        test_stop(m);
+    }
+    test_detached();
+    Curl_cleanup();
+
+    stop_standins();
+    if (system("rm -rf " FTP_DIR) != 0) printf("can't remove %s\n", FTP_DIR);
+    printf("%s\n", (errors) ? "FAILED" : "all tests passed");
+    return (errors) ? 1 : 0;
+}
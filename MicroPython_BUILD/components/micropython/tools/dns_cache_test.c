@@ -0,0 +1,314 @@
+/*
+ * Host test of the DNS resolver cache (components/dnscache/dns_cache.c) used by
+ * usocket, curl, requests and the MQTT transport.
+ *
+ * Two DNS stand-ins (dns_standin.py) are started on the loopback, one answering
+ * immediately, the other one with a delay. Checked are the cache hits and the TTL
+ * expiry (also shortened to DNS_CACHE_MAX_TTL), the CNAME chain, the negative
+ * caching, the server failures and the failover, the coalescing of the concurrent
+ * lookups, more concurrent lookups than the query sockets, the async lookup with
+ * cancel, the timeouts, the lwip getaddrinfo/gethostbyname wrappers, and that the
+ * forged answers (wrong query id, A record of another name) are not accepted.
+ *
+ *   gcc -O2 -Ihost -I../../dnscache/include -DCONFIG_MICROPY_USE_DNS_CACHE -DCONFIG_MICROPY_USE_BOTH_CORES \
+ *       -DCONFIG_MICROPY_DNS_CACHE_MAX_TTL=2 -o dns_cache_test dns_cache_test.c ../../dnscache/dns_cache.c \
+ *       host/host_stubs.c -lpthread
+ *   ./dns_cache_test [-v]
+ * (run in this directory, the stand-ins use the UDP ports 5353 and 5354)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/wait.h>
+
+#include "freertos/FreeRTOS.h"
+#include "lwip/sockets.h"
+#include "lwip/dns.h"
+#include "dns_cache.h"
+
+#define FAST_PORT   5353
+#define SLOW_PORT   5354
+#define DEAD_PORT   5399
+
+int __wrap_lwip_getaddrinfo(const char *nodename, const char *servname, const struct addrinfo *hints, struct addrinfo **res);
+struct hostent *__wrap_lwip_gethostbyname(const char *name);
+
+// lwip's resolver, used for the names not handled by the cache
+int __real_lwip_getaddrinfo(const char *nodename, const char *servname, const struct addrinfo *hints, struct addrinfo **res)
+{
+    return getaddrinfo(nodename, servname, hints, res);
+}
+
+struct hostent *__real_lwip_gethostbyname(const char *name)
+{
+    return gethostbyname(name);
+}
+
+static int errors = 0;
+static int verbose = 0;
+static pid_t standins[2];
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL line %d: %s\n", __LINE__, #cond); errors++; } } while (0)
+
+static double now_ms(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1e6;
+}
+
+static pid_t start_standin(char *const argv[])
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!verbose) {
+            freopen("/dev/null", "w", stdout);
+        }
+        execvp(argv[0], argv);
+        perror("python3");
+        _exit(1);
+    }
+    return pid;
+}
+
+static void stop_standins(void)
+{
+    for (int i = 0; i < 2; i++) {
+        if (standins[i] > 0) {
+            kill(standins[i], SIGTERM);
+            waitpid(standins[i], NULL, 0);
+            standins[i] = 0;
+        }
+    }
+}
+
+static void set_server(int index, int port)
+{
+    struct sockaddr_in server;
+    memset(&server, 0, sizeof(server));
+    server.sin_family = AF_INET;
+    server.sin_port = htons(port);
+    server.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    dns_cache_set_server(index, (port) ? &server : NULL);
+}
+
+static unsigned queries(void)
+{
+    dns_cache_stats_t stats;
+    dns_cache_get_stats(&stats);
+    return stats.queries;
+}
+
+// Blocking lookup, the address is returned as a string
+static int resolve(const char *host, char *ip)
+{
+    struct in_addr addr = { 0 };
+    double t = now_ms();
+    int status = dns_cache_resolve(host, &addr, 3000);
+    strcpy(ip, (status == DNS_CACHE_OK) ? inet_ntoa(addr) : "-");
+    if (verbose) {
+        printf("  %-16s status %2d %-12s %7.1f ms\n", host, status, ip, now_ms() - t);
+    }
+    return status;
+}
+
+static void *slow_lookup(void *arg)
+{
+    char ip[20];
+    *(int *)arg = resolve("slow.test", ip);
+    return NULL;
+}
+
+typedef struct {
+    char name[16];
+    int status;
+    struct in_addr addr;
+} parallel_t;
+
+static void *parallel_lookup(void *arg)
+{
+    parallel_t *p = arg;
+    p->status = dns_cache_resolve(p->name, &p->addr, 10000);
+    return NULL;
+}
+
+static volatile int async_count = 0;
+static volatile int async_status = 99;
+
+static void async_cb(int status, const struct in_addr *addr, void *arg)
+{
+    async_status = status;
+    async_count++;
+}
+
+int main(int argc, char *argv[])
+{
+    char ip[20];
+    unsigned q;
+    int status;
+    double t;
+
+    verbose = (argc > 1) && (strcmp(argv[1], "-v") == 0);
+
+    char *fast[] = { "python3", "dns_standin.py", "--bind", "127.0.0.1", "--port", "5353", "--neg-ttl", "3",
+        "--record", "a.test=10.0.0.1:2", "--cname", "www.test=a.test:60", "--record", "a2.test=10.0.0.2",
+        "--record", "b.test=10.0.0.3", "--record", "zero.test=10.0.0.9:0",
+        "--record", "long.test=10.0.0.7:100000", "--servfail", "fail.test",
+        "--foreign", "evil.test=6.6.6.6", "--record", "bad.test=10.0.0.8", "--bad-id", "bad.test",
+        "--cname", "dangling.test=other.test", NULL };
+    char *slow[] = { "python3", "dns_standin.py", "--bind", "127.0.0.1", "--port", "5354", "--delay", "500",
+        "--record", "slow.test=10.0.0.5", "--record", "cancel.test=10.0.0.6",
+        "--record", "p0.test=10.1.0.0", "--record", "p1.test=10.1.0.1",
+        "--record", "p2.test=10.1.0.2", "--record", "p3.test=10.1.0.3", "--record", "p4.test=10.1.0.4",
+        "--record", "p5.test=10.1.0.5", NULL };
+    standins[0] = start_standin(fast);
+    standins[1] = start_standin(slow);
+    atexit(stop_standins);
+    usleep(800000);
+
+    printf("Names not looked up\n");
+    set_server(0, FAST_PORT);
+    CHECK((resolve("1.2.3.4", ip) == DNS_CACHE_OK) && (strcmp(ip, "1.2.3.4") == 0));
+    CHECK((resolve("localhost", ip) == DNS_CACHE_OK) && (strcmp(ip, "127.0.0.1") == 0));
+    CHECK(resolve("printer.local", ip) == DNS_CACHE_ERROR);
+    CHECK(resolve("a..test", ip) == DNS_CACHE_ERROR);
+
+    printf("Cache hits and TTL\n");
+    CHECK((resolve("a.test", ip) == DNS_CACHE_OK) && (strcmp(ip, "10.0.0.1") == 0));
+    q = queries();
+    CHECK((resolve("A.Test.", ip) == DNS_CACHE_OK) && (strcmp(ip, "10.0.0.1") == 0));
+    CHECK(queries() == q);
+    usleep(2200000);
+    CHECK(resolve("a.test", ip) == DNS_CACHE_OK);
+    CHECK(queries() == q + 1);
+    CHECK((resolve("www.test", ip) == DNS_CACHE_OK) && (strcmp(ip, "10.0.0.1") == 0));
+    q = queries();
+    CHECK((resolve("www.test", ip) == DNS_CACHE_OK) && (queries() == q));
+    CHECK(resolve("zero.test", ip) == DNS_CACHE_OK);
+    q = queries();
+    CHECK((resolve("zero.test", ip) == DNS_CACHE_OK) && (queries() == q + 1));
+
+    printf("TTL shortened to DNS_CACHE_MAX_TTL (%d s)\n", DNS_CACHE_MAX_TTL);
+    CHECK(resolve("long.test", ip) == DNS_CACHE_OK);
+    q = queries();
+    usleep(DNS_CACHE_MAX_TTL * 1000000 + 200000);
+    CHECK((resolve("long.test", ip) == DNS_CACHE_OK) && (queries() == q + 1));
+
+    printf("Negative caching\n");
+    CHECK(resolve("nx.test", ip) == DNS_CACHE_NOT_FOUND);
+    q = queries();
+    CHECK((resolve("nx.test", ip) == DNS_CACHE_NOT_FOUND) && (queries() == q));
+    usleep(3200000);
+    CHECK((resolve("nx.test", ip) == DNS_CACHE_NOT_FOUND) && (queries() == q + 1));
+    CHECK(resolve("dangling.test", ip) == DNS_CACHE_NOT_FOUND);
+    CHECK(resolve("fail.test", ip) == DNS_CACHE_FAIL);
+
+    printf("Forged answers\n");
+    CHECK((resolve("bad.test", ip) == DNS_CACHE_OK) && (strcmp(ip, "10.0.0.8") == 0));
+    CHECK(resolve("evil.test", ip) == DNS_CACHE_NOT_FOUND);
+
+    printf("Concurrent lookups of the same name\n");
+    set_server(0, SLOW_PORT);
+    q = queries();
+    pthread_t threads[6];
+    int results[6];
+    for (int i = 0; i < 5; i++) {
+        pthread_create(&threads[i], NULL, slow_lookup, &results[i]);
+    }
+    for (int i = 0; i < 5; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK(results[i] == DNS_CACHE_OK);
+    }
+    CHECK(queries() - q == 1);
+
+    printf("More concurrent names than the query sockets\n");
+    parallel_t par[6];
+    t = now_ms();
+    for (int i = 0; i < 6; i++) {
+        sprintf(par[i].name, "p%d.test", i);
+        pthread_create(&threads[i], NULL, parallel_lookup, &par[i]);
+    }
+    for (int i = 0; i < 6; i++) {
+        pthread_join(threads[i], NULL);
+        CHECK((par[i].status == DNS_CACHE_OK) && ((int)(ntohl(par[i].addr.s_addr) & 0xff) == i));
+    }
+    if (verbose) {
+        printf("  6 names in %.0f ms\n", now_ms() - t);
+    }
+
+    printf("Async lookup and cancel\n");
+    dns_cache_waiter_t waiter;
+    struct in_addr addr;
+    set_server(0, FAST_PORT);
+    CHECK(dns_cache_resolve_async("b.test", &addr, &waiter, async_cb, NULL) == DNS_CACHE_PENDING);
+    for (int i = 0; (i < 300) && (async_count == 0); i++) {
+        usleep(10000);
+    }
+    CHECK((async_count == 1) && (async_status == DNS_CACHE_OK));
+    CHECK((dns_cache_resolve_async("b.test", &addr, &waiter, async_cb, NULL) == DNS_CACHE_OK) && (async_count == 1));
+    // the slow server answers after the lookup is cancelled, the answer is still cached
+    set_server(0, SLOW_PORT);
+    CHECK(dns_cache_resolve_async("cancel.test", &addr, &waiter, async_cb, NULL) == DNS_CACHE_PENDING);
+    dns_cache_cancel(&waiter);
+    usleep(800000);
+    CHECK(async_count == 1);
+    q = queries();
+    CHECK((resolve("cancel.test", ip) == DNS_CACHE_OK) && (strcmp(ip, "10.0.0.6") == 0) && (queries() == q));
+
+    printf("Timeouts and failover\n");
+    set_server(0, DEAD_PORT);
+    t = now_ms();
+    CHECK(dns_cache_resolve("dead.test", &addr, 500) == DNS_CACHE_TIMEOUT);
+    CHECK(now_ms() - t < 1000);
+    set_server(1, FAST_PORT);
+    CHECK((resolve("a2.test", ip) == DNS_CACHE_OK) && (strcmp(ip, "10.0.0.2") == 0));
+    dns_cache_flush();
+    set_server(0, FAST_PORT);
+    q = queries();
+    CHECK((resolve("a2.test", ip) == DNS_CACHE_OK) && (queries() == q + 1));
+    set_server(0, DEAD_PORT);
+    set_server(1, 0);
+    t = now_ms();
+    status = dns_cache_resolve("dead2.test", &addr, 20000);
+    CHECK(status == DNS_CACHE_TIMEOUT);
+    if (verbose) {
+        printf("  all tries: %.0f ms\n", now_ms() - t);
+    }
+
+    printf("lwip wrappers\n");
+    set_server(0, FAST_PORT);
+    struct addrinfo hints;
+    struct addrinfo *res = NULL;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    CHECK(__wrap_lwip_getaddrinfo("a2.test", "8080", &hints, &res) == 0);
+    if (res) {
+        struct sockaddr_in *sa = (struct sockaddr_in *)res->ai_addr;
+        CHECK((sa->sin_addr.s_addr == inet_addr("10.0.0.2")) && (ntohs(sa->sin_port) == 8080));
+        freeaddrinfo(res);
+    }
+    res = NULL;
+    CHECK((__wrap_lwip_getaddrinfo("nx2.test", "80", &hints, &res) == EAI_NONAME) && (res == NULL));
+    struct hostent *he = __wrap_lwip_gethostbyname("www.test");
+    CHECK((he) && (((struct in_addr *)he->h_addr_list[0])->s_addr == inet_addr("10.0.0.1")) && (he->h_addr_list[1] == NULL));
+    CHECK(__wrap_lwip_gethostbyname("nx2.test") == NULL);
+
+    printf("No DNS server\n");
+    set_server(0, 0);
+    dns_cache_flush();
+    CHECK(resolve("none.test", ip) == DNS_CACHE_ERROR);
+
+    dns_cache_stats_t stats;
+    dns_cache_get_stats(&stats);
+    printf("%u queries, %u hits, %u negative hits, %u misses, %u timeouts, %u failures\n",
+        stats.queries, stats.hits, stats.negative_hits, stats.misses, stats.timeouts, stats.failures);
+    printf("%s: %d errors\n", (errors) ? "FAILED" : "OK", errors);
+    return (errors) ? 1 : 0;
+}
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+#
+# Local DNS server for testing the ESP32 resolver cache (components/dnscache/dns_cache.c,
+# usocket.getaddrinfo, usocket.getaddrinfo_async and network.dns_*)
+#
+# Answers A queries from the given records; the other names get NXDOMAIN with
+# an SOA record in the authority section, so the negative answers can be cached.
+# The answers can be delayed, the first queries dropped or answered with SERVFAIL
+# to test the retransmissions, the timeouts and the server failover.
+# Forged answers (A record of another name, wrong query id) test that the
+# resolver only accepts the answer to its own question.
+#
+#   python3 dns_standin.py --record api.example.com=192.168.0.10 --ttl 30
+#   python3 dns_standin.py --record a.test=10.0.0.1:5 --cname www.test=a.test:60 --delay 800
+#   python3 dns_standin.py --port 5353 --drop 1 --servfail fail.test
+#   python3 dns_standin.py --record a.test=10.0.0.1 --foreign evil.test=6.6.6.6 --bad-id a.test
+#
+# Use it from the ESP32 with
+#   network.dns_server('192.168.0.2')
+# Every query is logged, the totals are printed on Ctrl-C.
+
+import argparse
+import socket
+import struct
+import threading
+import time
+
+TYPE_A = 1
+TYPE_CNAME = 5
+TYPE_SOA = 6
+CLASS_IN = 1
+
+
+def encode_name(name):
+    out = b''
+    for label in name.rstrip('.').split('.'):
+        out += bytes([len(label)]) + label.encode()
+    return out + b'\0'
+
+
+def decode_question(msg):
+    pos = 12
+    labels = []
+    while msg[pos] != 0:
+        n = msg[pos]
+        labels.append(msg[pos + 1:pos + 1 + n].decode(errors='replace'))
+        pos += n + 1
+    qtype, qclass = struct.unpack('>HH', msg[pos + 1:pos + 5])
+    return '.'.join(labels), qtype, qclass, pos + 5
+
+
+def rr(name, rtype, ttl, rdata):
+    return encode_name(name) + struct.pack('>HHIH', rtype, CLASS_IN, ttl, len(rdata)) + rdata
+
+
+class StandIn:
+    def __init__(self, args):
+        self.args = args
+        self.records = {}
+        self.cnames = {}
+        for rec in args.record:
+            name, value = rec.split('=')
+            ip, _, ttl = value.partition(':')
+            self.records[name.lower()] = (ip, int(ttl) if ttl else args.ttl)
+        for rec in args.cname:
+            name, value = rec.split('=')
+            target, _, ttl = value.partition(':')
+            self.cnames[name.lower()] = (target.lower(), int(ttl) if ttl else args.ttl)
+        self.servfail = set(n.lower() for n in args.servfail)
+        self.foreign = {}
+        for rec in args.foreign:
+            name, ip = rec.split('=')
+            self.foreign[name.lower()] = ip
+        self.bad_id = set(n.lower() for n in args.bad_id)
+        self.queries = 0
+        self.dropped = 0
+        self.lock = threading.Lock()
+
+    def answer(self, msg):
+        qname, qtype, qclass, qend = decode_question(msg)
+        flags = 0x8000 | 0x0400 | 0x0080 | (msg[2] & 0x01) << 8    # QR, AA, RA, RD copied
+        answers = []
+        authority = []
+        name = qname.lower()
+        rcode = 0
+        if name in self.servfail:
+            rcode = 2
+        elif name in self.foreign:
+            # only an A record of an unrelated name
+            answers.append(rr('victim.other', TYPE_A, 86400, socket.inet_aton(self.foreign[name])))
+        else:
+            # follow the CNAME chain
+            for _ in range(8):
+                if name not in self.cnames:
+                    break
+                target, ttl = self.cnames[name]
+                answers.append(rr(name, TYPE_CNAME, ttl, encode_name(target)))
+                name = target
+            if name in self.records and qtype == TYPE_A:
+                ip, ttl = self.records[name]
+                answers.append(rr(name, TYPE_A, ttl, socket.inet_aton(ip)))
+            else:
+                if name not in self.records:
+                    rcode = 3
+                soa = encode_name('ns.test') + encode_name('admin.test') + \
+                    struct.pack('>IIIII', 1, 3600, 600, 86400, self.args.neg_ttl)
+                authority.append(rr('test', TYPE_SOA, 3600, soa))
+        hdr = msg[:2] + struct.pack('>HHHHH', flags | rcode, 1, len(answers), len(authority), 0)
+        return qname, rcode, hdr + msg[12:qend] + b''.join(answers) + b''.join(authority)
+
+    def forged(self, data):
+        # the same answer with another query id and address
+        bad = bytearray(data)
+        bad[0] ^= 0x5a
+        if bad[7] and len(bad) >= 4:
+            bad[-4:] = socket.inet_aton('6.6.6.6')
+        return bytes(bad)
+
+    def reply(self, sock, data, addr, qname, rcode):
+        if self.args.delay:
+            time.sleep(self.args.delay / 1000)
+        if qname.lower() in self.bad_id:
+            sock.sendto(self.forged(data), addr)
+        sock.sendto(data, addr)
+        print('{:8.3f} {}:{} {} -> {}'.format(time.monotonic() % 1000, addr[0], addr[1], qname,
+                                           {0: 'ok', 2: 'SERVFAIL', 3: 'NXDOMAIN'}.get(rcode, rcode)))
+
+    def serve(self):
+        sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        sock.bind((self.args.bind, self.args.port))
+        print('DNS stand-in on {}:{}, {} records'.format(self.args.bind, self.args.port,
+                                                         len(self.records) + len(self.cnames)))
+        while True:
+            msg, addr = sock.recvfrom(512)
+            if len(msg) < 17 or msg[2] & 0x80:
+                continue
+            with self.lock:
+                self.queries += 1
+                drop = self.dropped < self.args.drop
+                if drop:
+                    self.dropped += 1
+            try:
+                qname, rcode, data = self.answer(msg)
+            except (IndexError, struct.error):
+                continue
+            if drop:
+                print('{:8.3f} {} {} dropped'.format(time.monotonic() % 1000, addr[0], qname))
+                continue
+            if self.args.delay:
+                threading.Thread(target=self.reply, args=(sock, data, addr, qname, rcode), daemon=True).start()
+            else:
+                self.reply(sock, data, addr, qname, rcode)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='DNS stand-in for the ESP32 resolver cache tests')
+    parser.add_argument('--bind', default='0.0.0.0')
+    parser.add_argument('--port', type=int, default=53)
+    parser.add_argument('--record', action='append', default=[], metavar='NAME=IP[:TTL]')
+    parser.add_argument('--cname', action='append', default=[], metavar='NAME=TARGET[:TTL]')
+    parser.add_argument('--servfail', action='append', default=[], metavar='NAME')
+    parser.add_argument('--foreign', action='append', default=[], metavar='NAME=IP',
+                        help='answer NAME with the A record of another name')
+    parser.add_argument('--bad-id', action='append', default=[], metavar='NAME',
+                        help='send a forged answer with a wrong id before the real one')
+    parser.add_argument('--ttl', type=int, default=60, help='default record TTL')
+    parser.add_argument('--neg-ttl', type=int, default=10, help='SOA minimum (negative answer TTL)')
+    parser.add_argument('--delay', type=int, default=0, help='answer delay in ms')
+    parser.add_argument('--drop', type=int, default=0, help='number of the first queries not answered')
+    args = parser.parse_args()
+    standin = StandIn(args)
+    try:
+        standin.serve()
+    except KeyboardInterrupt:
+        print('\n{} queries, {} dropped'.format(standin.queries, standin.dropped))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+#
+# Local FTP stand-in server for testing the curl module transfers
+# (curl.ftp_get/ftp_put/ftp_list and curl.Multi, esp32/modules_examples/curl_multi_bench.py)
+#
+# Minimal passive mode FTP server, any user name and password are accepted.
+# Files are served from and uploaded to the --root directory.
+#
+#   python3 ftp_bench_server.py                           # port 2121, current directory
+#   python3 ftp_bench_server.py --port 2121 --root /tmp/ftp
+
+import argparse
+import os
+import socket
+import socketserver
+import threading
+import time
+
+root = '.'
+lock = threading.Lock()
+connections = 0
+transfers = 0
+
+
+class Handler(socketserver.StreamRequestHandler):
+
+    def reply(self, code, text):
+        self.wfile.write(('%d %s\r\n' % (code, text)).encode())
+
+    def path(self, arg):
+        name = os.path.normpath('/' + os.path.join(self.cwd, arg)).lstrip('/')
+        return os.path.join(root, name)
+
+    def data_conn(self):
+        if self.pasv is None:
+            return None
+        self.pasv.settimeout(10)
+        try:
+            conn, _ = self.pasv.accept()
+        finally:
+            self.pasv.close()
+            self.pasv = None
+        return conn
+
+    def transfer_done(self):
+        global transfers
+        with lock:
+            transfers += 1
+        self.reply(226, 'Transfer complete')
+
+    def handle(self):
+        global connections
+        with lock:
+            connections += 1
+        self.cwd = '/'
+        self.pasv = None
+        self.rest = 0
+        self.reply(220, 'FTP stand-in ready')
+        while True:
+            line = self.rfile.readline()
+            if not line:
+                break
+            line = line.decode(errors='replace').rstrip('\r\n')
+            cmd, _, arg = line.partition(' ')
+            cmd = cmd.upper()
+            if cmd == 'USER':
+                self.reply(331, 'Password required')
+            elif cmd == 'PASS':
+                self.reply(230, 'Logged in')
+            elif cmd == 'SYST':
+                self.reply(215, 'UNIX Type: L8')
+            elif cmd in ('AUTH', 'EPSV', 'EPRT', 'PORT', 'MDTM'):
+                self.reply(502, 'Not implemented')
+            elif cmd in ('TYPE', 'MODE', 'STRU', 'NOOP', 'OPTS', 'PBSZ', 'PROT'):
+                self.reply(200, 'OK')
+            elif cmd == 'FEAT':
+                self.reply(211, 'No features')
+            elif cmd == 'PWD':
+                self.reply(257, '"%s"' % self.cwd)
+            elif cmd == 'CWD':
+                p = self.path(arg)
+                if os.path.isdir(p):
+                    self.cwd = os.path.normpath(os.path.join(self.cwd, arg))
+                    self.reply(250, 'OK')
+                else:
+                    self.reply(550, 'No such directory')
+            elif cmd == 'MKD':
+                try:
+                    os.mkdir(self.path(arg))
+                    self.reply(257, '"%s" created' % arg)
+                except OSError:
+                    self.reply(550, 'Cannot create directory')
+            elif cmd == 'SIZE':
+                p = self.path(arg)
+                if os.path.isfile(p):
+                    self.reply(213, str(os.path.getsize(p)))
+                else:
+                    self.reply(550, 'No such file')
+            elif cmd == 'REST':
+                self.rest = int(arg)
+                self.reply(350, 'Restarting')
+            elif cmd == 'PASV':
+                self.pasv = socket.socket()
+                self.pasv.bind((self.connection.getsockname()[0], 0))
+                self.pasv.listen(1)
+                host = self.connection.getsockname()[0].replace('.', ',')
+                port = self.pasv.getsockname()[1]
+                self.reply(227, 'Entering Passive Mode (%s,%d,%d)' % (host, port >> 8, port & 0xff))
+            elif cmd in ('LIST', 'NLST'):
+                p = self.path(arg if arg and not arg.startswith('-') else '')
+                self.reply(150, 'Opening data connection')
+                conn = self.data_conn()
+                if conn is None:
+                    self.reply(425, 'Use PASV first')
+                    continue
+                with conn:
+                    for name in sorted(os.listdir(p)) if os.path.isdir(p) else []:
+                        if cmd == 'NLST':
+                            conn.sendall((name + '\r\n').encode())
+                        else:
+                            st = os.stat(os.path.join(p, name))
+                            kind = 'd' if os.path.isdir(os.path.join(p, name)) else '-'
+                            conn.sendall(('%srw-r--r-- 1 ftp ftp %d %s %s\r\n' % (
+                                kind, st.st_size, time.strftime('%b %d %H:%M', time.localtime(st.st_mtime)), name)).encode())
+                self.transfer_done()
+            elif cmd == 'RETR':
+                p = self.path(arg)
+                if not os.path.isfile(p):
+                    self.reply(550, 'No such file')
+                    continue
+                self.reply(150, 'Opening data connection (%d bytes)' % os.path.getsize(p))
+                conn = self.data_conn()
+                if conn is None:
+                    self.reply(425, 'Use PASV first')
+                    continue
+                with conn, open(p, 'rb') as f:
+                    f.seek(self.rest)
+                    self.rest = 0
+                    while True:
+                        data = f.read(16384)
+                        if not data:
+                            break
+                        conn.sendall(data)
+                self.transfer_done()
+            elif cmd in ('STOR', 'APPE'):
+                p = self.path(arg)
+                self.reply(150, 'Opening data connection')
+                conn = self.data_conn()
+                if conn is None:
+                    self.reply(425, 'Use PASV first')
+                    continue
+                with conn, open(p, 'ab' if cmd == 'APPE' else 'wb') as f:
+                    while True:
+                        data = conn.recv(16384)
+                        if not data:
+                            break
+                        f.write(data)
+                self.transfer_done()
+            elif cmd == 'DELE':
+                try:
+                    os.remove(self.path(arg))
+                    self.reply(250, 'Deleted')
+                except OSError:
+                    self.reply(550, 'No such file')
+            elif cmd == 'QUIT':
+                self.reply(221, 'Bye')
+                break
+            else:
+                self.reply(502, 'Not implemented')
+
+
+class Server(socketserver.ThreadingMixIn, socketserver.TCPServer):
+    daemon_threads = True
+    allow_reuse_address = True
+
+
+def main():
+    global root
+    parser = argparse.ArgumentParser(description='FTP stand-in server')
+    parser.add_argument('--port', type=int, default=2121)
+    parser.add_argument('--root', default='.')
+    args = parser.parse_args()
+    root = os.path.abspath(args.root)
+
+    server = Server(('', args.port), Handler)
+    print('Serving ftp from {} on port {}'.format(root, args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print('{} transfers on {} connections'.format(transfers, connections))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+#
+# Throughput benchmark for the ESP32 ftp server (network.ftp)
+#
+# Uploads a test file to the device (STOR), downloads it back (RETR) and
+# compares the content, then repeats the download with several clients
+# at the same time (one session per client, each on its own passive port).
+#
+#   python3 ftp_client_bench.py 192.168.0.20
+#   python3 ftp_client_bench.py 192.168.0.20 --size 1000000 --clients 2 --dir /sd
+#
+# Start the server on the ESP32 first:
+#   network.ftp.start(user="micro", password="python", buffsize=4096)
+
+import argparse
+import ftplib
+import io
+import os
+import threading
+import time
+
+
+def connect(args):
+    ftp = ftplib.FTP()
+    ftp.connect(args.host, args.port, timeout=30)
+    ftp.login(args.user, args.password)
+    ftp.cwd(args.dir)
+    return ftp
+
+
+def upload(args, data):
+    ftp = connect(args)
+    t = time.time()
+    ftp.storbinary('STOR ' + args.name, io.BytesIO(data), blocksize=8192)
+    t = time.time() - t
+    ftp.quit()
+    return t
+
+
+def download(args, result):
+    ftp = connect(args)
+    buf = io.BytesIO()
+    t = time.time()
+    ftp.retrbinary('RETR ' + args.name, buf.write, blocksize=8192)
+    result.append((time.time() - t, buf.getvalue()))
+    ftp.quit()
+
+
+def report(name, size, t):
+    print('  {:24s} {:9d} bytes in {:7.3f} s, {:8.1f} KB/s'.format(name, size, t, size / t / 1024))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32 ftp server benchmark')
+    parser.add_argument('host')
+    parser.add_argument('--port', type=int, default=21)
+    parser.add_argument('--user', default='micro')
+    parser.add_argument('--password', default='python')
+    parser.add_argument('--dir', default='/flash')
+    parser.add_argument('--name', default='_ftp_bench.bin')
+    parser.add_argument('--size', type=int, default=256 * 1024)
+    parser.add_argument('--clients', type=int, default=2, help='concurrent downloads')
+    args = parser.parse_args()
+
+    data = os.urandom(args.size)
+    print('ftp benchmark, {}:{}{}/{}'.format(args.host, args.port, args.dir, args.name))
+
+    report('STOR', len(data), upload(args, data))
+
+    result = []
+    download(args, result)
+    t, got = result[0]
+    report('RETR', len(got), t)
+    if got != data:
+        print('  ERROR: downloaded data differs ({} bytes)'.format(len(got)))
+
+    ftp = connect(args)
+    t = time.time()
+    names = ftp.nlst()
+    report('NLST ({} entries)'.format(len(names)), sum(len(n) + 2 for n in names), time.time() - t)
+    ftp.quit()
+
+    if args.clients > 1:
+        result = []
+        threads = [threading.Thread(target=download, args=(args, result)) for i in range(args.clients)]
+        t = time.time()
+        for th in threads:
+            th.start()
+        for th in threads:
+            th.join()
+        t = time.time() - t
+        ok = sum(1 for r in result if r[1] == data)
+        report('RETR x{} ({} ok)'.format(args.clients, ok), sum(len(r[1]) for r in result), t)
+
+    ftp = connect(args)
+    ftp.delete(args.name)
+    ftp.quit()
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,297 @@
+/*
+ * Host test and read throughput benchmark of the gzip file reader (extmod/vfs_native_gz.c)
+ *
+ * vfs_native_gz.c is built unchanged; the compressed files are created by the
+ * image builders' compressor (mkfs_common, 'mkspiffs/mklfs/mkfatfs -z'), with the
+ * restart point index, and by zlib as 'gzip -9' without the index.
+ * For each input file:
+ *   sequential reads with several read sizes and random seek+read are compared
+ *   with the source, a truncated file must return a prefix of the source;
+ *   the throughput of sequential reads and the time of random seek+read are
+ *   printed for the uncompressed file, the indexed and the plain gzip file.
+ * Without arguments a 512 KB text file and a 64 KB random file are generated.
+ *
+ *   gcc -O2 -DNO_QSTR -DMICROPY_VFS=1 -DMICROPY_VFS_NATIVE_GZIP=1 -Ihost -I.. -I../../zlib -I../../mkfs_common \
+ *       -o gz_reader_test gz_reader_test.c ../../mkfs_common/mkfs_tree.c \
+ *       ../../zlib/{adler32,crc32,deflate,inflate,inffast,inftrees,trees,zutil}.c -lpthread
+ *   ./gz_reader_test [file ...]
+ * (run in this directory)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "mkfs_tree.h"
+#include "extmod/vfs_native_gz.c"
+
+#define N_RANDOM    3000
+
+static char tmp_dir[64];
+static int n_errors = 0;
+
+static double ms_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+static void check(int ok, const char *what, const char *name)
+{
+    if (!ok) {
+        printf("  FAIL: %s (%s)\n", what, name);
+        n_errors++;
+    }
+}
+
+static void write_file(const char *path, const uint8_t *data, size_t len)
+{
+    FILE *f = fopen(path, "wb");
+    if ((f == NULL) || (fwrite(data, 1, len, f) != len) || (fclose(f) != 0)) {
+        perror(path);
+        exit(2);
+    }
+}
+
+// 'gzip -9', no header extra field
+static uint8_t *gzip_plain(const uint8_t *src, size_t len, size_t *out_len)
+{
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit2(&strm, 9, Z_DEFLATED, 15 + 16, 9, Z_DEFAULT_STRATEGY) != Z_OK) return NULL;
+    size_t max = deflateBound(&strm, len) + 32;
+    uint8_t *out = malloc(max);
+    strm.next_in = (uint8_t *)src;
+    strm.avail_in = len;
+    strm.next_out = out;
+    strm.avail_out = max;
+    if (deflate(&strm, Z_FINISH) != Z_STREAM_END) {
+        free(out);
+        out = NULL;
+    }
+    *out_len = max - strm.avail_out;
+    deflateEnd(&strm);
+    return out;
+}
+
+// Read the whole file with reads of 'rsize' bytes, compare with the source
+static int read_all(const char *path, const uint8_t *src, size_t len, uint32_t rsize, bool gz, double *ms)
+{
+    uint8_t *buf = malloc(rsize);
+    int fd = open(path, O_RDONLY);
+    gz_file_t *g = NULL;
+    if ((fd < 0) || (gz && ((g = native_vfs_gz_open(fd)) == NULL))) {
+        if (fd >= 0) close(fd);
+        free(buf);
+        return -1;
+    }
+    size_t pos = 0;
+    int ok = 1;
+    double t = ms_now();
+    while (1) {
+        int n = (gz) ? native_vfs_gz_read(g, fd, buf, rsize) : read(fd, buf, rsize);
+        if (n < 0) {
+            ok = -1;
+            break;
+        }
+        if (n == 0) break;
+        if (((pos + n) > len) || (memcmp(buf, src + pos, n) != 0)) ok = 0;
+        pos += n;
+    }
+    if (ms) *ms = ms_now() - t;
+    if (ok == 1) ok = (pos == len);
+    if (g) native_vfs_gz_close(g);
+    close(fd);
+    free(buf);
+    return ok;
+}
+
+// Random seek+read of 1..256 bytes, compare with the source
+static int read_random(const char *path, const uint8_t *src, size_t len, bool gz, double *ms)
+{
+    uint8_t buf[256];
+    int fd = open(path, O_RDONLY);
+    gz_file_t *g = NULL;
+    if ((fd < 0) || (gz && ((g = native_vfs_gz_open(fd)) == NULL))) {
+        if (fd >= 0) close(fd);
+        return 0;
+    }
+    srand(len);
+    int ok = 1;
+    double t = ms_now();
+    for (int i = 0; i < N_RANDOM; i++) {
+        uint32_t off = rand() % (len + 16);
+        uint32_t n = 1 + (rand() % sizeof(buf));
+        int res;
+        if (gz) {
+            res = native_vfs_gz_seek(g, fd, off);
+            if (res == 0) res = native_vfs_gz_read(g, fd, buf, n);
+        }
+        else {
+            res = (lseek(fd, off, SEEK_SET) < 0) ? -1 : read(fd, buf, n);
+        }
+        uint32_t expect = (off >= len) ? 0 : (((len - off) < n) ? (len - off) : n);
+        if ((res != (int)expect) || ((expect) && (memcmp(buf, src + off, expect) != 0))) {
+            ok = 0;
+            break;
+        }
+    }
+    if (ms) *ms = ms_now() - t;
+    if (g) native_vfs_gz_close(g);
+    close(fd);
+    return ok;
+}
+
+// A truncated file must return a prefix of the source and then stop or fail
+static int read_truncated(const char *path, const uint8_t *src, size_t len)
+{
+    uint8_t buf[1000];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    gz_file_t *g = native_vfs_gz_open(fd);
+    if (g == NULL) {
+        // not even the header and trailer could be read
+        close(fd);
+        return 1;
+    }
+    size_t pos = 0;
+    int ok = 1;
+    for (int i = 0; i < 100000; i++) {
+        int n = native_vfs_gz_read(g, fd, buf, sizeof(buf));
+        if (n <= 0) break;
+        if (((pos + n) > len) || (memcmp(buf, src + pos, n) != 0)) {
+            // the trailer of a truncated file is compressed data, the read size is not exact
+            if (pos + n <= len) ok = 0;
+            break;
+        }
+        pos += n;
+    }
+    native_vfs_gz_close(g);
+    close(fd);
+    return ok;
+}
+
+static void test_file(const char *name, const uint8_t *src, size_t len)
+{
+    char raw_path[128], rp_path[128], gz_path[128], tr_path[128];
+    snprintf(raw_path, sizeof(raw_path), "%s/raw", tmp_dir);
+    snprintf(rp_path, sizeof(rp_path), "%s/rp.gz", tmp_dir);
+    snprintf(gz_path, sizeof(gz_path), "%s/plain.gz", tmp_dir);
+    snprintf(tr_path, sizeof(tr_path), "%s/trunc.gz", tmp_dir);
+
+    size_t rp_len, gz_len;
+    uint8_t *rp = mkfs_gz_compress(src, len, &rp_len);
+    uint8_t *gz = gzip_plain(src, len, &gz_len);
+    if ((rp == NULL) || (gz == NULL)) {
+        printf("%s: compression failed\n", name);
+        exit(2);
+    }
+    write_file(raw_path, src, len);
+    write_file(rp_path, rp, rp_len);
+    write_file(gz_path, gz, gz_len);
+
+    printf("%s: %zu bytes, compressed %zu (%d%% saved), gzip -9 %zu\n",
+           name, len, rp_len, (len) ? (int)(100 * ((double)len - rp_len) / len) : 0, gz_len);
+
+    // correctness
+    static const uint32_t rsizes[] = { 1, 7, 100, 512, 1500, 4096, 65536 };
+    for (int i = 0; i < (int)(sizeof(rsizes) / sizeof(rsizes[0])); i++) {
+        if ((rsizes[i] == 1) && (len > 65536)) continue;
+        check(read_all(rp_path, src, len, rsizes[i], true, NULL) == 1, "sequential read, indexed", name);
+        check(read_all(gz_path, src, len, rsizes[i], true, NULL) == 1, "sequential read, gzip -9", name);
+    }
+    check(read_random(rp_path, src, len, true, NULL), "random seek+read, indexed", name);
+    check(read_random(gz_path, src, len, true, NULL), "random seek+read, gzip -9", name);
+    for (int i = 1; i <= 4; i++) {
+        size_t cut = rp_len * i / 5;
+        write_file(tr_path, rp, cut);
+        check(read_truncated(tr_path, src, len), "truncated file", name);
+    }
+
+    // throughput, the best of 3 runs
+    static const uint32_t tsizes[] = { 512, 4096 };
+    for (int i = 0; i < 2; i++) {
+        double t_raw = 1e9, t_rp = 1e9, t_gz = 1e9, t;
+        for (int r = 0; r < 3; r++) {
+            if ((read_all(raw_path, src, len, tsizes[i], false, &t) == 1) && (t < t_raw)) t_raw = t;
+            if ((read_all(rp_path, src, len, tsizes[i], true, &t) == 1) && (t < t_rp)) t_rp = t;
+            if ((read_all(gz_path, src, len, tsizes[i], true, &t) == 1) && (t < t_gz)) t_gz = t;
+        }
+        printf("  sequential %4u B reads: raw %7.1f MB/s, indexed %6.1f MB/s, gzip -9 %6.1f MB/s\n", tsizes[i],
+               len / (t_raw * 1000.0), len / (t_rp * 1000.0), len / (t_gz * 1000.0));
+    }
+    double t_raw = 0, t_rp = 0, t_gz = 0;
+    read_random(raw_path, src, len, false, &t_raw);
+    read_random(rp_path, src, len, true, &t_rp);
+    read_random(gz_path, src, len, true, &t_gz);
+    printf("  random seek+read: raw %6.1f us, indexed %7.1f us, gzip -9 %8.1f us\n",
+           t_raw * 1000.0 / N_RANDOM, t_rp * 1000.0 / N_RANDOM, t_gz * 1000.0 / N_RANDOM);
+
+    free(rp);
+    free(gz);
+}
+
+static uint8_t *gen_text(size_t len)
+{
+    // log and html like text
+    static const char *words[] = { "<div class=\"row\">", "</div>\n", "temperature", "humidity", "=", "21.5",
+                                   "2018-05-28 12:00:01", "sensor", "ok\n", "function", "(value)", "{ return", "};\n" };
+    uint8_t *buf = malloc(len);
+    srand(1);
+    for (size_t pos = 0; pos < len;) {
+        const char *w = words[rand() % (sizeof(words) / sizeof(words[0]))];
+        size_t n = strlen(w);
+        if (n > (len - pos)) n = len - pos;
+        memcpy(buf + pos, w, n);
+        pos += n;
+        if (pos < len) buf[pos++] = ' ';
+    }
+    return buf;
+}
+
+int main(int argc, char *argv[])
+{
+    strcpy(tmp_dir, "/tmp/gz_reader_XXXXXX");
+    if (mkdtemp(tmp_dir) == NULL) {
+        perror("mkdtemp");
+        return 2;
+    }
+
+    if (argc < 2) {
+        uint8_t *text = gen_text(512 * 1024);
+        test_file("text", text, 512 * 1024);
+        free(text);
+        uint8_t *rnd = malloc(64 * 1024);
+        for (int i = 0; i < 64 * 1024; i++) rnd[i] = rand();
+        test_file("random", rnd, 64 * 1024);
+        free(rnd);
+    }
+    for (int i = 1; i < argc; i++) {
+        struct stat st;
+        FILE *f = fopen(argv[i], "rb");
+        if ((f == NULL) || (stat(argv[i], &st) != 0)) {
+            perror(argv[i]);
+            return 2;
+        }
+        uint8_t *data = malloc(st.st_size + 1);
+        if (fread(data, 1, st.st_size, f) != (size_t)st.st_size) {
+            perror(argv[i]);
+            return 2;
+        }
+        fclose(f);
+        test_file(argv[i], data, st.st_size);
+        free(data);
+    }
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", tmp_dir);
+    if (system(cmd) != 0) printf("can't remove %s\n", tmp_dir);
+
+    printf("%s, %d errors\n", (n_errors) ? "FAILED" : "OK", n_errors);
+    return (n_errors) ? 1 : 0;
+}
@@ -0,0 +1,14 @@
+#pragma once
+// Only the declarations used by the inline pin functions of mphalport.h
+#include "esp_err.h"
+
+typedef int gpio_num_t;
+typedef enum {
+    GPIO_MODE_INPUT,
+    GPIO_MODE_INPUT_OUTPUT,
+    GPIO_MODE_INPUT_OUTPUT_OD,
+} gpio_mode_t;
+
+esp_err_t gpio_set_direction(gpio_num_t gpio_num, gpio_mode_t mode);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+int gpio_get_level(gpio_num_t gpio_num);
@@ -0,0 +1,30 @@
+#pragma once
+#include "esp_err.h"
+
+// Only the declarations used by the display backlight code, nothing is driven on the host
+typedef struct {
+    int speed_mode;
+    int bit_num;
+    int duty_resolution;
+    int timer_num;
+    uint32_t freq_hz;
+} ledc_timer_config_t;
+
+typedef struct {
+    int gpio_num;
+    int speed_mode;
+    int channel;
+    int intr_type;
+    int timer_sel;
+    uint32_t duty;
+} ledc_channel_config_t;
+
+#define LEDC_HIGH_SPEED_MODE    0
+#define LEDC_TIMER_3            3
+#define LEDC_TIMER_10_BIT       10
+#define LEDC_CHANNEL_7          7
+
+static inline esp_err_t ledc_timer_config(const ledc_timer_config_t *conf) { return ESP_OK; }
+static inline esp_err_t ledc_channel_config(const ledc_channel_config_t *conf) { return ESP_OK; }
+static inline esp_err_t ledc_set_duty(int mode, int channel, uint32_t duty) { return ESP_OK; }
+static inline esp_err_t ledc_update_duty(int mode, int channel) { return ESP_OK; }
@@ -0,0 +1,5 @@
+#pragma once
+// Only the types used by the declarations in modmachine.h
+#include "driver/gpio.h"
+
+typedef void *intr_handle_t;
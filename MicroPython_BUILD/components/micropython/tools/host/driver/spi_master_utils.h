@@ -0,0 +1,17 @@
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+
+// Only the declarations used by the display driver headers, there is no SPI bus on the host
+#define HSPI_HOST   1
+#define VSPI_HOST   2
+
+typedef struct {
+    void *handle;
+    int dc;
+    int cs;
+} exspi_device_handle_t;
+
+esp_err_t spi_device_select(exspi_device_handle_t *handle, int force);
+esp_err_t spi_device_deselect(exspi_device_handle_t *handle);
@@ -0,0 +1,4 @@
+#pragma once
+// The UART is simulated by the test program, see soc/uart_struct.h
+#define UART_NUM_0      0
+#define UART_FIFO_LEN   128
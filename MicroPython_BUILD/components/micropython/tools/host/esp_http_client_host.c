@@ -0,0 +1,216 @@
+/*
+ * Host stand-in for the ESP-IDF HTTP client (esp_http_client)
+ *
+ * Plain http over BSD sockets, enough for the firmware modules downloading a
+ * single resource: a GET request per connection with the extra headers set by
+ * esp_http_client_set_header(), the status line and Content-Length of the
+ * response are parsed. The body is read up to Content-Length or until the server
+ * closes the connection; a connection reset is a read error (-1), as on the device.
+ * Only the connected/finish/disconnected events are delivered.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include "esp_http_client.h"
+
+#define HTTP_MAX_HEADERS    8
+#define HTTP_HDR_BUF_SIZE   2048
+
+struct esp_http_client {
+    char host[64];
+    char port[8];
+    char path[256];
+    char *hdr_key[HTTP_MAX_HEADERS];
+    char *hdr_value[HTTP_MAX_HEADERS];
+    http_event_handle_cb event_handler;
+    int sock;
+    int status_code;
+    int content_length;             // -1 if not given
+    int body_read;
+    char buf[HTTP_HDR_BUF_SIZE];    // body data received with the headers
+    int buf_pos;
+    int buf_len;
+};
+
+uint32_t host_http_rx_bytes = 0;
+
+static void http_event(esp_http_client_handle_t client, esp_http_client_event_id_t id)
+{
+    if (client->event_handler == NULL) return;
+    esp_http_client_event_t evt = {0};
+    evt.event_id = id;
+    evt.client = client;
+    client->event_handler(&evt);
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    if ((config->url == NULL) || (strncmp(config->url, "http://", 7) != 0)) return NULL;
+    esp_http_client_handle_t client = calloc(1, sizeof(struct esp_http_client));
+    if (client == NULL) return NULL;
+    const char *host = config->url + 7;
+    const char *path = strchr(host, '/');
+    if (path == NULL) path = host + strlen(host);
+    const char *port = memchr(host, ':', path - host);
+    const char *host_end = (port) ? port : path;
+    if (((host_end - host) >= sizeof(client->host)) || (strlen(path) >= sizeof(client->path))) {
+        free(client);
+        return NULL;
+    }
+    memcpy(client->host, host, host_end - host);
+    if (port) snprintf(client->port, sizeof(client->port), "%.*s", (int)(path - port - 1), port + 1);
+    else strcpy(client->port, "80");
+    strcpy(client->path, (*path) ? path : "/");
+    client->event_handler = config->event_handler;
+    client->sock = -1;
+    return client;
+}
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char *key)
+{
+    for (int i = 0; i < HTTP_MAX_HEADERS; i++) {
+        if ((client->hdr_key[i]) && (strcasecmp(client->hdr_key[i], key) == 0)) {
+            free(client->hdr_key[i]);
+            free(client->hdr_value[i]);
+            client->hdr_key[i] = NULL;
+            client->hdr_value[i] = NULL;
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    esp_http_client_delete_header(client, key);
+    for (int i = 0; i < HTTP_MAX_HEADERS; i++) {
+        if (client->hdr_key[i] == NULL) {
+            client->hdr_key[i] = strdup(key);
+            client->hdr_value[i] = strdup(value);
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    struct addrinfo hints = {0}, *res = NULL;
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(client->host, client->port, &hints, &res) != 0) return ESP_FAIL;
+    esp_http_client_close(client);
+    client->sock = socket(res->ai_family, res->ai_socktype, 0);
+    if ((client->sock < 0) || (connect(client->sock, res->ai_addr, res->ai_addrlen) != 0)) {
+        freeaddrinfo(res);
+        esp_http_client_close(client);
+        http_event(client, HTTP_EVENT_ERROR);
+        return ESP_FAIL;
+    }
+    freeaddrinfo(res);
+    http_event(client, HTTP_EVENT_ON_CONNECTED);
+
+    char req[1024];
+    int len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n", client->path, client->host);
+    for (int i = 0; i < HTTP_MAX_HEADERS; i++) {
+        if (client->hdr_key[i]) len += snprintf(req+len, sizeof(req)-len, "%s: %s\r\n", client->hdr_key[i], client->hdr_value[i]);
+    }
+    len += snprintf(req+len, sizeof(req)-len, "\r\n");
+    if (send(client->sock, req, len, MSG_NOSIGNAL) != len) {
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+    http_event(client, HTTP_EVENT_HEADER_SENT);
+    client->status_code = 0;
+    client->content_length = -1;
+    client->body_read = 0;
+    client->buf_pos = 0;
+    client->buf_len = 0;
+    return ESP_OK;
+}
+
+// Returns the content length, ESP_FAIL on error
+int esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    if (client->sock < 0) return ESP_FAIL;
+    char *end = NULL;
+    while (end == NULL) {
+        if (client->buf_len >= (sizeof(client->buf) - 1)) return ESP_FAIL;
+        int n = recv(client->sock, client->buf + client->buf_len, sizeof(client->buf) - 1 - client->buf_len, 0);
+        if (n <= 0) return ESP_FAIL;
+        client->buf_len += n;
+        client->buf[client->buf_len] = '\0';
+        end = strstr(client->buf, "\r\n\r\n");
+    }
+    *end = '\0';
+    if (sscanf(client->buf, "HTTP/1.%*d %d", &client->status_code) != 1) return ESP_FAIL;
+    for (char *line = strstr(client->buf, "\r\n"); line; line = strstr(line + 2, "\r\n")) {
+        if (strncasecmp(line + 2, "Content-Length:", 15) == 0) client->content_length = atoi(line + 17);
+    }
+    client->buf_pos = (end + 4) - client->buf;
+    return (client->content_length >= 0) ? client->content_length : 0;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    if (client->sock < 0) return -1;
+    if ((client->content_length >= 0) && (len > (client->content_length - client->body_read))) {
+        len = client->content_length - client->body_read;
+    }
+    if (len <= 0) {
+        http_event(client, HTTP_EVENT_ON_FINISH);
+        return 0;
+    }
+    int n;
+    if (client->buf_pos < client->buf_len) {
+        n = client->buf_len - client->buf_pos;
+        if (n > len) n = len;
+        memcpy(buffer, client->buf + client->buf_pos, n);
+        client->buf_pos += n;
+    }
+    else {
+        n = recv(client->sock, buffer, len, 0);
+        if (n < 0) return -1;
+    }
+    client->body_read += n;
+    host_http_rx_bytes += n;
+    return n;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status_code;
+}
+
+int esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+    return client->content_length;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    if (client == NULL) return ESP_FAIL;
+    if (client->sock >= 0) {
+        close(client->sock);
+        client->sock = -1;
+        http_event(client, HTTP_EVENT_DISCONNECTED);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    if (client == NULL) return ESP_FAIL;
+    esp_http_client_close(client);
+    for (int i = 0; i < HTTP_MAX_HEADERS; i++) {
+        free(client->hdr_key[i]);
+        free(client->hdr_value[i]);
+    }
+    free(client);
+    return ESP_OK;
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+typedef int wifi_mode_t;
@@ -0,0 +1,28 @@
+#pragma once
+#include <pthread.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdTRUE                          1
+#define pdFALSE                         0
+#define pdPASS                          1
+#define portTICK_PERIOD_MS              1
+#define portTICK_RATE_MS                portTICK_PERIOD_MS
+#define portMAX_DELAY                   0xffffffff
+#define pdMS_TO_TICKS(ms)               (ms)
+
+typedef pthread_t *TaskHandle_t;
+typedef int portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    0
+
+// All critical sections share one recursive lock
+void portENTER_CRITICAL(portMUX_TYPE *mux);
+void portEXIT_CRITICAL(portMUX_TYPE *mux);
@@ -0,0 +1,10 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+// Tasks are detached threads, the stack size, priority and core are ignored
+BaseType_t xTaskCreate(void (*func)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle);
+BaseType_t xTaskCreatePinnedToCore(void (*func)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle, int core);
+void vTaskDelete(TaskHandle_t handle);
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+#define taskYIELD() vTaskDelay(0)
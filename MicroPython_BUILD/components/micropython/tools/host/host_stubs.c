@@ -0,0 +1,268 @@
+/*
+ * Host stand-ins for the FreeRTOS and ESP-IDF functions
+ *
+ * Minimal FreeRTOS, lwip and esp_* API implemented over POSIX (pthreads, BSD sockets,
+ * clock_gettime), so the ESP-IDF independent parts of the firmware can be compiled
+ * and tested on Linux by the *_test.c programs in this directory. Only what those
+ * programs use is provided. The sdkconfig options are given on the command line (-D).
+ */
+
+#include <time.h>
+#include <unistd.h>
+#include <sched.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/queue.h"
+#include "lwip/dns.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_err.h"
+#include "rom/crc.h"
+
+struct host_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+};
+
+static pthread_mutex_t host_critical;
+static pthread_once_t host_critical_once = PTHREAD_ONCE_INIT;
+
+int MainTaskCore = 0;
+ip_addr_t host_dns_servers[2];
+
+static void host_critical_init(void)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&host_critical, &attr);
+}
+
+void portENTER_CRITICAL(portMUX_TYPE *mux)
+{
+    pthread_once(&host_critical_once, host_critical_init);
+    pthread_mutex_lock(&host_critical);
+}
+
+void portEXIT_CRITICAL(portMUX_TYPE *mux)
+{
+    pthread_mutex_unlock(&host_critical);
+}
+
+// Absolute time of the timeout for pthread_cond_timedwait
+static void host_deadline(struct timespec *ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_REALTIME, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    QueueHandle_t queue = calloc(1, sizeof(struct host_queue));
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    queue->items = malloc(length * item_size);
+    queue->length = length;
+    queue->item_size = item_size;
+    return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void *item, TickType_t ticks)
+{
+    struct timespec ts;
+    host_deadline(&ts, ticks);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == queue->length) {
+        if ((ticks == 0) || ((ticks != portMAX_DELAY) && (pthread_cond_timedwait(&queue->cond, &queue->mutex, &ts) != 0))) {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+    }
+    UBaseType_t tail = (queue->head + queue->count) % queue->length;
+    if (queue->item_size) {
+        memcpy(queue->items + tail * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void *item, TickType_t ticks)
+{
+    struct timespec ts;
+    host_deadline(&ts, ticks);
+    pthread_mutex_lock(&queue->mutex);
+    while (queue->count == 0) {
+        if ((ticks == 0) || ((ticks != portMAX_DELAY) && (pthread_cond_timedwait(&queue->cond, &queue->mutex, &ts) != 0))) {
+            pthread_mutex_unlock(&queue->mutex);
+            return pdFALSE;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(&queue->cond, &queue->mutex);
+        }
+    }
+    if (queue->item_size) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+    return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&queue->mutex);
+    UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&queue->mutex);
+    return count;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&queue->mutex);
+    pthread_cond_destroy(&queue->cond);
+    free(queue->items);
+    free(queue);
+}
+
+// Semaphores are queues of zero size items, as in FreeRTOS
+static SemaphoreHandle_t host_sem_new(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max, 0);
+    sem->count = initial;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return host_sem_new(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return host_sem_new(1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    return host_sem_new(max, initial);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks)
+{
+    return xQueueReceive(sem, NULL, ticks);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, NULL, 0);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem)
+{
+    vQueueDelete(sem);
+}
+
+BaseType_t xTaskCreate(void (*func)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle)
+{
+    pthread_t *thread = malloc(sizeof(pthread_t));
+    if (pthread_create(thread, NULL, (void *(*)(void *))func, arg) != 0) {
+        free(thread);
+        return pdFALSE;
+    }
+    pthread_detach(*thread);
+    if (handle) {
+        *handle = thread;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(void (*func)(void *), const char *name, uint32_t stack, void *arg, UBaseType_t prio, TaskHandle_t *handle, int core)
+{
+    return xTaskCreate(func, name, stack, arg, prio, handle);
+}
+
+void vTaskDelete(TaskHandle_t handle)
+{
+    if (handle == NULL) {
+        pthread_exit(NULL);
+    }
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    if (ticks == 0) {
+        sched_yield();
+    }
+    else {
+        usleep(ticks * 1000);
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return esp_timer_get_time() / 1000;
+}
+
+uint32_t esp_random(void)
+{
+    static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    static uint64_t state = 0;
+    pthread_mutex_lock(&mutex);
+    if (state == 0) {
+        state = (uint64_t)time(NULL) * 6364136223846793005ULL + getpid();
+    }
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    uint32_t r = state >> 32;
+    pthread_mutex_unlock(&mutex);
+    return r;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000LL + t.tv_nsec / 1000;
+}
+
+const ip_addr_t *dns_getserver(uint8_t index)
+{
+    return (index < 2) ? &host_dns_servers[index] : NULL;
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    static char name[24];
+    if (code == ESP_OK) return "ESP_OK";
+    if (code == ESP_FAIL) return "ESP_FAIL";
+    snprintf(name, sizeof(name), "ESP_ERR 0x%x", (unsigned)code);
+    return name;
+}
+
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    crc = ~crc;
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++) crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
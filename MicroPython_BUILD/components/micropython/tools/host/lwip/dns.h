@@ -0,0 +1,12 @@
+#pragma once
+#include <stdint.h>
+
+typedef struct { uint32_t addr; } ip4_addr_t;
+typedef struct { ip4_addr_t ip4; int type; } ip_addr_t;
+
+#define IP_IS_V4(ip)    ((ip)->type == 0)
+#define ip_2_ip4(ip)    (&(ip)->ip4)
+
+// The servers "got from DHCP", set by the test in host_dns_servers
+extern ip_addr_t host_dns_servers[2];
+const ip_addr_t *dns_getserver(uint8_t index);
@@ -0,0 +1,4 @@
+#pragma once
+#include <stdint.h>
+
+typedef int8_t err_t;
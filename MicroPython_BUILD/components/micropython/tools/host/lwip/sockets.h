@@ -0,0 +1,12 @@
+#pragma once
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <strings.h>
+#include <stdio.h>
+
+#define inet_ntoa_r(addr, buf, len) snprintf(buf, len, "%s", inet_ntoa(addr))
@@ -0,0 +1,13 @@
+#pragma once
+// mbedtls MD5 over the host's OpenSSL (link with -lcrypto)
+#include <openssl/evp.h>
+
+typedef struct {
+    EVP_MD_CTX *ctx;
+} mbedtls_md5_context;
+
+static inline void mbedtls_md5_init(mbedtls_md5_context *ctx) { ctx->ctx = EVP_MD_CTX_new(); }
+static inline void mbedtls_md5_free(mbedtls_md5_context *ctx) { EVP_MD_CTX_free(ctx->ctx); ctx->ctx = NULL; }
+static inline int mbedtls_md5_starts(mbedtls_md5_context *ctx) { return EVP_DigestInit_ex(ctx->ctx, EVP_md5(), NULL) ? 0 : -1; }
+static inline int mbedtls_md5_update(mbedtls_md5_context *ctx, const unsigned char *input, size_t ilen) { return EVP_DigestUpdate(ctx->ctx, input, ilen) ? 0 : -1; }
+static inline int mbedtls_md5_finish(mbedtls_md5_context *ctx, unsigned char output[16]) { return EVP_DigestFinal_ex(ctx->ctx, output, NULL) ? 0 : -1; }
@@ -0,0 +1,13 @@
+#pragma once
+// mbedtls SHA-256 over the host's OpenSSL (link with -lcrypto), SHA-224 is not supported
+#include <openssl/evp.h>
+
+typedef struct {
+    EVP_MD_CTX *ctx;
+} mbedtls_sha256_context;
+
+static inline void mbedtls_sha256_init(mbedtls_sha256_context *ctx) { ctx->ctx = EVP_MD_CTX_new(); }
+static inline void mbedtls_sha256_free(mbedtls_sha256_context *ctx) { EVP_MD_CTX_free(ctx->ctx); ctx->ctx = NULL; }
+static inline int mbedtls_sha256_starts(mbedtls_sha256_context *ctx, int is224) { return EVP_DigestInit_ex(ctx->ctx, EVP_sha256(), NULL) ? 0 : -1; }
+static inline int mbedtls_sha256_update(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen) { return EVP_DigestUpdate(ctx->ctx, input, ilen) ? 0 : -1; }
+static inline int mbedtls_sha256_finish(mbedtls_sha256_context *ctx, unsigned char output[32]) { return EVP_DigestFinal_ex(ctx->ctx, output, NULL) ? 0 : -1; }
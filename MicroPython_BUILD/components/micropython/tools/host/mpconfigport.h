@@ -0,0 +1,16 @@
+#pragma once
+// MicroPython configuration for the host builds, only what the py/ headers
+// included by the port's C libraries need (compile with -DNO_QSTR)
+#include <stdint.h>
+#include <stdio.h>
+#include <alloca.h>
+
+#define MICROPY_ALLOC_PATH_MAX      (256)
+#define MICROPY_FLOAT_IMPL          (MICROPY_FLOAT_IMPL_FLOAT)
+#define MICROPY_LONGINT_IMPL        (MICROPY_LONGINT_IMPL_MPZ)
+
+typedef intptr_t mp_int_t;
+typedef uintptr_t mp_uint_t;
+typedef long mp_off_t;
+
+#define MP_PLAT_PRINT_STRN(str, len) fwrite(str, 1, len, stdout)
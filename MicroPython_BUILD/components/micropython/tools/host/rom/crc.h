@@ -0,0 +1,6 @@
+#pragma once
+// ROM CRC functions
+#include <stdint.h>
+
+// CRC32 (IEEE 802.3, as zlib's crc32()), implemented in host_stubs.c
+uint32_t crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len);
@@ -0,0 +1,2 @@
+#pragma once
+// ROM queue macros, not used on the host
@@ -0,0 +1,40 @@
+#pragma once
+// TJpgDec API of the ESP32 ROM JPEG decoder, implemented on the host with libjpeg (tjpgd_host.c)
+#include <stdint.h>
+
+typedef unsigned int UINT;
+typedef uint8_t BYTE;
+typedef uint16_t WORD;
+typedef int16_t SHORT;
+typedef int32_t LONG;
+
+typedef enum {
+    JDR_OK = 0, // Succeeded
+    JDR_INTR,   // Interrupted by output function
+    JDR_INP,    // Device error or wrong termination of input stream
+    JDR_MEM1,   // Insufficient memory pool for the image
+    JDR_MEM2,   // Insufficient stream input buffer
+    JDR_PAR,    // Parameter error
+    JDR_FMT1,   // Data format error (may be damaged data)
+    JDR_FMT2,   // Right format but not supported
+    JDR_FMT3    // Not supported JPEG standard
+} JRESULT;
+
+typedef struct {
+    WORD left, right, top, bottom;
+} JRECT;
+
+typedef struct JDEC JDEC;
+struct JDEC {
+    BYTE scale;         // Output scaling ratio
+    BYTE msx, msy;      // MCU size in unit of block (width, height)
+    UINT width, height; // Size of the input image (pixel)
+    void *pool;         // Pointer to available memory pool
+    UINT sz_pool;       // Size of momory pool (bytes available)
+    UINT (*infunc)(JDEC *, BYTE *, UINT);   // Pointer to jpeg stream input function
+    void *device;       // Pointer to I/O device identifiler for the session
+    void *host;         // libjpeg decoder state
+};
+
+JRESULT jd_prepare(JDEC *jd, UINT (*infunc)(JDEC *, BYTE *, UINT), void *pool, UINT sz_pool, void *dev);
+JRESULT jd_decomp(JDEC *jd, UINT (*outfunc)(JDEC *, void *, JRECT *), BYTE scale);
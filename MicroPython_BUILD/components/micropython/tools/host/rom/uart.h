@@ -0,0 +1,2 @@
+#pragma once
+// ROM UART functions, not used on the host
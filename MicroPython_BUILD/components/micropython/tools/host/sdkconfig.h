@@ -0,0 +1,2 @@
+#pragma once
+// The options are set on the compiler command line (-DCONFIG_...)
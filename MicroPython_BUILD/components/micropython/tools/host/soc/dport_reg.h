@@ -0,0 +1,2 @@
+#pragma once
+// DPORT registers, not used on the host
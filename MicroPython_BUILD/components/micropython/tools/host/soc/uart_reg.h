@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+// Writing the FIFO register of the simulated UART puts the byte into its TX FIFO
+void host_uart_fifo_write(int uart_num, uint8_t c);
+#define UART_FIFO_AHB_REG(i)            (i)
+#define WRITE_PERI_REG(addr, val)       host_uart_fifo_write((addr), (val))
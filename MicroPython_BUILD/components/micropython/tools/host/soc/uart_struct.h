@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+// Simulated UART0, implemented by the test program: reading 'UART0' updates
+// the TX FIFO count for the bytes transmitted since the last access
+typedef struct {
+    struct {
+        uint32_t txfifo_cnt;
+    } status;
+} uart_dev_t;
+
+uart_dev_t *host_uart_dev(int uart_num);
+#define UART0 (*host_uart_dev(0))
@@ -0,0 +1,3 @@
+#pragma once
+
+typedef int tcpip_adapter_if_t;
@@ -0,0 +1,17 @@
+#pragma once
+// In-memory display panel for the host builds of the tft library (tftspi_host.c)
+#include "tftspi.h"
+
+extern const tft_panel_t tft_mem_panel;    // panel backend drawing into the frame buffer
+extern color_t *tft_mem_fb;                 // frame buffer, '_width' x '_height' pixels
+
+// Allocate the frame buffer for the current display size, set the display variables
+int tft_mem_init(int width, int height, uint8_t bpc);
+// Clear the frame buffer and the transfer counters
+void tft_mem_reset(void);
+// FNV-1a hash of the frame buffer
+uint32_t tft_mem_hash(void);
+// Write the frame buffer as binary PPM image
+int tft_mem_write_ppm(const char *fname);
+// Number of pixels different from the PPM image, -1 if it can't be read
+long tft_mem_compare_ppm(const char *fname);
@@ -0,0 +1,354 @@
+/*
+ * Host stand-in for the tft library's display driver (esp32/libs/tft/tftspi.c)
+ *
+ * The display is a frame buffer in memory. 'tft_mem_panel' is the panel
+ * backend drawing into it; it counts the pixel data transfers like
+ * 'tft_spi_stats_panel' on the device, the bytes are the ones the SPI
+ * display would get. The low level functions of tftspi.c (send_data(),
+ * drawPixel(), ...) draw through the same panel, so the tft.c versions
+ * from before the panel backend can be built and compared too.
+ * Display commands (rotation, invert, gamma) are ignored, there is no touch panel.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "tft_panel_mem.h"
+#include "py/mpprint.h"
+
+int _width = 320;
+int _height = 240;
+uint8_t tft_disp_type = DISP_TYPE_ILI9341;
+uint8_t tft_touch_type = TOUCH_TYPE_NONE;
+uint8_t gray_scale = 0;
+uint32_t max_rdclock = 8000000;
+uint8_t bits_per_color = 16;
+uint8_t TFT_RGB_BGR = 0;
+uint8_t gamma_curve = 0;
+uint32_t spi_speed = 40000000;
+uint8_t spibus_is_init = 1;
+exspi_device_handle_t *disp_spi = NULL;
+exspi_device_handle_t *ts_spi = NULL;
+
+color_t *tft_mem_fb = NULL;
+static int fb_width, fb_height;
+
+tft_panel_stats_t tft_panel_stats = {0};
+
+// ==== MicroPython and driver functions used by tft.c ====
+
+const mp_print_t mp_plat_print = {NULL, NULL};
+
+int mp_printf(const mp_print_t *print, const char *fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vprintf(fmt, ap);
+    va_end(ap);
+    return n;
+}
+
+bool file_noton_spi_sdcard(char *fname)
+{
+    return true;
+}
+
+esp_err_t spi_device_select(exspi_device_handle_t *handle, int force)
+{
+    return ESP_OK;
+}
+
+esp_err_t spi_device_deselect(exspi_device_handle_t *handle)
+{
+    return ESP_OK;
+}
+
+void disp_spi_transfer_cmd(int8_t cmd)
+{
+}
+
+void disp_spi_transfer_cmd_data(int8_t cmd, uint8_t *data, uint32_t len)
+{
+}
+
+int stmpe610_get_touch(uint16_t *x, uint16_t *y, uint16_t *z)
+{
+    return 0;
+}
+
+int touch_get_data(uint8_t type)
+{
+    return 0;
+}
+
+void _tft_setRotation(uint8_t rot)
+{
+    // only the display size, the frame buffer is addressed as the display RAM after MADCTL
+    if (((rot & 1) && (_width < _height)) || (!(rot & 1) && (_width > _height))) {
+        int tmp = _width;
+        _width = _height;
+        _height = tmp;
+    }
+}
+
+// ==== Transfer counters ====
+
+void TFT_countTransfer(tft_panel_stats_t *stats, int x1, int y1, int x2, int y2, uint32_t pixels, uint8_t bpc)
+{
+    stats->transactions++;
+    stats->pixels += pixels;
+    // CASET + 4 bytes, PASET + 4 bytes, RAMWR/RAMRD command
+    stats->bytes += 11 + ((pixels * bpc) / 8);
+    if ((stats->windows == 0) || (x1 != stats->win[0]) || (y1 != stats->win[1]) || (x2 != stats->win[2]) || (y2 != stats->win[3])) {
+        stats->windows++;
+        stats->win[0] = x1;
+        stats->win[1] = y1;
+        stats->win[2] = x2;
+        stats->win[3] = y2;
+    }
+}
+
+// ==== Memory panel ====
+
+// Colors as stored by the display, 16-bit RGB565 or 18-bit
+static color_t mem_color(color_t color)
+{
+    if (bits_per_color == 16) {
+        color.r &= 0xF8;
+        color.g &= 0xFC;
+        color.b &= 0xF8;
+    }
+    else {
+        color.r &= 0xFC;
+        color.g &= 0xFC;
+        color.b &= 0xFC;
+    }
+    return color;
+}
+
+// Write 'len' pixels to the window (x1,y1),(x2,y2) row by row, 'buf' NULL repeats 'color'
+static void mem_write(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf, color_t color)
+{
+    if ((x2 < x1) || (y2 < y1)) return;
+    int x = x1;
+    int y = y1;
+    for (uint32_t i = 0; (i < len) && (y <= y2); i++) {
+        if ((x >= 0) && (y >= 0) && (x < fb_width) && (y < fb_height)) {
+            tft_mem_fb[y * fb_width + x] = mem_color((buf) ? buf[i] : color);
+        }
+        if (++x > x2) {
+            x = x1;
+            y++;
+        }
+    }
+}
+
+static esp_err_t mem_select()
+{
+    return ESP_OK;
+}
+
+static esp_err_t mem_deselect()
+{
+    return ESP_OK;
+}
+
+static esp_err_t mem_wait_trans_finish(uint8_t free_line)
+{
+    return ESP_OK;
+}
+
+static void mem_drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel)
+{
+    TFT_countTransfer(&tft_panel_stats, x, y, x+1, y+1, 1, bits_per_color);
+    mem_write(x, y, x, y, 1, NULL, color);
+}
+
+static void mem_send_data(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf, uint8_t wait)
+{
+    TFT_countTransfer(&tft_panel_stats, x1, y1, x2, y2, len, bits_per_color);
+    mem_write(x1, y1, x2, y2, len, buf, (color_t){0, 0, 0});
+}
+
+static void mem_pushColorRep(int x1, int y1, int x2, int y2, color_t color, uint32_t len)
+{
+    TFT_countTransfer(&tft_panel_stats, x1, y1, x2, y2, len, bits_per_color);
+    mem_write(x1, y1, x2, y2, len, NULL, color);
+}
+
+// 'buf' gets one dummy byte followed by 'len' 24-bit colors, as read from the display
+static int mem_read_data(int x1, int y1, int x2, int y2, int len, uint8_t *buf, uint8_t set_sp)
+{
+    TFT_countTransfer(&tft_panel_stats, x1, y1, x2, y2, len, 24);
+    memset(buf, 0, len * sizeof(color_t) + 1);
+    int x = x1;
+    int y = y1;
+    for (int i = 0; i < len; i++) {
+        if ((x >= 0) && (y >= 0) && (x < fb_width) && (y < fb_height)) {
+            color_t c = tft_mem_fb[y * fb_width + x];
+            buf[1 + i*3] = c.r;
+            buf[2 + i*3] = c.g;
+            buf[3 + i*3] = c.b;
+        }
+        if (++x > x2) {
+            x = x1;
+            y++;
+        }
+    }
+    return ESP_OK;
+}
+
+const tft_panel_t tft_mem_panel = {
+    .select = mem_select,
+    .deselect = mem_deselect,
+    .wait_trans_finish = mem_wait_trans_finish,
+    .drawPixel = mem_drawPixel,
+    .send_data = mem_send_data,
+    .pushColorRep = mem_pushColorRep,
+    .read_data = mem_read_data,
+};
+
+// ==== tftspi.c low level functions and the panel backend selection ====
+
+esp_err_t disp_select()
+{
+    return mem_select();
+}
+
+esp_err_t disp_deselect()
+{
+    return mem_deselect();
+}
+
+esp_err_t wait_trans_finish(uint8_t free_line)
+{
+    return mem_wait_trans_finish(free_line);
+}
+
+void drawPixel(int16_t x, int16_t y, color_t color, uint8_t sel)
+{
+    mem_drawPixel(x, y, color, sel);
+}
+
+void send_data(int x1, int y1, int x2, int y2, uint32_t len, color_t *buf, uint8_t wait)
+{
+    mem_send_data(x1, y1, x2, y2, len, buf, wait);
+}
+
+void TFT_pushColorRep(int x1, int y1, int x2, int y2, color_t color, uint32_t len)
+{
+    mem_pushColorRep(x1, y1, x2, y2, color, len);
+}
+
+int read_data(int x1, int y1, int x2, int y2, int len, uint8_t *buf, uint8_t set_sp)
+{
+    return mem_read_data(x1, y1, x2, y2, len, buf, set_sp);
+}
+
+color_t readPixel(int16_t x, int16_t y)
+{
+    uint8_t color_buf[sizeof(color_t)+1] = {0};
+
+    tft_panel->read_data(x, y, x+1, y+1, 1, color_buf, 1);
+
+    color_t color;
+    color.r = color_buf[1];
+    color.g = color_buf[2];
+    color.b = color_buf[3];
+    return color;
+}
+
+const tft_panel_t tft_spi_panel = {
+    .select = disp_select,
+    .deselect = disp_deselect,
+    .wait_trans_finish = wait_trans_finish,
+    .drawPixel = drawPixel,
+    .send_data = send_data,
+    .pushColorRep = TFT_pushColorRep,
+    .read_data = read_data,
+};
+const tft_panel_t *tft_panel = &tft_spi_panel;
+
+void TFT_setPanel(const tft_panel_t *panel)
+{
+    tft_panel = (panel) ? panel : &tft_spi_panel;
+}
+
+// ==== Frame buffer ====
+
+int tft_mem_init(int width, int height, uint8_t bpc)
+{
+    free(tft_mem_fb);
+    // the display RAM is addressed the same in all orientations
+    fb_width = (width > height) ? width : height;
+    fb_height = fb_width;
+    tft_mem_fb = calloc((size_t)fb_width * fb_height, sizeof(color_t));
+    if (tft_mem_fb == NULL) return -1;
+    _width = width;
+    _height = height;
+    bits_per_color = bpc;
+    tft_mem_reset();
+    return 0;
+}
+
+void tft_mem_reset(void)
+{
+    memset(tft_mem_fb, 0, (size_t)fb_width * fb_height * sizeof(color_t));
+    memset(&tft_panel_stats, 0, sizeof(tft_panel_stats_t));
+}
+
+uint32_t tft_mem_hash(void)
+{
+    uint32_t h = 2166136261u;
+    for (int y = 0; y < _height; y++) {
+        for (int x = 0; x < _width; x++) {
+            color_t c = tft_mem_fb[y * fb_width + x];
+            h = (h ^ c.r) * 16777619u;
+            h = (h ^ c.g) * 16777619u;
+            h = (h ^ c.b) * 16777619u;
+        }
+    }
+    return h;
+}
+
+int tft_mem_write_ppm(const char *fname)
+{
+    FILE *f = fopen(fname, "wb");
+    if (f == NULL) return -1;
+    fprintf(f, "P6\n%d %d\n255\n", _width, _height);
+    for (int y = 0; y < _height; y++) {
+        for (int x = 0; x < _width; x++) {
+            color_t c = tft_mem_fb[y * fb_width + x];
+            uint8_t rgb[3] = {c.r, c.g, c.b};
+            fwrite(rgb, 1, 3, f);
+        }
+    }
+    return (fclose(f) == 0) ? 0 : -1;
+}
+
+long tft_mem_compare_ppm(const char *fname)
+{
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) return -1;
+    int w, h, max;
+    if ((fscanf(f, "P6 %d %d %d", &w, &h, &max) != 3) || (fgetc(f) == EOF) || (w != _width) || (h != _height)) {
+        fclose(f);
+        return -1;
+    }
+    long diff = 0;
+    for (int y = 0; y < _height; y++) {
+        for (int x = 0; x < _width; x++) {
+            uint8_t rgb[3];
+            if (fread(rgb, 1, 3, f) != 3) {
+                fclose(f);
+                return -1;
+            }
+            color_t c = tft_mem_fb[y * fb_width + x];
+            if ((rgb[0] != c.r) || (rgb[1] != c.g) || (rgb[2] != c.b)) diff++;
+        }
+    }
+    fclose(f);
+    return diff;
+}
@@ -0,0 +1,186 @@
+/*
+ * Host stand-in for the ESP32 ROM JPEG decoder (TJpgDec API, rom/tjpgd.h)
+ *
+ * The image is decoded with libjpeg and given to the output function
+ * MCU by MCU, in the order and with the rectangles TJpgDec uses, so the
+ * output callbacks of the tft library get the same calls as on the device.
+ * The input function is called while decoding to fill a JD_SZBUF bytes
+ * buffer, as TJpgDec does.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+
+#include "rom/tjpgd.h"
+
+#define JD_SZBUF    512     // input buffer size of the ROM decoder
+
+typedef struct {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    struct jpeg_source_mgr src;
+    jmp_buf jb;
+    JDEC *jd;
+    uint8_t inbuf[JD_SZBUF];
+} host_jdec_t;
+
+static void host_init_source(j_decompress_ptr cinfo)
+{
+}
+
+static boolean host_fill_input_buffer(j_decompress_ptr cinfo)
+{
+    host_jdec_t *h = (host_jdec_t *)cinfo->client_data;
+    UINT n = h->jd->infunc(h->jd, h->inbuf, JD_SZBUF);
+    if (n == 0) {
+        // end of the stream, insert EOI
+        h->inbuf[0] = 0xFF;
+        h->inbuf[1] = JPEG_EOI;
+        n = 2;
+    }
+    h->src.next_input_byte = h->inbuf;
+    h->src.bytes_in_buffer = n;
+    return TRUE;
+}
+
+static void host_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+    host_jdec_t *h = (host_jdec_t *)cinfo->client_data;
+    if (num_bytes <= 0) return;
+    if ((size_t)num_bytes <= h->src.bytes_in_buffer) {
+        h->src.next_input_byte += num_bytes;
+        h->src.bytes_in_buffer -= num_bytes;
+        return;
+    }
+    // skip the rest in the input stream
+    num_bytes -= h->src.bytes_in_buffer;
+    h->src.bytes_in_buffer = 0;
+    h->jd->infunc(h->jd, NULL, num_bytes);
+}
+
+static void host_term_source(j_decompress_ptr cinfo)
+{
+}
+
+static void host_error_exit(j_common_ptr cinfo)
+{
+    host_jdec_t *h = (host_jdec_t *)cinfo->client_data;
+    longjmp(h->jb, 1);
+}
+
+static void host_free(host_jdec_t *h)
+{
+    jpeg_destroy_decompress(&h->cinfo);
+    free(h);
+}
+
+JRESULT jd_prepare(JDEC *jd, UINT (*infunc)(JDEC *, BYTE *, UINT), void *pool, UINT sz_pool, void *dev)
+{
+    memset(jd, 0, sizeof(JDEC));
+    jd->pool = pool;
+    jd->sz_pool = sz_pool;
+    jd->infunc = infunc;
+    jd->device = dev;
+
+    host_jdec_t *h = calloc(1, sizeof(host_jdec_t));
+    if (h == NULL) return JDR_MEM1;
+    h->jd = jd;
+
+    h->cinfo.err = jpeg_std_error(&h->jerr);
+    h->jerr.error_exit = host_error_exit;
+    h->cinfo.client_data = h;
+    jpeg_create_decompress(&h->cinfo);
+    if (setjmp(h->jb)) {
+        host_free(h);
+        return JDR_FMT1;
+    }
+    h->src.init_source = host_init_source;
+    h->src.fill_input_buffer = host_fill_input_buffer;
+    h->src.skip_input_data = host_skip_input_data;
+    h->src.resync_to_restart = jpeg_resync_to_restart;
+    h->src.term_source = host_term_source;
+    h->cinfo.src = &h->src;
+    if (jpeg_read_header(&h->cinfo, TRUE) != JPEG_HEADER_OK) {
+        host_free(h);
+        return JDR_FMT1;
+    }
+    jd->width = h->cinfo.image_width;
+    jd->height = h->cinfo.image_height;
+    jd->msx = h->cinfo.max_h_samp_factor;
+    jd->msy = h->cinfo.max_v_samp_factor;
+    jd->host = h;
+    return JDR_OK;
+}
+
+JRESULT jd_decomp(JDEC *jd, UINT (*outfunc)(JDEC *, void *, JRECT *), BYTE scale)
+{
+    host_jdec_t *h = jd->host;
+    if (h == NULL) return JDR_PAR;
+    if (scale > 3) {
+        host_free(h);
+        jd->host = NULL;
+        return JDR_PAR;
+    }
+    jd->scale = scale;
+
+    uint8_t *rows = NULL;
+    uint8_t *mcu = NULL;
+    JRESULT rc = JDR_OK;
+    if (setjmp(h->jb)) {
+        rc = JDR_FMT1;
+        goto exit;
+    }
+    h->cinfo.out_color_space = JCS_RGB;
+    h->cinfo.scale_num = 1;
+    h->cinfo.scale_denom = 1 << scale;
+    jpeg_start_decompress(&h->cinfo);
+
+    // size of the scaled image and MCU
+    int w = h->cinfo.output_width;
+    int ht = h->cinfo.output_height;
+    int mx = (jd->msx * 8) >> scale;
+    int my = (jd->msy * 8) >> scale;
+    if (mx < 1) mx = 1;
+    if (my < 1) my = 1;
+    rows = malloc((size_t)w * my * 3);
+    mcu = malloc(mx * my * 3);
+    if ((rows == NULL) || (mcu == NULL)) {
+        rc = JDR_MEM1;
+        goto exit;
+    }
+    // decode one MCU row, output its MCUs
+    for (int y = 0; y < ht; y += my) {
+        int ry = (y + my <= ht) ? my : ht - y;
+        for (int i = 0; i < ry; i++) {
+            JSAMPROW row = rows + (size_t)i * w * 3;
+            jpeg_read_scanlines(&h->cinfo, &row, 1);
+        }
+        for (int x = 0; x < w; x += mx) {
+            // the MCUs at the right and bottom edges are cropped to the image
+            JRECT rect;
+            int rx = (x + mx <= w) ? mx : w - x;
+            rect.left = x;
+            rect.right = x + rx - 1;
+            rect.top = y;
+            rect.bottom = y + ry - 1;
+            for (int i = 0; i < ry; i++) {
+                memcpy(mcu + i * rx * 3, rows + ((size_t)i * w + x) * 3, rx * 3);
+            }
+            if (!outfunc(jd, mcu, &rect)) {
+                rc = JDR_INTR;
+                goto exit;
+            }
+        }
+    }
+    jpeg_finish_decompress(&h->cinfo);
+
+exit:
+    free(mcu);
+    free(rows);
+    host_free(h);
+    jd->host = NULL;
+    return rc;
+}
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+# Local HTTP(S) stand-in server for the requests benchmark
+# (esp32/modules_examples/requests_bench.py)
+#
+# HTTP/1.1 with keep-alive, answers every GET with a small JSON document
+# and every POST/PUT/PATCH with the length of the received body.
+# GET /big?n=<bytes> returns a binary body of the requested size (streaming test).
+#
+#   python3 http_bench_server.py                       # http on port 8080
+#   python3 http_bench_server.py --port 8443 --tls     # https, self-signed certificate
+#
+# For --tls the certificate and key are created with openssl if they don't exist.
+
+import argparse
+import os
+import socketserver
+import ssl
+import subprocess
+import threading
+from http.server import BaseHTTPRequestHandler, HTTPServer
+
+connections = 0
+requests = 0
+lock = threading.Lock()
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def setup(self):
+        global connections
+        super().setup()
+        with lock:
+            connections += 1
+
+    def _reply(self, body):
+        global requests
+        with lock:
+            requests += 1
+        self.send_response(200)
+        self.send_header('Content-Type', 'application/json')
+        self.send_header('Content-Length', str(len(body)))
+        self.end_headers()
+        if self.command != 'HEAD':
+            self.wfile.write(body)
+
+    def do_GET(self):
+        if self.path.startswith('/big'):
+            n = 100000
+            if '?n=' in self.path:
+                n = int(self.path.split('?n=')[1])
+            self._reply(bytes(i & 0xff for i in range(n)))
+            return
+        self._reply(b'{"temperature": 21.5, "humidity": 48, "n": %d}' % requests)
+
+    def do_HEAD(self):
+        self._reply(b'')
+
+    def do_POST(self):
+        n = int(self.headers.get('Content-Length', 0))
+        self.rfile.read(n)
+        self._reply(b'{"received": %d}' % n)
+
+    do_PUT = do_POST
+    do_PATCH = do_POST
+
+    def log_message(self, format, *args):
+        pass
+
+
+class Server(socketserver.ThreadingMixIn, HTTPServer):
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description='requests benchmark server')
+    parser.add_argument('--port', type=int, default=8080)
+    parser.add_argument('--tls', action='store_true', help='use https')
+    parser.add_argument('--cert', default='bench_cert.pem')
+    parser.add_argument('--key', default='bench_key.pem')
+    args = parser.parse_args()
+
+    server = Server(('', args.port), Handler)
+    if args.tls:
+        if not (os.path.exists(args.cert) and os.path.exists(args.key)):
+            subprocess.check_call(['openssl', 'req', '-x509', '-newkey', 'rsa:2048', '-nodes',
+                                   '-keyout', args.key, '-out', args.cert, '-days', '365',
+                                   '-subj', '/CN=bench'])
+        ctx = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+        ctx.load_cert_chain(args.cert, args.key)
+        server.socket = ctx.wrap_socket(server.socket, server_side=True)
+
+    print('Serving {} on port {}'.format('https' if args.tls else 'http', args.port))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    print('{} requests on {} connections'.format(requests, connections))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,218 @@
+#!/usr/bin/env python3
+#
+# Benchmark of the host image builders (mkspiffs, mklfs, mkfatfs)
+#
+# Packs a generated directory of 1000 files (mixed sizes, some compressible,
+# in subdirectories) with each tool which is built, and reports the times of:
+#   the new image with one thread and with '-j' threads (the images must be the same),
+#   the incremental build (-m) without changes and after changing 10 files.
+# The content of the incremental image is verified by unpacking it (mklfs)
+# or by the list of files and sizes (mkspiffs).
+#
+#   python3 mkfs_bench.py --jobs 8
+#   python3 mkfs_bench.py --tools ../.. --files 1000 --keep /tmp/mkfs_bench
+
+import argparse
+import filecmp
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+# SOURCE_DATE_EPOCH makes the images of the same files the same
+EPOCH = '1500000000'
+
+# name, tool path (relative to the components directory), image size, create arguments
+TOOLS = (
+    ('mkspiffs', 'mkspiffs/mkspiffs', 8 * 1024 * 1024,
+     lambda src, img, size: ['-c', src, '-b', '4096', '-p', '256', '-s', str(size), img]),
+    ('mklfs', 'mklittlefs/mklfs', 8 * 1024 * 1024,
+     lambda src, img, size: ['-b', '4096', '-c', str(size // 4096), src, img]),
+    ('mkfatfs', 'mkfatfs/src/mkfatfs', 8 * 1024 * 1024,
+     lambda src, img, size: ['-c', src, '-s', str(size), img]),
+)
+
+# verification of the image content, by the tools which can unpack or list it
+UNPACK = {
+    'mklfs': lambda img, dst, size: ['-b', '4096', '-c', str(size // 4096), '-u', dst, img],
+}
+LIST = {
+    'mkspiffs': lambda img, size: ['-l', '-b', '4096', '-p', '256', '-s', str(size), img],
+}
+
+WORDS = ('machine', 'network', 'display', 'sensor', 'thread', 'socket', 'buffer', 'import',
+         'def', 'return', 'while', 'print', 'value', 'config', 'data', 'time')
+
+
+def make_file(rnd, path, size, text):
+    if text:
+        # compressible, like the python sources and html of the image
+        out = []
+        n = 0
+        while n < size:
+            w = rnd.choice(WORDS)
+            out.append(w)
+            n += len(w) + 1
+        data = ' '.join(out).encode()[:size]
+    else:
+        data = bytes(rnd.getrandbits(8) for _ in range(size))
+    with open(path, 'wb') as f:
+        f.write(data)
+
+
+def make_tree(root, n_files):
+    # the same files on every run
+    rnd = random.Random(1000)
+    n_dirs = max(1, n_files // 50)
+    files = []
+    for i in range(n_files):
+        d = os.path.join(root, 'd%02d' % (i % n_dirs))
+        os.makedirs(d, exist_ok=True)
+        text = (i % 3) != 0
+        name = os.path.join(d, 'f%04d.%s' % (i, 'txt' if text else 'bin'))
+        # mostly small files, some up to 16 KB
+        size = rnd.choice((64, 200, 512, 1000, 1500, 3000, 4096, 6000, 16000))
+        make_file(rnd, name, size, text)
+        files.append(name)
+    return files
+
+
+def change_tree(root, files):
+    # 10 files: 5 changed, 2 only touched, 1 removed, 2 new
+    rnd = random.Random(10)
+    later = int(EPOCH) + 3600
+    for name in files[5:10]:
+        with open(name, 'ab') as f:
+            f.write(b' changed')
+    for name in files[10:12]:
+        os.utime(name, (later, later))
+    os.remove(files[12])
+    for i in range(2):
+        make_file(rnd, os.path.join(root, 'd00', 'new%d.txt' % i), 2000, True)
+
+
+def run(tool, args):
+    env = dict(os.environ, SOURCE_DATE_EPOCH=EPOCH)
+    t = time.monotonic()
+    res = subprocess.run([tool] + args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, env=env)
+    t = (time.monotonic() - t) * 1000
+    out = res.stdout.decode(errors='replace')
+    if res.returncode != 0:
+        print(out)
+        raise RuntimeError('{} failed ({})'.format(os.path.basename(tool), res.returncode))
+    timing = [ln.strip() for ln in out.splitlines() if ln.startswith('Time:') or 'files, ' in ln]
+    return t, timing, out
+
+
+def same_tree(a, b):
+    cmp = filecmp.dircmp(a, b)
+    if cmp.left_only or cmp.right_only or cmp.funny_files:
+        return False
+    _, mismatch, errors = filecmp.cmpfiles(a, b, cmp.common_files, shallow=False)
+    if mismatch or errors:
+        return False
+    return all(same_tree(os.path.join(a, d), os.path.join(b, d)) for d in cmp.common_dirs)
+
+
+def same_list(root, listing):
+    # 'size<tab>/path' lines, the directories are listed with size 0
+    files = {}
+    for d, _, names in os.walk(root):
+        for n in names:
+            path = os.path.join(d, n)
+            files['/' + os.path.relpath(path, root)] = os.path.getsize(path)
+    listed = {}
+    for ln in listing.splitlines():
+        size, _, path = ln.partition('\t')
+        if size.isdigit() and not os.path.isdir(os.path.join(root, path.lstrip('/'))):
+            listed[path] = int(size)
+    return files == listed
+
+
+def report(label, t, timing):
+    print('  {:<28} {:9.1f} ms'.format(label, t))
+    for ln in timing:
+        print('      ' + ln)
+
+
+def bench(name, tool, size, create, work, src, files, jobs):
+    print('{} ({} files)'.format(name, len(files)))
+    img1 = os.path.join(work, name + '_j1.img')
+    imgn = os.path.join(work, name + '_jn.img')
+    imgi = os.path.join(work, name + '_incr.img')
+    manifest = os.path.join(work, name + '.manifest')
+
+    t, timing, _ = run(tool, create(src, img1, size) + ['-j', '1'])
+    report('new image, 1 thread', t, timing)
+    t, timing, _ = run(tool, create(src, imgn, size) + ['-j', str(jobs)])
+    report('new image, {} threads'.format(jobs), t, timing)
+    same = filecmp.cmp(img1, imgn, shallow=False)
+    print('  deterministic: {}'.format('yes' if same else 'NO'))
+
+    # the incremental build works on a copy of the tree, the same tree is used by the next tool
+    incr = os.path.join(work, name + '_src')
+    shutil.copytree(src, incr)
+    incr_files = [os.path.join(incr, os.path.relpath(f, src)) for f in files]
+    t, timing, _ = run(tool, create(incr, imgi, size) + ['-j', str(jobs), '-m', manifest])
+    report('new image with manifest', t, timing)
+    t, timing, _ = run(tool, create(incr, imgi, size) + ['-j', str(jobs), '-m', manifest])
+    report('incremental, no changes', t, timing)
+    change_tree(incr, incr_files)
+    t, timing, _ = run(tool, create(incr, imgi, size) + ['-j', str(jobs), '-m', manifest])
+    report('incremental, 10 changed', t, timing)
+
+    ok = same
+    verified = None
+    if name in UNPACK:
+        dst = os.path.join(work, name + '_unpacked')
+        run(tool, UNPACK[name](imgi, dst, size))
+        verified = same_tree(incr, dst)
+    elif name in LIST:
+        verified = same_list(incr, run(tool, LIST[name](imgi, size))[2])
+    if verified is not None:
+        print('  incremental image content: {}'.format('ok' if verified else 'DIFFERENT'))
+        ok = ok and verified
+    print()
+    return ok
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description='Benchmark of the host image builders')
+    parser.add_argument('--tools', default=os.path.join(here, '..', '..'),
+                        help='components directory with the built tools')
+    parser.add_argument('--files', type=int, default=1000, help='number of files to pack')
+    parser.add_argument('--jobs', type=int, default=os.cpu_count() or 1, help='number of threads (-j)')
+    parser.add_argument('--keep', help='work directory, kept after the benchmark')
+    args = parser.parse_args()
+
+    work = args.keep or tempfile.mkdtemp(prefix='mkfs_bench_')
+    if args.keep:
+        shutil.rmtree(work, ignore_errors=True)
+        os.makedirs(work)
+    try:
+        src = os.path.join(work, 'src')
+        files = make_tree(src, args.files)
+        total = sum(os.path.getsize(f) for f in files)
+        print('{} files, {} bytes, {} threads\n'.format(len(files), total, args.jobs))
+        ok = True
+        n_tools = 0
+        for name, path, size, create in TOOLS:
+            tool = os.path.join(args.tools, path)
+            if not os.access(tool, os.X_OK):
+                print('{}: not built ({})\n'.format(name, tool))
+                continue
+            n_tools += 1
+            ok = bench(name, tool, size, create, work, src, files, args.jobs) and ok
+    finally:
+        if not args.keep:
+            shutil.rmtree(work, ignore_errors=True)
+    if n_tools == 0 or not ok:
+        sys.exit(1)
+
+
+if __name__ == '__main__':
+    main()
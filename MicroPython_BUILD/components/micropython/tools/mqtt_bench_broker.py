@@ -0,0 +1,122 @@
+#!/usr/bin/env python3
+#
+# Local MQTT broker stand-in for testing the mqtt module publish throughput
+# (Mqtt.publish/publish_many, esp32/modules_examples/mqtt_bench.py)
+#
+# Minimal MQTT 3.1.1 server: accepts any client, acknowledges QoS1/QoS2
+# PUBLISH messages and SUBSCRIBE requests, answers PINGREQ. The messages are
+# not forwarded to the subscribers, only counted. The number of received
+# messages, bytes and socket reads is printed every second while messages
+# are arriving.
+# --ack-delay simulates the broker/network round trip for the acknowledges.
+#
+#   python3 mqtt_bench_broker.py                      # port 1883
+#   python3 mqtt_bench_broker.py --port 1883 --ack-delay 20
+
+import argparse
+import asyncio
+import time
+
+stats = {'messages': 0, 'bytes': 0, 'reads': 0, 'acks': 0}
+
+
+class Client(asyncio.Protocol):
+
+    def __init__(self, ack_delay):
+        self.ack_delay = ack_delay
+        self.buf = b''
+
+    def connection_made(self, transport):
+        self.transport = transport
+        print('client connected from {}'.format(transport.get_extra_info('peername')))
+
+    def connection_lost(self, exc):
+        print('client disconnected')
+
+    def send(self, data, delay=0):
+        if delay > 0:
+            asyncio.get_event_loop().call_later(delay, self.send, data)
+        elif not self.transport.is_closing():
+            self.transport.write(data)
+
+    def data_received(self, data):
+        stats['reads'] += 1
+        stats['bytes'] += len(data)
+        self.buf += data
+        while True:
+            # fixed header: type, remaining length (1-4 bytes)
+            n, mult, i = 0, 1, 1
+            while True:
+                if i >= len(self.buf):
+                    return
+                b = self.buf[i]
+                n += (b & 0x7f) * mult
+                mult *= 128
+                i += 1
+                if not b & 0x80:
+                    break
+            if len(self.buf) < i + n:
+                return
+            pkt, body = self.buf[0], self.buf[i:i + n]
+            self.buf = self.buf[i + n:]
+            self.packet(pkt >> 4, (pkt >> 1) & 3, body)
+
+    def packet(self, ptype, qos, body):
+        if ptype == 1:      # CONNECT
+            self.send(b'\x20\x02\x00\x00')
+        elif ptype == 3:    # PUBLISH
+            stats['messages'] += 1
+            if qos > 0:
+                tlen = (body[0] << 8) | body[1]
+                msg_id = body[2 + tlen:4 + tlen]
+                stats['acks'] += 1
+                self.send((b'\x40\x02' if qos == 1 else b'\x50\x02') + msg_id, self.ack_delay)
+        elif ptype == 6:    # PUBREL
+            self.send(b'\x70\x02' + body[:2])
+        elif ptype == 8:    # SUBSCRIBE
+            nt = 0
+            i = 2
+            while i < len(body):
+                i += 2 + ((body[i] << 8) | body[i + 1]) + 1
+                nt += 1
+            self.send(bytes([0x90, 2 + nt]) + body[:2] + b'\x00' * nt)
+        elif ptype == 10:   # UNSUBSCRIBE
+            self.send(b'\xb0\x02' + body[:2])
+        elif ptype == 12:   # PINGREQ
+            self.send(b'\xd0\x00')
+        elif ptype == 14:   # DISCONNECT
+            self.transport.close()
+
+
+async def report():
+    last = dict(stats)
+    while True:
+        await asyncio.sleep(1)
+        d = {k: stats[k] - last[k] for k in stats}
+        last = dict(stats)
+        if d['messages']:
+            print('{:7d} msg/s {:9d} bytes/s {:6d} reads/s ({:.1f} msg/read) {:6d} acks/s'.format(
+                d['messages'], d['bytes'], d['reads'], d['messages'] / max(d['reads'], 1), d['acks']))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='MQTT broker stand-in')
+    parser.add_argument('--port', type=int, default=1883)
+    parser.add_argument('--ack-delay', type=float, default=0, help='acknowledge delay in ms')
+    args = parser.parse_args()
+
+    loop = asyncio.new_event_loop()
+    asyncio.set_event_loop(loop)
+    server = loop.run_until_complete(loop.create_server(lambda: Client(args.ack_delay / 1000), '', args.port))
+    loop.create_task(report())
+    print('MQTT broker stand-in on port {}, ack delay {} ms'.format(args.port, args.ack_delay))
+    try:
+        loop.run_forever()
+    except KeyboardInterrupt:
+        pass
+    server.close()
+    print('{messages} messages, {bytes} bytes in {reads} reads'.format(**stats))
+
+
+if __name__ == '__main__':
+    main()
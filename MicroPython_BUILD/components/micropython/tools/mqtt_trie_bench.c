@@ -0,0 +1,195 @@
+/*
+ * Host test and benchmark of the MQTT topic trie (espmqtt/lib/mqtt_trie.c)
+ * used by the mqtt module for the per-subscription callbacks.
+ *
+ * Checks the '+' and '#' wildcard matching, then matches topics against
+ * 1000 subscription filters with the trie and with a linear scan of the
+ * filters (what the Python code in the data callback had to do).
+ *
+ *   gcc -O2 -I../../espmqtt/lib/include -o mqtt_trie_bench mqtt_trie_bench.c ../../espmqtt/lib/mqtt_trie.c
+ *   ./mqtt_trie_bench [filters] [topics]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mqtt_trie.h"
+
+static int errors = 0;
+
+static void count_cb(void *data, void *arg)
+{
+    (*(int *)arg)++;
+}
+
+static void sum_cb(void *data, void *arg)
+{
+    *(long *)arg += (long)(intptr_t)data;
+}
+
+// Reference matching of one filter, MQTT 3.1.1 rules
+static int filter_matches(const char *filter, const char *topic)
+{
+    if ((topic[0] == '$') && ((filter[0] == '+') || (filter[0] == '#'))) return 0;
+    while (1) {
+        if (filter[0] == '#') return 1;
+        if (filter[0] == '+') {
+            while (*topic && (*topic != '/')) topic++;
+            filter++;
+        }
+        else {
+            while (*filter && (*filter != '/') && (*filter == *topic)) { filter++; topic++; }
+            if ((*filter && (*filter != '/')) || (*topic && (*topic != '/'))) return 0;
+        }
+        if ((*filter == '\0') && (*topic == '\0')) return 1;
+        if (*filter == '\0') return 0;
+        // filter at '/'
+        if (*topic == '\0') return (strcmp(filter, "/#") == 0);
+        filter++;
+        topic++;
+    }
+}
+
+static void check(mqtt_trie_handle_t trie, const char *topic, int expected)
+{
+    int n = 0;
+    int res = mqtt_trie_match(trie, topic, strlen(topic), count_cb, &n);
+    if ((res != expected) || (n != expected)) {
+        printf("  FAIL: '%s' matched %d filters, expected %d\n", topic, res, expected);
+        errors++;
+    }
+}
+
+static void test_wildcards(void)
+{
+    static const char *filters[] = {
+        "sport/tennis/player1", "sport/tennis/player1/#", "sport/#", "#", "+/+", "/+", "+",
+        "sport/+/player1", "$SYS/#", "$SYS/+/info", "a//b", "a/+/+/d",
+    };
+    mqtt_trie_handle_t trie = mqtt_trie_init();
+    for (int i = 0; i < (int)(sizeof(filters) / sizeof(filters[0])); i++) {
+        if (mqtt_trie_insert(trie, filters[i], (void *)filters[i], NULL) != 0) {
+            printf("  FAIL: insert '%s'\n", filters[i]);
+            errors++;
+        }
+    }
+    // sport/tennis/player1: exact, player1/#, sport/#, #, sport/+/player1
+    check(trie, "sport/tennis/player1", 5);
+    // sport/tennis/player1/ranking: player1/#, sport/#, #
+    check(trie, "sport/tennis/player1/ranking", 3);
+    // sport: sport/#, #, +
+    check(trie, "sport", 3);
+    // sport/: sport/#, #, +/+
+    check(trie, "sport/", 3);
+    // /finance: #, +/+, /+
+    check(trie, "/finance", 3);
+    // $SYS/broker/info: $SYS/#, $SYS/+/info (not '#')
+    check(trie, "$SYS/broker/info", 2);
+    check(trie, "$SYS", 1);
+    // a//b: exact, #
+    check(trie, "a//b", 2);
+    check(trie, "a/x/y/d", 2);
+
+    // invalid filters
+    const char *invalid[] = { "", "a/#/b", "a#", "a/b+", "+a/b", "##" };
+    for (int i = 0; i < (int)(sizeof(invalid) / sizeof(invalid[0])); i++) {
+        if (mqtt_trie_insert(trie, invalid[i], (void *)1, NULL) == 0) {
+            printf("  FAIL: invalid filter '%s' accepted\n", invalid[i]);
+            errors++;
+        }
+    }
+    // replace and remove
+    void *old = NULL;
+    mqtt_trie_insert(trie, "sport/#", (void *)2, &old);
+    if (old != filters[2]) { printf("  FAIL: replace\n"); errors++; }
+    if (mqtt_trie_remove(trie, "sport/#") != (void *)2) { printf("  FAIL: remove\n"); errors++; }
+    if (mqtt_trie_remove(trie, "sport/#") != NULL) { printf("  FAIL: remove twice\n"); errors++; }
+    check(trie, "sport", 2);
+    for (int i = 0; i < (int)(sizeof(filters) / sizeof(filters[0])); i++) mqtt_trie_remove(trie, filters[i]);
+    if (mqtt_trie_count(trie) != 0) { printf("  FAIL: count after remove\n"); errors++; }
+    check(trie, "sport/tennis/player1", 0);
+    mqtt_trie_destroy(trie);
+}
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    int nfilters = (argc > 1) ? atoi(argv[1]) : 1000;
+    int ntopics = (argc > 2) ? atoi(argv[2]) : 100000;
+
+    printf("wildcard tests\n");
+    test_wildcards();
+
+    // filters: 80% exact, 15% with '+', 5% with '#'
+    char **filters = malloc(nfilters * sizeof(char *));
+    mqtt_trie_handle_t trie = mqtt_trie_init();
+    for (int i = 0; i < nfilters; i++) {
+        char buf[64];
+        if (i % 20 == 0) sprintf(buf, "site/%d/#", i / 20);
+        else if (i % 20 < 4) sprintf(buf, "site/%d/+/%d/temp", i / 20, i % 20);
+        else sprintf(buf, "site/%d/dev/%d/temp", i / 20, i % 20);
+        filters[i] = strdup(buf);
+        mqtt_trie_insert(trie, filters[i], (void *)(intptr_t)(i + 1), NULL);
+    }
+    // topics: about half of them match an exact filter
+    char **topics = malloc(ntopics * sizeof(char *));
+    srand(1);
+    for (int i = 0; i < ntopics; i++) {
+        char buf[64];
+        int s = rand() % (nfilters / 10);
+        if (rand() & 1) sprintf(buf, "site/%d/dev/%d/temp", s, rand() % 20);
+        else sprintf(buf, "other/%d/dev/%d/hum", s, rand() % 20);
+        topics[i] = strdup(buf);
+    }
+
+    // check the trie against the linear scan
+    for (int i = 0; i < ntopics; i += 97) {
+        long sum_trie = 0, sum_lin = 0;
+        mqtt_trie_match(trie, topics[i], strlen(topics[i]), sum_cb, &sum_trie);
+        for (int f = 0; f < nfilters; f++) {
+            if (filter_matches(filters[f], topics[i])) sum_lin += f + 1;
+        }
+        if (sum_trie != sum_lin) {
+            printf("  FAIL: '%s' trie %ld, linear %ld\n", topics[i], sum_trie, sum_lin);
+            errors++;
+        }
+    }
+
+    printf("%d filters, %d topics\n", nfilters, ntopics);
+    long matched = 0;
+    double t = now();
+    for (int i = 0; i < ntopics; i++) {
+        int n = 0;
+        mqtt_trie_match(trie, topics[i], strlen(topics[i]), count_cb, &n);
+        matched += n;
+    }
+    t = now() - t;
+    printf("  trie:   %8.3f s, %8.0f ns/topic, %ld matches\n", t, t * 1e9 / ntopics, matched);
+
+    matched = 0;
+    t = now();
+    for (int i = 0; i < ntopics; i++) {
+        for (int f = 0; f < nfilters; f++) {
+            if (filter_matches(filters[f], topics[i])) matched++;
+        }
+    }
+    t = now() - t;
+    printf("  linear: %8.3f s, %8.0f ns/topic, %ld matches\n", t, t * 1e9 / ntopics, matched);
+
+    mqtt_trie_destroy(trie);
+    for (int i = 0; i < nfilters; i++) free(filters[i]);
+    for (int i = 0; i < ntopics; i++) free(topics[i]);
+    free(filters);
+    free(topics);
+    printf("%s (%d errors)\n", (errors) ? "FAILED" : "OK", errors);
+    return (errors) ? 1 : 0;
+}
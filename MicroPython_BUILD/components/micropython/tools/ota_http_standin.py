@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#
+# HTTP stand-in for the OTA update host test (ota_pipeline_test.c)
+#
+# Serves the files of a directory, with Range requests (206 Partial Content),
+# at a limited data rate. A failure of the next image request can be armed with
+#   GET /arm?drop=N[&reset=1]   the connection is closed (or reset) after N body bytes
+#   GET /arm?norange=1          the Range header is ignored, the full file is sent (200)
+# so the interrupted downloads and the resume can be tested with the same url.
+#
+#   python3 ota_http_standin.py --port 8070 --dir /tmp/ota_test --rate 1500000
+
+import argparse
+import os
+import socket
+import struct
+import threading
+import time
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+armed = {}
+lock = threading.Lock()
+
+
+class Handler(BaseHTTPRequestHandler):
+    protocol_version = 'HTTP/1.1'
+
+    def log_message(self, fmt, *args):
+        print('ota_http_standin: ' + fmt % args, flush=True)
+
+    def do_GET(self):
+        global armed
+        url = urlparse(self.path)
+        if url.path == '/arm':
+            with lock:
+                armed = {k: int(v[0]) for k, v in parse_qs(url.query).items()}
+            self.reply(200, b'ok')
+            return
+        path = os.path.join(self.server.dir, os.path.basename(url.path))
+        if not os.path.isfile(path):
+            self.reply(404, b'not found')
+            return
+        with lock:
+            fail, armed = armed, {}
+        data = open(path, 'rb').read()
+        start = 0
+        rng = self.headers.get('Range')
+        if rng and rng.startswith('bytes=') and not fail.get('norange'):
+            start = int(rng[6:].split('-')[0])
+        if start >= len(data) and start > 0:
+            self.reply(416, b'')
+            return
+        self.send_response(206 if start else 200)
+        if start:
+            self.send_header('Content-Range', 'bytes {}-{}/{}'.format(start, len(data) - 1, len(data)))
+        self.send_header('Content-Length', str(len(data) - start))
+        self.send_header('Connection', 'close')
+        self.end_headers()
+        try:
+            self.send_body(data[start:], fail.get('drop', -1), fail.get('reset', 0))
+        except ConnectionError:
+            # the client stopped the download
+            pass
+        self.close_connection = True
+
+    def reply(self, code, body):
+        self.send_response(code)
+        self.send_header('Content-Length', str(len(body)))
+        self.send_header('Connection', 'close')
+        self.end_headers()
+        self.wfile.write(body)
+        self.close_connection = True
+
+    def send_body(self, data, drop, reset):
+        # in 4KB blocks at the data rate
+        begin = time.monotonic()
+        pos = 0
+        while pos < len(data):
+            n = min(4096, len(data) - pos)
+            if 0 <= drop < pos + n:
+                self.wfile.write(data[pos:drop])
+                self.wfile.flush()
+                if reset:
+                    # RST instead of FIN
+                    self.connection.setsockopt(socket.SOL_SOCKET, socket.SO_LINGER, struct.pack('ii', 1, 0))
+                self.connection.close()
+                return
+            self.wfile.write(data[pos:pos + n])
+            pos += n
+            if self.server.rate:
+                delay = begin + pos / self.server.rate - time.monotonic()
+                if delay > 0:
+                    time.sleep(delay)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='HTTP stand-in for the OTA update host test')
+    parser.add_argument('--port', type=int, default=8070)
+    parser.add_argument('--dir', required=True, help='directory of the served files')
+    parser.add_argument('--rate', type=int, default=0, help='data rate in bytes/s, 0: unlimited')
+    args = parser.parse_args()
+    server = ThreadingHTTPServer(('127.0.0.1', args.port), Handler)
+    server.dir = args.dir
+    server.rate = args.rate
+    server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
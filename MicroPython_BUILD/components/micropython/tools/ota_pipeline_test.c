@@ -0,0 +1,648 @@
+/*
+ * Host test of the OTA update pipeline (esp32/modota.c)
+ *
+ * modota.c is built unchanged, the update images are downloaded from an HTTP
+ * stand-in (ota_http_standin.py) on the loopback and written by the writer task
+ * to a fake flash in memory. The fake flash checks that only erased flash is
+ * written, the erase alignment and the 16-byte writes to an encrypted partition.
+ * Tested are the MD5/SHA-256 verification (also the '<url>.md5' file), the
+ * interrupted downloads (connection closed or reset) continued with a Range request,
+ * the fallback to a full download when the server ignores the Range, the gzip images,
+ * an image bigger than the partition, and that the NVS resume record is cleared when
+ * it is not valid anymore: on success, on a failure other than an interrupted
+ * download, for a gzip image and when the partition is written by another update.
+ * The benchmark downloads an image from a rate limited stand-in to a flash with
+ * simulated erase/write times, download and flash write must overlap.
+ *
+ *   gcc -O2 -funsigned-char -DNO_QSTR -DMICROPY_PY_UZLIB=1 -DCONFIG_MICROPY_USE_OTA -DCONFIG_LOG_DEFAULT_LEVEL=3 \
+ *       -DCONFIG_MICRO_PY_LOG_LEVEL=3 -DCONFIG_MICROPY_TASK_PRIORITY=5 -Ihost -I.. -I../esp32 -I../extmod \
+ *       -o ota_pipeline_test ota_pipeline_test.c host/host_stubs.c host/esp_http_client_host.c \
+ *       ../extmod/uzlib/tinflate.c ../extmod/uzlib/tinfgzip.c ../extmod/uzlib/crc32.c ../extmod/uzlib/adler32.c -lz -lcrypto -lpthread
+ *   ./ota_pipeline_test [-v]
+ * (run in this directory, the stand-ins use the TCP ports 8070 and 8071;
+ * char is unsigned, as with the Xtensa compiler)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "esp_system.h"
+
+// The module table of modota.c, not used by the test
+#define MP_QSTR___name__        1
+#define MP_QSTR_ota             2
+#define MP_QSTR_start           3
+#define MP_QSTR_fromfile        4
+#define MP_QSTR_set_bootpart    5
+#define MP_QSTR_url             6
+#define MP_QSTR_restart         7
+#define MP_QSTR_md5             8
+#define MP_QSTR_forceFactory    9
+#define MP_QSTR_certificate     10
+#define MP_QSTR_sha256          11
+#define MP_QSTR_resume          12
+#define MP_QSTR_file            13
+#define MP_QSTR_partition       14
+
+#include "modota.c"
+
+#define FAST_PORT   8070
+#define SLOW_PORT   8071
+#define SLOW_RATE   1500000         // bytes/s
+#define PART_SIZE   (1024 * 1024)
+#define IMAGE_DIR   "/tmp/ota_test"
+
+static int errors = 0;
+static int verbose = 0;
+static pid_t standins[2];
+
+#define CHECK(cond) do { if (!(cond)) { printf("  FAIL line %d: %s\n", __LINE__, #cond); errors++; } } while (0)
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// ==== Fake flash, the factory (running) and the OTA_0 (update) partitions ====
+
+static esp_partition_t partitions[2] = {
+    { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY, 0x010000, PART_SIZE, "MicroPython", false },
+    { ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x110000, PART_SIZE, "MicroPython_1", false },
+};
+static uint8_t flash[2][PART_SIZE];
+static const esp_partition_t *boot_partition = NULL;
+static int erase_us = 0;            // simulated erase time of a sector
+static int write_us = 0;            // simulated write time of 4KB
+static double flash_busy = 0;       // simulated erase and write time
+static int flash_errors = 0;        // not erased flash written, unaligned erase or encrypted write
+static uint32_t ota_handle_offset = 0;
+
+static uint8_t *part_mem(const esp_partition_t *partition)
+{
+    return flash[(partition == &partitions[0]) ? 0 : 1];
+}
+
+static void flash_delay(int us)
+{
+    if (us > 0) {
+        usleep(us);
+        flash_busy += us / 1e6;
+    }
+}
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype, const char *label)
+{
+    for (int i = 0; i < 2; i++) {
+        if ((partitions[i].subtype == subtype) && ((label == NULL) || (strcmp(label, partitions[i].label) == 0))) {
+            return &partitions[i];
+        }
+    }
+    return NULL;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t src_offset, void *dst, size_t size)
+{
+    if ((src_offset + size) > partition->size) return ESP_ERR_INVALID_SIZE;
+    memcpy(dst, part_mem(partition) + src_offset, size);
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dst_offset, const void *src, size_t size)
+{
+    if ((dst_offset + size) > partition->size) return ESP_ERR_INVALID_SIZE;
+    if ((partition->encrypted) && ((dst_offset & 15) || (size & 15))) {
+        printf("  flash: unaligned write to encrypted partition at 0x%zx, %zu bytes\n", dst_offset, size);
+        flash_errors++;
+        return ESP_ERR_INVALID_SIZE;
+    }
+    uint8_t *mem = part_mem(partition) + dst_offset;
+    for (size_t i = 0; i < size; i++) {
+        if (mem[i] != 0xFF) {
+            printf("  flash: write to not erased flash at 0x%zx\n", dst_offset + i);
+            flash_errors++;
+            break;
+        }
+    }
+    for (size_t i = 0; i < size; i++) mem[i] &= ((const uint8_t *)src)[i];
+    flash_delay((int)(((uint64_t)write_us * size) / 4096));
+    return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t start_addr, size_t size)
+{
+    if ((start_addr + size) > partition->size) return ESP_ERR_INVALID_SIZE;
+    if ((start_addr % SPI_FLASH_SEC_SIZE) || (size % SPI_FLASH_SEC_SIZE)) {
+        printf("  flash: unaligned erase at 0x%zx, %zu bytes\n", start_addr, size);
+        flash_errors++;
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(part_mem(partition) + start_addr, 0xFF, size);
+    flash_delay(erase_us * (int)(size / SPI_FLASH_SEC_SIZE));
+    return ESP_OK;
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    return &partitions[0];
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    return &partitions[1];
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    boot_partition = partition;
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    ota_handle_offset = 0;
+    *out_handle = 1;
+    return esp_partition_erase_range(partition, 0, partition->size);
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    esp_err_t err = esp_partition_write(&partitions[1], ota_handle_offset, data, size);
+    ota_handle_offset += size;
+    return err;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    return ESP_OK;
+}
+
+// ==== NVS in memory ====
+
+#define NVS_KEYS    8
+
+nvs_handle mpy_nvs_handle = 1;
+static struct {
+    char key[16];
+    uint32_t value;
+} nvs_table[NVS_KEYS];
+static int nvs_writes = 0;
+
+esp_err_t nvs_set_u32(nvs_handle handle, const char *key, uint32_t value)
+{
+    nvs_writes++;
+    for (int i = 0; i < NVS_KEYS; i++) {
+        if ((nvs_table[i].key[0] == '\0') || (strcmp(nvs_table[i].key, key) == 0)) {
+            strncpy(nvs_table[i].key, key, sizeof(nvs_table[i].key) - 1);
+            nvs_table[i].value = value;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NO_MEM;
+}
+
+esp_err_t nvs_get_u32(nvs_handle handle, const char *key, uint32_t *out_value)
+{
+    for (int i = 0; i < NVS_KEYS; i++) {
+        if (strcmp(nvs_table[i].key, key) == 0) {
+            *out_value = nvs_table[i].value;
+            return ESP_OK;
+        }
+    }
+    return ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle handle)
+{
+    return ESP_OK;
+}
+
+// Returns the saved resume offset, -1 if there is no resume record
+static int resume_record(void)
+{
+    uint32_t url_crc = 0, offset = 0;
+    if ((nvs_get_u32(mpy_nvs_handle, "OTA_ResURL", &url_crc) != ESP_OK) || (url_crc == 0)) return -1;
+    nvs_get_u32(mpy_nvs_handle, "OTA_ResOfs", &offset);
+    return offset;
+}
+
+// ==== mphalport and module functions, not used by the test ====
+
+const mp_print_t mp_plat_print = {NULL, NULL};
+const mp_obj_type_t mp_type_module;
+const mp_obj_type_t mp_type_dict;
+const mp_obj_type_t mp_type_fun_builtin_var;
+const mp_obj_type_t mp_type_str;
+const mp_obj_type_t mp_type_OSError;
+const struct _mp_obj_none_t { mp_obj_base_t base; } mp_const_none_obj;
+const struct _mp_obj_bool_t { mp_obj_base_t base; bool value; } mp_const_false_obj, mp_const_true_obj;
+
+void mp_hal_set_wdt_tmo() { }
+void mp_hal_reset_wdt() { }
+void mp_hal_stdout_tx_newline() { }
+
+int mp_printf(const mp_print_t *print, const char *fmt, ...)
+{
+    return 0;
+}
+
+void mp_arg_parse_all(size_t n_pos, const mp_obj_t *pos, mp_map_t *kws, size_t n_allowed, const mp_arg_t *allowed, mp_arg_val_t *out_vals)
+{
+}
+
+const char *mp_obj_str_get_str(mp_obj_t self_in)
+{
+    return NULL;
+}
+
+bool mp_obj_is_true(mp_obj_t arg)
+{
+    return false;
+}
+
+NORETURN void mp_raise_ValueError(const char *msg)
+{
+    abort();
+}
+
+mp_obj_t mp_obj_new_exception_msg(const mp_obj_type_t *exc_type, const char *msg)
+{
+    return MP_OBJ_NULL;
+}
+
+NORETURN void nlr_jump(void *val)
+{
+    abort();
+}
+
+void get_certificate(mp_obj_t cert, char *cert_pem_buf)
+{
+}
+
+int physicalPath(const char *path, char *ph_path)
+{
+    return -1;
+}
+
+void prepareSleepReset(uint8_t hrst, char *msg)
+{
+}
+
+void esp_restart(void)
+{
+}
+
+// ==== Test images ====
+
+typedef struct {
+    char name[32];
+    uint8_t *data;
+    int size;
+    char md5[33];
+    char sha256[65];
+} image_t;
+
+static void save_file(const char *name, const void *data, int size)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", IMAGE_DIR, name);
+    FILE *f = fopen(path, "wb");
+    fwrite(data, 1, size, f);
+    fclose(f);
+}
+
+// Firmware like image: random data and repeated strings, so that it can be compressed
+static void make_image(image_t *img, const char *name, int size, int seed)
+{
+    strcpy(img->name, name);
+    img->size = size;
+    img->data = malloc(size);
+    srand(seed);
+    for (int i = 0; i < size; i++) {
+        img->data[i] = ((i & 0x3ff) < 0x200) ? (rand() & 0xff) : "MicroPython OTA image "[i % 22];
+    }
+    img->data[0] = 0xE9;
+
+    unsigned char digest[32];
+    mbedtls_md5_context md5_ctx;
+    mbedtls_md5_init(&md5_ctx);
+    mbedtls_md5_starts(&md5_ctx);
+    mbedtls_md5_update(&md5_ctx, img->data, size);
+    mbedtls_md5_finish(&md5_ctx, digest);
+    mbedtls_md5_free(&md5_ctx);
+    ota_hex_digest(digest, 16, img->md5);
+    mbedtls_sha256_context sha_ctx;
+    mbedtls_sha256_init(&sha_ctx);
+    mbedtls_sha256_starts(&sha_ctx, 0);
+    mbedtls_sha256_update(&sha_ctx, img->data, size);
+    mbedtls_sha256_finish(&sha_ctx, digest);
+    mbedtls_sha256_free(&sha_ctx);
+    ota_hex_digest(digest, 32, img->sha256);
+
+    save_file(name, img->data, size);
+    char md5_name[40];
+    snprintf(md5_name, sizeof(md5_name), "%s.md5", name);
+    save_file(md5_name, img->md5, 32);
+}
+
+// gzip compressed copy of the image, with the 32KB window supported by the writer
+static void make_gzip(const image_t *img, const char *name)
+{
+    z_stream zs = {0};
+    uLong max = compressBound(img->size) + 64;
+    uint8_t *out = malloc(max);
+    deflateInit2(&zs, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    zs.next_in = img->data;
+    zs.avail_in = img->size;
+    zs.next_out = out;
+    zs.avail_out = max;
+    deflate(&zs, Z_FINISH);
+    save_file(name, out, zs.total_out);
+    deflateEnd(&zs);
+    free(out);
+}
+
+static int partition_matches(const image_t *img)
+{
+    return memcmp(flash[1], img->data, img->size) == 0;
+}
+
+// ==== HTTP stand-ins ====
+
+static pid_t start_standin(int port, int rate)
+{
+    char port_s[16], rate_s[16];
+    snprintf(port_s, sizeof(port_s), "%d", port);
+    snprintf(rate_s, sizeof(rate_s), "%d", rate);
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!verbose) {
+            freopen("/dev/null", "w", stdout);
+            freopen("/dev/null", "w", stderr);
+        }
+        execlp("python3", "python3", "ota_http_standin.py", "--port", port_s, "--dir", IMAGE_DIR, "--rate", rate_s, NULL);
+        perror("python3");
+        _exit(1);
+    }
+    return pid;
+}
+
+static void stop_standins(void)
+{
+    for (int i = 0; i < 2; i++) {
+        if (standins[i] > 0) {
+            kill(standins[i], SIGTERM);
+            waitpid(standins[i], NULL, 0);
+            standins[i] = 0;
+        }
+    }
+}
+
+static int http_get(const char *url)
+{
+    esp_http_client_config_t config = { .url = url };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    int status = -1;
+    if ((client) && (esp_http_client_open(client, 0) == ESP_OK) && (esp_http_client_fetch_headers(client) >= 0)) {
+        status = esp_http_client_get_status_code(client);
+    }
+    esp_http_client_cleanup(client);
+    return status;
+}
+
+static void wait_standin(int port)
+{
+    char url[64];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/arm", port);
+    for (int i = 0; i < 100; i++) {
+        if (http_get(url) == 200) return;
+        usleep(50000);
+    }
+    printf("HTTP stand-in on port %d not started\n", port);
+    stop_standins();
+    exit(1);
+}
+
+// Arm a failure of the next image request
+static void arm(const char *query)
+{
+    char url[96];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/arm?%s", FAST_PORT, query);
+    CHECK(http_get(url) == 200);
+}
+
+// ==== Tests ====
+
+static char *image_url(const char *name)
+{
+    static char url[96];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/%s", FAST_PORT, name);
+    return url;
+}
+
+// Runs the update, returns the response body bytes read
+static uint32_t update(const char *name, bool md5_fetch, const char *md5, const char *sha256, bool resume, esp_err_t *res)
+{
+    uint32_t rx = host_http_rx_bytes;
+    boot_partition = NULL;
+    *res = mpy_ota_update(image_url(name), md5_fetch, md5, sha256, resume, 0);
+    return host_http_rx_bytes - rx;
+}
+
+static void test_verified(const image_t *img, const image_t *other)
+{
+    printf("checksums\n");
+    esp_err_t res;
+    int writes = nvs_writes;
+    uint32_t rx = update(img->name, false, img->md5, img->sha256, false, &res);
+    CHECK(res == ESP_OK);
+    CHECK(rx == img->size);
+    CHECK(partition_matches(img));
+    CHECK(boot_partition == &partitions[1]);
+    CHECK(nvs_writes == writes);
+
+    // '<url>.md5' file
+    update(img->name, true, NULL, NULL, false, &res);
+    CHECK(res == ESP_OK);
+    CHECK(boot_partition == &partitions[1]);
+
+    update(img->name, false, other->md5, NULL, false, &res);
+    CHECK(res != ESP_OK);
+    CHECK(boot_partition == NULL);
+
+    update(img->name, false, NULL, other->sha256, true, &res);
+    CHECK(res != ESP_OK);
+    CHECK(boot_partition == NULL);
+    CHECK(resume_record() < 0);
+}
+
+static void test_resume(const image_t *img, const char *query)
+{
+    printf("resume after %s\n", query);
+    esp_err_t res;
+    arm(query);
+    update(img->name, false, NULL, img->sha256, true, &res);
+    CHECK(res != ESP_OK);
+    CHECK(boot_partition == NULL);
+    int ofs = resume_record();
+    CHECK((ofs > 0) && (ofs <= 300000) && ((ofs % SPI_FLASH_SEC_SIZE) == 0));
+
+    uint32_t rx = update(img->name, false, NULL, img->sha256, true, &res);
+    CHECK(res == ESP_OK);
+    CHECK(rx == (img->size - ofs));
+    CHECK(partition_matches(img));
+    CHECK(boot_partition == &partitions[1]);
+    CHECK(resume_record() < 0);
+}
+
+static void test_no_range(const image_t *img)
+{
+    printf("resume ignored by the server\n");
+    esp_err_t res;
+    arm("drop=300000");
+    update(img->name, false, NULL, NULL, true, &res);
+    CHECK(res != ESP_OK);
+    CHECK(resume_record() > 0);
+
+    arm("norange=1");
+    uint32_t rx = update(img->name, false, img->md5, NULL, true, &res);
+    CHECK(res == ESP_OK);
+    CHECK(rx == img->size);
+    CHECK(partition_matches(img));
+    CHECK(resume_record() < 0);
+}
+
+// The record is cleared when the partition is written by another update
+static void test_stale_record(const image_t *img, const image_t *other, const char *gz_name)
+{
+    printf("stale resume record\n");
+    esp_err_t res;
+
+    // gzip image
+    arm("drop=300000");
+    update(img->name, false, NULL, NULL, true, &res);
+    CHECK(resume_record() > 0);
+    update(gz_name, false, NULL, other->sha256, true, &res);
+    CHECK(res == ESP_OK);
+    CHECK(partition_matches(other));
+    CHECK(resume_record() < 0);
+    uint32_t rx = update(img->name, false, NULL, img->sha256, true, &res);
+    CHECK(res == ESP_OK);
+    CHECK(rx == img->size);
+    CHECK(partition_matches(img));
+
+    // interrupted gzip download, no resume point is saved
+    arm("drop=100000");
+    update(gz_name, false, NULL, other->sha256, true, &res);
+    CHECK(res != ESP_OK);
+    CHECK(resume_record() < 0);
+
+    // update without resume
+    arm("drop=300000");
+    update(img->name, false, NULL, NULL, true, &res);
+    CHECK(resume_record() > 0);
+    update(other->name, false, NULL, other->sha256, false, &res);
+    CHECK(res == ESP_OK);
+    CHECK(resume_record() < 0);
+
+    // update from file
+    arm("drop=300000");
+    update(img->name, false, NULL, NULL, true, &res);
+    CHECK(resume_record() > 0);
+    char path[128];
+    snprintf(path, sizeof(path), "%s/%s", IMAGE_DIR, img->name);
+    CHECK(mpy_ota_fileupdate(path, 0) == ESP_OK);
+    CHECK(partition_matches(img));
+    CHECK(resume_record() < 0);
+}
+
+static void test_too_big(const image_t *img)
+{
+    printf("image bigger than the partition\n");
+    esp_err_t res;
+    partitions[1].size = 512 * 1024;
+    update(img->name, false, NULL, NULL, true, &res);
+    CHECK(res != ESP_OK);
+    CHECK(boot_partition == NULL);
+    CHECK(resume_record() < 0);
+    partitions[1].size = PART_SIZE;
+}
+
+static void test_encrypted(const image_t *img, const char *gz_name)
+{
+    printf("encrypted partition\n");
+    esp_err_t res;
+    partitions[1].encrypted = true;
+    update(img->name, false, NULL, img->sha256, false, &res);
+    CHECK(res == ESP_OK);
+    CHECK(partition_matches(img));
+    update(gz_name, false, NULL, img->sha256, false, &res);
+    CHECK(res == ESP_OK);
+    CHECK(partition_matches(img));
+    partitions[1].encrypted = false;
+}
+
+static void test_pipeline(const image_t *img)
+{
+    erase_us = 2000;
+    write_us = 1000;
+    flash_busy = 0;
+    esp_err_t res;
+    char url[96];
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/%s", SLOW_PORT, img->name);
+    double t0 = now();
+    res = mpy_ota_update(url, false, NULL, img->sha256, false, 0);
+    double t = now() - t0;
+    double download = (double)img->size / SLOW_RATE;
+    printf("pipeline: %d bytes, download %.3f s, flash erase/write %.3f s, update %.3f s (%.0f%% of sequential)\n",
+           img->size, download, flash_busy, t, t * 100 / (download + flash_busy));
+    CHECK(res == ESP_OK);
+    CHECK(partition_matches(img));
+    CHECK(t < (0.8 * (download + flash_busy)));
+    erase_us = 0;
+    write_us = 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if ((argc > 1) && (strcmp(argv[1], "-v") == 0)) verbose = 1;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    // modota.c logs to stderr
+    if (!verbose) freopen("/dev/null", "w", stderr);
+
+    mkdir(IMAGE_DIR, 0755);
+    image_t img, img2, small;
+    make_image(&img, "image.bin", 768 * 1024 + 333, 1);
+    make_image(&img2, "image2.bin", 600 * 1024 + 77, 2);
+    make_image(&small, "small.bin", 200003, 3);
+    make_gzip(&img2, "image2.gz");
+    make_gzip(&small, "small.gz");
+
+    standins[0] = start_standin(FAST_PORT, 0);
+    standins[1] = start_standin(SLOW_PORT, SLOW_RATE);
+    wait_standin(FAST_PORT);
+    wait_standin(SLOW_PORT);
+
+    test_verified(&img, &img2);
+    test_resume(&img, "drop=300000");
+    test_resume(&img, "drop=300000&reset=1");
+    test_no_range(&img);
+    test_stale_record(&img, &img2, "image2.gz");
+    test_too_big(&img);
+    test_encrypted(&small, "small.gz");
+    CHECK(flash_errors == 0);
+    test_pipeline(&img);
+
+    stop_standins();
+    printf("%s\n", (errors) ? "FAILED" : "all tests passed");
+    return (errors) ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+#!/usr/bin/env python3
+#
+# Peer for the ESP32 socket receive benchmark (esp32/modules_examples/socket_bench.py)
+#
+# UDP: on a 'send <count> <size>' request datagram, sends <count> datagrams of
+#      <size> bytes back to the requester as fast as possible, or paced to
+#      --rate datagrams per second.
+# TCP: on connect, reads the requested byte count (ASCII line) and streams
+#      that many bytes.
+#
+#   python3 socket_bench_server.py                  # UDP and TCP on port 5005
+#   python3 socket_bench_server.py --rate 5000
+
+import argparse
+import socket
+import threading
+import time
+
+
+def udp_server(port, rate):
+    s = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.bind(('', port))
+    while True:
+        req, addr = s.recvfrom(64)
+        try:
+            cmd, count, size = req.decode().split()
+            count, size = int(count), int(size)
+        except ValueError:
+            continue
+        if cmd != 'send':
+            continue
+        # a small delay lets the device enter the receive loop
+        time.sleep(0.1)
+        data = bytearray(size)
+        t = time.perf_counter()
+        for i in range(count):
+            data[0:4] = i.to_bytes(4, 'little')
+            s.sendto(data, addr)
+            if rate:
+                while time.perf_counter() - t < (i + 1) / rate:
+                    pass
+        t = time.perf_counter() - t
+        print('UDP {}: sent {} x {} bytes, {:.0f} datagrams/s'.format(addr[0], count, size, count / t))
+
+
+def tcp_client(conn, addr):
+    with conn:
+        line = b''
+        while not line.endswith(b'\n'):
+            data = conn.recv(32)
+            if not data:
+                return
+            line += data
+        size = int(line)
+        block = bytes(i & 0xff for i in range(4096))
+        t = time.perf_counter()
+        sent = 0
+        while sent < size:
+            n = min(len(block), size - sent)
+            conn.sendall(block[:n])
+            sent += n
+        t = time.perf_counter() - t
+        print('TCP {}: sent {} bytes, {:.1f} KB/s'.format(addr[0], sent, sent / t / 1024))
+
+
+def tcp_server(port):
+    s = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    s.bind(('', port))
+    s.listen(2)
+    while True:
+        conn, addr = s.accept()
+        threading.Thread(target=tcp_client, args=(conn, addr), daemon=True).start()
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32 socket benchmark peer')
+    parser.add_argument('--port', type=int, default=5005)
+    parser.add_argument('--rate', type=int, default=0, help='UDP datagrams per second, 0 = unlimited')
+    args = parser.parse_args()
+    threading.Thread(target=udp_server, args=(args.port, args.rate), daemon=True).start()
+    print('Listening on UDP and TCP port {}'.format(args.port))
+    tcp_server(args.port)
+
+
+if __name__ == '__main__':
+    main()
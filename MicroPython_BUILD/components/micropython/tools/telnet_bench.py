@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+#
+# Output throughput benchmark for the ESP32 telnet server (network.telnet)
+#
+# Logs in to the telnet REPL, prints --size bytes on the device (100 byte lines)
+# and measures the time to receive them. The TX counters of the telnet server
+# (network.telnet.stats()) are read before and after to show how the output
+# was coalesced into send() calls and TCP segments.
+#
+#   python3 telnet_bench.py 192.168.0.20
+#   python3 telnet_bench.py 192.168.0.20 --size 200000 --user micro --password python
+#
+# Start the server on the ESP32 first:
+#   network.telnet.start(user="micro", password="python")
+
+import argparse
+import ast
+import socket
+import time
+
+END = b'@@END@@'
+
+
+def read_until(s, token, buf=b''):
+    while token not in buf:
+        data = s.recv(65536)
+        if not data:
+            raise EOFError('connection closed')
+        buf += data
+    return buf
+
+
+def command(s, cmd):
+    s.sendall(cmd.encode() + b'\r')
+    # the marker is built on the device so that the echoed command doesn't match it
+    s.sendall(b"print('@@'+'END@@')\r")
+    return read_until(s, END + b'\r\n')
+
+
+def main():
+    parser = argparse.ArgumentParser(description='ESP32 telnet server output benchmark')
+    parser.add_argument('host')
+    parser.add_argument('--port', type=int, default=23)
+    parser.add_argument('--user', default='micro')
+    parser.add_argument('--password', default='python')
+    parser.add_argument('--size', type=int, default=100 * 1024)
+    args = parser.parse_args()
+
+    s = socket.create_connection((args.host, args.port), timeout=30)
+    # the server discards the input received before the prompt is sent
+    read_until(s, b'Login as: ')
+    time.sleep(0.3)
+    s.sendall(args.user.encode() + b'\r')
+    read_until(s, b'Password: ')
+    time.sleep(0.3)
+    s.sendall(args.password.encode() + b'\r')
+    read_until(s, b'>>> ')
+
+    command(s, 'import network; _st = network.telnet.stats()')
+    lines = (args.size + 99) // 100
+    t = time.time()
+    out = command(s, "for _i in range({}): print('%099d' % _i)".format(lines))
+    t = time.time() - t
+    out = command(s, 'print(network.telnet.stats(), _st)')
+    st = out[:out.rindex(END)].split(b'print(network.telnet.stats(), _st)')[-1]
+    st = st[st.index(b'('):st.rindex(b')') + 1].decode()
+    st1, st0 = ast.literal_eval('[' + st.replace(') (', '), (') + ']')
+    s.close()
+
+    d = [a - b for a, b in zip(st1, st0)]
+    print('telnet benchmark, {}:{}, {} lines of 100 bytes'.format(args.host, args.port, lines))
+    print('  received {:9d} bytes in {:7.3f} s, {:8.1f} KB/s'.format(lines * 100, t, lines * 100 / t / 1024))
+    print('  device:  {:9d} bytes, {} sends, {} segments, {:.0f} segments/s, {} dropped'.format(
+        d[0], d[1], d[2], d[2] / t, d[3]))
+
+
+if __name__ == '__main__':
+    main()
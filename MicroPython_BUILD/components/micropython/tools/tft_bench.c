@@ -0,0 +1,416 @@
+/*
+ * Host rendering benchmark and golden image test of the tft library (esp32/libs/tft/tft.c)
+ *
+ * tft.c is built unchanged and draws through the in-memory panel backend
+ * (host/tftspi_host.c). For every test one frame is drawn and its transfers
+ * to the display are counted: pixel data transactions, address window
+ * changes and the SPI bytes the display would get. Then the frame is drawn
+ * repeatedly to measure the primitives per second (host CPU time, the SPI
+ * transfer time is not included, see the byte counts for that). The file
+ * reads and seeks of the image decoders are counted with the linker's --wrap.
+ * JPEG images are decoded with libjpeg behind the ROM decoder API (host/tjpgd_host.c),
+ * the BMP (24-bit bottom-up and top-down, 8-bit palette) and JPEG test images
+ * are generated in /tmp.
+ *
+ *   gcc -O2 -DNO_QSTR -DCONFIG_MICROPY_USE_TFT -Ihost -I.. -I../esp32 -I../esp32/libs/tft -o tft_bench \
+ *       tft_bench.c ../esp32/libs/tft/tft.c ../esp32/libs/tft/DefaultFont.c ../esp32/libs/tft/DejaVuSans18.c \
+ *       ../esp32/libs/tft/DejaVuSans24.c ../esp32/libs/tft/SmallFont.c ../esp32/libs/tft/Ubuntu16.c \
+ *       ../esp32/libs/tft/comic24.c ../esp32/libs/tft/def_small.c ../esp32/libs/tft/minya24.c \
+ *       ../esp32/libs/tft/tooney32.c host/tftspi_host.c host/tjpgd_host.c host/host_stubs.c \
+ *       -Wl,--wrap=fread,--wrap=fseek -ljpeg -lm -lpthread
+ *   ./tft_bench [-t seconds] [-a] [-w dir] [-c dir] [test ...]
+ *
+ *   -t  minimal measuring time of each test, default 0.5 s
+ *   -a  antialiased edges of the filled arcs, ellipses, polygons and stars
+ *   -w  write the frames of the tests as dir/<test>.ppm (golden images)
+ *   -c  compare the frames with dir/<test>.ppm, exit code 1 if any differs
+ *
+ * To compare with an older version of the drawing code, build with it instead of tft.c, e.g.
+ *   git show <commit>:MicroPython_BUILD/components/micropython/esp32/libs/tft/tft.c > /tmp/tft_old.c
+ * and build with /tmp/tft_old.c in place of ../esp32/libs/tft/tft.c; add -DTFT_BENCH_NO_SPANS
+ * for the versions before the span rasterizer (no TFT_drawStar() and antialiasing).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <jpeglib.h>
+
+#include "tft.h"
+#include "tft_panel_mem.h"
+
+#define BENCH_WIDTH     320
+#define BENCH_HEIGHT    240
+#define JPG_FILE        "/tmp/tft_bench.jpg"
+#define BMP_FILE        "/tmp/tft_bench.bmp"
+#define BMP8_FILE       "/tmp/tft_bench8.bmp"
+#define BMP_TD_FILE     "/tmp/tft_bench_td.bmp"
+
+typedef struct {
+    const char *name;
+    int ops;                // primitives drawn in one frame
+    void (*draw)(int i);    // draw the primitive 'i' of the frame
+} bench_test_t;
+
+static uint32_t rnd_state;
+static uint32_t file_ops;
+static uint8_t *bmp_mem;
+static int bmp_mem_size;
+
+size_t __real_fread(void *ptr, size_t size, size_t n, FILE *f);
+int __real_fseek(FILE *f, long offset, int whence);
+
+size_t __wrap_fread(void *ptr, size_t size, size_t n, FILE *f)
+{
+    file_ops++;
+    return __real_fread(ptr, size, n, f);
+}
+
+int __wrap_fseek(FILE *f, long offset, int whence)
+{
+    file_ops++;
+    return __real_fseek(f, offset, whence);
+}
+
+static uint32_t rnd(uint32_t n)
+{
+    rnd_state = rnd_state * 1103515245 + 12345;
+    return (rnd_state >> 8) % n;
+}
+
+static color_t rnd_color(void)
+{
+    return (color_t){rnd(256), rnd(256), rnd(256)};
+}
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+// ==== Tests ====
+
+static void draw_text(int i)
+{
+    TFT_setFont((i & 1) ? DEJAVU18_FONT : DEFAULT_FONT, NULL);
+    _fg = rnd_color();
+    TFT_print("The quick brown fox jumps 0123456789", 0, i * 20);
+}
+
+static void draw_lines(int i)
+{
+    color_t c = rnd_color();
+    int x0 = rnd(BENCH_WIDTH), y0 = rnd(BENCH_HEIGHT);
+    TFT_drawLine(x0, y0, rnd(BENCH_WIDTH), rnd(BENCH_HEIGHT), c);
+}
+
+static void draw_rects(int i)
+{
+    color_t c = rnd_color();
+    int x = rnd(BENCH_WIDTH - 60), y = rnd(BENCH_HEIGHT - 40);
+    TFT_fillRect(x, y, 60, 40, c);
+}
+
+static void draw_screen(int i)
+{
+    TFT_fillScreen(rnd_color());
+}
+
+static void draw_circles(int i)
+{
+    color_t c = rnd_color();
+    int x = 40 + rnd(BENCH_WIDTH - 80), y = 40 + rnd(BENCH_HEIGHT - 80);
+    TFT_fillCircle(x, y, 40, c);
+}
+
+static void draw_arc(int i)
+{
+    // gauge: thick arc with outline
+    TFT_drawArc(160, 120, 110, 24, 30, 330, TFT_WHITE, TFT_ORANGE);
+}
+
+static void draw_ellipse(int i)
+{
+    TFT_fillEllipse(160, 120, 140, 90, TFT_CYAN, 15);
+}
+
+static void draw_polygon(int i)
+{
+    TFT_drawPolygon(160, 120, 7, 100, TFT_YELLOW, TFT_BLUE, 10, 2);
+}
+
+#ifndef TFT_BENCH_NO_SPANS
+static void draw_star(int i)
+{
+    TFT_drawStar(160, 120, 100, TFT_RED, TFT_GREEN, 0, 2.5);
+}
+#endif
+
+static void draw_jpg(int i)
+{
+    TFT_jpg_image(0, 0, 0, JPG_FILE, NULL, 0);
+}
+
+static void draw_jpg_half(int i)
+{
+    TFT_jpg_image(CENTER, CENTER, 1, JPG_FILE, NULL, 0);
+}
+
+static void draw_bmp(int i)
+{
+    TFT_bmp_image(0, 0, 0, BMP_FILE, NULL, 0);
+}
+
+static void draw_bmp_half(int i)
+{
+    TFT_bmp_image(CENTER, CENTER, 1, BMP_FILE, NULL, 0);
+}
+
+static void draw_bmp_third(int i)
+{
+    TFT_bmp_image(CENTER, CENTER, 2, BMP_FILE, NULL, 0);
+}
+
+static void draw_bmp_clip(int i)
+{
+    // clipped on all sides
+    TFT_bmp_image(-40, -30, 0, BMP_FILE, NULL, 0);
+    TFT_bmp_image(200, 150, 0, BMP_FILE, NULL, 0);
+}
+
+static void draw_bmp8(int i)
+{
+    TFT_bmp_image(0, 0, 0, BMP8_FILE, NULL, 0);
+}
+
+static void draw_bmp_topdown(int i)
+{
+    TFT_bmp_image(0, 0, 0, BMP_TD_FILE, NULL, 0);
+}
+
+static void draw_bmp_mem(int i)
+{
+    TFT_bmp_image(0, 0, 0, NULL, bmp_mem, bmp_mem_size);
+}
+
+static const bench_test_t tests[] = {
+    {"text",        10,     draw_text},
+    {"lines",       100,    draw_lines},
+    {"rects",       50,     draw_rects},
+    {"fillscreen",  1,      draw_screen},
+    {"circles",     10,     draw_circles},
+    {"arc",         1,      draw_arc},
+    {"ellipse",     1,      draw_ellipse},
+    {"polygon",     1,      draw_polygon},
+#ifndef TFT_BENCH_NO_SPANS
+    {"star",        1,      draw_star},
+#endif
+    {"jpeg",        1,      draw_jpg},
+    {"jpeg_half",   1,      draw_jpg_half},
+    {"bmp",         1,      draw_bmp},
+    {"bmp_half",    1,      draw_bmp_half},
+    {"bmp_third",   1,      draw_bmp_third},
+    {"bmp_clip",    1,      draw_bmp_clip},
+    {"bmp8",        1,      draw_bmp8},
+    {"bmp_topdown", 1,      draw_bmp_topdown},
+    {"bmp_mem",     1,      draw_bmp_mem},
+};
+
+// ==== Test images ====
+
+static void image_pixel(int x, int y, uint8_t *rgb)
+{
+    rgb[0] = (x * 255) / BENCH_WIDTH;
+    rgb[1] = (y * 255) / BENCH_HEIGHT;
+    rgb[2] = (((x / 20) + (y / 20)) & 1) ? 220 : 40;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+// 24-bit or 8-bit image with the 3-3-2 RGB palette, bottom-up or top-down
+static int write_bmp(const char *fname, int bpp, int top_down)
+{
+    int ncolors = (bpp == 8) ? 256 : 0;
+    int row_size = ((BENCH_WIDTH * bpp / 8) + 3) & ~3;
+    uint32_t img_pos = 54 + ncolors * 4;
+    uint8_t hdr[54] = {'B', 'M'};
+    put32(hdr + 2, img_pos + row_size * BENCH_HEIGHT);
+    put32(hdr + 10, img_pos);
+    put32(hdr + 14, 40);
+    put32(hdr + 18, BENCH_WIDTH);
+    put32(hdr + 22, (top_down) ? -BENCH_HEIGHT : BENCH_HEIGHT);
+    hdr[26] = 1;
+    hdr[28] = bpp;
+    put32(hdr + 46, ncolors);
+    FILE *f = fopen(fname, "wb");
+    if (f == NULL) return -1;
+    fwrite(hdr, 1, sizeof(hdr), f);
+    for (int i = 0; i < ncolors; i++) {
+        uint8_t bgrx[4] = {((i & 3) * 255) / 3, (((i >> 2) & 7) * 255) / 7, ((i >> 5) * 255) / 7, 0};
+        fwrite(bgrx, 1, 4, f);
+    }
+    uint8_t *row = calloc(1, row_size);
+    for (int n = 0; n < BENCH_HEIGHT; n++) {
+        int y = (top_down) ? n : BENCH_HEIGHT - 1 - n;
+        for (int x = 0; x < BENCH_WIDTH; x++) {
+            uint8_t rgb[3];
+            image_pixel(x, y, rgb);
+            if (bpp == 8) row[x] = (rgb[0] & 0xE0) | ((rgb[1] >> 3) & 0x1C) | (rgb[2] >> 6);
+            else {
+                row[x*3] = rgb[2];
+                row[x*3 + 1] = rgb[1];
+                row[x*3 + 2] = rgb[0];
+            }
+        }
+        fwrite(row, 1, row_size, f);
+    }
+    free(row);
+    return fclose(f);
+}
+
+static int load_file(const char *fname, uint8_t **buf, int *size)
+{
+    FILE *f = fopen(fname, "rb");
+    if (f == NULL) return -1;
+    fseek(f, 0, SEEK_END);
+    *size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    *buf = malloc(*size);
+    int res = ((*buf) && (fread(*buf, 1, *size, f) == *size)) ? 0 : -1;
+    fclose(f);
+    return res;
+}
+
+static int write_jpg(const char *fname)
+{
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+    FILE *f = fopen(fname, "wb");
+    if (f == NULL) return -1;
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_compress(&cinfo);
+    jpeg_stdio_dest(&cinfo, f);
+    cinfo.image_width = BENCH_WIDTH;
+    cinfo.image_height = BENCH_HEIGHT;
+    cinfo.input_components = 3;
+    cinfo.in_color_space = JCS_RGB;
+    jpeg_set_defaults(&cinfo);
+    jpeg_set_quality(&cinfo, 85, TRUE);
+    jpeg_start_compress(&cinfo, TRUE);
+    uint8_t row[BENCH_WIDTH * 3];
+    while (cinfo.next_scanline < cinfo.image_height) {
+        for (int x = 0; x < BENCH_WIDTH; x++) image_pixel(x, cinfo.next_scanline, row + x*3);
+        JSAMPROW p = row;
+        jpeg_write_scanlines(&cinfo, &p, 1);
+    }
+    jpeg_finish_compress(&cinfo);
+    jpeg_destroy_compress(&cinfo);
+    return fclose(f);
+}
+
+// ==== Benchmark ====
+
+static void draw_frame(const bench_test_t *test)
+{
+    rnd_state = 1;
+    TFT_resetclipwin();
+    _fg = TFT_WHITE;
+    _bg = TFT_BLACK;
+    for (int i = 0; i < test->ops; i++) test->draw(i);
+}
+
+int main(int argc, char **argv)
+{
+    double min_time = 0.5;
+    const char *write_dir = NULL;
+    const char *compare_dir = NULL;
+    int argi = 1;
+    for (; argi < argc; argi++) {
+        if ((strcmp(argv[argi], "-t") == 0) && (argi + 1 < argc)) min_time = atof(argv[++argi]);
+        #ifndef TFT_BENCH_NO_SPANS
+        else if (strcmp(argv[argi], "-a") == 0) tft_antialias = 1;
+        #endif
+        else if ((strcmp(argv[argi], "-w") == 0) && (argi + 1 < argc)) write_dir = argv[++argi];
+        else if ((strcmp(argv[argi], "-c") == 0) && (argi + 1 < argc)) compare_dir = argv[++argi];
+        else break;
+    }
+
+    if ((write_bmp(BMP_FILE, 24, 0) != 0) || (write_bmp(BMP8_FILE, 8, 0) != 0) || (write_bmp(BMP_TD_FILE, 24, 1) != 0) ||
+            (load_file(BMP_FILE, &bmp_mem, &bmp_mem_size) != 0) || (write_jpg(JPG_FILE) != 0)) {
+        printf("Can't write the test images\n");
+        return 2;
+    }
+    if (tft_mem_init(BENCH_WIDTH, BENCH_HEIGHT, 16) != 0) return 2;
+    TFT_setPanel(&tft_mem_panel);
+    tft_active_mode = TFT_MODE_TFT;
+    orientation = LANDSCAPE;
+    font_rotate = 0;
+    font_transparent = 0;
+    text_wrap = 0;
+
+    #ifndef TFT_BENCH_NO_SPANS
+    printf("Display %dx%d, %d bits per color%s\n\n", _width, _height, bits_per_color, (tft_antialias) ? ", antialiased" : "");
+    #else
+    printf("Display %dx%d, %d bits per color\n\n", _width, _height, bits_per_color);
+    #endif
+    printf("%-11s %10s %9s %9s %10s %10s %9s %9s  %s\n", "test", "prims/s", "Mpix/s", "trans/f", "windows/f", "bytes/f", "pix/trans", "fileops/f", "hash");
+    int failed = 0;
+    for (size_t t = 0; t < sizeof(tests) / sizeof(tests[0]); t++) {
+        const bench_test_t *test = &tests[t];
+        if (argi < argc) {
+            int selected = 0;
+            for (int i = argi; i < argc; i++) {
+                if (strcmp(argv[i], test->name) == 0) selected = 1;
+            }
+            if (!selected) continue;
+        }
+
+        // one counted frame
+        tft_mem_reset();
+        file_ops = 0;
+        draw_frame(test);
+        tft_panel_stats_t frame = tft_panel_stats;
+        uint32_t frame_file_ops = file_ops;
+        uint32_t hash = tft_mem_hash();
+
+        char fname[256];
+        if (write_dir) {
+            snprintf(fname, sizeof(fname), "%s/%s.ppm", write_dir, test->name);
+            if (tft_mem_write_ppm(fname) != 0) printf("Can't write %s\n", fname);
+        }
+        long diff = 0;
+        if (compare_dir) {
+            snprintf(fname, sizeof(fname), "%s/%s.ppm", compare_dir, test->name);
+            diff = tft_mem_compare_ppm(fname);
+            if (diff != 0) failed++;
+        }
+
+        // timed frames
+        int frames = 0;
+        double t0 = now();
+        double elapsed;
+        do {
+            draw_frame(test);
+            frames++;
+            elapsed = now() - t0;
+        } while (elapsed < min_time);
+
+        printf("%-11s %10.0f %9.2f %9u %10u %10u %9.1f %9u  %08x",
+            test->name, (frames * test->ops) / elapsed, ((double)frame.pixels * frames) / elapsed / 1e6,
+            frame.transactions, frame.windows, frame.bytes,
+            (frame.transactions) ? (double)frame.pixels / frame.transactions : 0.0, frame_file_ops, hash);
+        if (compare_dir) {
+            if (diff < 0) printf("  no golden image");
+            else if (diff > 0) printf("  %ld pixels differ", diff);
+            else printf("  same");
+        }
+        printf("\n");
+    }
+    return (failed) ? 1 : 0;
+}
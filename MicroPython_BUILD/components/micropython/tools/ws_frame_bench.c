@@ -0,0 +1,293 @@
+/*
+ * Loopback benchmark of the WebSocket framing (espmqtt/lib/ws_frame.c) used
+ * by the websocket module and the MQTT WebSocket transport.
+ *
+ * A sender thread writes masked client frames to a TCP loopback connection,
+ * the receiver parses and unmasks them:
+ *   bytewise - the previous way: the header and the extended length/mask are
+ *              read with separate reads, the payload is unmasked byte by byte
+ *   ws_frame - headers parsed from bulk reads, payload read directly into the
+ *              destination buffer and unmasked in place 32 bits at a time
+ * The unmasking alone and the permessage-deflate inflate speed are also measured.
+ *
+ *   gcc -O2 -I../../espmqtt/lib/include -o ws_frame_bench ws_frame_bench.c ../../espmqtt/lib/ws_frame.c -lz -lpthread
+ *   ./ws_frame_bench [MBytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "ws_frame.h"
+
+#define RX_BUF_SIZE 256
+
+static size_t total_bytes;
+static size_t frame_size;
+static int listen_sock;
+static uint8_t *payload;
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void write_all(int sock, const uint8_t *buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = write(sock, buf, len);
+        if (n <= 0) {
+            perror("write");
+            exit(1);
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+static size_t read_exactly(int sock, uint8_t *buf, size_t len, int *reads)
+{
+    size_t got = 0;
+    while (got < len) {
+        ssize_t n = read(sock, buf + got, len - got);
+        if (n <= 0) {
+            return got;
+        }
+        (*reads)++;
+        got += n;
+    }
+    return got;
+}
+
+// Sender: masked client frames with a new masking key for every frame
+static void *sender(void *arg)
+{
+    int sock = accept(listen_sock, NULL, NULL);
+    uint8_t *frame = malloc(WS_FRAME_MAX_HEADER + frame_size);
+    uint32_t seed = 1;
+    for (size_t sent = 0; sent < total_bytes; sent += frame_size) {
+        uint8_t mask[4];
+        seed = seed * 1103515245 + 12345;
+        memcpy(mask, &seed, 4);
+        int hdr = ws_frame_header(frame, WS_FRAME_FIN | 2, frame_size, mask);
+        memcpy(frame + hdr, payload, frame_size);
+        ws_frame_mask(frame + hdr, frame_size, mask, 0);
+        write_all(sock, frame, hdr + frame_size);
+    }
+    free(frame);
+    close(sock);
+    return NULL;
+}
+
+static int connect_loopback(pthread_t *thread, int port)
+{
+    pthread_create(thread, NULL, sender, NULL);
+    int sock = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    return sock;
+}
+
+// Previous receiver: byte oriented header state machine, bytewise unmasking
+static size_t receive_bytewise(int sock, uint8_t *buf, size_t buf_size, int *reads)
+{
+    size_t received = 0;
+    uint8_t hdr[8];
+    while (read_exactly(sock, hdr, 2, reads) == 2) {
+        int opt = 0;
+        size_t len = hdr[1] & 0x7f;
+        if (len == 126) opt += 2;
+        else if (len == 127) opt += 8;
+        if (hdr[1] & 0x80) opt += 4;
+        uint8_t ext[12];
+        if (read_exactly(sock, ext, opt, reads) != (size_t)opt) break;
+        uint8_t *mask = ext + opt - 4;
+        if (len == 126) {
+            len = (ext[0] << 8) | ext[1];
+        } else if (len == 127) {
+            len = 0;
+            for (int i = 0; i < 8; i++) len = (len << 8) | ext[i];
+        }
+        int mask_pos = 0;
+        uint8_t *dest = buf;
+        while (len > 0) {
+            ssize_t n = read(sock, dest, len);
+            if (n <= 0) return received;
+            (*reads)++;
+            for (uint8_t *p = dest; p < dest + n; p++) {
+                *p ^= mask[mask_pos++ & 3];
+            }
+            dest += n;
+            len -= n;
+            received += n;
+        }
+    }
+    return received;
+}
+
+// ws_frame receiver, the same data path as the websocket module
+static size_t receive_ws_frame(int sock, uint8_t *buf, size_t buf_size, int *reads)
+{
+    size_t received = 0;
+    uint8_t rx[RX_BUF_SIZE];
+    int rx_pos = 0, rx_len = 0;
+    ws_frame_t frame = {0};
+    while (1) {
+        if (frame.remaining == 0) {
+            int hdr = ws_frame_parse(&frame, rx + rx_pos, rx_len - rx_pos);
+            if (hdr < 0) {
+                printf("invalid frame\n");
+                exit(1);
+            }
+            if (hdr == 0) {
+                memmove(rx, rx + rx_pos, rx_len - rx_pos);
+                rx_len -= rx_pos;
+                rx_pos = 0;
+                ssize_t n = read(sock, rx + rx_len, RX_BUF_SIZE - rx_len);
+                if (n <= 0) return received;
+                (*reads)++;
+                rx_len += n;
+                continue;
+            }
+            rx_pos += hdr;
+        }
+        // the payload is read directly into its place in the frame buffer
+        uint8_t *dest = buf + buf_size - frame.remaining;
+        size_t n = frame.remaining;
+        if (rx_pos < rx_len) {
+            if (n > (size_t)(rx_len - rx_pos)) n = rx_len - rx_pos;
+            memcpy(dest, rx + rx_pos, n);
+            rx_pos += n;
+        } else {
+            ssize_t r = read(sock, dest, n);
+            if (r <= 0) return received;
+            (*reads)++;
+            n = r;
+        }
+        received += ws_frame_payload(&frame, dest, n);
+    }
+}
+
+static void run(const char *name, size_t (*receiver)(int, uint8_t *, size_t, int *), int port)
+{
+    pthread_t thread;
+    uint8_t *buf = malloc(frame_size);
+    int reads = 0;
+    int sock = connect_loopback(&thread, port);
+    double t = now();
+    size_t received = receiver(sock, buf, frame_size, &reads);
+    t = now() - t;
+    pthread_join(thread, NULL);
+    close(sock);
+    // the last frame is unmasked into the buffer, check it
+    if ((received != total_bytes) || (memcmp(buf, payload, frame_size) != 0)) {
+        printf("  %-10s data error (%zu bytes)\n", name, received);
+        exit(1);
+    }
+    printf("  %-10s %8.1f MB/s, %7d reads\n", name, received / t / 1e6, reads);
+    free(buf);
+}
+
+static void bench_mask(void)
+{
+    size_t len = 1 << 20;
+    uint8_t *buf = malloc(len + 1);
+    uint8_t mask[4] = { 0x11, 0x22, 0x33, 0x44 };
+    int rounds = 200;
+    double t = now();
+    for (int r = 0; r < rounds; r++) {
+        for (size_t i = 0; i < len; i++) {
+            buf[i] ^= mask[i & 3];
+        }
+        __asm__ volatile("" ::: "memory");
+    }
+    double tb = now() - t;
+    t = now();
+    for (int r = 0; r < rounds; r++) {
+        // unaligned start, as after a frame header
+        ws_frame_mask(buf + 1, len, mask, 0);
+        __asm__ volatile("" ::: "memory");
+    }
+    double tw = now() - t;
+    printf("unmask in memory: bytewise %.0f MB/s, ws_frame_mask %.0f MB/s\n", rounds * len / tb / 1e6, rounds * len / tw / 1e6);
+    free(buf);
+}
+
+static void bench_inflate(void)
+{
+    // compressible text, sent as a permessage-deflate message and inflated in 256 byte pieces
+    size_t len = 1 << 20;
+    uint8_t *text = malloc(len);
+    for (size_t i = 0; i < len; i++) {
+        text[i] = "temperature=21.5;humidity=40;"[i % 29] + ((i / 997) & 3);
+    }
+    ws_deflate_t z;
+    ws_deflate_init(&z, 11, 11);
+    uint8_t *comp = malloc(WS_DEFLATE_BOUND(len));
+    int clen = ws_deflate(&z, text, len, comp, WS_DEFLATE_BOUND(len));
+    uint8_t *out = malloc(len + 4096);
+    double t = now();
+    size_t pos = 0, got = 0;
+    while (1) {
+        size_t used;
+        size_t in = (clen - pos < RX_BUF_SIZE) ? clen - pos : RX_BUF_SIZE;
+        int n = ws_inflate(&z, comp + pos, in, &used, out + got, 4096, in == 0);
+        if (n < 0) break;
+        pos += used;
+        got += n;
+        if ((in == 0) && ws_inflate_done(&z)) break;
+    }
+    t = now() - t;
+    printf("permessage-deflate: %zu -> %d bytes, inflate %.1f MB/s, %s\n", len, clen, got / t / 1e6,
+           ((got == len) && (memcmp(out, text, len) == 0)) ? "ok" : "DATA ERROR");
+    ws_deflate_free(&z);
+    free(text);
+    free(comp);
+    free(out);
+}
+
+int main(int argc, char **argv)
+{
+    size_t mbytes = (argc > 1) ? atoi(argv[1]) : 64;
+    total_bytes = mbytes << 20;
+    size_t sizes[] = { 125, 1400, 16384, 65536 };
+    payload = malloc(65536);
+    for (int i = 0; i < 65536; i++) {
+        payload[i] = i * 31 + (i >> 8);
+    }
+
+    listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    struct sockaddr_in addr = { .sin_family = AF_INET, .sin_port = 0, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t alen = sizeof(addr);
+    bind(listen_sock, (struct sockaddr *)&addr, sizeof(addr));
+    listen(listen_sock, 1);
+    getsockname(listen_sock, (struct sockaddr *)&addr, &alen);
+    int port = ntohs(addr.sin_port);
+
+    printf("masked client frames over TCP loopback, %zu MB\n", mbytes);
+    for (int i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++) {
+        frame_size = sizes[i];
+        total_bytes = (mbytes << 20) - (mbytes << 20) % frame_size;
+        printf("frame payload %zu bytes:\n", frame_size);
+        run("bytewise", receive_bytewise, port);
+        run("ws_frame", receive_ws_frame, port);
+    }
+    bench_mask();
+    bench_inflate();
+    close(listen_sock);
+    return 0;
+}
@@ -0,0 +1,387 @@
+/*
+ * Host loopback test and throughput benchmark of the ymodem module (esp32/modymodem.c)
+ *
+ * modymodem.c is built unchanged against a simulated UART0 on the master side of a
+ * pseudo-tty: its 128 byte TX FIFO is emptied at the baud rate, the received bytes
+ * are put into the stdin ring buffer at the baud rate, as by the UART driver.
+ * The YMODEM stand-in (ymodem_standin.py) on the slave side is the host's sz/rz.
+ * Receive and send are tested in YMODEM and YMODEM-G mode, with a corrupted packet
+ * (NAK and resend, abort in YMODEM-G mode) and a NAKed packet (resend). The files
+ * are compared, the data rate is printed by the stand-in. The CPU time of the
+ * transferring task is measured, it must wait, not spin, while the TX FIFO is full.
+ *
+ *   gcc -O2 -DNO_QSTR -DCONFIG_MICROPY_RX_BUFFER_SIZE=1080 -Ihost -I.. -I../esp32 -o ymodem_loopback_test \
+ *       ymodem_loopback_test.c host/host_stubs.c -lpthread
+ *   ./ymodem_loopback_test [-b baud] [-s size] [-v]
+ * (run in this directory)
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// The module table of modymodem.c, not used by the test
+#define MP_QSTR___name__    1
+#define MP_QSTR_ymodem      2
+#define MP_QSTR_send        3
+#define MP_QSTR_recv        4
+
+#include "modymodem.c"
+
+static int baud = 921600;
+static int verbose = 0;
+static int uart_fd = -1;
+static int slave_fd = -1;
+static char slave_name[64];
+static volatile int uart_run = 1;
+
+// ==== Simulated UART0 ====
+
+static pthread_mutex_t uart_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint8_t tx_fifo[UART_FIFO_LEN];
+static int tx_head = 0;
+static int tx_count = 0;
+static double tx_time;          // the FIFO is transmitted up to this time
+static uint32_t tx_overflows = 0;
+static uint32_t rx_overflows = 0;
+static uart_dev_t uart_dev;
+static uint8_t stdin_buf[CONFIG_MICROPY_RX_BUFFER_SIZE];
+ringbuf_t stdin_ringbuf = {stdin_buf, sizeof(stdin_buf)};
+
+static double now(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double thread_cpu(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void sleep_until(double t)
+{
+    double d = t - now();
+    if (d > 0) usleep((useconds_t)(d * 1e6));
+}
+
+uart_dev_t *host_uart_dev(int uart_num)
+{
+    pthread_mutex_lock(&uart_lock);
+    uart_dev.status.txfifo_cnt = tx_count;
+    pthread_mutex_unlock(&uart_lock);
+    return &uart_dev;
+}
+
+void host_uart_fifo_write(int uart_num, uint8_t c)
+{
+    pthread_mutex_lock(&uart_lock);
+    if (tx_count < UART_FIFO_LEN) {
+        if (tx_count == 0) tx_time = now();
+        tx_fifo[(tx_head + tx_count) % UART_FIFO_LEN] = c;
+        tx_count++;
+    }
+    else tx_overflows++;
+    pthread_mutex_unlock(&uart_lock);
+}
+
+// Transmit the FIFO content at the baud rate
+static void *uart_tx_task(void *arg)
+{
+    double byte_time = 10.0 / baud;
+    while (uart_run) {
+        usleep(100);
+        uint8_t buf[UART_FIFO_LEN];
+        int n = 0;
+        pthread_mutex_lock(&uart_lock);
+        double t = now();
+        while ((tx_count > 0) && ((tx_time + byte_time) <= t)) {
+            buf[n++] = tx_fifo[tx_head];
+            tx_head = (tx_head + 1) % UART_FIFO_LEN;
+            tx_count--;
+            tx_time += byte_time;
+        }
+        pthread_mutex_unlock(&uart_lock);
+        if ((n > 0) && (write(uart_fd, buf, n) != n)) perror("uart write");
+    }
+    return NULL;
+}
+
+// Receive at the baud rate into the stdin ring buffer, the task waiting for input is signaled
+static void *uart_rx_task(void *arg)
+{
+    double byte_time = 10.0 / baud;
+    double rx_time = now();
+    while (uart_run) {
+        uint8_t buf[64];
+        int n = read(uart_fd, buf, sizeof(buf));
+        if (n <= 0) {
+            usleep(1000);
+            continue;
+        }
+        // the line was idle
+        if (rx_time < (now() - 0.001)) rx_time = now();
+        rx_time += n * byte_time;
+        sleep_until(rx_time);
+        for (int i = 0; i < n; i++) {
+            if (ringbuf_put(&stdin_ringbuf, buf[i]) < 0) rx_overflows++;
+        }
+        xSemaphoreGive(uart0_semaphore);
+    }
+    return NULL;
+}
+
+// ==== mphalport functions used by modymodem.c ====
+
+uint64_t mp_hal_ticks_ms(void)
+{
+    return (uint64_t)(now() * 1000);
+}
+
+int mp_hal_stdin_rx_chr(uint32_t timeout)
+{
+    uint64_t wait_end = mp_hal_ticks_ms() + timeout;
+    while (1) {
+        int c = ringbuf_get(&stdin_ringbuf);
+        if (c >= 0) return c;
+        uint64_t t = mp_hal_ticks_ms();
+        if (t >= wait_end) return -1;
+        xSemaphoreTake(uart0_semaphore, wait_end - t);
+    }
+}
+
+// ==== Module functions, not used by the test ====
+
+const mp_print_t mp_plat_print = {NULL, NULL};
+const mp_obj_type_t mp_type_module;
+const mp_obj_type_t mp_type_dict;
+const mp_obj_type_t mp_type_fun_builtin_1;
+const mp_obj_type_t mp_type_fun_builtin_var;
+const struct _mp_obj_none_t { mp_obj_base_t base; } mp_const_none_obj;
+
+int mp_printf(const mp_print_t *print, const char *fmt, ...)
+{
+    return 0;
+}
+
+const char *mp_obj_str_get_str(mp_obj_t self_in)
+{
+    return NULL;
+}
+
+bool mp_obj_is_true(mp_obj_t arg)
+{
+    return false;
+}
+
+int physicalPath(const char *path, char *ph_path)
+{
+    return -1;
+}
+
+void native_vfs_file_changed()
+{
+}
+
+// ==== Tests ====
+
+static pid_t start_standin(char *const argv[])
+{
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (!verbose) {
+            int fd = open("/dev/null", O_WRONLY);
+            dup2(fd, 2);
+        }
+        execvp(argv[0], argv);
+        perror("execvp");
+        _exit(127);
+    }
+    return pid;
+}
+
+static int wait_standin(pid_t pid)
+{
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return (WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+}
+
+static void uart_reset(void)
+{
+    // wait until the line is quiet, then empty the buffers
+    double end = now() + 0.2;
+    while (now() < end) {
+        usleep(10000);
+        if (stdin_ringbuf.iget != stdin_ringbuf.iput) {
+            stdin_ringbuf.iget = stdin_ringbuf.iput;
+            end = now() + 0.2;
+        }
+    }
+    tcflush(uart_fd, TCIOFLUSH);
+    stdin_ringbuf.iget = stdin_ringbuf.iput;
+    tx_overflows = 0;
+    rx_overflows = 0;
+}
+
+static int compare_files(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    int res = -1;
+    if (fa && fb) {
+        int ca, cb;
+        do {
+            ca = fgetc(fa);
+            cb = fgetc(fb);
+        } while ((ca == cb) && (ca != EOF));
+        res = (ca == cb) ? 0 : -1;
+    }
+    if (fa) fclose(fa);
+    if (fb) fclose(fb);
+    return res;
+}
+
+static int failures = 0;
+
+static void report(const char *name, int ok, double wall, double cpu, const char *msg)
+{
+    printf("%-24s %-4s %7.3f s, task CPU %5.1f%%, TX FIFO overflows %u, RX overflows %u%s%s\n",
+           name, (ok) ? "ok" : "FAIL", wall, (wall > 0) ? (cpu * 100 / wall) : 0, tx_overflows, rx_overflows,
+           (msg && msg[0]) ? ", " : "", (msg) ? msg : "");
+    if (!ok) failures++;
+}
+
+// The device receives the file sent by the stand-in, 'expect_ok' = 0 if the transfer must fail
+static void test_receive(const char *name, const char *src, int ymodem_g, int corrupt, int expect_ok)
+{
+    uart_reset();
+    char corrupt_s[16];
+    snprintf(corrupt_s, sizeof(corrupt_s), "%d", corrupt);
+    char *argv[] = { "python3", "ymodem_standin.py", "--port", slave_name, "--send", (char *)src,
+                     "--corrupt", corrupt_s, NULL };
+    pid_t pid = start_standin(argv);
+
+    FILE *ffd = fopen("/tmp/ymodem_received.bin", "wb");
+    char getname[128] = {0};
+    char err_msg[128] = {0};
+    double t0 = now();
+    double c0 = thread_cpu();
+    int res = Ymodem_Receive(ffd, YM_MAX_FILESIZE, getname, err_msg, ymodem_g);
+    double cpu = thread_cpu() - c0;
+    double wall = now() - t0;
+    fclose(ffd);
+    int standin_res = wait_standin(pid);
+
+    struct stat st;
+    stat(src, &st);
+    int ok;
+    if (expect_ok) {
+        ok = (res == st.st_size) && (standin_res == 0) && (compare_files(src, "/tmp/ymodem_received.bin") == 0) &&
+             (strcmp(getname, strrchr(src, '/') + 1) == 0);
+    }
+    else ok = (res < 0) && (standin_res != 0);
+    // after an abort the stand-in streams on, the RX overflows are expected
+    ok = ok && (tx_overflows == 0) && ((rx_overflows == 0) || !expect_ok) && (cpu < (wall / 2));
+    report(name, ok, wall, cpu, err_msg);
+}
+
+// The device sends the file to the stand-in
+static void test_send(const char *name, const char *src, int ymodem_g, int nak)
+{
+    uart_reset();
+    char nak_s[16];
+    snprintf(nak_s, sizeof(nak_s), "%d", nak);
+    char *argv[] = { "python3", "ymodem_standin.py", "--port", slave_name, "--recv", "/tmp/ymodem_out",
+                     "--nak", nak_s, (ymodem_g) ? "--g" : NULL, NULL };
+    mkdir("/tmp/ymodem_out", 0755);
+    unlink("/tmp/ymodem_out/ymodem_test.bin");
+    pid_t pid = start_standin(argv);
+
+    struct stat st;
+    stat(src, &st);
+    FILE *ffd = fopen(src, "rb");
+    char err_msg[128] = {0};
+    double t0 = now();
+    double c0 = thread_cpu();
+    int res = Ymodem_Transmit("ymodem_test.bin", st.st_size, ffd, err_msg);
+    double cpu = thread_cpu() - c0;
+    double wall = now() - t0;
+    fclose(ffd);
+    int standin_res = wait_standin(pid);
+
+    int ok = (res == 0) && (standin_res == 0) && (compare_files(src, "/tmp/ymodem_out/ymodem_test.bin") == 0);
+    ok = ok && (tx_overflows == 0) && (rx_overflows == 0) && (cpu < (wall / 2));
+    report(name, ok, wall, cpu, err_msg);
+}
+
+int main(int argc, char *argv[])
+{
+    int size = 128 * 1024 + 333;
+    int opt;
+    while ((opt = getopt(argc, argv, "b:s:v")) != -1) {
+        switch (opt) {
+            case 'b': baud = atoi(optarg); break;
+            case 's': size = atoi(optarg); break;
+            case 'v': verbose = 1; break;
+            default:
+                fprintf(stderr, "usage: %s [-b baud] [-s size] [-v]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    // the pseudo-tty, raw on both sides
+    uart_fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((uart_fd < 0) || (grantpt(uart_fd) != 0) || (unlockpt(uart_fd) != 0) ||
+        (ptsname_r(uart_fd, slave_name, sizeof(slave_name)) != 0)) {
+        perror("pseudo-tty");
+        return 1;
+    }
+    // kept open, so that the master is not hung up between the stand-ins
+    slave_fd = open(slave_name, O_RDWR | O_NOCTTY);
+    struct termios tio;
+    tcgetattr(slave_fd, &tio);
+    cfmakeraw(&tio);
+    tcsetattr(slave_fd, TCSANOW, &tio);
+    fcntl(uart_fd, F_SETFL, fcntl(uart_fd, F_GETFL) | O_NONBLOCK);
+
+    uart0_mutex = xSemaphoreCreateMutex();
+    uart0_semaphore = xSemaphoreCreateBinary();
+    pthread_t tx_thread, rx_thread;
+    pthread_create(&tx_thread, NULL, uart_tx_task, NULL);
+    pthread_create(&rx_thread, NULL, uart_rx_task, NULL);
+
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    const char *src = "/tmp/ymodem_test.bin";
+    FILE *f = fopen(src, "wb");
+    srand(1);
+    for (int i = 0; i < size; i++) fputc(rand() & 0xff, f);
+    fclose(f);
+
+    printf("YMODEM loopback, %d bytes at %d baud (line rate %.1f kB/s)\n", size, baud, baud / 10 / 1000.0);
+    test_receive("recv", src, 0, 0, 1);
+    test_receive("recv YMODEM-G", src, 1, 0, 1);
+    test_receive("recv corrupted packet", src, 0, 3, 1);
+    test_receive("recv YMODEM-G corrupted", src, 1, 3, 0);
+    test_send("send", src, 0, 0);
+    test_send("send YMODEM-G", src, 1, 0);
+    test_send("send NAKed packet", src, 0, 3);
+
+    uart_run = 0;
+    pthread_join(tx_thread, NULL);
+    pthread_join(rx_thread, NULL);
+    printf("%s\n", (failures) ? "FAILED" : "all tests passed");
+    return (failures) ? 1 : 0;
+}
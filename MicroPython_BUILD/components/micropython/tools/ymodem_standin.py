@@ -0,0 +1,250 @@
+#!/usr/bin/env python3
+#
+# YMODEM stand-in for testing the ESP32 ymodem module (esp32/modymodem.c)
+#
+# The host side of the transfer, in place of sz/rz, on a serial port or the
+# slave side of a pseudo-tty (see ymodem_loopback_test.c):
+#   --send FILE  sends the file to ymodem.recv()
+#   --recv DIR   receives the file from ymodem.send() into DIR
+# With --g the transfer is requested and made in YMODEM-G streaming mode.
+# A data packet can be corrupted once (--corrupt N, the receiver must NAK it and
+# get it again, in YMODEM-G mode it must abort) or NAKed once (--nak N, the sender
+# must send it again).
+#
+#   python3 ymodem_standin.py --port /dev/ttyUSB0 --baud 921600 --send test.bin
+#   python3 ymodem_standin.py --port /dev/pts/3 --recv /tmp --g
+#
+# The data rate (first data packet to the end of file) is printed, the exit code
+# is 0 if the transfer was complete.
+
+import argparse
+import binascii
+import os
+import select
+import sys
+import termios
+import time
+import tty
+
+SOH = 0x01
+STX = 0x02
+EOT = 0x04
+ACK = 0x06
+NAK = 0x15
+CA = 0x18
+CRC16 = ord('C')
+CRC16G = ord('G')
+
+BAUDS = {9600: termios.B9600, 19200: termios.B19200, 38400: termios.B38400, 57600: termios.B57600,
+         115200: termios.B115200, 230400: termios.B230400, 460800: termios.B460800, 921600: termios.B921600}
+
+
+def crc16(data):
+    # CRC16-CCITT (XMODEM)
+    return binascii.crc_hqx(data, 0)
+
+
+def packet(seqno, data, size):
+    data = data.ljust(size, b'\x1a' if size == 1024 else b'\0')
+    crc = crc16(data)
+    return bytes([STX if size == 1024 else SOH, seqno & 0xff, 0xff - (seqno & 0xff)]) + data + \
+        bytes([crc >> 8, crc & 0xff])
+
+
+class Aborted(Exception):
+    pass
+
+
+class Timeout(Aborted):
+    pass
+
+
+class Port:
+    def __init__(self, path, baud):
+        self.fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+        tty.setraw(self.fd)
+        if baud in BAUDS:
+            attr = termios.tcgetattr(self.fd)
+            attr[4] = attr[5] = BAUDS[baud]
+            termios.tcsetattr(self.fd, termios.TCSANOW, attr)
+        termios.tcflush(self.fd, termios.TCIOFLUSH)
+        self.buf = b''
+
+    def write(self, data):
+        while data:
+            n = os.write(self.fd, data)
+            data = data[n:]
+
+    def read(self, n, timeout):
+        end = time.monotonic() + timeout
+        while len(self.buf) < n:
+            left = end - time.monotonic()
+            if left <= 0 or not select.select([self.fd], [], [], left)[0]:
+                break
+            self.buf += os.read(self.fd, 4096)
+        data, self.buf = self.buf[:n], self.buf[n:]
+        return data
+
+    def getc(self, timeout):
+        data = self.read(1, timeout)
+        return data[0] if data else None
+
+    def wait(self, chars, timeout, what):
+        # skip everything else, abort on CA
+        end = time.monotonic() + timeout
+        while True:
+            c = self.getc(max(end - time.monotonic(), 0))
+            if c is None:
+                raise Aborted('timeout waiting for ' + what)
+            if c in chars:
+                return c
+            if c == CA:
+                raise Aborted('aborted by receiver')
+
+
+def send(port, args):
+    data = open(args.send, 'rb').read()
+    name = os.path.basename(args.send)
+    # the receiver requests the transfer with 'C' or 'G', repeated every second
+    g = port.wait((CRC16, CRC16G), 30, 'C/G') == CRC16G
+    port.read(4096, 0.05)
+    header = '{}\0{} {:o} 0'.format(name, len(data), int(os.path.getmtime(args.send))).encode()
+    while True:
+        port.write(packet(0, header, 128))
+        if g:
+            port.wait((CRC16G,), 10, 'G after the header')
+            break
+        if port.wait((ACK, NAK), 10, 'header ACK') == ACK:
+            port.wait((CRC16,), 10, 'C after the header')
+            break
+    start = time.monotonic()
+    seqno = 1
+    corrupted = False
+    for pos in range(0, len(data), 1024):
+        pkt = packet(seqno, data[pos:pos + 1024], 1024)
+        while True:
+            if seqno == args.corrupt and not corrupted:
+                corrupted = True
+                bad = bytearray(pkt)
+                bad[10] ^= 0xff
+                port.write(bytes(bad))
+            else:
+                port.write(pkt)
+            if g:
+                # only an abort is expected while streaming
+                if port.getc(0) == CA:
+                    raise Aborted('aborted by receiver')
+                break
+            if port.wait((ACK, NAK), 10, 'ACK of packet {}'.format(seqno)) == ACK:
+                break
+        seqno += 1
+    while True:
+        port.write(bytes([EOT]))
+        if port.wait((ACK, NAK), 10, 'ACK of EOT') == ACK:
+            break
+    elapsed = time.monotonic() - start
+    # end of the batch: empty header
+    port.wait((CRC16G,) if g else (CRC16,), 10, 'C/G after EOT')
+    port.write(packet(0, b'', 128))
+    if not g:
+        port.wait((ACK,), 10, 'ACK of the last header')
+    return len(data), elapsed, g
+
+
+def receive_packet(port, timeout):
+    c = port.getc(timeout)
+    if c is None:
+        raise Timeout('timeout waiting for a packet')
+    if c == EOT:
+        return EOT, None, None
+    if c == CA:
+        raise Aborted('aborted by sender')
+    if c not in (SOH, STX):
+        return None, None, None
+    size = 1024 if c == STX else 128
+    pkt = port.read(size + 4, 5)
+    if len(pkt) != size + 4 or pkt[0] != 0xff - pkt[1] or crc16(pkt[2:]) != 0:
+        return None, None, None
+    return c, pkt[0], pkt[2:-2]
+
+
+def receive(port, args):
+    req = CRC16G if args.g else CRC16
+    # request the transfer every 3 seconds, the sender's 'C' is skipped
+    for _ in range(10):
+        port.write(bytes([req]))
+        end = time.monotonic() + 3
+        kind = None
+        try:
+            while kind is None:
+                kind, seqno, data = receive_packet(port, max(end - time.monotonic(), 0))
+        except Timeout:
+            continue
+        if kind in (SOH, STX) and seqno == 0:
+            break
+    else:
+        raise Aborted('no header from the sender')
+    name = data.split(b'\0')[0].decode()
+    size = int(data.split(b'\0')[1].split(b' ')[0])
+    port.write(bytes([CRC16G]) if args.g else bytes([ACK, CRC16]))
+    start = time.monotonic()
+    out = b''
+    expected = 1
+    naked = False
+    while True:
+        kind, seqno, data = receive_packet(port, 10)
+        if kind == EOT:
+            port.write(bytes([ACK]))
+            break
+        if kind is None:
+            if args.g:
+                port.write(bytes([CA, CA]))
+                raise Aborted('packet error in YMODEM-G mode')
+            port.write(bytes([NAK]))
+            continue
+        if seqno == expected and expected == args.nak and not naked and not args.g:
+            naked = True
+            port.write(bytes([NAK]))
+            continue
+        if seqno == expected:
+            out += data
+            expected = (expected + 1) & 0xff
+        if not args.g:
+            port.write(bytes([ACK]))
+    elapsed = time.monotonic() - start
+    # the empty header ends the batch
+    port.write(bytes([req]))
+    kind, seqno, data = receive_packet(port, 10)
+    if kind not in (SOH, STX) or seqno != 0 or data[0] != 0:
+        raise Aborted('no end of batch')
+    if not args.g:
+        port.write(bytes([ACK]))
+    with open(os.path.join(args.recv, name), 'wb') as f:
+        f.write(out[:size])
+    return size, elapsed, args.g
+
+
+def main():
+    parser = argparse.ArgumentParser(description='YMODEM stand-in for the ESP32 ymodem module tests')
+    parser.add_argument('--port', required=True, help='serial port or pseudo-tty')
+    parser.add_argument('--baud', type=int, default=0, help='baud rate of a serial port')
+    group = parser.add_mutually_exclusive_group(required=True)
+    group.add_argument('--send', metavar='FILE', help='send the file to ymodem.recv()')
+    group.add_argument('--recv', metavar='DIR', help='receive the file from ymodem.send()')
+    parser.add_argument('--g', action='store_true', help='request YMODEM-G streaming (receive)')
+    parser.add_argument('--corrupt', type=int, default=0, metavar='N', help='corrupt data packet N once (send)')
+    parser.add_argument('--nak', type=int, default=0, metavar='N', help='NAK data packet N once (receive)')
+    args = parser.parse_args()
+    port = Port(args.port, args.baud)
+    try:
+        size, elapsed, g = send(port, args) if args.send else receive(port, args)
+    except Aborted as e:
+        print('ymodem_standin: {}'.format(e))
+        sys.exit(1)
+    print('ymodem_standin: {} {} bytes {} in {:.3f} s, {:.1f} kB/s'.format(
+        'YMODEM-G' if g else 'YMODEM', size, 'sent' if args.send else 'received', elapsed,
+        size / elapsed / 1000 if elapsed else 0))
+
+
+if __name__ == '__main__':
+    main()
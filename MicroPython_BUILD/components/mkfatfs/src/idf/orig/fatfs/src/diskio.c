@@ -9,6 +9,7 @@
 /*-----------------------------------------------------------------------*/
 
 #include <string.h>
+#include <stdlib.h>
 #include <time.h>
 #include <sys/time.h>
 #include "diskio.h"		/* FatFs lower layer API */
@@ -79,7 +80,9 @@ DRESULT ff_disk_ioctl (BYTE pdrv, BYTE cmd, void* buff)
 
 DWORD get_fattime(void)
 {
-    time_t t = time(NULL);
+    // SOURCE_DATE_EPOCH, if set, gives reproducible image time stamps
+    const char *epoch = getenv("SOURCE_DATE_EPOCH");
+    time_t t = ((epoch) && (*epoch)) ? (time_t)strtoll(epoch, NULL, 10) : time(NULL);
     struct tm *tmr = gmtime(&t);
     int year = tmr->tm_year < 80 ? 0 : tmr->tm_year - 80;
     return    ((DWORD)(year) << 25)
@@ -37,6 +37,7 @@
 
 #include "fatfs/fatfs.h"
 #include "fatfs/FatPartition.h"
+#include "mkfs_tree.h"
 
 static const char *BASE_PATH = "/spiflash";
 
@@ -52,6 +53,21 @@ static int s_imageSize;
 static wl_handle_t s_wl_handle;
 static FATFS* s_fs = NULL;
 
+static unsigned int s_packFiles = 0;
+static unsigned long s_packBytes = 0;
+
+static std::string s_compressExt;
+static unsigned int s_gzFiles = 0;
+static unsigned long s_gzIn = 0;
+static unsigned long s_gzOut = 0;
+
+// Source directory, scanned and read by the front end
+static mkfs_tree_t s_srcTree = {0};
+static int s_threads = 0;
+static std::string s_manifestName;
+static unsigned int s_unchanged = 0;
+static unsigned int s_removed = 0;
+
 
 //----------------------------
 int addDir(const char* name) {
@@ -72,19 +88,18 @@ int addDir(const char* name) {
 }
 
 
-//-----------------------------------------
-int addFile(char* name, const char* path) {
-    //spiffs_metadata_t meta;
+// Add the file read by the front end, compressed files as '<name>.gz'
+//-------------------------------------------
+int addFile(const mkfs_entry_t* entry) {
+    char name[512];
 
-    FILE* src = fopen(path, "rb");
-    if (!src) {
-        std::cerr << "error: failed to open " << path << " for reading" << std::endl;
+    if (entry->error) {
+        std::cerr << "error: failed to read " << entry->src << " (" << strerror(entry->error) << ")" << std::endl;
         return 1;
     }
 
-
     std::string nameInFat = BASE_PATH;
-    nameInFat += name;
+    nameInFat += mkfs_stored_name(entry, name, sizeof(name));
 
     const int flags = O_CREAT | O_TRUNC | O_RDWR;
     int fd = emulate_esp_vfs_open(nameInFat.c_str(), flags, 0);
@@ -93,122 +108,99 @@ int addFile(char* name, const char* path) {
         return 0; //0 does not stop copying files
     }
 
-
-    // read file size
-    fseek(src, 0, SEEK_END);
-    size_t size = ftell(src);
-    fseek(src, 0, SEEK_SET);
-
     if (g_debugLevel > 0) {
-        std::cout << "file size: " << size << std::endl;
+        std::cout << "file size: " << entry->size << std::endl;
     }
 
-    size_t left = size;
-    uint8_t data_byte;
-    while (left > 0){
-        if (1 != fread(&data_byte, 1, 1, src)) {
-            std::cerr << "fread error!" << std::endl;
-            fclose(src);
-            emulate_esp_vfs_close(fd);
-            return 1;
-        }
-        ssize_t res = emulate_esp_vfs_write(fd, &data_byte, 1);
+    // write in 4 KB chunks (flash sector size)
+    for (size_t pos = 0; pos < entry->data_size; pos += 4096) {
+        size_t len = ((entry->data_size - pos) > 4096) ? 4096 : (entry->data_size - pos);
+        ssize_t res = emulate_esp_vfs_write(fd, entry->data + pos, len);
         if (res < 0) {
             std::cerr << "esp_vfs_write() error" << std::endl;
             if (g_debugLevel > 0) {
-                std::cout << "data left: " << left << std::endl;
+                std::cout << "data left: " << (entry->data_size - pos) << std::endl;
             }
-            fclose(src);
             emulate_esp_vfs_close(fd);
             return 1;
         }
-        left -= 1;
     }
 
     emulate_esp_vfs_close(fd);
 
-    fclose(src);
-
+    if (entry->gzip) {
+        std::cout << "  compressed: " << entry->size << " -> " << entry->data_size << " bytes" << std::endl;
+        s_gzFiles++;
+        s_gzIn += entry->size;
+        s_gzOut += entry->data_size;
+    }
+    s_packFiles++;
+    s_packBytes += entry->size;
     return 0;
 }
 
-//-------------------------------------------------------
-int addFiles(const char* dirname, const char* subPath) {
-    DIR *dir;
-    struct dirent *ent;
-    bool error = false;
-    std::string dirPath = dirname;
-    dirPath += subPath;
-
-    // Open directory
-    if ((dir = opendir (dirPath.c_str())) != NULL) {
-
-        // Read files from directory.
-        while ((ent = readdir (dir)) != NULL) {
-            // Ignore dir itself.
-            if (ent->d_name[0] == '.')				
-                continue;            	
-
-            std::string fullpath = dirPath;
-            fullpath += ent->d_name;
-            struct stat path_stat;
-            stat (fullpath.c_str(), &path_stat);
-
-            if (!S_ISREG(path_stat.st_mode)) {
-                // Check if path is a directory.
-                if (S_ISDIR(path_stat.st_mode)) {
-                    // Prepare new sub path.
-                    std::string newSubPath = subPath;
-                    newSubPath += ent->d_name;
-                    
-                    addDir(newSubPath.c_str());
-                    
-                    newSubPath += "/";
-
-                    if (addFiles(dirname, newSubPath.c_str()) != 0)
-                    {
-                        std::cerr << "Error for adding content from " << ent->d_name << "!" << std::endl;
-                    }
-
-                    continue;
-                }
-                else {
-                    std::cerr << "skipping " << ent->d_name << std::endl;
-                    continue;
-                }
-            }
+// Hidden files are not included into the image
+//-------------------------------------
+static bool skipName(const char* name) {
+    return (name[0] == '.');
+}
 
-            // Filepath with dirname as root folder.
-            std::string filepath = subPath;
-            filepath += ent->d_name;
-            std::cout << "adding to image: " << filepath << std::endl;
-
-            // Add File to image.
-            if (addFile((char*)filepath.c_str(), fullpath.c_str()) != 0) {
-                std::cerr << "error adding file!" << std::endl;
-                error = true;
-                if (g_debugLevel > 0) {
-                    std::cout << std::endl;
-                }
-                break;
+// Add the new and changed entries of the source tree, in the image order
+//--------------
+int addFiles() {
+    for (size_t i = 0; i < s_srcTree.count; i++) {
+        const mkfs_entry_t* entry = &s_srcTree.entries[i];
+        if (entry->state == MKFS_UNCHANGED) {
+            s_unchanged++;
+            continue;
+        }
+        if (entry->is_dir) {
+            addDir(entry->path);
+            continue;
+        }
+        std::cout << "adding to image: " << entry->path << std::endl;
+        if (addFile(entry) != 0) {
+            std::cerr << "error adding file!" << std::endl;
+            if (g_debugLevel > 0) {
+                std::cout << std::endl;
             }
-        } // end while
-        closedir (dir);
-    }
-    else {
-        std::cerr << "warning: can't read source directory: \"" << dirPath << "\"" << std::endl;
-        return 1;
+            return 1;
+        }
     }
+    return 0;
+}
 
-    return (error) ? 1 : 0;
+// Remove the entries of the previous build which are not needed,
+// the directory content before the directory
+//------------------------------------------
+int removeFiles(const mkfs_tree_t* old) {
+    char name[512];
+
+    for (size_t i = old->count; i-- > 0;) {
+        if (!mkfs_tree_stale(old, i, &s_srcTree)) {
+            continue;
+        }
+        const mkfs_entry_t* entry = &old->entries[i];
+        std::string nameInFat = BASE_PATH;
+        nameInFat += mkfs_stored_name(entry, name, sizeof(name));
+        int res = (entry->is_dir) ? emulate_vfs_rmdir(nameInFat.c_str()) : emulate_esp_vfs_unlink(nameInFat.c_str());
+        if (res < 0) {
+            std::cerr << "error removing " << name << std::endl;
+            return 1;
+        }
+        std::cout << "removed from image: " << name << std::endl;
+        s_removed++;
+    }
+    return 0;
 }
 
-//-----------------
-bool fatfsMount() {
+// The new image is formatted, the image of the previous build must be mounted
+//-----------------------------
+bool fatfsMount(bool format) {
   bool result;
   esp_vfs_fat_mount_config_t mountConfig;
   mountConfig.max_files = 4;
-  mountConfig.format_if_mount_failed = true;
+  mountConfig.format_if_mount_failed = format;
   result = (ESP_OK == emulate_esp_vfs_fat_spiflash_mount(BASE_PATH, &mountConfig, &s_wl_handle, &s_fs, s_imageSize));
 
   return result;
@@ -280,37 +272,130 @@ bool dirCreate(const char* path) {
     return true;
 }
 
-//----------------
-int actionPack() {
+// Create the new image, or update the image of the previous build if 'old' is set
+// Time of the phases is returned in 't_phase': format, add files, save image
+//--------------------------------------------------------------
+int buildImage(const mkfs_tree_t* old, double* t_phase) {
     int ret = 0; //0 - ok
-
-    g_flashmem.resize(s_imageSize, 0xff);
-
-    FILE* fdres = fopen(s_imageName.c_str(), "wb");
-    if (!fdres) {
-        std::cerr << "error: failed to open image file" << std::endl;
-        return 1;
+    double t_start = mkfs_ms_now();
+
+    g_flashmem.assign(s_imageSize, 0xff);
+    if (old) {
+        FILE* fdsrc = fopen(s_imageName.c_str(), "rb");
+        if ((!fdsrc) || (fread(&g_flashmem[0], 1, g_flashmem.size(), fdsrc) != g_flashmem.size())) {
+            std::cerr << "error: failed to read image file" << std::endl;
+            if (fdsrc) fclose(fdsrc);
+            return 1;
+        }
+        fclose(fdsrc);
     }
 
-    if (fatfsMount()) {
+    if (fatfsMount(old == NULL)) {
       if (g_debugLevel > 0) {
         std::cout << "Mounted successfully" << std::endl;
       }
     } else {
       std::cerr << "Mount failed" << std::endl;
       return 1;
-    }  
+    }
+    double t_format = mkfs_ms_now();
+
+    if (old) {
+        ret = removeFiles(old);
+    }
+    if (ret == 0) {
+        ret = addFiles();
+    }
+    if (!fatfsUnmount()) {
+        ret = 1;
+    }
+    double t_add = mkfs_ms_now();
 
-    ret = addFiles(s_dirName.c_str(), "/");
-    fatfsUnmount();
+    FILE* fdres = fopen(s_imageName.c_str(), "wb");
+    if (!fdres) {
+        std::cerr << "error: failed to open image file" << std::endl;
+        return 1;
+    }
+    if (fwrite(&g_flashmem[0], 4, g_flashmem.size()/4, fdres) != g_flashmem.size()/4) {
+        ret = 1;
+    }
+    if (fclose(fdres) != 0) {
+        ret = 1;
+    }
+    double t_save = mkfs_ms_now();
 
-    fwrite(&g_flashmem[0], 4, g_flashmem.size()/4, fdres);
-    fclose(fdres);
+    t_phase[0] = t_format - t_start;
+    t_phase[1] = t_add - t_format;
+    t_phase[2] = t_save - t_add;
+    return ret;
+}
+
+//----------------
+int actionPack() {
+    mkfs_tree_t old = {0};
+    double t_phase[3] = {0};
+    std::string params = "mkfatfs -s " + std::to_string(s_imageSize) + " -z " + s_compressExt;
+    s_threads = mkfs_threads(s_threads);
+
+    double t_start = mkfs_ms_now();
+    if (mkfs_tree_scan(&s_srcTree, s_dirName.c_str(), skipName, s_threads) != 0) {
+        return 1;
+    }
+    double t_scan = mkfs_ms_now();
+
+    // only the new and changed files are read when the previous image is updated
+    bool update = ((!s_manifestName.empty()) &&
+                   (mkfs_manifest_load(&old, s_manifestName.c_str(), params.c_str(), s_imageName.c_str()) == 0));
+    if (update) {
+        mkfs_tree_match(&s_srcTree, &old);
+    }
+    // read errors are reported when the file is added
+    mkfs_tree_read(&s_srcTree, s_compressExt.c_str(), s_threads);
+    if (update) {
+        // FAT time stamps are the time of the build
+        mkfs_tree_compare(&s_srcTree, &old, false);
+    }
+    double t_read = mkfs_ms_now();
+
+    int ret = 0;
+    if (update) {
+        std::cout << "Updating the image of the previous build" << std::endl;
+        ret = buildImage(&old, t_phase);
+        if (ret != 0) {
+            std::cerr << "Updating the image failed, creating a new image" << std::endl;
+            update = false;
+            s_packFiles = s_gzFiles = s_unchanged = s_removed = 0;
+            s_packBytes = s_gzIn = s_gzOut = 0;
+            mkfs_tree_reset(&s_srcTree);
+            mkfs_tree_read(&s_srcTree, s_compressExt.c_str(), s_threads);
+        }
+    }
+    if (!update) {
+        ret = buildImage(NULL, t_phase);
+    }
+    if ((ret == 0) && (!s_manifestName.empty())) {
+        mkfs_manifest_save(&s_srcTree, s_manifestName.c_str(), params.c_str(), s_imageName.c_str());
+    }
+
+    std::cout << s_packFiles << " files, " << s_packBytes << " bytes added";
+    if (update) {
+        std::cout << ", " << s_unchanged << " unchanged, " << s_removed << " removed";
+    }
+    std::cout << std::endl;
+    if (s_gzFiles) {
+        std::cout << s_gzFiles << " files compressed, " << s_gzIn << " -> " << s_gzOut << " bytes ("
+                  << (100 * (s_gzIn - s_gzOut) / s_gzIn) << "% saved)" << std::endl;
+    }
+    std::cout << "Time: scan " << (t_scan - t_start) << " ms, read " << (t_read - t_scan) << " ms ("
+              << s_threads << " threads), " << (update ? "mount " : "format ") << t_phase[0] << " ms, add files "
+              << t_phase[1] << " ms, save image " << t_phase[2] << " ms" << std::endl;
 
     if (g_debugLevel > 0) {
       std::cout << "Image file is written to \"" << s_imageName << "\"" << std::endl;
     }
 
+    mkfs_tree_free(&s_srcTree);
+    mkfs_tree_free(&old);
     return ret;
 }
 
@@ -324,9 +409,15 @@ void processArgs(int argc, const char** argv) {
     TCLAP::UnlabeledValueArg<std::string> outNameArg( "image_file", "fatFS image file", true, "", "image_file"  );
     TCLAP::ValueArg<int> imageSizeArg( "s", "size", "fs image size, in bytes", false, 0x10000, "number" );
     TCLAP::ValueArg<int> debugArg( "d", "debug", "Debug level. 0 means no debug output.", false, 0, "0-5" );
+    TCLAP::ValueArg<std::string> compressArg( "z", "compress", "when creating an image, store files with these extensions gzip compressed as '<name>.gz'", false, "", ".ext1,.ext2,..." );
+    TCLAP::ValueArg<int> jobsArg( "j", "jobs", "number of threads scanning and reading the source directory, 0 means one for each CPU", false, 0, "number" );
+    TCLAP::ValueArg<std::string> manifestArg( "m", "manifest", "when creating an image, update the image of the previous build: only the files changed since are written", false, "", "manifest_file" );
 
     cmd.add( imageSizeArg );
     cmd.add(debugArg);
+    cmd.add( compressArg );
+    cmd.add( jobsArg );
+    cmd.add( manifestArg );
     std::vector<TCLAP::Arg*> args = {&packArg, &unpackArg, &listArg, &visualizeArg};
     cmd.xorAdd( args );
     cmd.add( outNameArg );
@@ -351,6 +442,9 @@ void processArgs(int argc, const char** argv) {
 
     s_imageName = outNameArg.getValue();
     s_imageSize = imageSizeArg.getValue();
+    s_compressExt = compressArg.getValue();
+    s_threads = jobsArg.getValue();
+    s_manifestName = manifestArg.getValue();
 
 
 }
@@ -0,0 +1,706 @@
+/*
+ * Common front end of the host image builders (mkspiffs, mklfs, mkfatfs)
+ *
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "mkfs_tree.h"
+#include "zlib.h"
+
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+#define MKFS_MANIFEST_VERSION   1
+#define MKFS_MANIFEST_LINE      8192
+
+typedef struct {
+    char **items;
+    size_t count;
+    size_t max;
+} str_list_t;
+
+//-------------------------------------
+static void *xrealloc(void *ptr, size_t size)
+{
+    ptr = realloc(ptr, (size) ? size : 1);
+    if (ptr == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        exit(1);
+    }
+    return ptr;
+}
+
+//-------------------------------------------------------------
+static char *str_join(const char *a, const char *b, const char *c)
+{
+    size_t la = strlen(a), lb = strlen(b), lc = strlen(c);
+    char *str = xrealloc(NULL, la + lb + lc + 1);
+    memcpy(str, a, la);
+    memcpy(str + la, b, lb);
+    memcpy(str + la + lb, c, lc + 1);
+    return str;
+}
+
+//-----------------------------------------------------
+static void str_list_push(str_list_t *list, char *str)
+{
+    if (list->count >= list->max) {
+        list->max = (list->max) ? list->max * 2 : 64;
+        list->items = xrealloc(list->items, list->max * sizeof(char *));
+    }
+    list->items[list->count++] = str;
+}
+
+//-------------------------------------------------
+static mkfs_entry_t *tree_add(mkfs_tree_t *tree)
+{
+    if (tree->count >= tree->max) {
+        tree->max = (tree->max) ? tree->max * 2 : 256;
+        tree->entries = xrealloc(tree->entries, tree->max * sizeof(mkfs_entry_t));
+    }
+    mkfs_entry_t *entry = &tree->entries[tree->count++];
+    memset(entry, 0, sizeof(mkfs_entry_t));
+    entry->peer = -1;
+    return entry;
+}
+
+//----------------------
+double mkfs_ms_now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return ((double)tv.tv_sec * 1000.0) + ((double)tv.tv_usec / 1000.0);
+}
+
+//-----------------------------
+int mkfs_threads(int requested)
+{
+    int n = requested;
+#ifdef _SC_NPROCESSORS_ONLN
+    if (n <= 0) n = (int)sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+    if (n <= 0) n = 4;
+    if (n > MKFS_MAX_THREADS) n = MKFS_MAX_THREADS;
+    return n;
+}
+
+//-----------------------------------------
+bool mkfs_source_date_epoch(int64_t *epoch)
+{
+    const char *env = getenv("SOURCE_DATE_EPOCH");
+    if ((env == NULL) || (*env == '\0')) return false;
+    if (epoch) *epoch = strtoll(env, NULL, 10);
+    return true;
+}
+
+//-------------------------------------------------
+static int64_t stat_mtime_ns(const struct stat *st)
+{
+#if defined(__APPLE__)
+    return ((int64_t)st->st_mtimespec.tv_sec * 1000000000) + st->st_mtimespec.tv_nsec;
+#elif defined(_WIN32)
+    return (int64_t)st->st_mtime * 1000000000;
+#else
+    return ((int64_t)st->st_mtim.tv_sec * 1000000000) + st->st_mtim.tv_nsec;
+#endif
+}
+
+//------------------------------------------------------------------
+// Image order: '/' sorts before all other characters, so the entries
+// are in the order of a walk of the sorted directories
+//------------------------------------------------------------------
+static int path_cmp(const char *a, const char *b)
+{
+    while ((*a) && (*a == *b)) {
+        a++;
+        b++;
+    }
+    int ca = (*a == '/') ? 1 : (unsigned char)*a;
+    int cb = (*b == '/') ? 1 : (unsigned char)*b;
+    return ca - cb;
+}
+
+//-------------------------------------------------
+static int entry_cmp(const void *a, const void *b)
+{
+    return path_cmp(((const mkfs_entry_t *)a)->path, ((const mkfs_entry_t *)b)->path);
+}
+
+//-----------------------------------------------
+static int str_cmp(const void *a, const void *b)
+{
+    return path_cmp(*(const char **)a, *(const char **)b);
+}
+
+//-------------------------------------------------------------------------
+const char *mkfs_stored_name(const mkfs_entry_t *entry, char *buf, size_t len)
+{
+    snprintf(buf, len, "%s%s", entry->path, (entry->gzip) ? ".gz" : "");
+    return buf;
+}
+
+
+// === Directory scan ===
+// Directories waiting to be scanned are taken from the shared list by the threads,
+// the subdirectories found are added to it. The scan is finished when the list is
+// empty and no thread is scanning a directory.
+
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    mkfs_tree_t *tree;
+    str_list_t dirs;        // directories to scan, relative to 'root', '' is the root
+    str_list_t skipped;     // skipped entries, printed after the scan
+    int busy;               // number of directories being scanned
+    int error;
+    const char *root;
+    mkfs_skip_t skip;
+} scan_ctx_t;
+
+//--------------------------------------------------------
+static void scan_dir(scan_ctx_t *ctx, const char *rel_path)
+{
+    mkfs_tree_t found = {0};
+    str_list_t subdirs = {0};
+    str_list_t skipped = {0};
+    char *dir_path = str_join(ctx->root, rel_path, "");
+    DIR *dir = opendir(dir_path);
+
+    if (dir == NULL) {
+        fprintf(stderr, "warning: can't read source directory '%s'\n", dir_path);
+        if (rel_path[0] == '\0') ctx->error = 1;
+        free(dir_path);
+        return;
+    }
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        // ignore the directory itself
+        if ((strcmp(ent->d_name, ".") == 0) || (strcmp(ent->d_name, "..") == 0)) continue;
+
+        char *path = str_join(rel_path, "/", ent->d_name);
+        if ((ctx->skip) && (ctx->skip(ent->d_name))) {
+            str_list_push(&skipped, path);
+            continue;
+        }
+        char *src = str_join(ctx->root, path, "");
+        struct stat st;
+        if ((stat(src, &st) != 0) || ((!S_ISREG(st.st_mode)) && (!S_ISDIR(st.st_mode)))) {
+            str_list_push(&skipped, path);
+            free(src);
+            continue;
+        }
+        mkfs_entry_t *entry = tree_add(&found);
+        entry->path = path;
+        entry->src = src;
+        entry->is_dir = S_ISDIR(st.st_mode);
+        entry->size = (entry->is_dir) ? 0 : (uint64_t)st.st_size;
+        entry->mtime_ns = stat_mtime_ns(&st);
+        if (entry->is_dir) str_list_push(&subdirs, strdup(path));
+    }
+    closedir(dir);
+    free(dir_path);
+
+    pthread_mutex_lock(&ctx->lock);
+    for (size_t i = 0; i < found.count; i++) *tree_add(ctx->tree) = found.entries[i];
+    for (size_t i = 0; i < subdirs.count; i++) str_list_push(&ctx->dirs, subdirs.items[i]);
+    for (size_t i = 0; i < skipped.count; i++) str_list_push(&ctx->skipped, skipped.items[i]);
+    if (subdirs.count) pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+
+    free(found.entries);
+    free(subdirs.items);
+    free(skipped.items);
+}
+
+//--------------------------------------
+static void *scan_worker(void *arg)
+{
+    scan_ctx_t *ctx = (scan_ctx_t *)arg;
+
+    pthread_mutex_lock(&ctx->lock);
+    while (1) {
+        while ((ctx->dirs.count == 0) && (ctx->busy > 0)) pthread_cond_wait(&ctx->cond, &ctx->lock);
+        if (ctx->dirs.count == 0) break;
+        char *rel_path = ctx->dirs.items[--ctx->dirs.count];
+        ctx->busy++;
+        pthread_mutex_unlock(&ctx->lock);
+
+        scan_dir(ctx, rel_path);
+        free(rel_path);
+
+        pthread_mutex_lock(&ctx->lock);
+        ctx->busy--;
+        if (ctx->busy == 0) pthread_cond_broadcast(&ctx->cond);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+//-----------------------------------------------------------------------------------------
+int mkfs_tree_scan(mkfs_tree_t *tree, const char *root, mkfs_skip_t skip, int n_threads)
+{
+    scan_ctx_t ctx;
+    memset(&ctx, 0, sizeof(scan_ctx_t));
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.cond, NULL);
+    ctx.tree = tree;
+    ctx.root = root;
+    ctx.skip = skip;
+
+    // the root path without the trailing '/', the entry paths start with '/'
+    char *root_path = strdup(root);
+    size_t len = strlen(root_path);
+    while ((len > 1) && (root_path[len - 1] == '/')) root_path[--len] = '\0';
+    ctx.root = root_path;
+    str_list_push(&ctx.dirs, strdup(""));
+
+    pthread_t threads[MKFS_MAX_THREADS];
+    int n_started = 0;
+    n_threads = mkfs_threads(n_threads);
+    for (int i = 1; i < n_threads; i++) {
+        if (pthread_create(&threads[n_started], NULL, scan_worker, &ctx) == 0) n_started++;
+    }
+    scan_worker(&ctx);
+    for (int i = 0; i < n_started; i++) pthread_join(threads[i], NULL);
+
+    qsort(tree->entries, tree->count, sizeof(mkfs_entry_t), entry_cmp);
+    qsort(ctx.skipped.items, ctx.skipped.count, sizeof(char *), str_cmp);
+    for (size_t i = 0; i < ctx.skipped.count; i++) {
+        fprintf(stderr, "skipping '%s'\n", ctx.skipped.items[i]);
+        free(ctx.skipped.items[i]);
+    }
+    free(ctx.skipped.items);
+    free(ctx.dirs.items);
+    free(root_path);
+    pthread_cond_destroy(&ctx.cond);
+    pthread_mutex_destroy(&ctx.lock);
+    return ctx.error;
+}
+
+
+// === File read ===
+// The threads take the next file to read from the shared index
+
+typedef struct {
+    pthread_mutex_t lock;
+    mkfs_tree_t *tree;
+    size_t next;
+    const char *compress_ext;
+} read_ctx_t;
+
+//------------------------------------------------------------------
+static void read_entry(mkfs_entry_t *entry, const char *compress_ext)
+{
+    FILE *src = fopen(entry->src, "rb");
+    if (src == NULL) {
+        entry->error = (errno) ? errno : EIO;
+        return;
+    }
+    struct stat st;
+    if (fstat(fileno(src), &st) != 0) {
+        entry->error = (errno) ? errno : EIO;
+        fclose(src);
+        return;
+    }
+    size_t size = (size_t)st.st_size;
+    uint8_t *data = xrealloc(NULL, size);
+    if ((size > 0) && (fread(data, 1, size, src) != size)) {
+        entry->error = EIO;
+        free(data);
+        fclose(src);
+        return;
+    }
+    fclose(src);
+    entry->size = size;
+    entry->crc = crc32(crc32(0L, Z_NULL, 0), data, size);
+    entry->data = data;
+    entry->data_size = size;
+    entry->gzip = false;
+
+    if ((compress_ext) && (compress_ext[0]) && (mkfs_gz_match(entry->path, compress_ext))) {
+        size_t gz_size = 0;
+        uint8_t *gz = mkfs_gz_compress(data, size, &gz_size);
+        if (gz == NULL) {
+            entry->error = ENOMEM;
+            return;
+        }
+        if (gz_size < size) {
+            free(entry->data);
+            entry->data = gz;
+            entry->data_size = gz_size;
+            entry->gzip = true;
+        }
+        // not smaller, stored as is
+        else free(gz);
+    }
+}
+
+//--------------------------------------
+static void *read_worker(void *arg)
+{
+    read_ctx_t *ctx = (read_ctx_t *)arg;
+
+    while (1) {
+        pthread_mutex_lock(&ctx->lock);
+        mkfs_entry_t *entry = NULL;
+        while ((entry == NULL) && (ctx->next < ctx->tree->count)) {
+            mkfs_entry_t *e = &ctx->tree->entries[ctx->next++];
+            if ((!e->is_dir) && (e->state != MKFS_UNCHANGED) && (e->data == NULL)) entry = e;
+        }
+        pthread_mutex_unlock(&ctx->lock);
+        if (entry == NULL) break;
+        entry->error = 0;
+        read_entry(entry, ctx->compress_ext);
+    }
+    return NULL;
+}
+
+//-------------------------------------------------------------------------------
+int mkfs_tree_read(mkfs_tree_t *tree, const char *compress_ext, int n_threads)
+{
+    read_ctx_t ctx;
+    memset(&ctx, 0, sizeof(read_ctx_t));
+    pthread_mutex_init(&ctx.lock, NULL);
+    ctx.tree = tree;
+    ctx.compress_ext = compress_ext;
+
+    pthread_t threads[MKFS_MAX_THREADS];
+    int n_started = 0;
+    n_threads = mkfs_threads(n_threads);
+    for (int i = 1; i < n_threads; i++) {
+        if (pthread_create(&threads[n_started], NULL, read_worker, &ctx) == 0) n_started++;
+    }
+    read_worker(&ctx);
+    for (int i = 0; i < n_started; i++) pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&ctx.lock);
+
+    int err = 0;
+    for (size_t i = 0; i < tree->count; i++) {
+        if (tree->entries[i].error) err = 1;
+    }
+    return err;
+}
+
+//-------------------------------------
+void mkfs_tree_free(mkfs_tree_t *tree)
+{
+    for (size_t i = 0; i < tree->count; i++) {
+        free(tree->entries[i].path);
+        free(tree->entries[i].src);
+        free(tree->entries[i].data);
+    }
+    free(tree->entries);
+    memset(tree, 0, sizeof(mkfs_tree_t));
+}
+
+
+// === Manifest ===
+// Text file, the header lines and one line for each entry, in the image order:
+//   D <mtime_ns> <path>
+//   F <size> <mtime_ns> <crc32> <gzip> <path>
+
+//-----------------------------------------------------------------------------------
+static bool manifest_header(char *buf, size_t len, const char *params, const char *image_name)
+{
+    struct stat st;
+    if (stat(image_name, &st) != 0) return false;
+    const char *epoch = getenv("SOURCE_DATE_EPOCH");
+    snprintf(buf, len, "# mkfs manifest %d\n# params %s epoch=%s\n# image %" PRIu64 " %" PRId64 "\n",
+             MKFS_MANIFEST_VERSION, params, ((epoch) && (*epoch)) ? epoch : "-",
+             (uint64_t)st.st_size, stat_mtime_ns(&st));
+    return true;
+}
+
+//------------------------------------------------------------------------------------------------
+int mkfs_manifest_save(const mkfs_tree_t *tree, const char *name, const char *params, const char *image_name)
+{
+    char header[1024];
+    if (!manifest_header(header, sizeof(header), params, image_name)) return -1;
+
+    FILE *f = fopen(name, "w");
+    if (f == NULL) {
+        fprintf(stderr, "error: failed to open '%s' for writting\n", name);
+        return -1;
+    }
+    fputs(header, f);
+    for (size_t i = 0; i < tree->count; i++) {
+        const mkfs_entry_t *entry = &tree->entries[i];
+        if (entry->is_dir) fprintf(f, "D %" PRId64 " %s\n", entry->mtime_ns, entry->path);
+        else fprintf(f, "F %" PRIu64 " %" PRId64 " %08x %d %s\n", entry->size, entry->mtime_ns,
+                     entry->crc, (entry->gzip) ? 1 : 0, entry->path);
+    }
+    int err = ferror(f);
+    if ((fclose(f) != 0) || (err)) {
+        fprintf(stderr, "error: failed to write '%s'\n", name);
+        remove(name);
+        return -1;
+    }
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------
+int mkfs_manifest_load(mkfs_tree_t *old, const char *name, const char *params, const char *image_name)
+{
+    FILE *f = fopen(name, "r");
+    if (f == NULL) return -1;
+
+    char header[1024];
+    bool valid = manifest_header(header, sizeof(header), params, image_name);
+    char *line = xrealloc(NULL, MKFS_MANIFEST_LINE);
+    // header lines
+    char *hdr = header;
+    while ((valid) && (*hdr)) {
+        size_t len = strcspn(hdr, "\n") + 1;
+        if ((fgets(line, MKFS_MANIFEST_LINE, f) == NULL) || (strlen(line) != len) || (strncmp(line, hdr, len) != 0)) valid = false;
+        hdr += len;
+    }
+    while ((valid) && (fgets(line, MKFS_MANIFEST_LINE, f) != NULL)) {
+        size_t len = strlen(line);
+        if ((len == 0) || (line[len - 1] != '\n')) {
+            valid = false;
+            break;
+        }
+        line[len - 1] = '\0';
+        mkfs_entry_t entry;
+        memset(&entry, 0, sizeof(mkfs_entry_t));
+        int gzip = 0;
+        int pos = 0;
+        if (line[0] == 'D') {
+            entry.is_dir = true;
+            if (sscanf(line, "D %" SCNd64 " %n", &entry.mtime_ns, &pos) != 1) pos = 0;
+        }
+        else if (sscanf(line, "F %" SCNu64 " %" SCNd64 " %" SCNx32 " %d %n",
+                        &entry.size, &entry.mtime_ns, &entry.crc, &gzip, &pos) != 4) pos = 0;
+        if ((pos == 0) || (line[pos] != '/')) {
+            valid = false;
+            break;
+        }
+        mkfs_entry_t *e = tree_add(old);
+        *e = entry;
+        e->path = strdup(line + pos);
+        e->gzip = (gzip != 0);
+        e->peer = -1;
+    }
+    free(line);
+    fclose(f);
+    // used only once
+    remove(name);
+
+    if (!valid) {
+        mkfs_tree_free(old);
+        return -1;
+    }
+    qsort(old->entries, old->count, sizeof(mkfs_entry_t), entry_cmp);
+    return 0;
+}
+
+//--------------------------------------------------------
+void mkfs_tree_match(mkfs_tree_t *tree, mkfs_tree_t *old)
+{
+    size_t i = 0;
+    size_t j = 0;
+    while ((i < tree->count) && (j < old->count)) {
+        mkfs_entry_t *entry = &tree->entries[i];
+        mkfs_entry_t *prev = &old->entries[j];
+        int res = path_cmp(entry->path, prev->path);
+        if (res < 0) i++;
+        else if (res > 0) j++;
+        else {
+            entry->peer = j;
+            prev->peer = i;
+            if (entry->is_dir == prev->is_dir) {
+                entry->state = MKFS_CHANGED;
+                if ((entry->mtime_ns == prev->mtime_ns) && (entry->size == prev->size)) {
+                    entry->state = MKFS_UNCHANGED;
+                    entry->crc = prev->crc;
+                    entry->gzip = prev->gzip;
+                }
+            }
+            i++;
+            j++;
+        }
+    }
+}
+
+//------------------------------------------------------------------------------
+void mkfs_tree_compare(mkfs_tree_t *tree, const mkfs_tree_t *old, bool mtime_stored)
+{
+    // all files get the same time stamp
+    if (mkfs_source_date_epoch(NULL)) mtime_stored = false;
+
+    for (size_t i = 0; i < tree->count; i++) {
+        mkfs_entry_t *entry = &tree->entries[i];
+        if ((entry->state != MKFS_CHANGED) || (entry->error)) continue;
+        const mkfs_entry_t *prev = &old->entries[entry->peer];
+        if ((mtime_stored) && ((entry->mtime_ns / 1000000000) != (prev->mtime_ns / 1000000000))) continue;
+        if ((entry->is_dir) || ((entry->size == prev->size) && (entry->crc == prev->crc) && (entry->gzip == prev->gzip))) {
+            // only touched
+            entry->state = MKFS_UNCHANGED;
+            free(entry->data);
+            entry->data = NULL;
+        }
+    }
+}
+
+//--------------------------------------
+void mkfs_tree_reset(mkfs_tree_t *tree)
+{
+    for (size_t i = 0; i < tree->count; i++) tree->entries[i].state = MKFS_NEW;
+}
+
+//--------------------------------------------------------------------------------
+bool mkfs_tree_stale(const mkfs_tree_t *old, size_t index, const mkfs_tree_t *tree)
+{
+    const mkfs_entry_t *prev = &old->entries[index];
+    if (prev->peer < 0) return true;
+    const mkfs_entry_t *entry = &tree->entries[prev->peer];
+    if (entry->is_dir != prev->is_dir) return true;
+    // stored under the other name
+    return ((!prev->is_dir) && (entry->gzip != prev->gzip));
+}
+
+
+// === gzip compression ===
+// Files with extensions from the '-z' list are stored gzip compressed as '<name>.gz'.
+// The deflate stream is fully flushed every GZ_RP_CHUNK input bytes and the compressed
+// offsets of those restart points are stored in the gzip header extra field,
+// subfield 'R','P': wbits (1 byte), reserved (3 bytes), chunk size (4 bytes), offsets (4 bytes each),
+// all little endian. The MicroPython file layer uses them to seek in the compressed file.
+// Small window is used to reduce the RAM needed for decompression on the device.
+
+#define GZ_WBITS        12
+#define GZ_RP_CHUNK     16384
+#define GZ_MAX_POINTS   16000
+
+//-----------------------------------------
+static void gz_put32(uint8_t *buf, uint32_t val)
+{
+    buf[0] = val & 0xFF;
+    buf[1] = (val >> 8) & 0xFF;
+    buf[2] = (val >> 16) & 0xFF;
+    buf[3] = (val >> 24) & 0xFF;
+}
+
+//-----------------------------------------------------------
+bool mkfs_gz_match(const char *name, const char *compress_ext)
+{
+    size_t nlen = strlen(name);
+    const char *ext = compress_ext;
+    while (*ext) {
+        size_t elen = strcspn(ext, ",");
+        if ((elen > 0) && (elen <= nlen)) {
+            size_t i;
+            for (i = 0; i < elen; i++) {
+                if (tolower((unsigned char)name[nlen - elen + i]) != tolower((unsigned char)ext[i])) break;
+            }
+            if (i == elen) return true;
+        }
+        ext += elen;
+        if (*ext == ',') ext++;
+    }
+    return false;
+}
+
+//------------------------------------------------------------------------
+// Compress the buffer to gzip format with the restart points index
+// Returns the allocated gzip data or NULL on error
+//------------------------------------------------------------------------
+uint8_t *mkfs_gz_compress(const uint8_t *src, size_t len, size_t *out_len)
+{
+    uint32_t chunk = GZ_RP_CHUNK;
+    while (((len / chunk) + 1) > GZ_MAX_POINTS) chunk *= 2;
+    uint32_t n_points = (len + chunk - 1) / chunk;
+    if (n_points == 0) n_points = 1;
+    size_t hdr_len = 10 + 2 + 4 + 8 + (4 * n_points);
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(z_stream));
+    if (deflateInit2(&strm, Z_BEST_COMPRESSION, Z_DEFLATED, -GZ_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK) return NULL;
+
+    // every full flush adds an empty stored block
+    size_t data_max = deflateBound(&strm, len) + (n_points * 16);
+    uint8_t *out = malloc(hdr_len + data_max + 8);
+    if (out == NULL) {
+        deflateEnd(&strm);
+        return NULL;
+    }
+    strm.next_out = out + hdr_len;
+    strm.avail_out = data_max;
+
+    for (uint32_t i = 0; i < n_points; i++) {
+        // restart point
+        gz_put32(out + 24 + (i * 4), strm.total_out);
+        size_t n = ((len - (i * chunk)) > chunk) ? chunk : (len - (i * chunk));
+        strm.next_in = (len) ? (uint8_t *)src + (i * chunk) : Z_NULL;
+        strm.avail_in = n;
+        int last = (i == (n_points - 1));
+        int res = deflate(&strm, (last) ? Z_FINISH : Z_FULL_FLUSH);
+        if ((last) ? (res != Z_STREAM_END) : ((res != Z_OK) || (strm.avail_in != 0) || (strm.avail_out == 0))) {
+            deflateEnd(&strm);
+            free(out);
+            return NULL;
+        }
+    }
+    size_t data_len = strm.total_out;
+    deflateEnd(&strm);
+
+    // gzip header; MTIME is 0, so the same file always gives the same output
+    uint8_t *hdr = out;
+    memset(hdr, 0, 10);
+    hdr[0] = 0x1f;
+    hdr[1] = 0x8b;
+    hdr[2] = 8;     // deflate
+    hdr[3] = 0x04;  // FEXTRA
+    hdr[8] = 2;     // maximum compression
+    hdr[9] = 3;     // Unix
+    uint32_t sub_len = 8 + (4 * n_points);
+    hdr[10] = (sub_len + 4) & 0xFF;
+    hdr[11] = ((sub_len + 4) >> 8) & 0xFF;
+    hdr[12] = 'R';
+    hdr[13] = 'P';
+    hdr[14] = sub_len & 0xFF;
+    hdr[15] = (sub_len >> 8) & 0xFF;
+    hdr[16] = GZ_WBITS;
+    hdr[17] = hdr[18] = hdr[19] = 0;
+    gz_put32(hdr + 20, chunk);
+
+    // trailer
+    uint8_t *trailer = out + hdr_len + data_len;
+    gz_put32(trailer, crc32(crc32(0L, Z_NULL, 0), (len) ? src : Z_NULL, len));
+    gz_put32(trailer + 4, (uint32_t)len);
+
+    *out_len = hdr_len + data_len + 8;
+    return out;
+}
@@ -0,0 +1,134 @@
+/*
+ * Common front end of the host image builders (mkspiffs, mklfs, mkfatfs)
+ *
+ * This file is part of the MicroPython ESP32 project, https://github.com/loboris/MicroPython_ESP32_psRAM_LoBo
+ *
+ * Copyright (c) 2018 LoBo (https://github.com/loboris)
+ *
+ * The MIT License (MIT)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * The source directory is scanned and the files are read (and gzip compressed)
+ * by a pool of threads, the file system library of the tool then only copies
+ * the prepared data into the image, in the same order on every run:
+ * sorted by name in each directory, directory content after the directory.
+ *
+ * With a manifest (-m) the image is updated in place on the next run:
+ * only new and changed files are written, removed files are deleted.
+ * The files of an updated image are the same as in a new image,
+ * the block layout is not; create a new image for the release builds.
+ */
+
+#ifndef _MKFS_TREE_H_
+#define _MKFS_TREE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MKFS_MAX_THREADS    16
+
+// State of the entry, compared to the previous build
+enum { MKFS_NEW = 0, MKFS_CHANGED, MKFS_UNCHANGED };
+
+typedef struct {
+    char *path;         // path in the image, '/dir/name'
+    char *src;          // source file path, NULL for the manifest entries
+    bool is_dir;
+    bool gzip;          // stored gzip compressed as '<path>.gz'
+    int state;
+    int error;          // errno of the failed read, 0 if read
+    uint64_t size;      // source file size
+    int64_t mtime_ns;   // source file modification time, in ns
+    uint32_t crc;       // crc32 of the source file content
+    uint8_t *data;      // data to store in the image (compressed if 'gzip'), NULL if not read
+    size_t data_size;
+    long peer;          // index of the entry with the same path in the other tree, -1 if none
+} mkfs_entry_t;
+
+typedef struct {
+    mkfs_entry_t *entries;
+    size_t count;
+    size_t max;
+} mkfs_tree_t;
+
+// Returns true if the directory entry with this name is not added to the image
+typedef bool (*mkfs_skip_t)(const char *name);
+
+// Number of threads to use, 'requested' or the number of CPUs if 0
+int mkfs_threads(int requested);
+
+double mkfs_ms_now(void);
+
+// SOURCE_DATE_EPOCH, if set, is the time stamp of all files (reproducible builds)
+bool mkfs_source_date_epoch(int64_t *epoch);
+
+// Scan the source directory 'root', the tree is sorted in the image order
+// Returns 0 on success
+int mkfs_tree_scan(mkfs_tree_t *tree, const char *root, mkfs_skip_t skip, int n_threads);
+
+// Read all files which are not MKFS_UNCHANGED and not read yet,
+// files with extensions from 'compress_ext' are compressed if that makes them smaller.
+// Returns 0 if all files were read, the failed ones have 'error' set
+int mkfs_tree_read(mkfs_tree_t *tree, const char *compress_ext, int n_threads);
+
+void mkfs_tree_free(mkfs_tree_t *tree);
+
+// Name of the entry in the image, '<path>' or '<path>.gz'
+const char *mkfs_stored_name(const mkfs_entry_t *entry, char *buf, size_t len);
+
+// === Incremental build ===
+// 'params' are the tool name and the options which change the image format.
+// The manifest of the previous build is loaded only if it was written for the same
+// 'params' and the image was not changed since. It is removed when loaded,
+// the next build then can't be based on an image which was not completed.
+// Returns 0 if loaded
+int mkfs_manifest_load(mkfs_tree_t *old, const char *name, const char *params, const char *image_name);
+int mkfs_manifest_save(const mkfs_tree_t *tree, const char *name, const char *params, const char *image_name);
+
+// Match the entries of the scanned and the previous tree; files with the same size
+// and modification time are MKFS_UNCHANGED and are not read by mkfs_tree_read
+void mkfs_tree_match(mkfs_tree_t *tree, mkfs_tree_t *old);
+
+// After mkfs_tree_read: files with the same content are MKFS_UNCHANGED,
+// unless the modification time is stored in the image ('mtime_stored') and was changed
+void mkfs_tree_compare(mkfs_tree_t *tree, const mkfs_tree_t *old, bool mtime_stored);
+
+// Mark all entries as new, for building a new image after the failed update
+void mkfs_tree_reset(mkfs_tree_t *tree);
+
+// Returns true if the entry 'index' of the previous build must be removed from the image
+bool mkfs_tree_stale(const mkfs_tree_t *old, size_t index, const mkfs_tree_t *tree);
+
+// === gzip compression ===
+bool mkfs_gz_match(const char *name, const char *compress_ext);
+uint8_t *mkfs_gz_compress(const uint8_t *src, size_t len, size_t *out_len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2634,7 +2634,9 @@ int lfs_deorphan(lfs_t *lfs) {
 
 //------------------------------------------------------
 static uint8_t lfs_dir_compute_attribute(uint8_t *buf) {
-	time_t now = time(NULL);
+	// SOURCE_DATE_EPOCH, if set, gives reproducible image time stamps
+	const char *epoch = getenv("SOURCE_DATE_EPOCH");
+	time_t now = ((epoch) && (*epoch)) ? (time_t)strtoll(epoch, NULL, 10) : time(NULL);
 	buf[0] = LFS_ATTRIBUTE_TIME;
 	buf[1] = now & 0xFF;
 	buf[2] = (now >> 8) & 0xFF;
@@ -28,6 +28,7 @@
 
 #include "lfs.h"
 #include "lfs_util.h"
+#include "mkfs_tree.h"
 
 #include <stdio.h>
 #include <inttypes.h>
@@ -36,8 +37,13 @@
 #include <string.h>
 #include <errno.h>
 #include <unistd.h>
-#include <dirent.h>
 #include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
 
 //#include "wear_levelling.h"
 
@@ -53,10 +59,34 @@ static char image_name[256] = {0};
 static char image_dir[256] = {0};
 static uint32_t fs_offset = 0;
 
+// Image file, mapped into memory (read into memory on Windows)
+enum { IMG_READ, IMG_CREATE, IMG_UPDATE };
+static size_t img_size = 0;
+static int img_fd = -1;
+static int img_mode = IMG_READ;
+
+enum { ACTION_PACK, ACTION_LIST, ACTION_UNPACK, ACTION_VERIFY };
+static int action = ACTION_PACK;
+static bool report = false;
+
 static uint32_t *erase_log = NULL;
 static uint32_t *prog_log = NULL;
 static uint32_t *read_log = NULL;
 
+static uint32_t n_files = 0;
+static uint64_t n_bytes = 0;
+
+static char compress_ext[256] = {0};
+static uint32_t n_gz_files = 0;
+static uint64_t n_gz_in = 0;
+static uint64_t n_gz_out = 0;
+
+// Source directory, scanned and read by the front end
+static mkfs_tree_t src_tree = {0};
+static int n_threads = 0;
+static char manifest_name[256] = {0};
+static uint32_t n_unchanged = 0;
+static uint32_t n_removed = 0;
 
 // === Image access functions ===
 
@@ -94,222 +124,469 @@ int lfs_img_sync(const struct lfs_config *cfg)
 
 // === File functions ===================
 
-//---------------------------------------
-int addFile(char* name, const char* path)
+//--------------------------------------------------------------------------
+// Write the buffer to the lfs file, the file is created or replaced
+//--------------------------------------------------------------------------
+static int write_lfs_file(const char *name, const uint8_t *buf, size_t size)
+{
+    lfs_file_t file;
+    int err = lfs_file_open(&lfs, &file, name, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    if (err < 0) return err;
+    lfs_ssize_t res = lfs_file_write(&lfs, &file, buf, size);
+    err = lfs_file_close(&lfs, &file);
+    if (res < 0) return res;
+    return err;
+}
+
+//--------------------------------------------------------------------------
+// Add the file read by the front end, compressed files as '<name>.gz'
+//--------------------------------------------------------------------------
+static int addFile(const mkfs_entry_t *entry)
 {
-    FILE* src = fopen(path, "rb");
-    if (!src) {
-        printf("error: failed to open '%s' for reading\r\n", path);
+    char name[512];
+
+    if (entry->error) {
+        printf("error: failed to read '%s' (%s)\r\n", entry->src, strerror(entry->error));
+        return 1;
+    }
+    int err = write_lfs_file(mkfs_stored_name(entry, name, sizeof(name)), entry->data, entry->data_size);
+    if (err < 0) {
+        printf("lfs_file_write error (%d)\r\n", err);
         return 1;
     }
+    if (entry->gzip) {
+        printf("  compressed: %u -> %u bytes\r\n", (uint32_t)entry->size, (uint32_t)entry->data_size);
+        n_gz_files++;
+        n_gz_in += entry->size;
+        n_gz_out += entry->data_size;
+    }
+    n_files++;
+    n_bytes += entry->size;
+    return 0;
+}
 
-    lfs_file_t *file = (lfs_file_t *) malloc(sizeof(lfs_file_t));
-    if (file == NULL) {
-        printf("error: failed to open lfs file '%s' for writting\r\n", name);
-        return 2;
+//-----------------------------------------------------
+// Add the new and changed entries of the source tree,
+// in the image order
+//-----------------------------------------------------
+static int addFiles(void)
+{
+    for (size_t i = 0; i < src_tree.count; i++) {
+        const mkfs_entry_t *entry = &src_tree.entries[i];
+        if (entry->state == MKFS_UNCHANGED) {
+            n_unchanged++;
+            continue;
+        }
+        if (entry->is_dir) {
+            printf("%s [D]\r\n", entry->path);
+            int err = lfs_mkdir(&lfs, entry->path);
+            if ((err < 0) && (err != LFS_ERR_EXIST)) {
+                printf("error adding directory (%d)!\r\n", err);
+                return 1;
+            }
+            continue;
+        }
+        printf("%s\r\n", entry->path);
+        if (addFile(entry) != 0) {
+            printf("error adding file!\r\n");
+            return 1;
+        }
     }
+    return 0;
+}
 
-    int lfs_flags = LFS_O_WRONLY | LFS_O_CREAT;
-    int err = lfs_file_open(&lfs, file, name, lfs_flags);
-    if (err < 0)
-    {
-        free(file);
-        return 3;
+//----------------------------------------------------------------
+// Remove the entries of the previous build which are not needed,
+// the directory content before the directory
+//----------------------------------------------------------------
+static int removeFiles(const mkfs_tree_t *old)
+{
+    char name[512];
+
+    for (size_t i = old->count; i-- > 0;) {
+        if (!mkfs_tree_stale(old, i, &src_tree)) continue;
+        mkfs_stored_name(&old->entries[i], name, sizeof(name));
+        printf("%s [removed]\r\n", name);
+        int err = lfs_remove(&lfs, name);
+        if ((err < 0) && (err != LFS_ERR_NOENT)) {
+            printf("error removing '%s' (%d)\r\n", name, err);
+            return 1;
+        }
+        n_removed++;
     }
+    return 0;
+}
 
-    // read file size
-    fseek(src, 0, SEEK_END);
-    size_t size = ftell(src);
-    fseek(src, 0, SEEK_SET);
 
-    size_t left = size;
-    uint8_t data_byte;
-    while (left > 0){
-        if (1 != fread(&data_byte, 1, 1, src)) {
-            printf("fread error!\r\n");
+//-------------------------------------------------------------
+// Open the image file and map it into memory.
+// A new image is created with all bytes set to 0xFF (erased flash).
+// Existing images are mapped copy-on-write, the file is never changed,
+// unless the image of the previous build is updated.
+//-------------------------------------------------------------
+static int img_open(const char *name, int mode)
+{
+    img_mode = mode;
+    int flags = O_RDONLY;
+    if (mode == IMG_CREATE) flags = O_RDWR | O_CREAT | O_TRUNC;
+    else if (mode == IMG_UPDATE) flags = O_RDWR;
+    img_fd = open(name, flags, 0644);
+    if (img_fd < 0) {
+        printf("error: failed to open '%s'\r\n", name);
+        return -1;
+    }
+#ifdef _WIN32
+    setmode(img_fd, O_BINARY);
+#endif
 
-            fclose(src);
-            lfs_file_close(&lfs, file);
-            free(file);
-            return 1;
+    if (mode == IMG_CREATE) {
+        img_size = fs_offset + ((size_t)block_size * block_count);
+    }
+    else {
+        struct stat st;
+        if (fstat(img_fd, &st) != 0) {
+            printf("error: can't stat '%s'\r\n", name);
+            return -1;
         }
-        lfs_ssize_t res = lfs_file_write(&lfs, file, &data_byte, 1);
-        if (res < 0) {
-            printf("SPIFFS_write error (%d)\r\n", res);
-
-            fclose(src);
-            lfs_file_close(&lfs, file);
-            free(file);
-            return 1;
+        img_size = st.st_size;
+        if (block_count == 0) block_count = (img_size - fs_offset) / block_size;
+        if ((img_size < fs_offset) || ((img_size - fs_offset) < ((size_t)block_size * block_count))) {
+            printf("error: image is smaller than %u blocks of %u bytes\r\n", block_count, block_size);
+            return -1;
+        }
+        if ((mode == IMG_UPDATE) && (img_size != (fs_offset + ((size_t)block_size * block_count)))) {
+            printf("error: image size is not %u blocks of %u bytes\r\n", block_count, block_size);
+            return -1;
         }
-        left -= 1;
     }
 
-    lfs_file_close(&lfs, file);
-    free(file);
+#ifdef _WIN32
+    lfs_image = malloc(img_size);
+    if (lfs_image == NULL) return -1;
+    if ((mode != IMG_CREATE) && (read(img_fd, lfs_image, img_size) != (int)img_size)) {
+        printf("error: failed to read '%s'\r\n", name);
+        return -1;
+    }
+#else
+    if ((mode == IMG_CREATE) && (ftruncate(img_fd, img_size) != 0)) {
+        printf("error: failed to resize '%s'\r\n", name);
+        return -1;
+    }
+    void *map = mmap(NULL, img_size, PROT_READ | PROT_WRITE, (mode == IMG_READ) ? MAP_PRIVATE : MAP_SHARED, img_fd, 0);
+    if (map == MAP_FAILED) {
+        printf("error: failed to map '%s'\r\n", name);
+        return -1;
+    }
+    lfs_image = (uint8_t *)map;
+#endif
+    if (mode == IMG_CREATE) memset(lfs_image, 0xFF, img_size);
 
     return 0;
 }
 
-//--------------------
-int addDir(char* name)
+//--------------------------
+static int img_close(void)
 {
-    int err = lfs_mkdir(&lfs, name);
+    int err = 0;
+    if (lfs_image) {
+#ifdef _WIN32
+        if ((img_mode != IMG_READ) && ((lseek(img_fd, 0, SEEK_SET) != 0) || (write(img_fd, lfs_image, img_size) != (int)img_size))) err = -1;
+        free(lfs_image);
+#else
+        if (img_mode != IMG_READ) err = msync(lfs_image, img_size, MS_SYNC);
+        munmap(lfs_image, img_size);
+#endif
+        lfs_image = NULL;
+    }
+    if (img_fd >= 0) close(img_fd);
+    img_fd = -1;
+    if (err) printf("error: failed to write '%s'\r\n", image_name);
     return err;
 }
 
 //----------------------------------------------------
-int addFiles(const char* dirname, const char* subPath)
+static void lfs_img_config(struct lfs_config *cfg)
 {
-    DIR *dir;
-    struct dirent *ent;
-    bool error = false;
-    char dirPath[512] = {0};
-    char dirpath[512] = {0};
-    char newSubPath[512] = {0};
-    char filepath[512] = {0};
-    char fullpath[512] = {0};
-
-    sprintf(dirPath, "%s", dirname);
-    strcat(dirPath, subPath);
-
-    // Open directory
-    if ((dir = opendir(dirPath)) != NULL) {
-        // Read files from directory.
-        while ((ent = readdir (dir)) != NULL) {
-
-            // Ignore directory itself.
-            if ((strcmp(ent->d_name, ".") == 0) || (strcmp(ent->d_name, "..") == 0)) {
-                continue;
-            }
-
-            sprintf(fullpath, "%s", dirPath);
-            strcat(fullpath, ent->d_name);
-            struct stat path_stat;
-            stat(fullpath, &path_stat);
-
-            if (!S_ISREG(path_stat.st_mode)) {
-                // Check if path is a directory.
-                if (S_ISDIR(path_stat.st_mode)) {
-                    sprintf(dirpath, "%s", subPath);
-                    strcat(dirpath, ent->d_name);
-                    printf("%s [D]\r\n", dirpath);
-                    int res = addDir(dirpath);
-                    if (res != 0) {
-                        printf("error adding directory (open)!\r\n");
-                        error = true;
-                        break;
-                    }
-                    // Prepare new sub path.
-                    sprintf(newSubPath, "%s", subPath);
-                    strcat(newSubPath, ent->d_name);
-                    strcat(newSubPath, "/");
-
-                    if (addFiles(dirname, newSubPath) != 0) {
-                        printf("Error for adding content from '%s' !\r\n", ent->d_name);
-                    }
-
-                    continue;
-                }
-                else {
-                    printf("skipping '%s'\r\n", ent->d_name);
-                    continue;
-                }
-            }
+    cfg->lookahead = lookahead;
+    cfg->block_count = block_count;
+    cfg->block_size = block_size;
+    cfg->prog_size = block_size;
+    cfg->read_size = block_size;
 
-            // File path with directory name as root folder.
-            sprintf(filepath, "%s", subPath);
-            strcat(filepath, ent->d_name);
-            printf("%s\r\n", filepath);
+    // setup function pointers
+    cfg->read  = lfs_img_read;
+    cfg->prog  = lfs_img_prog;
+    cfg->erase = lfs_img_erase;
+    cfg->sync  = lfs_img_sync;
 
-            // Add File to image.
-            if (addFile(filepath, fullpath) != 0) {
-                printf("error adding file!\r\n");
-                error = true;
-                break;
-            }
-        } // end while
-        closedir(dir);
+    // Zeroed cache buffers: the unused bytes of the programmed blocks are
+    // copied from them, the same directory then always gives the same image.
+    // Only one file is opened at a time.
+    if (cfg->read_buffer == NULL) {
+        cfg->read_buffer = calloc(1, cfg->read_size);
+        cfg->prog_buffer = calloc(1, cfg->prog_size);
+        cfg->lookahead_buffer = calloc(1, cfg->lookahead / 8);
+        cfg->file_buffer = calloc(1, cfg->prog_size);
     }
-    else {
-        printf("warning: can't read source directory\r\n");
-        return 1;
+
+    if (report) {
+        read_log = calloc(block_count, sizeof(uint32_t));
+        prog_log = calloc(block_count, sizeof(uint32_t));
+        erase_log = calloc(block_count, sizeof(uint32_t));
     }
+}
+
+// === Image inspection functions ===
+
+static uint8_t *used_map = NULL;
+static uint32_t n_dup_blocks = 0;
+static uint32_t n_bad_blocks = 0;
+static uint32_t n_errors = 0;
+static uint32_t n_dirs = 0;
 
-    return (error) ? 1 : 0;
+//-----------------------------------------------------
+static int traverse_cb(void *data, lfs_block_t block)
+{
+    if (block >= block_count) {
+        n_bad_blocks++;
+        return 0;
+    }
+    if (used_map[block]) n_dup_blocks++;
+    used_map[block] = 1;
+    return 0;
 }
 
+//----------------------------------------------
+// Mark all blocks referenced by the file system
+//----------------------------------------------
+static int mark_used_blocks(void)
+{
+    if (used_map == NULL) used_map = malloc(block_count);
+    if (used_map == NULL) return LFS_ERR_NOMEM;
+    memset(used_map, 0, block_count);
+    n_dup_blocks = 0;
+    n_bad_blocks = 0;
+    return lfs_traverse(&lfs, traverse_cb, NULL);
+}
 
-//----------------------------------------
-int lfs_img_create(struct lfs_config *cfg)
+//---------------------------------
+// Print block usage and wear report
+// Counters are the block device accesses made by this run
+//---------------------------------
+static void block_report(void)
 {
-    lfs_image = malloc(cfg->block_size * cfg->block_count);
-    if (lfs_image == NULL) return -1;
+    int err = mark_used_blocks();
+    if (err) {
+        printf("Error traversing file system (%d)\r\n", err);
+        return;
+    }
+    uint32_t n_used = 0;
+    for (uint32_t i = 0; i < block_count; i++) {
+        if (used_map[i]) n_used++;
+    }
 
-    for (int i=0; i<cfg->block_count; i++) {
-        memset(lfs_image+(i*cfg->block_size), 0xFF, cfg->block_size);
+    printf("Block usage: %u of %u blocks used ('#' used, '.' free)\r\n", n_used, block_count);
+    for (uint32_t i = 0; i < block_count; i++) {
+        if ((i % 64) == 0) printf("  %5u: ", i);
+        printf("%c", (used_map[i]) ? '#' : '.');
+        if (((i % 64) == 63) || (i == (block_count-1))) printf("\r\n");
     }
 
-    // setup function pointers
-    cfg->read  = lfs_img_read;
-    cfg->prog  = lfs_img_prog;
-    cfg->erase = lfs_img_erase;
-    cfg->sync  = lfs_img_sync;
+    if ((read_log) && (prog_log) && (erase_log)) {
+        uint64_t t_read = 0, t_prog = 0, t_erase = 0;
+        uint32_t max_erase = 0;
+        printf("\r\nBlock   reads   progs  erases\r\n");
+        for (uint32_t i = 0; i < block_count; i++) {
+            if ((read_log[i] == 0) && (prog_log[i] == 0) && (erase_log[i] == 0)) continue;
+            printf("%5u %7u %7u %7u\r\n", i, read_log[i], prog_log[i], erase_log[i]);
+            t_read += read_log[i];
+            t_prog += prog_log[i];
+            t_erase += erase_log[i];
+            if (erase_log[i] > max_erase) max_erase = erase_log[i];
+        }
+        printf("Total %7" PRIu64 " %7" PRIu64 " %7" PRIu64 ", max erases per block: %u\r\n", t_read, t_prog, t_erase, max_erase);
+    }
+    printf("\r\n");
+}
 
-    return 0;
+//-----------------------------------------------------------------------
+// Read the file from the image, write it to 'dest' if not NULL
+// Returns the crc32 of the file content in 'crc'
+//-----------------------------------------------------------------------
+static int read_lfs_file(const char *path, FILE *dest, uint32_t *crc)
+{
+    lfs_file_t file;
+    uint8_t *buf = malloc(block_size);
+    if (buf == NULL) return LFS_ERR_NOMEM;
+
+    int err = lfs_file_open(&lfs, &file, path, LFS_O_RDONLY);
+    if (err < 0) {
+        free(buf);
+        return err;
+    }
+    *crc = 0xffffffff;
+    while (1) {
+        lfs_ssize_t res = lfs_file_read(&lfs, &file, buf, block_size);
+        if (res < 0) {
+            err = res;
+            break;
+        }
+        if (res == 0) break;
+        lfs_crc(crc, buf, res);
+        if ((dest) && (fwrite(buf, 1, res, dest) != (size_t)res)) {
+            err = LFS_ERR_IO;
+            break;
+        }
+    }
+    *crc ^= 0xffffffff;
+    lfs_file_close(&lfs, &file);
+    free(buf);
+    return err;
 }
 
-//----------------------
-int lfs_img_format(void)
+//-------------------------------------------------------
+// Walk the directory tree, list, unpack or verify files
+//-------------------------------------------------------
+static int walk_dir(const char *path, const char *dest)
 {
-    int err = lfs_img_create(&config);
+    lfs_dir_t dir;
+    struct lfs_info info;
+    char lfs_path[512];
+    char dest_path[512];
+
+    int err = lfs_dir_open(&lfs, &dir, path);
     if (err) {
+        printf("error: can't open directory '%s' (%d)\r\n", path, err);
+        n_errors++;
         return err;
     }
+    n_dirs++;
+
+    while ((err = lfs_dir_read(&lfs, &dir, &info)) > 0) {
+        if ((strcmp(info.name, ".") == 0) || (strcmp(info.name, "..") == 0)) continue;
+
+        snprintf(lfs_path, sizeof(lfs_path), "%s%s%s", path, (strcmp(path, "/") == 0) ? "" : "/", info.name);
+        if (dest) snprintf(dest_path, sizeof(dest_path), "%s%s", dest, lfs_path);
+
+        if (info.type == LFS_TYPE_DIR) {
+            if (action == ACTION_LIST) printf("%-10s %8s  %s/\r\n", "<DIR>", "", lfs_path);
+            if (dest) {
+#ifdef _WIN32
+                mkdir(dest_path);
+#else
+                mkdir(dest_path, 0755);
+#endif
+            }
+            walk_dir(lfs_path, dest);
+            continue;
+        }
 
-    err = lfs_format(&lfs, &config);
-
+        FILE *f = NULL;
+        if (dest) {
+            f = fopen(dest_path, "wb");
+            if (f == NULL) {
+                printf("error: failed to open '%s' for writting\r\n", dest_path);
+                n_errors++;
+                continue;
+            }
+        }
+        uint32_t crc = 0;
+        int res = read_lfs_file(lfs_path, f, &crc);
+        if (f) fclose(f);
+        if (res < 0) {
+            printf("error: reading '%s' failed (%d)\r\n", lfs_path, res);
+            n_errors++;
+            continue;
+        }
+        if ((action == ACTION_LIST) || (action == ACTION_UNPACK)) {
+            printf("%10u %08x  %s\r\n", info.size, crc, lfs_path);
+        }
+        n_files++;
+        n_bytes += info.size;
+    }
+    lfs_dir_close(&lfs, &dir);
+    if (err < 0) {
+        printf("error: reading directory '%s' failed (%d)\r\n", path, err);
+        n_errors++;
+    }
     return err;
 }
 
-//------------------
-int save_image(void)
+//-------------------------------------------------
+// Mount an existing image and list/unpack/verify it
+//-------------------------------------------------
+static int lfs_read_image(void)
 {
-    FILE* img_file = fopen(image_name, "wb");
-    if (!img_file) {
-        printf("error: failed to open '%s'\r\n", image_name);
+    double t_start = mkfs_ms_now();
+
+    int err = img_open(image_name, IMG_READ);
+    if (err) {
+        img_close();
         return 1;
     }
-    fwrite(lfs_image, 1, block_size * block_count, img_file);
-    fclose(img_file);
+    lfs_img_config(&config);
+    printf("Block size=%u, Block count=%u\r\n", block_size, block_count);
 
-    return 0;
-}
+    err = lfs_mount(&lfs, &config);
+    if (err) {
+        printf("Error mounting image (%d)\r\n", err);
+        img_close();
+        return 1;
+    }
+    double t_mount = mkfs_ms_now();
+
+    if (action == ACTION_UNPACK) {
+#ifdef _WIN32
+        mkdir(image_dir);
+#else
+        mkdir(image_dir, 0755);
+#endif
+    }
+    printf("----------------------------------\r\n");
+    walk_dir("/", (action == ACTION_UNPACK) ? image_dir : NULL);
+    printf("----------------------------------\r\n");
+
+    if (action == ACTION_VERIFY) {
+        err = mark_used_blocks();
+        if (err) {
+            printf("Error traversing file system (%d)\r\n", err);
+            n_errors++;
+        }
+        if (n_bad_blocks) printf("error: %u references to blocks outside of the file system\r\n", n_bad_blocks);
+        if (n_dup_blocks) printf("error: %u blocks referenced more than once\r\n", n_dup_blocks);
+        n_errors += n_bad_blocks + n_dup_blocks;
+    }
+    if (report) block_report();
+    double t_walk = mkfs_ms_now();
 
-//---------------------
-int lfs_img_mount(void)
-{
-    int err = 0;
+    lfs_unmount(&lfs);
+    img_close();
 
-    if (use_wl) fs_offset = 4096;
-    else fs_offset = 0;
+    printf("%u directories, %u files, %" PRIu64 " bytes, %u errors\r\n", n_dirs, n_files, n_bytes, n_errors);
+    printf("Time: mount %.1f ms, %s %.1f ms\r\n", t_mount - t_start,
+            (action == ACTION_LIST) ? "list" : ((action == ACTION_UNPACK) ? "unpack" : "verify"), t_walk - t_mount);
 
-    config.lookahead = lookahead;
-    config.block_count = block_count;
-    config.block_size = block_size;
-    config.prog_size = block_size;
-    config.read_size = block_size;
+    return (n_errors) ? 1 : 0;
+}
 
-    err = lfs_img_create(&config);
+//--------------------------------------------------------------------
+// Format the new image or mount the image of the previous build
+//--------------------------------------------------------------------
+int lfs_img_mount(bool update)
+{
+    int err = img_open(image_name, (update) ? IMG_UPDATE : IMG_CREATE);
     if (err) {
-        printf("Error creating image (%d)\r\n", err);
+        printf("Error %s image (%d)\r\n", (update) ? "opening" : "creating", err);
         return err;
     }
+    lfs_img_config(&config);
 
-    err = lfs_format(&lfs, &config);
-    if (err) {
-        printf("Error formating image (%d)\r\n", err);
-        return err;
+    if (!update) {
+        err = lfs_format(&lfs, &config);
+        if (err) {
+            printf("Error formating image (%d)\r\n", err);
+            return err;
+        }
     }
 
     err = lfs_mount(&lfs, &config);
@@ -320,28 +597,97 @@ int lfs_img_mount(void)
     return 0;
 }
 
+//-------------------------------------------------------------------------------
+// Create the new image, or update the image of the previous build if 'old' is set
+// Time of the phases is returned in 't_phase': format, add files, save image
+//-------------------------------------------------------------------------------
+static int lfs_build_image(const mkfs_tree_t *old, double *t_phase)
+{
+    double t_start = mkfs_ms_now();
+    int err = lfs_img_mount(old != NULL);
+    if (err) {
+        img_close();
+        return 1;
+    }
+    double t_format = mkfs_ms_now();
+
+    if (old) err = removeFiles(old);
+    if (err == 0) err = addFiles();
+    printf("\r\n");
+    if ((err == 0) && (report)) block_report();
+
+    int res = lfs_unmount(&lfs);
+    if (res) {
+        printf("Error unmounting image (%d)\r\n", res);
+        err = 1;
+    }
+    double t_add = mkfs_ms_now();
+
+    if (img_close() != 0) err = 1;
+    double t_save = mkfs_ms_now();
+
+    t_phase[0] = t_format - t_start;
+    t_phase[1] = t_add - t_format;
+    t_phase[2] = t_save - t_add;
+    return err;
+}
+
 //------------------------
 int lfs_create_image(void)
 {
     int err = 0;
+    mkfs_tree_t old = {0};
+    double t_phase[3] = {0};
+    char params[384];
 
-    err = lfs_img_mount();
-    if (err) return err;
+    snprintf(params, sizeof(params), "mklfs -b %u -c %u -l %u%s -z %s", block_size, block_count, lookahead,
+             (use_wl) ? " -w" : "", compress_ext);
+    n_threads = mkfs_threads(n_threads);
 
     printf("\r\nAdding files from image directory:\r\n");
     printf("  '%s'\r\n", image_dir);
     printf("----------------------------------\r\n\r\n");
-    addFiles(image_dir, "/");
-    printf("\r\n");
 
-    err = lfs_unmount(&lfs);
-    if (err) {
-        printf("Error unmounting image (%d)\r\n", err);
+    double t_start = mkfs_ms_now();
+    if (mkfs_tree_scan(&src_tree, image_dir, NULL, n_threads) != 0) return 1;
+    double t_scan = mkfs_ms_now();
+
+    // only the new and changed files are read when the previous image is updated
+    bool update = ((manifest_name[0]) && (mkfs_manifest_load(&old, manifest_name, params, image_name) == 0));
+    if (update) mkfs_tree_match(&src_tree, &old);
+    // read errors are reported when the file is added
+    mkfs_tree_read(&src_tree, compress_ext, n_threads);
+    if (update) mkfs_tree_compare(&src_tree, &old, false);
+    double t_read = mkfs_ms_now();
+
+    if (update) {
+        printf("Updating the image of the previous build\r\n");
+        err = lfs_build_image(&old, t_phase);
+        if (err) {
+            printf("Updating the image failed, creating a new image\r\n\r\n");
+            update = false;
+            n_files = n_gz_files = n_unchanged = n_removed = 0;
+            n_bytes = n_gz_in = n_gz_out = 0;
+            mkfs_tree_reset(&src_tree);
+            mkfs_tree_read(&src_tree, compress_ext, n_threads);
+        }
     }
+    if (!update) err = lfs_build_image(NULL, t_phase);
+    if ((err == 0) && (manifest_name[0])) mkfs_manifest_save(&src_tree, manifest_name, params, image_name);
 
-    save_image();
+    printf("%u files, %" PRIu64 " bytes added", n_files, n_bytes);
+    if (update) printf(", %u unchanged, %u removed", n_unchanged, n_removed);
+    printf("\r\n");
+    if (n_gz_files) {
+        printf("%u files compressed, %" PRIu64 " -> %" PRIu64 " bytes (%.1f%% saved)\r\n",
+                n_gz_files, n_gz_in, n_gz_out, (n_gz_in) ? (100.0 * (double)(n_gz_in - n_gz_out) / (double)n_gz_in) : 0.0);
+    }
+    printf("Time: scan %.1f ms, read %.1f ms (%d threads), %s %.1f ms, add files %.1f ms, save image %.1f ms\r\n",
+            t_scan - t_start, t_read - t_scan, n_threads, (update) ? "mount" : "format", t_phase[0], t_phase[1], t_phase[2]);
 
-    return 0;
+    mkfs_tree_free(&src_tree);
+    mkfs_tree_free(&old);
+    return err;
 }
 
 
@@ -353,7 +699,7 @@ int main(int argc, char **argv) {
     char *ptr;
 
     printf("\r\n");
-    while ( (c = getopt(argc, argv, "b:c:l:wT")) != -1) {
+    while ( (c = getopt(argc, argv, "b:c:l:wTLVu:rz:j:m:")) != -1) {
         switch (c) {
         case 'b':
             cvalue = optarg;
@@ -370,6 +716,28 @@ int main(int argc, char **argv) {
         case 'w':
             use_wl = true;
             break;
+        case 'L':
+            action = ACTION_LIST;
+            break;
+        case 'V':
+            action = ACTION_VERIFY;
+            break;
+        case 'u':
+            action = ACTION_UNPACK;
+            snprintf(image_dir, sizeof(image_dir), "%s", optarg);
+            break;
+        case 'r':
+            report = true;
+            break;
+        case 'z':
+            snprintf(compress_ext, sizeof(compress_ext), "%s", optarg);
+            break;
+        case 'j':
+            n_threads = (int)strtol(optarg, &ptr, 10);
+            break;
+        case 'm':
+            snprintf(manifest_name, sizeof(manifest_name), "%s", optarg);
+            break;
         case '?':
             break;
         default:
@@ -377,8 +745,30 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (argc < 2) {
+    if (use_wl) fs_offset = 4096;
+    else fs_offset = 0;
+
+    if (action != ACTION_PACK) {
+        if ((argc - optind) < 1) {
+            printf("Error: image name argument is mandatory\r\n");
+            printf("Usage: mklfs [-b block_size] [-c block_count] [-w] [-r] {-L | -V | -u dest_dir} image_name\r\n");
+            printf("\r\n");
+            return 1;
+        }
+        if (block_size == 0) block_size = 4096;
+        snprintf(image_name, sizeof(image_name), "%s", argv[optind]);
+
+        printf("%s LittleFS image '%s'\r\n", (action == ACTION_LIST) ? "Listing" : ((action == ACTION_UNPACK) ? "Unpacking" : "Verifying"), image_name);
+        printf("=======================\r\n");
+        int err = lfs_read_image();
+        printf("=======================\r\n");
+        printf("\r\n");
+        return err;
+    }
+
+    if ((argc - optind) < 2) {
         printf("Error: image directory and image name arguments are mandatory\r\n");
+        printf("Usage: mklfs -b block_size -c block_count [-l lookahead] [-w] [-r] [-z .ext1,.ext2,...] [-j threads] [-m manifest] image_dir image_name\r\n");
         printf("\r\n");
         return 1;
     }
@@ -391,6 +781,8 @@ int main(int argc, char **argv) {
     printf("Image directory:\r\n  '%s'\r\n", image_dir);
     printf("Image name:\r\n  '%s'\r\n", image_name);
     printf("Block size=%u, Block count=%u, lookahead=%u, use wear leveling: %s\r\n", block_size, block_count, lookahead, use_wl ? "True" : "False");
+    if (compress_ext[0]) printf("Compress files: %s\r\n", compress_ext);
+    if (manifest_name[0]) printf("Manifest:\r\n  '%s'\r\n", manifest_name);
 
     int err = lfs_create_image();
     printf("=======================\r\n");
@@ -22,6 +22,7 @@
 #include <cstdlib>
 #include "tclap/CmdLine.h"
 #include "tclap/UnlabeledValueArg.h"
+#include "mkfs_tree.h"
 
 #if defined (CONFIG_SPIFFS_USE_MTIME) || defined (CONFIG_SPIFFS_USE_DIR)
 /**
@@ -58,6 +59,21 @@ static std::vector<uint8_t> s_spiffsCache;
 static int s_debugLevel = 0;
 static bool s_addAllFiles;
 
+static unsigned int s_packFiles = 0;
+static unsigned long s_packBytes = 0;
+
+static std::string s_compressExt;
+static unsigned int s_gzFiles = 0;
+static unsigned long s_gzIn = 0;
+static unsigned long s_gzOut = 0;
+
+// Source directory, scanned and read by the front end
+static mkfs_tree_t s_srcTree = {0};
+static int s_threads = 0;
+static std::string s_manifestName;
+static unsigned int s_unchanged = 0;
+static unsigned int s_removed = 0;
+
 // Unless -a flag is given, these files/directories will not be included into the image
 static const char* ignored_file_names[] = {
     ".DS_Store",
@@ -149,12 +165,24 @@ void spiffsUnmount(){
     SPIFFS_unmount(&s_fs);
 }
 
-static void spiffs_update_meta(spiffs *fs, spiffs_file fd, u8_t type)
+// Time stamp stored in the image for the source file.
+// SOURCE_DATE_EPOCH, if set, is used for all files (reproducible builds)
+static time_t source_mtime(const mkfs_entry_t* entry)
+{
+    int64_t epoch;
+    if (mkfs_source_date_epoch(&epoch)) {
+        return (time_t)epoch;
+    }
+    return (time_t)(entry->mtime_ns / 1000000000);
+}
+
+static void spiffs_update_meta(spiffs *fs, spiffs_file fd, u8_t type, time_t mtime)
 {
+    (void)mtime;
 #if defined (CONFIG_SPIFFS_USE_MTIME) || defined (CONFIG_SPIFFS_USE_DIR)
     spiffs_meta_t meta;
 #ifdef CONFIG_SPIFFS_USE_MTIME
-    meta.mtime = time(NULL);
+    meta.mtime = mtime;
 #endif //CONFIG_SPIFFS_USE_MTIME
 
 #ifdef CONFIG_SPIFFS_USE_DIR
@@ -205,168 +233,134 @@ static int get_spiffs_stat(const char * path, struct stat * st)
 }
 */
 
-int addFile(char* name, const char* path) {
-    FILE* src = fopen(path, "rb");
-    if (!src) {
-        std::cerr << "error: failed to open " << path << " for reading" << std::endl;
+// Add the file read by the front end, compressed files as '<name>.gz'
+int addFile(const mkfs_entry_t* entry) {
+    char name[512];
+
+    if (entry->error) {
+        std::cerr << "error: failed to read " << entry->src << " (" << strerror(entry->error) << ")" << std::endl;
         return 1;
     }
-
+    mkfs_stored_name(entry, name, sizeof(name));
     spiffs_file dst = SPIFFS_open(&s_fs, name, SPIFFS_CREAT | SPIFFS_TRUNC | SPIFFS_RDWR, 0);
-    spiffs_update_meta(&s_fs, dst, SPIFFS_TYPE_FILE);
-
-    // read file size
-    fseek(src, 0, SEEK_END);
-    size_t size = ftell(src);
-    fseek(src, 0, SEEK_SET);
+    if (dst < 0) {
+        std::cerr << "SPIFFS_open error(" << s_fs.err_code << ")" << std::endl;
+        return 1;
+    }
+    spiffs_update_meta(&s_fs, dst, SPIFFS_TYPE_FILE, source_mtime(entry));
 
     if (s_debugLevel > 0) {
-        std::cout << "file size: " << size << std::endl;
+        std::cout << "file size: " << entry->size << std::endl;
     }
 
-    size_t left = size;
-    uint8_t data_byte;
-    while (left > 0){
-        if (1 != fread(&data_byte, 1, 1, src)) {
-            std::cerr << "fread error!" << std::endl;
+    // write in block sized chunks
+    int res = 0;
+    for (size_t pos = 0; (pos < entry->data_size) && (res >= 0); pos += s_blockSize) {
+        size_t len = ((entry->data_size - pos) > (size_t)s_blockSize) ? s_blockSize : (entry->data_size - pos);
+        res = SPIFFS_write(&s_fs, dst, entry->data + pos, len);
+    }
+    SPIFFS_close(&s_fs, dst);
+    if (res < 0) {
+        std::cerr << "SPIFFS_write error(" << s_fs.err_code << "): ";
+        if (s_fs.err_code == SPIFFS_ERR_FULL) {
+            std::cerr << "File system is full." << std::endl;
+        } else {
+            std::cerr << "unknown" << std::endl;
+        }
+        return 1;
+    }
+    if (entry->gzip) {
+        std::cout << "  compressed: " << entry->size << " -> " << entry->data_size << " bytes" << std::endl;
+        s_gzFiles++;
+        s_gzIn += entry->size;
+        s_gzOut += entry->data_size;
+    }
 
-            fclose(src);
-            SPIFFS_close(&s_fs, dst);
-            return 1;
+    s_packFiles++;
+    s_packBytes += entry->size;
+    return 0;
+}
+
+int addDir(const mkfs_entry_t* entry) {
+#ifdef CONFIG_SPIFFS_USE_DIR
+    std::cout << entry->path << " [D]"  << std::endl;
+    spiffs_file dst = SPIFFS_open(&s_fs, entry->path, SPIFFS_CREAT | SPIFFS_WRONLY, 0);
+    if (dst < 0) {
+        std::cerr << "error adding directory (open)!" << std::endl;
+        return 1;
+    }
+    spiffs_update_meta(&s_fs, dst, SPIFFS_TYPE_DIR, source_mtime(entry));
+    if (SPIFFS_close(&s_fs, dst) < 0) {
+        std::cerr << "error adding directory (close)!" << std::endl;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+// Unless -a flag is given, the ignored files/directories are not included into the image
+static bool skipName(const char* name) {
+    if (s_addAllFiles) {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(ignored_file_names) / sizeof(ignored_file_names[0]); ++i) {
+        if (strcmp(name, ignored_file_names[i]) == 0) {
+            return true;
         }
-        int res = SPIFFS_write(&s_fs, dst, &data_byte, 1);
-        if (res < 0) {
-            std::cerr << "SPIFFS_write error(" << s_fs.err_code << "): ";
+    }
+    return false;
+}
 
-            if (s_fs.err_code == SPIFFS_ERR_FULL) {
-                std::cerr << "File system is full." << std::endl;
-            } else {
-                std::cerr << "unknown";
+// Add the new and changed entries of the source tree, in the image order
+int addFiles() {
+    for (size_t i = 0; i < s_srcTree.count; i++) {
+        const mkfs_entry_t* entry = &s_srcTree.entries[i];
+        if (entry->state == MKFS_UNCHANGED) {
+            s_unchanged++;
+            continue;
+        }
+        if (entry->is_dir) {
+            if (addDir(entry) != 0) {
+                return 1;
             }
-            std::cerr << std::endl;
-
+            continue;
+        }
+        std::cout << entry->path << std::endl;
+        if (addFile(entry) != 0) {
+            std::cerr << "error adding file!" << std::endl;
             if (s_debugLevel > 0) {
-                std::cout << "data left: " << left << std::endl;
+                std::cout << std::endl;
             }
-
-            fclose(src);
-            SPIFFS_close(&s_fs, dst);
             return 1;
         }
-        left -= 1;
     }
-
-    SPIFFS_close(&s_fs, dst);
-    fclose(src);
-
     return 0;
 }
 
-int addFiles(const char* dirname, const char* subPath) {
-    DIR *dir;
-    struct dirent *ent;
-    bool error = false;
-    std::string dirPath = dirname;
-    dirPath += subPath;
-
-    // Open directory
-    if ((dir = opendir (dirPath.c_str())) != NULL) {
+// Remove the entries of the previous build which are not needed,
+// the directory content before the directory
+int removeFiles(const mkfs_tree_t* old) {
+    char name[512];
 
-        // Read files from directory.
-        while ((ent = readdir (dir)) != NULL) {
-
-            // Ignore dir itself.
-            if ((strcmp(ent->d_name, ".") == 0) || (strcmp(ent->d_name, "..") == 0)) {
+    for (size_t i = old->count; i-- > 0;) {
+        if (!mkfs_tree_stale(old, i, &s_srcTree)) {
+            continue;
+        }
+        mkfs_stored_name(&old->entries[i], name, sizeof(name));
+        int res = SPIFFS_remove(&s_fs, name);
+        if (res < 0) {
+            SPIFFS_clearerr(&s_fs);
+            // directories are not stored without CONFIG_SPIFFS_USE_DIR
+            if (res == SPIFFS_ERR_NOT_FOUND) {
                 continue;
             }
-
-            if (!s_addAllFiles) {
-                bool skip = false;
-                size_t ignored_file_names_count = sizeof(ignored_file_names) / sizeof(ignored_file_names[0]);
-                for (size_t i = 0; i < ignored_file_names_count; ++i) {
-                    if (strcmp(ent->d_name, ignored_file_names[i]) == 0) {
-                        std::cerr << "skipping " << ent->d_name << std::endl;
-                        skip = true;
-                        break;
-                    }
-                }
-                if (skip) {
-                    continue;
-                }
-            }
-
-            std::string fullpath = dirPath;
-            fullpath += ent->d_name;
-            struct stat path_stat;
-            stat (fullpath.c_str(), &path_stat);
-
-            if (!S_ISREG(path_stat.st_mode)) {
-                // Check if path is a directory.
-                if (S_ISDIR(path_stat.st_mode)) {
-#ifdef CONFIG_SPIFFS_USE_DIR
-                    std::string dirpath = subPath;
-                    dirpath += ent->d_name;
-                    std::cout << dirpath << " [D]"  << std::endl;
-                    spiffs_file dst = SPIFFS_open(&s_fs, (char*)dirpath.c_str(), SPIFFS_CREAT | SPIFFS_WRONLY, 0);
-                    if (dst < 0) {
-                        std::cerr << "error adding directory (open)!" << std::endl;
-                        error = true;
-                        if (s_debugLevel > 0) {
-                            std::cout << std::endl;
-                        }
-                        break;
-                    }
-                    spiffs_update_meta(&s_fs, dst, SPIFFS_TYPE_DIR);
-                    if (SPIFFS_close(&s_fs, dst) < 0) {
-                        std::cerr << "error adding directory (close)!" << std::endl;
-                        error = true;
-                        if (s_debugLevel > 0) {
-                            std::cout << std::endl;
-                        }
-                        break;
-                    }
-#endif
-                    // Prepare new sub path.
-                    std::string newSubPath = subPath;
-                    newSubPath += ent->d_name;
-                    newSubPath += "/";
-
-                    if (addFiles(dirname, newSubPath.c_str()) != 0)
-                    {
-                        std::cerr << "Error for adding content from " << ent->d_name << "!" << std::endl;
-                    }
-
-                    continue;
-                }
-                else
-                {
-                    std::cerr << "skipping " << ent->d_name << std::endl;
-                    continue;
-                }
-            }
-
-            // Filepath with dirname as root folder.
-            std::string filepath = subPath;
-            filepath += ent->d_name;
-            std::cout << filepath << std::endl;
-
-            // Add File to image.
-            if (addFile((char*)filepath.c_str(), fullpath.c_str()) != 0) {
-                std::cerr << "error adding file!" << std::endl;
-                error = true;
-                if (s_debugLevel > 0) {
-                    std::cout << std::endl;
-                }
-                break;
-            }
-        } // end while
-        closedir (dir);
-    } else {
-        std::cerr << "warning: can't read source directory" << std::endl;
-        return 1;
+            std::cerr << "error removing " << name << " (" << res << ")" << std::endl;
+            return 1;
+        }
+        std::cout << name << " [removed]" << std::endl;
+        s_removed++;
     }
-
-    return (error) ? 1 : 0;
+    return 0;
 }
 
 void listFiles() {
@@ -550,28 +544,131 @@ bool unpackFiles(std::string sDest) {
 
 // Actions
 
+// Create the new image, or update the image of the previous build if 'old' is set
+// Time of the phases is returned in 't_phase': format, add files, save image
+int buildImage(const mkfs_tree_t* old, double* t_phase) {
+    double t_start = mkfs_ms_now();
+    int result = 0;
+
+    s_flashmem.assign(s_imageSize, 0xff);
+    if (old) {
+        FILE* fdsrc = fopen(s_imageName.c_str(), "rb");
+        if ((!fdsrc) || (fread(&s_flashmem[0], 1, s_flashmem.size(), fdsrc) != s_flashmem.size())) {
+            std::cerr << "error: failed to read image file" << std::endl;
+            if (fdsrc) fclose(fdsrc);
+            return 1;
+        }
+        fclose(fdsrc);
+        if (!spiffsMount()) {
+            std::cerr << "error: failed to mount image" << std::endl;
+            return 1;
+        }
+    } else {
+        spiffsFormat();
+    }
+    double t_format = mkfs_ms_now();
+
+    if (old) {
+        result = removeFiles(old);
+    }
+    if (result == 0) {
+        result = addFiles();
+    }
+    //listFiles();
+    spiffsUnmount();
+    double t_add = mkfs_ms_now();
+
+    FILE* fdres = fopen(s_imageName.c_str(), "wb");
+    if (!fdres) {
+        std::cerr << "error: failed to open image file" << std::endl;
+        return 1;
+    }
+    if (fwrite(&s_flashmem[0], 4, s_flashmem.size()/4, fdres) != s_flashmem.size()/4) {
+        result = 1;
+    }
+    if (fclose(fdres) != 0) {
+        result = 1;
+    }
+    double t_save = mkfs_ms_now();
+
+    t_phase[0] = t_format - t_start;
+    t_phase[1] = t_add - t_format;
+    t_phase[2] = t_save - t_add;
+    return result;
+}
+
 int actionPack() {
     if (!dirExists(s_dirName.c_str())) {
         std::cerr << "error: can't read source directory" << std::endl;
         return 1;
     }
-    
-    s_flashmem.resize(s_imageSize, 0xff);
 
-    FILE* fdres = fopen(s_imageName.c_str(), "wb");
-    if (!fdres) {
-        std::cerr << "error: failed to open image file" << std::endl;
+    mkfs_tree_t old = {0};
+    double t_phase[3] = {0};
+    std::string params = "mkspiffs -s " + std::to_string(s_imageSize) + " -p " + std::to_string(s_pageSize) +
+                         " -b " + std::to_string(s_blockSize) + (s_addAllFiles ? " -a" : "") + " -z " + s_compressExt;
+    s_threads = mkfs_threads(s_threads);
+
+    double t_start = mkfs_ms_now();
+    if (mkfs_tree_scan(&s_srcTree, s_dirName.c_str(), skipName, s_threads) != 0) {
         return 1;
     }
+    double t_scan = mkfs_ms_now();
 
-    spiffsFormat();
-    int result = addFiles(s_dirName.c_str(), "/");
-    //listFiles();
-    spiffsUnmount();
+    // only the new and changed files are read when the previous image is updated
+    bool update = ((!s_manifestName.empty()) &&
+                   (mkfs_manifest_load(&old, s_manifestName.c_str(), params.c_str(), s_imageName.c_str()) == 0));
+    if (update) {
+        mkfs_tree_match(&s_srcTree, &old);
+    }
+    // read errors are reported when the file is added
+    mkfs_tree_read(&s_srcTree, s_compressExt.c_str(), s_threads);
+#ifdef CONFIG_SPIFFS_USE_MTIME
+    bool mtime_stored = true;
+#else
+    bool mtime_stored = false;
+#endif
+    if (update) {
+        mkfs_tree_compare(&s_srcTree, &old, mtime_stored);
+    }
+    double t_read = mkfs_ms_now();
+
+    int result = 0;
+    if (update) {
+        std::cerr << "Updating the image of the previous build" << std::endl;
+        result = buildImage(&old, t_phase);
+        if (result != 0) {
+            std::cerr << "Updating the image failed, creating a new image" << std::endl;
+            update = false;
+            s_packFiles = s_gzFiles = s_unchanged = s_removed = 0;
+            s_packBytes = s_gzIn = s_gzOut = 0;
+            mkfs_tree_reset(&s_srcTree);
+            mkfs_tree_read(&s_srcTree, s_compressExt.c_str(), s_threads);
+        }
+    }
+    if (!update) {
+        result = buildImage(NULL, t_phase);
+    }
+    if ((result == 0) && (!s_manifestName.empty())) {
+        mkfs_manifest_save(&s_srcTree, s_manifestName.c_str(), params.c_str(), s_imageName.c_str());
+    }
 
-    fwrite(&s_flashmem[0], 4, s_flashmem.size()/4, fdres);
-    fclose(fdres);
+    // summary on stderr, stdout only lists the added files
+    std::cerr << s_packFiles << " files, " << s_packBytes << " bytes added";
+    if (update) {
+        std::cerr << ", " << s_unchanged << " unchanged, " << s_removed << " removed";
+    }
+    std::cerr << std::endl;
+    if (s_gzFiles) {
+        std::cerr << s_gzFiles << " files compressed, " << s_gzIn << " -> " << s_gzOut << " bytes ("
+                  << (100 * (s_gzIn - s_gzOut) / s_gzIn) << "% saved)" << std::endl;
+    }
+    std::cerr << "Time: scan " << (t_scan - t_start) << " ms, read " << (t_read - t_scan) << " ms ("
+              << s_threads << " threads), " << (update ? "mount " : "format ") << t_phase[0] << " ms, add files "
+              << t_phase[1] << " ms, save image " << t_phase[2] << " ms" << std::endl;
 
+    mkfs_tree_free(&s_srcTree);
+    mkfs_tree_free(&old);
     return result;
 }
 
@@ -669,12 +766,18 @@ void processArgs(int argc, const char** argv) {
     TCLAP::ValueArg<int> blockSizeArg( "b", "block", "fs block size, in bytes", false, 4096, "number" );
     TCLAP::SwitchArg addAllFilesArg( "a", "all-files", "when creating an image, include files which are normally ignored; currently only applies to '.DS_Store' files and '.git' directories", false);
     TCLAP::ValueArg<int> debugArg( "d", "debug", "Debug level. 0 means no debug output.", false, 0, "0-5" );
+    TCLAP::ValueArg<std::string> compressArg( "z", "compress", "when creating an image, store files with these extensions gzip compressed as '<name>.gz'", false, "", ".ext1,.ext2,..." );
+    TCLAP::ValueArg<int> jobsArg( "j", "jobs", "number of threads scanning and reading the source directory, 0 means one for each CPU", false, 0, "number" );
+    TCLAP::ValueArg<std::string> manifestArg( "m", "manifest", "when creating an image, update the image of the previous build: only the files changed since are written", false, "", "manifest_file" );
 
     cmd.add( imageSizeArg );
     cmd.add( pageSizeArg );
     cmd.add( blockSizeArg );
     cmd.add( addAllFilesArg );
     cmd.add( debugArg );
+    cmd.add( compressArg );
+    cmd.add( jobsArg );
+    cmd.add( manifestArg );
     std::vector<TCLAP::Arg*> args = {&packArg, &unpackArg, &listArg, &visualizeArg};
     cmd.xorAdd( args );
     cmd.add( outNameArg );
@@ -702,6 +805,9 @@ void processArgs(int argc, const char** argv) {
     s_pageSize  = pageSizeArg.getValue();
     s_blockSize = blockSizeArg.getValue();
     s_addAllFiles = addAllFilesArg.isSet();
+    s_compressExt = compressArg.getValue();
+    s_threads = jobsArg.getValue();
+    s_manifestName = manifestArg.getValue();
 }
 
 int main(int argc, const char * argv[]) {